@@ -0,0 +1,348 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-stage micro-benchmark of the armor detector on a corpus of recorded frames.
+//
+// Usage:
+//   ros2 run armor_detector armor_detector_bench --frames=<dir> [--color=red|blue]
+//     [--opencv_threads=N] [--opencv_baseline]
+//     [--benchmark_format=json] [--benchmark_out=result.json]
+//
+// Every image in <dir> is one frame, docs/test.png is used if no directory is given.
+// Each stage reports the per-frame latency (p50_us, p99_us) and armors_per_sec.
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+// 3rd party
+#include <benchmark/benchmark.h>
+#include <opencv2/opencv.hpp>
+// project
+#include "armor_detector/armor_detector.hpp"
+#include "armor_detector/armor_pose_estimator.hpp"
+#include "rm_utils/opencv_config.hpp"
+#include "rm_utils/url_resolver.hpp"
+
+using namespace fyt;
+using namespace fyt::auto_aim;
+namespace fs = std::filesystem;
+
+namespace {
+struct Frame {
+  cv::Mat rgb;
+  cv::Mat binary;
+  std::vector<Light> lights;
+  // Output of findCandidates(), number images, corners and classes are filled in order
+  Detector::Candidates candidates;
+};
+
+std::string g_frames_dir;
+EnemyColor g_color = EnemyColor::RED;
+std::vector<Frame> g_frames;
+
+std::unique_ptr<Detector> createDetector() {
+  Detector::LightParams l_params = {
+    .min_ratio = 0.08, .max_ratio = 0.4, .max_angle = 40.0, .color_diff_thresh = 25};
+  Detector::ArmorParams a_params = {.min_light_ratio = 0.6,
+                                    .min_small_center_distance = 0.8,
+                                    .max_small_center_distance = 3.2,
+                                    .min_large_center_distance = 3.2,
+                                    .max_large_center_distance = 5.0,
+                                    .max_angle = 35.0};
+  auto detector = std::make_unique<Detector>(160, g_color, l_params, a_params);
+  detector->enable_debug = false;
+
+  fs::path model_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/model/lenet.onnx");
+  fs::path label_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/model/label.txt");
+  detector->classifier = std::make_unique<NumberClassifier>(
+    model_path, label_path, 0.6, std::vector<std::string>{"negative"});
+  detector->corner_corrector = std::make_unique<LightCornerCorrector>();
+  return detector;
+}
+
+// Same intrinsics as rm_bringup/config/camera_info.yaml
+sensor_msgs::msg::CameraInfo::SharedPtr createCameraInfo() {
+  auto camera_info = std::make_shared<sensor_msgs::msg::CameraInfo>();
+  camera_info->width = 1280;
+  camera_info->height = 1024;
+  camera_info->distortion_model = "plumb_bob";
+  camera_info->k = {3230.47207, 0., 607.2527, 0., 3236.03897, 578.62507, 0., 0., 1.};
+  camera_info->d = {-0.311577, 1.233957, 0.000046, 0.005697, 0.000000};
+  return camera_info;
+}
+
+std::vector<fs::path> listFrames() {
+  std::vector<fs::path> paths;
+  if (g_frames_dir.empty()) {
+    paths.emplace_back(
+      utils::URLResolver::getResolvedPath("package://armor_detector/docs/test.png"));
+    return paths;
+  }
+  for (const auto &entry : fs::directory_iterator(g_frames_dir)) {
+    std::string ext = entry.path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (entry.is_regular_file() && (ext == ".png" || ext == ".jpg" || ext == ".bmp")) {
+      paths.emplace_back(entry.path());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+// Load the corpus and run every stage once, so each benchmark gets the real input of its stage
+bool loadFrames() {
+  auto detector = createDetector();
+  for (const auto &path : listFrames()) {
+    Frame frame;
+    frame.rgb = cv::imread(path.string(), cv::IMREAD_COLOR);
+    if (frame.rgb.empty()) {
+      std::cerr << "Failed to read " << path << std::endl;
+      continue;
+    }
+    cv::cvtColor(frame.rgb, frame.rgb, cv::COLOR_BGR2RGB);
+    frame.binary = detector->preprocessImage(frame.rgb).clone();
+    frame.lights = detector->findLights(frame.rgb, frame.binary);
+    frame.candidates = detector->findCandidates(frame.rgb);
+    for (auto &armor : frame.candidates.armors) {
+      armor.number_img = detector->classifier->extractNumber(frame.candidates.gray_img, armor);
+      detector->corner_corrector->correctCorners(armor, frame.candidates.gray_img);
+    }
+    detector->classifier->classifyBatch(frame.candidates.armors);
+    detector->classifier->eraseIgnoreClasses(frame.candidates.armors);
+    g_frames.emplace_back(std::move(frame));
+  }
+  return !g_frames.empty();
+}
+
+// Collects the per-frame latency of a stage and reports it as counters
+class LatencyRecorder {
+public:
+  explicit LatencyRecorder(benchmark::State &state) : state_(state) {
+    samples_.reserve(state.max_iterations);
+  }
+
+  void start() { start_ = std::chrono::steady_clock::now(); }
+
+  void stop(size_t armors_num) {
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+    state_.SetIterationTime(elapsed.count());
+    samples_.push_back(elapsed.count());
+    total_time_ += elapsed.count();
+    total_armors_ += armors_num;
+  }
+
+  void report() {
+    if (samples_.empty()) {
+      return;
+    }
+    std::sort(samples_.begin(), samples_.end());
+    auto percentile = [this](double p) {
+      size_t index = static_cast<size_t>(p * (samples_.size() - 1) + 0.5);
+      return samples_[index] * 1e6;
+    };
+    state_.counters["p50_us"] = percentile(0.50);
+    state_.counters["p99_us"] = percentile(0.99);
+    state_.counters["armors_per_sec"] = total_time_ > 0 ? total_armors_ / total_time_ : 0.0;
+    state_.counters["frames"] = static_cast<double>(g_frames.size());
+  }
+
+private:
+  benchmark::State &state_;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<double> samples_;
+  double total_time_ = 0;
+  size_t total_armors_ = 0;
+};
+
+const Frame &nextFrame(size_t &index) { return g_frames[index++ % g_frames.size()]; }
+
+// The stages modify the armors, so each iteration works on a copy of the loaded ones
+std::vector<Armor> cloneArmors(const std::vector<Armor> &armors) {
+  std::vector<Armor> copies;
+  copies.reserve(armors.size());
+  for (const auto &armor : armors) {
+    copies.emplace_back(armor.clone());
+  }
+  return copies;
+}
+
+void BM_PreprocessImage(benchmark::State &state) {
+  auto detector = createDetector();
+  LatencyRecorder recorder(state);
+  size_t index = 0;
+  for (auto _ : state) {
+    const Frame &frame = nextFrame(index);
+    recorder.start();
+    cv::Mat binary = detector->preprocessImage(frame.rgb);
+    benchmark::DoNotOptimize(binary);
+    recorder.stop(frame.candidates.armors.size());
+  }
+  recorder.report();
+}
+
+void BM_FindLights(benchmark::State &state) {
+  auto detector = createDetector();
+  LatencyRecorder recorder(state);
+  size_t index = 0;
+  for (auto _ : state) {
+    const Frame &frame = nextFrame(index);
+    // findLights() reads the (R - B) plane of the last preprocessed frame
+    detector->preprocessImage(frame.rgb);
+    recorder.start();
+    auto lights = detector->findLights(frame.rgb, frame.binary);
+    benchmark::DoNotOptimize(lights);
+    recorder.stop(frame.candidates.armors.size());
+  }
+  recorder.report();
+}
+
+void BM_MatchLights(benchmark::State &state) {
+  auto detector = createDetector();
+  LatencyRecorder recorder(state);
+  size_t index = 0;
+  for (auto _ : state) {
+    const Frame &frame = nextFrame(index);
+    recorder.start();
+    auto armors = detector->matchLights(frame.lights);
+    benchmark::DoNotOptimize(armors);
+    recorder.stop(frame.candidates.armors.size());
+  }
+  recorder.report();
+}
+
+void BM_ExtractNumber(benchmark::State &state) {
+  auto detector = createDetector();
+  LatencyRecorder recorder(state);
+  size_t index = 0;
+  for (auto _ : state) {
+    const Frame &frame = nextFrame(index);
+    recorder.start();
+    for (const auto &armor : frame.candidates.armors) {
+      cv::Mat number_img = detector->classifier->extractNumber(frame.candidates.gray_img, armor);
+      benchmark::DoNotOptimize(number_img);
+    }
+    recorder.stop(frame.candidates.armors.size());
+  }
+  recorder.report();
+}
+
+void BM_Classify(benchmark::State &state) {
+  auto detector = createDetector();
+  LatencyRecorder recorder(state);
+  size_t index = 0;
+  std::vector<Armor> armors;
+  for (auto _ : state) {
+    const Frame &frame = nextFrame(index);
+    armors = cloneArmors(frame.candidates.armors);
+    recorder.start();
+    for (auto &armor : armors) {
+      detector->classifier->classify(armor.number_img, armor);
+    }
+    recorder.stop(armors.size());
+  }
+  recorder.report();
+}
+
+void BM_CorrectCorners(benchmark::State &state) {
+  auto detector = createDetector();
+  LatencyRecorder recorder(state);
+  size_t index = 0;
+  std::vector<Armor> armors;
+  for (auto _ : state) {
+    const Frame &frame = nextFrame(index);
+    armors = cloneArmors(frame.candidates.armors);
+    recorder.start();
+    for (auto &armor : armors) {
+      detector->corner_corrector->correctCorners(armor, frame.candidates.gray_img);
+    }
+    recorder.stop(armors.size());
+  }
+  recorder.report();
+}
+
+void BM_ExtractArmorPoses(benchmark::State &state) {
+  ArmorPoseEstimator estimator(createCameraInfo());
+  estimator.enableBA(state.range(0) != 0);
+  LatencyRecorder recorder(state);
+  size_t index = 0;
+  std::vector<rm_interfaces::msg::Armor> armors_msg;
+  for (auto _ : state) {
+    const Frame &frame = nextFrame(index);
+    recorder.start();
+    estimator.extractArmorPoses(
+      frame.candidates.armors, Eigen::Matrix3d::Identity(), std::nullopt, armors_msg);
+    recorder.stop(frame.candidates.armors.size());
+  }
+  recorder.report();
+}
+
+void registerBenchmarks() {
+  auto configure = [](benchmark::internal::Benchmark *b) {
+    b->UseManualTime()->Unit(benchmark::kMicrosecond);
+  };
+  configure(benchmark::RegisterBenchmark("preprocessImage", BM_PreprocessImage));
+  configure(benchmark::RegisterBenchmark("findLights", BM_FindLights));
+  configure(benchmark::RegisterBenchmark("matchLights", BM_MatchLights));
+  configure(benchmark::RegisterBenchmark("extractNumber", BM_ExtractNumber));
+  configure(benchmark::RegisterBenchmark("classify", BM_Classify));
+  configure(benchmark::RegisterBenchmark("correctCorners", BM_CorrectCorners));
+  configure(benchmark::RegisterBenchmark("extractArmorPoses", BM_ExtractArmorPoses)
+              ->ArgName("ba")
+              ->Arg(0)
+              ->Arg(1));
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  // Remaining arguments are ours
+  utils::OpenCVConfig opencv_config;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--frames=", 9) == 0) {
+      g_frames_dir = argv[i] + 9;
+    } else if (std::strcmp(argv[i], "--color=blue") == 0) {
+      g_color = EnemyColor::BLUE;
+    } else if (std::strcmp(argv[i], "--color=red") == 0) {
+      g_color = EnemyColor::RED;
+    } else if (std::strcmp(argv[i], "--opencv_baseline") == 0) {
+      opencv_config.baseline = true;
+    } else if (std::strncmp(argv[i], "--opencv_threads=", 17) == 0) {
+      opencv_config.threads = std::atoi(argv[i] + 17);
+    } else {
+      std::cerr << "Unknown argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  if (!loadFrames()) {
+    std::cerr << "No frames loaded" << std::endl;
+    return 1;
+  }
+  std::cerr << "Loaded " << g_frames.size() << " frames" << std::endl;
+  std::cerr << "OpenCV: " << utils::applyOpenCVConfig(opencv_config) << std::endl;
+
+  registerBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,52 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_DETECTOR_ADAPTIVE_THRESHOLD_HPP_
+#define ARMOR_DETECTOR_ADAPTIVE_THRESHOLD_HPP_
+
+// std
+#include <array>
+#include <cstdint>
+
+namespace fyt::auto_aim {
+
+// Online binary threshold that keeps the ratio of pixels above it near a target, so that the
+// number of contours stays bounded under any lighting. It works on a histogram of the gray
+// image, which the preprocessing pass collects from a subsampled grid
+class AdaptiveThreshold {
+public:
+  using Histogram = std::array<uint32_t, 256>;
+
+  // The histogram takes every SUBSAMPLE-th pixel of every SUBSAMPLE-th row
+  static constexpr int SUBSAMPLE = 4;
+
+  struct Params {
+    bool enable = false;
+    // Target ratio of the pixels above the threshold
+    double target_ratio = 0.002;
+    // The threshold is kept while its ratio is within [target / hysteresis, target * hysteresis]
+    double hysteresis = 2.0;
+    // Fraction of the distance to the target threshold moved in a frame
+    double gain = 0.3;
+    int min_thres = 60;
+    int max_thres = 250;
+  };
+
+  // Return: the threshold of the next frame given the histogram of a frame binarized by thres
+  static int update(const Histogram &histogram, int thres, const Params &params) noexcept;
+};
+
+}  // namespace fyt::auto_aim
+
+#endif  // ARMOR_DETECTOR_ADAPTIVE_THRESHOLD_HPP_
@@ -20,7 +20,9 @@
 #define ARMOR_DETECTOR_DETECTOR_HPP_
 
 // std
+#include <array>
 #include <cmath>
+#include <mutex>
 #include <rm_utils/common.hpp>
 #include <string>
 #include <vector>
@@ -28,11 +30,17 @@
 #include <opencv2/core.hpp>
 #include <opencv2/core/types.hpp>
 // project
+#include "armor_detector/adaptive_threshold.hpp"
+#include "armor_detector/cascade_filter.hpp"
+#include "armor_detector/classification_cache.hpp"
+#include "armor_detector/keypoint_detector.hpp"
+#include "armor_detector/light_tracker.hpp"
 #include "armor_detector/light_corner_corrector.hpp"
 #include "armor_detector/types.hpp"
 #include "armor_detector/number_classifier.hpp"
 #include "rm_interfaces/msg/debug_armors.hpp"
 #include "rm_interfaces/msg/debug_lights.hpp"
+#include "rm_utils/bayer.hpp"
 
 namespace fyt::auto_aim {
 class Detector {
@@ -58,43 +66,242 @@ public:
     double max_angle;
   };
 
+  // Where preprocessImage() runs
+  enum class PreprocessBackend {
+    CPU,
+    // OpenCL through cv::UMat (T-API), e.g. an integrated GPU. A raw frame stays on the CPU
+    OPENCL
+  };
+
+  // Back end used to extract lights from the binary image
+  enum class LightExtractor {
+    // cv::findContours + cv::minAreaRect
+    CONTOUR,
+    // Run-length connected component labeling, lights are built from blob moments
+    CONNECTED_COMPONENTS
+  };
+
   Detector(const int &bin_thres, const EnemyColor &color, const LightParams &l,
            const ArmorParams &a);
 
   std::vector<Armor> detect(const cv::Mat &input) noexcept;
+  // Only search inside the roi, results are still in the coordinate of input
+  std::vector<Armor> detect(const cv::Mat &input, const cv::Rect &roi) noexcept;
+
+  // detect() split into two stages for pipelined detection. The candidates own everything the
+  // second stage needs, so the first stage can go on with the next frame in the meantime
+  struct Candidates {
+    cv::Mat gray_img;
+    std::vector<Armor> armors;
+    // Offset of the search window in the input image
+    cv::Point2f offset;
+    // Found by the keypoint detector, number and corners are final
+    bool classified = false;
+    // On an audit frame of the cascade, the pairs it rejects are kept and flagged here, so
+    // that the second stage measures its misses. Empty on the other frames
+    std::vector<char> cascade_rejected;
+  };
+  // Stage 1: preprocess, find lights, match them and reject the obvious negatives
+  Candidates findCandidates(const cv::Mat &input, const cv::Rect &roi = cv::Rect()) noexcept;
+  // Stage 2: number extraction, corner correction and classification, results are in the
+  // coordinate of input. May run concurrently with findCandidates(), but not with itself
+  std::vector<Armor> classifyCandidates(Candidates &candidates) noexcept;
 
+  // Single pass over the rgb image, also produces the gray and (R - B) images. A CV_8UC1 input
+  // is a raw frame of bayer_pattern, read without demosaicing
   cv::Mat preprocessImage(const cv::Mat &input) noexcept;
   std::vector<Light> findLights(const cv::Mat &rbg_img,
                                 const cv::Mat &binary_img) noexcept;
+  // Same as above, into lights whose capacity is reused
+  void findLights(const cv::Mat &rbg_img, const cv::Mat &binary_img,
+                  std::vector<Light> &lights) noexcept;
   std::vector<Armor> matchLights(const std::vector<Light> &lights) noexcept;
 
-  // For debug usage
-  cv::Mat getAllNumbersImage() const noexcept;
-  void drawResults(cv::Mat &img) const noexcept;
+  // For debug usage, stateless and safe to call from another thread with the results
+  static cv::Mat getAllNumbersImage(const std::vector<Armor> &armors) noexcept;
+  static void drawResults(cv::Mat &img, const std::vector<Armor> &armors) noexcept;
 
   // Parameters
+  // Initial value of the adaptive threshold while it is enabled
   int binary_thres;
+  // Updated from the frames searched without roi
+  AdaptiveThreshold::Params adaptive_thres;
   EnemyColor detect_color;
   LightParams light_params;
   ArmorParams armor_params;
+  LightExtractor light_extractor = LightExtractor::CONTOUR;
+  // Rejection of the obvious negatives before the number classification
+  CascadeFilter::Params cascade;
+  // Coarse-to-fine search of the frames searched without roi
+  struct CoarseSearchParams {
+    bool enable = false;
+    // The full frame is searched if the regions cover more than this ratio of it
+    double max_area_ratio = 0.5;
+  };
+  CoarseSearchParams coarse_search;
+  // Reuse of the pairing results of the lights that barely moved. Off while enable_debug is
+  // true, so that every pair is in debug_armors
+  LightTracker::Params light_tracking;
+  // Falls back to CPU if OpenCL is disabled or fails
+  PreprocessBackend preprocess_backend = PreprocessBackend::CPU;
+  // Layout of a CV_8UC1 input, the search window of a raw frame is aligned to the 2x2 cells
+  utils::BayerPattern bayer_pattern = utils::BayerPattern::RGGB;
 
+  // Learned front end, replaces light finding, matching, corner correction and the number
+  // classification if set. The classifier then only filters the ignored classes
+  std::unique_ptr<ArmorKeypointDetector> keypoint_detector;
   std::unique_ptr<NumberClassifier> classifier;
+  // Reuse of the classification of the last frame, read by the second stage
+  ClassificationCache::Params number_cache;
   std::unique_ptr<LightCornerCorrector> corner_corrector;
+  // Turned off under overload, read by the second stage
+  bool enable_corner_correction = true;
+
+  // Binary threshold of the last frame
+  int binaryThreshold() const noexcept { return last_thres_; }
+  // Armors of the last frame that reused a cached classification, read by the second stage
+  int numberCacheHits() const noexcept { return last_cache_hits_; }
+  // Pairs rejected by the cascade in the last frame, read by the first stage
+  int cascadeRejects() const noexcept { return last_cascade_rejects_; }
+  // Rejected pairs classified by the audit of the last frame, and those the classifier took
+  // for an armor, read by the second stage
+  int cascadeAudited() const noexcept { return last_cascade_audited_; }
+  int cascadeMisses() const noexcept { return last_cascade_misses_; }
 
-  // Debug msgs
+  // Debug msgs, debug_lights and debug_armors are only filled if enable_debug is true
+  bool enable_debug = true;
   cv::Mat binary_img;
   rm_interfaces::msg::DebugLights debug_lights;
   rm_interfaces::msg::DebugArmors debug_armors;
 
 private:
+  // Append the lights found in the binary image, diff_img is the (R - B) plane of rgb_img or
+  // empty
+  void findLightsByContours(const cv::Mat &rgb_img, const cv::Mat &binary_img,
+                            const cv::Mat &diff_img, std::vector<Light> &lights) noexcept;
+  void findLightsByComponents(const cv::Mat &rgb_img, const cv::Mat &binary_img,
+                              const cv::Mat &diff_img, std::vector<Light> &lights) noexcept;
+  // Coarse-to-fine search of a full rgb frame. The coarse pass reads every second row and ORs
+  // the pixel pairs, so that a light of a few pixels still shows up, and also fills the
+  // histogram. Return: false if the regions around its blobs would cover too much of the frame
+  bool searchCoarse(const cv::Mat &rgb_img) noexcept;
+  // preprocessImage() inside regions_ only, the planes are zero elsewhere
+  cv::Mat preprocessRegions(const cv::Mat &rgb_img) noexcept;
+  // findLights() inside regions_ only
+  void findLightsInRegions(const cv::Mat &rgb_img, const cv::Mat &binary_img,
+                           std::vector<Light> &lights) noexcept;
+  // preprocessImage() of a raw frame, every 2x2 cell takes its R, B and the mean of its two G
+  cv::Mat preprocessBayer(const cv::Mat &bayer_img) noexcept;
+  // preprocessImage() on the OpenCL device, the planes are downloaded into the host pools.
+  // Return: an empty Mat if OpenCL failed
+  cv::Mat preprocessOpenCL(const cv::Mat &rgb_img) noexcept;
+  // Round the roi outwards to whole 2x2 cells for a raw frame, so that its pattern is kept
+  cv::Rect alignWindow(const cv::Mat &input, const cv::Rect &roi) const noexcept;
+
+  // Decide the color of a light by the mean of (R - B)
+  void judgeColor(Light &light, int sum_diff, int n) const noexcept;
+
+  // Drop the pairs failing the cascade, or flag them on an audit frame
+  void filterCandidates(Candidates &candidates, const cv::Mat &binary_img) noexcept;
+  // offset moves the armors into the coordinate of the input, for the classification cache
+  void classifyArmors(std::vector<Armor> &armors,
+                      const cv::Mat &gray_img,
+                      const cv::Point2f &offset,
+                      std::vector<char> &cascade_rejected) noexcept;
+  // Count the flagged pairs the classifier did not reject, then drop them
+  void auditCascade(std::vector<Armor> &armors, std::vector<char> &cascade_rejected) noexcept;
+  // Move the results of a sub image back to the coordinate of the input
+  void shiftDebugResults(const cv::Point2f &offset) noexcept;
+  static void shiftLight(Light &light, const cv::Point2f &offset) noexcept;
+  static void shiftArmor(Armor &armor, const cv::Point2f &offset) noexcept;
+
   bool isLight(const Light &possible_light) noexcept;
-  bool containLight(const int i,const int j,const std::vector<Light> &lights) noexcept;
+  // Fill light_table_ with the x-sorted lights
+  void buildLightTable(const std::vector<Light> &lights) noexcept;
+  bool containLight(const int i, const int j) const noexcept;
   ArmorType isArmor(const Light &light_1, const Light &light_2) noexcept;
 
+  // Threshold of the next frame, binary_thres if the adaptive threshold is disabled
+  int nextThreshold() noexcept;
+  // Add the subsampled gray values of the rows [begin, end) of gray_img_ to histogram_
+  void accumulateHistogram(int begin, int end) noexcept;
+
+  // Only used by the second stage
+  ClassificationCache number_cache_;
+  // Result of the cache lookup of each armor, and the armors left to classify
+  std::vector<int> cache_ages_;
+  std::vector<Armor> to_classify_;
+  int last_cache_hits_ = 0;
+  int last_cascade_audited_ = 0;
+  int last_cascade_misses_ = 0;
+
+  // Only used by the first stage
+  int last_cascade_rejects_ = 0;
+  int cascade_frames_ = 0;
+
+  int adaptive_value_ = -1;
+  int last_thres_ = 0;
+  AdaptiveThreshold::Histogram histogram_{};
+  std::mutex histogram_mutex_;
+
   cv::Mat gray_img_;
+  // Half size binary image of the coarse pass, and the regions refined at full resolution
+  cv::Mat coarse_binary_;
+  std::vector<cv::Rect> regions_;
+  // R - B of each pixel, CV_16SC1
+  cv::Mat color_diff_img_;
+
+  // Device buffers of the OpenCL path, kept from frame to frame. They are allocated in host
+  // accessible memory, so that the transfers of an integrated GPU are plain copies
+  cv::UMat rgb_umat_{cv::USAGE_ALLOCATE_HOST_MEMORY};
+  cv::UMat gray_umat_{cv::USAGE_ALLOCATE_HOST_MEMORY};
+  cv::UMat binary_umat_{cv::USAGE_ALLOCATE_HOST_MEMORY};
+  cv::UMat red_umat_{cv::USAGE_ALLOCATE_HOST_MEMORY};
+  cv::UMat blue_umat_{cv::USAGE_ALLOCATE_HOST_MEMORY};
+  cv::UMat diff_umat_{cv::USAGE_ALLOCATE_HOST_MEMORY};
+
+  // The gray and binary images of a frame go to the second stage and the debug thread, so they
+  // come from pools whose buffers are reused once no frame refers to them
+  static constexpr size_t IMAGE_POOL_SIZE = 8;
+  std::array<cv::Mat, IMAGE_POOL_SIZE> gray_pool_;
+  std::array<cv::Mat, IMAGE_POOL_SIZE> binary_pool_;
+  static cv::Mat pooledImage(std::array<cv::Mat, IMAGE_POOL_SIZE> &pool,
+                             const cv::Size &size,
+                             int type) noexcept;
+
+  // Buffers reused by the connected component extractor
+  struct Run {
+    int y, x_begin, x_end;
+  };
+  struct BlobStats {
+    int area;
+    double sum_x, sum_y, sum_xx, sum_xy, sum_yy;
+    // (R - B) of the edge pixels, as the contour extractor measures it
+    int sum_diff;
+    int edge_pixels;
+  };
+  std::vector<Run> runs_;
+  std::vector<int> run_parents_;
+  std::vector<BlobStats> blobs_;
+  // Buffers reused by the contour extractor
+  std::vector<std::vector<cv::Point>> contours_;
+  std::vector<cv::Vec4i> hierarchy_;
+  // Number of armors of the last frame, the next one reserves as many
+  size_t last_armors_num_ = 0;
+
+  // Structure-of-arrays copy of the lights used by the pairing stage
+  struct LightTable {
+    std::vector<float> center_x, center_y;
+    std::vector<float> top_x, top_y;
+    std::vector<float> bottom_x, bottom_y;
+    std::vector<float> min_y, max_y;
+    std::vector<float> length, width;
+  } light_table_;
 
   std::vector<Light> lights_;
-  std::vector<Armor> armors_;
+  LightTracker light_tracker_;
+  // Armor parameters of the verdicts in light_tracker_
+  ArmorParams tracked_armor_params_{};
 };
 
 } // namespace fyt::auto_aim
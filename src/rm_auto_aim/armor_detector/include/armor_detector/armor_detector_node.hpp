@@ -37,18 +37,38 @@
 #include <sensor_msgs/msg/image.hpp>
 #include <visualization_msgs/msg/marker_array.hpp>
 // std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 // project
 #include "armor_detector/armor_detector.hpp"
 #include "armor_detector/armor_pose_estimator.hpp"
+#include "armor_detector/keypoint_detector.hpp"
 #include "armor_detector/number_classifier.hpp"
+#include "armor_detector/overload_controller.hpp"
 #include "rm_interfaces/msg/armors.hpp"
+#include "rm_interfaces/msg/camera_control.hpp"
+#include "rm_interfaces/msg/serial_receive_data.hpp"
 #include "rm_interfaces/msg/target.hpp"
 #include "rm_interfaces/srv/set_mode.hpp"
+#include "rm_utils/attitude_cache.hpp"
+#include "rm_utils/debug_image.hpp"
 #include "rm_utils/heartbeat.hpp"
 #include "rm_utils/logger/log.hpp"
+#include "rm_utils/perception_scheduler.hpp"
+#include "rm_utils/sample_dumper.hpp"
+#include "rm_utils/spsc_queue.hpp"
+#include "rm_utils/startup_report.hpp"
 
 namespace fyt::auto_aim {
 
@@ -58,42 +78,179 @@ namespace fyt::auto_aim {
 class ArmorDetectorNode : public rclcpp::Node {
 public:
   ArmorDetectorNode(const rclcpp::NodeOptions &options);
+  ~ArmorDetectorNode() override;
 
 private:
+  // Snapshot of one frame for the debug thread
+  struct DebugFrame {
+    sensor_msgs::msg::Image::ConstSharedPtr img_msg;
+    cv::Mat binary_img;
+    std::vector<Armor> armors;
+    rm_interfaces::msg::DebugLights debug_lights;
+    rm_interfaces::msg::DebugArmors debug_armors;
+    cv::Rect roi;
+    cv::Point sensor_offset;
+    double latency;
+  };
+
+  // Runtime tunable parameters. Every change publishes a new immutable
+  // snapshot and each frame reads the newest one once (RCU)
+  struct DetectorParams {
+    int binary_thres;
+    AdaptiveThreshold::Params adaptive_thres;
+    EnemyColor detect_color;
+    Detector::LightParams light;
+    Detector::ArmorParams armor;
+    Detector::LightExtractor light_extractor;
+    LightTracker::Params light_tracking;
+    Detector::CoarseSearchParams coarse_search;
+    CascadeFilter::Params cascade;
+    double classifier_threshold;
+    ClassificationCache::Params number_cache;
+    bool debug;
+  };
+
+  // One frame passing through the detection stages
+  struct DetectionFrame {
+    sensor_msgs::msg::Image::ConstSharedPtr img_msg;
+    std::shared_ptr<const DetectorParams> params;
+    Eigen::Matrix3d imu_to_camera;
+    // Search window in the full frame
+    cv::Rect roi;
+    // Offset of the sensor AOI of the image in the full frame, the results are moved by it
+    cv::Point sensor_offset;
+    Detector::Candidates candidates;
+    // Debug data of stage 1, only filled if debug is true
+    bool debug = false;
+    cv::Mat binary_img;
+    rm_interfaces::msg::DebugLights debug_lights;
+    rm_interfaces::msg::DebugArmors debug_armors;
+  };
+
   void imageCallback(const sensor_msgs::msg::Image::ConstSharedPtr img_msg);
-  // void targetCallback(const rm_interfaces::msg::Target::SharedPtr
-  // target_msg);
+  // Detect the armors of a frame, on the scheduler or in imageCallback
+  void processImage(const sensor_msgs::msg::Image::ConstSharedPtr &img_msg);
+  void targetCallback(const rm_interfaces::msg::Target::SharedPtr target_msg);
+
+  // Fill imu_to_camera_ and t_odom_camera_ at the time of image, return false
+  // if the transform is not available
+  bool lookupCameraPose(const std_msgs::msg::Header &img_header);
+
+  // Project the tracked target into the image to get the search window,
+  // return an empty rect if a full-frame scan is needed
+  cv::Rect getTargetRoi(const rclcpp::Time &img_stamp,
+                        const Eigen::Matrix3d &R_odom_camera,
+                        const Eigen::Vector3d &t_odom_camera,
+                        const cv::Size &img_size);
+  // Window of the whole tracked robot, empty if there is no recent target
+  cv::Rect projectTarget(const rclcpp::Time &img_stamp,
+                         const Eigen::Matrix3d &R_odom_camera,
+                         const Eigen::Vector3d &t_odom_camera,
+                         const cv::Size &img_size);
+
+  // Ask the camera driver for a sensor AOI around the tracked target, or the
+  // full frame if it is lost
+  void requestCameraAoi(const rclcpp::Time &img_stamp,
+                        const cv::Size &full_size);
+  // AOI of the image in the full frame, from the camera info of the same frame
+  cv::Rect getFrameAoi(const sensor_msgs::msg::Image &img);
 
   std::unique_ptr<Detector> initDetector();
 
-  std::vector<Armor>
-  detectArmors(const sensor_msgs::msg::Image::ConstSharedPtr &img_msg);
+  // The models and the pose estimator are loaded in the background while the subscriptions are
+  // set up, the frames are dropped until all of them are done
+  utils::StartupReport startup_;
+  std::future<std::unique_ptr<NumberClassifier>> classifier_future_;
+  std::future<std::unique_ptr<ArmorKeypointDetector>> keypoint_future_;
+  std::future<std::unique_ptr<ArmorPoseEstimator>> pose_estimator_future_;
+  // Guards the futures, the pose estimator is started from the camera info callback and may
+  // finish its step before its future is assigned
+  std::mutex startup_mutex_;
+  // Only touched by the image callbacks
+  bool startup_done_ = false;
+  void finishStartupStep(const std::string &step);
+  // Take the results of the background steps once all of them are done.
+  // Return: true if the node is ready
+  bool finishStartup();
+
+  // Stage 1: tf lookup, search window, preprocessing and light matching
+  bool detectCandidates(const sensor_msgs::msg::Image::ConstSharedPtr &img_msg,
+                        DetectionFrame &frame);
+  // Stage 2: classification, pose estimation and publishing
+  void processCandidates(DetectionFrame &frame);
+  // Runs stage 2 if pipelining is enabled
+  void pipelineLoop();
 
   void createDebugPublishers() noexcept;
   void destroyDebugPublishers() noexcept;
 
   void publishMarkers() noexcept;
 
+  // Rendering and publishing of the debug images run in debug_thread_,
+  // so the armors publishing is never delayed by visualization
+  bool debugFrameDue() noexcept;
+  void pushDebugFrame(DebugFrame &&frame);
+  void debugLoop();
+  void publishDebugFrame(DebugFrame &frame);
+
   void setModeCallback(
       const std::shared_ptr<rm_interfaces::srv::SetMode::Request> request,
       std::shared_ptr<rm_interfaces::srv::SetMode::Response> response);
 
   // Dynamic Parameter
+  void initParamSetters();
+  // Copy the current snapshot, modify it and publish it
+  void updateParams(const std::function<void(DetectorParams &)> &modify);
+  void applyParams(const DetectorParams &params) noexcept;
   rcl_interfaces::msg::SetParametersResult
   onSetParameters(std::vector<rclcpp::Parameter> parameters);
+  // Only accessed through std::atomic_load / std::atomic_store
+  std::shared_ptr<const DetectorParams> params_;
+  std::mutex params_update_mutex_;
+  std::unordered_map<std::string, std::function<void(DetectorParams &,
+                                                     const rclcpp::Parameter &)>>
+      param_setters_;
   rclcpp::Node::OnSetParametersCallbackHandle::SharedPtr
       on_set_parameters_callback_handle_;
 
   // Heartbeat
   HeartBeatPublisher::SharedPtr heartbeat_;
+  // Metrics reported with the heartbeat, registered at the end of the constructor
+  utils::LatencyHistogram *candidates_latency_ = nullptr;
+  utils::LatencyHistogram *armors_latency_ = nullptr;
+  utils::LatencyHistogram *end_to_end_latency_ = nullptr;
+  std::atomic<int64_t> *dropped_frames_ = nullptr;
+  std::atomic<int64_t> *dropped_debug_frames_ = nullptr;
+  std::atomic<int64_t> *pipeline_depth_ = nullptr;
+  std::atomic<int64_t> *binary_thres_gauge_ = nullptr;
+  std::atomic<int64_t> *expired_frames_ = nullptr;
+  std::atomic<int64_t> *number_cache_hits_ = nullptr;
+  std::atomic<int64_t> *ba_skipped_ = nullptr;
+  std::atomic<int64_t> *cascade_rejects_ = nullptr;
+  std::atomic<int64_t> *cascade_audited_ = nullptr;
+  std::atomic<int64_t> *cascade_misses_ = nullptr;
+  std::atomic<int64_t> *overload_degrades_ = nullptr;
+  std::atomic<int64_t> *overload_recovers_ = nullptr;
+  std::atomic<int64_t> *overload_level_ = nullptr;
+
+  // Frame deadline and degraded modes
+  std::unique_ptr<OverloadController> overload_;
+  // Drop the frame if it is past the deadline
+  bool frameExpired(const std_msgs::msg::Header &header);
 
   // Armor Detector
   std::unique_ptr<Detector> detector_;
+  // Cleared with a warning once the detector falls back to the CPU
+  bool preprocess_opencl_ = false;
 
   // Pose Solver
   bool use_ba_;
+  ArmorPoseEstimator::Budget pose_budget_;
   std::unique_ptr<ArmorPoseEstimator> armor_pose_estimator_;
 
+  // Number images of the classified armors, saved for retraining
+  std::unique_ptr<utils::SampleDumper> sample_dumper_;
+
   // Detected armors publisher
   rm_interfaces::msg::Armors armors_msg_;
   rclcpp::Publisher<rm_interfaces::msg::Armors>::SharedPtr armors_pub_;
@@ -112,23 +269,93 @@ private:
 
   // Image subscription
   rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr img_sub_;
+  // Callback group of the image and camera info
+  rclcpp::CallbackGroup::SharedPtr image_group_;
+  rclcpp::SubscriptionOptions image_sub_options_;
 
   // Target subscription
-  // rclcpp::Subscription<rm_interfaces::msg::Target>::SharedPtr target_sub_;
-  // rm_interfaces::msg::Target::SharedPtr tracked_target_;
+  rclcpp::Subscription<rm_interfaces::msg::Target>::SharedPtr target_sub_;
+  rm_interfaces::msg::Target::SharedPtr tracked_target_;
+  std::mutex target_mutex_;
   std::deque<Armor> tracked_armors_;
 
+  // Tracker-guided roi detection
+  struct RoiParams {
+    bool enable;
+    // Force a full-frame scan every N frames
+    int full_scan_interval;
+    // Padding around the target, Unit: m
+    double padding;
+    // Targets older than this are ignored, Unit: s
+    double max_target_age;
+  } roi_params_;
+  int frames_since_full_scan_ = 0;
+  // Written by stage 2, read by stage 1
+  std::atomic<bool> roi_lost_{true};
+  // No armor in the last frame, whatever its window. Written by stage 2 on every frame, read by
+  // stage 1 for the camera AOI
+  std::atomic<bool> aoi_lost_{true};
+
+  // Detector-driven sensor AOI, a smaller AOI raises the frame rate of the
+  // camera and cuts the transfer and demosaicing
+  struct CameraControlParams {
+    bool enable;
+    // Size of the AOI over the window of the target
+    double scale;
+    // Min interval between two AOI changes except back to the full frame, a
+    // change may restart the stream, Unit: s
+    double min_interval;
+  } camera_control_params_;
+  rclcpp::Publisher<rm_interfaces::msg::CameraControl>::SharedPtr
+      camera_control_pub_;
+  // Requested AOI in the full frame, empty for the full frame. Stage 1 only
+  cv::Rect requested_aoi_;
+  int64_t last_aoi_request_ns_ = 0;
+  // AOI of the latest frames by stamp, filled from camera_info
+  struct FrameAoi {
+    int64_t stamp_ns = 0;
+    cv::Rect aoi;
+  };
+  std::array<FrameAoi, 16> frame_aois_;
+  size_t frame_aoi_next_ = 0;
+  std::mutex frame_aoi_mutex_;
+
+  // Pipelined detection, stage 1 runs in imageCallback and stage 2 in
+  // pipeline_thread_, frames are handed over in order
+  bool pipeline_enable_;
+  utils::SpscQueue<DetectionFrame, 4> pipeline_queue_;
+  std::thread pipeline_thread_;
+  std::atomic<bool> pipeline_running_{true};
+
+  // Queue of the shared perception scheduler, the frames are processed there instead of in
+  // imageCallback, -1 if disabled
+  int scheduler_queue_ = -1;
+
   // ReceiveData subscripiton
   std::string odom_frame_;
   Eigen::Matrix3d imu_to_camera_;
+  Eigen::Vector3d t_odom_camera_;
   std::shared_ptr<tf2_ros::Buffer> tf2_buffer_;
   std::shared_ptr<tf2_ros::TransformListener> tf2_listener_;
 
+  // Gimbal attitude fed by serial/receive, looked up without tf2. The process
+  // cache is used instead if the serial driver runs in this process. Together
+  // with the static gimbal to camera transform it gives the camera pose, tf2
+  // is only used if the cache doesn't cover the image stamp
+  bool use_attitude_cache_;
+  utils::AttitudeCache<> attitude_cache_;
+  rclcpp::Subscription<rm_interfaces::msg::SerialReceiveData>::SharedPtr
+      serial_receive_sub_;
+  bool gimbal_to_camera_ready_ = false;
+  Eigen::Matrix3d R_gimbal_camera_;
+  Eigen::Vector3d t_gimbal_camera_;
+
   // Enable/Disable Armor Detector
   rclcpp::Service<rm_interfaces::srv::SetMode>::SharedPtr set_mode_srv_;
 
   // Debug information
-  bool debug_;
+  // Written by the parameter callback, read by both stages
+  std::atomic<bool> debug_;
   std::shared_ptr<rclcpp::ParameterEventHandler> debug_param_sub_;
   std::shared_ptr<rclcpp::ParameterCallbackHandle> debug_cb_handle_;
   rclcpp::Publisher<rm_interfaces::msg::DebugLights>::SharedPtr
@@ -138,6 +365,21 @@ private:
   image_transport::Publisher binary_img_pub_;
   image_transport::Publisher number_img_pub_;
   image_transport::Publisher result_img_pub_;
+  // Protects the debug publishers
+  std::mutex debug_pub_mutex_;
+
+  // Debug thread, the oldest frame is dropped if the queue is full
+  std::thread debug_thread_;
+  std::mutex debug_queue_mutex_;
+  std::condition_variable debug_queue_cv_;
+  std::deque<DebugFrame> debug_queue_;
+  std::size_t debug_queue_size_;
+  bool debug_running_ = true;
+  // Decimation of the debug output, 0 means no limit
+  double debug_max_fps_;
+  std::chrono::steady_clock::time_point last_debug_time_;
+  // Downscaling and cropping of the debug images
+  utils::DebugImageParams debug_image_params_;
 };
 
 } // namespace fyt::auto_aim
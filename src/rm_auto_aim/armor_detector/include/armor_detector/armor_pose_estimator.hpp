@@ -17,7 +17,10 @@
 
 // std
 #include <array>
+#include <cmath>
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 // OpenCV
 #include <opencv2/opencv.hpp>
@@ -31,32 +34,110 @@
 // project
 #include "armor_detector/ba_solver.hpp"
 #include "rm_interfaces/msg/armor.hpp"
-#include "rm_utils/math/pnp_solver.hpp"
+#include "rm_utils/math/planar_pnp_solver.hpp"
+#include "rm_utils/math/undistorter.hpp"
 
 namespace fyt::auto_aim {
 class ArmorPoseEstimator {
 public:
   explicit ArmorPoseEstimator(sensor_msgs::msg::CameraInfo::SharedPtr camera_info);
 
-  std::vector<rm_interfaces::msg::Armor> extractArmorPoses(const std::vector<Armor> &armors,
-                                               Eigen::Matrix3d R_imu_camera);
+  // Yaw of the tracked target predicted to the time of image
+  struct TargetYaw {
+    ArmorNumber id;
+    double yaw;
+    int armors_num;
+  };
+
+  // Which armors get the costly refinements. Disabled, every armor gets all of them
+  struct Budget {
+    bool enable = false;
+    // BA only on armors with lights at least this long (px) and at most this far (m), the yaw
+    // BA recovers on a smaller or farther armor is within the noise of its corners
+    double ba_min_light_length = 12.0;
+    double ba_max_distance = 6.0;
+    // While a target is tracked, BA only on the armors of its number
+    bool ba_target_only = true;
+    // On the armors of the tracked target, pick the PnP solution by the predicted yaw of the
+    // target instead of the tilt of the lights
+    bool target_disambiguation = true;
+  };
+
+  using Solutions = std::array<PlanarPnPSolver<Armor::N_LANDMARKS>::Solution, 2>;
+
+  // target_yaw is used to warm start BA for the armors of the tracked target
+  std::vector<rm_interfaces::msg::Armor> extractArmorPoses(
+    const std::vector<Armor> &armors,
+    Eigen::Matrix3d R_imu_camera,
+    const std::optional<TargetYaw> &target_yaw = std::nullopt);
+  // Same as above but write into armors_msg to reuse its memory, armors are solved in parallel
+  void extractArmorPoses(const std::vector<Armor> &armors,
+                         const Eigen::Matrix3d &R_imu_camera,
+                         const std::optional<TargetYaw> &target_yaw,
+                         std::vector<rm_interfaces::msg::Armor> &armors_msg);
 
   void enableBA(bool enable) { use_ba_ = enable; }
 
+  void setBudget(const Budget &budget) { budget_ = budget; }
+  const Budget &budget() const { return budget_; }
+  // Armors of the last call on which the budget skipped BA
+  int baSkipped() const;
+
+  // Whether the budget spends BA on the armor, distance is of its PnP solution
+  static bool worthBA(const Budget &budget, const Armor &armor, double distance,
+                      const std::optional<TargetYaw> &target_yaw);
+  // Put first the PnP solution of which the yaw is nearest an armor of the tracked target
+  // Return: false if the target isn't of the armor or the reprojection errors already tell the
+  // solutions apart, the solutions are untouched then
+  static bool selectByTargetYaw(const Armor &armor, const Eigen::Matrix3d &R_imu_camera,
+                                const TargetYaw &target_yaw, Solutions &solutions);
+  // Yaw of an armor in the imu frame, the same as the one of the tracker
+  static double armorYaw(const Eigen::Matrix3d &R_imu_armor) {
+    return std::atan2(-R_imu_armor(0, 1), R_imu_armor(1, 1));
+  }
+
 private:
+  // Solvers are not thread-safe, each armor being solved uses its own workspace
+  struct Workspace {
+    std::unique_ptr<BaSolver> ba_solver;
+    Solutions solutions;
+    // Undistorted landmarks of the armor
+    std::array<cv::Point2f, Armor::N_LANDMARKS> image_points;
+  };
+  Workspace createWorkspace() const;
+
+  bool solveArmorPose(const Armor &armor, const Eigen::Matrix3d &R_imu_camera,
+                      const std::optional<TargetYaw> &target_yaw, Workspace &workspace,
+                      rm_interfaces::msg::Armor &armor_msg, char &ba_skipped) const;
+
   // Select the best PnP solution according to the armor's direction in image, only available for SOLVEPNP_IPPE
-  void sortPnPResult(const Armor &armor, std::vector<cv::Mat> &rvecs,
-                     std::vector<cv::Mat> &tvecs) const;
+  void sortPnPResult(const Armor &armor, Solutions &solutions) const;
+
+  // Solutions with a reprojection error ratio above this are told apart by the errors alone
+  static constexpr double PROJECT_ERR_THRES = 3.0;
 
   // Convert a rotation matrix to RPY
   static Eigen::Vector3d rotationMatrixToRPY(const Eigen::Matrix3d &R);
 
   bool use_ba_;
+  Budget budget_;
 
   Eigen::Matrix3d R_gimbal_camera_;
 
-  std::unique_ptr<BaSolver> ba_solver_;
-  std::unique_ptr<PnPSolver> pnp_solver_;
+  sensor_msgs::msg::CameraInfo::SharedPtr camera_info_;
+  cv::Point2f image_center_;
+
+  // Distortion table of the camera, shared by all armors
+  std::unique_ptr<Undistorter> undistorter_;
+  // IPPE solver specialized for the armor landmarks, without distortion
+  std::unique_ptr<PlanarPnPSolver<Armor::N_LANDMARKS>> pnp_solver_;
+  int small_armor_model_;
+  int large_armor_model_;
+
+  std::vector<Workspace> workspaces_;
+  // Per armor result of the last call, char instead of bool to be written in parallel
+  std::vector<char> success_;
+  std::vector<char> ba_skipped_;
 };
 } // namespace fyt::auto_aim
 #endif // ARMOR_POSE_ESTIMATOR_HPP_
\ No newline at end of file
@@ -20,6 +20,7 @@
 // std
 #include <array>
 #include <cstddef>
+#include <optional>
 #include <tuple>
 #include <vector>
 // 3rd party
@@ -49,13 +50,46 @@ public:
   BaSolver(std::array<double, 9> &camera_matrix,
            std::vector<double> &dist_coeffs);
 
-  // Solve the armor pose using the BA algorithm, return the optimized rotation
+  // Solve the armor pose using the BA algorithm, return the optimized rotation.
+  // image_points: the undistorted landmarks of armor, the projection is pinhole.
+  // yaw_hint (e.g. predicted by the tracker) is used as the initial value if
+  // it fits the observation better than the PnP result
   Eigen::Matrix3d solveBa(const Armor &armor,
+                          const std::array<cv::Point2f, Armor::N_LANDMARKS> &image_points,
                           const Eigen::Vector3d &t_camera_armor,
                           const Eigen::Matrix3d &R_camera_armor,
-                          const Eigen::Matrix3d &R_imu_camera) noexcept;
+                          const Eigen::Matrix3d &R_imu_camera,
+                          const std::optional<double> &yaw_hint =
+                              std::nullopt) noexcept;
 
 private:
+  // Reprojection problem of a single yaw angle
+  struct YawProblem {
+    Eigen::Matrix3d R_camera_imu;
+    Eigen::Vector3d t;
+    // Object points rotated by the armor pitch
+    std::array<Eigen::Vector3d, Armor::N_LANDMARKS> points;
+    std::array<Eigen::Vector2d, Armor::N_LANDMARKS> observations;
+  };
+
+  // Huber-weighted cost, also fill the gradient and the Gauss-Newton hessian
+  // if they are not null
+  double evaluate(const YawProblem &problem, double yaw, double *gradient,
+                  double *hessian) const noexcept;
+
+  // Levenberg-Marquardt on the yaw with analytic jacobians, return false if it
+  // diverges
+  bool optimizeYaw(const YawProblem &problem, double &yaw) const noexcept;
+
+  // Generic g2o graph optimization, only used as a fallback
+  double optimizeYawG2o(const YawProblem &problem, const Armor &armor,
+                        const Sophus::SO3d &R_pitch,
+                        double initial_yaw) noexcept;
+
+  static constexpr int MAX_ITERATIONS = 20;
+  // Huber kernel width, Unit: pixel
+  static constexpr double HUBER_DELTA = 1.0;
+
   Eigen::Matrix3d K_;
   g2o::SparseOptimizer optimizer_;
   g2o::OptimizationAlgorithmProperty solver_property_;
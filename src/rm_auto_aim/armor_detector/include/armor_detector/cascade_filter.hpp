@@ -0,0 +1,74 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_DETECTOR_CASCADE_FILTER_HPP_
+#define ARMOR_DETECTOR_CASCADE_FILTER_HPP_
+
+// 3rd party
+#include <opencv2/core.hpp>
+// project
+#include "armor_detector/types.hpp"
+
+namespace fyt::auto_aim {
+
+// Cheap rejection of the light pairs that are obviously no armor (reflections, light strips
+// on walls, lit panels), between matching the lights and extracting the numbers, so that they
+// cost neither a warp nor a forward pass of the classifier. Each pair is scored on a few cues,
+// a failed cue counts 1 and the pair is rejected at min_failures. The limits are meant to be
+// loose, the recall loss is measured by classifying the rejected pairs every audit_interval-th
+// frame
+class CascadeFilter {
+public:
+  struct Params {
+    bool enable = false;
+    int min_failures = 1;
+    // Ratio of the light pixels of the binary image in the number region between the lights
+    double max_center_fill = 0.5;
+    // Symmetry of the lights: ratio of their widths (short / long) and difference of their
+    // tilts (deg)
+    double min_width_ratio = 0.3;
+    double max_tilt_diff = 20.0;
+    // Ratio of the mean (R - B) of the lights (weak / strong), a reflection is much weaker
+    // than its light
+    double min_color_ratio = 0.2;
+    // Distance implied by the length of the lights, m
+    double min_distance = 0.3;
+    double max_distance = 12.0;
+    // fy of the camera in pixels, set from the camera info. 0 skips the distance cue
+    double focal_length = 0;
+    // Frames between two audits, 0: never
+    int audit_interval = 100;
+  };
+
+  struct Features {
+    float center_fill;
+    float width_ratio;
+    float tilt_diff;
+    float color_ratio;
+    // 0 if the focal length is unknown
+    float distance;
+  };
+
+  // binary_img: the binary image the lights were found in
+  static Features features(const Armor &armor,
+                           const cv::Mat &binary_img,
+                           double focal_length) noexcept;
+
+  // Number of the cues the features fail
+  static int failures(const Features &features, const Params &params) noexcept;
+};
+
+}  // namespace fyt::auto_aim
+
+#endif  // ARMOR_DETECTOR_CASCADE_FILTER_HPP_
@@ -0,0 +1,72 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_DETECTOR_CLASSIFICATION_CACHE_HPP_
+#define ARMOR_DETECTOR_CLASSIFICATION_CACHE_HPP_
+
+// std
+#include <vector>
+// third party
+#include <opencv2/core.hpp>
+// project
+#include "armor_detector/types.hpp"
+
+namespace fyt::auto_aim {
+
+// Temporal cache of the number classification. An armor of this frame that is associated with
+// an armor of the last frame, by the distance of their centers relative to the light length,
+// takes over its number and confidence instead of running the classifier. The confidence decays
+// with every reuse, and an armor is classified again once it is too old or too uncertain
+class ClassificationCache {
+public:
+  struct Params {
+    bool enable = false;
+    // Maximum number of frames a classification is reused
+    int max_age = 10;
+    // Only classifications at least this confident are reused
+    double min_confidence = 0.9;
+    // Subtracted from the confidence at every reuse
+    double decay = 0.01;
+    // Maximum distance of the centers in light lengths
+    double max_distance = 0.5;
+  };
+
+  // Take over the number and confidence of the matching armor of the last frame, offset moves
+  // the armor into the coordinate of the input.
+  // Return: age of the reused classification, or -1 if the armor must be classified
+  int lookup(Armor &armor, const cv::Point2f &offset, const Params &params) const noexcept;
+
+  // Replace the entries by the armors of this frame, ages[i] is the result of lookup() for
+  // armors[i], or -1 if it has just been classified
+  void update(const std::vector<Armor> &armors,
+              const std::vector<int> &ages,
+              const cv::Point2f &offset) noexcept;
+
+  void clear() noexcept { entries_.clear(); }
+
+private:
+  struct Entry {
+    cv::Point2f center;
+    float light_length;
+    ArmorType type;
+    ArmorNumber number;
+    float confidence;
+    int age;
+  };
+  std::vector<Entry> entries_;
+};
+
+}  // namespace fyt::auto_aim
+
+#endif  // ARMOR_DETECTOR_CLASSIFICATION_CACHE_HPP_
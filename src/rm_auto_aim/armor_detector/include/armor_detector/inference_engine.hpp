@@ -0,0 +1,77 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_DETECTOR_INFERENCE_ENGINE_HPP_
+#define ARMOR_DETECTOR_INFERENCE_ENGINE_HPP_
+
+// std
+#include <memory>
+#include <string>
+#include <string_view>
+// third party
+#include <opencv2/dnn.hpp>
+#ifdef ARMOR_DETECTOR_WITH_OPENVINO
+#include <openvino/openvino.hpp>
+#endif
+
+namespace fyt::auto_aim {
+
+// Inference back end of the classifier, not thread-safe
+class InferenceEngine {
+public:
+  virtual ~InferenceEngine() = default;
+  // Run inference on a NCHW float blob, return the output as a N x K matrix
+  virtual cv::Mat infer(const cv::Mat &blob) = 0;
+};
+
+// OpenCV DNN module, CPU only
+class CvDnnEngine : public InferenceEngine {
+public:
+  explicit CvDnnEngine(const std::string &model_path);
+  cv::Mat infer(const cv::Mat &blob) override;
+
+private:
+  cv::dnn::Net net_;
+};
+
+#ifdef ARMOR_DETECTOR_WITH_OPENVINO
+// OpenVINO runtime, device can be "CPU", "GPU" or "NPU"
+class OpenVINOEngine : public InferenceEngine {
+public:
+  // Compiled blobs are cached in cache_dir to speed up the next startup
+  OpenVINOEngine(const std::string &model_path,
+                 const std::string &device,
+                 const std::string &cache_dir);
+  cv::Mat infer(const cv::Mat &blob) override;
+
+private:
+  ov::Core core_;
+  ov::CompiledModel compiled_model_;
+  ov::InferRequest infer_request_;
+};
+#endif
+
+class InferenceEngineFactory {
+public:
+  InferenceEngineFactory() = delete;
+  // Factory method to create an inference engine, type can be "opencv" or "openvino",
+  // return nullptr if the type is unknown or not built in
+  static std::unique_ptr<InferenceEngine> createEngine(std::string_view type,
+                                                       const std::string &model_path,
+                                                       const std::string &device = "CPU",
+                                                       const std::string &cache_dir = "");
+};
+
+}  // namespace fyt::auto_aim
+#endif  // ARMOR_DETECTOR_INFERENCE_ENGINE_HPP_
@@ -0,0 +1,95 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_DETECTOR_KEYPOINT_DETECTOR_HPP_
+#define ARMOR_DETECTOR_KEYPOINT_DETECTOR_HPP_
+
+// std
+#include <memory>
+#include <vector>
+// third party
+#include <opencv2/core.hpp>
+// project
+#include "armor_detector/inference_engine.hpp"
+#include "armor_detector/types.hpp"
+#include "rm_utils/common.hpp"
+
+namespace fyt::auto_aim {
+
+// Learned armor front end, a YOLOX-pose style network that outputs the four corners, the color
+// and the number of every armor in one inference. It replaces the light finding, light
+// matching, corner correction and number classification of the traditional pipeline.
+//
+// Model contract:
+//   - input: 1 x 3 x S x S float RGB in [0, 255], the frame letterboxed with gray (114) padding
+//   - output: one row per anchor of the strides 8, 16 and 32, in this order:
+//       x, y of the corners (offsets in grid cells): top left, bottom left, bottom right and
+//       top right, i.e. the ends of the left light and then of the right light,
+//       objectness (after sigmoid), NUM_COLORS color scores (blue, red, gray, purple) and
+//       NUM_NUMBERS number scores (hero, engineer, 3, 4, 5, outpost, sentry, base, negative)
+class ArmorKeypointDetector {
+public:
+  static constexpr int NUM_KEYPOINTS = 4;
+  static constexpr int NUM_COLORS = 4;
+  static constexpr int NUM_NUMBERS = 9;
+  static constexpr int ROW_SIZE = 2 * NUM_KEYPOINTS + 1 + NUM_COLORS + NUM_NUMBERS;
+
+  struct Params {
+    // S of the input
+    int input_size = 416;
+    float conf_threshold = 0.6;
+    float nms_threshold = 0.45;
+    // An armor is large if the distance of its lights is above this times their length, the
+    // same as Detector::ArmorParams::min_large_center_distance
+    double min_large_center_distance = 3.2;
+  };
+
+  ArmorKeypointDetector(std::unique_ptr<InferenceEngine> engine, const Params &params);
+
+  // Detect the armors of color in rgb_img. The armors are complete but for number_img, their
+  // lights are made from the corners. Not thread-safe
+  void detect(const cv::Mat &rgb_img, EnemyColor color, std::vector<Armor> &armors);
+
+  const Params &params() const noexcept { return params_; }
+
+private:
+  struct GridStride {
+    int grid0;
+    int grid1;
+    int stride;
+  };
+
+  // Letterbox rgb_img into blob_, scale_ and pad_ map the input back to the image
+  void makeBlob(const cv::Mat &rgb_img);
+
+  // Light from the ends of its bar in the image
+  static Light makeLight(const cv::Point2f &top, const cv::Point2f &bottom, EnemyColor color);
+
+  std::unique_ptr<InferenceEngine> engine_;
+  Params params_;
+  std::vector<GridStride> grid_strides_;
+
+  // Reused from frame to frame
+  cv::Mat input_img_;
+  cv::Mat blob_;
+  float scale_ = 1;
+  cv::Point2f pad_;
+  std::vector<Armor> proposals_;
+  std::vector<cv::Rect> boxes_;
+  std::vector<float> scores_;
+  std::vector<int> keep_;
+};
+
+}  // namespace fyt::auto_aim
+#endif  // ARMOR_DETECTOR_KEYPOINT_DETECTOR_HPP_
@@ -29,8 +29,10 @@ struct SymmetryAxis {
   float mean_val; // Mean brightness
 };
 
+enum class CornerType { TOP, BOTTOM };
+
 // This class is used to improve the precision of the corner points of the light bar.
-// First, the PCA algorithm is used to find the symmetry axis of the light bar,
+// First, the weighted PCA of the brightness is used to find the symmetry axis of the light bar,
 // and then along the symmetry axis to find the corner points of the light bar based on the gradient of brightness.
 class LightCornerCorrector {
 public:
@@ -39,15 +41,21 @@ public:
   // Correct the corners of the armor's lights
   void correctCorners(Armor &armor, const cv::Mat &gray_img);
 
+  // At most max_rays rays per corner, spread over the width of the light. A near light is
+  // wider than the rays that it takes to average the edge. 0: one ray per pixel of the width
+  void setMaxRays(int max_rays) noexcept { max_rays_ = max_rays; }
+
 private:
   // Find the symmetry axis of the light
   SymmetryAxis findSymmetryAxis(const cv::Mat &gray_img, const Light &light);
 
-  // Find the corner of the light
+  // Find the corner of the light with sub-pixel precision
   cv::Point2f findCorner(const cv::Mat &gray_img,
                          const Light &light,
                          const SymmetryAxis &axis,
-                         std::string order);
+                         CornerType type);
+
+  int max_rays_ = 0;
 };
 
 }  // namespace fyt::auto_aim
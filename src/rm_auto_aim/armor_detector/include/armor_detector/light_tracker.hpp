@@ -0,0 +1,104 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_DETECTOR_LIGHT_TRACKER_HPP_
+#define ARMOR_DETECTOR_LIGHT_TRACKER_HPP_
+
+// std
+#include <cstdint>
+#include <vector>
+// third party
+#include <opencv2/core.hpp>
+// project
+#include "armor_detector/types.hpp"
+
+namespace fyt::auto_aim {
+
+// Carries the lights and the pairing results over from frame to frame. Every light is
+// associated with the nearest light of the last frame, and keeps the reference geometry of its
+// track while it stays within a small tolerance of it. The verdict of a pair of such stable
+// lights, with the same stable lights in between, is taken from the last frame instead of
+// running containLight() and isArmor() again. As the reference is only renewed once a light
+// leaves the tolerance, a reused verdict is never based on lights more than 2 * max_shift away
+class LightTracker {
+public:
+  struct Params {
+    bool enable = false;
+    // Maximum distance of a light from its reference position, in pixels
+    double max_shift = 1.5;
+    // Maximum relative change of the light length
+    double max_length_change = 0.05;
+  };
+
+  // Pairs are tracked in a dense table, a larger scene is paired from scratch
+  static constexpr int MAX_LIGHTS = 128;
+
+  enum Verdict : int8_t {
+    UNKNOWN = -1,
+    // Another light inside the bounding box of the pair
+    CONTAINED = 0,
+    INVALID = 1,
+    SMALL = 2,
+    LARGE = 3,
+  };
+
+  // Associate the x-sorted lights with the lights of the last frame, offset moves them into
+  // the coordinate of the input. The verdicts can be queried until finish()
+  void associate(const std::vector<Light> &lights,
+                 const cv::Point2f &offset,
+                 const Params &params) noexcept;
+
+  // True between associate() and finish() for n lights
+  bool active(size_t n) const noexcept { return active_ && n == tracks_.size(); }
+
+  // Verdict of the pair of lights i < j in the last frame, UNKNOWN if it must be evaluated
+  Verdict cached(int i, int j) const noexcept;
+  // Verdict of the pair in this frame
+  void store(int i, int j, Verdict verdict) noexcept {
+    verdicts_[static_cast<size_t>(i) * tracks_.size() + j] = verdict;
+  }
+
+  // This frame becomes the last frame
+  void finish() noexcept;
+
+  // Forget the last frame
+  void reset() noexcept;
+
+  static Verdict toVerdict(ArmorType type) noexcept {
+    return type == ArmorType::SMALL ? SMALL : type == ArmorType::LARGE ? LARGE : INVALID;
+  }
+
+private:
+  struct Track {
+    // Position in the input, to associate the lights of the next frame
+    cv::Point2f center;
+    // Reference geometry, in the input
+    cv::Point2f ref_center;
+    float ref_length;
+    // Index of the light in the last frame, -1 for a new or changed light
+    int last;
+  };
+
+  bool active_ = false;
+  std::vector<Track> tracks_, last_tracks_;
+  // Row-major verdicts of the pairs of lights
+  std::vector<int8_t> verdicts_, last_verdicts_;
+  // Number of new or changed lights before each light, one more entry than the lights
+  std::vector<int> changed_prefix_;
+  std::vector<char> last_used_;
+};
+
+}  // namespace fyt::auto_aim
+
+#endif  // ARMOR_DETECTOR_LIGHT_TRACKER_HPP_
@@ -23,38 +23,68 @@
 #include <cstddef>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 // third party
 #include <opencv2/opencv.hpp>
 // project
+#include "armor_detector/inference_engine.hpp"
 #include "armor_detector/types.hpp"
 
 namespace fyt::auto_aim {
 // Class used to classify the number of the armor, based on the MLP model
 class NumberClassifier {
 public:
+  // Size of the number image, the input of the model
+  static constexpr int NUMBER_SIZE = 28;
+
+  // backend: "opencv" or "openvino", see InferenceEngineFactory
   NumberClassifier(const std::string &model_path,
                    const std::string &label_path,
                    const double threshold,
-                   const std::vector<std::string> &ignore_classes = {});
+                   const std::vector<std::string> &ignore_classes = {},
+                   const std::string &backend = "opencv",
+                   const std::string &device = "CPU",
+                   const std::string &cache_dir = "");
 
-  // Extract the roi image of number from the src
+  // Extract the binary 28x28 number image from the src (gray or rgb), the ROI crop and
+  // the resize are done within a single warp
   cv::Mat extractNumber(const cv::Mat &src, const Armor &armor) const noexcept;
+  // Same as above, into number_img without allocating if it is already NUMBER_SIZE x
+  // NUMBER_SIZE CV_8UC1, e.g. a view of a buffer shared by the armors of a frame
+  void extractNumber(const cv::Mat &src, const Armor &armor, cv::Mat &number_img) const noexcept;
 
   // Classify the number of the armor
   void classify(const cv::Mat &src, Armor &armor) noexcept;
 
+  // Classify all armors with a single forward pass, number_img must be extracted
+  void classifyBatch(std::vector<Armor> &armors) noexcept;
+
   // Erase the ignore classes
   void eraseIgnoreClasses(std::vector<Armor> &armors) noexcept;
 
+  // True if eraseIgnoreClasses() erases the armor: below the threshold, an ignored class, or
+  // a number that does not come with the type of the armor
+  bool isIgnored(const Armor &armor) const noexcept;
+
   double threshold;
 
 private:
+  // Decode one row of the network output
+  void decode(const cv::Mat &output, Armor &armor) const noexcept;
+  // Pack number images into the reused NCHW blob, must be called with mutex_ held
+  cv::Mat packBlob(const Armor *armors, int n) noexcept;
+
   std::mutex mutex_;
-  cv::dnn::Net net_;
-  std::vector<std::string> class_names_;
-  std::vector<std::string> ignore_classes_;
+  // False if the model only accepts a batch size of 1
+  bool support_batch_ = true;
+  std::vector<float> blob_buffer_;
+  std::unique_ptr<InferenceEngine> engine_;
+  // Id of each class
+  std::vector<ArmorNumber> class_numbers_;
+  std::vector<ArmorNumber> ignore_classes_;
 };
 }  // namespace fyt::auto_aim
 #endif  // ARMOR_DETECTOR_NUMBER_CLASSIFIER_HPP_
@@ -0,0 +1,75 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_DETECTOR_OVERLOAD_CONTROLLER_HPP_
+#define ARMOR_DETECTOR_OVERLOAD_CONTROLLER_HPP_
+
+// std
+#include <atomic>
+#include <limits>
+
+namespace fyt::auto_aim {
+
+// Explicit overload control of the detector. A frame older than the deadline is dropped
+// before it is processed, and while the smoothed latency of the published frames is close
+// to the deadline the optional stages are turned off one level at a time
+class OverloadController {
+public:
+  enum Level : int {
+    NORMAL = 0,
+    // No BA optimization of the yaw
+    NO_BA = 1,
+    // No PCA correction of the light corners
+    NO_CORNER_CORRECTION = 2,
+    // No debug images, lights, armors or markers
+    NO_DEBUG = 3,
+  };
+
+  struct Params {
+    bool enable = false;
+    // Maximum age of a frame, from its stamp, in seconds
+    double deadline = 0.03;
+    // Degrade above degrade_ratio * deadline and recover below recover_ratio * deadline
+    double degrade_ratio = 0.8;
+    double recover_ratio = 0.5;
+    // Minimum time between two changes of the level, so that the latency settles in between
+    double hold = 0.5;
+    // Weight of a new latency in the moving average
+    double smoothing = 0.1;
+  };
+
+  OverloadController() noexcept = default;
+  explicit OverloadController(const Params &params) noexcept : params_(params) {}
+
+  bool expired(double age) const noexcept { return params_.enable && age > params_.deadline; }
+
+  // Record the latency of a published frame, now in seconds.
+  // Return: +1 if the level is raised, -1 if it is lowered, 0 otherwise
+  int update(double latency, double now) noexcept;
+
+  // May be read by any thread
+  Level level() const noexcept { return level_.load(std::memory_order_relaxed); }
+
+  const Params &params() const noexcept { return params_; }
+
+private:
+  Params params_;
+  std::atomic<Level> level_{NORMAL};
+  double mean_latency_ = -1;
+  double last_change_ = -std::numeric_limits<double>::infinity();
+};
+
+}  // namespace fyt::auto_aim
+
+#endif  // ARMOR_DETECTOR_OVERLOAD_CONTROLLER_HPP_
@@ -19,6 +19,7 @@
 
 // std
 #include <algorithm>
+#include <array>
 #include <numeric>
 #include <string>
 // 3rd party
@@ -28,6 +29,7 @@
 #include <opencv2/imgproc.hpp>
 #include <sophus/so3.hpp>
 // project
+#include "rm_utils/armor_number.hpp"
 #include "rm_utils/assert.hpp"
 #include "rm_utils/common.hpp"
 
@@ -42,8 +44,8 @@ constexpr double LARGE_ARMOR_HEIGHT = 50.0 / 1000.0; // 55
 // 15 degree in rad
 constexpr double FIFTTEN_DEGREE_RAD = 15 * CV_PI / 180;
 
-// Armor type
-enum class ArmorType { SMALL, LARGE, INVALID };
+// Armor type, SMALL and LARGE have the values of rm_interfaces::msg::Armor::TYPE_*
+enum class ArmorType : uint8_t { SMALL, LARGE, INVALID };
 inline std::string armorTypeToString(const ArmorType &type) {
   switch (type) {
     case ArmorType::SMALL:
@@ -59,16 +61,20 @@ inline std::string armorTypeToString(const ArmorType &type) {
 struct Light : public cv::RotatedRect {
   Light() = default;
   explicit Light(const std::vector<cv::Point> &contour)
-  : cv::RotatedRect(cv::minAreaRect(contour)), color(EnemyColor::WHITE) {
+  : Light(cv::minAreaRect(contour),
+          std::accumulate(
+            contour.begin(),
+            contour.end(),
+            cv::Point2f(0, 0),
+            [n = static_cast<float>(contour.size())](const cv::Point2f &a, const cv::Point &b) {
+              return a + cv::Point2f(b.x, b.y) / n;
+            })) {
     FYT_ASSERT(contour.size() > 0);
-
-    center = std::accumulate(
-      contour.begin(),
-      contour.end(),
-      cv::Point2f(0, 0),
-      [n = static_cast<float>(contour.size())](const cv::Point2f &a, const cv::Point &b) {
-        return a + cv::Point2f(b.x, b.y) / n;
-      });
+  }
+  // Build from a fitted box and the centroid of the light bar
+  Light(const cv::RotatedRect &box, const cv::Point2f &centroid)
+  : cv::RotatedRect(box), color_diff(0), color(EnemyColor::WHITE) {
+    center = centroid;
 
     cv::Point2f p[4];
     this->points(p);
@@ -87,19 +93,28 @@ struct Light : public cv::RotatedRect {
     tilt_angle = std::atan2(std::abs(top.x - bottom.x), std::abs(top.y - bottom.y));
     tilt_angle = tilt_angle / CV_PI * 180;
   }
-  EnemyColor color;
+  // 4-byte fields only, so that a light has no padding
   cv::Point2f top, bottom, center;
   cv::Point2f axis;
-  double length;
-  double width;
+  float length;
+  float width;
   float tilt_angle;
+  // Mean (R - B) of the light, the color is decided by it
+  float color_diff;
+  EnemyColor color;
 };
 
-// Struct used to store the armor
+// Struct used to store the armor. Move-only, so that the armors of a frame are handed from
+// stage to stage and never copied by accident, use clone() for an explicit copy
 struct Armor {
   static constexpr const int N_LANDMARKS = 6;
   static constexpr const int N_LANDMARKS_2 = N_LANDMARKS * 2;
   Armor() = default;
+  Armor(Armor &&) = default;
+  Armor &operator=(Armor &&) = default;
+  Armor &operator=(const Armor &) = delete;
+  Armor clone() const { return Armor(*this); }
+
   Armor(const Light &l1, const Light &l2) {
     if (l1.center.x < l2.center.x) {
       left_light = l1, right_light = l2;
@@ -108,39 +123,55 @@ struct Armor {
     }
 
     center = (left_light.center + right_light.center) / 2;
+    updateLandmarks();
   }
 
-  // Build the points in the object coordinate system, start from bottom left in
-  // clockwise order
-  template <typename PointType>
-  static inline std::vector<PointType> buildObjectPoints(const double &w,
-                                                         const double &h) noexcept {
+  // (y, z) of the object points in units of the armor width and height, x = 0. Start from
+  // bottom left in clockwise order, the same as the landmarks
+  static constexpr std::array<std::array<double, 2>, N_LANDMARKS> OBJECT_POINT_TABLE = [] {
     if constexpr (N_LANDMARKS == 4) {
-      return {PointType(0, w / 2, -h / 2),
-              PointType(0, w / 2, h / 2),
-              PointType(0, -w / 2, h / 2),
-              PointType(0, -w / 2, -h / 2)};
+      return std::array<std::array<double, 2>, N_LANDMARKS>{
+        {{0.5, -0.5}, {0.5, 0.5}, {-0.5, 0.5}, {-0.5, -0.5}}};
     } else {
-      return {PointType(0, w / 2, -h / 2),
-              PointType(0, w / 2, 0),
-              PointType(0, w / 2, h / 2),
-              PointType(0, -w / 2, h / 2),
-              PointType(0, -w / 2, 0),
-              PointType(0, -w / 2, -h / 2)};
+      return std::array<std::array<double, 2>, N_LANDMARKS>{
+        {{0.5, -0.5}, {0.5, 0}, {0.5, 0.5}, {-0.5, 0.5}, {-0.5, 0}, {-0.5, -0.5}}};
     }
+  }();
+
+  // Build the points in the object coordinate system
+  template <typename PointType>
+  static inline std::array<PointType, N_LANDMARKS> buildObjectPoints(const double &w,
+                                                                     const double &h) noexcept {
+    std::array<PointType, N_LANDMARKS> points;
+    for (int i = 0; i < N_LANDMARKS; i++) {
+      points[i] = PointType(0, OBJECT_POINT_TABLE[i][0] * w, OBJECT_POINT_TABLE[i][1] * h);
+    }
+    return points;
+  }
+
+  // The object points of a small or large armor, built once and shared by PnP and BA
+  template <typename PointType>
+  static const std::array<PointType, N_LANDMARKS> &objectPoints(ArmorType type) noexcept {
+    static const auto small = buildObjectPoints<PointType>(SMALL_ARMOR_WIDTH, SMALL_ARMOR_HEIGHT);
+    static const auto large = buildObjectPoints<PointType>(LARGE_ARMOR_WIDTH, LARGE_ARMOR_HEIGHT);
+    return type == ArmorType::SMALL ? small : large;
   }
 
   // Landmarks start from bottom left in clockwise order
-  std::vector<cv::Point2f> landmarks() const {
+  const std::array<cv::Point2f, N_LANDMARKS> &landmarks() const noexcept { return landmarks_; }
+
+  // Recompute the landmarks from the lights, called whenever the lights are modified, e.g.
+  // after the corner correction
+  void updateLandmarks() noexcept {
     if constexpr (N_LANDMARKS == 4) {
-      return {left_light.bottom, left_light.top, right_light.top, right_light.bottom};
+      landmarks_ = {left_light.bottom, left_light.top, right_light.top, right_light.bottom};
     } else {
-      return {left_light.bottom,
-              left_light.center,
-              left_light.top,
-              right_light.top,
-              right_light.center,
-              right_light.bottom};
+      landmarks_ = {left_light.bottom,
+                    left_light.center,
+                    left_light.top,
+                    right_light.top,
+                    right_light.center,
+                    right_light.bottom};
     }
   }
 
@@ -149,11 +180,15 @@ struct Armor {
   cv::Point2f center;
   ArmorType type;
 
-  // Number part
+  // Number part, the label shown in the debug image is formatted from number and confidence
   cv::Mat number_img;
-  std::string number;
+  ArmorNumber number = ArmorNumber::UNKNOWN;
   float confidence;
-  std::string classfication_result;
+
+private:
+  Armor(const Armor &) = default;
+
+  std::array<cv::Point2f, N_LANDMARKS> landmarks_;
 };
 
 }  // namespace fyt::auto_aim
@@ -0,0 +1,66 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_detector/adaptive_threshold.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace fyt::auto_aim {
+
+int AdaptiveThreshold::update(const Histogram &histogram,
+                              int thres,
+                              const Params &params) noexcept {
+  thres = std::clamp(thres, 0, 255);
+  uint64_t total = 0;
+  uint64_t above = 0;
+  for (int v = 0; v < 256; v++) {
+    total += histogram[v];
+    above += v > thres ? histogram[v] : 0;
+  }
+  if (total == 0) {
+    return thres;
+  }
+
+  const double target = params.target_ratio * total;
+  const double ratio = static_cast<double>(above) / total;
+  if (ratio >= params.target_ratio / params.hysteresis &&
+      ratio <= params.target_ratio * params.hysteresis) {
+    return thres;
+  }
+
+  // The lowest threshold that leaves at most the target above it
+  int goal = 0;
+  uint64_t count = 0;
+  for (int v = 255; v > 0; v--) {
+    count += histogram[v];
+    if (count > target) {
+      goal = v;
+      break;
+    }
+  }
+
+  // A single bin holds too many pixels, any other threshold would be further off
+  if (goal == thres) {
+    return thres;
+  }
+  int step = static_cast<int>(std::lround(params.gain * (goal - thres)));
+  if (step == 0) {
+    step = goal > thres ? 1 : -1;
+  }
+  return std::clamp(thres + step, params.min_thres, params.max_thres);
+}
+
+}  // namespace fyt::auto_aim
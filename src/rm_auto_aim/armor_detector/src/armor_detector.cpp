@@ -20,21 +20,42 @@
 // std
 #include <algorithm>
 #include <cmath>
-#include <execution>
+#include <cstdint>
 #include <vector>
 // OpenCV
 #include <opencv2/core.hpp>
 #include <opencv2/core/base.hpp>
 #include <opencv2/core/mat.hpp>
+#include <opencv2/core/ocl.hpp>
 #include <opencv2/core/types.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 // project
 #include "armor_detector/types.hpp"
 #include "rm_utils/common.hpp"
+#include "rm_utils/trace.hpp"
+#include "rm_utils/worker_pool.hpp"
 #include <fmt/format.h>
 
 namespace fyt::auto_aim {
+namespace {
+// Fixed-point weights of cv::COLOR_RGB2GRAY, so that the gray image is bit-exact
+constexpr int R2Y = 4899, G2Y = 9617, B2Y = 1868, SHIFT = 14;
+
+// One row of the fused preprocessing pass. The loop is kept branch-free so that the compiler
+// is able to vectorize it
+inline void fusedRow(
+  const uchar *src, int cols, int thres, uchar *gray, uchar *binary, int16_t *diff) noexcept {
+  for (int x = 0; x < cols; x++) {
+    const int r = src[3 * x], g = src[3 * x + 1], b = src[3 * x + 2];
+    const int v = (r * R2Y + g * G2Y + b * B2Y + (1 << (SHIFT - 1))) >> SHIFT;
+    gray[x] = static_cast<uchar>(v);
+    binary[x] = v > thres ? 255 : 0;
+    diff[x] = static_cast<int16_t>(r - b);
+  }
+}
+}  // namespace
+
 Detector::Detector(const int &bin_thres,
                    const EnemyColor &color,
                    const LightParams &l,
@@ -42,73 +63,732 @@ Detector::Detector(const int &bin_thres,
 : binary_thres(bin_thres), detect_color(color), light_params(l), armor_params(a) {}
 
 std::vector<Armor> Detector::detect(const cv::Mat &input) noexcept {
-  // 1. Preprocess the image
-  binary_img = preprocessImage(input);
-  // 2. Find lights
-  lights_ = findLights(input, binary_img);
-  // 3. Match lights to armors
-  armors_ = matchLights(lights_);
-
-  if (!armors_.empty() && classifier != nullptr) {
-    // Parallel processing
-    std::for_each(
-      std::execution::par, armors_.begin(), armors_.end(), [this, &input](Armor &armor) {
-        // 4. Extract the number image
-        armor.number_img = classifier->extractNumber(input, armor);
-        // 5. Do classification
-        classifier->classify(input, armor);
-        // 6. Correct the corners of the armor
-        if (corner_corrector != nullptr) {
-          corner_corrector->correctCorners(armor, gray_img_);
-        }
-      });
-    // 7. Erase the armors with ignore classes
-    classifier->eraseIgnoreClasses(armors_);
+  return detect(input, cv::Rect());
+}
+
+std::vector<Armor> Detector::detect(const cv::Mat &input, const cv::Rect &roi) noexcept {
+  // 1 ~ 3. Preprocess, find lights and match them, 4 ~ 7. number classification. The armors
+  // are moved from stage to stage
+  Candidates candidates = findCandidates(input, roi);
+  return classifyCandidates(candidates);
+}
+
+Detector::Candidates Detector::findCandidates(const cv::Mat &input, const cv::Rect &roi) noexcept {
+  cv::Rect window = alignWindow(input, roi);
+  if (window.empty()) {
+    window = cv::Rect(0, 0, input.cols, input.rows);
+  }
+  const cv::Mat view = input(window);
+
+  Candidates candidates;
+  candidates.offset = cv::Point2f(window.x, window.y);
+  // A raw frame has no color for the network, it goes through the traditional pipeline
+  if (keypoint_detector != nullptr && view.channels() == 3) {
+    utils::TraceScope trace(utils::TraceStage::ARMOR_KEYPOINTS);
+    keypoint_detector->detect(view, detect_color, candidates.armors);
+    candidates.classified = true;
+    binary_img.release();
+    debug_lights.data.clear();
+    debug_armors.data.clear();
+    return candidates;
+  }
+
+  // Only a full rgb frame on the CPU, a search window already holds the target
+  const bool coarse = coarse_search.enable && window.size() == input.size() &&
+                      view.channels() == 3 && preprocess_backend == PreprocessBackend::CPU &&
+                      searchCoarse(view);
+  {
+    utils::TraceScope trace(utils::TraceStage::PREPROCESS);
+    binary_img = coarse ? preprocessRegions(view) : preprocessImage(view);
+  }
+  // A search window holds the target, its ratio of light pixels is not that of the scene
+  if (adaptive_thres.enable && window.size() == input.size()) {
+    adaptive_value_ = AdaptiveThreshold::update(histogram_, last_thres_, adaptive_thres);
+  }
+  {
+    utils::TraceScope trace(utils::TraceStage::FIND_LIGHTS);
+    if (coarse) {
+      findLightsInRegions(view, binary_img, lights_);
+    } else {
+      findLights(view, binary_img, lights_);
+    }
+  }
+
+  {
+    utils::TraceScope trace(utils::TraceStage::MATCH_LIGHTS);
+    if (light_tracking.enable && !enable_debug) {
+      // The verdicts only hold for the armor parameters they were made with
+      const auto &a = armor_params, &t = tracked_armor_params_;
+      if (a.min_light_ratio != t.min_light_ratio ||
+          a.min_small_center_distance != t.min_small_center_distance ||
+          a.max_small_center_distance != t.max_small_center_distance ||
+          a.min_large_center_distance != t.min_large_center_distance ||
+          a.max_large_center_distance != t.max_large_center_distance ||
+          a.max_angle != t.max_angle) {
+        light_tracker_.reset();
+        tracked_armor_params_ = armor_params;
+      }
+      light_tracker_.associate(lights_, candidates.offset, light_tracking);
+    } else {
+      light_tracker_.reset();
+    }
+    candidates.armors = matchLights(lights_);
+  }
+  filterCandidates(candidates, binary_img);
+  // The gray image goes with the candidates, the next frame takes another buffer of the pool
+  candidates.gray_img = std::move(gray_img_);
+  shiftDebugResults(candidates.offset);
+  return candidates;
+}
+
+std::vector<Armor> Detector::classifyCandidates(Candidates &candidates) noexcept {
+  if (!candidates.classified) {
+    utils::TraceScope trace(utils::TraceStage::CLASSIFY);
+    classifyArmors(
+      candidates.armors, candidates.gray_img, candidates.offset, candidates.cascade_rejected);
+  } else if (classifier != nullptr) {
+    classifier->eraseIgnoreClasses(candidates.armors);
+  }
+  for (auto &armor : candidates.armors) {
+    shiftArmor(armor, candidates.offset);
+  }
+  return std::move(candidates.armors);
+}
+
+void Detector::filterCandidates(Candidates &candidates, const cv::Mat &binary_img) noexcept {
+  last_cascade_rejects_ = 0;
+  if (!cascade.enable) {
+    cascade_frames_ = 0;
+    return;
+  }
+  const bool audit =
+    cascade.audit_interval > 0 && cascade_frames_++ % cascade.audit_interval == 0;
+  auto &armors = candidates.armors;
+  if (audit) {
+    candidates.cascade_rejected.assign(armors.size(), 0);
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < armors.size(); i++) {
+    const auto features = CascadeFilter::features(armors[i], binary_img, cascade.focal_length);
+    const bool reject = CascadeFilter::failures(features, cascade) >= cascade.min_failures;
+    last_cascade_rejects_ += reject;
+    if (audit) {
+      candidates.cascade_rejected[i] = reject;
+    } else if (!reject) {
+      if (kept != i) {
+        armors[kept] = std::move(armors[i]);
+      }
+      kept++;
+    }
+  }
+  if (!audit) {
+    armors.resize(kept);
+  }
+}
+
+void Detector::auditCascade(std::vector<Armor> &armors,
+                            std::vector<char> &cascade_rejected) noexcept {
+  last_cascade_audited_ = last_cascade_misses_ = 0;
+  if (cascade_rejected.empty()) {
+    return;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < armors.size(); i++) {
+    if (cascade_rejected[i]) {
+      // Without a classifier there is nothing to compare with
+      if (classifier != nullptr) {
+        last_cascade_audited_++;
+        last_cascade_misses_ += !classifier->isIgnored(armors[i]);
+      }
+      continue;
+    }
+    if (kept != i) {
+      armors[kept] = std::move(armors[i]);
+    }
+    kept++;
+  }
+  armors.resize(kept);
+  cascade_rejected.clear();
+}
+
+void Detector::classifyArmors(std::vector<Armor> &armors,
+                              const cv::Mat &gray_img,
+                              const cv::Point2f &offset,
+                              std::vector<char> &cascade_rejected) noexcept {
+  const bool correct_corners = corner_corrector != nullptr && enable_corner_correction;
+  if (classifier == nullptr || !number_cache.enable) {
+    number_cache_.clear();
+  }
+  last_cache_hits_ = 0;
+  if (armors.empty() || (classifier == nullptr && !correct_corners)) {
+    number_cache_.clear();
+    auditCascade(armors, cascade_rejected);
+    return;
+  }
+  // Armors associated with a confident classification of the last frame skip the classifier
+  cache_ages_.assign(armors.size(), -1);
+  int num_to_classify = 0;
+  if (classifier != nullptr) {
+    for (size_t i = 0; i < armors.size(); i++) {
+      cache_ages_[i] = number_cache_.lookup(armors[i], offset, number_cache);
+      num_to_classify += cache_ages_[i] < 0;
+    }
+    last_cache_hits_ = static_cast<int>(armors.size()) - num_to_classify;
+  }
+  // The number images of a frame share one buffer, each armor to classify holds a view of
+  // its rows
+  cv::Mat number_imgs;
+  if (num_to_classify > 0) {
+    number_imgs.create(num_to_classify * NumberClassifier::NUMBER_SIZE,
+                       NumberClassifier::NUMBER_SIZE,
+                       CV_8UC1);
+    int row = 0;
+    for (size_t i = 0; i < armors.size(); i++) {
+      if (cache_ages_[i] < 0) {
+        armors[i].number_img = number_imgs.rowRange(row, row + NumberClassifier::NUMBER_SIZE);
+        row += NumberClassifier::NUMBER_SIZE;
+      }
+    }
+  }
+  // Parallel processing, a single armor is done inline
+  utils::WorkerPool::instance().parallelFor(armors.size(), [&](size_t i) {
+    Armor &armor = armors[i];
+    // 4. Extract the number image
+    if (!armor.number_img.empty()) {
+      classifier->extractNumber(gray_img, armor, armor.number_img);
+    }
+    // 5. Correct the corners of the armor
+    if (correct_corners) {
+      corner_corrector->correctCorners(armor, gray_img);
+    }
+  });
+  // Without a classifier every matched light pair is kept
+  if (classifier == nullptr) {
+    auditCascade(armors, cascade_rejected);
+    return;
+  }
+  // 6. Do classification, all armors left in one forward pass
+  if (num_to_classify == static_cast<int>(armors.size())) {
+    classifier->classifyBatch(armors);
+  } else if (num_to_classify > 0) {
+    to_classify_.clear();
+    for (size_t i = 0; i < armors.size(); i++) {
+      if (cache_ages_[i] < 0) {
+        to_classify_.push_back(std::move(armors[i]));
+      }
+    }
+    classifier->classifyBatch(to_classify_);
+    auto it = to_classify_.begin();
+    for (size_t i = 0; i < armors.size(); i++) {
+      if (cache_ages_[i] < 0) {
+        armors[i] = std::move(*it++);
+      }
+    }
+  }
+  // The negative armors are cached as well, so that they are not classified every frame
+  if (number_cache.enable) {
+    number_cache_.update(armors, cache_ages_, offset);
+  }
+  auditCascade(armors, cascade_rejected);
+  // 7. Erase the armors with ignore classes
+  classifier->eraseIgnoreClasses(armors);
+}
+
+void Detector::shiftDebugResults(const cv::Point2f &offset) noexcept {
+  if (offset == cv::Point2f(0, 0)) {
+    return;
+  }
+  for (auto &light : lights_) {
+    shiftLight(light, offset);
+  }
+  for (auto &light_data : debug_lights.data) {
+    light_data.center_x += offset.x;
+  }
+  for (auto &armor_data : debug_armors.data) {
+    armor_data.center_x += offset.x;
+  }
+}
+
+void Detector::shiftLight(Light &light, const cv::Point2f &offset) noexcept {
+  light.cv::RotatedRect::center += offset;
+  light.center += offset;
+  light.top += offset;
+  light.bottom += offset;
+}
+
+void Detector::shiftArmor(Armor &armor, const cv::Point2f &offset) noexcept {
+  shiftLight(armor.left_light, offset);
+  shiftLight(armor.right_light, offset);
+  armor.center += offset;
+  // PnP takes the landmarks, not the lights
+  armor.updateLandmarks();
+}
+
+cv::Rect Detector::alignWindow(const cv::Mat &input, const cv::Rect &roi) const noexcept {
+  cv::Rect window = roi & cv::Rect(0, 0, input.cols, input.rows);
+  if (input.channels() != 1 || window.empty()) {
+    return window;
+  }
+  const int x0 = window.x & ~1, y0 = window.y & ~1;
+  const int x1 = std::min((window.x + window.width + 1) & ~1, input.cols);
+  const int y1 = std::min((window.y + window.height + 1) & ~1, input.rows);
+  return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+cv::Mat Detector::pooledImage(std::array<cv::Mat, IMAGE_POOL_SIZE> &pool,
+                              const cv::Size &size,
+                              int type) noexcept {
+  // A buffer only referred to by the pool is not used by any frame anymore
+  auto is_free = [](const cv::Mat &mat) { return mat.u == nullptr || mat.u->refcount == 1; };
+  for (auto &mat : pool) {
+    if (!mat.empty() && is_free(mat) && mat.size() == size && mat.type() == type) {
+      return mat;
+    }
+  }
+  for (auto &mat : pool) {
+    if (is_free(mat)) {
+      mat.create(size, type);
+      return mat;
+    }
+  }
+  // Every buffer is still in use, e.g. the debug thread falls behind
+  return cv::Mat(size, type);
+}
+
+int Detector::nextThreshold() noexcept {
+  if (!adaptive_thres.enable) {
+    adaptive_value_ = -1;
+    last_thres_ = binary_thres;
+    return last_thres_;
+  }
+  if (adaptive_value_ < 0) {
+    adaptive_value_ = std::clamp(binary_thres, adaptive_thres.min_thres, adaptive_thres.max_thres);
+  }
+  histogram_.fill(0);
+  last_thres_ = adaptive_value_;
+  return last_thres_;
+}
+
+void Detector::accumulateHistogram(int begin, int end) noexcept {
+  if (!adaptive_thres.enable) {
+    return;
+  }
+  // The gray rows were just written by this thread and are still in its cache
+  constexpr int STEP = AdaptiveThreshold::SUBSAMPLE;
+  AdaptiveThreshold::Histogram local{};
+  for (int y = (begin + STEP - 1) / STEP * STEP; y < end; y += STEP) {
+    const uchar *gray = gray_img_.ptr<uchar>(y);
+    for (int x = 0; x < gray_img_.cols; x += STEP) {
+      local[gray[x]]++;
+    }
+  }
+  std::lock_guard<std::mutex> lock(histogram_mutex_);
+  for (size_t v = 0; v < local.size(); v++) {
+    histogram_[v] += local[v];
   }
-  return armors_;
 }
 
 cv::Mat Detector::preprocessImage(const cv::Mat &rgb_img) noexcept {
-  cv::cvtColor(rgb_img, gray_img_, cv::COLOR_RGB2GRAY);
+  if (rgb_img.channels() == 1) {
+    return preprocessBayer(rgb_img);
+  }
+  if (preprocess_backend == PreprocessBackend::OPENCL) {
+    if (cv::ocl::useOpenCL()) {
+      cv::Mat binary_img = preprocessOpenCL(rgb_img);
+      if (!binary_img.empty()) {
+        return binary_img;
+      }
+    }
+    preprocess_backend = PreprocessBackend::CPU;
+  }
+  gray_img_ = pooledImage(gray_pool_, rgb_img.size(), CV_8UC1);
+  color_diff_img_.create(rgb_img.size(), CV_16SC1);
+  cv::Mat binary_img = pooledImage(binary_pool_, rgb_img.size(), CV_8UC1);
+
+  const int thres = nextThreshold();
+
+  // Read the rgb image only once and write gray, binary and (R - B) planes in the same pass
+  cv::parallel_for_(cv::Range(0, rgb_img.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; y++) {
+      fusedRow(rgb_img.ptr<uchar>(y),
+               rgb_img.cols,
+               thres,
+               gray_img_.ptr<uchar>(y),
+               binary_img.ptr<uchar>(y),
+               color_diff_img_.ptr<int16_t>(y));
+    }
+    accumulateHistogram(range.start, range.end);
+  });
+
+  return binary_img;
+}
 
-  cv::Mat binary_img;
-  cv::threshold(gray_img_, binary_img, binary_thres, 255, cv::THRESH_BINARY);
+bool Detector::searchCoarse(const cv::Mat &rgb_img) noexcept {
+  const int thres = nextThreshold();
+  coarse_binary_.create(rgb_img.rows / 2, rgb_img.cols / 2, CV_8UC1);
+  cv::parallel_for_(cv::Range(0, coarse_binary_.rows), [&](const cv::Range &range) {
+    // The histogram takes the same pixels as accumulateHistogram(), every SUBSAMPLE-th pixel
+    // of every SUBSAMPLE-th row
+    constexpr int STEP = AdaptiveThreshold::SUBSAMPLE;
+    AdaptiveThreshold::Histogram local{};
+    for (int cy = range.start; cy < range.end; cy++) {
+      const uchar *src = rgb_img.ptr<uchar>(2 * cy);
+      uchar *dst = coarse_binary_.ptr<uchar>(cy);
+      for (int cx = 0; cx < coarse_binary_.cols; cx++) {
+        const uchar *p = src + 6 * cx;
+        const int v0 = (p[0] * R2Y + p[1] * G2Y + p[2] * B2Y + (1 << (SHIFT - 1))) >> SHIFT;
+        const int v1 = (p[3] * R2Y + p[4] * G2Y + p[5] * B2Y + (1 << (SHIFT - 1))) >> SHIFT;
+        dst[cx] = (v0 > thres) | (v1 > thres) ? 255 : 0;
+      }
+      if (adaptive_thres.enable && (2 * cy) % STEP == 0) {
+        for (int x = 0; x < rgb_img.cols; x += STEP) {
+          const uchar *p = src + 3 * x;
+          local[(p[0] * R2Y + p[1] * G2Y + p[2] * B2Y + (1 << (SHIFT - 1))) >> SHIFT]++;
+        }
+      }
+    }
+    if (adaptive_thres.enable) {
+      std::lock_guard<std::mutex> lock(histogram_mutex_);
+      for (size_t v = 0; v < local.size(); v++) {
+        histogram_[v] += local[v];
+      }
+    }
+  });
+
+  // Region of each blob: its partner light lies within max_large_center_distance light
+  // lengths, and the number image reaches about a light length above and below
+  constexpr int REGION_PAD = 4;
+  const cv::Rect frame(0, 0, rgb_img.cols, rgb_img.rows);
+  cv::findContours(
+    coarse_binary_, contours_, hierarchy_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+  regions_.clear();
+  for (const auto &contour : contours_) {
+    const cv::Rect r = cv::boundingRect(contour);
+    // Lights are taller than wide, and at least a few pixels long
+    if (r.height < 2) {
+      continue;
+    }
+    // Back to the full frame, with the odd row below
+    const cv::Rect blob(2 * r.x, 2 * r.y, 2 * r.width, 2 * r.height + 1);
+    const int mx = cvCeil(blob.height * armor_params.max_large_center_distance) + REGION_PAD;
+    const int my = blob.height + REGION_PAD;
+    regions_.push_back(
+      cv::Rect(blob.x - mx, blob.y - my, blob.width + 2 * mx, blob.height + 2 * my) & frame);
+  }
+
+  // Overlapping regions are merged, so that every light lies inside exactly one of them
+  for (bool merged = true; merged;) {
+    merged = false;
+    for (size_t i = 0; i < regions_.size() && !merged; i++) {
+      for (size_t j = i + 1; j < regions_.size(); j++) {
+        if ((regions_[i] & regions_[j]).area() > 0) {
+          regions_[i] |= regions_[j];
+          regions_.erase(regions_.begin() + j);
+          merged = true;
+          break;
+        }
+      }
+    }
+  }
+
+  double area = 0;
+  for (const auto &region : regions_) {
+    area += region.area();
+  }
+  return area <= coarse_search.max_area_ratio * frame.area();
+}
+
+cv::Mat Detector::preprocessRegions(const cv::Mat &rgb_img) noexcept {
+  // The threshold and the histogram are from the coarse pass
+  const int thres = last_thres_;
+  gray_img_ = pooledImage(gray_pool_, rgb_img.size(), CV_8UC1);
+  color_diff_img_.create(rgb_img.size(), CV_16SC1);
+  cv::Mat binary_img = pooledImage(binary_pool_, rgb_img.size(), CV_8UC1);
+  // The number extraction reads the gray image around the armors, and debug shows the binary
+  gray_img_.setTo(0);
+  binary_img.setTo(0);
+
+  for (const auto &region : regions_) {
+    cv::parallel_for_(cv::Range(region.y, region.y + region.height), [&](const cv::Range &range) {
+      for (int y = range.start; y < range.end; y++) {
+        fusedRow(rgb_img.ptr<uchar>(y) + 3 * region.x,
+                 region.width,
+                 thres,
+                 gray_img_.ptr<uchar>(y) + region.x,
+                 binary_img.ptr<uchar>(y) + region.x,
+                 color_diff_img_.ptr<int16_t>(y) + region.x);
+      }
+    });
+  }
+  return binary_img;
+}
+
+void Detector::findLightsInRegions(const cv::Mat &rgb_img, const cv::Mat &binary_img,
+                                   std::vector<Light> &lights) noexcept {
+  debug_lights.data.clear();
+  lights.clear();
+
+  for (const auto &region : regions_) {
+    const size_t first_light = lights.size();
+    const size_t first_debug = debug_lights.data.size();
+    if (light_extractor == LightExtractor::CONNECTED_COMPONENTS) {
+      findLightsByComponents(
+        rgb_img(region), binary_img(region), color_diff_img_(region), lights);
+    } else {
+      findLightsByContours(rgb_img(region), binary_img(region), color_diff_img_(region), lights);
+    }
+    // Back to the coordinate of rgb_img
+    const cv::Point2f offset(region.x, region.y);
+    for (size_t i = first_light; i < lights.size(); i++) {
+      shiftLight(lights[i], offset);
+    }
+    for (size_t i = first_debug; i < debug_lights.data.size(); i++) {
+      debug_lights.data[i].center_x += offset.x;
+    }
+  }
+
+  std::sort(lights.begin(), lights.end(), [](const Light &l1, const Light &l2) {
+    return l1.center.x < l2.center.x;
+  });
+}
+
+cv::Mat Detector::preprocessOpenCL(const cv::Mat &rgb_img) noexcept {
+  const int thres = nextThreshold();
+  try {
+    rgb_img.copyTo(rgb_umat_);
+    // The gray image of the device may differ from the fixed-point CPU pass by one level
+    cv::cvtColor(rgb_umat_, gray_umat_, cv::COLOR_RGB2GRAY);
+    cv::threshold(gray_umat_, binary_umat_, thres, 255, cv::THRESH_BINARY);
+    cv::extractChannel(rgb_umat_, red_umat_, 0);
+    cv::extractChannel(rgb_umat_, blue_umat_, 2);
+    cv::subtract(red_umat_, blue_umat_, diff_umat_, cv::noArray(), CV_16S);
+
+    // The number extraction, the corner corrector and the debug thread read the planes on the
+    // host, so they are downloaded into the same buffers as the CPU pass
+    gray_img_ = pooledImage(gray_pool_, rgb_img.size(), CV_8UC1);
+    cv::Mat binary_img = pooledImage(binary_pool_, rgb_img.size(), CV_8UC1);
+    color_diff_img_.create(rgb_img.size(), CV_16SC1);
+    gray_umat_.copyTo(gray_img_);
+    binary_umat_.copyTo(binary_img);
+    diff_umat_.copyTo(color_diff_img_);
+    accumulateHistogram(0, gray_img_.rows);
+    return binary_img;
+  } catch (const cv::Exception &) {
+    return cv::Mat();
+  }
+}
+
+cv::Mat Detector::preprocessBayer(const cv::Mat &bayer_img) noexcept {
+  gray_img_ = pooledImage(gray_pool_, bayer_img.size(), CV_8UC1);
+  color_diff_img_.create(bayer_img.size(), CV_16SC1);
+  cv::Mat binary_img = pooledImage(binary_pool_, bayer_img.size(), CV_8UC1);
+
+  const int thres = nextThreshold();
+  const cv::Point red = utils::bayerRedOffset(bayer_pattern);
+  const cv::Point blue(1 - red.x, 1 - red.y);
+  const int cell_rows = (bayer_img.rows + 1) / 2;
+  const int cell_cols = (bayer_img.cols + 1) / 2;
+
+  // One cell is two rows and two columns, the last one is clamped for an odd size. This is the
+  // same nearest neighbour demosaic as the camera driver, so the colors match the rgb path
+  cv::parallel_for_(cv::Range(0, cell_rows), [&](const cv::Range &range) {
+    for (int cy = range.start; cy < range.end; cy++) {
+      const int y[2] = {2 * cy, std::min(2 * cy + 1, bayer_img.rows - 1)};
+      const uchar *src[2] = {bayer_img.ptr<uchar>(y[0]), bayer_img.ptr<uchar>(y[1])};
+      const uchar *red_row = src[red.y], *blue_row = src[blue.y];
+      // G is at (blue.x, red.y) and (red.x, blue.y)
+      const uchar *green_row_0 = src[red.y], *green_row_1 = src[blue.y];
+      uchar *gray[2] = {gray_img_.ptr<uchar>(y[0]), gray_img_.ptr<uchar>(y[1])};
+      uchar *binary[2] = {binary_img.ptr<uchar>(y[0]), binary_img.ptr<uchar>(y[1])};
+      int16_t *diff[2] = {color_diff_img_.ptr<int16_t>(y[0]), color_diff_img_.ptr<int16_t>(y[1])};
+      for (int cx = 0; cx < cell_cols; cx++) {
+        const int x[2] = {2 * cx, std::min(2 * cx + 1, bayer_img.cols - 1)};
+        const int r = red_row[x[red.x]], b = blue_row[x[blue.x]];
+        const int g = (green_row_0[x[blue.x]] + green_row_1[x[red.x]] + 1) >> 1;
+        const int v = (r * R2Y + g * G2Y + b * B2Y + (1 << (SHIFT - 1))) >> SHIFT;
+        for (int i = 0; i < 2; i++) {
+          for (int j = 0; j < 2; j++) {
+            gray[i][x[j]] = static_cast<uchar>(v);
+            binary[i][x[j]] = v > thres ? 255 : 0;
+            diff[i][x[j]] = static_cast<int16_t>(r - b);
+          }
+        }
+      }
+    }
+    accumulateHistogram(2 * range.start, std::min(2 * range.end, bayer_img.rows));
+  });
 
   return binary_img;
 }
 
 std::vector<Light> Detector::findLights(const cv::Mat &rgb_img,
                                         const cv::Mat &binary_img) noexcept {
-  using std::vector;
-  vector<vector<cv::Point>> contours;
-  vector<cv::Vec4i> hierarchy;
-  cv::findContours(binary_img, contours, hierarchy, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+  std::vector<Light> lights;
+  findLights(rgb_img, binary_img, lights);
+  return lights;
+}
 
-  vector<Light> lights;
+void Detector::findLights(const cv::Mat &rgb_img, const cv::Mat &binary_img,
+                          std::vector<Light> &lights) noexcept {
   debug_lights.data.clear();
+  lights.clear();
+
+  if (light_extractor == LightExtractor::CONNECTED_COMPONENTS) {
+    findLightsByComponents(rgb_img, binary_img, color_diff_img_, lights);
+  } else {
+    findLightsByContours(rgb_img, binary_img, color_diff_img_, lights);
+  }
 
-  for (const auto &contour : contours) {
+  std::sort(lights.begin(), lights.end(), [](const Light &l1, const Light &l2) {
+    return l1.center.x < l2.center.x;
+  });
+}
+
+void Detector::findLightsByContours(const cv::Mat &rgb_img, const cv::Mat &binary_img,
+                                    const cv::Mat &diff_img, std::vector<Light> &lights) noexcept {
+  // The buffers keep their capacity from frame to frame
+  cv::findContours(binary_img, contours_, hierarchy_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+
+  // The (R - B) plane is produced by preprocessImage(), fall back to the rgb image if absent
+  const bool has_diff_img = diff_img.size() == rgb_img.size();
+
+  for (const auto &contour : contours_) {
     if (contour.size() < 6) continue;
 
     auto light = Light(contour);
 
     if (isLight(light)) {
-      int sum_r = 0, sum_b = 0;
-      for (const auto &point : contour) {
-        sum_r += rgb_img.at<cv::Vec3b>(point.y, point.x)[0];
-        sum_b += rgb_img.at<cv::Vec3b>(point.y, point.x)[2];
+      // Sum of (R - B) along the contour
+      int sum_diff = 0;
+      if (has_diff_img) {
+        for (const auto &point : contour) {
+          sum_diff += diff_img.at<int16_t>(point.y, point.x);
+        }
+      } else {
+        for (const auto &point : contour) {
+          const auto &pixel = rgb_img.at<cv::Vec3b>(point.y, point.x);
+          sum_diff += pixel[0] - pixel[2];
+        }
+      }
+      judgeColor(light, sum_diff, static_cast<int>(contour.size()));
+      lights.emplace_back(light);
+    }
+  }
+}
+
+void Detector::findLightsByComponents(const cv::Mat &rgb_img, const cv::Mat &binary_img,
+                                      const cv::Mat &diff_img,
+                                      std::vector<Light> &lights) noexcept {
+  const bool has_diff_img = diff_img.size() == rgb_img.size();
+
+  runs_.clear();
+  run_parents_.clear();
+
+  auto find_root = [this](int i) {
+    while (run_parents_[i] != i) {
+      i = run_parents_[i] = run_parents_[run_parents_[i]];
+    }
+    return i;
+  };
+
+  // 1. Scan runs row by row and union the ones 8-connected with the previous row
+  int prev_begin = 0, prev_end = 0;
+  for (int y = 0; y < binary_img.rows; y++) {
+    const uchar *row = binary_img.ptr<uchar>(y);
+    const int cur_begin = static_cast<int>(runs_.size());
+    int k = prev_begin;
+    for (int x = 0; x < binary_img.cols; x++) {
+      if (row[x] == 0) continue;
+      const int x_begin = x;
+      while (x < binary_img.cols && row[x] != 0) x++;
+      const int x_end = x - 1;
+
+      const int id = static_cast<int>(runs_.size());
+      runs_.push_back({y, x_begin, x_end});
+      run_parents_.push_back(id);
+
+      // Runs of the previous row are sorted, so the overlapping ones are contiguous
+      while (k < prev_end && runs_[k].x_end < x_begin - 1) k++;
+      for (int j = k; j < prev_end && runs_[j].x_begin <= x_end + 1; j++) {
+        int a = find_root(id), b = find_root(j);
+        if (a != b) run_parents_[std::max(a, b)] = std::min(a, b);
       }
-      if (std::abs(sum_r - sum_b) / static_cast<int>(contour.size()) >
-          light_params.color_diff_thresh) {
-        light.color = sum_r > sum_b ? EnemyColor::RED : EnemyColor::BLUE;
+    }
+    prev_begin = cur_begin;
+    prev_end = static_cast<int>(runs_.size());
+  }
+
+  // 2. Accumulate moments and color sums of each blob
+  blobs_.assign(runs_.size(), BlobStats{});
+  for (int i = 0; i < static_cast<int>(runs_.size()); i++) {
+    const Run &run = runs_[i];
+    BlobStats &blob = blobs_[find_root(i)];
+    const double n = run.x_end - run.x_begin + 1;
+    const double y = run.y;
+    const double sum_x = (run.x_begin + run.x_end) * n / 2;
+    // sum of x^2 for x in [x_begin, x_end]
+    auto square_sum = [](double m) { return m * (m + 1) * (2 * m + 1) / 6; };
+    const double sum_xx = square_sum(run.x_end) - square_sum(run.x_begin - 1);
+
+    blob.area += static_cast<int>(n);
+    blob.sum_x += sum_x;
+    blob.sum_y += y * n;
+    blob.sum_xx += sum_xx;
+    blob.sum_xy += y * sum_x;
+    blob.sum_yy += y * y * n;
+
+    // Only the edge pixels: the ends of the run and the pixels with no lit pixel above or
+    // below. The saturated core of a light has R close to B and would dilute the mean
+    const uchar *above = run.y > 0 ? binary_img.ptr<uchar>(run.y - 1) : nullptr;
+    const uchar *below = run.y + 1 < binary_img.rows ? binary_img.ptr<uchar>(run.y + 1) : nullptr;
+    const int16_t *diff = has_diff_img ? diff_img.ptr<int16_t>(run.y) : nullptr;
+    const cv::Vec3b *pixel = has_diff_img ? nullptr : rgb_img.ptr<cv::Vec3b>(run.y);
+    for (int x = run.x_begin; x <= run.x_end; x++) {
+      const bool edge = x == run.x_begin || x == run.x_end || above == nullptr ||
+                        above[x] == 0 || below == nullptr || below[x] == 0;
+      if (edge) {
+        blob.sum_diff += has_diff_img ? diff[x] : pixel[x][0] - pixel[x][2];
+        blob.edge_pixels++;
       }
+    }
+  }
+
+  // 3. Build lights from the second order moments of the blobs
+  for (int i = 0; i < static_cast<int>(runs_.size()); i++) {
+    if (run_parents_[i] != i) continue;
+    const BlobStats &blob = blobs_[i];
+    if (blob.area < 6) continue;
+
+    const double n = blob.area;
+    const double cx = blob.sum_x / n, cy = blob.sum_y / n;
+    // Central moments, plus the variance of a unit pixel
+    const double mu20 = blob.sum_xx / n - cx * cx + 1.0 / 12;
+    const double mu02 = blob.sum_yy / n - cy * cy + 1.0 / 12;
+    const double mu11 = blob.sum_xy / n - cx * cy;
+
+    const double common = std::sqrt((mu20 - mu02) * (mu20 - mu02) / 4 + mu11 * mu11);
+    const double lambda_1 = (mu20 + mu02) / 2 + common;
+    const double lambda_2 = std::max((mu20 + mu02) / 2 - common, 0.0);
+    const double theta = 0.5 * std::atan2(2 * mu11, mu20 - mu02);
+
+    // A uniform rectangle of side l has a variance of l^2 / 12 along that side
+    cv::RotatedRect box(cv::Point2f(cx, cy),
+                        cv::Size2f(std::sqrt(12 * lambda_1), std::sqrt(12 * lambda_2)),
+                        theta / CV_PI * 180);
+    auto light = Light(box, cv::Point2f(cx, cy));
+
+    if (isLight(light)) {
+      judgeColor(light, blob.sum_diff, blob.edge_pixels);
       lights.emplace_back(light);
     }
   }
-  std::sort(lights.begin(), lights.end(), [](const Light &l1, const Light &l2) {
-    return l1.center.x < l2.center.x;
-  });
-  return lights;
+}
+
+void Detector::judgeColor(Light &light, int sum_diff, int n) const noexcept {
+  light.color_diff = static_cast<float>(sum_diff) / n;
+  if (std::abs(sum_diff) / n > light_params.color_diff_thresh) {
+    light.color = sum_diff > 0 ? EnemyColor::RED : EnemyColor::BLUE;
+  }
 }
 
 bool Detector::isLight(const Light &light) noexcept {
@@ -121,6 +801,9 @@ bool Detector::isLight(const Light &light) noexcept {
   bool is_light = ratio_ok && angle_ok;
 
   // Fill in debug information
+  if (!enable_debug) {
+    return is_light;
+  }
   rm_interfaces::msg::DebugLight light_data;
   light_data.center_x = light.center.x;
   light_data.ratio = ratio;
@@ -132,54 +815,98 @@ bool Detector::isLight(const Light &light) noexcept {
 }
 
 std::vector<Armor> Detector::matchLights(const std::vector<Light> &lights) noexcept {
+  // The armors go to the second stage, so only their growth is avoided
   std::vector<Armor> armors;
+  armors.reserve(last_armors_num_);
   this->debug_armors.data.clear();
+  buildLightTable(lights);
+
+  const int n = static_cast<int>(lights.size());
+  // Set up by findCandidates() for these lights
+  const bool tracked = light_tracker_.active(lights.size());
   // Loop all the pairing of lights
-  for (auto light_1 = lights.begin(); light_1 != lights.end(); light_1++) {
-    if (light_1->color != detect_color) continue;
-    double max_iter_width = light_1->length * armor_params.max_large_center_distance;
-
-    for (auto light_2 = light_1 + 1; light_2 != lights.end(); light_2++) {
-      if (light_2->color != detect_color) continue;
-      if (containLight(light_1 - lights.begin(), light_2 - lights.begin(), lights)) {
-        continue;
+  for (int i = 0; i < n; i++) {
+    if (lights[i].color != detect_color) continue;
+    // Lights are sorted by x, so only the ones inside the x window can be paired
+    const float max_x = light_table_.center_x[i] +
+                        lights[i].length * armor_params.max_large_center_distance;
+    const int end = static_cast<int>(
+      std::upper_bound(light_table_.center_x.begin() + i + 1, light_table_.center_x.end(), max_x) -
+      light_table_.center_x.begin());
+
+    for (int j = i + 1; j < end; j++) {
+      if (lights[j].color != detect_color) continue;
+      LightTracker::Verdict verdict = tracked ? light_tracker_.cached(i, j) : LightTracker::UNKNOWN;
+      if (verdict == LightTracker::UNKNOWN) {
+        verdict = containLight(i, j) ? LightTracker::CONTAINED
+                                     : LightTracker::toVerdict(isArmor(lights[i], lights[j]));
       }
-      if (light_2->center.x - light_1->center.x > max_iter_width) break;
-
-      auto type = isArmor(*light_1, *light_2);
-      if (type != ArmorType::INVALID) {
-        auto armor = Armor(*light_1, *light_2);
-        armor.type = type;
-        armors.emplace_back(armor);
+      if (tracked) {
+        light_tracker_.store(i, j, verdict);
+      }
+      if (verdict == LightTracker::SMALL || verdict == LightTracker::LARGE) {
+        armors.emplace_back(lights[i], lights[j]).type =
+          verdict == LightTracker::SMALL ? ArmorType::SMALL : ArmorType::LARGE;
       }
     }
   }
+  light_tracker_.finish();
 
+  last_armors_num_ = armors.size();
   return armors;
 }
 
+void Detector::buildLightTable(const std::vector<Light> &lights) noexcept {
+  auto &t = light_table_;
+  const size_t n = lights.size();
+  for (auto *v : {&t.center_x, &t.center_y, &t.top_x, &t.top_y, &t.bottom_x, &t.bottom_y,
+                  &t.min_y, &t.max_y, &t.length, &t.width}) {
+    v->resize(n);
+  }
+  for (size_t k = 0; k < n; k++) {
+    const Light &l = lights[k];
+    t.center_x[k] = l.center.x, t.center_y[k] = l.center.y;
+    t.top_x[k] = l.top.x, t.top_y[k] = l.top.y;
+    t.bottom_x[k] = l.bottom.x, t.bottom_y[k] = l.bottom.y;
+    t.min_y[k] = std::min({l.top.y, l.bottom.y, l.center.y});
+    t.max_y[k] = std::max({l.top.y, l.bottom.y, l.center.y});
+    t.length[k] = l.length, t.width[k] = l.width;
+  }
+}
+
 // Check if there is another light in the boundingRect formed by the 2 lights
-bool Detector::containLight(const int i, const int j, const std::vector<Light> &lights) noexcept {
-  const Light &light_1 = lights.at(i), light_2 = lights.at(j);
-  auto points = std::vector<cv::Point2f>{light_1.top, light_1.bottom, light_2.top, light_2.bottom};
-  auto bounding_rect = cv::boundingRect(points);
-  double avg_length = (light_1.length + light_2.length) / 2.0;
-  double avg_width = (light_1.width + light_2.width) / 2.0;
+bool Detector::containLight(const int i, const int j) const noexcept {
+  const auto &t = light_table_;
+  // Same as cv::boundingRect() of the 4 end points, without building a point list
+  const int rect_x0 = cvFloor(std::min({t.top_x[i], t.bottom_x[i], t.top_x[j], t.bottom_x[j]}));
+  const int rect_y0 = cvFloor(std::min({t.top_y[i], t.bottom_y[i], t.top_y[j], t.bottom_y[j]}));
+  const int rect_x1 =
+    cvFloor(std::max({t.top_x[i], t.bottom_x[i], t.top_x[j], t.bottom_x[j]})) + 1;
+  const int rect_y1 =
+    cvFloor(std::max({t.top_y[i], t.bottom_y[i], t.top_y[j], t.bottom_y[j]})) + 1;
+  auto contains = [&](float x, float y) {
+    return rect_x0 <= x && x < rect_x1 && rect_y0 <= y && y < rect_y1;
+  };
+
+  const float avg_length = (t.length[i] + t.length[j]) / 2.0;
+  const float avg_width = (t.width[i] + t.width[j]) / 2.0;
   // Only check lights in between
   for (int k = i + 1; k < j; k++) {
-    const Light &test_light = lights.at(k);
-
+    // Cheap rejection by the vertical extent
+    if (t.max_y[k] < rect_y0 || t.min_y[k] >= rect_y1) {
+      continue;
+    }
     // 防止数字干扰
-    if (test_light.width > 2 * avg_width) {
+    if (t.width[k] > 2 * avg_width) {
       continue;
     }
     // 防止红点准星或弹丸干扰
-    if (test_light.length < 0.5 * avg_length) {
+    if (t.length[k] < 0.5 * avg_length) {
       continue;
     }
 
-    if (bounding_rect.contains(test_light.top) || bounding_rect.contains(test_light.bottom) ||
-        bounding_rect.contains(test_light.center)) {
+    if (contains(t.top_x[k], t.top_y[k]) || contains(t.bottom_x[k], t.bottom_y[k]) ||
+        contains(t.center_x[k], t.center_y[k])) {
       return true;
     }
   }
@@ -217,6 +944,9 @@ ArmorType Detector::isArmor(const Light &light_1, const Light &light_2) noexcept
   }
 
   // Fill in debug information
+  if (!enable_debug) {
+    return type;
+  }
   rm_interfaces::msg::DebugArmor armor_data;
   armor_data.type = armorTypeToString(type);
   armor_data.center_x = (light_1.center.x + light_2.center.x) / 2;
@@ -228,14 +958,20 @@ ArmorType Detector::isArmor(const Light &light_1, const Light &light_2) noexcept
   return type;
 }
 
-cv::Mat Detector::getAllNumbersImage() const noexcept {
-  if (armors_.empty()) {
+cv::Mat Detector::getAllNumbersImage(const std::vector<Armor> &armors) noexcept {
+  if (armors.empty()) {
     return cv::Mat(cv::Size(20, 28), CV_8UC1);
   } else {
     std::vector<cv::Mat> number_imgs;
-    number_imgs.reserve(armors_.size());
-    for (auto &armor : armors_) {
-      number_imgs.emplace_back(armor.number_img);
+    number_imgs.reserve(armors.size());
+    for (auto &armor : armors) {
+      // The keypoint detector extracts no number image
+      if (!armor.number_img.empty()) {
+        number_imgs.emplace_back(armor.number_img);
+      }
+    }
+    if (number_imgs.empty()) {
+      return cv::Mat(cv::Size(20, 28), CV_8UC1);
     }
     cv::Mat all_num_img;
     cv::vconcat(number_imgs, all_num_img);
@@ -243,7 +979,7 @@ cv::Mat Detector::getAllNumbersImage() const noexcept {
   }
 }
 
-void Detector::drawResults(cv::Mat &img) const noexcept {
+void Detector::drawResults(cv::Mat &img, const std::vector<Armor> &armors) noexcept {
   // Draw Lights
 
   // for (const auto &light : lights_) {
@@ -254,7 +990,7 @@ void Detector::drawResults(cv::Mat &img) const noexcept {
   // }
 
   // Draw armors
-  for (const auto &armor : armors_) {
+  for (const auto &armor : armors) {
     // cv::line(img, armor.left_light.top, armor.right_light.bottom, cv::Scalar(0, 255, 0), 1);
     // cv::line(img, armor.left_light.bottom, armor.right_light.top, cv::Scalar(0, 255, 0), 1);
 
@@ -272,9 +1008,11 @@ void Detector::drawResults(cv::Mat &img) const noexcept {
              cv::LINE_AA);
   }
   // Show numbers and confidence
-  for (const auto &armor : armors_) {
-    std::string text =
-      fmt::format("{} {}", armorTypeToString(armor.type), armor.classfication_result);
+  for (const auto &armor : armors) {
+    std::string text = fmt::format("{} {}:{:.1f}%",
+                                   armorTypeToString(armor.type),
+                                   armorNumberToString(armor.number),
+                                   armor.confidence * 100.0);
     cv::putText(
       img, text, armor.left_light.top, cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0, 255, 255), 2);
   }
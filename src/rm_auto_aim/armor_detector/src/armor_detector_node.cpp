@@ -19,13 +19,17 @@
 
 // std
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <filesystem>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <numeric>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 // ros2
 #include <cv_bridge/cv_bridge.h>
@@ -41,6 +45,7 @@
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
 // third party
 #include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 // project
@@ -48,22 +53,64 @@
 #include "armor_detector/ba_solver.hpp"
 #include "armor_detector/types.hpp"
 #include "rm_utils/assert.hpp"
+#include "rm_utils/bayer.hpp"
 #include "rm_utils/common.hpp"
+#include "rm_utils/debug_image.hpp"
+#include "rm_utils/flight_recorder.hpp"
 #include "rm_utils/logger/log.hpp"
 #include "rm_utils/math/pnp_solver.hpp"
 #include "rm_utils/math/utils.hpp"
+#include "rm_utils/opencv_config.hpp"
+#include "rm_utils/thread_config.hpp"
+#include "rm_utils/trace.hpp"
 #include "rm_utils/url_resolver.hpp"
+#include "rm_utils/worker_pool.hpp"
 
 namespace fyt::auto_aim {
 ArmorDetectorNode::ArmorDetectorNode(const rclcpp::NodeOptions &options)
     : Node("armor_detector", options) {
   FYT_REGISTER_LOGGER("armor_detector", "~/fyt2024-log", INFO);
   FYT_INFO("armor_detector", "Starting ArmorDetectorNode!");
+  startup_.begin("constructor");
+  // Worker pool of the armor loops, created before OpenCV is given the cores it leaves
+  const int64_t worker_threads = this->declare_parameter("worker_pool.threads", 0);
+  utils::WorkerPool::instance(static_cast<size_t>(std::max<int64_t>(worker_threads, 0)));
+  FYT_INFO("armor_detector",
+           "OpenCV: {}",
+           utils::applyOpenCVConfig(utils::declareOpenCVConfig(*this)));
   // Detector
   detector_ = initDetector();
 
+  // Overload control, the optional stages are turned off one by one
+  OverloadController::Params overload_params;
+  overload_params.enable = this->declare_parameter("overload.enable", false);
+  overload_params.deadline =
+      this->declare_parameter("overload.deadline", overload_params.deadline);
+  overload_params.degrade_ratio = this->declare_parameter(
+      "overload.degrade_ratio", overload_params.degrade_ratio);
+  overload_params.recover_ratio = this->declare_parameter(
+      "overload.recover_ratio", overload_params.recover_ratio);
+  overload_params.hold =
+      this->declare_parameter("overload.hold", overload_params.hold);
+  overload_ = std::make_unique<OverloadController>(overload_params);
+
   // Tricks to make pose more accurate
   use_ba_ = this->declare_parameter("use_ba", true);
+  pose_budget_.enable =
+      this->declare_parameter("pose_budget.enable", pose_budget_.enable);
+  pose_budget_.ba_min_light_length = this->declare_parameter(
+      "pose_budget.ba_min_light_length", pose_budget_.ba_min_light_length);
+  pose_budget_.ba_max_distance = this->declare_parameter(
+      "pose_budget.ba_max_distance", pose_budget_.ba_max_distance);
+  pose_budget_.ba_target_only = this->declare_parameter(
+      "pose_budget.ba_target_only", pose_budget_.ba_target_only);
+  pose_budget_.target_disambiguation = this->declare_parameter(
+      "pose_budget.target_disambiguation", pose_budget_.target_disambiguation);
+  const int corner_max_rays =
+      this->declare_parameter("pose_budget.corner_max_rays", 9);
+  if (pose_budget_.enable && detector_->corner_corrector != nullptr) {
+    detector_->corner_corrector->setMaxRays(corner_max_rays);
+  }
 
   // Armors Publisher
   armors_pub_ = this->create_publisher<rm_interfaces::msg::Armors>(
@@ -72,6 +119,7 @@ ArmorDetectorNode::ArmorDetectorNode(const rclcpp::NodeOptions &options)
   // Transform initialize
   odom_frame_ = this->declare_parameter("target_frame", "odom");
   imu_to_camera_ = Eigen::Matrix3d::Identity();
+  t_odom_camera_ = Eigen::Vector3d::Zero();
 
   // Visualization Marker Publisher
   // See http://wiki.ros.org/rviz/DisplayTypes/Marker
@@ -100,39 +148,121 @@ ArmorDetectorNode::ArmorDetectorNode(const rclcpp::NodeOptions &options)
 
   // Debug Publishers
   debug_ = this->declare_parameter("debug", true);
+  updateParams([this](DetectorParams &p) { p.debug = debug_; });
   if (debug_) {
     createDebugPublishers();
   }
+  debug_max_fps_ = this->declare_parameter("debug_max_fps", 30.0);
+  debug_queue_size_ =
+      std::max<int64_t>(this->declare_parameter("debug_queue_size", 2), 1);
+  debug_image_params_ = utils::declareDebugImageParams(*this, "debug_image");
+  debug_thread_ = std::thread(&ArmorDetectorNode::debugLoop, this);
+
+  // Training samples, written by a background thread
+  sample_dumper_ = utils::declareSampleDumper(*this);
+
+  // Pipelined detection, light finding of the next frame runs while the
+  // current frame is being classified and solved
+  pipeline_enable_ = this->declare_parameter("pipeline.enable", false);
+  if (pipeline_enable_) {
+    pipeline_thread_ = std::thread(&ArmorDetectorNode::pipelineLoop, this);
+  }
+
+  // Shared perception scheduler, the newest frame waits while one is being
+  // processed. The auto aim mode is active at startup
+  if (this->declare_parameter("scheduler.enable", false)) {
+    const int64_t threads = this->declare_parameter("scheduler.threads", 0);
+    auto &scheduler = utils::PerceptionScheduler::instance(
+        static_cast<size_t>(std::max<int64_t>(threads, 0)));
+    scheduler_queue_ = scheduler.addQueue("armor_detector", 1, 1);
+  }
   // Debug param change moniter
   debug_param_sub_ = std::make_shared<rclcpp::ParameterEventHandler>(this);
   debug_cb_handle_ = debug_param_sub_->add_parameter_callback(
       "debug", [this](const rclcpp::Parameter &p) {
         debug_ = p.as_bool();
+        updateParams([this](DetectorParams &d) { d.debug = debug_; });
         debug_ ? createDebugPublishers() : destroyDebugPublishers();
       });
 
+  // Sensor AOI requested from the camera driver
+  camera_control_params_.enable =
+      this->declare_parameter("camera_control.enable", false);
+  camera_control_params_.scale =
+      this->declare_parameter("camera_control.scale", 2.0);
+  camera_control_params_.min_interval =
+      this->declare_parameter("camera_control.min_interval", 0.2);
+  if (camera_control_params_.enable) {
+    camera_control_pub_ =
+        this->create_publisher<rm_interfaces::msg::CameraControl>(
+            "camera_control", rclcpp::QoS(1));
+  }
+
+  // Frames get a callback group of their own, so that with a multi-threaded
+  // executor the target, attitude, tf and set_mode callbacks never delay the
+  // next image. Camera info shares it since it sets up the pose estimator
+  image_group_ =
+      this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  image_sub_options_.callback_group = image_group_;
+
+  // Done once the first camera info is in and the pose estimator is built
+  startup_.begin("pose_estimator");
   cam_info_sub_ = this->create_subscription<sensor_msgs::msg::CameraInfo>(
       "camera_info", rclcpp::SensorDataQoS(),
       [this](sensor_msgs::msg::CameraInfo::SharedPtr camera_info) {
-        cam_center_ = cv::Point2f(camera_info->k[2], camera_info->k[5]);
-        cam_info_ =
-            std::make_shared<sensor_msgs::msg::CameraInfo>(*camera_info);
-        // Setup armor pose solver
-        armor_pose_estimator_ = std::make_unique<ArmorPoseEstimator>(cam_info_);
-        armor_pose_estimator_->enableBA(use_ba_);
-        cam_info_sub_.reset();
-      });
+        if (cam_info_ == nullptr) {
+          cam_center_ = cv::Point2f(camera_info->k[2], camera_info->k[5]);
+          cam_info_ =
+              std::make_shared<sensor_msgs::msg::CameraInfo>(*camera_info);
+          // Setup armor pose solver in the background, the g2o solvers take
+          // a while to construct. Assigned under the lock that finishStartup()
+          // takes, the task may finish the last step before the assignment
+          std::lock_guard<std::mutex> lock(startup_mutex_);
+          pose_estimator_future_ = std::async(
+              std::launch::async, [this, cam_info = cam_info_]() {
+                auto estimator = std::make_unique<ArmorPoseEstimator>(cam_info);
+                estimator->enableBA(use_ba_);
+                estimator->setBudget(pose_budget_);
+                finishStartupStep("pose_estimator");
+                return estimator;
+              });
+        }
+        if (!camera_control_params_.enable) {
+          cam_info_sub_.reset();
+          return;
+        }
+        // The AOI of every frame comes with its camera info
+        const auto &roi = camera_info->roi;
+        FrameAoi entry;
+        entry.stamp_ns = rclcpp::Time(camera_info->header.stamp).nanoseconds();
+        entry.aoi = roi.width > 0 && roi.height > 0
+                        ? cv::Rect(roi.x_offset, roi.y_offset, roi.width,
+                                   roi.height)
+                        : cv::Rect(0, 0, camera_info->width,
+                                   camera_info->height);
+        std::lock_guard<std::mutex> lock(frame_aoi_mutex_);
+        frame_aois_[frame_aoi_next_] = entry;
+        frame_aoi_next_ = (frame_aoi_next_ + 1) % frame_aois_.size();
+      },
+      image_sub_options_);
 
   img_sub_ = this->create_subscription<sensor_msgs::msg::Image>(
       "image_raw", rclcpp::SensorDataQoS(),
       std::bind(&ArmorDetectorNode::imageCallback, this,
-                std::placeholders::_1));
+                std::placeholders::_1),
+      image_sub_options_);
 
-  // target_sub_ = this->create_subscription<rm_interfaces::msg::Target>(
-  //   "armor_solver/target",
-  //   rclcpp::SensorDataQoS(),
-  //   std::bind(&ArmorDetectorNode::targetCallback, this,
-  //   std::placeholders::_1));
+  // Tracker-guided roi
+  roi_params_.enable = this->declare_parameter("roi.enable", false);
+  roi_params_.full_scan_interval =
+      this->declare_parameter("roi.full_scan_interval", 30);
+  roi_params_.padding = this->declare_parameter("roi.padding", 0.3);
+  roi_params_.max_target_age = this->declare_parameter("roi.max_target_age", 0.1);
+
+  target_sub_ = this->create_subscription<rm_interfaces::msg::Target>(
+      "armor_solver/target", rclcpp::SensorDataQoS(),
+      std::bind(&ArmorDetectorNode::targetCallback, this,
+                std::placeholders::_1));
 
   tf2_buffer_ = std::make_shared<tf2_ros::Buffer>(this->get_clock());
   auto timer_interface = std::make_shared<tf2_ros::CreateTimerROS>(
@@ -140,58 +270,314 @@ ArmorDetectorNode::ArmorDetectorNode(const rclcpp::NodeOptions &options)
   tf2_buffer_->setCreateTimerInterface(timer_interface);
   tf2_listener_ = std::make_shared<tf2_ros::TransformListener>(*tf2_buffer_);
 
+  // Gimbal attitude cache, filled from serial/receive unless the serial driver
+  // runs in this process and writes the process cache
+  use_attitude_cache_ = this->declare_parameter("use_attitude_cache", true);
+  if (use_attitude_cache_) {
+    serial_receive_sub_ =
+        this->create_subscription<rm_interfaces::msg::SerialReceiveData>(
+            "serial/receive", rclcpp::SensorDataQoS(),
+            [this](const rm_interfaces::msg::SerialReceiveData::SharedPtr msg) {
+              if (msg->header.frame_id != odom_frame_ ||
+                  !utils::processAttitudeCache().empty()) {
+                return;
+              }
+              // Same as the odom to gimbal_link tf of the serial driver
+              tf2::Quaternion q;
+              q.setRPY(msg->roll, msg->pitch, msg->yaw);
+              attitude_cache_.push(
+                  rclcpp::Time(msg->header.stamp).nanoseconds(),
+                  Eigen::Quaterniond(q.w(), q.x(), q.y(), q.z()));
+            });
+  }
+
   set_mode_srv_ = this->create_service<rm_interfaces::srv::SetMode>(
       "armor_detector/set_mode",
       std::bind(&ArmorDetectorNode::setModeCallback, this,
                 std::placeholders::_1, std::placeholders::_2));
 
   heartbeat_ = HeartBeatPublisher::create(this);
+  auto &metrics = heartbeat_->metrics();
+  candidates_latency_ = &metrics.latency("candidates");
+  armors_latency_ = &metrics.latency("armors");
+  end_to_end_latency_ = &metrics.latency("end_to_end");
+  dropped_frames_ = &metrics.counter("dropped_frames");
+  dropped_debug_frames_ = &metrics.counter("dropped_debug_frames");
+  pipeline_depth_ = &metrics.gauge("pipeline_queue");
+  binary_thres_gauge_ = &metrics.gauge("binary_thres");
+  expired_frames_ = &metrics.counter("expired_frames");
+  number_cache_hits_ = &metrics.counter("number_cache_hits");
+  ba_skipped_ = &metrics.counter("ba_skipped");
+  cascade_rejects_ = &metrics.counter("cascade_rejects");
+  cascade_audited_ = &metrics.counter("cascade_audited");
+  cascade_misses_ = &metrics.counter("cascade_misses");
+  overload_degrades_ = &metrics.counter("overload_degrades");
+  overload_recovers_ = &metrics.counter("overload_recovers");
+  overload_level_ = &metrics.gauge("overload_level");
+  startup_.attach(metrics);
+  finishStartupStep("constructor");
+}
+
+void ArmorDetectorNode::finishStartupStep(const std::string &step) {
+  if (startup_.finish(step)) {
+    FYT_INFO("armor_detector", "Startup {}", startup_.summary());
+  }
+}
+
+bool ArmorDetectorNode::finishStartup() {
+  // Every future is ready, or about to be, once the last step is finished
+  if (!startup_.ready()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(startup_mutex_);
+  if (classifier_future_.valid()) {
+    detector_->classifier = classifier_future_.get();
+  }
+  if (keypoint_future_.valid()) {
+    detector_->keypoint_detector = keypoint_future_.get();
+  }
+  if (pose_estimator_future_.valid()) {
+    armor_pose_estimator_ = pose_estimator_future_.get();
+  }
+  startup_done_ = true;
+  return true;
+}
+
+ArmorDetectorNode::~ArmorDetectorNode() {
+  // The background steps report to the heartbeat, which is destroyed first
+  std::unique_lock<std::mutex> startup_lock(startup_mutex_);
+  if (classifier_future_.valid()) {
+    classifier_future_.wait();
+  }
+  if (keypoint_future_.valid()) {
+    keypoint_future_.wait();
+  }
+  if (pose_estimator_future_.valid()) {
+    pose_estimator_future_.wait();
+  }
+  startup_lock.unlock();
+  if (scheduler_queue_ >= 0) {
+    utils::PerceptionScheduler::instance().removeQueue(scheduler_queue_);
+  }
+  pipeline_running_ = false;
+  if (pipeline_thread_.joinable()) {
+    pipeline_thread_.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(debug_queue_mutex_);
+    debug_running_ = false;
+  }
+  debug_queue_cv_.notify_all();
+  if (debug_thread_.joinable()) {
+    debug_thread_.join();
+  }
 }
 
 void ArmorDetectorNode::imageCallback(
     const sensor_msgs::msg::Image::ConstSharedPtr img_msg) {
-  // Get the transform from odom to gimbal
-  try {
-    rclcpp::Time target_time = img_msg->header.stamp;
-    auto odom_to_gimbal = tf2_buffer_->lookupTransform(
-        odom_frame_, img_msg->header.frame_id, target_time,
-        rclcpp::Duration::from_seconds(0.01));
-    auto msg_q = odom_to_gimbal.transform.rotation;
-    tf2::Quaternion tf_q;
-    tf2::fromMsg(msg_q, tf_q);
-    tf2::Matrix3x3 tf2_matrix = tf2::Matrix3x3(tf_q);
-    imu_to_camera_ << tf2_matrix.getRow(0)[0], tf2_matrix.getRow(0)[1],
-        tf2_matrix.getRow(0)[2], tf2_matrix.getRow(1)[0],
-        tf2_matrix.getRow(1)[1], tf2_matrix.getRow(1)[2],
-        tf2_matrix.getRow(2)[0], tf2_matrix.getRow(2)[1],
-        tf2_matrix.getRow(2)[2];
-  } catch (...) {
-    FYT_ERROR("armor_detector", "Something Wrong when lookUpTransform");
+  // Nothing reads the models before they are taken here
+  if (!startup_done_ && !finishStartup()) {
+    return;
+  }
+  if (scheduler_queue_ >= 0) {
+    // The worker reads the pose estimator without locking, so wait for it here
+    if (armor_pose_estimator_ == nullptr) {
+      return;
+    }
+    if (!utils::PerceptionScheduler::instance().submit(
+            scheduler_queue_, [this, img_msg]() { processImage(img_msg); })) {
+      dropped_frames_->fetch_add(1, std::memory_order_relaxed);
+    }
     return;
   }
+  processImage(img_msg);
+}
 
-  // Detect armors
-  auto armors = detectArmors(img_msg);
+void ArmorDetectorNode::processImage(
+    const sensor_msgs::msg::Image::ConstSharedPtr &img_msg) {
+  if (pipeline_enable_) {
+    // Stage 2 reads the pose estimator without locking, so wait for it here
+    if (armor_pose_estimator_ == nullptr) {
+      return;
+    }
+    DetectionFrame frame;
+    if (detectCandidates(img_msg, frame)) {
+      // Drop the frame if stage 2 falls behind
+      if (!pipeline_queue_.push(std::move(frame))) {
+        dropped_frames_->fetch_add(1, std::memory_order_relaxed);
+      }
+      pipeline_depth_->store(pipeline_queue_.size(), std::memory_order_relaxed);
+    }
+  } else {
+    DetectionFrame frame;
+    if (detectCandidates(img_msg, frame)) {
+      processCandidates(frame);
+    }
+  }
+}
+
+bool ArmorDetectorNode::detectCandidates(
+    const sensor_msgs::msg::Image::ConstSharedPtr &img_msg,
+    DetectionFrame &frame) {
+  utils::Trace::setFrame(rclcpp::Time(img_msg->header.stamp).nanoseconds());
+  if (frameExpired(img_msg->header)) {
+    return false;
+  }
+  utils::LatencyScope stage_latency(candidates_latency_);
+  // Get the transform from odom to camera
+  if (!lookupCameraPose(img_msg->header)) {
+    return false;
+  }
+
+  // The image may be a smaller AOI of the sensor, the search window and the
+  // results are in the full frame of the calibration
+  const cv::Rect aoi = getFrameAoi(*img_msg);
+  frame.sensor_offset = aoi.tl();
+  cv::Size full_size(img_msg->width, img_msg->height);
+  if (cam_info_ != nullptr && cam_info_->width > 0 && cam_info_->height > 0) {
+    full_size = cv::Size(cam_info_->width, cam_info_->height);
+  }
+  if (camera_control_params_.enable) {
+    requestCameraAoi(img_msg->header.stamp, full_size);
+  }
+
+  // Search window from the tracker
+  frame.roi = cv::Rect();
+  if (roi_params_.enable) {
+    frame.roi = getTargetRoi(img_msg->header.stamp, imu_to_camera_,
+                             t_odom_camera_, full_size);
+  }
+
+  // Read the parameters once per frame
+  frame.params = std::atomic_load(&params_);
+  applyParams(*frame.params);
+  const bool debug_allowed = overload_->level() < OverloadController::NO_DEBUG;
+  detector_->enable_debug = detector_->enable_debug && debug_allowed;
+
+  // Convert ROS img to cv::Mat, a raw frame is read by the detector as it is
+  const auto bayer_pattern = utils::bayerPattern(img_msg->encoding);
+  cv::Mat img;
+  if (bayer_pattern != utils::BayerPattern::NONE) {
+    img = cv_bridge::toCvShare(img_msg)->image;
+    detector_->bayer_pattern = bayer_pattern;
+  } else {
+    img = cv_bridge::toCvShare(img_msg, "rgb8")->image;
+  }
+  frame.candidates =
+      detector_->findCandidates(img, frame.roi - frame.sensor_offset);
+  frame.candidates.offset += cv::Point2f(frame.sensor_offset);
+  if (preprocess_opencl_ &&
+      detector_->preprocess_backend == Detector::PreprocessBackend::CPU) {
+    preprocess_opencl_ = false;
+    FYT_WARN("armor_detector",
+             "OpenCL preprocessing failed or disabled, falling back to the CPU");
+  }
+  binary_thres_gauge_->store(detector_->binaryThreshold(), std::memory_order_relaxed);
+  cascade_rejects_->fetch_add(detector_->cascadeRejects(), std::memory_order_relaxed);
+  frame.img_msg = img_msg;
+  frame.imu_to_camera = imu_to_camera_;
+
+  // The debug data of stage 1 would be overwritten by the next frame
+  frame.debug = frame.params->debug && debug_allowed;
+  if (frame.debug) {
+    // binary_img is never reused while a frame refers to it, so sharing it is safe
+    frame.binary_img = detector_->binary_img;
+    frame.debug_lights = std::move(detector_->debug_lights);
+    frame.debug_armors = std::move(detector_->debug_armors);
+  }
+  return true;
+}
+
+void ArmorDetectorNode::processCandidates(DetectionFrame &frame) {
+  // May run on another thread than the first stage
+  utils::Trace::setFrame(rclcpp::Time(frame.img_msg->header.stamp).nanoseconds());
+  // The frame may have waited for this stage
+  if (frameExpired(frame.img_msg->header)) {
+    return;
+  }
+  utils::LatencyScope stage_latency(armors_latency_);
+  const auto level = overload_->level();
+  // Detect armors, the classifier and the corner corrector are only used by this stage
+  if (detector_->classifier != nullptr) {
+    detector_->classifier->threshold = frame.params->classifier_threshold;
+  }
+  detector_->number_cache = frame.params->number_cache;
+  detector_->enable_corner_correction =
+      level < OverloadController::NO_CORNER_CORRECTION;
+  auto armors = detector_->classifyCandidates(frame.candidates);
+  number_cache_hits_->fetch_add(detector_->numberCacheHits(),
+                                std::memory_order_relaxed);
+  cascade_audited_->fetch_add(detector_->cascadeAudited(), std::memory_order_relaxed);
+  cascade_misses_->fetch_add(detector_->cascadeMisses(), std::memory_order_relaxed);
+  if (!frame.roi.empty()) {
+    // Fall back to a full-frame scan on the next frame if the target is lost
+    roi_lost_ = armors.empty();
+  }
+  aoi_lost_ = armors.empty();
+
+  auto final_time = this->now();
+  auto latency = (final_time - frame.img_msg->header.stamp).seconds() * 1000;
 
   // Init message
-  armors_msg_.header = img_msg->header;
-  armors_msg_.armors.clear();
+  armors_msg_.header = frame.img_msg->header;
 
   // Extract armor poses
   if (armor_pose_estimator_ != nullptr) {
-    armors_msg_.armors =
-        armor_pose_estimator_->extractArmorPoses(armors, imu_to_camera_);
+    // Warm start BA and pick the PnP solutions with the yaw of the tracked target
+    const bool use_ba = use_ba_ && level < OverloadController::NO_BA;
+    armor_pose_estimator_->enableBA(use_ba);
+    std::optional<ArmorPoseEstimator::TargetYaw> target_yaw;
+    if (use_ba || pose_budget_.enable) {
+      std::lock_guard<std::mutex> lock(target_mutex_);
+      if (tracked_target_ != nullptr &&
+          tracked_target_->header.frame_id == odom_frame_) {
+        double dt = (rclcpp::Time(frame.img_msg->header.stamp) -
+                     rclcpp::Time(tracked_target_->header.stamp))
+                        .seconds();
+        // Same age limit as the tracker-guided roi
+        if (std::abs(dt) < roi_params_.max_target_age) {
+          target_yaw = ArmorPoseEstimator::TargetYaw{
+              static_cast<ArmorNumber>(tracked_target_->id),
+              tracked_target_->yaw + tracked_target_->v_yaw * dt,
+              tracked_target_->armors_num};
+        }
+      }
+    }
+    armor_pose_estimator_->extractArmorPoses(armors, frame.imu_to_camera,
+                                             target_yaw, armors_msg_.armors);
+    ba_skipped_->fetch_add(armor_pose_estimator_->baSkipped(),
+                           std::memory_order_relaxed);
 
-    // std::string path =
-    //   fmt::format("/home/zcf/fyt2024-log/images/{}/{}.jpg",
-    //   armor_msg.number, now().seconds());
-    // cv::imwrite(path, armor.number_img);
+    if (sample_dumper_ != nullptr) {
+      const int64_t stamp =
+          rclcpp::Time(frame.img_msg->header.stamp).nanoseconds();
+      for (const auto &armor : armors) {
+        sample_dumper_->submit(armor.number_img,
+                               armorNumberToString(armor.number), stamp,
+                               armor.confidence);
+      }
+    }
   } else {
+    armors_msg_.armors.clear();
     FYT_WARN("armor_detector", "PnP Failed!");
   }
 
+  // Hand the debug info over to the debug thread, the armors are done with
+  if (frame.debug && debugFrameDue()) {
+    DebugFrame debug_frame;
+    debug_frame.img_msg = frame.img_msg;
+    debug_frame.binary_img = std::move(frame.binary_img);
+    debug_frame.armors = std::move(armors);
+    debug_frame.debug_lights = std::move(frame.debug_lights);
+    debug_frame.debug_armors = std::move(frame.debug_armors);
+    debug_frame.roi = frame.roi;
+    debug_frame.sensor_offset = frame.sensor_offset;
+    debug_frame.latency = latency;
+    pushDebugFrame(std::move(debug_frame));
+  }
+
   // Publishing marker
-  if (debug_) {
+  if (debug_ && level < OverloadController::NO_DEBUG) {
     marker_array_.markers.clear();
     armor_marker_.id = 0;
     text_marker_.id = 0;
@@ -203,15 +589,70 @@ void ArmorDetectorNode::imageCallback(
       text_marker_.pose.position = armor.pose.position;
       text_marker_.id++;
       text_marker_.pose.position.y -= 0.1;
-      text_marker_.text = armor.number;
+      text_marker_.text = std::string(armorNumberToString(armor.number));
       marker_array_.markers.emplace_back(armor_marker_);
       marker_array_.markers.emplace_back(text_marker_);
     }
     publishMarkers();
   }
 
+  const uint64_t frame_id = rclcpp::Time(armors_msg_.header.stamp).nanoseconds();
+  for (const auto &armor : armors_msg_.armors) {
+    const auto &position = armor.pose.position;
+    const auto &orientation = armor.pose.orientation;
+    utils::FlightRecorder::record(utils::FlightEvent::DETECTION,
+                                  armor.number,
+                                  frame_id,
+                                  {static_cast<float>(position.x),
+                                   static_cast<float>(position.y),
+                                   static_cast<float>(position.z),
+                                   static_cast<float>(orientation.x),
+                                   static_cast<float>(orientation.y),
+                                   static_cast<float>(orientation.z),
+                                   static_cast<float>(orientation.w),
+                                   armor.distance_to_image_center});
+  }
+
   // Publishing detected armors
   armors_pub_->publish(armors_msg_);
+  const auto now = this->now();
+  const auto end_to_end = now - frame.img_msg->header.stamp;
+  end_to_end_latency_->record(end_to_end.nanoseconds());
+
+  // Step the degraded mode by the latency of the published frames
+  const int change = overload_->update(end_to_end.seconds(), now.seconds());
+  if (change > 0) {
+    overload_degrades_->fetch_add(1, std::memory_order_relaxed);
+    FYT_WARN("armor_detector", "Overloaded, degraded to level {}",
+             static_cast<int>(overload_->level()));
+  } else if (change < 0) {
+    overload_recovers_->fetch_add(1, std::memory_order_relaxed);
+    FYT_INFO("armor_detector", "Recovered to level {}",
+             static_cast<int>(overload_->level()));
+  }
+  overload_level_->store(overload_->level(), std::memory_order_relaxed);
+}
+
+bool ArmorDetectorNode::frameExpired(const std_msgs::msg::Header &header) {
+  if (!overload_->params().enable ||
+      !overload_->expired((this->now() - rclcpp::Time(header.stamp)).seconds())) {
+    return false;
+  }
+  expired_frames_->fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+
+void ArmorDetectorNode::pipelineLoop() {
+  utils::configureThread("detector_stage2");
+  DetectionFrame frame;
+  while (pipeline_running_) {
+    if (pipeline_queue_.pop(frame)) {
+      processCandidates(frame);
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
 }
 
 std::unique_ptr<Detector> ArmorDetectorNode::initDetector() {
@@ -221,6 +662,17 @@ std::unique_ptr<Detector> ArmorDetectorNode::initDetector() {
   param_desc.integer_range[0].from_value = 0;
   param_desc.integer_range[0].to_value = 255;
   int binary_thres = declare_parameter("binary_thres", 160, param_desc);
+  AdaptiveThreshold::Params adaptive_thres;
+  adaptive_thres.enable = declare_parameter("adaptive_thres.enable", false);
+  adaptive_thres.target_ratio =
+      declare_parameter("adaptive_thres.target_ratio", adaptive_thres.target_ratio);
+  adaptive_thres.hysteresis =
+      declare_parameter("adaptive_thres.hysteresis", adaptive_thres.hysteresis);
+  adaptive_thres.gain = declare_parameter("adaptive_thres.gain", adaptive_thres.gain);
+  adaptive_thres.min_thres =
+      declare_parameter("adaptive_thres.min", adaptive_thres.min_thres);
+  adaptive_thres.max_thres =
+      declare_parameter("adaptive_thres.max", adaptive_thres.max_thres);
 
   Detector::LightParams l_params = {
       .min_ratio = declare_parameter("light.min_ratio", 0.08),
@@ -243,21 +695,154 @@ std::unique_ptr<Detector> ArmorDetectorNode::initDetector() {
 
   auto detector = std::make_unique<Detector>(binary_thres, EnemyColor::RED,
                                              l_params, a_params);
+  detector->adaptive_thres = adaptive_thres;
 
-  // Init classifier
-  namespace fs = std::filesystem;
-  fs::path model_path = utils::URLResolver::getResolvedPath(
-      "package://armor_detector/model/lenet.onnx");
-  fs::path label_path = utils::URLResolver::getResolvedPath(
-      "package://armor_detector/model/label.txt");
-  FYT_ASSERT_MSG(fs::exists(model_path) && fs::exists(label_path),
-                 model_path.string() + " Not Found!");
+  // "contour" or "connected_components"
+  std::string light_extractor =
+      declare_parameter("light.extractor", std::string("contour"));
+  detector->light_extractor =
+      light_extractor == "connected_components"
+          ? Detector::LightExtractor::CONNECTED_COMPONENTS
+          : Detector::LightExtractor::CONTOUR;
 
+  LightTracker::Params light_tracking;
+  light_tracking.enable = declare_parameter("light_tracking.enable", false);
+  light_tracking.max_shift =
+      declare_parameter("light_tracking.max_shift", light_tracking.max_shift);
+  light_tracking.max_length_change = declare_parameter(
+      "light_tracking.max_length_change", light_tracking.max_length_change);
+  detector->light_tracking = light_tracking;
+
+  detector->coarse_search.enable = declare_parameter("coarse_search.enable", false);
+  detector->coarse_search.max_area_ratio = declare_parameter(
+      "coarse_search.max_area_ratio", detector->coarse_search.max_area_ratio);
+
+  // Cheap rejection of the light pairs before the number classifier
+  CascadeFilter::Params cascade;
+  cascade.enable = declare_parameter("cascade.enable", false);
+  cascade.min_failures = declare_parameter("cascade.min_failures", cascade.min_failures);
+  cascade.max_center_fill =
+      declare_parameter("cascade.max_center_fill", cascade.max_center_fill);
+  cascade.min_width_ratio =
+      declare_parameter("cascade.min_width_ratio", cascade.min_width_ratio);
+  cascade.max_tilt_diff = declare_parameter("cascade.max_tilt_diff", cascade.max_tilt_diff);
+  cascade.min_color_ratio =
+      declare_parameter("cascade.min_color_ratio", cascade.min_color_ratio);
+  cascade.min_distance = declare_parameter("cascade.min_distance", cascade.min_distance);
+  cascade.max_distance = declare_parameter("cascade.max_distance", cascade.max_distance);
+  cascade.audit_interval =
+      declare_parameter("cascade.audit_interval", cascade.audit_interval);
+  detector->cascade = cascade;
+
+  // Init classifier, without it every matched light pair is reported as an
+  // armor with an unknown number
   double threshold = this->declare_parameter("classifier_threshold", 0.7);
   std::vector<std::string> ignore_classes = this->declare_parameter(
       "ignore_classes", std::vector<std::string>{"negative"});
-  detector->classifier = std::make_unique<NumberClassifier>(
-      model_path, label_path, threshold, ignore_classes);
+  // Inference back end, "opencv" or "openvino"
+  std::string backend =
+      this->declare_parameter("classifier_backend", std::string("opencv"));
+  std::string device =
+      this->declare_parameter("classifier_device", std::string("CPU"));
+  std::string cache_dir = this->declare_parameter(
+      "classifier_cache_dir", std::string("/tmp/fyt_model_cache"));
+  bool use_classifier = this->declare_parameter("use_classifier", true);
+  ClassificationCache::Params number_cache;
+  number_cache.enable = declare_parameter("number_cache.enable", false);
+  number_cache.max_age =
+      declare_parameter("number_cache.max_age", number_cache.max_age);
+  number_cache.min_confidence = declare_parameter(
+      "number_cache.min_confidence", number_cache.min_confidence);
+  number_cache.decay =
+      declare_parameter("number_cache.decay", number_cache.decay);
+  number_cache.max_distance =
+      declare_parameter("number_cache.max_distance", number_cache.max_distance);
+  detector->number_cache = number_cache;
+  if (use_classifier) {
+    namespace fs = std::filesystem;
+    fs::path model_path = utils::URLResolver::getResolvedPath(
+        "package://armor_detector/model/lenet.onnx");
+    fs::path label_path = utils::URLResolver::getResolvedPath(
+        "package://armor_detector/model/label.txt");
+    FYT_ASSERT_MSG(fs::exists(model_path) && fs::exists(label_path),
+                   model_path.string() + " Not Found!");
+    startup_.begin("classifier");
+    classifier_future_ = std::async(
+        std::launch::async, [this, model_path, label_path, threshold,
+                             ignore_classes, backend, device, cache_dir]() {
+          std::unique_ptr<NumberClassifier> classifier;
+          try {
+            classifier = std::make_unique<NumberClassifier>(
+                model_path, label_path, threshold, ignore_classes, backend,
+                device, cache_dir);
+          } catch (const std::exception &e) {
+            FYT_ERROR("armor_detector", "Failed to load classifier: {}",
+                      e.what());
+          }
+          finishStartupStep("classifier");
+          return classifier;
+        });
+  } else {
+    FYT_INFO("armor_detector", "Number classifier disabled");
+  }
+
+  // Learned keypoint front end, replaces the lights and the classifier
+  if (declare_parameter("keypoint.enable", false)) {
+    namespace fs = std::filesystem;
+    fs::path model_path = utils::URLResolver::getResolvedPath(declare_parameter(
+        "keypoint.model",
+        std::string("package://armor_detector/model/armor_keypoint.onnx")));
+    ArmorKeypointDetector::Params k_params;
+    k_params.input_size = static_cast<int>(
+        declare_parameter("keypoint.input_size", k_params.input_size));
+    k_params.conf_threshold = static_cast<float>(declare_parameter(
+        "keypoint.conf_threshold", static_cast<double>(k_params.conf_threshold)));
+    k_params.nms_threshold = static_cast<float>(declare_parameter(
+        "keypoint.nms_threshold", static_cast<double>(k_params.nms_threshold)));
+    k_params.min_large_center_distance = a_params.min_large_center_distance;
+    const std::string k_backend =
+        declare_parameter("keypoint.backend", std::string("openvino"));
+    const std::string k_device =
+        declare_parameter("keypoint.device", std::string("CPU"));
+    startup_.begin("keypoint");
+    keypoint_future_ = std::async(
+        std::launch::async,
+        [this, model_path, k_params, k_backend, k_device, cache_dir]() {
+          std::unique_ptr<InferenceEngine> engine;
+          if (fs::exists(model_path)) {
+            engine = InferenceEngineFactory::createEngine(
+                k_backend, model_path.string(), k_device, cache_dir);
+          }
+          std::unique_ptr<ArmorKeypointDetector> keypoint_detector;
+          if (engine != nullptr) {
+            keypoint_detector = std::make_unique<ArmorKeypointDetector>(
+                std::move(engine), k_params);
+            FYT_INFO("armor_detector", "Keypoint detector {} on {} {}",
+                     model_path.string(), k_backend, k_device);
+          } else {
+            FYT_WARN("armor_detector",
+                     "Keypoint model {} not loaded, using the lights",
+                     model_path.string());
+          }
+          finishStartupStep("keypoint");
+          return keypoint_detector;
+        });
+  }
+
+  // "cpu" or "opencl", OpenCL is enabled for the process if it is available
+  const std::string preprocess_backend =
+      declare_parameter("preprocess.backend", std::string("cpu"));
+  if (preprocess_backend == "opencl") {
+    if (cv::ocl::haveOpenCL()) {
+      cv::ocl::setUseOpenCL(true);
+      detector->preprocess_backend = Detector::PreprocessBackend::OPENCL;
+      FYT_INFO("armor_detector", "Preprocessing on OpenCL device {}",
+               cv::ocl::Device::getDefault().name());
+    } else {
+      FYT_WARN("armor_detector",
+               "OpenCL is not available, preprocessing on the CPU");
+    }
+  }
 
   // Init Corrector
   bool use_pca = this->declare_parameter("use_pca", true);
@@ -265,117 +850,422 @@ std::unique_ptr<Detector> ArmorDetectorNode::initDetector() {
     detector->corner_corrector = std::make_unique<LightCornerCorrector>();
   }
 
+  // Initial parameter snapshot
+  auto params = std::make_shared<DetectorParams>();
+  params->binary_thres = detector->binary_thres;
+  params->adaptive_thres = detector->adaptive_thres;
+  params->detect_color = detector->detect_color;
+  params->light = detector->light_params;
+  params->armor = detector->armor_params;
+  params->light_extractor = detector->light_extractor;
+  params->light_tracking = detector->light_tracking;
+  params->coarse_search = detector->coarse_search;
+  params->cascade = detector->cascade;
+  params->classifier_threshold = threshold;
+  params->number_cache = detector->number_cache;
+  params->debug = detector->enable_debug;
+  std::atomic_store(&params_, std::shared_ptr<const DetectorParams>(params));
+  initParamSetters();
+
   // Set dynamic parameter callback
   on_set_parameters_callback_handle_ =
       this->add_on_set_parameters_callback(std::bind(
           &ArmorDetectorNode::onSetParameters, this, std::placeholders::_1));
 
+  preprocess_opencl_ =
+      detector->preprocess_backend == Detector::PreprocessBackend::OPENCL;
   return detector;
 }
 
-std::vector<Armor> ArmorDetectorNode::detectArmors(
-    const sensor_msgs::msg::Image::ConstSharedPtr &img_msg) {
-  // Convert ROS img to cv::Mat
-  auto img = cv_bridge::toCvShare(img_msg, "rgb8")->image;
+void ArmorDetectorNode::initParamSetters() {
+  auto extractor = [](const rclcpp::Parameter &p) {
+    return p.as_string() == "connected_components"
+               ? Detector::LightExtractor::CONNECTED_COMPONENTS
+               : Detector::LightExtractor::CONTOUR;
+  };
+  param_setters_ = {
+      {"binary_thres",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.binary_thres = p.as_int();
+       }},
+      {"adaptive_thres.enable",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.adaptive_thres.enable = p.as_bool();
+       }},
+      {"adaptive_thres.target_ratio",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.adaptive_thres.target_ratio = p.as_double();
+       }},
+      {"adaptive_thres.hysteresis",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.adaptive_thres.hysteresis = p.as_double();
+       }},
+      {"adaptive_thres.gain",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.adaptive_thres.gain = p.as_double();
+       }},
+      {"adaptive_thres.min",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.adaptive_thres.min_thres = p.as_int();
+       }},
+      {"adaptive_thres.max",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.adaptive_thres.max_thres = p.as_int();
+       }},
+      {"classifier_threshold",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.classifier_threshold = p.as_double();
+       }},
+      {"number_cache.enable",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.number_cache.enable = p.as_bool();
+       }},
+      {"number_cache.max_age",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.number_cache.max_age = p.as_int();
+       }},
+      {"number_cache.min_confidence",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.number_cache.min_confidence = p.as_double();
+       }},
+      {"number_cache.decay",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.number_cache.decay = p.as_double();
+       }},
+      {"number_cache.max_distance",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.number_cache.max_distance = p.as_double();
+       }},
+      {"light.min_ratio",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light.min_ratio = p.as_double();
+       }},
+      {"light.max_ratio",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light.max_ratio = p.as_double();
+       }},
+      {"light.max_angle",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light.max_angle = p.as_double();
+       }},
+      {"light.color_diff_thresh",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light.color_diff_thresh = p.as_int();
+       }},
+      {"light.extractor",
+       [extractor](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light_extractor = extractor(p);
+       }},
+      {"light_tracking.enable",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light_tracking.enable = p.as_bool();
+       }},
+      {"light_tracking.max_shift",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light_tracking.max_shift = p.as_double();
+       }},
+      {"light_tracking.max_length_change",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.light_tracking.max_length_change = p.as_double();
+       }},
+      {"coarse_search.enable",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.coarse_search.enable = p.as_bool();
+       }},
+      {"coarse_search.max_area_ratio",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.coarse_search.max_area_ratio = p.as_double();
+       }},
+      {"cascade.enable",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.enable = p.as_bool();
+       }},
+      {"cascade.min_failures",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.min_failures = p.as_int();
+       }},
+      {"cascade.max_center_fill",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.max_center_fill = p.as_double();
+       }},
+      {"cascade.min_width_ratio",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.min_width_ratio = p.as_double();
+       }},
+      {"cascade.max_tilt_diff",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.max_tilt_diff = p.as_double();
+       }},
+      {"cascade.min_color_ratio",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.min_color_ratio = p.as_double();
+       }},
+      {"cascade.min_distance",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.min_distance = p.as_double();
+       }},
+      {"cascade.max_distance",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.max_distance = p.as_double();
+       }},
+      {"cascade.audit_interval",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.cascade.audit_interval = p.as_int();
+       }},
+      {"armor.min_light_ratio",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.armor.min_light_ratio = p.as_double();
+       }},
+      {"armor.min_small_center_distance",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.armor.min_small_center_distance = p.as_double();
+       }},
+      {"armor.max_small_center_distance",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.armor.max_small_center_distance = p.as_double();
+       }},
+      {"armor.min_large_center_distance",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.armor.min_large_center_distance = p.as_double();
+       }},
+      {"armor.max_large_center_distance",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.armor.max_large_center_distance = p.as_double();
+       }},
+      {"armor.max_angle",
+       [](DetectorParams &d, const rclcpp::Parameter &p) {
+         d.armor.max_angle = p.as_double();
+       }},
+  };
+}
 
-  auto armors = detector_->detect(img);
+void ArmorDetectorNode::updateParams(
+    const std::function<void(DetectorParams &)> &modify) {
+  // Writers are serialized, readers never wait
+  std::lock_guard<std::mutex> lock(params_update_mutex_);
+  auto params = std::make_shared<DetectorParams>(*std::atomic_load(&params_));
+  modify(*params);
+  std::atomic_store(&params_, std::shared_ptr<const DetectorParams>(params));
+}
 
-  auto final_time = this->now();
-  auto latency = (final_time - img_msg->header.stamp).seconds() * 1000;
+void ArmorDetectorNode::applyParams(const DetectorParams &params) noexcept {
+  detector_->binary_thres = params.binary_thres;
+  detector_->adaptive_thres = params.adaptive_thres;
+  detector_->detect_color = params.detect_color;
+  detector_->light_params = params.light;
+  detector_->armor_params = params.armor;
+  detector_->light_extractor = params.light_extractor;
+  detector_->light_tracking = params.light_tracking;
+  detector_->coarse_search = params.coarse_search;
+  detector_->cascade = params.cascade;
+  // The size prior needs the focal length, it is skipped until the camera info is in
+  detector_->cascade.focal_length = cam_info_ != nullptr ? cam_info_->k[4] : 0.0;
+  detector_->enable_debug = params.debug;
+}
 
-  // Publish debug info
-  if (debug_) {
-    binary_img_pub_.publish(
-        cv_bridge::CvImage(img_msg->header, "mono8", detector_->binary_img)
-            .toImageMsg());
+rcl_interfaces::msg::SetParametersResult
+ArmorDetectorNode::onSetParameters(std::vector<rclcpp::Parameter> parameters) {
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+  // All parameters of one call go into a single snapshot
+  updateParams([&](DetectorParams &params) {
+    for (const auto &param : parameters) {
+      auto it = param_setters_.find(param.get_name());
+      if (it != param_setters_.end()) {
+        it->second(params, param);
+      }
+    }
+  });
+  return result;
+}
 
-    // Sort lights and armors data by x coordinate
-    std::sort(detector_->debug_lights.data.begin(),
-              detector_->debug_lights.data.end(),
-              [](const auto &l1, const auto &l2) {
-                return l1.center_x < l2.center_x;
-              });
-    std::sort(detector_->debug_armors.data.begin(),
-              detector_->debug_armors.data.end(),
-              [](const auto &a1, const auto &a2) {
-                return a1.center_x < a2.center_x;
-              });
+void ArmorDetectorNode::targetCallback(
+    const rm_interfaces::msg::Target::SharedPtr target_msg) {
+  std::lock_guard<std::mutex> lock(target_mutex_);
+  if (target_msg->tracking) {
+    tracked_target_ = target_msg;
+  } else {
+    tracked_target_ = nullptr;
+    if (!tracked_armors_.empty()) {
+      tracked_armors_.clear();
+    }
+  }
+}
+
+bool ArmorDetectorNode::lookupCameraPose(
+    const std_msgs::msg::Header &img_header) {
+  // Fast path, no lock and no waiting
+  Eigen::Quaterniond q_odom_gimbal;
+  if (use_attitude_cache_ && gimbal_to_camera_ready_ &&
+      utils::processAttitudeCacheOr(attitude_cache_)
+          .lookup(rclcpp::Time(img_header.stamp).nanoseconds(), q_odom_gimbal)) {
+    Eigen::Matrix3d R_odom_gimbal = q_odom_gimbal.toRotationMatrix();
+    imu_to_camera_ = R_odom_gimbal * R_gimbal_camera_;
+    t_odom_camera_ = R_odom_gimbal * t_gimbal_camera_;
+    return true;
+  }
 
-    lights_data_pub_->publish(detector_->debug_lights);
-    armors_data_pub_->publish(detector_->debug_armors);
+  try {
+    rclcpp::Time target_time = img_header.stamp;
+    auto odom_to_camera = tf2_buffer_->lookupTransform(
+        odom_frame_, img_header.frame_id, target_time,
+        rclcpp::Duration::from_seconds(0.01));
+    const auto &msg_q = odom_to_camera.transform.rotation;
+    imu_to_camera_ =
+        Eigen::Quaterniond(msg_q.w, msg_q.x, msg_q.y, msg_q.z).toRotationMatrix();
+    const auto &msg_t = odom_to_camera.transform.translation;
+    t_odom_camera_ = Eigen::Vector3d(msg_t.x, msg_t.y, msg_t.z);
 
-    if (!armors.empty()) {
-      auto all_num_img = detector_->getAllNumbersImage();
-      number_img_pub_.publish(
-          *cv_bridge::CvImage(img_msg->header, "mono8", all_num_img)
-               .toImageMsg());
+    // The gimbal to camera transform is static, look it up only once
+    if (use_attitude_cache_ && !gimbal_to_camera_ready_) {
+      auto gimbal_to_camera = tf2_buffer_->lookupTransform(
+          "gimbal_link", img_header.frame_id, tf2::TimePointZero);
+      const auto &q = gimbal_to_camera.transform.rotation;
+      const auto &t = gimbal_to_camera.transform.translation;
+      R_gimbal_camera_ =
+          Eigen::Quaterniond(q.w, q.x, q.y, q.z).toRotationMatrix();
+      t_gimbal_camera_ = Eigen::Vector3d(t.x, t.y, t.z);
+      gimbal_to_camera_ready_ = true;
     }
+  } catch (...) {
+    FYT_ERROR("armor_detector", "Something Wrong when lookUpTransform");
+    return false;
+  }
+  return true;
+}
 
-    detector_->drawResults(img);
+cv::Rect ArmorDetectorNode::getTargetRoi(const rclcpp::Time &img_stamp,
+                                         const Eigen::Matrix3d &R_odom_camera,
+                                         const Eigen::Vector3d &t_odom_camera,
+                                         const cv::Size &img_size) {
+  // Full-frame scan on lost target and periodically
+  if (cam_info_ == nullptr || roi_lost_ ||
+      ++frames_since_full_scan_ >= roi_params_.full_scan_interval) {
+    frames_since_full_scan_ = 0;
+    roi_lost_ = false;
+    return cv::Rect();
+  }
+  return projectTarget(img_stamp, R_odom_camera, t_odom_camera, img_size);
+}
+
+cv::Rect ArmorDetectorNode::projectTarget(const rclcpp::Time &img_stamp,
+                                          const Eigen::Matrix3d &R_odom_camera,
+                                          const Eigen::Vector3d &t_odom_camera,
+                                          const cv::Size &img_size) {
+  if (cam_info_ == nullptr) {
+    return cv::Rect();
+  }
+  rm_interfaces::msg::Target target;
+  {
+    std::lock_guard<std::mutex> lock(target_mutex_);
+    if (tracked_target_ == nullptr) {
+      return cv::Rect();
+    }
+    target = *tracked_target_;
+  }
+  double dt = (img_stamp - rclcpp::Time(target.header.stamp)).seconds();
+  if (std::abs(dt) > roi_params_.max_target_age ||
+      target.header.frame_id != odom_frame_) {
+    return cv::Rect();
+  }
 
-    // Draw camera center
-    cv::circle(img, cam_center_, 5, cv::Scalar(255, 0, 0), 2);
-    // Draw latency
-    std::stringstream latency_ss;
-    latency_ss << "Latency: " << std::fixed << std::setprecision(2) << latency
-               << "ms";
-    auto latency_s = latency_ss.str();
-    cv::putText(img, latency_s, cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX,
-                1.0, cv::Scalar(0, 255, 0), 2);
-    result_img_pub_.publish(
-        cv_bridge::CvImage(img_msg->header, "rgb8", img).toImageMsg());
+  // Predict the robot center to the time of image
+  Eigen::Vector3d p_odom(target.position.x + target.velocity.x * dt,
+                         target.position.y + target.velocity.y * dt,
+                         target.position.z + target.velocity.z * dt);
+  Eigen::Vector3d p_camera = R_odom_camera.transpose() * (p_odom - t_odom_camera);
+  if (p_camera.z() < 0.1) {
+    return cv::Rect();
   }
 
-  return armors;
+  // The window covers the whole robot, armors are radius away from its center
+  const auto &k = cam_info_->k;
+  double fx = k[0], fy = k[4], cx = k[2], cy = k[5];
+  double u = fx * p_camera.x() / p_camera.z() + cx;
+  double v = fy * p_camera.y() / p_camera.z() + cy;
+  double radius = std::max(target.radius_1, target.radius_2);
+  double half_w = fx * (radius + roi_params_.padding) / p_camera.z();
+  double half_h = fy * (std::abs(target.d_za) + std::abs(target.d_zc) +
+                        roi_params_.padding) / p_camera.z();
+
+  cv::Rect roi(cv::Point(u - half_w, v - half_h), cv::Point(u + half_w, v + half_h));
+  roi &= cv::Rect(cv::Point(0, 0), img_size);
+  return roi;
 }
 
-rcl_interfaces::msg::SetParametersResult
-ArmorDetectorNode::onSetParameters(std::vector<rclcpp::Parameter> parameters) {
-  rcl_interfaces::msg::SetParametersResult result;
-  result.successful = true;
-  for (const auto &param : parameters) {
-    if (param.get_name() == "binary_thres") {
-      detector_->binary_thres = param.as_int();
-    } else if (param.get_name() == "classifier_threshold") {
-      detector_->classifier->threshold = param.as_double();
-    } else if (param.get_name() == "light.min_ratio") {
-      detector_->light_params.min_ratio = param.as_double();
-    } else if (param.get_name() == "light.max_ratio") {
-      detector_->light_params.max_ratio = param.as_double();
-    } else if (param.get_name() == "light.max_angle") {
-      detector_->light_params.max_angle = param.as_double();
-    } else if (param.get_name() == "light.color_diff_thresh") {
-      detector_->light_params.color_diff_thresh = param.as_int();
-    } else if (param.get_name() == "armor.min_light_ratio") {
-      detector_->armor_params.min_light_ratio = param.as_double();
-    } else if (param.get_name() == "armor.min_small_center_distance") {
-      detector_->armor_params.min_small_center_distance = param.as_double();
-    } else if (param.get_name() == "armor.max_small_center_distance") {
-      detector_->armor_params.max_small_center_distance = param.as_double();
-    } else if (param.get_name() == "armor.min_large_center_distance") {
-      detector_->armor_params.min_large_center_distance = param.as_double();
-    } else if (param.get_name() == "armor.max_large_center_distance") {
-      detector_->armor_params.max_large_center_distance = param.as_double();
-    } else if (param.get_name() == "armor.max_angle") {
-      detector_->armor_params.max_angle = param.as_double();
+void ArmorDetectorNode::requestCameraAoi(const rclcpp::Time &img_stamp,
+                                         const cv::Size &full_size) {
+  // Back to the full frame once the target is lost in the AOI
+  const cv::Rect window =
+      aoi_lost_ ? cv::Rect()
+                : projectTarget(img_stamp, imu_to_camera_, t_odom_camera_,
+                                full_size);
+  const int64_t stamp_ns = img_stamp.nanoseconds();
+  cv::Rect aoi;
+  if (window.empty()) {
+    if (requested_aoi_.empty()) {
+      return;
+    }
+  } else {
+    const double scale = camera_control_params_.scale;
+    const cv::Point2f center =
+        (cv::Point2f(window.tl()) + cv::Point2f(window.br())) * 0.5f;
+    const cv::Size2f size(window.width * scale, window.height * scale);
+    aoi = cv::Rect(cv::Rect2f(center - cv::Point2f(size) * 0.5, size)) &
+          cv::Rect(cv::Point(), full_size);
+    // Keep the AOI while it covers the window and isn't much larger than
+    // needed, every change may cost the camera a frame
+    if (!requested_aoi_.empty() && (requested_aoi_ & window) == window &&
+        requested_aoi_.area() <= 2 * aoi.area()) {
+      return;
+    }
+    if ((stamp_ns - last_aoi_request_ns_) * 1e-9 <
+        camera_control_params_.min_interval) {
+      return;
     }
   }
-  return result;
+
+  rm_interfaces::msg::CameraControl control;
+  control.header.stamp = img_stamp;
+  control.x_offset = aoi.x;
+  control.y_offset = aoi.y;
+  control.width = aoi.width;
+  control.height = aoi.height;
+  camera_control_pub_->publish(control);
+  requested_aoi_ = aoi;
+  last_aoi_request_ns_ = stamp_ns;
 }
 
-// void ArmorDetectorNode::targetCallback(const
-// rm_interfaces::msg::Target::SharedPtr target_msg) {
-//   if (target_msg->tracking) {
-//     tracked_target_ = target_msg;
-//   } else {
-//     tracked_target_ = nullptr;
-//     if (!tracked_armors_.empty()) {
-//       tracked_armors_.clear();
-//     }
-//   }
-// }
+cv::Rect ArmorDetectorNode::getFrameAoi(const sensor_msgs::msg::Image &img) {
+  const cv::Rect full(0, 0, img.width, img.height);
+  if (!camera_control_params_.enable || cam_info_ == nullptr ||
+      (img.width == cam_info_->width && img.height == cam_info_->height)) {
+    return full;
+  }
+  // The camera info of the same frame, or the latest one of the same size if
+  // it hasn't arrived yet
+  const int64_t stamp_ns = rclcpp::Time(img.header.stamp).nanoseconds();
+  std::lock_guard<std::mutex> lock(frame_aoi_mutex_);
+  const FrameAoi *latest = nullptr;
+  for (size_t i = 1; i <= frame_aois_.size(); i++) {
+    const auto &entry =
+        frame_aois_[(frame_aoi_next_ + frame_aois_.size() - i) %
+                    frame_aois_.size()];
+    if (entry.aoi.size() != full.size()) {
+      continue;
+    }
+    if (entry.stamp_ns == stamp_ns) {
+      return entry.aoi;
+    }
+    if (latest == nullptr) {
+      latest = &entry;
+    }
+  }
+  return latest != nullptr ? latest->aoi : full;
+}
 
 void ArmorDetectorNode::createDebugPublishers() noexcept {
+  std::lock_guard<std::mutex> lock(debug_pub_mutex_);
   lights_data_pub_ = this->create_publisher<rm_interfaces::msg::DebugLights>(
       "armor_detector/debug_lights", 10);
   armors_data_pub_ = this->create_publisher<rm_interfaces::msg::DebugArmors>(
@@ -391,6 +1281,7 @@ void ArmorDetectorNode::createDebugPublishers() noexcept {
 }
 
 void ArmorDetectorNode::destroyDebugPublishers() noexcept {
+  std::lock_guard<std::mutex> lock(debug_pub_mutex_);
   lights_data_pub_.reset();
   armors_data_pub_.reset();
 
@@ -399,6 +1290,146 @@ void ArmorDetectorNode::destroyDebugPublishers() noexcept {
   result_img_pub_.shutdown();
 }
 
+bool ArmorDetectorNode::debugFrameDue() noexcept {
+  if (debug_max_fps_ <= 0) {
+    return true;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_debug_time_ <
+      std::chrono::duration<double>(1.0 / debug_max_fps_)) {
+    return false;
+  }
+  last_debug_time_ = now;
+  return true;
+}
+
+void ArmorDetectorNode::pushDebugFrame(DebugFrame &&frame) {
+  {
+    std::lock_guard<std::mutex> lock(debug_queue_mutex_);
+    while (debug_queue_.size() >= debug_queue_size_) {
+      debug_queue_.pop_front();
+      dropped_debug_frames_->fetch_add(1, std::memory_order_relaxed);
+    }
+    debug_queue_.emplace_back(std::move(frame));
+  }
+  debug_queue_cv_.notify_one();
+}
+
+void ArmorDetectorNode::debugLoop() {
+  utils::configureThread("detector_debug");
+  while (true) {
+    DebugFrame frame;
+    {
+      std::unique_lock<std::mutex> lock(debug_queue_mutex_);
+      debug_queue_cv_.wait(
+          lock, [this] { return !debug_running_ || !debug_queue_.empty(); });
+      if (!debug_running_) {
+        return;
+      }
+      frame = std::move(debug_queue_.front());
+      debug_queue_.pop_front();
+    }
+    publishDebugFrame(frame);
+  }
+}
+
+void ArmorDetectorNode::publishDebugFrame(DebugFrame &frame) {
+  std::lock_guard<std::mutex> lock(debug_pub_mutex_);
+  // Debug has been turned off since the frame was queued
+  if (lights_data_pub_ == nullptr) {
+    return;
+  }
+  const auto &header = frame.img_msg->header;
+
+  // Region of the targets for debug_image.roi_only
+  cv::Rect targets = frame.roi;
+  for (const auto &armor : frame.armors) {
+    std::vector<cv::Point2f> corners = {armor.left_light.top,
+                                        armor.left_light.bottom,
+                                        armor.right_light.top,
+                                        armor.right_light.bottom};
+    const cv::Rect box = cv::boundingRect(corners);
+    targets = targets.empty() ? box : (targets | box);
+  }
+
+  // The keypoint detector makes no binary image. The images are only rendered and
+  // encoded for the subscribers
+  if (!frame.binary_img.empty() && binary_img_pub_.getNumSubscribers() > 0) {
+    // The binary image is of the search window, or of the AOI of the sensor
+    const cv::Point origin =
+        frame.roi.empty() ? frame.sensor_offset : frame.roi.tl();
+    binary_img_pub_.publish(
+        cv_bridge::CvImage(header, "mono8",
+                           utils::shrinkDebugImage(frame.binary_img,
+                                                   debug_image_params_,
+                                                   targets - origin))
+            .toImageMsg());
+  }
+
+  // Sort lights and armors data by x coordinate
+  std::sort(frame.debug_lights.data.begin(), frame.debug_lights.data.end(),
+            [](const auto &l1, const auto &l2) {
+              return l1.center_x < l2.center_x;
+            });
+  std::sort(frame.debug_armors.data.begin(), frame.debug_armors.data.end(),
+            [](const auto &a1, const auto &a2) {
+              return a1.center_x < a2.center_x;
+            });
+
+  lights_data_pub_->publish(frame.debug_lights);
+  armors_data_pub_->publish(frame.debug_armors);
+
+  // Number images are only extracted by the classifier
+  if (!frame.armors.empty() && detector_->classifier != nullptr &&
+      number_img_pub_.getNumSubscribers() > 0) {
+    auto all_num_img = Detector::getAllNumbersImage(frame.armors);
+    number_img_pub_.publish(
+        *cv_bridge::CvImage(header, "mono8", all_num_img).toImageMsg());
+  }
+
+  if (result_img_pub_.getNumSubscribers() == 0) {
+    return;
+  }
+  // The image is shared with the other subscribers, draw on a copy
+  cv::Mat img;
+  const auto bayer_pattern = utils::bayerPattern(frame.img_msg->encoding);
+  if (bayer_pattern != utils::BayerPattern::NONE) {
+    utils::bayerToRgb(cv_bridge::toCvShare(frame.img_msg)->image, bayer_pattern,
+                      img);
+  } else {
+    img = cv_bridge::toCvShare(frame.img_msg, "rgb8")->image.clone();
+  }
+  // An image of a smaller AOI is drawn at its place in the full frame
+  if (frame.sensor_offset != cv::Point() && cam_info_ != nullptr) {
+    const cv::Rect aoi(frame.sensor_offset, img.size());
+    cv::Mat full_img(cam_info_->height, cam_info_->width, CV_8UC3,
+                     cv::Scalar::all(0));
+    if ((aoi & cv::Rect(0, 0, full_img.cols, full_img.rows)) == aoi) {
+      img.copyTo(full_img(aoi));
+      img = full_img;
+    }
+  }
+  Detector::drawResults(img, frame.armors);
+
+  // Draw camera center
+  cv::circle(img, cam_center_, 5, cv::Scalar(255, 0, 0), 2);
+  // Draw search window
+  if (!frame.roi.empty()) {
+    cv::rectangle(img, frame.roi, cv::Scalar(255, 255, 0), 1);
+  }
+  // The text is drawn after the shrinking, so that it stays readable
+  img = utils::shrinkDebugImage(img, debug_image_params_, targets);
+  // Draw latency
+  std::stringstream latency_ss;
+  latency_ss << "Latency: " << std::fixed << std::setprecision(2)
+             << frame.latency << "ms";
+  auto latency_s = latency_ss.str();
+  cv::putText(img, latency_s, cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1.0,
+              cv::Scalar(0, 255, 0), 2);
+  result_img_pub_.publish(
+      cv_bridge::CvImage(header, "rgb8", img).toImageMsg());
+}
+
 void ArmorDetectorNode::publishMarkers() noexcept {
   using Marker = visualization_msgs::msg::Marker;
   armor_marker_.action =
@@ -425,19 +1456,23 @@ void ArmorDetectorNode::setModeCallback(
       img_sub_ = this->create_subscription<sensor_msgs::msg::Image>(
           "image_raw", rclcpp::SensorDataQoS(),
           std::bind(&ArmorDetectorNode::imageCallback, this,
-                    std::placeholders::_1));
+                    std::placeholders::_1),
+          image_sub_options_);
     }
   };
 
+  bool active = false;
   switch (mode) {
   case VisionMode::AUTO_AIM_RED: {
-    detector_->detect_color = EnemyColor::RED;
+    updateParams([](DetectorParams &p) { p.detect_color = EnemyColor::RED; });
     createImageSub();
+    active = true;
     break;
   }
   case VisionMode::AUTO_AIM_BLUE: {
-    detector_->detect_color = EnemyColor::BLUE;
+    updateParams([](DetectorParams &p) { p.detect_color = EnemyColor::BLUE; });
     createImageSub();
+    active = true;
     break;
   }
   default: {
@@ -445,6 +1480,12 @@ void ArmorDetectorNode::setModeCallback(
   }
   }
 
+  // The frames of the active mode get the workers first
+  if (scheduler_queue_ >= 0) {
+    utils::PerceptionScheduler::instance().setPriority(scheduler_queue_,
+                                                       active ? 1 : 0);
+  }
+
   FYT_WARN("armor_detector", "Set mode to {}", mode_name);
 }
 
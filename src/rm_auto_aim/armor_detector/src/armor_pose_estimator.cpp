@@ -13,85 +13,198 @@
 // limitations under the License.
 
 #include "armor_detector/armor_pose_estimator.hpp"
+// std
+#include <algorithm>
+#include <cmath>
 
 #include "armor_detector/types.hpp"
 #include "rm_utils/logger/log.hpp"
 #include "rm_utils/math/utils.hpp"
+#include "rm_utils/trace.hpp"
+#include "rm_utils/worker_pool.hpp"
 
 namespace fyt::auto_aim {
 ArmorPoseEstimator::ArmorPoseEstimator(
-    sensor_msgs::msg::CameraInfo::SharedPtr camera_info) {
+    sensor_msgs::msg::CameraInfo::SharedPtr camera_info)
+    : camera_info_(camera_info) {
+  // The landmarks are undistorted once, PnP and BA then use the pinhole model
+  undistorter_ = std::make_unique<Undistorter>(
+      camera_info->k, camera_info->d, camera_info->width, camera_info->height);
   // Setup pnp solver
-  pnp_solver_ = std::make_unique<PnPSolver>(camera_info->k, camera_info->d);
-  pnp_solver_->setObjectPoints(
-      "small", Armor::buildObjectPoints<cv::Point3f>(SMALL_ARMOR_WIDTH,
-                                                     SMALL_ARMOR_HEIGHT));
-  pnp_solver_->setObjectPoints(
-      "large", Armor::buildObjectPoints<cv::Point3f>(LARGE_ARMOR_WIDTH,
-                                                     LARGE_ARMOR_HEIGHT));
+  pnp_solver_ = std::make_unique<PlanarPnPSolver<Armor::N_LANDMARKS>>(
+      camera_info->k, std::vector<double>());
+  small_armor_model_ = pnp_solver_->addObjectPoints(
+      Armor::objectPoints<cv::Point3f>(ArmorType::SMALL));
+  large_armor_model_ = pnp_solver_->addObjectPoints(
+      Armor::objectPoints<cv::Point3f>(ArmorType::LARGE));
+  image_center_ = cv::Point2f(camera_info->k[2], camera_info->k[5]);
   // BA solver
-  ba_solver_ = std::make_unique<BaSolver>(camera_info->k, camera_info->d);
+  workspaces_.emplace_back(createWorkspace());
 
   R_gimbal_camera_ = Eigen::Matrix3d::Identity();
   R_gimbal_camera_ << 0, 0, 1, -1, 0, 0, 0, -1, 0;
 }
 
+ArmorPoseEstimator::Workspace ArmorPoseEstimator::createWorkspace() const {
+  Workspace workspace;
+  workspace.ba_solver =
+      std::make_unique<BaSolver>(camera_info_->k, camera_info_->d);
+  return workspace;
+}
+
 std::vector<rm_interfaces::msg::Armor>
 ArmorPoseEstimator::extractArmorPoses(const std::vector<Armor> &armors,
-                                   Eigen::Matrix3d R_imu_camera) {
+                                   Eigen::Matrix3d R_imu_camera,
+                                   const std::optional<TargetYaw> &target_yaw) {
   std::vector<rm_interfaces::msg::Armor> armors_msg;
+  extractArmorPoses(armors, R_imu_camera, target_yaw, armors_msg);
+  return armors_msg;
+}
 
-  for (const auto &armor : armors) {
-    std::vector<cv::Mat> rvecs, tvecs;
+void ArmorPoseEstimator::extractArmorPoses(
+    const std::vector<Armor> &armors, const Eigen::Matrix3d &R_imu_camera,
+    const std::optional<TargetYaw> &target_yaw,
+    std::vector<rm_interfaces::msg::Armor> &armors_msg) {
+  // Each armor owns a workspace, so that they can be solved in parallel
+  while (workspaces_.size() < armors.size()) {
+    workspaces_.emplace_back(createWorkspace());
+  }
+  // Existing messages are overwritten to reuse their memory
+  armors_msg.resize(armors.size());
+  success_.assign(armors.size(), 0);
+  ba_skipped_.assign(armors.size(), 0);
 
-    // Use PnP to get the initial pose information
-    if (pnp_solver_->solvePnPGeneric(
-            armor.landmarks(), rvecs, tvecs,
-            (armor.type == ArmorType::SMALL ? "small" : "large"))) {
-      sortPnPResult(armor, rvecs, tvecs);
-      cv::Mat rmat;
-      cv::Rodrigues(rvecs[0], rmat);
+  // The armors may be solved by the worker threads, which trace them for the frame of the caller
+  const uint64_t frame_id = utils::Trace::frame();
+  auto solve = [&](std::size_t i) {
+    utils::Trace::setFrame(frame_id);
+    success_[i] = solveArmorPose(armors[i], R_imu_camera, target_yaw,
+                                 workspaces_[i], armors_msg[i], ba_skipped_[i]);
+  };
+  utils::WorkerPool::instance().parallelFor(armors.size(), solve);
 
-      Eigen::Matrix3d R = utils::cvToEigen(rmat);
-      Eigen::Vector3d t = utils::cvToEigen(tvecs[0]);
+  // Remove the failed ones and keep the order
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < armors_msg.size(); i++) {
+    if (success_[i]) {
+      if (n != i) {
+        std::swap(armors_msg[n], armors_msg[i]);
+      }
+      n++;
+    } else {
+      FYT_WARN("armor_detector", "PnP Failed!");
+    }
+  }
+  armors_msg.resize(n);
+}
 
-      double armor_roll =
-          rotationMatrixToRPY(R_gimbal_camera_ * R)[0] * 180 / M_PI;
+int ArmorPoseEstimator::baSkipped() const {
+  return static_cast<int>(std::count(ba_skipped_.begin(), ba_skipped_.end(), 1));
+}
 
-      if (use_ba_ && armor_roll < 15) {
-        // Use BA alogorithm to optimize the pose from PnP
-        // solveBa() will modify the rotation_matrix
-        R = ba_solver_->solveBa(armor, t, R, R_imu_camera);
-      }
-      Eigen::Quaterniond q(R);
+bool ArmorPoseEstimator::worthBA(const Budget &budget, const Armor &armor,
+                                 double distance,
+                                 const std::optional<TargetYaw> &target_yaw) {
+  if (!budget.enable) {
+    return true;
+  }
+  if (budget.ba_target_only && target_yaw.has_value() &&
+      target_yaw->id != armor.number) {
+    return false;
+  }
+  const double light_length =
+      (armor.left_light.length + armor.right_light.length) / 2;
+  return light_length >= budget.ba_min_light_length &&
+         distance <= budget.ba_max_distance;
+}
 
-      // Fill the armor message
-      rm_interfaces::msg::Armor armor_msg;
+bool ArmorPoseEstimator::selectByTargetYaw(const Armor &armor,
+                                           const Eigen::Matrix3d &R_imu_camera,
+                                           const TargetYaw &target_yaw,
+                                           Solutions &solutions) {
+  if (target_yaw.id != armor.number || target_yaw.armors_num <= 0 ||
+      solutions[1].reprojection_error / solutions[0].reprojection_error >
+          PROJECT_ERR_THRES) {
+    return false;
+  }
+  // Distance of the yaw of each solution to the nearest armor of the target
+  const double step = 2 * M_PI / target_yaw.armors_num;
+  auto yaw_error = [&](const Eigen::Matrix3d &R) {
+    return std::abs(std::remainder(armorYaw(R_imu_camera * R) - target_yaw.yaw, step));
+  };
+  if (yaw_error(solutions[1].R) < yaw_error(solutions[0].R)) {
+    std::swap(solutions[0], solutions[1]);
+  }
+  return true;
+}
 
-      // Fill basic info
-      armor_msg.type = armorTypeToString(armor.type);
-      armor_msg.number = armor.number;
+bool ArmorPoseEstimator::solveArmorPose(
+    const Armor &armor, const Eigen::Matrix3d &R_imu_camera,
+    const std::optional<TargetYaw> &target_yaw, Workspace &workspace,
+    rm_interfaces::msg::Armor &armor_msg, char &ba_skipped) const {
+  // Use PnP to get the initial pose information, the planar solver is
+  // stateless and shared by all armors
+  auto &solutions = workspace.solutions;
+  auto &image_points = workspace.image_points;
+  {
+    utils::TraceScope trace(utils::TraceStage::PNP);
+    undistorter_->undistort(armor.landmarks(), image_points);
+    if (pnp_solver_->solve(image_points,
+                           armor.type == ArmorType::SMALL ? small_armor_model_
+                                                          : large_armor_model_,
+                           solutions) < 2) {
+      return false;
+    }
+    if (!budget_.enable || !budget_.target_disambiguation ||
+        !target_yaw.has_value() ||
+        !selectByTargetYaw(armor, R_imu_camera, *target_yaw, solutions)) {
+      sortPnPResult(armor, solutions);
+    }
+  }
 
-      // Fill pose
-      armor_msg.pose.position.x = t(0);
-      armor_msg.pose.position.y = t(1);
-      armor_msg.pose.position.z = t(2);
-      armor_msg.pose.orientation.x = q.x();
-      armor_msg.pose.orientation.y = q.y();
-      armor_msg.pose.orientation.z = q.z();
-      armor_msg.pose.orientation.w = q.w();
+  Eigen::Matrix3d R = solutions[0].R;
+  Eigen::Vector3d t = solutions[0].t;
 
-      // Fill the distance to image center
-      armor_msg.distance_to_image_center =
-          pnp_solver_->calculateDistanceToCenter(armor.center);
+  double armor_roll = rotationMatrixToRPY(R_gimbal_camera_ * R)[0] * 180 / M_PI;
 
-      armors_msg.push_back(std::move(armor_msg));
-    } else {
-      FYT_WARN("armor_detector", "PnP Failed!");
+  if (use_ba_ && armor_roll < 15 && !worthBA(budget_, armor, t.norm(), target_yaw)) {
+    ba_skipped = 1;
+  } else if (use_ba_ && armor_roll < 15) {
+    std::optional<double> yaw_hint;
+    if (target_yaw.has_value() && target_yaw->id == armor.number &&
+        target_yaw->armors_num > 0) {
+      // Pick the armor of the target closest to the PnP result
+      Eigen::Matrix3d R_imu_armor = R_imu_camera * R;
+      double pnp_yaw = armorYaw(R_imu_armor);
+      double step = 2 * M_PI / target_yaw->armors_num;
+      double k = std::round(std::remainder(pnp_yaw - target_yaw->yaw, 2 * M_PI) / step);
+      yaw_hint = target_yaw->yaw + k * step;
     }
+    // Use BA alogorithm to optimize the pose from PnP
+    // solveBa() will modify the rotation_matrix
+    utils::TraceScope trace(utils::TraceStage::BA);
+    R = workspace.ba_solver->solveBa(armor, image_points, t, R, R_imu_camera,
+                                     yaw_hint);
   }
+  Eigen::Quaterniond q(R);
 
-  return armors_msg;
+  // Fill basic info
+  armor_msg.type = static_cast<uint8_t>(armor.type);
+  armor_msg.number = static_cast<uint8_t>(armor.number);
+
+  // Fill pose
+  armor_msg.pose.position.x = t(0);
+  armor_msg.pose.position.y = t(1);
+  armor_msg.pose.position.z = t(2);
+  armor_msg.pose.orientation.x = q.x();
+  armor_msg.pose.orientation.y = q.y();
+  armor_msg.pose.orientation.z = q.z();
+  armor_msg.pose.orientation.w = q.w();
+
+  // Fill the distance to image center
+  armor_msg.distance_to_image_center =
+      cv::norm(armor.center - image_center_);
+  return true;
 }
 
 Eigen::Vector3d ArmorPoseEstimator::rotationMatrixToRPY(const Eigen::Matrix3d &R) {
@@ -105,35 +218,17 @@ Eigen::Vector3d ArmorPoseEstimator::rotationMatrixToRPY(const Eigen::Matrix3d &R
 }
 
 void ArmorPoseEstimator::sortPnPResult(const Armor &armor,
-                                    std::vector<cv::Mat> &rvecs,
-                                    std::vector<cv::Mat> &tvecs) const {
-  constexpr float PROJECT_ERR_THRES = 3.0;
-
-  // 获取这两个解
-  cv::Mat &rvec1 = rvecs.at(0);
-  cv::Mat &tvec1 = tvecs.at(0);
-  cv::Mat &rvec2 = rvecs.at(1);
-  cv::Mat &tvec2 = tvecs.at(1);
-
-  // 将旋转向量转换为旋转矩阵
-  cv::Mat R1_cv, R2_cv;
-  cv::Rodrigues(rvec1, R1_cv);
-  cv::Rodrigues(rvec2, R2_cv);
-
-  // 转换为Eigen矩阵
-  Eigen::Matrix3d R1 = utils::cvToEigen(R1_cv);
-  Eigen::Matrix3d R2 = utils::cvToEigen(R2_cv);
+                                       Solutions &solutions) const {
+  // 获取这两个解, 求解器已按重投影误差排序
+  const Eigen::Matrix3d &R1 = solutions[0].R;
+  const Eigen::Matrix3d &R2 = solutions[1].R;
 
   // 计算云台系下装甲板的RPY角
   auto rpy1 = rotationMatrixToRPY(R_gimbal_camera_ * R1);
   auto rpy2 = rotationMatrixToRPY(R_gimbal_camera_ * R2);
 
-  std::string coord_frame_name =
-      (armor.type == ArmorType::SMALL ? "small" : "large");
-  double error1 = pnp_solver_->calculateReprojectionError(
-      armor.landmarks(), rvec1, tvec1, coord_frame_name);
-  double error2 = pnp_solver_->calculateReprojectionError(
-      armor.landmarks(), rvec2, tvec2, coord_frame_name);
+  double error1 = solutions[0].reprojection_error;
+  double error2 = solutions[1].reprojection_error;
 
   // 两个解的重投影误差差距较大或者roll角度较大时，不做选择
   if ((error2 / error1 > PROJECT_ERR_THRES) || (rpy1[0] > 10 * 180 / M_PI) ||
@@ -150,15 +245,14 @@ void ArmorPoseEstimator::sortPnPResult(const Armor &armor,
   double angle = (l_angle + r_angle) / 2;
   angle += 90.0;
 
-  if (armor.number == "outpost") angle = -angle;
+  if (armor.number == ArmorNumber::OUTPOST) angle = -angle;
 
   // 根据倾斜角度选择解
   // 如果装甲板左倾（angle > 0），选择Yaw为负的解
   // 如果装甲板右倾（angle < 0），选择Yaw为正的解
   if ((angle > 0 && rpy1[2] > 0 && rpy2[2] < 0) ||
       (angle < 0 && rpy1[2] < 0 && rpy2[2] > 0)) {
-    std::swap(rvec1, rvec2);
-    std::swap(tvec1, tvec2);
+    std::swap(solutions[0], solutions[1]);
     FYT_DEBUG("armor_detector", "PnP Solution 2 Selected");
   }
 }
@@ -16,6 +16,8 @@
 
 #include "armor_detector/ba_solver.hpp"
 // std
+#include <algorithm>
+#include <cmath>
 #include <memory>
 // g2o
 #include <g2o/core/robust_kernel.h>
@@ -56,13 +58,12 @@ BaSolver::BaSolver(std::array<double, 9> &camera_matrix,
   lm_algorithm_->setUserLambdaInit(0.1);
 }
 
-Eigen::Matrix3d
-BaSolver::solveBa(const Armor &armor, const Eigen::Vector3d &t_camera_armor,
-                  const Eigen::Matrix3d &R_camera_armor,
-                  const Eigen::Matrix3d &R_imu_camera) noexcept {
-  // Reset optimizer
-  optimizer_.clear();
-
+Eigen::Matrix3d BaSolver::solveBa(
+    const Armor &armor,
+    const std::array<cv::Point2f, Armor::N_LANDMARKS> &image_points,
+    const Eigen::Vector3d &t_camera_armor,
+    const Eigen::Matrix3d &R_camera_armor, const Eigen::Matrix3d &R_imu_camera,
+    const std::optional<double> &yaw_hint) noexcept {
   // Essential coordinate system transformation
   Eigen::Matrix3d R_imu_armor = R_imu_camera * R_camera_armor;
   Sophus::SO3d R_camera_imu = Sophus::SO3d(R_imu_camera.transpose());
@@ -79,40 +80,160 @@ BaSolver::solveBa(const Armor &armor, const Eigen::Vector3d &t_camera_armor,
 
   // Get the pitch angle of the armor
   double armor_pitch =
-      armor.number == "outpost" ? -FIFTTEN_DEGREE_RAD : FIFTTEN_DEGREE_RAD;
+      armor.number == ArmorNumber::OUTPOST ? -FIFTTEN_DEGREE_RAD : FIFTTEN_DEGREE_RAD;
   Sophus::SO3d R_pitch = Sophus::SO3d::exp(Eigen::Vector3d(0, armor_pitch, 0));
 
   // Get the 3D points of the armor
-  const auto armor_size =
-      armor.type == ArmorType::SMALL
-          ? Eigen::Vector2d(SMALL_ARMOR_WIDTH, SMALL_ARMOR_HEIGHT)
-          : Eigen::Vector2d(LARGE_ARMOR_WIDTH, LARGE_ARMOR_HEIGHT);
-  const auto object_points =
-      Armor::buildObjectPoints<Eigen::Vector3d>(armor_size(0), armor_size(1));
+  const auto &object_points = Armor::objectPoints<Eigen::Vector3d>(armor.type);
+
+  // Fill the problem
+  YawProblem problem;
+  problem.R_camera_imu = R_camera_imu.matrix();
+  problem.t = t_camera_armor;
+  for (size_t i = 0; i < Armor::N_LANDMARKS; i++) {
+    problem.points[i] = R_pitch * object_points[i];
+    problem.observations[i] = Eigen::Vector2d(image_points[i].x, image_points[i].y);
+  }
+
+  // Warm start from the hint if it explains the observation better
+  if (yaw_hint.has_value() &&
+      evaluate(problem, *yaw_hint, nullptr, nullptr) <
+          evaluate(problem, initial_armor_yaw, nullptr, nullptr)) {
+    initial_armor_yaw = *yaw_hint;
+  }
+
+  // Start optimizing
+  double yaw_optimized = initial_armor_yaw;
+  if (!optimizeYaw(problem, yaw_optimized)) {
+    yaw_optimized =
+        optimizeYawG2o(problem, armor, R_pitch, initial_armor_yaw);
+  }
+
+  if (std::isnan(yaw_optimized)) {
+    FYT_ERROR("armor_detector", "Yaw angle is nan after optimization");
+    return R_camera_armor;
+  }
+
+  Sophus::SO3d R_yaw = Sophus::SO3d::exp(Eigen::Vector3d(0, 0, yaw_optimized));
+  return (R_camera_imu * R_yaw * R_pitch).matrix();
+}
+
+double BaSolver::evaluate(const YawProblem &problem, double yaw,
+                          double *gradient, double *hessian) const noexcept {
+  const double fx = K_(0, 0), fy = K_(1, 1), cx = K_(0, 2), cy = K_(1, 2);
+  const double c = std::cos(yaw), s = std::sin(yaw);
+
+  double cost = 0, g = 0, h = 0;
+  for (size_t i = 0; i < Armor::N_LANDMARKS; i++) {
+    const Eigen::Vector3d &q = problem.points[i];
+    // R_yaw * q and its derivative with respect to yaw
+    const Eigen::Vector3d p_imu(c * q.x() - s * q.y(), s * q.x() + c * q.y(),
+                                q.z());
+    const Eigen::Vector3d dp_imu(-p_imu.y(), p_imu.x(), 0);
+    const Eigen::Vector3d p = problem.R_camera_imu * p_imu + problem.t;
+    const Eigen::Vector3d dp = problem.R_camera_imu * dp_imu;
+
+    const double inv_z = 1.0 / p.z();
+    const Eigen::Vector2d error(
+        problem.observations[i].x() - (fx * p.x() * inv_z + cx),
+        problem.observations[i].y() - (fy * p.y() * inv_z + cy));
+    // Jacobian of the error
+    const Eigen::Vector2d jacobian(
+        -fx * (dp.x() * inv_z - p.x() * dp.z() * inv_z * inv_z),
+        -fy * (dp.y() * inv_z - p.y() * dp.z() * inv_z * inv_z));
+
+    // Huber kernel, same as g2o::RobustKernelHuber
+    const double e2 = error.squaredNorm();
+    const double e = std::sqrt(e2);
+    double weight = 1.0;
+    if (e <= HUBER_DELTA) {
+      cost += e2;
+    } else {
+      cost += 2 * HUBER_DELTA * e - HUBER_DELTA * HUBER_DELTA;
+      weight = HUBER_DELTA / e;
+    }
+    g += weight * jacobian.dot(error);
+    h += weight * jacobian.squaredNorm();
+  }
+
+  if (gradient != nullptr) {
+    *gradient = g;
+  }
+  if (hessian != nullptr) {
+    *hessian = h;
+  }
+  return cost;
+}
+
+bool BaSolver::optimizeYaw(const YawProblem &problem,
+                           double &yaw) const noexcept {
+  double gradient, hessian;
+  double cost = evaluate(problem, yaw, &gradient, &hessian);
+  if (!std::isfinite(cost)) {
+    return false;
+  }
+
+  // Same initial damping as the g2o solver
+  double lambda = 0.1;
+  for (int iter = 0; iter < MAX_ITERATIONS; iter++) {
+    const double delta = -gradient / (hessian + lambda);
+    if (!std::isfinite(delta)) {
+      return false;
+    }
+    if (std::abs(delta) < 1e-8) {
+      break;
+    }
+
+    const double new_yaw = yaw + delta;
+    double new_gradient, new_hessian;
+    const double new_cost =
+        evaluate(problem, new_yaw, &new_gradient, &new_hessian);
+    if (std::isfinite(new_cost) && new_cost < cost) {
+      yaw = new_yaw;
+      cost = new_cost;
+      gradient = new_gradient;
+      hessian = new_hessian;
+      lambda = std::max(lambda * 0.1, 1e-9);
+    } else {
+      lambda *= 10;
+    }
+  }
+
+  // Keep the yaw in [-pi, pi] like Sophus::SO3d::log()
+  yaw = std::remainder(yaw, 2 * M_PI);
+  return std::isfinite(yaw);
+}
+
+double BaSolver::optimizeYawG2o(const YawProblem &problem, const Armor &armor,
+                                const Sophus::SO3d &R_pitch,
+                                double initial_yaw) noexcept {
+  // Reset optimizer
+  optimizer_.clear();
+
+  const Sophus::SO3d R_camera_imu(problem.R_camera_imu);
+  const auto &object_points = Armor::objectPoints<Eigen::Vector3d>(armor.type);
 
   // Fill the optimizer
   size_t id_counter = 0;
 
   VertexYaw *v_yaw = new VertexYaw();
   v_yaw->setId(id_counter++);
-  v_yaw->setEstimate(initial_armor_yaw);
+  v_yaw->setEstimate(initial_yaw);
   optimizer_.addVertex(v_yaw);
 
-  const auto &landmarks = armor.landmarks();
   for (size_t i = 0; i < Armor::N_LANDMARKS; i++) {
     g2o::VertexPointXYZ *v_point = new g2o::VertexPointXYZ();
     v_point->setId(id_counter++);
-    v_point->setEstimate(Eigen::Vector3d(
-        object_points[i].x(), object_points[i].y(), object_points[i].z()));
+    v_point->setEstimate(object_points[i]);
     v_point->setFixed(true);
     optimizer_.addVertex(v_point);
 
     EdgeProjection *edge =
-        new EdgeProjection(R_camera_imu, R_pitch, t_camera_armor, K_);
+        new EdgeProjection(R_camera_imu, R_pitch, problem.t, K_);
     edge->setId(id_counter++);
     edge->setVertex(0, v_yaw);
     edge->setVertex(1, v_point);
-    edge->setMeasurement(Eigen::Vector2d(landmarks[i].x, landmarks[i].y));
+    edge->setMeasurement(problem.observations[i]);
     edge->setInformation(EdgeProjection::InfoMatrixType::Identity());
     edge->setRobustKernel(new g2o::RobustKernelHuber);
     optimizer_.addEdge(edge);
@@ -120,18 +241,10 @@ BaSolver::solveBa(const Armor &armor, const Eigen::Vector3d &t_camera_armor,
 
   // Start optimizing
   optimizer_.initializeOptimization();
-  optimizer_.optimize(20);
+  optimizer_.optimize(MAX_ITERATIONS);
 
   // Get yaw angle after optimization
-  double yaw_optimized = v_yaw->estimate();
-
-  if (std::isnan(yaw_optimized)) {
-    FYT_ERROR("armor_detector", "Yaw angle is nan after optimization");
-    return R_camera_armor;
-  }
-
-  Sophus::SO3d R_yaw = Sophus::SO3d::exp(Eigen::Vector3d(0, 0, yaw_optimized));
-  return (R_camera_imu * R_yaw * R_pitch).matrix();
+  return v_yaw->estimate();
 }
 
-} // namespace fyt::auto_aim
\ No newline at end of file
+} // namespace fyt::auto_aim
@@ -0,0 +1,85 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_detector/cascade_filter.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace fyt::auto_aim {
+
+namespace {
+// Grid of the samples of the number region, in fractions of the way from the left light to
+// the right one and from the bottom of the lights to their top. The margins keep the lights
+// and the glow around them out
+constexpr int FILL_COLS = 8, FILL_ROWS = 6;
+constexpr float FILL_U0 = 0.25f, FILL_U1 = 0.75f;
+constexpr float FILL_V0 = 0.15f, FILL_V1 = 0.85f;
+
+float ratio(float a, float b) noexcept {
+  a = std::abs(a), b = std::abs(b);
+  const float longer = std::max(a, b);
+  return longer > 0 ? std::min(a, b) / longer : 1.0f;
+}
+}  // namespace
+
+CascadeFilter::Features CascadeFilter::features(const Armor &armor,
+                                                const cv::Mat &binary_img,
+                                                double focal_length) noexcept {
+  const Light &l = armor.left_light, &r = armor.right_light;
+  Features f;
+
+  int filled = 0, samples = 0;
+  for (int row = 0; row < FILL_ROWS; row++) {
+    const float v = FILL_V0 + (FILL_V1 - FILL_V0) * row / (FILL_ROWS - 1);
+    const cv::Point2f left = l.bottom + v * (l.top - l.bottom);
+    const cv::Point2f right = r.bottom + v * (r.top - r.bottom);
+    for (int col = 0; col < FILL_COLS; col++) {
+      const float u = FILL_U0 + (FILL_U1 - FILL_U0) * col / (FILL_COLS - 1);
+      const cv::Point2f p = left + u * (right - left);
+      const int x = cvRound(p.x), y = cvRound(p.y);
+      if (x < 0 || y < 0 || x >= binary_img.cols || y >= binary_img.rows) {
+        continue;
+      }
+      filled += binary_img.ptr<uchar>(y)[x] != 0;
+      samples++;
+    }
+  }
+  f.center_fill = samples > 0 ? static_cast<float>(filled) / samples : 0.0f;
+
+  f.width_ratio = ratio(l.width, r.width);
+  f.tilt_diff = std::abs(l.tilt_angle - r.tilt_angle);
+  f.color_ratio = ratio(l.color_diff, r.color_diff);
+
+  // The lights are about as long as the armor is high
+  const float length = (l.length + r.length) / 2;
+  f.distance = focal_length > 0 && length > 0
+                 ? static_cast<float>(focal_length * SMALL_ARMOR_HEIGHT / length)
+                 : 0.0f;
+  return f;
+}
+
+int CascadeFilter::failures(const Features &f, const Params &params) noexcept {
+  int failed = 0;
+  failed += f.center_fill > params.max_center_fill;
+  failed += f.width_ratio < params.min_width_ratio;
+  failed += f.tilt_diff > params.max_tilt_diff;
+  failed += f.color_ratio < params.min_color_ratio;
+  failed +=
+    f.distance > 0 && (f.distance < params.min_distance || f.distance > params.max_distance);
+  return failed;
+}
+
+}  // namespace fyt::auto_aim
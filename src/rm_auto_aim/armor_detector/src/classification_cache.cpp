@@ -0,0 +1,71 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_detector/classification_cache.hpp"
+
+// std
+#include <limits>
+
+namespace fyt::auto_aim {
+
+int ClassificationCache::lookup(Armor &armor,
+                                const cv::Point2f &offset,
+                                const Params &params) const noexcept {
+  if (!params.enable) {
+    return -1;
+  }
+  const cv::Point2f center = armor.center + offset;
+  const float light_length = (armor.left_light.length + armor.right_light.length) / 2;
+  const float max_distance = static_cast<float>(params.max_distance) * light_length;
+
+  const Entry *best = nullptr;
+  float best_distance = std::numeric_limits<float>::max();
+  for (const auto &entry : entries_) {
+    if (entry.type != armor.type) {
+      continue;
+    }
+    const float distance = static_cast<float>(cv::norm(entry.center - center));
+    if (distance < max_distance && distance < best_distance) {
+      best = &entry;
+      best_distance = distance;
+    }
+  }
+  if (best == nullptr || best->age >= params.max_age) {
+    return -1;
+  }
+  const float confidence = best->confidence - static_cast<float>(params.decay);
+  if (confidence < params.min_confidence) {
+    return -1;
+  }
+  armor.number = best->number;
+  armor.confidence = confidence;
+  return best->age + 1;
+}
+
+void ClassificationCache::update(const std::vector<Armor> &armors,
+                                 const std::vector<int> &ages,
+                                 const cv::Point2f &offset) noexcept {
+  entries_.clear();
+  for (size_t i = 0; i < armors.size(); i++) {
+    const Armor &armor = armors[i];
+    entries_.push_back(Entry{armor.center + offset,
+                             (armor.left_light.length + armor.right_light.length) / 2,
+                             armor.type,
+                             armor.number,
+                             armor.confidence,
+                             i < ages.size() && ages[i] > 0 ? ages[i] : 0});
+  }
+}
+
+}  // namespace fyt::auto_aim
@@ -0,0 +1,85 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_detector/inference_engine.hpp"
+// project
+#include "rm_utils/assert.hpp"
+#include "rm_utils/logger/log.hpp"
+
+namespace fyt::auto_aim {
+
+CvDnnEngine::CvDnnEngine(const std::string &model_path) {
+  net_ = cv::dnn::readNetFromONNX(model_path);
+}
+
+cv::Mat CvDnnEngine::infer(const cv::Mat &blob) {
+  net_.setInput(blob);
+  cv::Mat output = net_.forward().clone();
+  return output.reshape(1, output.size[0]);
+}
+
+#ifdef ARMOR_DETECTOR_WITH_OPENVINO
+OpenVINOEngine::OpenVINOEngine(const std::string &model_path,
+                               const std::string &device,
+                               const std::string &cache_dir) {
+  if (!cache_dir.empty()) {
+    core_.set_property(ov::cache_dir(cache_dir));
+  }
+  auto model = core_.read_model(model_path);
+  // Make the batch dimension dynamic so that all armors can be classified at once
+  try {
+    ov::set_batch(model, -1);
+  } catch (const ov::Exception &e) {
+    FYT_WARN("armor_detector", "Model does not support dynamic batch: {}", e.what());
+  }
+  compiled_model_ = core_.compile_model(
+    model, device, ov::hint::performance_mode(ov::hint::PerformanceMode::LATENCY));
+  infer_request_ = compiled_model_.create_infer_request();
+}
+
+cv::Mat OpenVINOEngine::infer(const cv::Mat &blob) {
+  FYT_ASSERT(blob.dims == 4 && blob.type() == CV_32F);
+  ov::Shape shape{static_cast<size_t>(blob.size[0]),
+                  static_cast<size_t>(blob.size[1]),
+                  static_cast<size_t>(blob.size[2]),
+                  static_cast<size_t>(blob.size[3])};
+  // The blob is continuous, no need to copy
+  ov::Tensor input_tensor(ov::element::f32, shape, const_cast<float *>(blob.ptr<float>()));
+  infer_request_.set_input_tensor(input_tensor);
+  infer_request_.infer();
+
+  auto output = infer_request_.get_output_tensor();
+  int rows = static_cast<int>(output.get_shape()[0]);
+  int cols = static_cast<int>(output.get_size() / rows);
+  return cv::Mat(rows, cols, CV_32F, output.data<float>()).clone();
+}
+#endif
+
+std::unique_ptr<InferenceEngine> InferenceEngineFactory::createEngine(
+  std::string_view type,
+  const std::string &model_path,
+  [[maybe_unused]] const std::string &device,
+  [[maybe_unused]] const std::string &cache_dir) {
+  if (type == "opencv") {
+    return std::make_unique<CvDnnEngine>(model_path);
+  }
+#ifdef ARMOR_DETECTOR_WITH_OPENVINO
+  if (type == "openvino") {
+    return std::make_unique<OpenVINOEngine>(model_path, device, cache_dir);
+  }
+#endif
+  return nullptr;
+}
+
+}  // namespace fyt::auto_aim
@@ -0,0 +1,153 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_detector/keypoint_detector.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cmath>
+// third party
+#include <opencv2/dnn.hpp>
+#include <opencv2/imgproc.hpp>
+// project
+#include "rm_utils/assert.hpp"
+
+namespace fyt::auto_aim {
+
+namespace {
+// Blue, red, gray and purple, the last two are never enemies
+constexpr std::array<EnemyColor, ArmorKeypointDetector::NUM_COLORS> DNN_COLORS = {
+  EnemyColor::BLUE, EnemyColor::RED, EnemyColor::WHITE, EnemyColor::WHITE};
+}  // namespace
+
+ArmorKeypointDetector::ArmorKeypointDetector(std::unique_ptr<InferenceEngine> engine,
+                                             const Params &params)
+: engine_(std::move(engine)), params_(params) {
+  FYT_ASSERT(engine_ != nullptr);
+  for (int stride : {8, 16, 32}) {
+    const int n = params_.input_size / stride;
+    for (int g1 = 0; g1 < n; g1++) {
+      for (int g0 = 0; g0 < n; g0++) {
+        grid_strides_.push_back(GridStride{g0, g1, stride});
+      }
+    }
+  }
+}
+
+void ArmorKeypointDetector::makeBlob(const cv::Mat &rgb_img) {
+  const int size = params_.input_size;
+  scale_ = std::min(static_cast<float>(size) / rgb_img.cols,
+                    static_cast<float>(size) / rgb_img.rows);
+  const int w = static_cast<int>(std::round(rgb_img.cols * scale_));
+  const int h = static_cast<int>(std::round(rgb_img.rows * scale_));
+  pad_ = cv::Point2f((size - w) / 2, (size - h) / 2);
+
+  input_img_.create(size, size, CV_8UC3);
+  input_img_.setTo(cv::Scalar(114, 114, 114));
+  cv::Mat resized =
+    input_img_(cv::Rect(static_cast<int>(pad_.x), static_cast<int>(pad_.y), w, h));
+  cv::resize(rgb_img, resized, resized.size());
+  // Into the same blob every frame
+  cv::dnn::blobFromImage(input_img_, blob_, 1.0, cv::Size(), cv::Scalar(), false, false, CV_32F);
+}
+
+Light ArmorKeypointDetector::makeLight(const cv::Point2f &top,
+                                       const cv::Point2f &bottom,
+                                       EnemyColor color) {
+  Light light;
+  light.top = top;
+  light.bottom = bottom;
+  light.center = (top + bottom) / 2;
+  light.length = static_cast<float>(cv::norm(top - bottom));
+  light.axis = light.length > 0 ? (top - bottom) / light.length : cv::Point2f(0, -1);
+  // The width is not known, which also keeps the corner corrector off
+  light.width = 0;
+  light.tilt_angle = static_cast<float>(
+    std::atan2(std::abs(top.x - bottom.x), std::abs(top.y - bottom.y)) / CV_PI * 180);
+  light.color = color;
+  // The box of the bar, as it would be fitted
+  static_cast<cv::RotatedRect &>(light) =
+    cv::RotatedRect(light.center, cv::Size2f(light.width, light.length), -light.tilt_angle);
+  return light;
+}
+
+void ArmorKeypointDetector::detect(const cv::Mat &rgb_img,
+                                   EnemyColor color,
+                                   std::vector<Armor> &armors) {
+  armors.clear();
+  if (rgb_img.empty()) {
+    return;
+  }
+  makeBlob(rgb_img);
+  const cv::Mat output = engine_->infer(blob_);
+  // N x K, or 1 x (anchors * K) for an engine that keeps the batch as rows
+  const cv::Mat rows = output.reshape(1, static_cast<int>(output.total() / ROW_SIZE));
+  const int num_anchors = std::min(static_cast<int>(grid_strides_.size()), rows.rows);
+
+  proposals_.clear();
+  boxes_.clear();
+  scores_.clear();
+  for (int i = 0; i < num_anchors; i++) {
+    const float *row = rows.ptr<float>(i);
+    const float objectness = row[2 * NUM_KEYPOINTS];
+    if (objectness < params_.conf_threshold) {
+      continue;
+    }
+    const float *color_scores = row + 2 * NUM_KEYPOINTS + 1;
+    const float *number_scores = color_scores + NUM_COLORS;
+    const int color_id =
+      static_cast<int>(std::max_element(color_scores, color_scores + NUM_COLORS) - color_scores);
+    if (DNN_COLORS[color_id] != color) {
+      continue;
+    }
+    const int number_id = static_cast<int>(
+      std::max_element(number_scores, number_scores + NUM_NUMBERS) - number_scores);
+    const auto number = static_cast<ArmorNumber>(number_id + 1);
+    if (number == ArmorNumber::NEGATIVE) {
+      continue;
+    }
+
+    // Grid to input, then input to image
+    const GridStride &gs = grid_strides_[i];
+    std::array<cv::Point2f, NUM_KEYPOINTS> pts;
+    for (int k = 0; k < NUM_KEYPOINTS; k++) {
+      const cv::Point2f p((row[2 * k] + gs.grid0) * gs.stride,
+                          (row[2 * k + 1] + gs.grid1) * gs.stride);
+      pts[k] = (p - pad_) / scale_;
+    }
+
+    Armor armor(makeLight(pts[0], pts[1], color), makeLight(pts[3], pts[2], color));
+    const float distance = static_cast<float>(
+      cv::norm(armor.left_light.center - armor.right_light.center));
+    const float light_length = (armor.left_light.length + armor.right_light.length) / 2;
+    armor.type = light_length > 0 && distance / light_length > params_.min_large_center_distance
+                   ? ArmorType::LARGE
+                   : ArmorType::SMALL;
+    armor.number = number;
+    armor.confidence = objectness;
+
+    boxes_.push_back(cv::boundingRect(std::vector<cv::Point2f>(pts.begin(), pts.end())));
+    scores_.push_back(objectness);
+    proposals_.push_back(std::move(armor));
+  }
+
+  cv::dnn::NMSBoxes(boxes_, scores_, params_.conf_threshold, params_.nms_threshold, keep_);
+  armors.reserve(keep_.size());
+  for (int i : keep_) {
+    armors.push_back(std::move(proposals_[i]));
+  }
+}
+
+}  // namespace fyt::auto_aim
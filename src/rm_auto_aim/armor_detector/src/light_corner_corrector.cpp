@@ -15,10 +15,21 @@
 
 #include "armor_detector/light_corner_corrector.hpp"
 
-#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 namespace fyt::auto_aim {
 
+namespace {
+// A Mat over a buffer that keeps its capacity. Each light has another size, so a reused Mat
+// would still be reallocated by create()
+cv::Mat scratchMat(std::vector<uchar> &buffer, int rows, int cols, int type) {
+  buffer.resize(static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type));
+  return cv::Mat(rows, cols, type, buffer.data());
+}
+}  // namespace
+
 void LightCornerCorrector::correctCorners(Armor &armor, const cv::Mat &gray_img) {
   // If the width of the light is too small, the correction is not performed
   constexpr int PASS_OPTIMIZE_WIDTH = 3;
@@ -29,10 +40,12 @@ void LightCornerCorrector::correctCorners(Armor &armor, const cv::Mat &gray_img)
     armor.left_light.center = left_axis.centroid;
     armor.left_light.axis = left_axis.direction;
     // Find the corner of the light
-    if (cv::Point2f t = findCorner(gray_img, armor.left_light, left_axis, "top"); t.x > 0) {
+    if (cv::Point2f t = findCorner(gray_img, armor.left_light, left_axis, CornerType::TOP);
+        t.x > 0) {
       armor.left_light.top = t;
     }
-    if (cv::Point2f b = findCorner(gray_img, armor.left_light, left_axis, "bottom"); b.x > 0) {
+    if (cv::Point2f b = findCorner(gray_img, armor.left_light, left_axis, CornerType::BOTTOM);
+        b.x > 0) {
       armor.left_light.bottom = b;
     }
   }
@@ -43,13 +56,16 @@ void LightCornerCorrector::correctCorners(Armor &armor, const cv::Mat &gray_img)
     armor.right_light.center = right_axis.centroid;
     armor.right_light.axis = right_axis.direction;
     // Find the corner of the light
-    if (cv::Point2f t = findCorner(gray_img, armor.right_light, right_axis, "top"); t.x > 0) {
+    if (cv::Point2f t = findCorner(gray_img, armor.right_light, right_axis, CornerType::TOP);
+        t.x > 0) {
       armor.right_light.top = t;
     }
-    if (cv::Point2f b = findCorner(gray_img, armor.right_light, right_axis, "bottom"); b.x > 0) {
+    if (cv::Point2f b = findCorner(gray_img, armor.right_light, right_axis, CornerType::BOTTOM);
+        b.x > 0) {
       armor.right_light.bottom = b;
     }
   }
+  armor.updateLandmarks();
 }
 
 SymmetryAxis LightCornerCorrector::findSymmetryAxis(const cv::Mat &gray_img, const Light &light) {
@@ -71,10 +87,12 @@ SymmetryAxis LightCornerCorrector::findSymmetryAxis(const cv::Mat &gray_img, con
   light_box.width = std::min(light_box.width, gray_img.cols - light_box.x);
   light_box.height = std::min(light_box.height, gray_img.rows - light_box.y);
 
-  // Get normalized light image
-  cv::Mat roi = gray_img(light_box);
-  float mean_val = cv::mean(roi)[0];
-  roi.convertTo(roi, CV_32F);
+  // Get normalized light image, in a buffer reused by each worker thread
+  const cv::Mat light_img = gray_img(light_box);
+  float mean_val = cv::mean(light_img)[0];
+  thread_local std::vector<uchar> roi_buffer;
+  cv::Mat roi = scratchMat(roi_buffer, light_img.rows, light_img.cols, CV_32F);
+  light_img.convertTo(roi, CV_32F);
   cv::normalize(roi, roi, 0, MAX_BRIGHTNESS, cv::NORM_MINMAX);
 
   // Calculate the centroid
@@ -82,26 +100,13 @@ SymmetryAxis LightCornerCorrector::findSymmetryAxis(const cv::Mat &gray_img, con
   cv::Point2f centroid = cv::Point2f(moments.m10 / moments.m00, moments.m01 / moments.m00) +
                          cv::Point2f(light_box.x, light_box.y);
 
-  // Initialize the PointCloud
-  std::vector<cv::Point2f> points;
-  for (int i = 0; i < roi.rows; i++) {
-    for (int j = 0; j < roi.cols; j++) {
-      for (int k = 0; k < std::round(roi.at<float>(i, j)); k++) {
-        points.emplace_back(cv::Point2f(j, i));
-      }
-    }
-  }
-  cv::Mat points_mat = cv::Mat(points).reshape(1);
-
-  // PCA (Principal Component Analysis)
-  auto pca = cv::PCA(points_mat, cv::Mat(), cv::PCA::DATA_AS_ROW);
+  // PCA (Principal Component Analysis) weighted by brightness.
+  // The covariance is given by the central moments, so the principal axis is
+  // solved in closed form instead of building a point cloud
+  double theta = 0.5 * std::atan2(2 * moments.mu11, moments.mu20 - moments.mu02);
 
-  // Get the symmetry axis
-  cv::Point2f axis =
-    cv::Point2f(pca.eigenvectors.at<float>(0, 0), pca.eigenvectors.at<float>(0, 1));
-
-  // Normalize the axis
-  axis = axis / cv::norm(axis);
+  // Get the symmetry axis, which is already normalized
+  cv::Point2f axis = cv::Point2f(std::cos(theta), std::sin(theta));
 
   if (axis.y > 0) {
     axis = -axis;
@@ -113,63 +118,88 @@ SymmetryAxis LightCornerCorrector::findSymmetryAxis(const cv::Mat &gray_img, con
 cv::Point2f LightCornerCorrector::findCorner(const cv::Mat &gray_img,
                                              const Light &light,
                                              const SymmetryAxis &axis,
-                                             std::string order) {
+                                             CornerType type) {
   constexpr float START = 0.8 / 2;
   constexpr float END = 1.2 / 2;
 
-  auto inImage = [&gray_img](const cv::Point &point) -> bool {
-    return point.x >= 0 && point.x < gray_img.cols && point.y >= 0 && point.y < gray_img.rows;
-  };
-
-  auto distance = [](float x0, float y0, float x1, float y1) -> float {
-    return std::sqrt((x0 - x1) * (x0 - x1) + (y0 - y1) * (y0 - y1));
-  };
-
-  int oper = order == "top" ? 1 : -1;
+  int oper = type == CornerType::TOP ? 1 : -1;
   float L = light.length;
   float dx = axis.direction.x * oper;
   float dy = axis.direction.y * oper;
 
-  std::vector<cv::Point2f> candidates;
-
-  // Select multiple corner candidates and take the average as the final corner
+  // Select multiple corner candidates (rays parallel to the axis) and take the average as the
+  // final corner
   int n = light.width - 2;
   int half_n = std::round(n / 2);
-  for (int i = -half_n; i <= half_n; i++) {
-    float x0 = axis.centroid.x + L * START * dx + i;
-    float y0 = axis.centroid.y + L * START * dy;
+  float spacing = 1;
+  if (max_rays_ > 0 && 2 * half_n + 1 > max_rays_) {
+    const int half_rays = max_rays_ / 2;
+    spacing = half_rays > 0 ? static_cast<float>(half_n) / half_rays : 0;
+    half_n = half_rays;
+  }
+  int n_rays = 2 * half_n + 1;
+  int n_steps = static_cast<int>(std::ceil(L * (END - START)));
+  if (n_steps < 2) {
+    return cv::Point2f(-1, -1);
+  }
 
-    cv::Point2f prev = cv::Point2f(x0, y0);
-    cv::Point2f corner = cv::Point2f(x0, y0);
+  // Sample all rays at once with bilinear interpolation, the row i is the brightness profile of
+  // the ray i. Samples outside the image replicate the border, which gives no brightness drop
+  thread_local std::vector<uchar> map_x_buffer, map_y_buffer, samples_buffer, profile_buffer;
+  cv::Mat map_x = scratchMat(map_x_buffer, n_rays, n_steps, CV_32F);
+  cv::Mat map_y = scratchMat(map_y_buffer, n_rays, n_steps, CV_32F);
+  cv::Mat samples = scratchMat(samples_buffer, n_rays, n_steps, gray_img.type());
+  cv::Mat profile = scratchMat(profile_buffer, n_rays, n_steps, CV_32F);
+  const float x_start = axis.centroid.x + L * START * dx;
+  const float y_start = axis.centroid.y + L * START * dy;
+  for (int i = 0; i < n_rays; i++) {
+    float *mx = map_x.ptr<float>(i);
+    float *my = map_y.ptr<float>(i);
+    const float x0 = x_start + (i - half_n) * spacing;
+    for (int k = 0; k < n_steps; k++) {
+      mx[k] = x0 + k * dx;
+      my[k] = y_start + k * dy;
+    }
+  }
+  cv::remap(gray_img, samples, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+  samples.convertTo(profile, CV_32F);
+
+  cv::Point2f sum(0, 0);
+  int n_candidates = 0;
+  for (int i = 0; i < n_rays; i++) {
+    const float *p = profile.ptr<float>(i);
+    // Search along the ray to find the maximum brightness drop
+    int best = -1;
     float max_brightness_diff = 0;
-    bool has_corner = false;
-    // Search along the symmetry axis to find the corner that has the maximum brightness difference
-    for (float x = x0 + dx, y = y0 + dy; distance(x, y, x0, y0) < L * (END - START);
-         x += dx, y += dy) {
-      cv::Point2f cur = cv::Point2f(x, y);
-      if (!inImage(cv::Point(cur))) {
-        break;
-      }
-
-      float brightness_diff = gray_img.at<uchar>(prev) - gray_img.at<uchar>(cur);
-      if (brightness_diff > max_brightness_diff && gray_img.at<uchar>(prev) > axis.mean_val) {
+    for (int k = 0; k + 1 < n_steps; k++) {
+      float brightness_diff = p[k] - p[k + 1];
+      if (brightness_diff > max_brightness_diff && p[k] > axis.mean_val) {
         max_brightness_diff = brightness_diff;
-        corner = prev;
-        has_corner = true;
+        best = k;
       }
-
-      prev = cur;
+    }
+    if (best < 0) {
+      continue;
     }
 
-    if (has_corner) {
-      candidates.emplace_back(corner);
+    // Refine the position of the drop with a parabola through the neighboring differences
+    float offset = 0;
+    if (best > 0 && best + 2 < n_steps) {
+      float d_prev = p[best - 1] - p[best];
+      float d_next = p[best + 1] - p[best + 2];
+      float denom = d_prev - 2 * max_brightness_diff + d_next;
+      if (denom < 0) {
+        offset = std::clamp(0.5f * (d_prev - d_next) / denom, -0.5f, 0.5f);
+      }
     }
-  }
-  if (!candidates.empty()) {
-    cv::Point2f result = std::accumulate(candidates.begin(), candidates.end(), cv::Point2f(0, 0));
-    return result / static_cast<float>(candidates.size());
+    float t = best + offset;
+    sum += cv::Point2f(map_x.at<float>(i, 0) + t * dx, map_y.at<float>(i, 0) + t * dy);
+    n_candidates++;
   }
 
+  if (n_candidates > 0) {
+    return sum / static_cast<float>(n_candidates);
+  }
   return cv::Point2f(-1, -1);
 }
 
@@ -0,0 +1,112 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_detector/light_tracker.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace fyt::auto_aim {
+
+void LightTracker::associate(const std::vector<Light> &lights,
+                             const cv::Point2f &offset,
+                             const Params &params) noexcept {
+  const int n = static_cast<int>(lights.size());
+  if (n > MAX_LIGHTS) {
+    reset();
+    return;
+  }
+  const int last_n = static_cast<int>(last_tracks_.size());
+  last_used_.assign(last_n, 0);
+  tracks_.resize(n);
+  changed_prefix_.resize(n + 1);
+  changed_prefix_[0] = 0;
+
+  // Both lists are sorted by x, so the candidates of a light start at a moving lower bound
+  int begin = 0;
+  for (int k = 0; k < n; k++) {
+    const Light &light = lights[k];
+    const cv::Point2f center = light.center + offset;
+    const float max_distance = static_cast<float>(params.max_shift);
+    while (begin < last_n && last_tracks_[begin].center.x < center.x - max_distance) {
+      begin++;
+    }
+    int best = -1;
+    float best_distance = max_distance;
+    for (int m = begin; m < last_n && last_tracks_[m].center.x <= center.x + max_distance;
+         m++) {
+      const float distance = static_cast<float>(cv::norm(last_tracks_[m].center - center));
+      if (!last_used_[m] && distance <= best_distance) {
+        best = m;
+        best_distance = distance;
+      }
+    }
+
+    Track &track = tracks_[k];
+    track.center = center;
+    if (best >= 0) {
+      last_used_[best] = 1;
+    }
+    // Stable while the light stays close to the reference of its track
+    if (best >= 0 && cv::norm(center - last_tracks_[best].ref_center) <= params.max_shift &&
+        std::abs(light.length - last_tracks_[best].ref_length) <=
+          params.max_length_change * last_tracks_[best].ref_length) {
+      track.ref_center = last_tracks_[best].ref_center;
+      track.ref_length = last_tracks_[best].ref_length;
+      track.last = best;
+    } else {
+      track.ref_center = center;
+      track.ref_length = light.length;
+      track.last = -1;
+    }
+    changed_prefix_[k + 1] = changed_prefix_[k] + (track.last < 0);
+  }
+
+  verdicts_.assign(static_cast<size_t>(n) * n, UNKNOWN);
+  active_ = true;
+}
+
+LightTracker::Verdict LightTracker::cached(int i, int j) const noexcept {
+  const int last_i = tracks_[i].last;
+  const int last_j = tracks_[j].last;
+  if (last_i < 0 || last_j < 0) {
+    return UNKNOWN;
+  }
+  // The lights in between must be the same, for the containment test
+  if (last_j - last_i != j - i || changed_prefix_[j] != changed_prefix_[i + 1]) {
+    return UNKNOWN;
+  }
+  return static_cast<Verdict>(
+    last_verdicts_[static_cast<size_t>(last_i) * last_tracks_.size() + last_j]);
+}
+
+void LightTracker::finish() noexcept {
+  if (!active_) {
+    return;
+  }
+  std::swap(tracks_, last_tracks_);
+  std::swap(verdicts_, last_verdicts_);
+  active_ = false;
+}
+
+void LightTracker::reset() noexcept {
+  active_ = false;
+  tracks_.clear();
+  last_tracks_.clear();
+  verdicts_.clear();
+  last_verdicts_.clear();
+}
+
+}  // namespace fyt::auto_aim
@@ -28,7 +28,6 @@
 // std
 #include <algorithm>
 #include <cstddef>
-#include <execution>
 #include <fstream>
 #include <future>
 #include <map>
@@ -39,22 +38,42 @@
 // project
 #include "armor_detector/number_classifier.hpp"
 #include "armor_detector/types.hpp"
+#include "rm_utils/assert.hpp"
+#include "rm_utils/logger/log.hpp"
 
 namespace fyt::auto_aim {
 NumberClassifier::NumberClassifier(const std::string &model_path,
                                    const std::string &label_path,
                                    const double thre,
-                                   const std::vector<std::string> &ignore_classes)
-: threshold(thre), ignore_classes_(ignore_classes) {
-  net_ = cv::dnn::readNetFromONNX(model_path);
+                                   const std::vector<std::string> &ignore_classes,
+                                   const std::string &backend,
+                                   const std::string &device,
+                                   const std::string &cache_dir)
+: threshold(thre) {
+  engine_ = InferenceEngineFactory::createEngine(backend, model_path, device, cache_dir);
+  FYT_ASSERT_MSG(engine_ != nullptr, "Unknown inference backend: " + backend);
   std::ifstream label_file(label_path);
   std::string line;
   while (std::getline(label_file, line)) {
-    class_names_.push_back(line);
+    class_numbers_.push_back(armorNumberFromString(line));
+  }
+  for (const auto &ignore_class : ignore_classes) {
+    ArmorNumber number = armorNumberFromString(ignore_class);
+    if (number != ArmorNumber::UNKNOWN) {
+      ignore_classes_.push_back(number);
+    }
   }
 }
 
 cv::Mat NumberClassifier::extractNumber(const cv::Mat &src, const Armor &armor) const noexcept {
+  cv::Mat number_img;
+  extractNumber(src, armor, number_img);
+  return number_img;
+}
+
+void NumberClassifier::extractNumber(const cv::Mat &src,
+                                     const Armor &armor,
+                                     cv::Mat &number_img) const noexcept {
   // Light length in image
   static const int light_length = 12;
   // Image size after warp
@@ -63,7 +82,7 @@ cv::Mat NumberClassifier::extractNumber(const cv::Mat &src, const Armor &armor)
   static const int large_armor_width = 54;
   // Number ROI size
   static const cv::Size roi_size(20, 28);
-  static const cv::Size input_size(28, 28);
+  static const cv::Size input_size(NUMBER_SIZE, NUMBER_SIZE);
 
   // Warp perspective transform
   cv::Point2f lights_vertices[4] = {
@@ -72,79 +91,133 @@ cv::Mat NumberClassifier::extractNumber(const cv::Mat &src, const Armor &armor)
   const int top_light_y = (warp_height - light_length) / 2 - 1;
   const int bottom_light_y = top_light_y + light_length;
   const int warp_width = armor.type == ArmorType::SMALL ? small_armor_width : large_armor_width;
+
+  // Fold the ROI crop and the resize into the transform, so that one warp gives the input
+  const float roi_x = (warp_width - roi_size.width) / 2;
+  const float scale_x = static_cast<float>(input_size.width) / roi_size.width;
+  const float scale_y = static_cast<float>(input_size.height) / roi_size.height;
+  auto to_input = [&](float x, float y) { return cv::Point2f((x - roi_x) * scale_x, y * scale_y); };
   cv::Point2f target_vertices[4] = {
-    cv::Point(0, bottom_light_y),
-    cv::Point(0, top_light_y),
-    cv::Point(warp_width - 1, top_light_y),
-    cv::Point(warp_width - 1, bottom_light_y),
+    to_input(0, bottom_light_y),
+    to_input(0, top_light_y),
+    to_input(warp_width - 1, top_light_y),
+    to_input(warp_width - 1, bottom_light_y),
   };
-  cv::Mat number_image;
   auto rotation_matrix = cv::getPerspectiveTransform(lights_vertices, target_vertices);
-  cv::warpPerspective(src, number_image, rotation_matrix, cv::Size(warp_width, warp_height));
 
-  // Get ROI
-  number_image = number_image(cv::Rect(cv::Point((warp_width - roi_size.width) / 2, 0), roi_size));
+  // Reused by each worker thread
+  thread_local cv::Mat warp_image, gray_image;
+  cv::warpPerspective(src, warp_image, rotation_matrix, input_size);
+  if (warp_image.channels() == 3) {
+    cv::cvtColor(warp_image, gray_image, cv::COLOR_RGB2GRAY);
+  } else {
+    gray_image = warp_image;
+  }
 
-  // Binarize
-  cv::cvtColor(number_image, number_image, cv::COLOR_RGB2GRAY);
-  cv::threshold(number_image, number_image, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
-  cv::resize(number_image, number_image, input_size);
-  return number_image;
+  // Binarize into the number image of the armor
+  cv::threshold(gray_image, number_img, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
 }
 
-void NumberClassifier::classify(const cv::Mat &src, Armor &armor) noexcept {
-  // Normalize
-  cv::Mat input = armor.number_img / 255.0;
-
-  // Create blob from image
-  cv::Mat blob;
-  cv::dnn::blobFromImage(input, blob);
-
-  // Set the input blob for the neural network
-  mutex_.lock();
-  net_.setInput(blob);
+cv::Mat NumberClassifier::packBlob(const Armor *armors, int n) noexcept {
+  const int h = NUMBER_SIZE, w = NUMBER_SIZE;
+  blob_buffer_.resize(static_cast<size_t>(n) * h * w);
+  for (int i = 0; i < n; i++) {
+    // Normalize into the blob in place
+    cv::Mat plane(h, w, CV_32F, blob_buffer_.data() + static_cast<size_t>(i) * h * w);
+    armors[i].number_img.convertTo(plane, CV_32F, 1.0 / 255.0);
+  }
+  const int sizes[4] = {n, 1, h, w};
+  return cv::Mat(4, sizes, CV_32F, blob_buffer_.data());
+}
 
+void NumberClassifier::classify(const cv::Mat &src, Armor &armor) noexcept {
   // Forward pass the image blob through the model
-  cv::Mat outputs = net_.forward().clone();
+  mutex_.lock();
+  cv::Mat outputs = engine_->infer(packBlob(&armor, 1));
   mutex_.unlock();
 
   // Decode the output
+  decode(outputs.reshape(1, 1), armor);
+}
+
+void NumberClassifier::classifyBatch(std::vector<Armor> &armors) noexcept {
+  if (armors.empty()) {
+    return;
+  }
+  if (!support_batch_ || armors.size() == 1) {
+    for (auto &armor : armors) {
+      classify(armor.number_img, armor);
+    }
+    return;
+  }
+
+  cv::Mat outputs;
+  try {
+    // Stack all number images into one NCHW blob
+    std::lock_guard<std::mutex> lock(mutex_);
+    outputs = engine_->infer(packBlob(armors.data(), static_cast<int>(armors.size())));
+  } catch (const std::exception &e) {
+    // May be transient, only this frame is classified one by one
+    FYT_WARN("armor_detector", "Batched classification failed: {}", e.what());
+    for (auto &armor : armors) {
+      classify(armor.number_img, armor);
+    }
+    return;
+  }
+
+  if (outputs.rows != static_cast<int>(armors.size())) {
+    // The model is exported with a fixed batch size, never try again
+    FYT_WARN("armor_detector",
+             "Model returned {} rows for a batch of {}, batching is disabled",
+             outputs.rows,
+             armors.size());
+    support_batch_ = false;
+    classifyBatch(armors);
+    return;
+  }
+
+  for (size_t i = 0; i < armors.size(); i++) {
+    decode(outputs.row(i), armors[i]);
+  }
+}
+
+void NumberClassifier::decode(const cv::Mat &output, Armor &armor) const noexcept {
   double confidence;
   cv::Point class_id_point;
-  minMaxLoc(outputs.reshape(1, 1), nullptr, &confidence, nullptr, &class_id_point);
+  minMaxLoc(output, nullptr, &confidence, nullptr, &class_id_point);
   int label_id = class_id_point.x;
 
   armor.confidence = confidence;
-  armor.number = class_names_[label_id];
-
-  armor.classfication_result = fmt::format("{}:{:.1f}%", armor.number, armor.confidence * 100.0);
+  armor.number = class_numbers_[label_id];
 }
 
 void NumberClassifier::eraseIgnoreClasses(std::vector<Armor> &armors) noexcept {
   armors.erase(
-    std::remove_if(armors.begin(),
-                   armors.end(),
-                   [this](const Armor &armor) {
-                     if (armor.confidence < threshold) {
-                       return true;
-                     }
-
-                     for (const auto &ignore_class : ignore_classes_) {
-                       if (armor.number == ignore_class) {
-                         return true;
-                       }
-                     }
-
-                     bool mismatch_armor_type = false;
-                     if (armor.type == ArmorType::LARGE) {
-                       mismatch_armor_type = armor.number == "outpost" || armor.number == "2" ||
-                                             armor.number == "sentry";
-                     } else if (armor.type == ArmorType::SMALL) {
-                       mismatch_armor_type = armor.number == "1" || armor.number == "base";
-                     }
-                     return mismatch_armor_type;
-                   }),
+    std::remove_if(
+      armors.begin(), armors.end(), [this](const Armor &armor) { return isIgnored(armor); }),
     armors.end());
 }
 
+bool NumberClassifier::isIgnored(const Armor &armor) const noexcept {
+  if (armor.confidence < threshold) {
+    return true;
+  }
+
+  for (const auto ignore_class : ignore_classes_) {
+    if (armor.number == ignore_class) {
+      return true;
+    }
+  }
+
+  bool mismatch_armor_type = false;
+  if (armor.type == ArmorType::LARGE) {
+    mismatch_armor_type = armor.number == ArmorNumber::OUTPOST ||
+                          armor.number == ArmorNumber::ENGINEER ||
+                          armor.number == ArmorNumber::SENTRY;
+  } else if (armor.type == ArmorType::SMALL) {
+    mismatch_armor_type = armor.number == ArmorNumber::HERO || armor.number == ArmorNumber::BASE;
+  }
+  return mismatch_armor_type;
+}
+
 }  // namespace fyt::auto_aim
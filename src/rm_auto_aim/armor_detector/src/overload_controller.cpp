@@ -0,0 +1,44 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_detector/overload_controller.hpp"
+
+namespace fyt::auto_aim {
+
+int OverloadController::update(double latency, double now) noexcept {
+  if (!params_.enable) {
+    return 0;
+  }
+  mean_latency_ = mean_latency_ < 0
+                    ? latency
+                    : mean_latency_ + params_.smoothing * (latency - mean_latency_);
+  if (now - last_change_ < params_.hold) {
+    return 0;
+  }
+
+  const Level level = level_.load(std::memory_order_relaxed);
+  int change = 0;
+  if (mean_latency_ > params_.degrade_ratio * params_.deadline && level < NO_DEBUG) {
+    change = 1;
+  } else if (mean_latency_ < params_.recover_ratio * params_.deadline && level > NORMAL) {
+    change = -1;
+  }
+  if (change != 0) {
+    level_.store(static_cast<Level>(level + change), std::memory_order_relaxed);
+    last_change_ = now;
+  }
+  return change;
+}
+
+}  // namespace fyt::auto_aim
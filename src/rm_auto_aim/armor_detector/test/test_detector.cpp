@@ -20,12 +20,18 @@
 #include <rclcpp/node_options.hpp>
 #include <rclcpp/utilities.hpp>
 // std
+#include <algorithm>
+#include <cmath>
 #include <memory>
+#include <utility>
 // opencv
 #include <opencv2/opencv.hpp>
 // project
 #include "armor_detector/armor_detector.hpp"
+#include "armor_detector/armor_pose_estimator.hpp"
 #include "rm_utils/common.hpp"
+#include "rm_utils/math/planar_pnp_solver.hpp"
+#include "rm_utils/math/undistorter.hpp"
 #include "rm_utils/url_resolver.hpp"
 
 using namespace fyt;
@@ -67,10 +73,532 @@ TEST(ArmorDetectorNodeTest, NodeStartupTest) {
   });
 
   EXPECT_EQ(armors.size(), static_cast<size_t>(6));
-  EXPECT_EQ(armors[0].number, "2");
-  EXPECT_EQ(armors[1].number, "3");
-  EXPECT_EQ(armors[2].number, "4");
-  EXPECT_EQ(armors[3].number, "5");
-  EXPECT_EQ(armors[4].number, "outpost");
-  EXPECT_EQ(armors[5].number, "sentry");
+  EXPECT_EQ(armors[0].number, ArmorNumber::ENGINEER);
+  EXPECT_EQ(armors[1].number, ArmorNumber::INFANTRY_3);
+  EXPECT_EQ(armors[2].number, ArmorNumber::INFANTRY_4);
+  EXPECT_EQ(armors[3].number, ArmorNumber::INFANTRY_5);
+  EXPECT_EQ(armors[4].number, ArmorNumber::OUTPOST);
+  EXPECT_EQ(armors[5].number, ArmorNumber::SENTRY);
+}
+
+TEST(ArmorDetectorNodeTest, ConnectedComponentsLightExtractor) {
+  Detector::LightParams l_params = {
+    .min_ratio = 0.08, .max_ratio = 0.4, .max_angle = 40.0, .color_diff_thresh = 25};
+  Detector::ArmorParams a_params = {.min_light_ratio = 0.6,
+                                    .min_small_center_distance = 0.8,
+                                    .max_small_center_distance = 3.2,
+                                    .min_large_center_distance = 3.2,
+                                    .max_large_center_distance = 5.0,
+                                    .max_angle = 35.0};
+  auto detector = std::make_unique<Detector>(160, EnemyColor::RED, l_params, a_params);
+
+  namespace fs = std::filesystem;
+  fs::path test_image_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/docs/test.png");
+  cv::Mat test_image = cv::imread(test_image_path.string(), cv::IMREAD_COLOR);
+  cv::cvtColor(test_image, test_image, cv::COLOR_BGR2RGB);
+
+  // Both back ends should find the same light pairs, with the same colors
+  std::vector<Armor> contour_armors = detector->detect(test_image);
+  detector->light_extractor = Detector::LightExtractor::CONNECTED_COMPONENTS;
+  std::vector<Armor> component_armors = detector->detect(test_image);
+
+  ASSERT_EQ(contour_armors.size(), component_armors.size());
+  for (size_t i = 0; i < contour_armors.size(); i++) {
+    EXPECT_NEAR(contour_armors[i].center.x, component_armors[i].center.x, 2.0);
+    EXPECT_NEAR(contour_armors[i].center.y, component_armors[i].center.y, 2.0);
+    for (const auto &[contour_light, component_light] :
+         {std::make_pair(contour_armors[i].left_light, component_armors[i].left_light),
+          std::make_pair(contour_armors[i].right_light, component_armors[i].right_light)}) {
+      EXPECT_EQ(contour_light.color, component_light.color);
+      // The contour lists a few edge pixels twice
+      EXPECT_NEAR(contour_light.color_diff,
+                  component_light.color_diff,
+                  0.15 * std::abs(contour_light.color_diff) + 3.0);
+    }
+  }
+}
+
+TEST(ArmorDetectorNodeTest, TwoStageDetection) {
+  Detector::LightParams l_params = {
+    .min_ratio = 0.08, .max_ratio = 0.4, .max_angle = 40.0, .color_diff_thresh = 25};
+  Detector::ArmorParams a_params = {.min_light_ratio = 0.6,
+                                    .min_small_center_distance = 0.8,
+                                    .max_small_center_distance = 3.2,
+                                    .min_large_center_distance = 3.2,
+                                    .max_large_center_distance = 5.0,
+                                    .max_angle = 35.0};
+  auto detector = std::make_unique<Detector>(160, EnemyColor::RED, l_params, a_params);
+
+  namespace fs = std::filesystem;
+  fs::path test_image_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/docs/test.png");
+  cv::Mat test_image = cv::imread(test_image_path.string(), cv::IMREAD_COLOR);
+  cv::cvtColor(test_image, test_image, cv::COLOR_BGR2RGB);
+
+  std::vector<Armor> armors = detector->detect(test_image);
+
+  // Stage 1 of the next frame must not affect the candidates of the previous one
+  auto candidates = detector->findCandidates(test_image);
+  auto next_candidates = detector->findCandidates(cv::Mat::zeros(test_image.size(), CV_8UC3));
+  std::vector<Armor> staged_armors = detector->classifyCandidates(candidates);
+
+  EXPECT_TRUE(next_candidates.armors.empty());
+  ASSERT_EQ(armors.size(), staged_armors.size());
+  for (size_t i = 0; i < armors.size(); i++) {
+    EXPECT_NEAR(armors[i].center.x, staged_armors[i].center.x, 1e-3);
+    EXPECT_NEAR(armors[i].center.y, staged_armors[i].center.y, 1e-3);
+  }
+}
+
+TEST(ArmorDetectorNodeTest, DetectWithoutClassifier) {
+  Detector::LightParams l_params = {
+    .min_ratio = 0.08, .max_ratio = 0.4, .max_angle = 40.0, .color_diff_thresh = 25};
+  Detector::ArmorParams a_params = {.min_light_ratio = 0.6,
+                                    .min_small_center_distance = 0.8,
+                                    .max_small_center_distance = 3.2,
+                                    .min_large_center_distance = 3.2,
+                                    .max_large_center_distance = 5.0,
+                                    .max_angle = 35.0};
+  auto detector = std::make_unique<Detector>(160, EnemyColor::RED, l_params, a_params);
+  detector->corner_corrector = std::make_unique<LightCornerCorrector>();
+
+  namespace fs = std::filesystem;
+  fs::path test_image_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/docs/test.png");
+  cv::Mat test_image = cv::imread(test_image_path.string(), cv::IMREAD_COLOR);
+  cv::cvtColor(test_image, test_image, cv::COLOR_BGR2RGB);
+
+  // Every matched light pair is kept, the six real armors included
+  std::vector<Armor> armors = detector->detect(test_image);
+  EXPECT_GE(armors.size(), static_cast<size_t>(6));
+  for (const auto &armor : armors) {
+    EXPECT_EQ(armor.number, ArmorNumber::UNKNOWN);
+    EXPECT_TRUE(armor.number_img.empty());
+  }
+}
+
+TEST(ArmorDetectorNodeTest, PlanarPnPMatchesOpenCV) {
+  const std::array<double, 9> camera_matrix = {1200, 0, 640, 0, 1200, 512, 0, 0, 1};
+  const std::vector<double> dist_coeffs = {-0.08, 0.12, 0.001, -0.0005, 0};
+  const auto object_points =
+    Armor::buildObjectPoints<cv::Point3f>(SMALL_ARMOR_WIDTH, SMALL_ARMOR_HEIGHT);
+
+  // Project the armor with a known pose
+  cv::Mat K(3, 3, CV_64F, const_cast<double *>(camera_matrix.data()));
+  cv::Mat D(1, 5, CV_64F, const_cast<double *>(dist_coeffs.data()));
+  cv::Mat rvec = (cv::Mat_<double>(3, 1) << 0.1, -0.4, 0.05);
+  cv::Mat tvec = (cv::Mat_<double>(3, 1) << 0.2, -0.1, 3.0);
+  std::vector<cv::Point2f> image_points;
+  cv::projectPoints(object_points, rvec, tvec, K, D, image_points);
+
+  PlanarPnPSolver<Armor::N_LANDMARKS> solver(camera_matrix, dist_coeffs);
+  int model = solver.addObjectPoints(object_points);
+  std::array<PlanarPnPSolver<Armor::N_LANDMARKS>::Solution, 2> solutions;
+  ASSERT_EQ(solver.solve(image_points, model, solutions), 2);
+
+  std::vector<cv::Mat> rvecs, tvecs;
+  cv::solvePnPGeneric(
+    object_points, image_points, K, D, rvecs, tvecs, false, cv::SOLVEPNP_IPPE);
+  ASSERT_FALSE(rvecs.empty());
+  cv::Mat R_cv;
+  cv::Rodrigues(rvecs[0], R_cv);
+
+  EXPECT_LT(solutions[0].reprojection_error, 1e-2);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(solutions[0].t(i), tvecs[0].at<double>(i), 1e-3);
+    for (int j = 0; j < 3; j++) {
+      EXPECT_NEAR(solutions[0].R(i, j), R_cv.at<double>(i, j), 1e-3);
+    }
+  }
+}
+
+TEST(ArmorDetectorNodeTest, AdaptiveThresholdTracksTargetRatio) {
+  AdaptiveThreshold::Params params;
+  params.enable = true;
+  params.target_ratio = 0.01;
+  // 1% of the pixels at 200, the rest is background
+  AdaptiveThreshold::Histogram histogram{};
+  histogram[40] = 9900;
+  histogram[200] = 100;
+
+  // Too low, the background is above the threshold: move towards 199 step by step
+  int thres = 30;
+  for (int i = 0; i < 100; i++) {
+    thres = AdaptiveThreshold::update(histogram, thres, params);
+  }
+  EXPECT_GE(thres, 40);
+  EXPECT_LT(thres, 200);
+
+  // Inside the hysteresis band the threshold is kept
+  EXPECT_EQ(AdaptiveThreshold::update(histogram, 120, params), 120);
+
+  // Too high, no light pixel left
+  thres = AdaptiveThreshold::update(histogram, 220, params);
+  EXPECT_LT(thres, 220);
+
+  // The bounds are respected
+  params.max_thres = 150;
+  EXPECT_LE(AdaptiveThreshold::update(histogram, 220, params), 150);
+}
+
+TEST(ArmorDetectorNodeTest, OverloadControllerStepsLevels) {
+  OverloadController::Params params;
+  params.enable = true;
+  params.deadline = 0.03;
+  params.hold = 0.5;
+  OverloadController overload(params);
+
+  EXPECT_TRUE(overload.expired(0.04));
+  EXPECT_FALSE(overload.expired(0.02));
+
+  // Slow frames degrade at once, then one level per hold time
+  double now = 0;
+  for (; now < 0.7; now += 0.01) {
+    overload.update(0.05, now);
+  }
+  EXPECT_EQ(overload.level(), OverloadController::NO_CORNER_CORRECTION);
+  for (; now < 3.0; now += 0.01) {
+    overload.update(0.05, now);
+  }
+  EXPECT_EQ(overload.level(), OverloadController::NO_DEBUG);
+
+  // Fast frames recover
+  for (; now < 6.0; now += 0.01) {
+    overload.update(0.005, now);
+  }
+  EXPECT_EQ(overload.level(), OverloadController::NORMAL);
+
+  // Disabled, nothing expires and the level stays
+  OverloadController disabled;
+  EXPECT_FALSE(disabled.expired(1.0));
+  EXPECT_EQ(disabled.update(1.0, 0.0), 0);
+}
+
+namespace {
+// Returns the same output for every blob
+class FixedEngine : public InferenceEngine {
+public:
+  explicit FixedEngine(cv::Mat output) : output_(std::move(output)) {}
+  cv::Mat infer(const cv::Mat &) override { return output_; }
+
+private:
+  cv::Mat output_;
+};
+}  // namespace
+
+TEST(ArmorDetectorNodeTest, KeypointDetectorDecodesCorners) {
+  ArmorKeypointDetector::Params params;
+  params.input_size = 64;
+  // 8 x 8 + 4 x 4 + 2 x 2 anchors
+  cv::Mat output = cv::Mat::zeros(84, ArmorKeypointDetector::ROW_SIZE, CV_32F);
+  auto set_armor = [&output](int row, float objectness, int color_id) {
+    float *p = output.ptr<float>(row);
+    // Top left, bottom left, bottom right and top right in cells of the first stride
+    const float corners[] = {1, 1, 1, 4, 5, 4, 5, 1};
+    std::copy(std::begin(corners), std::end(corners), p);
+    p[8] = objectness;
+    p[9 + color_id] = 1;
+    // Infantry 3
+    p[9 + ArmorKeypointDetector::NUM_COLORS + 2] = 1;
+  };
+  set_armor(0, 0.9, 1);
+  // Overlapping duplicate with a lower score, removed by the NMS
+  set_armor(1, 0.8, 1);
+  // Below the threshold
+  set_armor(2, 0.3, 1);
+  // Blue
+  set_armor(20, 0.9, 0);
+
+  ArmorKeypointDetector detector(std::make_unique<FixedEngine>(output), params);
+  std::vector<Armor> armors;
+  detector.detect(cv::Mat::zeros(64, 64, CV_8UC3), EnemyColor::RED, armors);
+
+  ASSERT_EQ(armors.size(), 1u);
+  const Armor &armor = armors.front();
+  EXPECT_EQ(armor.number, ArmorNumber::INFANTRY_3);
+  EXPECT_EQ(armor.type, ArmorType::SMALL);
+  EXPECT_FLOAT_EQ(armor.confidence, 0.9f);
+  EXPECT_NEAR(armor.left_light.top.x, 8, 1e-3);
+  EXPECT_NEAR(armor.left_light.bottom.y, 32, 1e-3);
+  EXPECT_NEAR(armor.right_light.top.x, 40, 1e-3);
+  EXPECT_NEAR(armor.right_light.bottom.y, 32, 1e-3);
+}
+
+TEST(ArmorDetectorNodeTest, ClassificationCacheReusesNearbyArmors) {
+  auto make_armor = [](float x) {
+    Light left(cv::RotatedRect(cv::Point2f(x - 30, 100), cv::Size2f(6, 20), 0),
+               cv::Point2f(x - 30, 100));
+    Light right(cv::RotatedRect(cv::Point2f(x + 30, 100), cv::Size2f(6, 20), 0),
+                cv::Point2f(x + 30, 100));
+    Armor armor(left, right);
+    armor.type = ArmorType::SMALL;
+    return armor;
+  };
+  ClassificationCache::Params params;
+  params.enable = true;
+  params.max_age = 3;
+  ClassificationCache cache;
+
+  Armor classified = make_armor(200);
+  classified.number = ArmorNumber::INFANTRY_3;
+  classified.confidence = 0.99;
+  cache.update({classified}, {-1}, cv::Point2f(0, 0));
+
+  // Moved by a few pixels, and seen through a search window
+  Armor next = make_armor(190);
+  int age = cache.lookup(next, cv::Point2f(15, 0), params);
+  EXPECT_EQ(age, 1);
+  EXPECT_EQ(next.number, ArmorNumber::INFANTRY_3);
+  EXPECT_LT(next.confidence, 0.99f);
+
+  // Too far away
+  Armor far = make_armor(400);
+  EXPECT_EQ(cache.lookup(far, cv::Point2f(0, 0), params), -1);
+
+  // Classified again after max_age reuses
+  for (int i = 0; i < params.max_age - 1; i++) {
+    cache.update({next}, {age}, cv::Point2f(15, 0));
+    age = cache.lookup(next, cv::Point2f(15, 0), params);
+  }
+  EXPECT_EQ(age, params.max_age);
+  cache.update({next}, {age}, cv::Point2f(15, 0));
+  EXPECT_EQ(cache.lookup(next, cv::Point2f(15, 0), params), -1);
+}
+
+TEST(ArmorDetectorNodeTest, LightTrackingKeepsTheArmors) {
+  Detector::LightParams l_params = {
+    .min_ratio = 0.08, .max_ratio = 0.4, .max_angle = 40.0, .color_diff_thresh = 25};
+  Detector::ArmorParams a_params = {.min_light_ratio = 0.6,
+                                    .min_small_center_distance = 0.8,
+                                    .max_small_center_distance = 3.2,
+                                    .min_large_center_distance = 3.2,
+                                    .max_large_center_distance = 5.0,
+                                    .max_angle = 35.0};
+  auto detector = std::make_unique<Detector>(160, EnemyColor::RED, l_params, a_params);
+  detector->enable_debug = false;
+
+  namespace fs = std::filesystem;
+  fs::path test_image_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/docs/test.png");
+  cv::Mat test_image = cv::imread(test_image_path.string(), cv::IMREAD_COLOR);
+  cv::cvtColor(test_image, test_image, cv::COLOR_BGR2RGB);
+  std::vector<Armor> armors = detector->detect(test_image);
+
+  // The second frame reuses the verdicts of the first, a shifted frame pairs again
+  detector->light_tracking.enable = true;
+  for (int i = 0; i < 3; i++) {
+    cv::Mat frame = test_image;
+    if (i == 2) {
+      cv::Mat shift = (cv::Mat_<double>(2, 3) << 1, 0, 10, 0, 1, 0);
+      cv::warpAffine(test_image, frame, shift, test_image.size());
+    }
+    std::vector<Armor> tracked_armors = detector->detect(frame);
+    ASSERT_EQ(armors.size(), tracked_armors.size());
+    for (size_t k = 0; k < armors.size(); k++) {
+      EXPECT_EQ(armors[k].type, tracked_armors[k].type);
+      EXPECT_NEAR(armors[k].center.y, tracked_armors[k].center.y, 1e-3);
+    }
+  }
+}
+
+TEST(ArmorDetectorNodeTest, CoarseSearchMatchesFullSearch) {
+  Detector::LightParams l_params = {
+    .min_ratio = 0.08, .max_ratio = 0.4, .max_angle = 40.0, .color_diff_thresh = 25};
+  Detector::ArmorParams a_params = {.min_light_ratio = 0.6,
+                                    .min_small_center_distance = 0.8,
+                                    .max_small_center_distance = 3.2,
+                                    .min_large_center_distance = 3.2,
+                                    .max_large_center_distance = 5.0,
+                                    .max_angle = 35.0};
+  auto detector = std::make_unique<Detector>(160, EnemyColor::RED, l_params, a_params);
+  detector->enable_debug = false;
+
+  namespace fs = std::filesystem;
+  fs::path test_image_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/docs/test.png");
+  cv::Mat test_image = cv::imread(test_image_path.string(), cv::IMREAD_COLOR);
+  cv::cvtColor(test_image, test_image, cv::COLOR_BGR2RGB);
+  std::vector<Armor> armors = detector->detect(test_image);
+
+  // The lights are refined at full resolution, so the armors are the same
+  detector->coarse_search.enable = true;
+  std::vector<Armor> coarse_armors = detector->detect(test_image);
+  ASSERT_EQ(armors.size(), coarse_armors.size());
+  for (size_t k = 0; k < armors.size(); k++) {
+    EXPECT_EQ(armors[k].type, coarse_armors[k].type);
+    EXPECT_NEAR(armors[k].center.x, coarse_armors[k].center.x, 1e-3);
+    EXPECT_NEAR(armors[k].center.y, coarse_armors[k].center.y, 1e-3);
+  }
+}
+
+TEST(ArmorDetectorNodeTest, CascadeFilterRejectsFilledPairs) {
+  auto make_light = [](float x, float color_diff) {
+    Light light(cv::RotatedRect(cv::Point2f(x, 100), cv::Size2f(10, 50), 0), cv::Point2f(x, 100));
+    light.color_diff = color_diff;
+    return light;
+  };
+  Armor armor(make_light(100, 80), make_light(220, 70));
+  cv::Mat binary_img = cv::Mat::zeros(200, 320, CV_8UC1);
+
+  CascadeFilter::Params params;
+  params.focal_length = 1000;
+  auto features = CascadeFilter::features(armor, binary_img, params.focal_length);
+  EXPECT_FLOAT_EQ(features.center_fill, 0.0f);
+  EXPECT_NEAR(features.distance, 1000 * SMALL_ARMOR_HEIGHT / 50, 1e-3);
+  EXPECT_EQ(CascadeFilter::failures(features, params), 0);
+
+  // A lit panel between the lights
+  cv::rectangle(binary_img, cv::Rect(110, 70, 100, 60), cv::Scalar(255), cv::FILLED);
+  features = CascadeFilter::features(armor, binary_img, params.focal_length);
+  EXPECT_GT(features.center_fill, 0.9f);
+  EXPECT_EQ(CascadeFilter::failures(features, params), 1);
+
+  // A reflection much weaker than its light, and too close for its size
+  Armor reflection(make_light(100, 80), make_light(220, 5));
+  features = CascadeFilter::features(reflection, cv::Mat::zeros(200, 320, CV_8UC1), 10);
+  EXPECT_EQ(CascadeFilter::failures(features, params), 2);
+}
+
+TEST(ArmorDetectorNodeTest, UndistortedPinholePnPMatchesOpenCV) {
+  const std::array<double, 9> camera_matrix = {1200, 0, 640, 0, 1200, 512, 0, 0, 1};
+  const std::vector<double> dist_coeffs = {-0.08, 0.12, 0.001, -0.0005, 0};
+  cv::Mat K(3, 3, CV_64F, const_cast<double *>(camera_matrix.data()));
+  cv::Mat D(1, 5, CV_64F, const_cast<double *>(dist_coeffs.data()));
+  Undistorter undistorter(camera_matrix, dist_coeffs, 1280, 1024);
+
+  // The table agrees with OpenCV over the image
+  std::vector<cv::Point2f> pixels, expected;
+  for (int y = 0; y < 1024; y += 37) {
+    for (int x = 0; x < 1280; x += 41) {
+      pixels.emplace_back(x + 0.3f, y + 0.7f);
+    }
+  }
+  cv::undistortPoints(pixels, expected, K, D, cv::noArray(), K,
+                      cv::TermCriteria(cv::TermCriteria::COUNT, 20, 0));
+  for (size_t i = 0; i < pixels.size(); i++) {
+    const cv::Point2f p = undistorter.undistort(pixels[i]);
+    EXPECT_NEAR(p.x, expected[i].x, 0.02);
+    EXPECT_NEAR(p.y, expected[i].y, 0.02);
+  }
+
+  // Pinhole PnP on the undistorted landmarks finds the pose of the distorted projection
+  const auto object_points =
+    Armor::buildObjectPoints<cv::Point3f>(SMALL_ARMOR_WIDTH, SMALL_ARMOR_HEIGHT);
+  cv::Mat rvec = (cv::Mat_<double>(3, 1) << 0.1, -0.4, 0.05);
+  cv::Mat tvec = (cv::Mat_<double>(3, 1) << 0.2, -0.1, 3.0);
+  std::vector<cv::Point2f> image_points;
+  cv::projectPoints(object_points, rvec, tvec, K, D, image_points);
+  std::array<cv::Point2f, Armor::N_LANDMARKS> undistorted;
+  undistorter.undistort(image_points, undistorted);
+
+  PlanarPnPSolver<Armor::N_LANDMARKS> solver(camera_matrix, {});
+  int model = solver.addObjectPoints(object_points);
+  std::array<PlanarPnPSolver<Armor::N_LANDMARKS>::Solution, 2> solutions;
+  ASSERT_EQ(solver.solve(undistorted, model, solutions), 2);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(solutions[0].t(i), tvec.at<double>(i), 1e-3);
+  }
+}
+
+TEST(ArmorDetectorNodeTest, PoseBudgetSkipsSmallArmorsAndPicksTrackedYaw) {
+  auto make_armor = [](float light_length) {
+    Light left(cv::RotatedRect({600, 500}, {6, light_length}, 0), {600, 500});
+    Light right(cv::RotatedRect({680, 500}, {6, light_length}, 0), {680, 500});
+    Armor armor(left, right);
+    armor.number = ArmorNumber::INFANTRY_3;
+    return armor;
+  };
+  const Armor near_armor = make_armor(30);
+  const ArmorPoseEstimator::TargetYaw target{ArmorNumber::INFANTRY_3, 0.1, 4};
+  const ArmorPoseEstimator::TargetYaw other{ArmorNumber::HERO, 0.1, 4};
+
+  // Disabled, every armor gets BA
+  ArmorPoseEstimator::Budget budget;
+  EXPECT_TRUE(ArmorPoseEstimator::worthBA(budget, make_armor(8), 10.0, other));
+  budget.enable = true;
+  EXPECT_TRUE(ArmorPoseEstimator::worthBA(budget, near_armor, 3.0, std::nullopt));
+  EXPECT_TRUE(ArmorPoseEstimator::worthBA(budget, near_armor, 3.0, target));
+  EXPECT_FALSE(ArmorPoseEstimator::worthBA(budget, near_armor, 8.0, target));
+  EXPECT_FALSE(ArmorPoseEstimator::worthBA(budget, make_armor(8), 3.0, target));
+  // Not the tracked target
+  EXPECT_FALSE(ArmorPoseEstimator::worthBA(budget, near_armor, 3.0, other));
+  budget.ba_target_only = false;
+  EXPECT_TRUE(ArmorPoseEstimator::worthBA(budget, near_armor, 3.0, other));
+
+  // Two solutions of similar error, the second one faces an armor of the target
+  auto yaw_rotation = [](double yaw) {
+    return Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+  };
+  ArmorPoseEstimator::Solutions solutions;
+  solutions[0] = {yaw_rotation(-0.6), Eigen::Vector3d(0, 0, 3), 1.0};
+  solutions[1] = {yaw_rotation(0.1 + M_PI / 2 + 0.05), Eigen::Vector3d(0, 0, 3), 1.5};
+  const Eigen::Matrix3d R_imu_camera = Eigen::Matrix3d::Identity();
+  EXPECT_FALSE(
+    ArmorPoseEstimator::selectByTargetYaw(near_armor, R_imu_camera, other, solutions));
+  ASSERT_TRUE(
+    ArmorPoseEstimator::selectByTargetYaw(near_armor, R_imu_camera, target, solutions));
+  EXPECT_NEAR(ArmorPoseEstimator::armorYaw(solutions[0].R), 0.1 + M_PI / 2 + 0.05, 1e-9);
+
+  // The reprojection errors tell them apart
+  solutions[0] = {yaw_rotation(-0.6), Eigen::Vector3d(0, 0, 3), 1.0};
+  solutions[1] = {yaw_rotation(0.1), Eigen::Vector3d(0, 0, 3), 4.0};
+  EXPECT_FALSE(
+    ArmorPoseEstimator::selectByTargetYaw(near_armor, R_imu_camera, target, solutions));
+  EXPECT_NEAR(ArmorPoseEstimator::armorYaw(solutions[0].R), -0.6, 1e-9);
+}
+
+TEST(ArmorDetectorNodeTest, RoiArmorsSolveToTheFullFramePose) {
+  Detector::LightParams l_params = {
+    .min_ratio = 0.08, .max_ratio = 0.4, .max_angle = 40.0, .color_diff_thresh = 25};
+  Detector::ArmorParams a_params = {.min_light_ratio = 0.6,
+                                    .min_small_center_distance = 0.8,
+                                    .max_small_center_distance = 3.2,
+                                    .min_large_center_distance = 3.2,
+                                    .max_large_center_distance = 5.0,
+                                    .max_angle = 35.0};
+  auto detector = std::make_unique<Detector>(160, EnemyColor::RED, l_params, a_params);
+  detector->corner_corrector = std::make_unique<LightCornerCorrector>();
+
+  namespace fs = std::filesystem;
+  fs::path test_image_path =
+    utils::URLResolver::getResolvedPath("package://armor_detector/docs/test.png");
+  cv::Mat test_image = cv::imread(test_image_path.string(), cv::IMREAD_COLOR);
+  cv::cvtColor(test_image, test_image, cv::COLOR_BGR2RGB);
+
+  std::vector<Armor> armors = detector->detect(test_image);
+  ASSERT_FALSE(armors.empty());
+  const Armor &armor = armors.front();
+  // A window around the armor, away from the origin of the image
+  const cv::Rect window =
+    cv::Rect(cv::Point(armor.center) - cv::Point(150, 100), cv::Size(300, 200)) &
+    cv::Rect(0, 0, test_image.cols, test_image.rows);
+  ASSERT_NE(window.tl(), cv::Point(0, 0));
+  std::vector<Armor> roi_armors = detector->detect(test_image, window);
+  auto roi_armor = std::find_if(roi_armors.begin(), roi_armors.end(), [&](const Armor &a) {
+    return cv::norm(a.center - armor.center) < 1.0;
+  });
+  ASSERT_NE(roi_armor, roi_armors.end());
+  for (int i = 0; i < Armor::N_LANDMARKS; i++) {
+    EXPECT_NEAR(roi_armor->landmarks()[i].x, armor.landmarks()[i].x, 1e-3);
+    EXPECT_NEAR(roi_armor->landmarks()[i].y, armor.landmarks()[i].y, 1e-3);
+  }
+
+  auto camera_info = std::make_shared<sensor_msgs::msg::CameraInfo>();
+  camera_info->width = test_image.cols;
+  camera_info->height = test_image.rows;
+  camera_info->k = {1200, 0, test_image.cols / 2.0, 0, 1200, test_image.rows / 2.0, 0, 0, 1};
+  camera_info->d = {0, 0, 0, 0, 0};
+  ArmorPoseEstimator estimator(camera_info);
+  estimator.enableBA(false);
+  std::vector<Armor> full_frame, roi;
+  full_frame.push_back(armor.clone());
+  roi.push_back(roi_armor->clone());
+  const auto poses = estimator.extractArmorPoses(full_frame, Eigen::Matrix3d::Identity());
+  const auto roi_poses = estimator.extractArmorPoses(roi, Eigen::Matrix3d::Identity());
+  ASSERT_EQ(poses.size(), 1u);
+  ASSERT_EQ(roi_poses.size(), 1u);
+  EXPECT_NEAR(poses[0].pose.position.x, roi_poses[0].pose.position.x, 1e-3);
+  EXPECT_NEAR(poses[0].pose.position.y, roi_poses[0].pose.position.y, 1e-3);
+  EXPECT_NEAR(poses[0].pose.position.z, roi_poses[0].pose.position.z, 1e-3);
 }
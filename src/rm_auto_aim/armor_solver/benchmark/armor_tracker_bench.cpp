@@ -0,0 +1,449 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Offline replay of recorded armors through the tracker bank and the solver, as fast as
+// possible and without an executor, so that the filter choices (EKF, IMM) and their
+// parameters can be compared and regressions caught on a laptop.
+//
+// Usage:
+//   ros2 run armor_solver armor_tracker_bench --bag=<uri> [--horizon=0.1] [--rounds=1]
+//     [--armors=/armor_detector/armors] [--serial=/serial/receive]
+//     [--ros-args --params-file armor_solver_params.yaml -p ekf.imm.enable:=true]
+//
+// The bag carries the armors of the detector, the attitudes of the serial driver and /tf,
+// /tf_static for the camera frames, i.e. a recording of a match or of the bringup. The
+// parameters are the ones of the armor_solver node. The prediction error is the distance from
+// the armors predicted horizon seconds ahead by the target state to the armors measured then,
+// the same error the solver makes when it leads a shot by the flying time.
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+// ros2
+#include <tf2_ros/buffer.h>
+
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp/serialization.hpp>
+#include <rosbag2_cpp/reader.hpp>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
+#include <tf2_msgs/msg/tf_message.hpp>
+// project
+#include "armor_solver/armor_solver.hpp"
+#include "armor_solver/motion_model.hpp"
+#include "armor_solver/tracker_bank.hpp"
+#include "rm_interfaces/msg/armors.hpp"
+#include "rm_interfaces/msg/serial_receive_data.hpp"
+#include "rm_interfaces/msg/target.hpp"
+#include "rm_utils/attitude_cache.hpp"
+
+using namespace fyt;
+using namespace fyt::auto_aim;
+
+namespace {
+std::string g_bag;
+std::string g_armors_topic = "/armor_detector/armors";
+std::string g_serial_topic = "/serial/receive";
+double g_horizon = 0.1;
+int g_rounds = 1;
+
+std::string withSlash(const std::string &topic) {
+  return !topic.empty() && topic.front() == '/' ? topic : "/" + topic;
+}
+
+// Everything the replay needs from the bag, deserialized once
+struct Recording {
+  struct Event {
+    enum Type { ARMORS, ATTITUDE, TF, TF_STATIC } type;
+    size_t index;
+  };
+  std::vector<Event> events;
+  std::vector<rm_interfaces::msg::Armors> armors;
+  std::vector<rm_interfaces::msg::SerialReceiveData> attitudes;
+  std::vector<tf2_msgs::msg::TFMessage> tfs;
+};
+
+template <typename T>
+void deserialize(const rosbag2_storage::SerializedBagMessage &bag_msg, std::vector<T> &out) {
+  static rclcpp::Serialization<T> serialization;
+  rclcpp::SerializedMessage serialized(*bag_msg.serialized_data);
+  out.emplace_back();
+  serialization.deserialize_message(&serialized, &out.back());
+}
+
+Recording readBag() {
+  Recording rec;
+  rosbag2_cpp::Reader reader;
+  reader.open(g_bag);
+  while (reader.has_next()) {
+    auto bag_msg = reader.read_next();
+    const std::string &topic = bag_msg->topic_name;
+    if (topic == g_armors_topic) {
+      rec.events.push_back({Recording::Event::ARMORS, rec.armors.size()});
+      deserialize(*bag_msg, rec.armors);
+    } else if (topic == g_serial_topic) {
+      rec.events.push_back({Recording::Event::ATTITUDE, rec.attitudes.size()});
+      deserialize(*bag_msg, rec.attitudes);
+    } else if (topic == "/tf" || topic == "/tf_static") {
+      rec.events.push_back({topic == "/tf" ? Recording::Event::TF : Recording::Event::TF_STATIC,
+                            rec.tfs.size()});
+      deserialize(*bag_msg, rec.tfs);
+    }
+  }
+  return rec;
+}
+
+// The tracker bank as the armor_solver node builds it from its parameters
+std::unique_ptr<TrackerBank> makeTrackerBank(rclcpp::Node &node) {
+  double max_match_distance = node.declare_parameter("tracker.max_match_distance", 0.2);
+  double max_match_yaw_diff = node.declare_parameter("tracker.max_match_yaw_diff", 1.0);
+  int tracking_thres = node.declare_parameter("tracker.tracking_thres", 5);
+  double lost_time_thres = node.declare_parameter("tracker.lost_time_thres", 0.3);
+  int max_tracks = node.declare_parameter("tracker.max_tracks", 8);
+
+  auto u_q = ProcessNoise{0.005,
+                          node.declare_parameter("ekf.sigma2_q_x", 20.0),
+                          node.declare_parameter("ekf.sigma2_q_y", 20.0),
+                          node.declare_parameter("ekf.sigma2_q_z", 20.0),
+                          node.declare_parameter("ekf.sigma2_q_yaw", 100.0),
+                          node.declare_parameter("ekf.sigma2_q_r", 800.0),
+                          node.declare_parameter("ekf.sigma2_q_d_zc", 800.0)};
+  auto u_r = MeasurementNoise{node.declare_parameter("ekf.r_x", 0.05),
+                              node.declare_parameter("ekf.r_y", 0.05),
+                              node.declare_parameter("ekf.r_z", 0.05),
+                              node.declare_parameter("ekf.r_yaw", 0.02)};
+  Eigen::DiagonalMatrix<double, X_N> p0;
+  p0.setIdentity();
+  RobotStateEKF ekf(Predict(0.005), Measure(), u_q, u_r, p0);
+
+  bool imm_enable = node.declare_parameter("ekf.imm.enable", false);
+  double switch_prob = node.declare_parameter("ekf.imm.switch_prob", 0.05);
+  int models_num = imm_enable ? IMM_MODEL_N : 1;
+  Eigen::MatrixXd transition = Eigen::MatrixXd::Constant(
+    models_num, models_num, models_num > 1 ? switch_prob / (models_num - 1) : 0.0);
+  transition.diagonal().setConstant(models_num > 1 ? 1 - switch_prob : 1.0);
+  RobotStateIMM imm(std::vector<RobotStateEKF>(models_num, ekf),
+                    transition,
+                    Eigen::VectorXd::Constant(models_num, 1.0 / models_num));
+
+  auto bank = std::make_unique<TrackerBank>(
+    max_tracks, max_match_distance, max_match_yaw_diff, tracking_thres, imm);
+  bank->process_noise = u_q;
+  bank->lost_time_thres = lost_time_thres;
+  bank->setMahalanobisGate(node.declare_parameter("tracker.mahalanobis_gate", 0.0));
+  OutpostFilter::Params outpost_params;
+  outpost_params.v_yaw = node.declare_parameter("tracker.outpost.v_yaw", outpost_params.v_yaw);
+  outpost_params.radius = node.declare_parameter("tracker.outpost.radius", outpost_params.radius);
+  outpost_params.memory = node.declare_parameter("tracker.outpost.memory", outpost_params.memory);
+  outpost_params.yaw_noise =
+    node.declare_parameter("tracker.outpost.yaw_noise", outpost_params.yaw_noise);
+  outpost_params.min_frames =
+    node.declare_parameter("tracker.outpost.min_frames", outpost_params.min_frames);
+  bank->setOutpostModel(node.declare_parameter("tracker.outpost.enable", true), outpost_params);
+  bank->setBatchedEKF(node.declare_parameter("tracker.batched_ekf", true));
+  bank->setSinglePrecision(node.declare_parameter("tracker.single_precision", false));
+  return bank;
+}
+
+// Armors of the target state, propagated by dt at constant velocity
+std::vector<Eigen::Vector3d> predictArmors(const rm_interfaces::msg::Target &t, double dt) {
+  const Eigen::Vector3d center(t.position.x + dt * t.velocity.x,
+                               t.position.y + dt * t.velocity.y,
+                               t.position.z + dt * t.velocity.z);
+  const double yaw = t.yaw + dt * t.v_yaw;
+  const int n = std::max(t.armors_num, 1);
+  std::vector<Eigen::Vector3d> armors;
+  for (int i = 0; i < n; i++) {
+    const bool current_pair = n != 4 || i % 2 == 0;
+    const double r = current_pair ? t.radius_1 : t.radius_2;
+    const double a = yaw + i * 2 * M_PI / n;
+    armors.emplace_back(center + Eigen::Vector3d(-r * std::cos(a),
+                                                 -r * std::sin(a),
+                                                 t.d_zc + (current_pair ? 0 : t.d_za)));
+  }
+  return armors;
+}
+
+double percentile(std::vector<double> samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[static_cast<size_t>(p * (samples.size() - 1) + 0.5)];
+}
+
+double mean(const std::vector<double> &samples) {
+  double sum = 0;
+  for (double s : samples) {
+    sum += s;
+  }
+  return sum / std::max<size_t>(samples.size(), 1);
+}
+
+void printLatency(const char *name, const std::vector<double> &us) {
+  std::printf("%-8s calls %8zu  p50 %8.2f us  p99 %8.2f us  max %8.2f us  mean %8.2f us  "
+              "%10.0f calls/s\n",
+              name,
+              us.size(),
+              percentile(us, 0.50),
+              percentile(us, 0.99),
+              us.empty() ? 0.0 : *std::max_element(us.begin(), us.end()),
+              mean(us),
+              mean(us) > 0 ? 1e6 / mean(us) : 0.0);
+}
+
+struct Stats {
+  std::vector<double> track_us;
+  std::vector<double> solve_us;
+  // Prediction errors in m
+  std::vector<double> errors;
+  size_t frames = 0;
+  size_t tracking_frames = 0;
+  size_t late_frames = 0;
+  size_t dropped_frames = 0;
+  size_t solver_errors = 0;
+};
+
+double elapsedUs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+    .count();
+}
+
+// One pass over the recording with fresh trackers and a fresh solver
+void replay(const std::shared_ptr<rclcpp::Node> &node,
+            const Recording &rec,
+            TrackerBank &bank,
+            Solver &solver,
+            Stats &stats) {
+  const std::string target_frame = node->get_parameter("target_frame").as_string();
+  const double transmit_delay = node->get_parameter("solver.transmit_delay").as_double();
+  auto tf2_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+  utils::AttitudeCache<> attitude_cache;
+
+  rclcpp::Time last_time(0, 0, RCL_ROS_TIME);
+  bool has_last_time = false;
+  // Targets of the recent frames, the oldest one at least horizon old is checked
+  std::deque<rm_interfaces::msg::Target> predictions;
+
+  for (const auto &event : rec.events) {
+    if (event.type == Recording::Event::TF || event.type == Recording::Event::TF_STATIC) {
+      for (const auto &t : rec.tfs[event.index].transforms) {
+        tf2_buffer->setTransform(t, "bag", event.type == Recording::Event::TF_STATIC);
+      }
+      continue;
+    }
+    if (event.type == Recording::Event::ATTITUDE) {
+      const auto &msg = rec.attitudes[event.index];
+      solver.updateBulletSpeed(msg.bullet_speed);
+      if (msg.header.frame_id == target_frame) {
+        tf2::Quaternion q;
+        q.setRPY(msg.roll, msg.pitch, msg.yaw);
+        attitude_cache.push(rclcpp::Time(msg.header.stamp).nanoseconds(),
+                            Eigen::Quaterniond(q.w(), q.x(), q.y(), q.z()));
+      }
+      continue;
+    }
+
+    // Same as ArmorSolverNode::armorsCallback, minus the publishers
+    stats.frames++;
+    auto armors_msg = std::make_shared<rm_interfaces::msg::Armors>(rec.armors[event.index]);
+    bool transformed = true;
+    for (auto &armor : armors_msg->armors) {
+      geometry_msgs::msg::PoseStamped ps;
+      ps.header = armors_msg->header;
+      ps.pose = armor.pose;
+      try {
+        armor.pose = tf2_buffer->transform(ps, target_frame).pose;
+      } catch (const tf2::TransformException &) {
+        transformed = false;
+        break;
+      }
+    }
+    if (!transformed) {
+      stats.dropped_frames++;
+      continue;
+    }
+    armors_msg->armors.erase(std::remove_if(armors_msg->armors.begin(),
+                                            armors_msg->armors.end(),
+                                            [](const rm_interfaces::msg::Armor &armor) {
+                                              return std::abs(armor.pose.position.z) > 2;
+                                            }),
+                             armors_msg->armors.end());
+
+    rclcpp::Time time = armors_msg->header.stamp;
+    auto start = std::chrono::steady_clock::now();
+    if (!bank.empty() && has_last_time && time < last_time) {
+      stats.late_frames++;
+      bank.updateDelayed(armors_msg, (last_time - time).seconds());
+      time = last_time;
+    } else {
+      bank.update(armors_msg, bank.empty() || !has_last_time ? 0 : (time - last_time).seconds());
+    }
+    stats.track_us.push_back(elapsedUs(start));
+    last_time = time;
+    has_last_time = true;
+
+    const Tracker *tracker = bank.target();
+    if (tracker == nullptr || (tracker->tracker_state != Tracker::TRACKING &&
+                               tracker->tracker_state != Tracker::TEMP_LOST)) {
+      predictions.clear();
+      continue;
+    }
+    stats.tracking_frames++;
+
+    rm_interfaces::msg::Target target;
+    target.header.stamp = time;
+    target.header.frame_id = target_frame;
+    target.tracking = true;
+    const auto &state = tracker->target_state;
+    target.id = static_cast<uint8_t>(tracker->tracked_id);
+    target.armors_num = static_cast<int>(tracker->tracked_armors_num);
+    target.position.x = state(0);
+    target.velocity.x = state(1);
+    target.position.y = state(2);
+    target.velocity.y = state(3);
+    target.position.z = state(4);
+    target.velocity.z = state(5);
+    target.yaw = state(6);
+    target.v_yaw = state(7);
+    target.radius_1 = state(8);
+    target.radius_2 = tracker->another_r;
+    target.d_zc = state(9);
+    target.d_za = tracker->d_za;
+
+    // Prediction error against the armors of the target measured in this frame
+    if (!predictions.empty() && predictions.front().id != target.id) {
+      predictions.clear();
+    }
+    while (predictions.size() > 1 &&
+           (time - rclcpp::Time(predictions[1].header.stamp)).seconds() >= g_horizon) {
+      predictions.pop_front();
+    }
+    if (!predictions.empty()) {
+      const double dt = (time - rclcpp::Time(predictions.front().header.stamp)).seconds();
+      if (dt >= g_horizon) {
+        const auto predicted = predictArmors(predictions.front(), dt);
+        for (const auto &armor : armors_msg->armors) {
+          if (armor.number != static_cast<int>(target.id)) {
+            continue;
+          }
+          const auto &p = armor.pose.position;
+          const Eigen::Vector3d measured(p.x, p.y, p.z);
+          double error = std::numeric_limits<double>::max();
+          for (const auto &q : predicted) {
+            error = std::min(error, (q - measured).norm());
+          }
+          stats.errors.push_back(error);
+        }
+      }
+    }
+    predictions.push_back(target);
+
+    // The command of the frame, as the event driven node solves it
+    start = std::chrono::steady_clock::now();
+    try {
+      solver.solve(
+        target, time + rclcpp::Duration::from_seconds(transmit_delay), tf2_buffer, &attitude_cache);
+      stats.solve_us.push_back(elapsedUs(start));
+    } catch (...) {
+      stats.solver_errors++;
+    }
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  auto args = rclcpp::init_and_remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i < args.size(); i++) {
+    const char *arg = args[i].c_str();
+    if (std::strncmp(arg, "--bag=", 6) == 0) {
+      g_bag = arg + 6;
+    } else if (std::strncmp(arg, "--armors=", 9) == 0) {
+      g_armors_topic = withSlash(arg + 9);
+    } else if (std::strncmp(arg, "--serial=", 9) == 0) {
+      g_serial_topic = withSlash(arg + 9);
+    } else if (std::strncmp(arg, "--horizon=", 10) == 0) {
+      g_horizon = std::max(0.0, std::atof(arg + 10));
+    } else if (std::strncmp(arg, "--rounds=", 9) == 0) {
+      g_rounds = std::max(1, std::atoi(arg + 9));
+    } else {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      rclcpp::shutdown();
+      return 1;
+    }
+  }
+  if (g_bag.empty()) {
+    std::cerr << "Usage: armor_tracker_bench --bag=<uri> [--horizon=0.1] [--rounds=1]"
+              << std::endl;
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  Recording rec = readBag();
+  std::cerr << "Loaded " << rec.armors.size() << " armors, " << rec.attitudes.size()
+            << " attitudes and " << rec.tfs.size() << " tf messages" << std::endl;
+  if (rec.armors.empty()) {
+    std::cerr << "No armors on " << g_armors_topic << std::endl;
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  Stats stats;
+  bool imm = false, batched = false, single_precision = false;
+  for (int round = 0; round < g_rounds; round++) {
+    // Never spun, it only holds the parameters of armor_solver. A new one every round for
+    // fresh trackers and a fresh solver
+    auto node = std::make_shared<rclcpp::Node>("armor_solver");
+    node->declare_parameter("target_frame", "odom");
+    node->declare_parameter("solver.transmit_delay", 0.0);
+    auto bank = makeTrackerBank(*node);
+    imm = node->get_parameter("ekf.imm.enable").as_bool();
+    batched = node->get_parameter("tracker.batched_ekf").as_bool();
+    single_precision = node->get_parameter("tracker.single_precision").as_bool();
+    Solver solver(node);
+    replay(node, rec, *bank, solver, stats);
+  }
+
+  // The batch only runs without the IMM, compare the error of double and float runs
+  std::printf("filter   %s%s\n",
+              imm ? "IMM" : "EKF",
+              imm || !batched ? "" : single_precision ? "  batched float" : "  batched double");
+  std::printf("frames   %zu  tracking %zu  late %zu  dropped (no tf) %zu  solver errors %zu\n",
+              stats.frames,
+              stats.tracking_frames,
+              stats.late_frames,
+              stats.dropped_frames,
+              stats.solver_errors);
+  printLatency("track", stats.track_us);
+  printLatency("solve", stats.solve_us);
+  std::printf("error    horizon %.3f s  samples %zu  mean %.4f m  p50 %.4f m  p90 %.4f m  "
+              "p99 %.4f m\n",
+              g_horizon,
+              stats.errors.size(),
+              mean(stats.errors),
+              percentile(stats.errors, 0.50),
+              percentile(stats.errors, 0.90),
+              percentile(stats.errors, 0.99));
+  rclcpp::shutdown();
+  return 0;
+}
@@ -18,11 +18,14 @@
 #define ARMOR_SOLVER_SOLVER_HPP_
 
 // std
+#include <array>
 #include <memory>
+#include <vector>
 // ros2
 #include <tf2_ros/buffer.h>
 #include <angles/angles.h>
 
+#include <rclcpp/rclcpp.hpp>
 #include <rclcpp/time.hpp>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
 // 3rd party
@@ -30,6 +33,8 @@
 // project
 #include "rm_interfaces/msg/gimbal_cmd.hpp"
 #include "rm_interfaces/msg/target.hpp"
+#include "rm_utils/attitude_cache.hpp"
+#include "rm_utils/math/bullet_speed_estimator.hpp"
 #include "rm_utils/math/trajectory_compensator.hpp"
 #include "rm_utils/math/manual_compensator.hpp"
 
@@ -41,33 +46,99 @@ public:
   // explicit Solver(std::string trajectory_compensator_type, float max_tracking_v_yaw);
   ~Solver() = default;
 
-  // Solve the gimbal command from tracked target
+  // Solve the gimbal command from tracked target. The gimbal attitude is read
+  // from attitude_cache if it is given and fresh, otherwise from tf2
   // Throw: tf2::TransformException if the transform from "odom" to "gimbal_link" is not available
   rm_interfaces::msg::GimbalCmd solve(const rm_interfaces::msg::Target &target_msg,
                                       const rclcpp::Time &current_time,
-                                      std::shared_ptr<tf2_ros::Buffer> tf2_buffer_);
+                                      std::shared_ptr<tf2_ros::Buffer> tf2_buffer_,
+                                      const utils::AttitudeCache<> *attitude_cache = nullptr);
 
   enum State { TRACKING_ARMOR = 0, TRACKING_CENTER = 1 } state;
 
+  static constexpr size_t MAX_ARMORS_NUM = 4;
+
+  // All armors of the target robot
+  struct ArmorCandidates {
+    std::array<Eigen::Vector3d, MAX_ARMORS_NUM> positions;
+    // Angle from the line of sight to the armor normal, in (-pi, pi].
+    // Its absolute value is the angular cost of shooting the armor
+    std::array<double, MAX_ARMORS_NUM> view_angles;
+    // Whether the armor faces the gimbal, i.e. |view_angle| < pi / 2
+    std::array<bool, MAX_ARMORS_NUM> visible;
+    size_t armors_num = 0;
+  };
+
+  // Next window of every armor of the outpost (fixed center, constant v_yaw) in which it faces
+  // the gimbal within max_view_angle, from `from` on. Times are from the stamp of the target,
+  // start is infinite if the armor never turns in
+  struct HitSchedule {
+    std::array<double, MAX_ARMORS_NUM> start;
+    std::array<double, MAX_ARMORS_NUM> end;
+    size_t armors_num = 0;
+  };
+
   std::vector<std::pair<double, double>> getTrajectory() const noexcept; 
 
+  // Feed the muzzle speed reported by the referee system. The compensator follows the
+  // estimated speed if solver.bullet_speed_estimation.enable is set
+  void updateBulletSpeed(double measured_speed);
+
 private:
-  // Get the armor positions from the target robot
-  std::vector<Eigen::Vector3d> getArmorPositions(const Eigen::Vector3d &target_center,
-                                                 const double yaw,
-                                                 const double r1,
-                                                 const double r2,
-                                                 const double d_zc,
-                                                 const double d_za,
-                                                 const size_t armors_num) const noexcept;
+  // Keep the cached parameters up to date
+  rcl_interfaces::msg::SetParametersResult onSetParameters(
+    const std::vector<rclcpp::Parameter> &parameters);
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr param_callback_handle_;
+
+  // Attitudes older than this fall back to tf2, Unit: ns
+  static constexpr int64_t MAX_ATTITUDE_AGE_NS = 50'000'000;
+
+  // Compute the armors of the target robot, sin and cos of the target yaw are evaluated once
+  // and rotated to the other armors
+  // Throw: std::runtime_error if armors_num is not in {1, ..., MAX_ARMORS_NUM}
+  void getArmorCandidates(const Eigen::Vector3d &target_center,
+                          const double target_yaw,
+                          const double r1,
+                          const double r2,
+                          const double d_zc,
+                          const double d_za,
+                          const size_t armors_num,
+                          ArmorCandidates &candidates) const;
 
   // Select the best armor to shoot
   // Return: selected idx in {0, 1, ..., armors_num - 1}
-  int selectBestArmor(const std::vector<Eigen::Vector3d> &armor_positions,
-                      const Eigen::Vector3d &target_center,
-                      const double target_yaw,
-                      const double target_v_yaw,
-                      const size_t armors_num) const noexcept;
+  int selectBestArmor(const ArmorCandidates &candidates, const double target_v_yaw) const noexcept;
+
+  // Sample the target over the planning horizon and find the first window in which a shot fired
+  // lands on the armor idx: the armor is still the selected one and faces the gimbal, and within
+  // the gimbal lag the current attitude is already on it. Times are relative to the solving time
+  // Return: false if there is no window
+  bool planFireWindow(const rm_interfaces::msg::Target &target,
+                      const double time_since_stamp,
+                      const int idx,
+                      double &window_start,
+                      double &window_end) const;
+
+  // planFireWindow for the outpost: the window of the armor idx is taken from its hit schedule in
+  // closed form instead of sampling the horizon
+  bool planOutpostFireWindow(const rm_interfaces::msg::Target &target,
+                             const double time_since_stamp,
+                             const int idx,
+                             double &window_start,
+                             double &window_end) const;
+
+  void getHitSchedule(const rm_interfaces::msg::Target &target,
+                      const double from,
+                      HitSchedule &schedule) const noexcept;
+
+  // Aims of the gimbal every setpoints_step_ from the solving time, at the armor idx or at the
+  // center if idx < 0. offset is the manual compensation (yaw, pitch) of the command
+  void planSetpoints(const rm_interfaces::msg::Target &target,
+                     const double time_since_stamp,
+                     const int idx,
+                     const double extra_delay,
+                     const Eigen::Vector2d &offset,
+                     rm_interfaces::msg::GimbalCmd &gimbal_cmd) const;
 
   void calcYawAndPitch(const Eigen::Vector3d &p,
                        const std::array<double, 3> rpy,
@@ -82,6 +153,9 @@ private:
 
   std::unique_ptr<TrajectoryCompensator> trajectory_compensator_;
   std::unique_ptr<ManualCompensator> manual_compensator_;
+  // nullptr if the estimation is disabled
+  std::unique_ptr<BulletSpeedEstimator> bullet_speed_estimator_;
+  double bullet_speed_deadband_;
 
   std::array<double, 3> rpy_;
 
@@ -98,6 +172,17 @@ private:
   double side_angle_;
   double min_switching_v_yaw_;
 
+  // Fire planner
+  bool fire_planner_enable_;
+  double fire_planner_horizon_;
+  double fire_planner_step_;
+  double gimbal_lag_;
+  double max_view_angle_;
+
+  // Setpoint horizon sent with the command, none if setpoints_num_ is 0
+  int setpoints_num_;
+  double setpoints_step_;
+
   std::weak_ptr<rclcpp::Node> node_;
 };
 }  // namespace fyt::auto_aim
@@ -31,16 +31,25 @@
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
 #include <visualization_msgs/msg/marker_array.hpp>
 // std
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 // project
 #include "armor_solver/armor_solver.hpp"
 #include "armor_solver/armor_tracker.hpp"
+#include "armor_solver/tracker_bank.hpp"
 #include "rm_interfaces/msg/armors.hpp"
 #include "rm_interfaces/msg/measurement.hpp"
+#include "rm_interfaces/msg/serial_receive_data.hpp"
 #include "rm_interfaces/msg/target.hpp"
 #include "rm_interfaces/srv/set_mode.hpp"
+#include "rm_utils/attitude_cache.hpp"
 #include "rm_utils/heartbeat.hpp"
 #include "rm_utils/logger/log.hpp"
 
@@ -49,14 +58,50 @@ using tf2_filter = tf2_ros::MessageFilter<rm_interfaces::msg::Armors>;
 class ArmorSolverNode : public rclcpp::Node {
 public:
   explicit ArmorSolverNode(const rclcpp::NodeOptions &options);
+  ~ArmorSolverNode() override;
 
 private:
   void armorsCallback(const rm_interfaces::msg::Armors::SharedPtr armors_ptr);
 
+  // Transform the armors to target_frame_, return false if the transform is not available
+  bool transformArmors(rm_interfaces::msg::Armors &armors_msg) noexcept;
+  // Cache the static gimbal_link to camera_frame transform of every camera,
+  // nullptr if the transform is not available yet
+  struct GimbalToCamera {
+    Eigen::Quaterniond q;
+    Eigen::Vector3d t;
+  };
+  const GimbalToCamera *lookupGimbalToCamera(const std::string &camera_frame) noexcept;
+
   void initMarkers() noexcept;
 
-  void publishMarkers(const rm_interfaces::msg::Target &target_msg,
-                      const rm_interfaces::msg::GimbalCmd &gimbal_cmd) noexcept;
+  // Everything the markers are built from, copied so that the markers are built and published
+  // in marker_thread_, off the thread that solves the gimbal commands
+  struct MarkerFrame {
+    rm_interfaces::msg::Target target;
+    rm_interfaces::msg::GimbalCmd gimbal_cmd;
+    bool small_armor = false;
+    std::vector<std::pair<double, double>> trajectory;
+  };
+  // Keep the frame as the next to publish, replacing one not published yet
+  void pushMarkerFrame(MarkerFrame &&frame);
+  void markerLoop();
+  void publishMarkers(const MarkerFrame &frame) noexcept;
+
+  // A debug topic is published at most at its rate, and only while somebody subscribes
+  struct DebugRate {
+    int64_t min_interval_ns = 0;
+    int64_t last_ns = 0;
+    bool ready(int64_t now_ns) noexcept {
+      if (now_ns - last_ns < min_interval_ns) {
+        return false;
+      }
+      last_ns = now_ns;
+      return true;
+    }
+  };
+  DebugRate measurement_rate_;
+  DebugRate marker_rate_;
 
 
   void setModeCallback(const std::shared_ptr<rm_interfaces::srv::SetMode::Request> request,
@@ -66,6 +111,12 @@ private:
 
   // Heartbeat
   HeartBeatPublisher::SharedPtr heartbeat_;
+  // Metrics reported with the heartbeat, registered at the end of the constructor
+  utils::LatencyHistogram *track_latency_ = nullptr;
+  utils::LatencyHistogram *solve_latency_ = nullptr;
+  utils::LatencyHistogram *end_to_end_latency_ = nullptr;
+  std::atomic<int64_t> *late_frames_ = nullptr;
+  std::atomic<int64_t> *solver_errors_ = nullptr;
 
   // The time when the last message was received
   rclcpp::Time last_time_;
@@ -75,7 +126,7 @@ private:
   double s2qx_, s2qy_, s2qz_, s2qyaw_, s2qr_, s2qd_zc_;
   double r_x_, r_y_, r_z_, r_yaw_;
   double lost_time_thres_;
-  std::unique_ptr<Tracker> tracker_;
+  std::unique_ptr<TrackerBank> tracker_bank_;
 
   // Armor Solver
   std::unique_ptr<Solver> solver_;
@@ -88,6 +139,16 @@ private:
   rm_interfaces::msg::Target armor_target_;
   std::shared_ptr<tf2_filter> tf2_filter_;
 
+  // Gimbal attitude fed by serial/receive, read by the solver without tf2. The process cache is
+  // used instead if the serial driver runs in this process
+  utils::AttitudeCache<> attitude_cache_;
+  // Subscriber without message_filter, the armors are transformed with attitude_cache_
+  bool use_attitude_cache_;
+  rclcpp::Subscription<rm_interfaces::msg::Armors>::SharedPtr armors_direct_sub_;
+  // Static gimbal to camera transforms, one per camera frame of the armors
+  std::unordered_map<std::string, GimbalToCamera> gimbal_to_camera_;
+  rclcpp::Subscription<rm_interfaces::msg::SerialReceiveData>::SharedPtr serial_receive_sub_;
+
   // Measurement publisher
   rclcpp::Publisher<rm_interfaces::msg::Measurement>::SharedPtr measure_pub_;
 
@@ -96,6 +157,12 @@ private:
   rclcpp::Publisher<rm_interfaces::msg::GimbalCmd>::SharedPtr gimbal_pub_;
   rclcpp::TimerBase::SharedPtr pub_timer_;
   void timerCallback();
+  // Solve and publish the gimbal command
+  void publishGimbalCmd();
+  bool event_driven_;
+  int64_t min_publish_interval_ns_;
+  int64_t last_publish_ns_ = 0;
+  double transmit_delay_;
   
   // Enable/Disable Armor Solver
   bool enable_;
@@ -109,6 +176,12 @@ private:
   visualization_msgs::msg::Marker armors_marker_;
   visualization_msgs::msg::Marker selection_marker_;
   rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr marker_pub_;
+  std::thread marker_thread_;
+  std::mutex marker_mutex_;
+  std::condition_variable marker_cv_;
+  MarkerFrame marker_frame_;
+  bool has_marker_frame_ = false;
+  bool marker_running_ = true;
 };
 
 }  // namespace fyt::auto_aim
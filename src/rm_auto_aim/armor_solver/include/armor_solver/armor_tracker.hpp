@@ -21,8 +21,10 @@
 #define ARMOR_SOLVER_TRACKER_HPP_
 
 // std
+#include <array>
 #include <memory>
 #include <string>
+#include <vector>
 // ros2
 #include <geometry_msgs/msg/point.hpp>
 #include <geometry_msgs/msg/quaternion.hpp>
@@ -32,8 +34,10 @@
 // project
 #include "rm_interfaces/msg/armors.hpp"
 #include "rm_interfaces/msg/target.hpp"
+#include "rm_utils/armor_number.hpp"
 #include "rm_utils/math/extended_kalman_filter.hpp"
 #include "armor_solver/motion_model.hpp"
+#include "armor_solver/outpost_filter.hpp"
 
 namespace fyt::auto_aim {
 
@@ -46,9 +50,27 @@ public:
   using Armors = rm_interfaces::msg::Armors;
   using Armor = rm_interfaces::msg::Armor;
 
-  void init(const Armors::SharedPtr &armors_msg) noexcept;
+  // Start tracking the robot of armor, stamp: time of the armor (s)
+  void init(const Armor &armor, double stamp) noexcept;
 
-  void update(const Armors::SharedPtr &armors_msg) noexcept;
+  // armors: the armors detected in this frame that carry tracked_id
+  // stamp: time of the frame (s)
+  void update(const std::vector<const Armor *> &armors, double stamp) noexcept;
+
+  // The steps of update() around the EKF update, for TrackerBank to run the EKFs of the tracks
+  // as a batch. After ekf->predict(): match the armors against the prediction, an armor jump
+  // is folded in here. Return: true if `measurement` is to be fused by the EKF update
+  bool matchArmors(const std::vector<const Armor *> &armors, bool &matched, bool &jumped) noexcept;
+  // After the EKF update (target_state set): the tracking state and the history
+  void finishUpdate(double stamp, bool matched, bool jumped) noexcept;
+
+  // Fold in the armors of a frame older than the last update (out-of-sequence): restore the
+  // stored posterior before it and replay only the frames since then.
+  // process_noise: noise of the filters, dt is overwritten
+  // Return: false if the frame is older than the history or no armor matches
+  bool updateDelayed(const std::vector<const Armor *> &armors,
+                     double stamp,
+                     const ProcessNoise &process_noise) noexcept;
 
   enum State {
     LOST,
@@ -57,31 +79,96 @@ public:
     TEMP_LOST,
   } tracker_state;
 
-  std::unique_ptr<RobotStateEKF> ekf;
+  std::unique_ptr<RobotStateIMM> ekf;
+  // Motion model of each filter of ekf, set along with their predict functions
+  std::array<MotionModel, IMM_MODEL_N> models;
 
   int tracking_thres;  // frame
   int lost_thres;      // second
+  // Squared Mahalanobis distance of the innovation to accept an armor, chi-square with 4 dof.
+  // 0: gate on max_match_distance and max_match_yaw_diff instead
+  double mahalanobis_gate;
 
   Armor tracked_armor;
-  std::string tracked_id;
+  ArmorNumber tracked_id;
   ArmorsNum tracked_armors_num;
-  Eigen::VectorXd measurement;
-  Eigen::VectorXd target_state;
+  // Fixed size, so that the tracking loop does not allocate
+  RobotStateEKF::MatrixZ1 measurement;
+  RobotStateEKF::MatrixX1 target_state;
 
-  // To store another pair of armors message
+  // The other pair of armors of a 4-armor robot: its radius, and its height above the
+  // current pair (only set for 4 armors)
   double d_za, another_r;
 
-  // To store offset relative to the reference plane
-  double d_zc;
+  // Plate seen now, counted from the plate the track was initialized with. A change of the
+  // plate is a transition of the filter state (yaw by 2 * pi / armors_num, the radius and
+  // height of the other pair swapped in for an odd change of 4 armors) followed by a normal
+  // update, so the covariance stays consistent across the jump
+  int armor_index;
+
+  // Track the outpost by OutpostFilter instead of the EKF. It is TRACKING once the filter has
+  // decided the spin direction, tracking_thres does not apply
+  bool outpost_model;
+  OutpostFilter::Params outpost_params;
 
 private:
+  // Posteriors of the filters after a frame, and the measurement of the frame
+  struct Snapshot {
+    double stamp;
+    std::array<Eigen::Matrix<double, X_N, 1>, IMM_MODEL_N> x;
+    std::array<Eigen::Matrix<double, X_N, X_N>, IMM_MODEL_N> P;
+    Eigen::VectorXd probabilities;
+    Eigen::Matrix<double, X_N, 1> state;
+    bool has_measurement;
+    Eigen::Vector4d z;
+    // The state was set by hand (init, armor jump), it can not be replayed across
+    bool reset;
+  };
+  static constexpr size_t HISTORY_SIZE = 16;
+
+  // z: the measurement of the frame itself, null if there was none
+  void pushSnapshot(double stamp, const Eigen::Vector4d *z, bool reset) noexcept;
+
+  Snapshot &snapshotAt(size_t i) noexcept {
+    return history_[(history_head_ + HISTORY_SIZE - history_size_ + i) % HISTORY_SIZE];
+  }
+
+  bool usesOutpostFilter() const noexcept {
+    return outpost_model && tracked_id == ArmorNumber::OUTPOST;
+  }
+
+  // Return: true if an armor matched the outpost
+  bool updateOutpost(const std::vector<const Armor *> &armors, double stamp) noexcept;
+
+  // Tracking state machine
+  void updateState(bool matched) noexcept;
+
+  // One filter step of a replay
+  void replayStep(double dt, const ProcessNoise &process_noise, const Eigen::Vector4d *z) noexcept;
+
+  // Prevent radius from spreading
+  void limitRadius() noexcept;
+
   void initEKF(const Armor &a) noexcept;
 
-  void handleArmorJump(const Armor &a) noexcept;
+  // Return: true if the armor is folded in as a change of the plate, false if the state is
+  // set by hand from it
+  bool handleArmorJump(const Armor &a) noexcept;
+
+  // Set the yaw from the armor, and the center too if the armor is far from the state
+  void resetToArmor(const Armor &a) noexcept;
+
+  // another_r and d_za from the other pairs of the filters
+  void updateOtherPair() noexcept;
+
+  void updateArmorsNum() noexcept;
 
   double orientationToYaw(const geometry_msgs::msg::Quaternion &q) noexcept;
 
-  static Eigen::Vector3d getArmorPositionFromState(const Eigen::VectorXd &x) noexcept;
+  // Yaw in (-pi, pi]
+  static double getRawYaw(const geometry_msgs::msg::Quaternion &q) noexcept;
+
+  static Eigen::Vector3d getArmorPositionFromState(const RobotStateEKF::MatrixX1 &x) noexcept;
 
   double max_match_distance_;
   double max_match_yaw_diff_;
@@ -90,6 +177,23 @@ private:
   int lost_count_;
 
   double last_yaw_;
+
+  // Radius and height above zc of the pair not seen, with their variances, per filter. They
+  // are swapped with r and d_zc of the state when the seen pair changes
+  struct OtherPair {
+    double r, r_var;
+    double dzc, dzc_var;
+  };
+  std::array<OtherPair, IMM_MODEL_N> other_pairs_;
+
+  OutpostFilter outpost_filter_;
+  // Newest stamp of the outpost filter updates, the state is given at it
+  double outpost_stamp_;
+
+  // Ring buffer of the recent posteriors, for out-of-sequence measurements
+  std::array<Snapshot, HISTORY_SIZE> history_;
+  size_t history_head_ = 0;
+  size_t history_size_ = 0;
 };
 
 }  // namespace fyt::auto_aim
@@ -15,10 +15,13 @@
 #ifndef ARMOR_SOLVER_MOTION_MODEL_HPP_
 #define ARMOR_SOLVER_MOTION_MODEL_HPP_
 
+// std
+#include <cmath>
 // ceres
 #include <ceres/ceres.h>
 // project
 #include "rm_utils/math/extended_kalman_filter.hpp"
+#include "rm_utils/math/interacting_multiple_model.hpp"
 
 namespace fyt::auto_aim {
 
@@ -64,21 +67,135 @@ struct Predict {
     }
   }
 
+  // The process is linear, F only depends on dt and the model
+  void jacobian(const Eigen::Matrix<double, X_N, 1> &,
+                Eigen::Matrix<double, X_N, X_N> &F) const noexcept {
+    F.setIdentity();
+    if (model == MotionModel::CONSTANT_VEL_ROT || model == MotionModel::CONSTANT_VELOCITY) {
+      F(0, 1) = dt;
+      F(2, 3) = dt;
+      F(4, 5) = dt;
+    } else {
+      F(1, 1) = 0;
+      F(3, 3) = 0;
+      F(5, 5) = 0;
+    }
+    if (model == MotionModel::CONSTANT_VEL_ROT || model == MotionModel::CONSTANT_ROTATION) {
+      F(6, 7) = dt;
+    } else {
+      F(7, 7) = 0;
+    }
+  }
+
   double dt;
   MotionModel model;
 };
 
 struct Measure {
   template <typename T>
-  void operator()(const T x[Z_N], T z[Z_N]) {
+  void operator()(const T x[X_N], T z[Z_N]) {
     z[0] = x[0] - ceres::cos(x[6]) * x[8];
     z[1] = x[2] - ceres::sin(x[6]) * x[8];
     z[2] = x[4] + x[9];
     z[3] = x[6];
   }
+
+  void jacobian(const Eigen::Matrix<double, X_N, 1> &x,
+                Eigen::Matrix<double, Z_N, X_N> &H) const noexcept {
+    const double c = std::cos(x[6]), s = std::sin(x[6]);
+    H.setZero();
+    H(0, 0) = 1;
+    H(0, 6) = s * x[8];
+    H(0, 8) = -c;
+    H(1, 2) = 1;
+    H(1, 6) = -c * x[8];
+    H(1, 8) = -s;
+    H(2, 4) = 1;
+    H(2, 9) = 1;
+    H(3, 6) = 1;
+  }
+
+  // z and the nonzero elements of H of K states at once, for BatchedKalmanFilter
+  template <int K, typename T>
+  static void lanes(const T (&x)[X_N][K], T (&z)[Z_N][K], T (&H)[Z_N][X_N][K]) noexcept {
+    for (int k = 0; k < K; k++) {
+      const T c = std::cos(x[6][k]), s = std::sin(x[6][k]);
+      z[0][k] = x[0][k] - c * x[8][k];
+      z[1][k] = x[2][k] - s * x[8][k];
+      z[2][k] = x[4][k] + x[9][k];
+      z[3][k] = x[6][k];
+      H[0][0][k] = 1;
+      H[0][6][k] = s * x[8][k];
+      H[0][8][k] = -c;
+      H[1][2][k] = 1;
+      H[1][6][k] = -c * x[8][k];
+      H[1][8][k] = -s;
+      H[2][4][k] = 1;
+      H[2][9][k] = 1;
+      H[3][6][k] = 1;
+    }
+  }
+};
+
+// Process noise, piecewise white acceleration of each pair of position and velocity
+struct ProcessNoise {
+  Eigen::Matrix<double, X_N, X_N> operator()() const noexcept {
+    Eigen::Matrix<double, X_N, X_N> q;
+    double t = dt, x = s2q_x, y = s2q_y, z = s2q_z, yaw = s2q_yaw, r = s2q_r, d_zc = s2q_d_zc;
+    double q_x_x = pow(t, 4) / 4 * x, q_x_vx = pow(t, 3) / 2 * x, q_vx_vx = pow(t, 2) * x;
+    double q_y_y = pow(t, 4) / 4 * y, q_y_vy = pow(t, 3) / 2 * y, q_vy_vy = pow(t, 2) * y;
+    double q_z_z = pow(t, 4) / 4 * x, q_z_vz = pow(t, 3) / 2 * x, q_vz_vz = pow(t, 2) * z;
+    double q_yaw_yaw = pow(t, 4) / 4 * yaw, q_yaw_vyaw = pow(t, 3) / 2 * x,
+           q_vyaw_vyaw = pow(t, 2) * yaw;
+    double q_r = pow(t, 4) / 4 * r;
+    double q_d_zc = pow(t, 4) / 4 * d_zc;
+    // clang-format off
+    //    xc      v_xc    yc      v_yc    zc      v_zc    yaw         v_yaw       r       d_za
+    q <<  q_x_x,  q_x_vx, 0,      0,      0,      0,      0,          0,          0,      0,
+          q_x_vx, q_vx_vx,0,      0,      0,      0,      0,          0,          0,      0,
+          0,      0,      q_y_y,  q_y_vy, 0,      0,      0,          0,          0,      0,
+          0,      0,      q_y_vy, q_vy_vy,0,      0,      0,          0,          0,      0,
+          0,      0,      0,      0,      q_z_z,  q_z_vz, 0,          0,          0,      0,
+          0,      0,      0,      0,      q_z_vz, q_vz_vz,0,          0,          0,      0,
+          0,      0,      0,      0,      0,      0,      q_yaw_yaw,  q_yaw_vyaw, 0,      0,
+          0,      0,      0,      0,      0,      0,      q_yaw_vyaw, q_vyaw_vyaw,0,      0,
+          0,      0,      0,      0,      0,      0,      0,          0,          q_r,    0,
+          0,      0,      0,      0,      0,      0,      0,          0,          0,      q_d_zc;
+    // clang-format on
+    return q;
+  }
+
+  double dt;
+  double s2q_x, s2q_y, s2q_z, s2q_yaw, s2q_r, s2q_d_zc;
+};
+
+// Measurement noise, the position noise grows with the distance
+struct MeasurementNoise {
+  Eigen::Matrix<double, Z_N, Z_N> operator()(
+    const Eigen::Matrix<double, Z_N, 1> &z) const noexcept {
+    Eigen::Matrix<double, Z_N, Z_N> r;
+    // clang-format off
+    r << r_x * std::abs(z[0]), 0, 0, 0,
+         0, r_y * std::abs(z[1]), 0, 0,
+         0, 0, r_z * std::abs(z[2]), 0,
+         0, 0, 0, r_yaw;
+    // clang-format on
+    return r;
+  }
+
+  double r_x, r_y, r_z, r_yaw;
 };
 
-using RobotStateEKF = ExtendedKalmanFilter<X_N, Z_N, Predict, Measure>;
+using RobotStateEKF =
+  ExtendedKalmanFilter<X_N, Z_N, Predict, Measure, ProcessNoise, MeasurementNoise>;
+
+// One EKF per motion model, or a single CONSTANT_VEL_ROT EKF if the IMM is disabled
+using RobotStateIMM = InteractingMultipleModel<RobotStateEKF>;
+
+// Models of the IMM, in the order of Target.model_probabilities
+constexpr MotionModel IMM_MODELS[] = {
+  MotionModel::CONSTANT_VELOCITY, MotionModel::CONSTANT_ROTATION, MotionModel::CONSTANT_VEL_ROT};
+constexpr int IMM_MODEL_N = 3;
 
 }  // namespace fyt::auto_aim
 #endif
@@ -0,0 +1,97 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_SOLVER_OUTPOST_FILTER_HPP_
+#define ARMOR_SOLVER_OUTPOST_FILTER_HPP_
+
+// std
+#include <cmath>
+// third party
+#include <Eigen/Dense>
+// project
+#include "armor_solver/motion_model.hpp"
+
+namespace fyt::auto_aim {
+// Dedicated model of the outpost: 3 armors at one height and radius around a fixed center,
+// spinning at the speed fixed by the rules in an unknown direction. The state is the center, the
+// phase (the yaw folded to one plate) and the spin direction, estimated in closed form with
+// exponential forgetting: the phase is fit by a line over time, whose slope picks the direction
+// among -v_yaw, 0 and v_yaw; the center is the mean of the centers seen by each armor. Late
+// measurements are folded in with their age, the fit does not depend on the order
+class OutpostFilter {
+public:
+  struct Params {
+    // Rotation speed, rad/s
+    double v_yaw = 0.8 * M_PI;
+    double radius = 0.2765;
+    // Time constant of the forgetting, s
+    double memory = 1.0;
+    // Standard deviation of the measured yaw, rad
+    double yaw_noise = 0.05;
+    // Frames before the direction may be decided
+    int min_frames = 3;
+  };
+
+  static constexpr int ARMORS_NUM = 3;
+
+  // yaw: continuous yaw of the armor, stamp: s
+  void init(const Params &params, const Eigen::Vector3d &position, double yaw, double stamp);
+
+  // Fold in an armor, stamp may be older than the last one
+  void update(const Eigen::Vector3d &position, double yaw, double stamp);
+
+  // Center of the outpost if the armor is one of its plates
+  Eigen::Vector3d centerOf(const Eigen::Vector3d &position, double yaw) const noexcept;
+
+  Eigen::Vector3d center() const noexcept;
+
+  // The direction is decided: min_frames seen and the slope of the phase known to a quarter
+  // of v_yaw, i.e. two standard deviations from the other directions
+  bool converged() const noexcept { return converged_; }
+
+  // -1, 0 (not spinning) or 1, only meaningful if converged
+  int spin() const noexcept { return spin_; }
+
+  // v_yaw of the direction if converged, the free slope of the phase otherwise
+  double vYaw() const noexcept;
+
+  // Continuous yaw of the plate of the last armor at stamp
+  double yaw(double stamp) const noexcept;
+
+  // State in the layout of the EKF: xc, v_xc, yc, v_yc, zc, v_zc, yaw, v_yaw, r, d_zc
+  Eigen::Matrix<double, X_N, 1> state(double stamp) const noexcept;
+
+private:
+  double phase(double stamp) const noexcept;
+  // Fold the angle to (-step / 2, step / 2], step being the angle between two plates
+  static double foldToPlate(double angle) noexcept;
+  // Move the time origin to keep the sums of t and t^2 small
+  void shiftOrigin(double t) noexcept;
+
+  Params params_;
+  // Time origin and last stamp, s
+  double origin_ = 0;
+  double last_stamp_ = 0;
+  // Weighted sums of 1, t, t^2, phase, t * phase, and the centers
+  double s0_ = 0, st_ = 0, stt_ = 0, sy_ = 0, sty_ = 0;
+  Eigen::Vector3d sc_ = Eigen::Vector3d::Zero();
+  // Yaw of the plate of the last armor minus the phase, a multiple of the plate step
+  double plate_offset_ = 0;
+  int frames_ = 0;
+  int spin_ = 0;
+  bool converged_ = false;
+};
+}  // namespace fyt::auto_aim
+
+#endif  // ARMOR_SOLVER_OUTPOST_FILTER_HPP_
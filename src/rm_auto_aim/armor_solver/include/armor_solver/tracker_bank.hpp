@@ -0,0 +1,108 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ARMOR_SOLVER_TRACKER_BANK_HPP_
+#define ARMOR_SOLVER_TRACKER_BANK_HPP_
+
+// std
+#include <vector>
+// project
+#include "armor_solver/armor_tracker.hpp"
+#include "armor_solver/motion_model.hpp"
+#include "rm_interfaces/msg/armors.hpp"
+#include "rm_utils/math/batched_kalman_filter.hpp"
+
+namespace fyt::auto_aim {
+// Fixed pool of trackers, one per robot id. Every robot in sight keeps its own EKF warm,
+// so switching the target to another robot does not need to wait for a new EKF to converge
+class TrackerBank {
+public:
+  using Armors = rm_interfaces::msg::Armors;
+  using Armor = rm_interfaces::msg::Armor;
+
+  // ekf: prototype copied into every track
+  TrackerBank(int capacity,
+              double max_match_distance,
+              double max_match_yaw_diff,
+              int tracking_thres,
+              const RobotStateIMM &ekf);
+
+  // Associate the armors with the tracks by id, update every live track and start a track
+  // for each new id. dt: time since the last update
+  void update(const Armors::SharedPtr &armors_msg, double dt) noexcept;
+
+  // Fold the armors of a late frame into the live tracks, delay: time from the frame to the
+  // last update
+  void updateDelayed(const Armors::SharedPtr &armors_msg, double delay) noexcept;
+
+  // Squared Mahalanobis gate of every track, 0 for the distance and yaw gates
+  void setMahalanobisGate(double gate) noexcept;
+
+  // Track the outpost by OutpostFilter instead of the EKF, see Tracker::outpost_model
+  void setOutpostModel(bool enable, const OutpostFilter::Params &params) noexcept;
+
+  // Run the EKFs of the tracks with a single CONSTANT_VEL_ROT filter (IMM disabled) as one
+  // batch per frame instead of one by one, the results are the same up to the rounding
+  void setBatchedEKF(bool enable) noexcept { batched_ekf_ = enable; }
+  // Run the batch in float, twice the lanes per vector instruction. The states are exchanged
+  // in double, each frame rounds them to float once
+  void setSinglePrecision(bool enable) noexcept { single_precision_ = enable; }
+
+  // The track to aim at, nullptr if there is no live track
+  const Tracker *target() const noexcept;
+
+  // True if no track is alive
+  bool empty() const noexcept;
+
+  // dt is set by update()
+  ProcessNoise process_noise;
+  double lost_time_thres;
+
+private:
+  // Index of the live (or just created) track of the id, -1 if none
+  int findTrack(ArmorNumber id) const noexcept;
+  // Index of a free track, -1 if the pool is full
+  int findFreeTrack() const noexcept;
+
+  // Keep the current target while it is tracked, otherwise switch to the tracked robot
+  // closest to the image center
+  void selectTarget() noexcept;
+
+  static constexpr int BATCH_LANES = 8;
+  using RobotStateBatch = BatchedKalmanFilter<X_N, Z_N, BATCH_LANES>;
+  using RobotStateBatchF = BatchedKalmanFilter<X_N, Z_N, BATCH_LANES, float>;
+
+  // Predict, match and update the tracks as a batch, at most BATCH_LANES
+  template <class Batch>
+  void updateBatch(Batch &batch, const int *indices, int n) noexcept;
+
+  std::vector<Tracker> tracks_;
+  // Per track armors of this frame, reused between frames
+  std::vector<std::vector<const Armor *>> candidates_;
+  // Tracks created in this frame, char instead of bool for a plain vector
+  std::vector<char> created_;
+  // Sum of dt, the time base of the track histories
+  double time_;
+  int target_;
+
+  bool batched_ekf_;
+  bool single_precision_;
+  // Tracks of this frame run in the batch
+  std::vector<int> batched_;
+  RobotStateBatch batch_;
+  RobotStateBatchF batch_f_;
+};
+}  // namespace fyt::auto_aim
+
+#endif  // ARMOR_SOLVER_TRACKER_BANK_HPP_
@@ -16,11 +16,14 @@
 
 #include "armor_solver/armor_solver.hpp"
 // std
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <limits>
 #include <stdexcept>
 // project
 #include "armor_solver/armor_solver_node.hpp"
+#include "rm_utils/armor_number.hpp"
 #include "rm_utils/logger/log.hpp"
 #include "rm_utils/math/utils.hpp"
 
@@ -36,12 +39,32 @@ Solver::Solver(std::weak_ptr<rclcpp::Node> n) : node_(n) {
   side_angle_ = node->declare_parameter("solver.side_angle", 15.0);
   min_switching_v_yaw_ = node->declare_parameter("solver.min_switching_v_yaw", 1.0);
 
+  fire_planner_enable_ = node->declare_parameter("solver.fire_planner.enable", false);
+  fire_planner_horizon_ = node->declare_parameter("solver.fire_planner.horizon", 0.15);
+  fire_planner_step_ = node->declare_parameter("solver.fire_planner.step", 0.005);
+  gimbal_lag_ = node->declare_parameter("solver.fire_planner.gimbal_lag", 0.03);
+  max_view_angle_ =
+    node->declare_parameter("solver.fire_planner.max_view_angle", 45.0) / 180.0 * M_PI;
+
+  setpoints_num_ = std::max<int64_t>(node->declare_parameter("solver.setpoints.num", 0), 0);
+  setpoints_step_ = node->declare_parameter("solver.setpoints.step", 0.02);
+
   std::string compenstator_type = node->declare_parameter("solver.compensator_type", "ideal");
   trajectory_compensator_ = CompensatorFactory::createCompensator(compenstator_type);
   trajectory_compensator_->iteration_times = node->declare_parameter("solver.iteration_times", 20);
   trajectory_compensator_->velocity = node->declare_parameter("solver.bullet_speed", 20.0);
   trajectory_compensator_->gravity = node->declare_parameter("solver.gravity", 9.8);
   trajectory_compensator_->resistance = node->declare_parameter("solver.resistance", 0.001);
+  trajectory_compensator_->buildTable();
+
+  if (node->declare_parameter("solver.bullet_speed_estimation.enable", false)) {
+    bullet_speed_estimator_ = std::make_unique<BulletSpeedEstimator>(
+      trajectory_compensator_->velocity,
+      node->declare_parameter("solver.bullet_speed_estimation.window_size", 10),
+      node->declare_parameter("solver.bullet_speed_estimation.min_speed", 10.0),
+      node->declare_parameter("solver.bullet_speed_estimation.max_speed", 35.0));
+  }
+  bullet_speed_deadband_ = node->declare_parameter("solver.bullet_speed_estimation.deadband", 0.1);
 
   manual_compensator_ = std::make_unique<ManualCompensator>();
   auto angle_offset = node->declare_parameter("solver.angle_offset", std::vector<std::string>{});
@@ -53,57 +76,113 @@ Solver::Solver(std::weak_ptr<rclcpp::Node> n) : node_(n) {
   overflow_count_ = 0;
   transfer_thresh_ = 5;
 
+  // Cache the tunable parameters instead of reading them on every solve()
+  param_callback_handle_ = node->add_on_set_parameters_callback(
+    std::bind(&Solver::onSetParameters, this, std::placeholders::_1));
+
   node.reset();
 }
 
-rm_interfaces::msg::GimbalCmd Solver::solve(const rm_interfaces::msg::Target &target,
-                                            const rclcpp::Time &current_time,
-                                            std::shared_ptr<tf2_ros::Buffer> tf2_buffer_) {
-  // Get newest parameters
-  try {
-    auto node = node_.lock();
-    max_tracking_v_yaw_ = node->get_parameter("solver.max_tracking_v_yaw").as_double();
-    prediction_delay_ = node->get_parameter("solver.prediction_delay").as_double();
-    controller_delay_ = node->get_parameter("solver.controller_delay").as_double();
-    side_angle_ = node->get_parameter("solver.side_angle").as_double();
-    min_switching_v_yaw_ = node->get_parameter("solver.min_switching_v_yaw").as_double();
-    node.reset();
-  } catch (const std::runtime_error &e) {
-    FYT_ERROR("armor_solver", "{}", e.what());
+void Solver::updateBulletSpeed(double measured_speed) {
+  if (bullet_speed_estimator_ == nullptr || !bullet_speed_estimator_->update(measured_speed)) {
+    return;
   }
+  double speed = bullet_speed_estimator_->estimate();
+  // Small changes are not worth rebuilding the ballistic table
+  if (std::abs(speed - trajectory_compensator_->velocity) < bullet_speed_deadband_) {
+    return;
+  }
+  FYT_DEBUG("armor_solver",
+            "Bullet speed {:.2f} -> {:.2f} m/s",
+            trajectory_compensator_->velocity,
+            speed);
+  trajectory_compensator_->velocity = speed;
+  trajectory_compensator_->buildTable();
+}
 
-  // Get current roll, yaw and pitch of gimbal
-  try {
-    auto gimbal_tf =
-      tf2_buffer_->lookupTransform(target.header.frame_id, "gimbal_link", tf2::TimePointZero);
-    auto msg_q = gimbal_tf.transform.rotation;
+rcl_interfaces::msg::SetParametersResult Solver::onSetParameters(
+  const std::vector<rclcpp::Parameter> &parameters) {
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+  for (const auto &param : parameters) {
+    if (param.get_type() != rclcpp::ParameterType::PARAMETER_DOUBLE) {
+      continue;
+    }
+    if (param.get_name() == "solver.max_tracking_v_yaw") {
+      max_tracking_v_yaw_ = param.as_double();
+    } else if (param.get_name() == "solver.prediction_delay") {
+      prediction_delay_ = param.as_double();
+    } else if (param.get_name() == "solver.controller_delay") {
+      controller_delay_ = param.as_double();
+    } else if (param.get_name() == "solver.side_angle") {
+      side_angle_ = param.as_double();
+    } else if (param.get_name() == "solver.min_switching_v_yaw") {
+      min_switching_v_yaw_ = param.as_double();
+    } else if (param.get_name() == "solver.bullet_speed") {
+      trajectory_compensator_->velocity = param.as_double();
+    } else if (param.get_name() == "solver.gravity") {
+      trajectory_compensator_->gravity = param.as_double();
+    } else if (param.get_name() == "solver.resistance") {
+      trajectory_compensator_->resistance = param.as_double();
+    }
+  }
+  // The ballistic table depends on the bullet speed, gravity and resistance
+  if (!trajectory_compensator_->tableValid()) {
+    trajectory_compensator_->buildTable();
+  }
+  return result;
+}
 
-    tf2::Quaternion tf_q;
-    tf2::fromMsg(msg_q, tf_q);
+rm_interfaces::msg::GimbalCmd Solver::solve(const rm_interfaces::msg::Target &target,
+                                            const rclcpp::Time &current_time,
+                                            std::shared_ptr<tf2_ros::Buffer> tf2_buffer_,
+                                            const utils::AttitudeCache<> *attitude_cache) {
+  // Get current roll, yaw and pitch of gimbal
+  utils::AttitudeCache<>::Sample attitude;
+  if (attitude_cache != nullptr && attitude_cache->latest(attitude) &&
+      current_time.nanoseconds() - attitude.stamp_ns < MAX_ATTITUDE_AGE_NS) {
+    tf2::Quaternion tf_q(attitude.q.x(), attitude.q.y(), attitude.q.z(), attitude.q.w());
     tf2::Matrix3x3(tf_q).getRPY(rpy_[0], rpy_[1], rpy_[2]);
     rpy_[1] = -rpy_[1];
-  } catch (tf2::TransformException &ex) {
-    FYT_ERROR("armor_solver", "{}", ex.what());
-    throw ex;
+  } else {
+    try {
+      auto gimbal_tf =
+        tf2_buffer_->lookupTransform(target.header.frame_id, "gimbal_link", tf2::TimePointZero);
+      auto msg_q = gimbal_tf.transform.rotation;
+
+      tf2::Quaternion tf_q;
+      tf2::fromMsg(msg_q, tf_q);
+      tf2::Matrix3x3(tf_q).getRPY(rpy_[0], rpy_[1], rpy_[2]);
+      rpy_[1] = -rpy_[1];
+    } catch (tf2::TransformException &ex) {
+      FYT_ERROR("armor_solver", "{}", ex.what());
+      throw ex;
+    }
   }
 
   // Use flying time to approximately predict the position of target
   Eigen::Vector3d target_position(target.position.x, target.position.y, target.position.z);
   double target_yaw = target.yaw;
   double flying_time = trajectory_compensator_->getFlyingTime(target_position);
-  double dt =
-    (current_time - rclcpp::Time(target.header.stamp)).seconds() + flying_time + prediction_delay_;
+  double time_since_stamp = (current_time - rclcpp::Time(target.header.stamp)).seconds();
+  double dt = time_since_stamp + flying_time + prediction_delay_;
   target_position.x() += dt * target.velocity.x;
   target_position.y() += dt * target.velocity.y;
   target_position.z() += dt * target.velocity.z;
   target_yaw += dt * target.v_yaw;
 
   // Choose the best armor to shoot
-  std::vector<Eigen::Vector3d> armor_positions = getArmorPositions(
-    target_position, target_yaw, target.radius_1, target.radius_2, target.d_zc, target.d_za, target.armors_num);
-  int idx =
-    selectBestArmor(armor_positions, target_position, target_yaw, target.v_yaw, target.armors_num);
-  auto chosen_armor_position = armor_positions.at(idx);
+  ArmorCandidates candidates;
+  getArmorCandidates(target_position,
+                     target_yaw,
+                     target.radius_1,
+                     target.radius_2,
+                     target.d_zc,
+                     target.d_za,
+                     target.armors_num,
+                     candidates);
+  int idx = selectBestArmor(candidates, target.v_yaw);
+  Eigen::Vector3d chosen_armor_position = candidates.positions[idx];
   if (chosen_armor_position.norm() < 0.1) {
     throw std::runtime_error("No valid armor to shoot");
   }
@@ -137,20 +216,39 @@ rm_interfaces::msg::GimbalCmd Solver::solve(const rm_interfaces::msg::Target &ta
         target_position.y() += controller_delay_ * target.velocity.y;
         target_position.z() += controller_delay_ * target.velocity.z;
         target_yaw += controller_delay_ * target.v_yaw;
-        armor_positions = getArmorPositions(target_position,
-                                            target_yaw,
-                                            target.radius_1,
-                                            target.radius_2,
-                                            target.d_zc,
-                                            target.d_za,
-                                            target.armors_num);
-        chosen_armor_position = armor_positions.at(idx);
+        getArmorCandidates(target_position,
+                           target_yaw,
+                           target.radius_1,
+                           target.radius_2,
+                           target.d_zc,
+                           target.d_za,
+                           target.armors_num,
+                           candidates);
+        chosen_armor_position = candidates.positions[idx];
         gimbal_cmd.distance = chosen_armor_position.norm();
         if (chosen_armor_position.norm() < 0.1) {
           throw std::runtime_error("No valid armor to shoot");
         }
         calcYawAndPitch(chosen_armor_position, rpy_, yaw, pitch);
       }
+
+      if (fire_planner_enable_) {
+        // The outpost spins at a known speed around a fixed center, its windows are exact
+        const bool outpost =
+          target.id == static_cast<uint8_t>(ArmorNumber::OUTPOST) && target.armors_num == 3;
+        bool has_window = outpost ? planOutpostFireWindow(target,
+                                                          time_since_stamp,
+                                                          idx,
+                                                          gimbal_cmd.fire_window_start,
+                                                          gimbal_cmd.fire_window_end)
+                                  : planFireWindow(target,
+                                                   time_since_stamp,
+                                                   idx,
+                                                   gimbal_cmd.fire_window_start,
+                                                   gimbal_cmd.fire_window_end);
+        // Only fire if the window is open right now
+        gimbal_cmd.fire_advice = has_window && gimbal_cmd.fire_window_start == 0;
+      }
       break;
     }
     case TRACKING_CENTER: {
@@ -185,12 +283,192 @@ rm_interfaces::msg::GimbalCmd Solver::solve(const rm_interfaces::msg::Target &ta
   gimbal_cmd.yaw_diff = (cmd_yaw - rpy_[2]) * 180 / M_PI;
   gimbal_cmd.pitch_diff = (cmd_pitch - rpy_[1]) * 180 / M_PI;
 
+  if (setpoints_num_ > 0) {
+    planSetpoints(target,
+                  time_since_stamp,
+                  state == TRACKING_ARMOR ? idx : -1,
+                  state == TRACKING_ARMOR ? controller_delay_ : 0.0,
+                  Eigen::Vector2d(yaw_offset, pitch_offset),
+                  gimbal_cmd);
+  }
+
   if (gimbal_cmd.fire_advice) {
     FYT_DEBUG("armor_solver", "You Need Fire!");
   }
   return gimbal_cmd;
 }
 
+bool Solver::planFireWindow(const rm_interfaces::msg::Target &target,
+                            const double time_since_stamp,
+                            const int idx,
+                            double &window_start,
+                            double &window_end) const {
+  window_start = window_end = -1;
+  if (fire_planner_step_ <= 0) {
+    return false;
+  }
+
+  const Eigen::Vector3d position(target.position.x, target.position.y, target.position.z);
+  const Eigen::Vector3d velocity(target.velocity.x, target.velocity.y, target.velocity.z);
+  const int samples_num = static_cast<int>(fire_planner_horizon_ / fire_planner_step_) + 1;
+  ArmorCandidates candidates;
+  for (int k = 0; k < samples_num; k++) {
+    // Fire at tau, the bullet lands after the flying time
+    const double tau = k * fire_planner_step_;
+    const double fire_dt = time_since_stamp + tau + prediction_delay_;
+    const double dt =
+      fire_dt + trajectory_compensator_->getFlyingTime(position + fire_dt * velocity);
+    getArmorCandidates(position + dt * velocity,
+                       target.yaw + dt * target.v_yaw,
+                       target.radius_1,
+                       target.radius_2,
+                       target.d_zc,
+                       target.d_za,
+                       target.armors_num,
+                       candidates);
+
+    bool hit = selectBestArmor(candidates, target.v_yaw) == idx &&
+               std::abs(candidates.view_angles[idx]) < max_view_angle_;
+    // The gimbal can not follow the command yet, it must be on the armor already. Always
+    // checked now, even without a lag
+    if (hit && (k == 0 || tau < gimbal_lag_)) {
+      double yaw, pitch;
+      calcYawAndPitch(candidates.positions[idx], rpy_, yaw, pitch);
+      hit = isOnTarget(rpy_[2], rpy_[1], yaw, pitch, candidates.positions[idx].norm());
+    }
+
+    if (hit) {
+      if (window_start < 0) {
+        window_start = tau;
+      }
+      window_end = tau;
+    } else if (window_start >= 0) {
+      break;
+    }
+  }
+  return window_start >= 0;
+}
+
+bool Solver::planOutpostFireWindow(const rm_interfaces::msg::Target &target,
+                                   const double time_since_stamp,
+                                   const int idx,
+                                   double &window_start,
+                                   double &window_end) const {
+  window_start = window_end = -1;
+  const Eigen::Vector3d center(target.position.x, target.position.y, target.position.z);
+  // A shot fired at tau lands at offset + tau
+  const double offset =
+    time_since_stamp + prediction_delay_ + trajectory_compensator_->getFlyingTime(center);
+  HitSchedule schedule;
+  getHitSchedule(target, offset, schedule);
+  double start = schedule.start[idx] - offset;
+  const double end = std::min(schedule.end[idx] - offset, fire_planner_horizon_);
+  if (start > fire_planner_horizon_) {
+    return false;
+  }
+
+  // The gimbal can not follow the command yet, it must be on the armor already. Always
+  // checked for a window open now, even without a lag
+  if (start <= 0 || start < gimbal_lag_) {
+    ArmorCandidates candidates;
+    getArmorCandidates(center,
+                       target.yaw + (offset + start) * target.v_yaw,
+                       target.radius_1,
+                       target.radius_2,
+                       target.d_zc,
+                       target.d_za,
+                       target.armors_num,
+                       candidates);
+    double yaw, pitch;
+    calcYawAndPitch(candidates.positions[idx], rpy_, yaw, pitch);
+    if (!isOnTarget(rpy_[2], rpy_[1], yaw, pitch, candidates.positions[idx].norm())) {
+      // Not before the next command without a lag
+      start = std::max(gimbal_lag_, fire_planner_step_);
+    }
+  }
+  if (start > end) {
+    return false;
+  }
+  window_start = start;
+  window_end = end;
+  return true;
+}
+
+void Solver::getHitSchedule(const rm_interfaces::msg::Target &target,
+                            const double from,
+                            HitSchedule &schedule) const noexcept {
+  const size_t armors_num = std::min<size_t>(target.armors_num, MAX_ARMORS_NUM);
+  schedule.armors_num = armors_num;
+  const double alpha = std::atan2(target.position.y, target.position.x);
+  const double step = 2 * M_PI / std::max<size_t>(armors_num, 1);
+  const double speed = std::abs(target.v_yaw);
+  const double m = max_view_angle_;
+  for (size_t i = 0; i < armors_num; i++) {
+    // View angle at `from`, counted in the direction of the spin so that it grows over time
+    double view = angles::normalize_angle(target.yaw + from * target.v_yaw + i * step - alpha);
+    if (target.v_yaw < 0) {
+      view = -view;
+    }
+    if (std::abs(view) < m) {
+      schedule.start[i] = from;
+      schedule.end[i] =
+        speed > 1e-6 ? from + (m - view) / speed : std::numeric_limits<double>::infinity();
+    } else if (speed > 1e-6) {
+      // Turns in once the view angle has grown to -m
+      const double to_start = std::fmod(-m - view + 4 * M_PI, 2 * M_PI);
+      schedule.start[i] = from + to_start / speed;
+      schedule.end[i] = schedule.start[i] + 2 * m / speed;
+    } else {
+      schedule.start[i] = schedule.end[i] = std::numeric_limits<double>::infinity();
+    }
+  }
+}
+
+void Solver::planSetpoints(const rm_interfaces::msg::Target &target,
+                           const double time_since_stamp,
+                           const int idx,
+                           const double extra_delay,
+                           const Eigen::Vector2d &offset,
+                           rm_interfaces::msg::GimbalCmd &gimbal_cmd) const {
+  const Eigen::Vector3d position(target.position.x, target.position.y, target.position.z);
+  const Eigen::Vector3d velocity(target.velocity.x, target.velocity.y, target.velocity.z);
+  // One more sample for the velocity of the last setpoint
+  std::vector<Eigen::Vector2d> aims(setpoints_num_ + 1);
+  ArmorCandidates candidates;
+  for (size_t k = 0; k < aims.size(); k++) {
+    const double aim_dt = time_since_stamp + k * setpoints_step_ + prediction_delay_ + extra_delay;
+    const double dt = aim_dt + trajectory_compensator_->getFlyingTime(position + aim_dt * velocity);
+    Eigen::Vector3d aim_position = position + dt * velocity;
+    // The armor aimed now stays the aimed one over the horizon
+    if (idx >= 0) {
+      getArmorCandidates(aim_position,
+                         target.yaw + dt * target.v_yaw,
+                         target.radius_1,
+                         target.radius_2,
+                         target.d_zc,
+                         target.d_za,
+                         target.armors_num,
+                         candidates);
+      aim_position = candidates.positions[idx];
+    }
+    calcYawAndPitch(aim_position, rpy_, aims[k].x(), aims[k].y());
+    aims[k] += offset;
+  }
+
+  gimbal_cmd.setpoints.resize(setpoints_num_);
+  for (int k = 0; k < setpoints_num_; k++) {
+    auto &setpoint = gimbal_cmd.setpoints[k];
+    setpoint.time = time_since_stamp + k * setpoints_step_;
+    setpoint.yaw = angles::normalize_angle(aims[k].x());
+    setpoint.pitch = aims[k].y();
+    setpoint.yaw_velocity =
+      angles::shortest_angular_distance(aims[k].x(), aims[k + 1].x()) / setpoints_step_;
+  }
+  // The first one is the command itself
+  gimbal_cmd.setpoints[0].yaw = gimbal_cmd.yaw;
+  gimbal_cmd.setpoints[0].pitch = gimbal_cmd.pitch;
+}
+
 bool Solver::isOnTarget(const double cur_yaw,
                         const double cur_pitch,
                         const double target_yaw,
@@ -211,19 +489,30 @@ bool Solver::isOnTarget(const double cur_yaw,
   return false;
 }
 
-std::vector<Eigen::Vector3d> Solver::getArmorPositions(const Eigen::Vector3d &target_center,
-                                                       const double target_yaw,
-                                                       const double r1,
-                                                       const double r2,
-                                                       const double d_zc,
-                                                       const double d_za,
-                                                       const size_t armors_num) const noexcept {
-  auto armor_positions = std::vector<Eigen::Vector3d>(armors_num, Eigen::Vector3d::Zero());
+void Solver::getArmorCandidates(const Eigen::Vector3d &target_center,
+                                const double target_yaw,
+                                const double r1,
+                                const double r2,
+                                const double d_zc,
+                                const double d_za,
+                                const size_t armors_num,
+                                ArmorCandidates &candidates) const {
+  if (armors_num == 0 || armors_num > MAX_ARMORS_NUM) {
+    throw std::runtime_error("Invalid armors_num");
+  }
+  candidates.armors_num = armors_num;
+
+  // Angle between the car's center and the X-axis
+  const double alpha = std::atan2(target_center.y(), target_center.x());
+  const double step = 2 * M_PI / armors_num;
+  const double cos_step = std::cos(step), sin_step = std::sin(step);
+  double cos_yaw = std::cos(target_yaw), sin_yaw = std::sin(target_yaw);
+  double view_angle = angles::normalize_angle(target_yaw - alpha);
+
   // Calculate the position of each armor
   bool is_current_pair = true;
   double r = 0., target_dz = 0.;
   for (size_t i = 0; i < armors_num; i++) {
-    double temp_yaw = target_yaw + i * (2 * M_PI / armors_num);
     if (armors_num == 4) {
       r = is_current_pair ? r1 : r2;
       target_dz = d_zc + (is_current_pair ? 0 : d_za);
@@ -232,34 +521,33 @@ std::vector<Eigen::Vector3d> Solver::getArmorPositions(const Eigen::Vector3d &ta
       r = r1;
       target_dz = d_zc;
     }
-    armor_positions[i] =
-      target_center + Eigen::Vector3d(-r * cos(temp_yaw), -r * sin(temp_yaw), target_dz);
+    candidates.positions[i] =
+      target_center + Eigen::Vector3d(-r * cos_yaw, -r * sin_yaw, target_dz);
+    candidates.view_angles[i] = view_angle;
+    candidates.visible[i] = std::abs(view_angle) < M_PI / 2;
+
+    // Rotate to the next armor
+    const double next_cos = cos_yaw * cos_step - sin_yaw * sin_step;
+    sin_yaw = sin_yaw * cos_step + cos_yaw * sin_step;
+    cos_yaw = next_cos;
+    view_angle += step;
+    if (view_angle > M_PI) {
+      view_angle -= 2 * M_PI;
+    }
   }
-  return armor_positions;
 }
 
-int Solver::selectBestArmor(const std::vector<Eigen::Vector3d> &armor_positions,
-                            const Eigen::Vector3d &target_center,
-                            const double target_yaw,
-                            const double target_v_yaw,
-                            const size_t armors_num) const noexcept {
-  // Angle between the car's center and the X-axis
-  double alpha = std::atan2(target_center.y(), target_center.x());
-  // Angle between the front of observed armor and the X-axis
-  double beta = target_yaw;
-
-  // clang-format off
-  Eigen::Matrix2d R_odom2center;
-  Eigen::Matrix2d R_odom2armor;
-  R_odom2center << std::cos(alpha), std::sin(alpha), 
-                  -std::sin(alpha), std::cos(alpha);
-  R_odom2armor << std::cos(beta), std::sin(beta), 
-                 -std::sin(beta), std::cos(beta);
-  // clang-format on
-  Eigen::Matrix2d R_center2armor = R_odom2center.transpose() * R_odom2armor;
-
-  // Equal to (alpha - beta) in most cases
-  double decision_angle = -std::asin(R_center2armor(0, 1));
+int Solver::selectBestArmor(const ArmorCandidates &candidates,
+                            const double target_v_yaw) const noexcept {
+  const size_t armors_num = candidates.armors_num;
+
+  // (alpha - beta) folded into [-pi / 2, pi / 2], same as asin(sin(alpha - beta))
+  double decision_angle = -candidates.view_angles[0];
+  if (decision_angle > M_PI / 2) {
+    decision_angle = M_PI - decision_angle;
+  } else if (decision_angle < -M_PI / 2) {
+    decision_angle = -M_PI - decision_angle;
+  }
 
   // Angle thresh of the armor jump
   double theta = (target_v_yaw > 0 ? side_angle_ : -side_angle_) / 180.0 * M_PI;
@@ -276,7 +564,7 @@ int Solver::selectBestArmor(const std::vector<Eigen::Vector3d> &armor_positions,
   }
 
   int selected_id = static_cast<int>(temp_angle / (2 * M_PI / armors_num));
-  return selected_id;
+  return std::min(selected_id, static_cast<int>(armors_num) - 1);
 }
 
 void Solver::calcYawAndPitch(const Eigen::Vector3d &p,
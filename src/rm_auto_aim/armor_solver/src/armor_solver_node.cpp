@@ -19,14 +19,31 @@
 #include "armor_solver/armor_solver_node.hpp"
 
 // std
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <vector>
 // project
 #include "armor_solver/motion_model.hpp"
 #include "rm_utils/common.hpp"
+#include "rm_utils/flight_recorder.hpp"
 #include "rm_utils/heartbeat.hpp"
+#include "rm_utils/trace.hpp"
 
 namespace fyt::auto_aim {
+namespace {
+template <typename PublisherT>
+bool hasSubscribers(const PublisherT &publisher) {
+  return publisher->get_subscription_count() + publisher->get_intra_process_subscription_count() >
+         0;
+}
+
+int64_t minInterval(double rate) {
+  // No limit for a rate of 0
+  return rate > 0 ? static_cast<int64_t>(1e9 / rate) : 0;
+}
+}  // namespace
+
 //last cmd data
 auto last_yaw=0.0;
 auto last_pitch=0.0;
@@ -37,14 +54,19 @@ ArmorSolverNode::ArmorSolverNode(const rclcpp::NodeOptions &options)
   FYT_INFO("armor_solver", "Starting ArmorSolverNode!");
 
   debug_mode_ = this->declare_parameter("debug", true);
+  // Maximum rates of the debug topics, in Hz
+  measurement_rate_.min_interval_ns =
+    minInterval(this->declare_parameter("debug_rate.measurement", 100.0));
+  marker_rate_.min_interval_ns = minInterval(this->declare_parameter("debug_rate.marker", 30.0));
 
   
   // Tracker
   double max_match_distance = this->declare_parameter("tracker.max_match_distance", 0.2);
   double max_match_yaw_diff = this->declare_parameter("tracker.max_match_yaw_diff", 1.0);
-  tracker_ = std::make_unique<Tracker>(max_match_distance, max_match_yaw_diff);
-  tracker_->tracking_thres = this->declare_parameter("tracker.tracking_thres", 5);
+  int tracking_thres = this->declare_parameter("tracker.tracking_thres", 5);
   lost_time_thres_ = this->declare_parameter("tracker.lost_time_thres", 0.3);
+  // One track per robot id
+  int max_tracks = this->declare_parameter("tracker.max_tracks", 8);
 
   // EKF
   // xa = x_armor, xc = x_robot_center
@@ -62,51 +84,49 @@ ArmorSolverNode::ArmorSolverNode(const rclcpp::NodeOptions &options)
   s2qr_ = declare_parameter("ekf.sigma2_q_r", 800.0);
   s2qd_zc_ = declare_parameter("ekf.sigma2_q_d_zc", 800.0);
 
-  auto u_q = [this]() {
-    Eigen::Matrix<double, X_N, X_N> q;
-    double t = dt_, x = s2qx_, y = s2qy_, z = s2qz_, yaw = s2qyaw_, r = s2qr_, d_zc=s2qd_zc_;
-    double q_x_x = pow(t, 4) / 4 * x, q_x_vx = pow(t, 3) / 2 * x, q_vx_vx = pow(t, 2) * x;
-    double q_y_y = pow(t, 4) / 4 * y, q_y_vy = pow(t, 3) / 2 * y, q_vy_vy = pow(t, 2) * y;
-    double q_z_z = pow(t, 4) / 4 * x, q_z_vz = pow(t, 3) / 2 * x, q_vz_vz = pow(t, 2) * z;
-    double q_yaw_yaw = pow(t, 4) / 4 * yaw, q_yaw_vyaw = pow(t, 3) / 2 * x,
-           q_vyaw_vyaw = pow(t, 2) * yaw;
-    double q_r = pow(t, 4) / 4 * r;
-    double q_d_zc = pow(t, 4) / 4 * d_zc;
-    // clang-format off
-    //    xc      v_xc    yc      v_yc    zc      v_zc    yaw         v_yaw       r       d_za
-    q <<  q_x_x,  q_x_vx, 0,      0,      0,      0,      0,          0,          0,      0,
-          q_x_vx, q_vx_vx,0,      0,      0,      0,      0,          0,          0,      0,
-          0,      0,      q_y_y,  q_y_vy, 0,      0,      0,          0,          0,      0,
-          0,      0,      q_y_vy, q_vy_vy,0,      0,      0,          0,          0,      0,
-          0,      0,      0,      0,      q_z_z,  q_z_vz, 0,          0,          0,      0,
-          0,      0,      0,      0,      q_z_vz, q_vz_vz,0,          0,          0,      0,
-          0,      0,      0,      0,      0,      0,      q_yaw_yaw,  q_yaw_vyaw, 0,      0,
-          0,      0,      0,      0,      0,      0,      q_yaw_vyaw, q_vyaw_vyaw,0,      0,
-          0,      0,      0,      0,      0,      0,      0,          0,          q_r,    0,
-          0,      0,      0,      0,      0,      0,      0,          0,          0,      q_d_zc;
-
-    // clang-format on
-    return q;
-  };
+  auto u_q = ProcessNoise{0.005, s2qx_, s2qy_, s2qz_, s2qyaw_, s2qr_, s2qd_zc_};
   // update_R - measurement noise covariance matrix
   r_x_ = declare_parameter("ekf.r_x", 0.05);
   r_y_ = declare_parameter("ekf.r_y", 0.05);
   r_z_ = declare_parameter("ekf.r_z", 0.05);
   r_yaw_ = declare_parameter("ekf.r_yaw", 0.02);
-  auto u_r = [this](const Eigen::Matrix<double, Z_N, 1> &z) {
-    Eigen::Matrix<double, Z_N, Z_N> r;
-    // clang-format off
-    r << r_x_ * std::abs(z[0]), 0, 0, 0,
-         0, r_y_ * std::abs(z[1]), 0, 0,
-         0, 0, r_z_ * std::abs(z[2]), 0,
-         0, 0, 0, r_yaw_;
-    // clang-format on
-    return r;
-  };
+  auto u_r = MeasurementNoise{r_x_, r_y_, r_z_, r_yaw_};
   // P - error estimate covariance matrix
   Eigen::DiagonalMatrix<double, X_N> p0;
   p0.setIdentity();
-  tracker_->ekf = std::make_unique<RobotStateEKF>(f, h, u_q, u_r, p0);
+  RobotStateEKF ekf(f, h, u_q, u_r, p0);
+
+  // IMM: run the motion models side by side and mix them by their probabilities
+  bool imm_enable = declare_parameter("ekf.imm.enable", false);
+  double switch_prob = declare_parameter("ekf.imm.switch_prob", 0.05);
+  int models_num = imm_enable ? IMM_MODEL_N : 1;
+  Eigen::MatrixXd transition = Eigen::MatrixXd::Constant(
+    models_num, models_num, models_num > 1 ? switch_prob / (models_num - 1) : 0.0);
+  transition.diagonal().setConstant(models_num > 1 ? 1 - switch_prob : 1.0);
+  RobotStateIMM imm(std::vector<RobotStateEKF>(models_num, ekf),
+                    transition,
+                    Eigen::VectorXd::Constant(models_num, 1.0 / models_num));
+
+  tracker_bank_ = std::make_unique<TrackerBank>(
+    max_tracks, max_match_distance, max_match_yaw_diff, tracking_thres, imm);
+  tracker_bank_->process_noise = u_q;
+  tracker_bank_->lost_time_thres = lost_time_thres_;
+  // Chi-square with 4 dof, 13.28 accepts 99% of the true armors
+  tracker_bank_->setMahalanobisGate(declare_parameter("tracker.mahalanobis_gate", 0.0));
+  // The outpost spins at the speed of the rules, only its direction is unknown
+  OutpostFilter::Params outpost_params;
+  outpost_params.v_yaw = declare_parameter("tracker.outpost.v_yaw", outpost_params.v_yaw);
+  outpost_params.radius = declare_parameter("tracker.outpost.radius", outpost_params.radius);
+  outpost_params.memory = declare_parameter("tracker.outpost.memory", outpost_params.memory);
+  outpost_params.yaw_noise =
+    declare_parameter("tracker.outpost.yaw_noise", outpost_params.yaw_noise);
+  outpost_params.min_frames =
+    declare_parameter("tracker.outpost.min_frames", outpost_params.min_frames);
+  tracker_bank_->setOutpostModel(declare_parameter("tracker.outpost.enable", true),
+                                 outpost_params);
+  // The EKFs of all tracks in one vectorized pass, only without the IMM
+  tracker_bank_->setBatchedEKF(declare_parameter("tracker.batched_ekf", true));
+  tracker_bank_->setSinglePrecision(declare_parameter("tracker.single_precision", false));
 
   // Subscriber with tf2 message_filter
   // tf2 relevant
@@ -117,19 +137,54 @@ ArmorSolverNode::ArmorSolverNode(const rclcpp::NodeOptions &options)
     this->get_node_base_interface(), this->get_node_timers_interface());
   tf2_buffer_->setCreateTimerInterface(timer_interface);
   tf2_listener_ = std::make_shared<tf2_ros::TransformListener>(*tf2_buffer_);
-  // subscriber and filter
-  armors_sub_.subscribe(this, "armor_detector/armors", rmw_qos_profile_sensor_data);
   target_frame_ = this->declare_parameter("target_frame", "odom");
-  tf2_filter_ = std::make_shared<tf2_filter>(armors_sub_,
-                                             *tf2_buffer_,
-                                             target_frame_,
-                                             10,
-                                             this->get_node_logging_interface(),
-                                             this->get_node_clock_interface(),
-                                             std::chrono::duration<int>(1));
-  // Register a callback with tf2_ros::MessageFilter to be called when
-  // transforms are available
-  tf2_filter_->registerCallback(&ArmorSolverNode::armorsCallback, this);
+  // Pair the armors with the cached gimbal attitude of their stamp instead of waiting in the
+  // tf2 message_filter, tf2 is still used when the cache misses
+  use_attitude_cache_ = this->declare_parameter("use_attitude_cache", false);
+  if (use_attitude_cache_) {
+    armors_direct_sub_ = this->create_subscription<rm_interfaces::msg::Armors>(
+      "armor_detector/armors",
+      rclcpp::SensorDataQoS(),
+      std::bind(&ArmorSolverNode::armorsCallback, this, std::placeholders::_1));
+  } else {
+    // subscriber and filter
+    armors_sub_.subscribe(this, "armor_detector/armors", rmw_qos_profile_sensor_data);
+    tf2_filter_ = std::make_shared<tf2_filter>(armors_sub_,
+                                               *tf2_buffer_,
+                                               target_frame_,
+                                               10,
+                                               this->get_node_logging_interface(),
+                                               this->get_node_clock_interface(),
+                                               std::chrono::duration<int>(1));
+    // Register a callback with tf2_ros::MessageFilter to be called when
+    // transforms are available
+    tf2_filter_->registerCallback(&ArmorSolverNode::armorsCallback, this);
+  }
+
+  // Gimbal attitude cache
+  serial_receive_sub_ = this->create_subscription<rm_interfaces::msg::SerialReceiveData>(
+    "serial/receive",
+    rclcpp::SensorDataQoS(),
+    [this](const rm_interfaces::msg::SerialReceiveData::SharedPtr msg) {
+      if (solver_ != nullptr) {
+        solver_->updateBulletSpeed(msg->bullet_speed);
+      }
+      if (msg->header.frame_id != target_frame_) {
+        return;
+      }
+      // A serial driver in this process already writes the process cache
+      if (utils::processAttitudeCache().empty()) {
+        // Same as the odom to gimbal_link tf of the serial driver
+        tf2::Quaternion q;
+        q.setRPY(msg->roll, msg->pitch, msg->yaw);
+        attitude_cache_.push(rclcpp::Time(msg->header.stamp).nanoseconds(),
+                             Eigen::Quaterniond(q.w(), q.x(), q.y(), q.z()));
+      }
+      // A new attitude changes the command, send it right away
+      if (event_driven_) {
+        publishGimbalCmd();
+      }
+    });
 
   // Measurement publisher (for debug usage)
   measure_pub_ = this->create_publisher<rm_interfaces::msg::Measurement>("armor_solver/measurement",
@@ -140,9 +195,17 @@ ArmorSolverNode::ArmorSolverNode(const rclcpp::NodeOptions &options)
                                                                    rclcpp::SensorDataQoS());
   gimbal_pub_ = this->create_publisher<rm_interfaces::msg::GimbalCmd>("armor_solver/cmd_gimbal",
                                                                       rclcpp::SensorDataQoS());
-  // Timer 250 Hz
-  pub_timer_ = this->create_wall_timer(std::chrono::milliseconds(4),
-                                       std::bind(&ArmorSolverNode::timerCallback, this));
+  // Time from solving a command to the MCU applying it, the target is predicted to this time
+  transmit_delay_ = this->declare_parameter("solver.transmit_delay", 0.0);
+  // Event driven: publish after every new target and gimbal attitude, limited to max_publish_rate.
+  // Otherwise publish by a 250 Hz wall timer
+  event_driven_ = this->declare_parameter("solver.event_driven", false);
+  double max_publish_rate = this->declare_parameter("solver.max_publish_rate", 500.0);
+  min_publish_interval_ns_ = static_cast<int64_t>(1e9 / std::max(max_publish_rate, 1.0));
+  if (!event_driven_) {
+    pub_timer_ = this->create_wall_timer(std::chrono::milliseconds(4),
+                                         std::bind(&ArmorSolverNode::timerCallback, this));
+  }
   armor_target_.header.frame_id = "";
 
   // Enable/Disable Armor Solver
@@ -154,15 +217,33 @@ ArmorSolverNode::ArmorSolverNode(const rclcpp::NodeOptions &options)
 
   if (debug_mode_) {
     initMarkers();
+    marker_thread_ = std::thread(&ArmorSolverNode::markerLoop, this);
   }
 
   // Heartbeat
   heartbeat_ = HeartBeatPublisher::create(this);
+  auto &metrics = heartbeat_->metrics();
+  track_latency_ = &metrics.latency("track");
+  solve_latency_ = &metrics.latency("solve");
+  end_to_end_latency_ = &metrics.latency("end_to_end");
+  late_frames_ = &metrics.counter("late_frames");
+  solver_errors_ = &metrics.counter("solver_errors");
 }
 
-void ArmorSolverNode::timerCallback() {
-  
+ArmorSolverNode::~ArmorSolverNode() {
+  {
+    std::lock_guard<std::mutex> lock(marker_mutex_);
+    marker_running_ = false;
+  }
+  marker_cv_.notify_all();
+  if (marker_thread_.joinable()) {
+    marker_thread_.join();
+  }
+}
+
+void ArmorSolverNode::timerCallback() { publishGimbalCmd(); }
 
+void ArmorSolverNode::publishGimbalCmd() {
   if (solver_ == nullptr) {
     return;
   }
@@ -171,6 +252,14 @@ void ArmorSolverNode::timerCallback() {
     return;
   }
 
+  const rclcpp::Time now = this->now();
+  if (event_driven_) {
+    if (now.nanoseconds() - last_publish_ns_ < min_publish_interval_ns_) {
+      return;
+    }
+    last_publish_ns_ = now.nanoseconds();
+  }
+
   // Init message
   rm_interfaces::msg::GimbalCmd control_msg;
 
@@ -188,13 +277,21 @@ void ArmorSolverNode::timerCallback() {
 
   if (armor_target_.tracking) {
     try {
-      control_msg = solver_->solve(armor_target_, this->now(), tf2_buffer_);
+      utils::TraceScope trace(utils::TraceStage::SOLVE,
+                              rclcpp::Time(armor_target_.header.stamp).nanoseconds());
+      utils::LatencyScope latency(solve_latency_);
+      // Predict to the time the command takes effect
+      control_msg = solver_->solve(armor_target_,
+                                   now + rclcpp::Duration::from_seconds(transmit_delay_),
+                                   tf2_buffer_,
+                                   &utils::processAttitudeCacheOr(attitude_cache_));
       last_yaw=control_msg.yaw;
       last_pitch=control_msg.pitch;
       FYT_DEBUG("armor_solver","AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA");
       std::cout<<"last yaw: "<<last_yaw<<" last pitch: "<<last_pitch<<std::endl;
     } catch (...) {
       FYT_ERROR("armor_solver", "Something went wrong in solver!");
+      solver_errors_->fetch_add(1, std::memory_order_relaxed);
       control_msg.yaw_diff = 0;
       control_msg.pitch_diff = 0;
       control_msg.distance = -1;
@@ -208,10 +305,31 @@ void ArmorSolverNode::timerCallback() {
     control_msg.yaw = last_yaw;
     control_msg.pitch = last_pitch;
   }
+  utils::FlightRecorder::record(utils::FlightEvent::COMMAND,
+                                control_msg.fire_advice ? 1 : 0,
+                                rclcpp::Time(armor_target_.header.stamp).nanoseconds(),
+                                {static_cast<float>(control_msg.pitch),
+                                 static_cast<float>(control_msg.yaw),
+                                 static_cast<float>(control_msg.distance),
+                                 static_cast<float>(control_msg.pitch_diff),
+                                 static_cast<float>(control_msg.yaw_diff)});
   gimbal_pub_->publish(control_msg);
+  if (armor_target_.tracking) {
+    // From the capture of the frame to the command
+    end_to_end_latency_->record((this->now() - armor_target_.header.stamp).nanoseconds());
+  }
 
-  if (debug_mode_) {
-    publishMarkers(armor_target_, control_msg);
+  if (debug_mode_ && hasSubscribers(marker_pub_) && marker_rate_.ready(now.nanoseconds())) {
+    MarkerFrame frame;
+    frame.target = armor_target_;
+    frame.gimbal_cmd = control_msg;
+    if (armor_target_.tracking) {
+      const Tracker *tracker = tracker_bank_->target();
+      frame.small_armor =
+        tracker != nullptr && tracker->tracked_armor.type == Tracker::Armor::TYPE_SMALL;
+      frame.trajectory = solver_->getTrajectory();
+    }
+    pushMarkerFrame(std::move(frame));
   }
 }
 
@@ -263,24 +381,81 @@ void ArmorSolverNode::initMarkers() noexcept {
     this->create_publisher<visualization_msgs::msg::MarkerArray>("armor_solver/marker", 10);
 }
 
-void ArmorSolverNode::armorsCallback(const rm_interfaces::msg::Armors::SharedPtr armors_msg) {
-  // Lazy initialize solver owing to weak_from_this() can't be called in constructor
-  if (solver_ == nullptr) {
-    solver_ = std::make_unique<Solver>(weak_from_this());
+bool ArmorSolverNode::transformArmors(rm_interfaces::msg::Armors &armors_msg) noexcept {
+  // Fast path, no lock and no waiting
+  Eigen::Quaterniond q_odom_gimbal;
+  const GimbalToCamera *gimbal_to_camera = nullptr;
+  if (use_attitude_cache_ &&
+      (gimbal_to_camera = lookupGimbalToCamera(armors_msg.header.frame_id)) != nullptr &&
+      utils::processAttitudeCacheOr(attitude_cache_)
+        .lookup(rclcpp::Time(armors_msg.header.stamp).nanoseconds(), q_odom_gimbal)) {
+    // odom and gimbal_link share the origin
+    const Eigen::Quaterniond q_odom_camera = q_odom_gimbal * gimbal_to_camera->q;
+    const Eigen::Vector3d t_odom_camera = q_odom_gimbal * gimbal_to_camera->t;
+    for (auto &armor : armors_msg.armors) {
+      auto &p = armor.pose.position;
+      auto &o = armor.pose.orientation;
+      const Eigen::Vector3d position =
+        q_odom_camera * Eigen::Vector3d(p.x, p.y, p.z) + t_odom_camera;
+      const Eigen::Quaterniond orientation =
+        (q_odom_camera * Eigen::Quaterniond(o.w, o.x, o.y, o.z)).normalized();
+      p.x = position.x();
+      p.y = position.y();
+      p.z = position.z();
+      o.w = orientation.w();
+      o.x = orientation.x();
+      o.y = orientation.y();
+      o.z = orientation.z();
+    }
+    return true;
   }
 
-  // Tranform armor position from image frame to world coordinate
-  for (auto &armor : armors_msg->armors) {
+  for (auto &armor : armors_msg.armors) {
     geometry_msgs::msg::PoseStamped ps;
-    ps.header = armors_msg->header;
+    ps.header = armors_msg.header;
     ps.pose = armor.pose;
     try {
       armor.pose = tf2_buffer_->transform(ps, target_frame_).pose;
     } catch (const tf2::TransformException &ex) {
       FYT_ERROR("armor_solver", "Transform error: {}", ex.what());
-      return;
+      return false;
     }
   }
+  return true;
+}
+
+const ArmorSolverNode::GimbalToCamera *ArmorSolverNode::lookupGimbalToCamera(
+  const std::string &camera_frame) noexcept {
+  if (auto it = gimbal_to_camera_.find(camera_frame); it != gimbal_to_camera_.end()) {
+    return &it->second;
+  }
+  // The gimbal to camera transforms are static, look each camera up only once
+  try {
+    auto gimbal_to_camera =
+      tf2_buffer_->lookupTransform("gimbal_link", camera_frame, tf2::TimePointZero);
+    const auto &q = gimbal_to_camera.transform.rotation;
+    const auto &t = gimbal_to_camera.transform.translation;
+    return &gimbal_to_camera_
+              .emplace(camera_frame,
+                       GimbalToCamera{Eigen::Quaterniond(q.w, q.x, q.y, q.z),
+                                      Eigen::Vector3d(t.x, t.y, t.z)})
+              .first->second;
+  } catch (const tf2::TransformException &ex) {
+    FYT_WARN("armor_solver", "Gimbal to camera transform not ready: {}", ex.what());
+    return nullptr;
+  }
+}
+
+void ArmorSolverNode::armorsCallback(const rm_interfaces::msg::Armors::SharedPtr armors_msg) {
+  // Lazy initialize solver owing to weak_from_this() can't be called in constructor
+  if (solver_ == nullptr) {
+    solver_ = std::make_unique<Solver>(weak_from_this());
+  }
+
+  // Tranform armor position from image frame to world coordinate
+  if (!transformArmors(*armors_msg)) {
+    return;
+  }
 
   // Filter abnormal armors
   armors_msg->armors.erase(std::remove_if(armors_msg->armors.begin(),
@@ -294,39 +469,44 @@ void ArmorSolverNode::armorsCallback(const rm_interfaces::msg::Armors::SharedPtr
   rm_interfaces::msg::Measurement measure_msg;
   rm_interfaces::msg::Target target_msg;
   rclcpp::Time time = armors_msg->header.stamp;
-  target_msg.header.stamp = time;
   target_msg.header.frame_id = target_frame_;
 
-
-  // Update tracker
-  if (tracker_->tracker_state == Tracker::LOST) {
-    tracker_->init(armors_msg);
-    target_msg.tracking = false;
-  } else {
-    dt_ = (time - last_time_).seconds();
-    tracker_->lost_thres = std::abs(static_cast<int>(lost_time_thres_ / dt_));
-    if (tracker_->tracked_id == "outpost") {
-      tracker_->ekf->setPredictFunc(Predict{dt_, MotionModel::CONSTANT_ROTATION});
+  utils::Trace::setFrame(time.nanoseconds());
+  {
+    utils::TraceScope trace(utils::TraceStage::TRACK);
+    utils::LatencyScope latency(track_latency_);
+    if (!tracker_bank_->empty() && time < last_time_) {
+      // A late frame, fold it in and keep the time of the newest state
+      late_frames_->fetch_add(1, std::memory_order_relaxed);
+      tracker_bank_->updateDelayed(armors_msg, (last_time_ - time).seconds());
+      time = last_time_;
     } else {
-      tracker_->ekf->setPredictFunc(Predict{dt_, MotionModel::CONSTANT_VEL_ROT});
+      // Update tracker bank, dt is only meaningful if some track is alive
+      dt_ = tracker_bank_->empty() ? 0 : (time - last_time_).seconds();
+      tracker_bank_->update(armors_msg, dt_);
     }
-    tracker_->update(armors_msg);
+  }
+  target_msg.header.stamp = time;
+
+  const Tracker *tracker = tracker_bank_->target();
+  target_msg.tracking = false;
+  if (tracker != nullptr) {
     // Publish measurement
-    measure_msg.x = tracker_->measurement(0);
-    measure_msg.y = tracker_->measurement(1);
-    measure_msg.z = tracker_->measurement(2);
-    measure_msg.yaw = tracker_->measurement(3);
-    measure_pub_->publish(measure_msg);
-
-    if (tracker_->tracker_state == Tracker::DETECTING) {
-      target_msg.tracking = false;
-    } else if (tracker_->tracker_state == Tracker::TRACKING ||
-               tracker_->tracker_state == Tracker::TEMP_LOST) {
+    measure_msg.x = tracker->measurement(0);
+    measure_msg.y = tracker->measurement(1);
+    measure_msg.z = tracker->measurement(2);
+    measure_msg.yaw = tracker->measurement(3);
+    if (hasSubscribers(measure_pub_) && measurement_rate_.ready(this->now().nanoseconds())) {
+      measure_pub_->publish(measure_msg);
+    }
+
+    if (tracker->tracker_state == Tracker::TRACKING ||
+        tracker->tracker_state == Tracker::TEMP_LOST) {
       target_msg.tracking = true;
       // Fill target message
-      const auto &state = tracker_->target_state;
-      target_msg.id = tracker_->tracked_id;
-      target_msg.armors_num = static_cast<int>(tracker_->tracked_armors_num);
+      const auto &state = tracker->target_state;
+      target_msg.id = static_cast<uint8_t>(tracker->tracked_id);
+      target_msg.armors_num = static_cast<int>(tracker->tracked_armors_num);
       target_msg.position.x = state(0);
       target_msg.velocity.x = state(1);
       target_msg.position.y = state(2);
@@ -336,21 +516,71 @@ void ArmorSolverNode::armorsCallback(const rm_interfaces::msg::Armors::SharedPtr
       target_msg.yaw = state(6);
       target_msg.v_yaw = state(7);
       target_msg.radius_1 = state(8);
-      target_msg.radius_2 = tracker_->another_r;
+      target_msg.radius_2 = tracker->another_r;
       target_msg.d_zc = state(9);
-      target_msg.d_za = tracker_->d_za;
+      target_msg.d_za = tracker->d_za;
+      const Eigen::VectorXd &mu = tracker->ekf->getProbabilities();
+      if (mu.size() == IMM_MODEL_N) {
+        for (int i = 0; i < IMM_MODEL_N; i++) {
+          target_msg.model_probabilities[i] = mu(i);
+        }
+      }
     }
   }
 
+  utils::FlightRecorder::record(
+    utils::FlightEvent::TRACKER,
+    tracker != nullptr ? static_cast<int16_t>(tracker->tracker_state) : -1,
+    rclcpp::Time(armors_msg->header.stamp).nanoseconds(),
+    {static_cast<float>(target_msg.position.x),
+     static_cast<float>(target_msg.position.y),
+     static_cast<float>(target_msg.position.z),
+     static_cast<float>(target_msg.yaw),
+     static_cast<float>(target_msg.velocity.x),
+     static_cast<float>(target_msg.velocity.y),
+     static_cast<float>(target_msg.velocity.z),
+     static_cast<float>(target_msg.v_yaw),
+     static_cast<float>(target_msg.radius_1)});
+
   // Store and Publish the target_msg
   armor_target_ = target_msg;
   target_pub_->publish(target_msg);
 
   last_time_ = time;
+
+  if (event_driven_) {
+    publishGimbalCmd();
+  }
+}
+
+void ArmorSolverNode::pushMarkerFrame(MarkerFrame &&frame) {
+  {
+    std::lock_guard<std::mutex> lock(marker_mutex_);
+    marker_frame_ = std::move(frame);
+    has_marker_frame_ = true;
+  }
+  marker_cv_.notify_one();
+}
+
+void ArmorSolverNode::markerLoop() {
+  MarkerFrame frame;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(marker_mutex_);
+      marker_cv_.wait(lock, [this] { return !marker_running_ || has_marker_frame_; });
+      if (!marker_running_) {
+        return;
+      }
+      std::swap(frame, marker_frame_);
+      has_marker_frame_ = false;
+    }
+    publishMarkers(frame);
+  }
 }
 
-void ArmorSolverNode::publishMarkers(const rm_interfaces::msg::Target &target_msg,
-                                     const rm_interfaces::msg::GimbalCmd &gimbal_cmd) noexcept {
+void ArmorSolverNode::publishMarkers(const MarkerFrame &frame) noexcept {
+  const rm_interfaces::msg::Target &target_msg = frame.target;
+  const rm_interfaces::msg::GimbalCmd &gimbal_cmd = frame.gimbal_cmd;
   position_marker_.header = target_msg.header;
   linear_v_marker_.header = target_msg.header;
   angular_v_marker_.header = target_msg.header;
@@ -387,7 +617,7 @@ void ArmorSolverNode::publishMarkers(const rm_interfaces::msg::Target &target_ms
     angular_v_marker_.points.emplace_back(arrow_end);
 
     armors_marker_.action = visualization_msgs::msg::Marker::ADD;
-    armors_marker_.scale.y = tracker_->tracked_armor.type == "small" ? 0.135 : 0.23;
+    armors_marker_.scale.y = frame.small_armor ? 0.135 : 0.23;
     // Draw armors
     bool is_current_pair = true;
     size_t a_n = target_msg.armors_num;
@@ -410,7 +640,7 @@ void ArmorSolverNode::publishMarkers(const rm_interfaces::msg::Target &target_ms
       armors_marker_.id = i;
       armors_marker_.pose.position = p_a;
       tf2::Quaternion q;
-      q.setRPY(0, target_msg.id == "outpost" ? -0.2618 : 0.2618, tmp_yaw);
+      q.setRPY(0, target_msg.id == Tracker::Armor::NUMBER_OUTPOST ? -0.2618 : 0.2618, tmp_yaw);
       armors_marker_.pose.orientation = tf2::toMsg(q);
       marker_array.markers.emplace_back(armors_marker_);
     }
@@ -424,7 +654,7 @@ void ArmorSolverNode::publishMarkers(const rm_interfaces::msg::Target &target_ms
     trajectory_marker_.action = visualization_msgs::msg::Marker::ADD;
     trajectory_marker_.points.clear();
     trajectory_marker_.header.frame_id = "gimbal_link";
-    for (const auto &point : solver_->getTrajectory()) {
+    for (const auto &point : frame.trajectory) {
       geometry_msgs::msg::Point p;
       p.x = point.first;
       p.z = point.second;
@@ -18,7 +18,9 @@
 
 #include "armor_solver/armor_tracker.hpp"
 // std
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <memory>
 #include <string>
 // ros2
@@ -33,140 +35,231 @@
 #include "rm_utils/logger/log.hpp"
 
 namespace fyt::auto_aim {
+namespace {
+constexpr double INITIAL_RADIUS = 0.26;
+// Prior of the pair not seen yet, 0.1 m standard deviation of its radius and height
+constexpr double OTHER_PAIR_VAR = 0.01;
+}  // namespace
+
 Tracker::Tracker(double max_match_distance, double max_match_yaw_diff)
 : tracker_state(LOST)
-, tracked_id(std::string(""))
-, measurement(Eigen::VectorXd::Zero(4))
-, target_state(Eigen::VectorXd::Zero(9))
+, models{MotionModel::CONSTANT_VEL_ROT,
+         MotionModel::CONSTANT_VEL_ROT,
+         MotionModel::CONSTANT_VEL_ROT}
+, mahalanobis_gate(0)
+, tracked_id(ArmorNumber::UNKNOWN)
+, measurement(RobotStateEKF::MatrixZ1::Zero())
+, target_state(RobotStateEKF::MatrixX1::Zero())
+, d_za(0)
+, another_r(INITIAL_RADIUS)
+, armor_index(0)
+, outpost_model(false)
 , max_match_distance_(max_match_distance)
 , max_match_yaw_diff_(max_match_yaw_diff)
 , detect_count_(0)
 , lost_count_(0)
-, last_yaw_(0) {}
-
-void Tracker::init(const Armors::SharedPtr &armors_msg) noexcept {
-  if (armors_msg->armors.empty()) {
-    return;
-  }
-
-  // Simply choose the armor that is closest to image center
-  double min_distance = DBL_MAX;
-  tracked_armor = armors_msg->armors[0];
-  for (const auto &armor : armors_msg->armors) {
-    if (armor.distance_to_image_center < min_distance) {
-      min_distance = armor.distance_to_image_center;
-      tracked_armor = armor;
-    }
-  }
+, last_yaw_(0)
+, outpost_stamp_(0) {}
 
+void Tracker::init(const Armor &armor, double stamp) noexcept {
+  tracked_armor = armor;
+  ekf->resetProbabilities();
   initEKF(tracked_armor);
-  FYT_INFO("armor_solver", "Init EKF!");
+  tracked_id = static_cast<ArmorNumber>(tracked_armor.number);
+  FYT_INFO("armor_solver", "Init EKF {}!", armorNumberToString(tracked_id));
 
-  tracked_id = tracked_armor.number;
   tracker_state = DETECTING;
+  detect_count_ = 0;
+  lost_count_ = 0;
+  updateArmorsNum();
 
-  if (tracked_armor.type == "large" &&
-      (tracked_id == "3" || tracked_id == "4" || tracked_id == "5")) {
-    tracked_armors_num = ArmorsNum::BALANCE_2;
-  } else if (tracked_id == "outpost") {
-    tracked_armors_num = ArmorsNum::OUTPOST_3;
-  } else {
-    tracked_armors_num = ArmorsNum::NORMAL_4;
+  if (usesOutpostFilter()) {
+    auto p = armor.pose.position;
+    outpost_filter_.init(outpost_params, Eigen::Vector3d(p.x, p.y, p.z), target_state(6), stamp);
+    outpost_stamp_ = stamp;
+    target_state = outpost_filter_.state(stamp);
+    ekf->setState(target_state);
   }
+
+  history_size_ = 0;
+  pushSnapshot(stamp, nullptr, true);
 }
 
-void Tracker::update(const Armors::SharedPtr &armors_msg) noexcept {
+void Tracker::update(const std::vector<const Armor *> &armors, double stamp) noexcept {
+  if (usesOutpostFilter()) {
+    updateState(updateOutpost(armors, stamp));
+    return;
+  }
+
   // KF predict
-  Eigen::VectorXd ekf_prediction = ekf->predict();
+  ekf->predict();
 
   bool matched = false;
+  bool jumped = false;
+  if (matchArmors(armors, matched, jumped)) {
+    target_state = ekf->update(measurement);
+  }
+  finishUpdate(stamp, matched, jumped);
+}
+
+bool Tracker::matchArmors(const std::vector<const Armor *> &armors,
+                          bool &matched,
+                          bool &jumped) noexcept {
   // Use KF prediction as default target state if no matched armor is found
+  const RobotStateEKF::MatrixX1 ekf_prediction = ekf->getState();
   target_state = ekf_prediction;
+  matched = false;
+  jumped = false;
 
-  if (!armors_msg->armors.empty()) {
-    // Find the closest armor with the same id
-    Armor same_id_armor;
-    int same_id_armors_count = 0;
-    auto predicted_position = getArmorPositionFromState(ekf_prediction);
-    double min_position_diff = DBL_MAX;
+  bool fuse = false;
+  if (!armors.empty()) {
+    const Armor *best = nullptr;
     double yaw_diff = DBL_MAX;
-    for (const auto &armor : armors_msg->armors) {
-      // Only consider armors with the same id
-      if (armor.number == tracked_id) {
-        same_id_armor = armor;
-        same_id_armors_count++;
+    bool gated = false;
+    if (mahalanobis_gate > 0) {
+      // Gate on the squared Mahalanobis distance of the innovation, S is factorized once so
+      // each armor costs one triangular solve
+      Eigen::Vector4d z_pri;
+      Eigen::Matrix4d S;
+      ekf->predictMeasurement(z_pri, S);
+      const Eigen::LLT<Eigen::Matrix4d> llt(S);
+      double min_distance = DBL_MAX;
+      for (const Armor *armor : armors) {
+        auto p = armor->pose.position;
+        const double yaw_innovation =
+          angles::shortest_angular_distance(z_pri(3), getRawYaw(armor->pose.orientation));
+        const Eigen::Vector4d innovation(
+          p.x - z_pri(0), p.y - z_pri(1), p.z - z_pri(2), yaw_innovation);
+        const double distance =
+          llt.info() == Eigen::Success ? llt.matrixL().solve(innovation).squaredNorm() : DBL_MAX;
+        if (best == nullptr || distance < min_distance) {
+          min_distance = distance;
+          yaw_diff = std::abs(yaw_innovation);
+          best = armor;
+        }
+      }
+      gated = min_distance < mahalanobis_gate;
+    } else {
+      // Find the closest armor, all of them have the tracked id
+      auto predicted_position = getArmorPositionFromState(ekf_prediction);
+      double min_position_diff = DBL_MAX;
+      for (const Armor *armor : armors) {
         // Calculate the difference between the predicted position and the
         // current armor position
-        auto p = armor.pose.position;
+        auto p = armor->pose.position;
         Eigen::Vector3d position_vec(p.x, p.y, p.z);
         double position_diff = (predicted_position - position_vec).norm();
         if (position_diff < min_position_diff) {
           // Find the closest armor
           min_position_diff = position_diff;
-          yaw_diff = abs(orientationToYaw(armor.pose.orientation) - ekf_prediction(6));
-          tracked_armor = armor;
-          // Update tracked armor type
-          if (tracked_armor.type == "large" &&
-              (tracked_id == "3" || tracked_id == "4" || tracked_id == "5")) {
-            tracked_armors_num = ArmorsNum::BALANCE_2;
-          } else if (tracked_id == "outpost") {
-            tracked_armors_num = ArmorsNum::OUTPOST_3;
-          } else {
-            tracked_armors_num = ArmorsNum::NORMAL_4;
-          }
+          yaw_diff = std::abs(angles::shortest_angular_distance(
+            ekf_prediction(6), getRawYaw(armor->pose.orientation)));
+          best = armor;
         }
       }
+      // Check if the distance and yaw difference of closest armor are within the
+      // threshold
+      gated = min_position_diff < max_match_distance_ && yaw_diff < max_match_yaw_diff_;
     }
+    tracked_armor = *best;
+    // Update tracked armor type
+    updateArmorsNum();
 
-    // Check if the distance and yaw difference of closest armor are within the
-    // threshold
-    if (min_position_diff < max_match_distance_ && yaw_diff < max_match_yaw_diff_) {
+    if (gated) {
       // Matched armor found
       matched = true;
       auto p = tracked_armor.pose.position;
       // Update EKF
       double measured_yaw = orientationToYaw(tracked_armor.pose.orientation);
       measurement = Eigen::Vector4d(p.x, p.y, p.z, measured_yaw);
-      target_state = ekf->update(measurement);
-    } else if (same_id_armors_count == 1 && yaw_diff > max_match_yaw_diff_) {
+      fuse = true;
+    } else if (armors.size() == 1 && yaw_diff > max_match_yaw_diff_) {
       // Matched armor not found, but there is only one armor with the same id
       // and yaw has jumped, take this case as the target is spinning and armor
       // jumped
-      handleArmorJump(same_id_armor);
+      matched = handleArmorJump(*armors.front());
+      jumped = true;
     } else {
       // No matched armor found
       FYT_WARN("armor_solver", "No matched armor found!");
     }
   }
+  return fuse;
+}
 
-  // Prevent radius from spreading
-  if (target_state(8) < 0.12) {
-    target_state(8) = 0.12;
-    ekf->setState(target_state);
-  } else if (target_state(8) > 0.4) {
-    target_state(8) = 0.4;
-    ekf->setState(target_state);
+void Tracker::finishUpdate(double stamp, bool matched, bool jumped) noexcept {
+  limitRadius();
+  updateOtherPair();
+  pushSnapshot(stamp, matched ? &measurement : nullptr, jumped);
+  updateState(matched);
+}
+
+bool Tracker::updateOutpost(const std::vector<const Armor *> &armors, double stamp) noexcept {
+  // Every plate of the outpost sees the same center, the closest one is matched
+  const Eigen::Vector3d center = outpost_filter_.center();
+  const Armor *best = nullptr;
+  double min_distance = DBL_MAX;
+  for (const Armor *armor : armors) {
+    auto p = armor->pose.position;
+    const Eigen::Vector3d armor_center = outpost_filter_.centerOf(
+      Eigen::Vector3d(p.x, p.y, p.z), getRawYaw(armor->pose.orientation));
+    const double distance = (armor_center - center).norm();
+    if (distance < min_distance) {
+      min_distance = distance;
+      best = armor;
+    }
+  }
+
+  bool matched = false;
+  if (best != nullptr && min_distance < max_match_distance_) {
+    matched = true;
+    auto p = best->pose.position;
+    // A late armor only refines the fit, the tracked armor and the measurement stay the newest
+    if (stamp < outpost_stamp_) {
+      const double raw_yaw = getRawYaw(best->pose.orientation);
+      const double yaw = last_yaw_ + angles::shortest_angular_distance(last_yaw_, raw_yaw);
+      outpost_filter_.update(Eigen::Vector3d(p.x, p.y, p.z), yaw, stamp);
+    } else {
+      tracked_armor = *best;
+      const double yaw = orientationToYaw(best->pose.orientation);
+      measurement = Eigen::Vector4d(p.x, p.y, p.z, yaw);
+      outpost_filter_.update(measurement.head<3>(), yaw, stamp);
+    }
+  } else if (best != nullptr) {
+    FYT_WARN("armor_solver", "No matched armor found!");
   }
 
-  // Tracking state machine
+  // The state stays at the newest frame
+  outpost_stamp_ = std::max(outpost_stamp_, stamp);
+  target_state = outpost_filter_.state(outpost_stamp_);
+  // The EKF is not run, its state follows for the readers of the filter
+  ekf->setState(target_state);
+  another_r = target_state(8);
+  d_za = 0;
+  return matched;
+}
+
+void Tracker::updateState(bool matched) noexcept {
   if (tracker_state == DETECTING) {
     if (matched) {
       detect_count_++;
-      if (detect_count_ > tracking_thres) {
+      const bool confirmed = usesOutpostFilter() ? outpost_filter_.converged()
+                                                 : detect_count_ > tracking_thres;
+      if (confirmed) {
         detect_count_ = 0;
         tracker_state = TRACKING;
-        FYT_DEBUG("armor_solver", "Tracker state: TRACKING {}", tracked_id);
+        FYT_DEBUG("armor_solver", "Tracker state: TRACKING {}", armorNumberToString(tracked_id));
       }
     } else {
       detect_count_ = 0;
       tracker_state = LOST;
-      FYT_DEBUG("armor_solver", "Tracker state: LOST {}", tracked_id);
+      FYT_DEBUG("armor_solver", "Tracker state: LOST {}", armorNumberToString(tracked_id));
     }
   } else if (tracker_state == TRACKING) {
     if (!matched) {
       tracker_state = TEMP_LOST;
       lost_count_++;
-      FYT_DEBUG("armor_solver", "Tracker state: TEMP_LOST {}", tracked_id);
+      FYT_DEBUG("armor_solver", "Tracker state: TEMP_LOST {}", armorNumberToString(tracked_id));
     }
   } else if (tracker_state == TEMP_LOST) {
     if (!matched) {
@@ -174,14 +267,151 @@ void Tracker::update(const Armors::SharedPtr &armors_msg) noexcept {
       if (lost_count_ > lost_thres) {
         lost_count_ = 0;
         tracker_state = LOST;
-        FYT_DEBUG("armor_solver", "Tracker state: LOST {}", tracked_id);
+        FYT_DEBUG("armor_solver", "Tracker state: LOST {}", armorNumberToString(tracked_id));
       }
     } else {
       tracker_state = TRACKING;
       lost_count_ = 0;
-      FYT_DEBUG("armor_solver", "Tracker state: TRACKING {}", tracked_id);
+      FYT_DEBUG("armor_solver", "Tracker state: TRACKING {}", armorNumberToString(tracked_id));
+    }
+  }
+}
+
+bool Tracker::updateDelayed(const std::vector<const Armor *> &armors,
+                            double stamp,
+                            const ProcessNoise &process_noise) noexcept {
+  if (usesOutpostFilter()) {
+    // The fit of the outpost does not depend on the order of the armors
+    return tracker_state != LOST && updateOutpost(armors, stamp);
+  }
+  if (tracker_state == LOST || armors.empty() || history_size_ == 0 ||
+      stamp >= snapshotAt(history_size_ - 1).stamp) {
+    return false;
+  }
+  // Newest snapshot before the measurement, no hand-set state may lie after it
+  int base = -1;
+  for (int i = static_cast<int>(history_size_) - 1; i >= 0; i--) {
+    if (snapshotAt(i).stamp <= stamp) {
+      base = i;
+      break;
+    }
+    if (snapshotAt(i).reset) {
+      break;
+    }
+  }
+  if (base < 0) {
+    FYT_DEBUG("armor_solver", "Measurement older than the history, drop it");
+    return false;
+  }
+
+  // Match the armor closest to the state predicted from the base snapshot
+  const Snapshot &base_snapshot = snapshotAt(base);
+  Eigen::Matrix<double, X_N, 1> x_then;
+  Predict(stamp - base_snapshot.stamp)(base_snapshot.state.data(), x_then.data());
+  const Eigen::Vector3d predicted_position = getArmorPositionFromState(x_then);
+  const Armor *matched = nullptr;
+  double min_position_diff = DBL_MAX;
+  for (const Armor *armor : armors) {
+    auto p = armor->pose.position;
+    double position_diff = (predicted_position - Eigen::Vector3d(p.x, p.y, p.z)).norm();
+    if (position_diff < min_position_diff) {
+      min_position_diff = position_diff;
+      matched = armor;
     }
   }
+  const double yaw =
+    x_then(6) + angles::shortest_angular_distance(x_then(6), getRawYaw(matched->pose.orientation));
+  if (min_position_diff > max_match_distance_ || std::abs(yaw - x_then(6)) > max_match_yaw_diff_) {
+    return false;
+  }
+  auto p = matched->pose.position;
+  const Eigen::Vector4d z(p.x, p.y, p.z, yaw);
+
+  // Keep the frames to replay, the history is rebuilt from the base snapshot
+  std::array<Snapshot, HISTORY_SIZE> later;
+  const size_t later_size = history_size_ - base - 1;
+  for (size_t i = 0; i < later_size; i++) {
+    later[i] = snapshotAt(base + 1 + i);
+  }
+  history_size_ = base + 1;
+  history_head_ = (history_head_ + HISTORY_SIZE - later_size) % HISTORY_SIZE;
+
+  // Restore the base snapshot
+  for (size_t j = 0; j < ekf->size(); j++) {
+    ekf->filter(j).setState(base_snapshot.x[j]);
+    ekf->filter(j).setCovariance(base_snapshot.P[j]);
+  }
+  ekf->restore(base_snapshot.probabilities, base_snapshot.state);
+
+  // Fold in the late measurement and replay the frames after it
+  double last_stamp = base_snapshot.stamp;
+  replayStep(stamp - last_stamp, process_noise, &z);
+  pushSnapshot(stamp, &z, false);
+  last_stamp = stamp;
+  for (size_t i = 0; i < later_size; i++) {
+    const Eigen::Vector4d *later_z = later[i].has_measurement ? &later[i].z : nullptr;
+    replayStep(later[i].stamp - last_stamp, process_noise, later_z);
+    pushSnapshot(later[i].stamp, later_z, false);
+    last_stamp = later[i].stamp;
+  }
+  return true;
+}
+
+void Tracker::replayStep(double dt,
+                         const ProcessNoise &process_noise,
+                         const Eigen::Vector4d *z) noexcept {
+  ProcessNoise q = process_noise;
+  q.dt = dt;
+  for (size_t j = 0; j < ekf->size(); j++) {
+    ekf->filter(j).setPredictFunc(Predict{dt, models[j]});
+    ekf->filter(j).setUpdateQFunc(q);
+  }
+  target_state = ekf->predict();
+  if (z != nullptr) {
+    target_state = ekf->update(*z);
+  }
+  limitRadius();
+  updateOtherPair();
+}
+
+void Tracker::limitRadius() noexcept {
+  if (target_state(8) < 0.12) {
+    target_state(8) = 0.12;
+    ekf->setState(target_state);
+  } else if (target_state(8) > 0.4) {
+    target_state(8) = 0.4;
+    ekf->setState(target_state);
+  }
+}
+
+void Tracker::pushSnapshot(double stamp, const Eigen::Vector4d *z, bool reset) noexcept {
+  Snapshot &snapshot = history_[history_head_];
+  snapshot.stamp = stamp;
+  for (size_t j = 0; j < ekf->size(); j++) {
+    snapshot.x[j] = ekf->filter(j).getState();
+    snapshot.P[j] = ekf->filter(j).getCovariance();
+  }
+  snapshot.probabilities = ekf->getProbabilities();
+  snapshot.state = target_state;
+  snapshot.has_measurement = z != nullptr;
+  if (z != nullptr) {
+    snapshot.z = *z;
+  }
+  snapshot.reset = reset;
+  history_head_ = (history_head_ + 1) % HISTORY_SIZE;
+  history_size_ = std::min(history_size_ + 1, HISTORY_SIZE);
+}
+
+void Tracker::updateArmorsNum() noexcept {
+  if (tracked_armor.type == Armor::TYPE_LARGE &&
+      (tracked_id == ArmorNumber::INFANTRY_3 || tracked_id == ArmorNumber::INFANTRY_4 ||
+       tracked_id == ArmorNumber::INFANTRY_5)) {
+    tracked_armors_num = ArmorsNum::BALANCE_2;
+  } else if (tracked_id == ArmorNumber::OUTPOST) {
+    tracked_armors_num = ArmorsNum::OUTPOST_3;
+  } else {
+    tracked_armors_num = ArmorsNum::NORMAL_4;
+  }
 }
 
 void Tracker::initEKF(const Armor &a) noexcept {
@@ -192,34 +422,73 @@ void Tracker::initEKF(const Armor &a) noexcept {
   double yaw = orientationToYaw(a.pose.orientation);
 
   // Set initial position at 0.2m behind the target
-  target_state = Eigen::VectorXd::Zero(X_N);
-  double r = 0.26;
+  target_state.setZero();
+  double r = INITIAL_RADIUS;
   double xc = xa + r * cos(yaw);
   double yc = ya + r * sin(yaw);
   double zc = za;
-  d_za = 0, d_zc = 0, another_r = r;
-  target_state << xc, 0, yc, 0, zc, 0, yaw, 0, r, d_zc;
+  target_state << xc, 0, yc, 0, zc, 0, yaw, 0, r, 0;
 
+  armor_index = 0;
+  other_pairs_.fill(OtherPair{r, OTHER_PAIR_VAR, 0, OTHER_PAIR_VAR});
   ekf->setState(target_state);
+  updateOtherPair();
 }
 
-void Tracker::handleArmorJump(const Armor &current_armor) noexcept {
-  double last_yaw = target_state(6);
-  double yaw = orientationToYaw(current_armor.pose.orientation);
-
-  if (abs(yaw - last_yaw) > 0.4) {
-    // Armor angle also jumped, take this case as target spinning
-    target_state(6) = yaw;
-    // Only 4 armors has 2 radius and height
-    if (tracked_armors_num == ArmorsNum::NORMAL_4) {
-      d_za = target_state(4) + target_state(9) - current_armor.pose.position.z;
-      std::swap(target_state(8), another_r);
-      d_zc = d_zc == 0 ? -d_za : 0;
-      target_state(9) = d_zc;
-    }
-    FYT_DEBUG("armor_solver", "Armor Jump!");
+bool Tracker::handleArmorJump(const Armor &current_armor) noexcept {
+  const int armors_num = static_cast<int>(tracked_armors_num);
+  const double step = 2 * M_PI / armors_num;
+  const double raw_yaw = getRawYaw(current_armor.pose.orientation);
+  // Plates the target turned by since the prediction
+  const int k = static_cast<int>(
+    std::lround(angles::shortest_angular_distance(target_state(6), raw_yaw) / step));
+  if (k == 0) {
+    resetToArmor(current_armor);
+    return false;
   }
 
+  // The plates of a pair share the radius and height, only 4 armors have 2 pairs
+  const bool swap_pair = tracked_armors_num == ArmorsNum::NORMAL_4 && k % 2 != 0;
+  target_state = ekf->transformPrediction(
+    [this, k, step, swap_pair](size_t j, RobotStateEKF::MatrixX1 &x, RobotStateEKF::MatrixXX &P) {
+      // A shift of the yaw by a constant keeps its covariance
+      x(6) += k * step;
+      if (swap_pair) {
+        // The other pair is independent of the rest of the state
+        OtherPair &other = other_pairs_[j];
+        std::swap(x(8), other.r);
+        std::swap(x(9), other.dzc);
+        const double r_var = P(8, 8), dzc_var = P(9, 9);
+        P.row(8).setZero();
+        P.col(8).setZero();
+        P.row(9).setZero();
+        P.col(9).setZero();
+        P(8, 8) = other.r_var;
+        P(9, 9) = other.dzc_var;
+        other.r_var = r_var;
+        other.dzc_var = dzc_var;
+      }
+    });
+  armor_index = ((armor_index + k) % armors_num + armors_num) % armors_num;
+  FYT_DEBUG("armor_solver", "Armor Jump to plate {}!", armor_index);
+
+  auto p = current_armor.pose.position;
+  const Eigen::Vector3d current_p(p.x, p.y, p.z);
+  if ((current_p - getArmorPositionFromState(target_state)).norm() > max_match_distance_) {
+    resetToArmor(current_armor);
+    return false;
+  }
+  // Update as a matched armor of the new plate
+  last_yaw_ = target_state(6) + angles::shortest_angular_distance(target_state(6), raw_yaw);
+  measurement = Eigen::Vector4d(p.x, p.y, p.z, last_yaw_);
+  target_state = ekf->update(measurement);
+  return true;
+}
+
+void Tracker::resetToArmor(const Armor &current_armor) noexcept {
+  const double yaw = orientationToYaw(current_armor.pose.orientation);
+  target_state(6) = yaw;
+
   auto p = current_armor.pose.position;
   Eigen::Vector3d current_p(p.x, p.y, p.z);
   Eigen::Vector3d infer_p = getArmorPositionFromState(target_state);
@@ -228,34 +497,48 @@ void Tracker::handleArmorJump(const Armor &current_armor) noexcept {
     // If the distance between the current armor and the inferred armor is too
     // large, the state is wrong, reset center position and velocity in the
     // state
-    d_zc = 0;
     double r = target_state(8);
-    target_state(0) = p.x + r * cos(yaw);  // xc
-    target_state(1) = 0;                   // vxc
-    target_state(2) = p.y + r * sin(yaw);  // yc
-    target_state(3) = 0;                   // vyc
-    target_state(4) = p.z;                 // zc
-    target_state(5) = 0;                   // vzc
-    target_state(9) = d_zc;                // d_zc
+    target_state(0) = p.x + r * cos(yaw);     // xc
+    target_state(1) = 0;                      // vxc
+    target_state(2) = p.y + r * sin(yaw);     // yc
+    target_state(3) = 0;                      // vyc
+    target_state(4) = p.z - target_state(9);  // zc
+    target_state(5) = 0;                      // vzc
     FYT_WARN("armor_solver", "State wrong!");
   }
 
   ekf->setState(target_state);
 }
 
+void Tracker::updateOtherPair() noexcept {
+  const Eigen::VectorXd &mu = ekf->getProbabilities();
+  double r = 0, dzc = 0;
+  for (size_t j = 0; j < ekf->size(); j++) {
+    r += mu(j) * other_pairs_[j].r;
+    dzc += mu(j) * other_pairs_[j].dzc;
+  }
+  another_r = r;
+  d_za = tracked_armors_num == ArmorsNum::NORMAL_4 ? dzc - target_state(9) : 0;
+}
+
 double Tracker::orientationToYaw(const geometry_msgs::msg::Quaternion &q) noexcept {
   // Get armor yaw
+  double yaw = getRawYaw(q);
+  // Make yaw change continuous (-pi~pi to -inf~inf)
+  yaw = last_yaw_ + angles::shortest_angular_distance(last_yaw_, yaw);
+  last_yaw_ = yaw;
+  return yaw;
+}
+
+double Tracker::getRawYaw(const geometry_msgs::msg::Quaternion &q) noexcept {
   tf2::Quaternion tf_q;
   tf2::fromMsg(q, tf_q);
   double roll, pitch, yaw;
   tf2::Matrix3x3(tf_q).getRPY(roll, pitch, yaw);
-  // Make yaw change continuous (-pi~pi to -inf~inf)
-  yaw = last_yaw_ + angles::shortest_angular_distance(last_yaw_, yaw);
-  last_yaw_ = yaw;
   return yaw;
 }
 
-Eigen::Vector3d Tracker::getArmorPositionFromState(const Eigen::VectorXd &x) noexcept {
+Eigen::Vector3d Tracker::getArmorPositionFromState(const RobotStateEKF::MatrixX1 &x) noexcept {
   // Calculate predicted position of the current armor
   double xc = x(0), yc = x(2), za = x(4) + x(9);
   double yaw = x(6), r = x(8);
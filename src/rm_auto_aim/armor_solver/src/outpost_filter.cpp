@@ -0,0 +1,137 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_solver/outpost_filter.hpp"
+// std
+#include <algorithm>
+
+namespace fyt::auto_aim {
+namespace {
+constexpr double PLATE_STEP = 2 * M_PI / OutpostFilter::ARMORS_NUM;
+// The time origin follows the stamps, far beyond the memory the sums lose precision
+constexpr double MAX_ORIGIN_AGE = 10.0;
+}  // namespace
+
+void OutpostFilter::init(const Params &params,
+                         const Eigen::Vector3d &position,
+                         double yaw,
+                         double stamp) {
+  params_ = params;
+  params_.memory = std::max(params_.memory, 1e-3);
+  origin_ = last_stamp_ = stamp;
+  s0_ = st_ = stt_ = sy_ = sty_ = 0;
+  sc_.setZero();
+  plate_offset_ = 0;
+  frames_ = 0;
+  spin_ = 0;
+  converged_ = false;
+  // The phase starts as the yaw of the first plate
+  update(position, yaw, stamp);
+}
+
+void OutpostFilter::update(const Eigen::Vector3d &position, double yaw, double stamp) {
+  // Unwrap the armor to the plate of the predicted phase, so that plate changes do not break
+  // the line of the phase
+  const double predicted = frames_ > 0 ? phase(stamp) : yaw;
+  const double y = predicted + foldToPlate(yaw - predicted);
+  plate_offset_ = PLATE_STEP * std::round((yaw - y) / PLATE_STEP);
+
+  double weight = 1.0;
+  if (stamp >= last_stamp_) {
+    const double decay = std::exp(-(stamp - last_stamp_) / params_.memory);
+    s0_ *= decay;
+    st_ *= decay;
+    stt_ *= decay;
+    sy_ *= decay;
+    sty_ *= decay;
+    sc_ *= decay;
+    last_stamp_ = stamp;
+  } else {
+    // A late armor weighs as it would have, had it come in time
+    weight = std::exp(-(last_stamp_ - stamp) / params_.memory);
+  }
+  if (last_stamp_ - origin_ > MAX_ORIGIN_AGE) {
+    shiftOrigin(last_stamp_ - origin_);
+  }
+  const double t = stamp - origin_;
+  s0_ += weight;
+  st_ += weight * t;
+  stt_ += weight * t * t;
+  sy_ += weight * y;
+  sty_ += weight * t * y;
+  sc_ += weight * centerOf(position, yaw);
+  frames_++;
+
+  // Closed-form least squares of the phase over time
+  const double det = s0_ * stt_ - st_ * st_;
+  if (frames_ < params_.min_frames || det <= 1e-12) {
+    converged_ = false;
+    return;
+  }
+  const double slope = (s0_ * sty_ - st_ * sy_) / det;
+  const double slope_std = params_.yaw_noise * std::sqrt(s0_ / det);
+  spin_ = static_cast<int>(std::clamp(std::round(slope / params_.v_yaw), -1.0, 1.0));
+  converged_ = slope_std < params_.v_yaw / 4;
+}
+
+Eigen::Vector3d OutpostFilter::centerOf(const Eigen::Vector3d &position,
+                                        double yaw) const noexcept {
+  return Eigen::Vector3d(position.x() + params_.radius * std::cos(yaw),
+                         position.y() + params_.radius * std::sin(yaw),
+                         position.z());
+}
+
+Eigen::Vector3d OutpostFilter::center() const noexcept {
+  return s0_ > 0 ? Eigen::Vector3d(sc_ / s0_) : Eigen::Vector3d::Zero();
+}
+
+double OutpostFilter::vYaw() const noexcept {
+  if (converged_) {
+    return spin_ * params_.v_yaw;
+  }
+  const double det = s0_ * stt_ - st_ * st_;
+  return det > 1e-12 ? (s0_ * sty_ - st_ * sy_) / det : 0.0;
+}
+
+double OutpostFilter::phase(double stamp) const noexcept {
+  if (s0_ <= 0) {
+    return 0;
+  }
+  // With the slope fixed, the intercept is the weighted mean of the phase minus the rotation
+  const double slope = vYaw();
+  const double intercept = (sy_ - slope * st_) / s0_;
+  return intercept + slope * (stamp - origin_);
+}
+
+double OutpostFilter::yaw(double stamp) const noexcept { return phase(stamp) + plate_offset_; }
+
+Eigen::Matrix<double, X_N, 1> OutpostFilter::state(double stamp) const noexcept {
+  const Eigen::Vector3d c = center();
+  Eigen::Matrix<double, X_N, 1> x;
+  x << c.x(), 0, c.y(), 0, c.z(), 0, yaw(stamp), vYaw(), params_.radius, 0;
+  return x;
+}
+
+double OutpostFilter::foldToPlate(double angle) noexcept {
+  return angle - PLATE_STEP * std::round(angle / PLATE_STEP);
+}
+
+void OutpostFilter::shiftOrigin(double t) noexcept {
+  // Sums of (t_i - t) from the sums of t_i
+  stt_ += -2 * t * st_ + t * t * s0_;
+  sty_ -= t * sy_;
+  st_ -= t * s0_;
+  origin_ += t;
+}
+}  // namespace fyt::auto_aim
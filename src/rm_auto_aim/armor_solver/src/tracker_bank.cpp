@@ -0,0 +1,268 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "armor_solver/tracker_bank.hpp"
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+// project
+#include "rm_utils/logger/log.hpp"
+
+namespace fyt::auto_aim {
+TrackerBank::TrackerBank(int capacity,
+                         double max_match_distance,
+                         double max_match_yaw_diff,
+                         int tracking_thres,
+                         const RobotStateIMM &ekf)
+: process_noise{},
+  lost_time_thres(0.3),
+  time_(0),
+  target_(-1),
+  batched_ekf_(true),
+  single_precision_(false) {
+  tracks_.reserve(capacity);
+  for (int i = 0; i < capacity; i++) {
+    tracks_.emplace_back(max_match_distance, max_match_yaw_diff);
+    tracks_.back().tracking_thres = tracking_thres;
+    tracks_.back().ekf = std::make_unique<RobotStateIMM>(ekf);
+  }
+  candidates_.resize(capacity);
+  created_.resize(capacity, 0);
+  batched_.reserve(capacity);
+}
+
+void TrackerBank::update(const Armors::SharedPtr &armors_msg, double dt) noexcept {
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    candidates_[i].clear();
+    created_[i] = 0;
+  }
+
+  // Assignment: armors go to the track of their id, a new id takes a free track
+  for (const auto &armor : armors_msg->armors) {
+    const auto number = static_cast<ArmorNumber>(armor.number);
+    int index = findTrack(number);
+    if (index < 0) {
+      index = findFreeTrack();
+      if (index < 0) {
+        FYT_WARN(
+          "armor_solver", "Tracker bank is full, drop armor {}", armorNumberToString(number));
+        continue;
+      }
+      created_[index] = 1;
+      tracks_[index].tracked_id = number;
+    }
+    candidates_[index].emplace_back(&armor);
+  }
+
+  process_noise.dt = dt;
+  time_ += dt;
+  batched_.clear();
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    Tracker &track = tracks_[i];
+    if (created_[i]) {
+      // Start with the armor closest to the image center
+      const Armor *best = candidates_[i].front();
+      for (const Armor *armor : candidates_[i]) {
+        if (armor->distance_to_image_center < best->distance_to_image_center) {
+          best = armor;
+        }
+      }
+      track.init(*best, time_);
+      continue;
+    }
+    if (track.tracker_state == Tracker::LOST) {
+      continue;
+    }
+
+    track.lost_thres = std::abs(static_cast<int>(lost_time_thres / dt));
+    RobotStateIMM &imm = *track.ekf;
+    for (size_t j = 0; j < imm.size(); j++) {
+      MotionModel model = imm.size() == 1 ? MotionModel::CONSTANT_VEL_ROT : IMM_MODELS[j];
+      // The outpost only rotates
+      if (track.tracked_id == ArmorNumber::OUTPOST) {
+        model = MotionModel::CONSTANT_ROTATION;
+      }
+      imm.filter(j).setPredictFunc(Predict{dt, model});
+      imm.filter(j).setUpdateQFunc(process_noise);
+      track.models[j] = model;
+    }
+    if (batched_ekf_ && imm.size() == 1 && track.models[0] == MotionModel::CONSTANT_VEL_ROT) {
+      batched_.push_back(static_cast<int>(i));
+      continue;
+    }
+    track.update(candidates_[i], time_);
+  }
+  for (size_t begin = 0; begin < batched_.size(); begin += BATCH_LANES) {
+    const int n = static_cast<int>(std::min<size_t>(BATCH_LANES, batched_.size() - begin));
+    if (single_precision_) {
+      updateBatch(batch_f_, batched_.data() + begin, n);
+    } else {
+      updateBatch(batch_, batched_.data() + begin, n);
+    }
+  }
+
+  selectTarget();
+}
+
+template <class Batch>
+void TrackerBank::updateBatch(Batch &batch, const int *indices, int n) noexcept {
+  using Scalar = typename Batch::ScalarType;
+  constexpr int LANES = Batch::LANES;
+  RobotStateEKF::MatrixXX F;
+  Predict(process_noise.dt).jacobian(RobotStateEKF::MatrixX1::Zero(), F);
+  for (int k = 0; k < n; k++) {
+    const RobotStateEKF &filter = tracks_[indices[k]].ekf->filter(0);
+    batch.setState(k, filter.getState());
+    batch.setCovariance(k, filter.getCovariance());
+  }
+  batch.predict(F, process_noise());
+
+  // Each track matches its armors against its prediction, as in Tracker::update()
+  bool matched[LANES], jumped[LANES];
+  Scalar z[Z_N][LANES] = {};
+  Scalar R[Z_N][Z_N][LANES] = {};
+  uint64_t mask = 0;
+  for (int k = 0; k < n; k++) {
+    Tracker &track = tracks_[indices[k]];
+    track.ekf->transformPrediction(
+      [&batch, k](size_t, RobotStateEKF::MatrixX1 &x, RobotStateEKF::MatrixXX &P) {
+        x = batch.getState(k);
+        P = batch.getCovariance(k);
+      });
+    if (!track.matchArmors(candidates_[indices[k]], matched[k], jumped[k])) {
+      continue;
+    }
+    mask |= uint64_t{1} << k;
+    const RobotStateEKF::MatrixZZ r = track.ekf->filter(0).getUpdateRFunc()(track.measurement);
+    for (int i = 0; i < Z_N; i++) {
+      z[i][k] = track.measurement(i);
+      for (int j = 0; j < Z_N; j++) {
+        R[i][j][k] = r(i, j);
+      }
+    }
+  }
+
+  const uint64_t updated = batch.update(
+    z, R, mask, [](const auto &x, auto &z_pri, auto &H) { Measure::lanes<LANES>(x, z_pri, H); });
+  for (int k = 0; k < n; k++) {
+    Tracker &track = tracks_[indices[k]];
+    if ((updated >> k) & 1) {
+      track.ekf->setState(batch.getState(k));
+      track.ekf->filter(0).setCovariance(batch.getCovariance(k));
+      track.target_state = track.ekf->getState();
+    } else if ((mask >> k) & 1) {
+      // Degenerated covariance, keep the prediction
+      RobotStateEKF &filter = track.ekf->filter(0);
+      filter.setCovariance(filter.getPredictedCovariance());
+    }
+    track.finishUpdate(time_, matched[k], jumped[k]);
+  }
+}
+
+void TrackerBank::updateDelayed(const Armors::SharedPtr &armors_msg, double delay) noexcept {
+  for (auto &candidates : candidates_) {
+    candidates.clear();
+  }
+  // Only live tracks take late armors, a late frame never starts a track
+  for (const auto &armor : armors_msg->armors) {
+    const int index = findTrack(static_cast<ArmorNumber>(armor.number));
+    if (index >= 0) {
+      candidates_[index].emplace_back(&armor);
+    }
+  }
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    if (!candidates_[i].empty()) {
+      tracks_[i].updateDelayed(candidates_[i], time_ - delay, process_noise);
+    }
+  }
+}
+
+void TrackerBank::setMahalanobisGate(double gate) noexcept {
+  for (auto &track : tracks_) {
+    track.mahalanobis_gate = gate;
+  }
+}
+
+void TrackerBank::setOutpostModel(bool enable, const OutpostFilter::Params &params) noexcept {
+  for (auto &track : tracks_) {
+    track.outpost_model = enable;
+    track.outpost_params = params;
+  }
+}
+
+const Tracker *TrackerBank::target() const noexcept {
+  return target_ < 0 ? nullptr : &tracks_[target_];
+}
+
+bool TrackerBank::empty() const noexcept {
+  for (const auto &track : tracks_) {
+    if (track.tracker_state != Tracker::LOST) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int TrackerBank::findTrack(ArmorNumber id) const noexcept {
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    if ((created_[i] || tracks_[i].tracker_state != Tracker::LOST) &&
+        tracks_[i].tracked_id == id) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+int TrackerBank::findFreeTrack() const noexcept {
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    if (!created_[i] && tracks_[i].tracker_state == Tracker::LOST) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+void TrackerBank::selectTarget() noexcept {
+  auto is_tracked = [](const Tracker &track) {
+    return track.tracker_state == Tracker::TRACKING || track.tracker_state == Tracker::TEMP_LOST;
+  };
+  if (target_ >= 0 && is_tracked(tracks_[target_])) {
+    return;
+  }
+
+  // Prefer a tracked robot, fall back to one still being detected
+  int best = -1;
+  bool best_tracked = false;
+  double min_distance = DBL_MAX;
+  for (size_t i = 0; i < tracks_.size(); i++) {
+    const Tracker &track = tracks_[i];
+    if (track.tracker_state == Tracker::LOST) {
+      continue;
+    }
+    const bool tracked = is_tracked(track);
+    const double distance = track.tracked_armor.distance_to_image_center;
+    if ((tracked && !best_tracked) || (tracked == best_tracked && distance < min_distance)) {
+      best = static_cast<int>(i);
+      best_tracked = tracked;
+      min_distance = distance;
+    }
+  }
+  if (best != target_ && best >= 0) {
+    FYT_INFO("armor_solver", "Switch target to {}", armorNumberToString(tracks_[best].tracked_id));
+  }
+  target_ = best;
+}
+}  // namespace fyt::auto_aim
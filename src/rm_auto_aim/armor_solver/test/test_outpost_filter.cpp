@@ -0,0 +1,118 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+// gtest
+#include <gtest/gtest.h>
+// project
+#include "armor_solver/outpost_filter.hpp"
+
+using namespace fyt::auto_aim;
+
+namespace {
+constexpr double RATE = 200.0;
+constexpr double PLATE_STEP = 2 * M_PI / OutpostFilter::ARMORS_NUM;
+
+struct Frame {
+  Eigen::Vector3d position;
+  double yaw;
+  double stamp;
+};
+
+// Outpost at (4, 1, 0.8) seen by a camera at the origin, the plate facing the camera is
+// measured with Gaussian noise on its yaw
+std::vector<Frame> synthesize(int spin, int frames, double yaw_noise, unsigned seed) {
+  const OutpostFilter::Params params;
+  const Eigen::Vector3d center(4.0, 1.0, 0.8);
+  const double facing = std::atan2(center.y(), center.x());
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0.0, yaw_noise);
+
+  std::vector<Frame> sequence;
+  for (int i = 0; i < frames; i++) {
+    const double stamp = 100.0 + i / RATE;
+    const double phase = 0.3 + spin * params.v_yaw * (stamp - 100.0);
+    // The plate closest to the camera
+    const double yaw = facing + std::remainder(phase - facing, PLATE_STEP);
+    const Eigen::Vector3d position =
+      center - params.radius * Eigen::Vector3d(std::cos(yaw), std::sin(yaw), 0);
+    sequence.push_back({position, yaw + noise(rng), stamp});
+  }
+  return sequence;
+}
+
+// Frames until converged(), -1 if never
+int feed(OutpostFilter &filter, const std::vector<Frame> &sequence) {
+  int converged_at = -1;
+  filter.init(OutpostFilter::Params(), sequence[0].position, sequence[0].yaw, sequence[0].stamp);
+  for (size_t i = 1; i < sequence.size(); i++) {
+    filter.update(sequence[i].position, sequence[i].yaw, sequence[i].stamp);
+    if (converged_at < 0 && filter.converged()) {
+      converged_at = static_cast<int>(i) + 1;
+    }
+  }
+  return converged_at;
+}
+}  // namespace
+
+TEST(OutpostFilter, DecidesTheSpinInAboutFifteenFrames) {
+  for (int spin : {-1, 0, 1}) {
+    for (unsigned seed = 0; seed < 10; seed++) {
+      OutpostFilter filter;
+      const int converged_at = feed(filter, synthesize(spin, 60, 0.05, seed));
+      ASSERT_GT(converged_at, 0) << "spin " << spin << ", seed " << seed;
+      EXPECT_LE(converged_at, 20) << "spin " << spin << ", seed " << seed;
+      EXPECT_EQ(filter.spin(), spin) << "seed " << seed;
+      EXPECT_NEAR(filter.vYaw(), spin * OutpostFilter::Params().v_yaw, 1e-9);
+      EXPECT_LT((filter.center() - Eigen::Vector3d(4.0, 1.0, 0.8)).norm(), 0.02);
+    }
+  }
+}
+
+TEST(OutpostFilter, FollowsThePhaseAcrossPlates) {
+  OutpostFilter filter;
+  // Two seconds, the plate changes 2.4 times per second
+  const auto sequence = synthesize(1, 400, 0.05, 1);
+  feed(filter, sequence);
+  const Frame &last = sequence.back();
+  // The yaw of the last plate, without the noise of a single frame
+  EXPECT_NEAR(std::remainder(filter.yaw(last.stamp) - last.yaw, 2 * M_PI), 0.0, 0.15);
+  // Half a second later the phase has moved by v_yaw / 2, up to a plate
+  const double ahead = filter.yaw(last.stamp + 0.5) - filter.yaw(last.stamp);
+  EXPECT_NEAR(ahead, 0.5 * OutpostFilter::Params().v_yaw, 1e-9);
+}
+
+TEST(OutpostFilter, LateFramesGiveTheSameFit) {
+  const auto sequence = synthesize(-1, 60, 0.05, 3);
+  OutpostFilter in_order;
+  feed(in_order, sequence);
+
+  // Every fourth frame arrives two frames late
+  auto shuffled = sequence;
+  for (size_t i = 4; i + 2 < shuffled.size(); i += 4) {
+    std::rotate(shuffled.begin() + i, shuffled.begin() + i + 1, shuffled.begin() + i + 3);
+  }
+  OutpostFilter late;
+  feed(late, shuffled);
+
+  EXPECT_TRUE(late.converged());
+  EXPECT_EQ(late.spin(), in_order.spin());
+  EXPECT_LT((late.center() - in_order.center()).norm(), 1e-9);
+  const double stamp = sequence.back().stamp;
+  EXPECT_NEAR(late.yaw(stamp), in_order.yaw(stamp), 1e-9);
+}
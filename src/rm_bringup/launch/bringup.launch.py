@@ -10,16 +10,23 @@ def generate_launch_description():
 
     from launch_ros.descriptions import ComposableNode
     from launch_ros.actions import ComposableNodeContainer, Node, SetParameter, PushRosNamespace
-    from launch.actions import TimerAction, Shutdown
+    from launch.actions import TimerAction, Shutdown, SetEnvironmentVariable
     from launch import LaunchDescription
 
     launch_params = yaml.safe_load(open(os.path.join(
         get_package_share_directory('rm_bringup'), 'config', 'launch_params.yaml')))
 
     SetParameter(name='rune',value=launch_params['rune']),
+    second_camera = launch_params.get('second_camera', {'enable': False})
+    second_camera_args = []
+    if second_camera['enable'] and not launch_params['video_play']:
+        second_camera_args = [' second_camera:=', second_camera['name'],
+                              ' second_xyz:=', second_camera['xyz'],
+                              ' second_rpy:=', second_camera['rpy']]
     robot_gimbal_description = Command(['xacro ', os.path.join(
         get_package_share_directory('rm_robot_description'), 'urdf', 'rm_gimbal.urdf.xacro'),
-        ' xyz:=', launch_params['odom2camera']['xyz'], ' rpy:=', launch_params['odom2camera']['rpy']])
+        ' xyz:=', launch_params['odom2camera']['xyz'], ' rpy:=', launch_params['odom2camera']['rpy']]
+        + second_camera_args)
     
     robot_navigation_description = Command(['xacro ', os.path.join(
         get_package_share_directory('rm_robot_description'), 'urdf', 'sentry.urdf.xacro')])
@@ -60,6 +67,17 @@ def generate_launch_description():
         )
 
 
+    # 打符节点按需加载: 串口节点在请求打符模式时通过容器的 load_node 服务加载, 离开打符模式后卸载
+    # 虚拟串口不支持, 仍在启动时加载
+    rune_on_demand = launch_params['rune'] and launch_params.get('rune_on_demand', False) \
+        and not launch_params['virtual_serial']
+    serial_driver_params = [get_params('serial_driver')]
+    if rune_on_demand:
+        serial_driver_params.append({
+            'rune_on_demand.enable': True,
+            'rune_on_demand.detector_params': get_params('rune_detector'),
+            'rune_on_demand.solver_params': get_params('rune_solver')})
+
     # 串口
     if launch_params['virtual_serial']:
         serial_driver_node = Node(
@@ -78,7 +96,7 @@ def generate_launch_description():
             name='serial_driver',
             output='both',
             emulate_tty=True,
-            parameters=[get_params('serial_driver')],
+            parameters=serial_driver_params,
             ros_arguments=['--ros-args', ],
         )
         
@@ -91,6 +109,34 @@ def generate_launch_description():
         extra_arguments=[{'use_intra_process_comms': True}]
     )
     
+    # 第二个相机及其装甲板识别, 在 <name> 命名空间下运行, 识别结果和订阅的目标、姿态话题重映射回主命名空间
+    second_camera_nodes = []
+    if second_camera_args:
+        prefix = '/' + launch_params['namespace'] if launch_params['namespace'] else ''
+        second_camera_nodes = [
+            ComposableNode(
+                package='rm_camera_driver',
+                plugin='fyt::camera_driver::DahengCameraNode',
+                name='camera_driver',
+                namespace=second_camera['name'],
+                parameters=[get_params('camera_driver'), get_params('second_camera_driver'),
+                            {'camera_name': second_camera['name'],
+                             'camera_frame_id': second_camera['name'] + '_optical_frame'}],
+                extra_arguments=[{'use_intra_process_comms': True}]
+            ),
+            ComposableNode(
+                package='armor_detector',
+                plugin='fyt::auto_aim::ArmorDetectorNode',
+                name='armor_detector',
+                namespace=second_camera['name'],
+                parameters=[get_params('armor_detector')],
+                remappings=[('armor_detector/armors', prefix + '/armor_detector/armors'),
+                            ('armor_solver/target', prefix + '/armor_solver/target'),
+                            ('serial/receive', prefix + '/serial/receive')],
+                extra_arguments=[{'use_intra_process_comms': True}]
+            ),
+        ]
+
     # 装甲板解算
     if launch_params['hero_solver']:
         armor_solver_node = Node(
@@ -131,6 +177,17 @@ def generate_launch_description():
         arguments=['--ros-args',], 
         )
 
+    # 容器的 executor, 识别节点的图像回调在各自的 callback group 中, 多线程时不被其他回调阻塞
+    container_executables = {
+        'single_threaded': 'component_container',
+        'multi_threaded': 'component_container_mt',
+        'isolated': 'component_container_isolated',
+    }
+    container_executor = launch_params.get('container_executor', 'multi_threaded')
+    container_ros_arguments = ['--ros-args', ]
+    if container_executor == 'multi_threaded' and launch_params.get('container_threads', 0) > 0:
+        container_ros_arguments += ['-p', 'thread_num:={}'.format(launch_params['container_threads'])]
+
     # 使用intra cmmunication提高图像的传输速度
     def get_camera_detector_container(*detector_nodes):
         nodes_list = list(detector_nodes)
@@ -139,37 +196,55 @@ def generate_launch_description():
             name='camera_detector_container',
             namespace='',
             package='rclcpp_components',
-            executable='component_container_mt',
+            executable=container_executables[container_executor],
             composable_node_descriptions=nodes_list,
             output='both',
             emulate_tty=True,
-            ros_arguments=['--ros-args', ],
+            ros_arguments=container_ros_arguments,
         )
         return TimerAction(
             period=2.0,
             actions=[container],
         )
 
-    # 延迟启动
-    delay_serial_node = TimerAction(
-        period=1.5,
-        actions=[serial_driver_node],
-    )
+    # 串口与解算节点也放入同一容器, Armors/Target/GimbalCmd 走进程内通信而不经过DDS序列化
+    def get_composable(package, plugin, name, parameters):
+        return ComposableNode(
+            package=package,
+            plugin=plugin,
+            name=name,
+            parameters=parameters,
+            extra_arguments=[{'use_intra_process_comms': True}]
+        )
 
-    delay_armor_solver_node = TimerAction(
-        period=2.0,
-        actions=[armor_solver_node],
-    )
-    
-    delay_rune_solver_node = TimerAction(
-        period=2.0,
-        actions=[rune_solver_node],
-    )
-    
-    if launch_params['rune']:
-        cam_detector_node = get_camera_detector_container(armor_detector_node, rune_detector_node)
-    else:
-        cam_detector_node = get_camera_detector_container(armor_detector_node)
+    if launch_params['compose_all']:
+        if launch_params['virtual_serial']:
+            serial_driver_node = get_composable(
+                'rm_serial_driver', 'fyt::serial_driver::VirtualSerialNode', 'virtual_serial',
+                [get_params('virtual_serial'), {'has_rune': launch_params['rune']}])
+        else:
+            serial_driver_node = get_composable(
+                'rm_serial_driver', 'fyt::serial_driver::SerialDriverNode', 'serial_driver',
+                serial_driver_params)
+        composed_nodes = [serial_driver_node]
+        # 英雄解算没有组件, 仍为独立进程
+        if not launch_params['hero_solver']:
+            armor_solver_node = get_composable(
+                'armor_solver', 'fyt::auto_aim::ArmorSolverNode', 'armor_solver',
+                [get_params('armor_solver')])
+            composed_nodes.append(armor_solver_node)
+        if launch_params['rune'] and not rune_on_demand:
+            rune_solver_node = get_composable(
+                'rune_solver', 'fyt::rune::RuneSolverNode', 'rune_solver',
+                [get_params('rune_solver')])
+            composed_nodes.append(rune_solver_node)
+
+    detector_nodes = [armor_detector_node] + second_camera_nodes
+    if launch_params['rune'] and not rune_on_demand:
+        detector_nodes.append(rune_detector_node)
+    if launch_params['compose_all']:
+        detector_nodes.extend(composed_nodes)
+    cam_detector_node = get_camera_detector_container(*detector_nodes)
 
     delay_cam_detector_node = TimerAction(
         period=2.0,
@@ -178,14 +253,40 @@ def generate_launch_description():
     
     push_namespace = PushRosNamespace(launch_params['namespace'])
     
+    # 线程绑核与实时优先级, 由各节点的 utils::configureThread() 读取
+    thread_config = SetEnvironmentVariable(
+        'FYT_THREAD_CONFIG', str(launch_params.get('thread_config', '')))
+    # 飞行记录器的转储目录, 由 utils::FlightRecorder::install() 读取
+    flight_dir = SetEnvironmentVariable(
+        'FYT_FLIGHT_DIR', str(launch_params.get('flight_dir', '')))
+
     launch_description_list = [
+        thread_config,
+        flight_dir,
         robot_gimbal_publisher,
         push_namespace,
-        delay_serial_node,
-        delay_cam_detector_node,
-        delay_armor_solver_node]
-    
-    if launch_params['rune']:
+        delay_cam_detector_node]
+
+    # 延迟启动
+    if not launch_params['compose_all']:
+        delay_serial_node = TimerAction(
+            period=1.5,
+            actions=[serial_driver_node],
+        )
+        launch_description_list.append(delay_serial_node)
+
+    if not launch_params['compose_all'] or launch_params['hero_solver']:
+        delay_armor_solver_node = TimerAction(
+            period=2.0,
+            actions=[armor_solver_node],
+        )
+        launch_description_list.append(delay_armor_solver_node)
+
+    if launch_params['rune'] and not launch_params['compose_all'] and not rune_on_demand:
+        delay_rune_solver_node = TimerAction(
+            period=2.0,
+            actions=[rune_solver_node],
+        )
         launch_description_list.append(delay_rune_solver_node)
     
     if launch_params['navigation']:
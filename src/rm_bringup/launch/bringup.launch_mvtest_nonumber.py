@@ -84,10 +84,10 @@ def generate_launch_description():
         
     # 装甲板识别
     armor_detector_node = ComposableNode(
-        package='armor_detector_test', 
+        package='armor_detector',
         plugin='fyt::auto_aim::ArmorDetectorNode',
         name='armor_detector',
-        parameters=[get_params('armor_detector')],
+        parameters=[get_params('armor_detector'), {'use_classifier': False}],
         extra_arguments=[{'use_intra_process_comms': True}]
     )
     
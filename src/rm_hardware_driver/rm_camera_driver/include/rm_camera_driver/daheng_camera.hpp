@@ -17,7 +17,16 @@
 #define RM_CAMERA_DRIVER_DAHENG_CAMERA_HPP_
 
 // std
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 // ros2
 #include <camera_info_manager/camera_info_manager.hpp>
 #include <image_transport/image_transport.hpp>
@@ -29,9 +38,15 @@
 #include "daheng/DxImageProc.h"
 #include "daheng/GxIAPI.h"
 // project
+#include "rm_camera_driver/frame_log.hpp"
 #include "rm_camera_driver/recorder.hpp"
+#include "rm_camera_driver/shared_frames.hpp"
+#include "rm_interfaces/msg/camera_control.hpp"
+#include "rm_interfaces/msg/serial_receive_data.hpp"
+#include "rm_utils/device_clock.hpp"
 #include "rm_utils/logger/log.hpp"
 #include "rm_utils/heartbeat.hpp"
+#include "rm_utils/stall_watchdog.hpp"
 
 namespace fyt::camera_driver {
 
@@ -47,9 +62,14 @@ public:
   rclcpp::Time getLatestFrameStamp();
 
 private:
-  // Watch dog
+  // Watch dog, opens the camera and closes it if no frame came for 5 s
   void timerCallback();
   rclcpp::TimerBase::SharedPtr timer_;
+  // Reopen the camera if it is open but the frames stop for watchdog.timeout_ms
+  void reopen();
+  // Serializes open() and close() of the timer and the stall watchdog
+  std::mutex device_mutex_;
+  std::atomic<int64_t> published_frames_{0};
 
   // Heartbeat
   HeartBeatPublisher::SharedPtr heartbeat_;
@@ -59,29 +79,96 @@ private:
     std::vector<rclcpp::Parameter> parameters);
   rclcpp::Node::OnSetParametersCallbackHandle::SharedPtr on_set_parameters_callback_handle_;
 
-  // onFrameCallback
+  // onFrameCallback, only copies the raw frame into the pool
   void GX_STDC onFrameCallbackFun(GX_FRAME_CALLBACK_PARAM *pFrame);
-
-  image_transport::CameraPublisher pub_;
+  // Registered to the SDK, pUserParam of the frame is the node that opened the device
+  static void GX_STDC frameCallback(GX_FRAME_CALLBACK_PARAM *pFrame);
+
+  // Exposure and AOI requested by the detectors, a new AOI restarts the stream
+  void controlCallback(const rm_interfaces::msg::CameraControl::SharedPtr msg);
+  rclcpp::Subscription<rm_interfaces::msg::CameraControl>::SharedPtr control_sub_;
+  // Current AOI in the coordinate of the configured frame, guarded by control_mutex_
+  int aoi_x_ = 0, aoi_y_ = 0, aoi_width_ = 0, aoi_height_ = 0;
+  std::mutex control_mutex_;
+
+  // Demosaic and publish the raw frames in order
+  void processThread();
+  // Give a raw frame back to the pool
+  void releaseRaw(size_t index);
+
+  // A raw frame copied from the SDK buffer
+  struct RawFrame {
+    std::vector<uint8_t> data;
+    int width = 0;
+    int height = 0;
+    // Offset of the AOI on the sensor
+    int offset_x = 0;
+    int offset_y = 0;
+    rclcpp::Time stamp;
+  };
+  // Preallocated raw frames, each one is either free, ready or owned by the process thread and
+  // the recorder, so a frame is never written while it is read. If none is free the oldest
+  // ready one is dropped. The recorder and the frame log hold at most two of them each
+  static constexpr size_t RAW_POOL_SIZE = 8;
+  std::array<RawFrame, RAW_POOL_SIZE> raw_pool_;
+  std::vector<size_t> free_raw_;
+  std::deque<size_t> ready_raw_;
+  std::mutex raw_mutex_;
+  std::condition_variable raw_cv_;
+  bool process_running_ = false;
+  std::thread process_thread_;
+  // CPU the process thread is pinned to, -1 for no pinning
+  int process_cpu_;
+
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_pub_;
+  rclcpp::Publisher<sensor_msgs::msg::CameraInfo>::SharedPtr camera_info_pub_;
+  // Template of the image msg, without data
   sensor_msgs::msg::Image image_msg_;
   sensor_msgs::msg::CameraInfo camera_info_;
   std::unique_ptr<camera_info_manager::CameraInfoManager> camera_info_manager_;
   std::string camera_name_, camera_info_url_, pixel_format_, frame_id_;
 
   // Daheng Galaxy API
+  // Serial number of the device to open, the device_index-th device (from 1) if empty
+  std::string device_sn_;
+  int device_index_;
+  // Holds a reference to the process-wide GXInitLib, shared by all camera nodes
+  bool lib_initialized_ = false;
   GX_DEV_HANDLE dev_handle_;
   GX_STATUS gx_status_;
   int64_t gx_pixel_format_;
   int64_t gx_pay_load_size_;
-  int64_t gx_bayer_type_;
+  // Color filter of the sensor (DX_PIXEL_COLOR_FILTER), read from the device by open()
+  std::atomic<int64_t> gx_bayer_type_{BAYERRG};
   int64_t max_resolution_width_;
   int64_t max_resolution_height_;
 
-  // Recorder
+  // Frames are stamped by the device clock mapped onto the ROS clock, at the middle of the
+  // exposure. Only used by the SDK callback, other threads request a reset
+  bool hardware_timestamp_;
+  // Fixed delay from the end of the exposure to the fastest arrival of a frame, in ns
+  int64_t transfer_delay_ns_;
+  utils::DeviceClock device_clock_;
+  std::atomic<bool> device_clock_reset_{false};
+
+  // Recorder, takes the raw frames and demosaics them on its own thread
   std::unique_ptr<Recorder> recorder_;
+  uint64_t recorder_dropped_ = 0;
+
+  // Raw frames, camera info and attitude for exact replay by the frame log player
+  std::unique_ptr<FrameLogWriter> frame_log_;
+  rclcpp::Subscription<rm_interfaces::msg::SerialReceiveData>::SharedPtr receive_data_sub_;
+  uint64_t frame_log_dropped_ = 0;
+
+  // Raw frames in shared memory for the tools of other processes
+  std::unique_ptr<SharedFrameWriter> shared_frames_;
 
   // General
   bool is_open_ = false;
+  // Publish the raw frames in the layout of the sensor, e.g. bayer_rggb8, instead of rgb8
+  bool raw_output_ = false;
+  // Demosaic to bgr8 instead of rgb8
+  bool swap_red_blue_ = false;
   int resolution_width_;
   int resolution_height_;
   int auto_white_balance_;
@@ -90,6 +177,8 @@ private:
   double gain_;
   int offest_x_;
   int offset_y_;
+
+  std::unique_ptr<utils::StallWatchdog> watchdog_;
 };
 
 }  // namespace fyt::camera_driver
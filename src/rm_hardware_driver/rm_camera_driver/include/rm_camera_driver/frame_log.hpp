@@ -0,0 +1,190 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_CAMERA_DRIVER_FRAME_LOG_HPP_
+#define RM_CAMERA_DRIVER_FRAME_LOG_HPP_
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fyt::camera_driver {
+// Binary log of a camera session for exact replay: raw frames with their device timestamps,
+// the camera info and the attitude stream, in arrival order. Little endian, every record is
+// aligned to 8 bytes so the file can be read in place from a memory map
+//
+//   FileHeader
+//   RecordHeader payload [padding] ...      records in the order of writing
+//   IndexEntry ...                          one per record, written on close
+//   Trailer
+//
+// A file without a trailer (e.g. the driver was killed) is indexed by scanning the records
+namespace frame_log {
+constexpr char FILE_MAGIC[8] = {'F', 'Y', 'T', 'F', 'L', 'O', 'G', '1'};
+constexpr char INDEX_MAGIC[8] = {'F', 'Y', 'T', 'F', 'I', 'D', 'X', '1'};
+constexpr uint32_t VERSION = 1;
+
+enum class RecordType : uint32_t {
+  // CDR serialized sensor_msgs/msg/CameraInfo
+  CAMERA_INFO = 1,
+  // FrameHeader followed by the image data
+  FRAME = 2,
+  // CDR serialized rm_interfaces/msg/SerialReceiveData
+  RECEIVE_DATA = 3,
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct RecordHeader {
+  uint32_t type;
+  uint32_t reserved;
+  int64_t stamp_ns;
+  // Size of the payload without padding
+  uint64_t size;
+};
+
+struct FrameHeader {
+  uint32_t width;
+  uint32_t height;
+  uint32_t step;
+  // Offset of the AOI in the full frame
+  uint32_t x_offset;
+  uint32_t y_offset;
+  // sensor_msgs encoding, null terminated
+  char encoding[20];
+};
+
+struct IndexEntry {
+  int64_t stamp_ns;
+  // Offset of the RecordHeader in the file
+  uint64_t offset;
+  uint32_t type;
+  uint32_t reserved;
+};
+
+struct Trailer {
+  uint64_t index_offset;
+  uint64_t index_size;
+  char magic[8];
+};
+
+static_assert(sizeof(FileHeader) == 16 && sizeof(RecordHeader) == 24 &&
+                sizeof(FrameHeader) == 40 && sizeof(IndexEntry) == 24 && sizeof(Trailer) == 24,
+              "frame_log structs must have no padding");
+
+constexpr size_t align8(size_t size) noexcept { return (size + 7) & ~size_t{7}; }
+}  // namespace frame_log
+
+// Writes the records on its own thread. Frames are shared with the camera (no copy) and at most
+// MAX_FRAMES of them are held, further frames are dropped and counted
+class FrameLogWriter {
+public:
+  using Buffer = std::vector<unsigned char>;
+  using BufferPtr = std::shared_ptr<const Buffer>;
+
+  explicit FrameLogWriter(const std::filesystem::path &file);
+  ~FrameLogWriter();
+
+  // Return: false if the file can't be created
+  bool open();
+  // Write the index and the trailer
+  void close();
+
+  void addFrame(int64_t stamp_ns, const frame_log::FrameHeader &header, BufferPtr data);
+  void addMessage(frame_log::RecordType type, int64_t stamp_ns, Buffer data);
+
+  uint64_t writtenFrames() const noexcept { return written_frames_; }
+  uint64_t droppedFrames() const noexcept { return dropped_frames_; }
+
+  std::filesystem::path path;
+
+private:
+  struct Record {
+    frame_log::RecordType type;
+    int64_t stamp_ns;
+    frame_log::FrameHeader frame_header;
+    BufferPtr data;
+  };
+
+  void writerThread();
+  void writeRecord(const Record &record);
+
+  static constexpr size_t MAX_FRAMES = 2;
+  static constexpr size_t MAX_RECORDS = 256;
+
+  std::FILE *file_ = nullptr;
+  uint64_t file_offset_ = 0;
+  std::vector<frame_log::IndexEntry> index_;
+
+  std::deque<Record> queue_;
+  size_t queued_frames_ = 0;
+  std::atomic<uint64_t> written_frames_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool running_ = false;
+  std::thread writer_thread_;
+};
+
+// Memory-mapped reader, the records are read in place
+class FrameLogReader {
+public:
+  struct Record {
+    frame_log::RecordType type;
+    int64_t stamp_ns;
+    const unsigned char *payload;
+    size_t size;
+  };
+
+  FrameLogReader() = default;
+  ~FrameLogReader();
+  FrameLogReader(const FrameLogReader &) = delete;
+  FrameLogReader &operator=(const FrameLogReader &) = delete;
+
+  // Return: false if the file can't be mapped or isn't a frame log
+  bool open(const std::filesystem::path &file);
+  void close();
+
+  size_t size() const noexcept { return index_.size(); }
+  Record record(size_t i) const noexcept;
+  // Index of the first record at or after stamp_ns
+  size_t seek(int64_t stamp_ns) const noexcept;
+
+  const std::vector<frame_log::IndexEntry> &index() const noexcept { return index_; }
+
+private:
+  // Rebuild the index of a file without a trailer, stops at the first incomplete record
+  void scanRecords();
+
+  const unsigned char *data_ = nullptr;
+  size_t file_size_ = 0;
+  std::vector<frame_log::IndexEntry> index_;
+};
+}  // namespace fyt::camera_driver
+#endif  // RM_CAMERA_DRIVER_FRAME_LOG_HPP_
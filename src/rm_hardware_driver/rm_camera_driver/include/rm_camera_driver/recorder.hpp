@@ -19,35 +19,74 @@
 // std
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <filesystem>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 // OpenCV
+#include <opencv2/core.hpp>
 #include <opencv2/videoio.hpp>
+// project
+#include "rm_utils/bayer.hpp"
 
 namespace fyt::camera_driver {
+// Records frames shared with the camera, e.g. slots of its raw buffer pool: addFrame() never
+// copies nor blocks, the conversion and encoding run on the recorder thread and a frame is
+// released as soon as it is converted
 class Recorder {
 public:
   using Frame = std::vector<unsigned char>;
-  Recorder(const std::filesystem::path &file, int fps, cv::Size size);
+  using FramePtr = std::shared_ptr<const Frame>;
+
+  // MJPG is encoded by the CPU, the others are H.264 through GStreamer in a Matroska file
+  enum class Encoder { MJPG, X264, VAAPI, QSV, NVENC };
+  // Return: MJPG for an unknown name
+  static Encoder encoderFromString(const std::string &name) noexcept;
+
+  // pattern is the layout of raw frames, NONE for rgb8 frames
+  Recorder(const std::filesystem::path &file,
+           int fps,
+           cv::Size size,
+           utils::BayerPattern pattern = utils::BayerPattern::NONE,
+           Encoder encoder = Encoder::MJPG);
   ~Recorder();
 
-  void addFrame(const Frame &frame);
-  void start();
+  // The frame is dropped if QUEUE_SIZE frames are waiting
+  void addFrame(FramePtr frame);
+  // The recorder thread is pinned to cpu, -1 for no pinning
+  void start(int cpu = -1);
+  // Layout of the raw frames once the camera has read it, a raw recorder stays raw
+  void setPattern(utils::BayerPattern pattern) noexcept { pattern_ = pattern; }
   void stop();
 
+  uint64_t writtenFrames() const noexcept { return written_frames_; }
+  uint64_t droppedFrames() const noexcept { return dropped_frames_; }
+
   std::filesystem::path path;
 
 private:
   void recorderThread();
 
+  // GStreamer pipeline of encoder_ writing to path
+  std::string pipeline() const;
+
   cv::Size size_;
   int fps_;
+  std::atomic<utils::BayerPattern> pattern_;
+  Encoder encoder_;
   cv::VideoWriter writer_;
+  // Converted frame, reused
+  cv::Mat bgr_;
 
-  std::deque<Frame> frame_queue_;
+  // Frames held by the recorder, each one keeps a buffer of the camera
+  static constexpr size_t QUEUE_SIZE = 2;
+  std::deque<FramePtr> frame_queue_;
+  std::atomic<uint64_t> written_frames_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
 
   std::mutex mutex_;
   std::atomic<bool> recoring_;
@@ -0,0 +1,143 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_CAMERA_DRIVER_SHARED_FRAMES_HPP_
+#define RM_CAMERA_DRIVER_SHARED_FRAMES_HPP_
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+// project
+#include "rm_camera_driver/frame_log.hpp"
+
+namespace fyt::camera_driver {
+// Frames of a camera in a POSIX shared memory object (/dev/shm/<name>), for the debug viewers
+// and tools of other processes. They map it read-only and read the frames in place, the driver
+// copies every frame once whatever the number of readers and never waits for them
+//
+//   StoreHeader
+//   Slot 0: SlotHeader, data          every slot starts at a multiple of 64 bytes
+//   Slot 1 ...
+//
+// Frame n (from 1) goes to slot n % slot_count. Every slot is a seqlock: its seq is odd while
+// the frame is written and 2n once frame n is complete, a reader checks seq before and after
+// reading the slot and drops the frame if it changed. A reader has slot_count - 1 frame periods
+// to use a frame in place, or copies it
+namespace shared_frames {
+constexpr char MAGIC[8] = {'F', 'Y', 'T', 'S', 'H', 'M', 'F', '1'};
+constexpr uint32_t VERSION = 1;
+
+struct StoreHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t slot_count;
+  // Bytes of a slot including its header, and the largest frame data it holds
+  uint64_t slot_stride;
+  uint64_t slot_capacity;
+  // Number of the newest complete frame, 0 before the first one
+  std::atomic<uint64_t> latest;
+  // Set when the driver closes the store, a new driver creates a new object under the name
+  std::atomic<uint32_t> closed;
+  uint32_t reserved;
+};
+
+struct SlotHeader {
+  std::atomic<uint64_t> seq;
+  int64_t stamp_ns;
+  // Size of the data
+  uint64_t size;
+  frame_log::FrameHeader frame;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                std::atomic<uint32_t>::is_always_lock_free,
+              "the atomics are shared between processes");
+static_assert(sizeof(StoreHeader) == 48 && sizeof(SlotHeader) == 64,
+              "shared_frames structs must have no padding");
+
+constexpr size_t align64(size_t size) noexcept { return (size + 63) & ~size_t{63}; }
+}  // namespace shared_frames
+
+// The driver side. Not thread safe, write() is called by the process thread only
+class SharedFrameWriter {
+public:
+  SharedFrameWriter(std::string name, size_t slot_count, size_t slot_capacity);
+  ~SharedFrameWriter();
+  SharedFrameWriter(const SharedFrameWriter &) = delete;
+  SharedFrameWriter &operator=(const SharedFrameWriter &) = delete;
+
+  // Create the object, replacing one left by a killed driver
+  // Return: false if it can't be created or mapped
+  bool open();
+  // Mark the store closed and remove the name, the readers keep their mapping
+  void close();
+
+  // Return: false if the frame is larger than a slot and was skipped
+  bool write(int64_t stamp_ns,
+             const frame_log::FrameHeader &header,
+             const void *data,
+             size_t size) noexcept;
+
+  const std::string &name() const noexcept { return name_; }
+
+private:
+  std::string name_;
+  size_t slot_count_;
+  size_t slot_capacity_;
+  unsigned char *data_ = nullptr;
+  size_t size_ = 0;
+  uint64_t frame_number_ = 0;
+};
+
+// The tool side, maps the store read-only
+class SharedFrameReader {
+public:
+  struct Frame {
+    uint64_t number;
+    int64_t stamp_ns;
+    frame_log::FrameHeader header;
+    // In the shared memory, valid while valid() holds
+    const unsigned char *data;
+    size_t size;
+  };
+
+  SharedFrameReader() = default;
+  ~SharedFrameReader();
+  SharedFrameReader(const SharedFrameReader &) = delete;
+  SharedFrameReader &operator=(const SharedFrameReader &) = delete;
+
+  // Return: false if there is no store of that name or it isn't one
+  bool open(const std::string &name);
+  void close();
+
+  // True once the driver closed the store, open() again to follow a restarted driver
+  bool closed() const noexcept;
+  // Number of the newest frame, 0 if none
+  uint64_t latest() const noexcept;
+
+  // The newest frame, false if there is none newer than after or it is being overwritten
+  bool acquire(Frame &frame, uint64_t after = 0) const noexcept;
+  // Whether the data of the frame is still the frame, check it after reading the data
+  bool valid(const Frame &frame) const noexcept;
+
+private:
+  const shared_frames::SlotHeader *slot(uint64_t number) const noexcept;
+
+  const unsigned char *data_ = nullptr;
+  size_t size_ = 0;
+};
+}  // namespace fyt::camera_driver
+#endif  // RM_CAMERA_DRIVER_SHARED_FRAMES_HPP_
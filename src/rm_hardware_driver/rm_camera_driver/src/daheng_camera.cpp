@@ -15,7 +15,12 @@
 
 #include "rm_camera_driver/daheng_camera.hpp"
 // std
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <cstdlib>
 #include <ctime>
 #include <memory>
@@ -23,6 +28,7 @@
 #include <thread>
 // ros2
 #include <rclcpp/rate.hpp>
+#include <rclcpp/serialization.hpp>
 #include <rclcpp/utilities.hpp>
 // OpenCV
 #include <opencv2/imgproc.hpp>
@@ -31,17 +37,88 @@
 // Daheng Galaxy Driver
 #include "daheng/GxIAPI.h"
 // project
+#include "rm_utils/bayer.hpp"
 #include "rm_utils/logger/log.hpp"
+#include "rm_utils/thread_config.hpp"
+#include "rm_utils/trace.hpp"
 
-// Callback Wrapper for adapting GxAPI's interface;
-static std::function<void GX_STDC(GX_FRAME_CALLBACK_PARAM *)> g_callback;
-extern "C" void GX_STDC CallbackWrapper(GX_FRAME_CALLBACK_PARAM *arg) {
-  if (g_callback) {
-    g_callback(arg);
+namespace fyt::camera_driver {
+namespace {
+// GXInitLib/GXCloseLib are process-wide, several camera nodes may live in one container
+std::mutex g_lib_mutex;
+int g_lib_users = 0;
+
+bool acquireLib() {
+  std::lock_guard<std::mutex> lock(g_lib_mutex);
+  if (g_lib_users == 0 && GXInitLib() != GX_STATUS_SUCCESS) {
+    return false;
   }
+  g_lib_users++;
+  return true;
 }
 
-namespace fyt::camera_driver {
+void releaseLib() {
+  std::lock_guard<std::mutex> lock(g_lib_mutex);
+  if (g_lib_users > 0 && --g_lib_users == 0) {
+    GXCloseLib();
+  }
+}
+
+// CDR bytes of a message for the frame log
+template <typename MessageT>
+FrameLogWriter::Buffer serialize(const MessageT &msg) {
+  static rclcpp::Serialization<MessageT> serialization;
+  rclcpp::SerializedMessage serialized;
+  serialization.serialize_message(&msg, &serialized);
+  const auto &buffer = serialized.get_rcl_serialized_message();
+  return FrameLogWriter::Buffer(buffer.buffer, buffer.buffer + buffer.buffer_length);
+}
+
+// Layout of a DX_PIXEL_COLOR_FILTER
+utils::BayerPattern bayerPatternOf(int64_t filter) {
+  switch (filter) {
+    case BAYERGB:
+      return utils::BayerPattern::GBRG;
+    case BAYERGR:
+      return utils::BayerPattern::GRBG;
+    case BAYERBG:
+      return utils::BayerPattern::BGGR;
+    default:
+      return utils::BayerPattern::RGGB;
+  }
+}
+
+// 8-bit raw pixel format of a DX_PIXEL_COLOR_FILTER
+int64_t rawPixelFormat(int64_t filter) {
+  switch (filter) {
+    case BAYERGB:
+      return GX_PIXEL_FORMAT_BAYER_GB8;
+    case BAYERGR:
+      return GX_PIXEL_FORMAT_BAYER_GR8;
+    case BAYERBG:
+      return GX_PIXEL_FORMAT_BAYER_BG8;
+    default:
+      return GX_PIXEL_FORMAT_BAYER_RG8;
+  }
+}
+
+// The filter with red and blue exchanged, DxRaw8toRGB24 then writes the other channel order
+int64_t swapRedBlue(int64_t filter) {
+  switch (filter) {
+    case BAYERRG:
+      return BAYERBG;
+    case BAYERBG:
+      return BAYERRG;
+    case BAYERGB:
+      return BAYERGR;
+    case BAYERGR:
+      return BAYERGB;
+    default:
+      return filter;
+  }
+}
+}  // namespace
+
 DahengCameraNode::DahengCameraNode(const rclcpp::NodeOptions &options)
 : Node("camera_driver", options) {
   FYT_REGISTER_LOGGER("camera_driver", "~/fyt2024-log", INFO);
@@ -51,6 +128,8 @@ DahengCameraNode::DahengCameraNode(const rclcpp::NodeOptions &options)
   camera_info_url_ =
     this->declare_parameter("camera_info_url", "package://rm_bringup/config/camera_info.yaml");
   frame_id_ = this->declare_parameter("camera_frame_id", "camera_optical_frame");
+  device_sn_ = this->declare_parameter("device_sn", "");
+  device_index_ = this->declare_parameter("device_index", 1);
   pixel_format_ = this->declare_parameter("pixel_format", "rgb8");
   resolution_width_ = this->declare_parameter("resolution_width", 1280);
   resolution_height_ = this->declare_parameter("resolution_height", 1024);
@@ -60,24 +139,30 @@ DahengCameraNode::DahengCameraNode(const rclcpp::NodeOptions &options)
   gain_ = this->declare_parameter("gain", 5.0);
   offest_x_ = this->declare_parameter("offsetX", 0);
   offset_y_ = this->declare_parameter("offsetY", 0);
-  //为存储原始图像数据申请空间
+  hardware_timestamp_ = this->declare_parameter("hardware_timestamp", true);
+  transfer_delay_ns_ = this->declare_parameter("transfer_delay", 0) * int64_t{1000};
+  // 图像消息模板, 每帧的数据缓存在处理线程中申请, 以unique_ptr发布避免进程内通信的拷贝
   image_msg_.header.frame_id = frame_id_;
   image_msg_.encoding = pixel_format_;
   image_msg_.height = resolution_height_;
   image_msg_.width = resolution_width_;
   image_msg_.step = resolution_width_ * 3;
-  image_msg_.data.resize(image_msg_.height * image_msg_.step);
 
-  if (pixel_format_ == "mono8") {
+  // 直接发布原始Bayer图像, 由识别节点按需转换, 数据量为RGB的1/3
+  // 排列以传感器为准, 在open()中读取
+  raw_output_ = utils::bayerPattern(pixel_format_) != utils::BayerPattern::NONE;
+  if (raw_output_) {
+    gx_pixel_format_ = rawPixelFormat(gx_bayer_type_);
+    image_msg_.step = resolution_width_;
+  } else if (pixel_format_ == "mono8") {
     gx_pixel_format_ = GX_PIXEL_FORMAT_MONO8;
   } else if (pixel_format_ == "mono16") {
     gx_pixel_format_ = GX_PIXEL_FORMAT_MONO16;
   } else if (pixel_format_ == "bgr8") {
     gx_pixel_format_ = GX_PIXEL_FORMAT_BGR8;
-    gx_bayer_type_ = BAYERBG;
+    swap_red_blue_ = true;
   } else if (pixel_format_ == "rgb8") {
     gx_pixel_format_ = GX_PIXEL_FORMAT_RGB8;
-    gx_bayer_type_ = BAYERRG;
   } else if (pixel_format_ == "bgra8") {
     gx_pixel_format_ = GX_PIXEL_FORMAT_BGRA8;
   } else {
@@ -102,12 +187,54 @@ DahengCameraNode::DahengCameraNode(const rclcpp::NodeOptions &options)
   camera_info_.header.stamp = this->now();
 
   bool use_sensor_data_qos = this->declare_parameter("use_sensor_data_qos", true);
-  auto qos = use_sensor_data_qos ? rmw_qos_profile_sensor_data : rmw_qos_profile_default;
-  pub_ = image_transport::create_camera_publisher(this, "image_raw", qos);
+  auto qos = use_sensor_data_qos ? rclcpp::SensorDataQoS() : rclcpp::QoS(10);
+  // Plain rclcpp publishers, image_transport can't publish unique_ptr for intra-process
+  image_pub_ = this->create_publisher<sensor_msgs::msg::Image>("image_raw", qos);
+  camera_info_pub_ = this->create_publisher<sensor_msgs::msg::CameraInfo>("camera_info", qos);
+
+  // 接受识别节点请求的曝光与AOI, AOI在camera_info的roi中给出
+  if (this->declare_parameter("camera_control", false)) {
+    control_sub_ = this->create_subscription<rm_interfaces::msg::CameraControl>(
+      "camera_control",
+      rclcpp::QoS(1),
+      std::bind(&DahengCameraNode::controlCallback, this, std::placeholders::_1));
+  }
+
+  // Demosaic on its own thread, the SDK callback only copies the raw frame
+  for (size_t i = 0; i < RAW_POOL_SIZE; i++) {
+    free_raw_.push_back(i);
+  }
+  process_cpu_ = this->declare_parameter("process_cpu", -1);
+  process_running_ = true;
+  process_thread_ = std::thread(&DahengCameraNode::processThread, this);
+  if (process_cpu_ >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(process_cpu_, &cpu_set);
+    if (pthread_setaffinity_np(process_thread_.native_handle(), sizeof(cpu_set), &cpu_set) != 0) {
+      FYT_WARN("camera_driver", "Failed to pin the process thread to CPU {}", process_cpu_);
+    }
+  }
 
   // Heartbeat
   heartbeat_ = HeartBeatPublisher::create(this);
 
+  // Stall watchdog, a hung SDK is reopened within a few frames instead of the 5 s of the timer
+  watchdog_ = utils::declareStallWatchdog(*this, heartbeat_->metrics());
+  if (watchdog_ != nullptr) {
+    utils::StallWatchdog::Stage stage;
+    stage.name = "camera";
+    stage.progress = &published_frames_;
+    // 10 frames by default
+    const int64_t timeout_ms = std::max(100, 10000 / std::max(frame_rate_, 1));
+    stage.timeout =
+      std::chrono::milliseconds(this->declare_parameter("watchdog.timeout_ms", timeout_ms));
+    // Opening takes up to a second
+    stage.cooldown = std::chrono::milliseconds(2000);
+    stage.recover = [this]() { reopen(); };
+    watchdog_->watch(std::move(stage));
+  }
+
   // Check if camera is alive every seconds
   timer_ = this->create_wall_timer(std::chrono::milliseconds(1000),
                                    std::bind(&DahengCameraNode::timerCallback, this));
@@ -122,29 +249,103 @@ DahengCameraNode::DahengCameraNode(const rclcpp::NodeOptions &options)
     std::string home = std::getenv("HOME");
 
     namespace fs = std::filesystem;
-    std::filesystem::path video_path = fs::path(home) / "fyt2024-log/video/" /
-                                       std::string(std::to_string(std::time(nullptr)) + ".avi");
-
-    recorder_ = std::make_unique<Recorder>(
-      video_path, frame_rate_, cv::Size(resolution_width_, resolution_height_));
-    recorder_->start();
+    // 文件名带相机名, 多个相机同时录制时不会冲突
+    std::filesystem::path video_path =
+      fs::path(home) / "fyt2024-log/video/" /
+      std::string(std::to_string(std::time(nullptr)) + "_" + camera_name_ + ".avi");
+
+    // 录制原始图像, 去马赛克和编码在录像线程中进行
+    // 排列在open()中按传感器更新, 与发布的格式无关
+    const auto encoder =
+      Recorder::encoderFromString(this->declare_parameter("recording_encoder", "mjpg"));
+    recorder_ = std::make_unique<Recorder>(video_path,
+                                           frame_rate_,
+                                           cv::Size(resolution_width_, resolution_height_),
+                                           bayerPatternOf(gx_bayer_type_),
+                                           encoder);
+    recorder_->start(this->declare_parameter("recording_cpu", -1));
     FYT_INFO("camera_driver", "Recorder started! Video file: {}", video_path.string());
   }
 
+  // Frame log
+  if (this->declare_parameter("frame_log", false)) {
+    std::filesystem::path log_path =
+      std::filesystem::path(std::getenv("HOME")) / "fyt2024-log/frames/" /
+      std::string(std::to_string(std::time(nullptr)) + "_" + camera_name_ + ".fytlog");
+    frame_log_ = std::make_unique<FrameLogWriter>(log_path);
+    if (frame_log_->open()) {
+      frame_log_->addMessage(frame_log::RecordType::CAMERA_INFO,
+                             rclcpp::Time(camera_info_.header.stamp).nanoseconds(),
+                             serialize(camera_info_));
+      receive_data_sub_ = this->create_subscription<rm_interfaces::msg::SerialReceiveData>(
+        "serial/receive",
+        rclcpp::SensorDataQoS(),
+        [this](const rm_interfaces::msg::SerialReceiveData::SharedPtr msg) {
+          frame_log_->addMessage(frame_log::RecordType::RECEIVE_DATA,
+                                 rclcpp::Time(msg->header.stamp).nanoseconds(),
+                                 serialize(*msg));
+        });
+      FYT_INFO("camera_driver", "Frame log started! Log file: {}", log_path.string());
+    } else {
+      FYT_ERROR("camera_driver", "Failed to create the frame log {}", log_path.string());
+      frame_log_.reset();
+    }
+  }
+
+  // Shared memory frames, the raw frames at full resolution
+  if (this->declare_parameter("shared_frames.enable", false)) {
+    shared_frames_ = std::make_unique<SharedFrameWriter>(
+      this->declare_parameter("shared_frames.name", "fyt_frames_" + camera_name_),
+      static_cast<size_t>(std::max(this->declare_parameter("shared_frames.slots", 4), 2)),
+      static_cast<size_t>(resolution_width_) * resolution_height_);
+    if (shared_frames_->open()) {
+      FYT_INFO("camera_driver", "Sharing the frames in /dev/shm/{}", shared_frames_->name());
+    } else {
+      FYT_ERROR("camera_driver", "Failed to create /dev/shm/{}", shared_frames_->name());
+      shared_frames_.reset();
+    }
+  }
+
   FYT_INFO("camera_driver", "DahengCameraNode has been initialized!");
 }
 
 DahengCameraNode::~DahengCameraNode() {
+  // No reopening while the device is closed
+  watchdog_.reset();
   close();
+  {
+    std::lock_guard<std::mutex> lock(raw_mutex_);
+    process_running_ = false;
+  }
+  raw_cv_.notify_all();
+  if (process_thread_.joinable()) {
+    process_thread_.join();
+  }
+  if (shared_frames_ != nullptr) {
+    shared_frames_->close();
+  }
+  if (frame_log_ != nullptr) {
+    receive_data_sub_.reset();
+    frame_log_->close();
+    FYT_INFO("camera_driver",
+             "Frame log {} has been saved, {} frames written, {} dropped",
+             frame_log_->path.string(),
+             frame_log_->writtenFrames(),
+             frame_log_->droppedFrames());
+  }
   if (recorder_ != nullptr) {
     recorder_->stop();
-    FYT_INFO(
-      "camera_driver", "Recorder stopped! Video file {} has been saved", recorder_->path.string());
+    FYT_INFO("camera_driver",
+             "Recorder stopped! Video file {} has been saved, {} frames written, {} dropped",
+             recorder_->path.string(),
+             recorder_->writtenFrames(),
+             recorder_->droppedFrames());
   }
   FYT_INFO("camera_driver", "DahengCameraNode has been destroyed!");
 }
 
 void DahengCameraNode::timerCallback() {
+  std::lock_guard<std::mutex> lock(device_mutex_);
   // Open camera
   while (!is_open_ && rclcpp::ok()) {
     bool is_open_success = open();
@@ -160,6 +361,33 @@ void DahengCameraNode::timerCallback() {
     FYT_WARN("camera_driver", "Camera is not alive! lost frame for {:.2f} seconds", dt);
     close();
   }
+
+  if (recorder_ != nullptr && recorder_->droppedFrames() != recorder_dropped_) {
+    FYT_WARN("camera_driver",
+             "Recorder dropped {} frames in the last second",
+             recorder_->droppedFrames() - recorder_dropped_);
+    recorder_dropped_ = recorder_->droppedFrames();
+  }
+  if (frame_log_ != nullptr && frame_log_->droppedFrames() != frame_log_dropped_) {
+    FYT_WARN("camera_driver",
+             "Frame log dropped {} frames in the last second",
+             frame_log_->droppedFrames() - frame_log_dropped_);
+    frame_log_dropped_ = frame_log_->droppedFrames();
+  }
+}
+
+void DahengCameraNode::reopen() {
+  std::lock_guard<std::mutex> lock(device_mutex_);
+  // A closed camera is opened by the timer
+  if (!is_open_) {
+    return;
+  }
+  FYT_WARN("camera_driver", "The frames stalled, reopening the camera");
+  close();
+  if (!open()) {
+    FYT_ERROR("camera_driver", "open() failed");
+    close();
+  }
 }
 
 void DahengCameraNode::close() {
@@ -170,7 +398,10 @@ void DahengCameraNode::close() {
     GXCloseDevice(dev_handle_);
     // GXUnregisterCaptureCallback(dev_handle_);
   }
-  GXCloseLib();
+  if (lib_initialized_) {
+    releaseLib();
+    lib_initialized_ = false;
+  }
   is_open_ = false;
 }
 
@@ -184,13 +415,18 @@ bool DahengCameraNode::open() {
   GX_OPEN_PARAM openParam;
   uint32_t device_num = 0;
   openParam.accessMode = GX_ACCESS_EXCLUSIVE;
-  openParam.openMode = GX_OPEN_INDEX;
-  openParam.pszContent = (char *)"1";
+  // 按序列号或序号打开, 多个相机时序号取决于枚举顺序, 应使用序列号
+  const std::string index = std::to_string(device_index_);
+  openParam.openMode = device_sn_.empty() ? GX_OPEN_INDEX : GX_OPEN_SN;
+  openParam.pszContent =
+    const_cast<char *>(device_sn_.empty() ? index.c_str() : device_sn_.c_str());
   // 尝试初始化库
-  gx_status_ = GXInitLib();
-  if (gx_status_ != GX_STATUS_SUCCESS) {
-    FYT_ERROR("camera_driver", "Can't init lib");
-    return false;
+  if (!lib_initialized_) {
+    if (!acquireLib()) {
+      FYT_ERROR("camera_driver", "Can't init lib");
+      return false;
+    }
+    lib_initialized_ = true;
   }
 
   // 枚举设备列表
@@ -203,11 +439,26 @@ bool DahengCameraNode::open() {
   //打开设备
   gx_status_ = GXOpenDevice(&openParam, &dev_handle_);
   if (gx_status_ != GX_STATUS_SUCCESS) {
-    FYT_ERROR("camera_driver", "Can't open device");
+    FYT_ERROR("camera_driver", "Can't open device {}", openParam.pszContent);
     return false;
   }
   is_open_ = true;
 
+  // 读取传感器的Bayer排列, 发布的原始图像、录像和帧日志都按它解释
+  int64_t color_filter = GX_COLOR_FILTER_NONE;
+  if (GXGetEnum(dev_handle_, GX_ENUM_PIXEL_COLOR_FILTER, &color_filter) == GX_STATUS_SUCCESS &&
+      color_filter != GX_COLOR_FILTER_NONE) {
+    gx_bayer_type_ = color_filter;
+  } else {
+    FYT_WARN("camera_driver", "Can't read the color filter, assuming RGGB");
+  }
+  if (raw_output_) {
+    gx_pixel_format_ = rawPixelFormat(gx_bayer_type_);
+  }
+  if (recorder_ != nullptr) {
+    recorder_->setPattern(bayerPatternOf(gx_bayer_type_));
+  }
+
   GXGetInt(dev_handle_, GX_INT_WIDTH_MAX, &max_resolution_width_);
   GXGetInt(dev_handle_, GX_INT_HEIGHT_MAX, &max_resolution_height_);
 
@@ -225,9 +476,27 @@ bool DahengCameraNode::open() {
   //  GX_REGION_SELECTOR_REGION0);
   GXSetInt(dev_handle_, GX_INT_OFFSET_X, offest_x_);
   GXSetInt(dev_handle_, GX_INT_OFFSET_Y, offset_y_);
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    aoi_x_ = aoi_y_ = 0;
+    aoi_width_ = resolution_width_;
+    aoi_height_ = resolution_height_;
+  }
+
+  // 获取时间戳频率, 重新打开后设备时间戳从0开始
+  int64_t tick_frequency = 0;
+  GXGetInt(dev_handle_, GX_INT_TIMESTAMP_TICK_FREQUENCY, &tick_frequency);
+  device_clock_.setTickPeriod(tick_frequency > 0 ? 1e9 / tick_frequency : 1.0);
 
   // 获取图像大小
   GXGetInt(dev_handle_, GX_INT_PAYLOAD_SIZE, &gx_pay_load_size_);
+  // 预先分配原始图像缓存, 正在处理的帧所在的缓存下一帧到来时才扩容
+  {
+    std::lock_guard<std::mutex> lock(raw_mutex_);
+    for (size_t i : free_raw_) {
+      raw_pool_[i].data.reserve(gx_pay_load_size_);
+    }
+  }
   //设置是否开启自动白平衡
   if (auto_white_balance_) {
     GXSetEnum(dev_handle_, GX_ENUM_BALANCE_WHITE_AUTO, 1);
@@ -248,10 +517,8 @@ bool DahengCameraNode::open() {
   GXSetEnum(dev_handle_, GX_ENUM_ACQUISITION_MODE, GX_ACQ_MODE_CONTINUOUS);
   GXSetInt(dev_handle_, GX_INT_ACQUISITION_SPEED_LEVEL, 1);
 
-  //注册图像处理回调函数
-  // void (*)(GX_FRAME_CALLBACK_PARAM *)
-  g_callback = std::bind(&DahengCameraNode::onFrameCallbackFun, this, std::placeholders::_1);
-  gx_status_ = GXRegisterCaptureCallback(dev_handle_, nullptr, CallbackWrapper);
+  //注册图像处理回调函数, 以this为用户参数区分不同相机
+  gx_status_ = GXRegisterCaptureCallback(dev_handle_, this, &DahengCameraNode::frameCallback);
   if (gx_status_ != GX_STATUS_SUCCESS) {
     FYT_ERROR("camera_driver", "Register capture callback function failed!");
     return false;
@@ -267,22 +534,215 @@ bool DahengCameraNode::open() {
   return true;
 }
 
+void GX_STDC DahengCameraNode::frameCallback(GX_FRAME_CALLBACK_PARAM *pFrame) {
+  // The thread of the SDK, configured by the first frame
+  static thread_local bool configured = false;
+  if (!configured) {
+    utils::configureThread("camera_sdk");
+    configured = true;
+  }
+  static_cast<DahengCameraNode *>(pFrame->pUserParam)->onFrameCallbackFun(pFrame);
+}
+
 void GX_STDC DahengCameraNode::onFrameCallbackFun(GX_FRAME_CALLBACK_PARAM *pFrame) {
-  if (pFrame->status == GX_FRAME_STATUS_SUCCESS) {
-    // RGB转换
-    DxRaw8toRGB24((void *)pFrame->pImgBuf,
-                  image_msg_.data.data(),
-                  pFrame->nWidth,
-                  pFrame->nHeight,
-                  RAW2RGB_NEIGHBOUR,
-                  static_cast<DX_PIXEL_COLOR_FILTER>(gx_bayer_type_),
-                  false);
-    image_msg_.header.stamp = camera_info_.header.stamp = this->now();
-    pub_.publish(image_msg_, camera_info_);
-    if (recorder_ != nullptr) {
-      recorder_->addFrame(image_msg_.data);
+  if (pFrame->status != GX_FRAME_STATUS_SUCCESS) {
+    return;
+  }
+  rclcpp::Time stamp = this->now();
+  if (hardware_timestamp_) {
+    if (device_clock_reset_.exchange(false)) {
+      device_clock_.reset();
+    }
+    // The fastest frame arrives at the end of the exposure plus the transfer delay
+    const int64_t arrival_ns = device_clock_.update(pFrame->nTimestamp, stamp.nanoseconds());
+    stamp = rclcpp::Time(arrival_ns - int64_t{exposure_time_} * 500 - transfer_delay_ns_,
+                         stamp.get_clock_type());
+  }
+
+  size_t index;
+  {
+    std::lock_guard<std::mutex> lock(raw_mutex_);
+    if (!free_raw_.empty()) {
+      index = free_raw_.back();
+      free_raw_.pop_back();
+    } else if (!ready_raw_.empty()) {
+      // The process thread falls behind, drop the oldest frame
+      index = ready_raw_.front();
+      ready_raw_.pop_front();
+    } else {
+      return;
+    }
+  }
+
+  // Nobody else touches the frame until it is ready
+  RawFrame &frame = raw_pool_[index];
+  frame.data.resize(pFrame->nImgSize);
+  std::memcpy(frame.data.data(), pFrame->pImgBuf, pFrame->nImgSize);
+  frame.width = pFrame->nWidth;
+  frame.height = pFrame->nHeight;
+  frame.offset_x = pFrame->nOffsetX;
+  frame.offset_y = pFrame->nOffsetY;
+  frame.stamp = stamp;
+
+  {
+    std::lock_guard<std::mutex> lock(raw_mutex_);
+    ready_raw_.push_back(index);
+  }
+  raw_cv_.notify_one();
+}
+
+void DahengCameraNode::processThread() {
+  utils::configureThread("camera_process");
+  while (true) {
+    size_t index;
+    {
+      std::unique_lock<std::mutex> lock(raw_mutex_);
+      raw_cv_.wait(lock, [this] { return !process_running_ || !ready_raw_.empty(); });
+      if (!process_running_) {
+        return;
+      }
+      index = ready_raw_.front();
+      ready_raw_.pop_front();
+    }
+
+    const RawFrame &frame = raw_pool_[index];
+    const int64_t bayer_type = gx_bayer_type_;
+    utils::TraceScope trace(utils::TraceStage::CAMERA_GRAB, frame.stamp.nanoseconds());
+    // The recorder may share the raw frame, it goes back to the pool once both are done
+    Recorder::FramePtr raw_data(&frame.data,
+                                [this, index](const Recorder::Frame *) { releaseRaw(index); });
+    // The ownership is moved to the subscribers, so the frame is never copied in the container
+    auto image_msg = std::make_unique<sensor_msgs::msg::Image>(image_msg_);
+    image_msg->width = frame.width;
+    image_msg->height = frame.height;
+    image_msg->step = raw_output_ ? frame.width : frame.width * 3;
+    image_msg->data.resize(image_msg->height * image_msg->step);
+    if (raw_output_) {
+      image_msg->encoding = utils::bayerEncoding(bayerPatternOf(bayer_type));
+      std::memcpy(image_msg->data.data(),
+                  frame.data.data(),
+                  std::min(frame.data.size(), image_msg->data.size()));
+    } else {
+      // RGB转换
+      DxRaw8toRGB24((void *)frame.data.data(),
+                    image_msg->data.data(),
+                    frame.width,
+                    frame.height,
+                    RAW2RGB_NEIGHBOUR,
+                    static_cast<DX_PIXEL_COLOR_FILTER>(
+                      swap_red_blue_ ? swapRedBlue(bayer_type) : bayer_type),
+                    false);
     }
+    image_msg->header.stamp = camera_info_.header.stamp = frame.stamp;
+    // The calibration is of the configured frame, a smaller AOI is given by the roi
+    const bool full_frame = frame.width == resolution_width_ && frame.height == resolution_height_;
+    camera_info_.roi.x_offset = full_frame ? 0 : frame.offset_x - offest_x_;
+    camera_info_.roi.y_offset = full_frame ? 0 : frame.offset_y - offset_y_;
+    camera_info_.roi.width = full_frame ? 0 : frame.width;
+    camera_info_.roi.height = full_frame ? 0 : frame.height;
+
+    // The video is of the configured frame size
+    if (recorder_ != nullptr && full_frame) {
+      recorder_->addFrame(raw_data);
+    }
+    if (frame_log_ != nullptr || shared_frames_ != nullptr) {
+      frame_log::FrameHeader header = {};
+      header.width = frame.width;
+      header.height = frame.height;
+      header.step = frame.width;
+      header.x_offset = camera_info_.roi.x_offset;
+      header.y_offset = camera_info_.roi.y_offset;
+      std::strncpy(header.encoding,
+                   utils::bayerEncoding(bayerPatternOf(bayer_type)).c_str(),
+                   sizeof(header.encoding) - 1);
+      if (frame_log_ != nullptr) {
+        frame_log_->addFrame(frame.stamp.nanoseconds(), header, raw_data);
+      }
+      // One copy per frame whatever the number of readers, they never hold the camera
+      if (shared_frames_ != nullptr) {
+        shared_frames_->write(frame.stamp.nanoseconds(),
+                              header,
+                              frame.data.data(),
+                              std::min<size_t>(frame.data.size(), header.step * header.height));
+      }
+    }
+    raw_data.reset();
+    camera_info_pub_->publish(camera_info_);
+    image_pub_->publish(std::move(image_msg));
+    published_frames_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void DahengCameraNode::controlCallback(const rm_interfaces::msg::CameraControl::SharedPtr msg) {
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  if (!is_open_) {
+    return;
   }
+
+  if (msg->exposure_time > 0 && msg->exposure_time != exposure_time_) {
+    exposure_time_ = msg->exposure_time;
+    GXSetFloat(dev_handle_, GX_FLOAT_EXPOSURE_TIME, static_cast<double>(exposure_time_));
+    device_clock_reset_ = true;
+  }
+
+  // Round the requested area outwards to the increments of the sensor, inside the configured
+  // frame. Zero width or height for the configured frame
+  int x = 0, y = 0, width = resolution_width_, height = resolution_height_;
+  if (msg->width > 0 && msg->height > 0) {
+    GX_INT_RANGE x_range, y_range, width_range, height_range;
+    GXGetIntRange(dev_handle_, GX_INT_OFFSET_X, &x_range);
+    GXGetIntRange(dev_handle_, GX_INT_OFFSET_Y, &y_range);
+    GXGetIntRange(dev_handle_, GX_INT_WIDTH, &width_range);
+    GXGetIntRange(dev_handle_, GX_INT_HEIGHT, &height_range);
+    auto fit = [](int64_t begin,
+                  int64_t end,
+                  int64_t full,
+                  const GX_INT_RANGE &offset_range,
+                  const GX_INT_RANGE &size_range,
+                  int &offset,
+                  int &size) {
+      const int64_t offset_inc = std::max<int64_t>(offset_range.nInc, 1);
+      const int64_t size_inc = std::max<int64_t>(size_range.nInc, 1);
+      int64_t s = std::max(end - begin, size_range.nMin);
+      s = std::min((s + size_inc - 1) / size_inc * size_inc, full);
+      int64_t o = std::clamp<int64_t>(begin, 0, full - s);
+      offset = o / offset_inc * offset_inc;
+      size = s;
+    };
+    fit(msg->x_offset, int64_t{msg->x_offset} + msg->width, resolution_width_, x_range,
+        width_range, x, width);
+    fit(msg->y_offset, int64_t{msg->y_offset} + msg->height, resolution_height_, y_range,
+        height_range, y, height);
+  }
+  if (x == aoi_x_ && y == aoi_y_ && width == aoi_width_ && height == aoi_height_) {
+    return;
+  }
+
+  // The size can't be changed during acquisition. The offsets are cleared first, so that any
+  // size is valid
+  GXStreamOff(dev_handle_);
+  GXSetInt(dev_handle_, GX_INT_OFFSET_X, 0);
+  GXSetInt(dev_handle_, GX_INT_OFFSET_Y, 0);
+  GXSetInt(dev_handle_, GX_INT_WIDTH, width);
+  GXSetInt(dev_handle_, GX_INT_HEIGHT, height);
+  GXSetInt(dev_handle_, GX_INT_OFFSET_X, offest_x_ + x);
+  GXSetInt(dev_handle_, GX_INT_OFFSET_Y, offset_y_ + y);
+  GXGetInt(dev_handle_, GX_INT_PAYLOAD_SIZE, &gx_pay_load_size_);
+  gx_status_ = GXStreamOn(dev_handle_);
+  if (gx_status_ != GX_STATUS_SUCCESS) {
+    FYT_ERROR("camera_driver", "Failed to restart the stream with the new AOI!");
+    return;
+  }
+  aoi_x_ = x;
+  aoi_y_ = y;
+  aoi_width_ = width;
+  aoi_height_ = height;
+  FYT_DEBUG("camera_driver", "Set AOI: x {} y {} width {} height {}", x, y, width, height);
+}
+
+void DahengCameraNode::releaseRaw(size_t index) {
+  std::lock_guard<std::mutex> lock(raw_mutex_);
+  free_raw_.push_back(index);
 }
 
 rcl_interfaces::msg::SetParametersResult DahengCameraNode::onSetParameters(
@@ -293,6 +753,8 @@ rcl_interfaces::msg::SetParametersResult DahengCameraNode::onSetParameters(
     if (param.get_name() == "exposure_time") {
       exposure_time_ = param.as_int();
       GXSetFloat(dev_handle_, GX_FLOAT_EXPOSURE_TIME, static_cast<double>(exposure_time_));
+      // The delay of the frames changes with the exposure
+      device_clock_reset_ = true;
       FYT_INFO("camera_driver", "Set exposure_time: {}", exposure_time_);
     } else if (param.get_name() == "gain") {
       gain_ = param.as_double();
@@ -0,0 +1,252 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_camera_driver/frame_log.hpp"
+// std
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+// project
+#include "rm_utils/thread_config.hpp"
+
+namespace fyt::camera_driver {
+using namespace frame_log;
+
+FrameLogWriter::FrameLogWriter(const std::filesystem::path &file) : path(file) {}
+
+FrameLogWriter::~FrameLogWriter() { close(); }
+
+bool FrameLogWriter::open() {
+  std::filesystem::create_directories(path.parent_path());
+  file_ = std::fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    return false;
+  }
+  // Frames are large, write them in big chunks
+  std::setvbuf(file_, nullptr, _IOFBF, 1 << 22);
+
+  FileHeader header = {};
+  std::memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+  header.version = VERSION;
+  std::fwrite(&header, sizeof(header), 1, file_);
+  file_offset_ = sizeof(header);
+
+  running_ = true;
+  writer_thread_ = std::thread(&FrameLogWriter::writerThread, this);
+  return true;
+}
+
+void FrameLogWriter::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+  }
+  cv_.notify_all();
+  writer_thread_.join();
+
+  // The records still queued are written before the index
+  for (const auto &record : queue_) {
+    writeRecord(record);
+  }
+  queue_.clear();
+
+  Trailer trailer = {};
+  trailer.index_offset = file_offset_;
+  trailer.index_size = index_.size();
+  std::memcpy(trailer.magic, INDEX_MAGIC, sizeof(trailer.magic));
+  std::fwrite(index_.data(), sizeof(IndexEntry), index_.size(), file_);
+  std::fwrite(&trailer, sizeof(trailer), 1, file_);
+  std::fclose(file_);
+  file_ = nullptr;
+}
+
+void FrameLogWriter::addFrame(int64_t stamp_ns, const FrameHeader &header, BufferPtr data) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+      return;
+    }
+    // The camera gets its buffer back at once
+    if (queued_frames_ >= MAX_FRAMES || queue_.size() >= MAX_RECORDS) {
+      dropped_frames_++;
+      return;
+    }
+    queue_.push_back(Record{RecordType::FRAME, stamp_ns, header, std::move(data)});
+    queued_frames_++;
+  }
+  cv_.notify_one();
+}
+
+void FrameLogWriter::addMessage(RecordType type, int64_t stamp_ns, Buffer data) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || queue_.size() >= MAX_RECORDS) {
+      return;
+    }
+    queue_.push_back(
+      Record{type, stamp_ns, FrameHeader{}, std::make_shared<const Buffer>(std::move(data))});
+  }
+  cv_.notify_one();
+}
+
+void FrameLogWriter::writerThread() {
+  utils::configureThread("frame_log");
+  while (true) {
+    Record record;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return !queue_.empty() || !running_; });
+      if (!running_) {
+        return;
+      }
+      record = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    writeRecord(record);
+    if (record.type == RecordType::FRAME) {
+      record.data.reset();
+      std::lock_guard<std::mutex> lock(mutex_);
+      queued_frames_--;
+    }
+  }
+}
+
+void FrameLogWriter::writeRecord(const Record &record) {
+  const bool is_frame = record.type == RecordType::FRAME;
+  const size_t data_size = record.data != nullptr ? record.data->size() : 0;
+
+  RecordHeader header = {};
+  header.type = static_cast<uint32_t>(record.type);
+  header.stamp_ns = record.stamp_ns;
+  header.size = (is_frame ? sizeof(FrameHeader) : 0) + data_size;
+
+  index_.push_back(
+    IndexEntry{record.stamp_ns, file_offset_, static_cast<uint32_t>(record.type), 0});
+
+  std::fwrite(&header, sizeof(header), 1, file_);
+  if (is_frame) {
+    std::fwrite(&record.frame_header, sizeof(FrameHeader), 1, file_);
+  }
+  if (data_size > 0) {
+    std::fwrite(record.data->data(), 1, data_size, file_);
+  }
+  static constexpr char padding[8] = {};
+  const size_t padded = align8(header.size);
+  std::fwrite(padding, 1, padded - header.size, file_);
+  file_offset_ += sizeof(header) + padded;
+  if (is_frame) {
+    written_frames_++;
+  }
+}
+
+FrameLogReader::~FrameLogReader() { close(); }
+
+bool FrameLogReader::open(const std::filesystem::path &file) {
+  close();
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+    ::close(fd);
+    return false;
+  }
+  file_size_ = st.st_size;
+  void *data = ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    file_size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const unsigned char *>(data);
+  // The records are mostly read in order
+  ::madvise(data, file_size_, MADV_SEQUENTIAL);
+
+  FileHeader header;
+  std::memcpy(&header, data_, sizeof(header));
+  if (std::memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != VERSION) {
+    close();
+    return false;
+  }
+
+  Trailer trailer;
+  bool has_index = false;
+  if (file_size_ >= sizeof(FileHeader) + sizeof(Trailer)) {
+    std::memcpy(&trailer, data_ + file_size_ - sizeof(Trailer), sizeof(trailer));
+    has_index = std::memcmp(trailer.magic, INDEX_MAGIC, sizeof(trailer.magic)) == 0 &&
+                trailer.index_offset + trailer.index_size * sizeof(IndexEntry) + sizeof(Trailer) ==
+                  file_size_;
+  }
+  if (has_index) {
+    index_.resize(trailer.index_size);
+    std::memcpy(
+      index_.data(), data_ + trailer.index_offset, trailer.index_size * sizeof(IndexEntry));
+  } else {
+    scanRecords();
+  }
+  return true;
+}
+
+void FrameLogReader::close() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<unsigned char *>(data_), file_size_);
+  }
+  data_ = nullptr;
+  file_size_ = 0;
+  index_.clear();
+}
+
+void FrameLogReader::scanRecords() {
+  size_t offset = sizeof(FileHeader);
+  while (offset + sizeof(RecordHeader) <= file_size_) {
+    RecordHeader header;
+    std::memcpy(&header, data_ + offset, sizeof(header));
+    const size_t end = offset + sizeof(header) + align8(header.size);
+    if (header.type < static_cast<uint32_t>(RecordType::CAMERA_INFO) ||
+        header.type > static_cast<uint32_t>(RecordType::RECEIVE_DATA) || end > file_size_) {
+      break;
+    }
+    index_.push_back(IndexEntry{header.stamp_ns, offset, header.type, 0});
+    offset = end;
+  }
+}
+
+FrameLogReader::Record FrameLogReader::record(size_t i) const noexcept {
+  const IndexEntry &entry = index_[i];
+  RecordHeader header;
+  std::memcpy(&header, data_ + entry.offset, sizeof(header));
+  return Record{static_cast<RecordType>(header.type),
+                header.stamp_ns,
+                data_ + entry.offset + sizeof(header),
+                static_cast<size_t>(header.size)};
+}
+
+size_t FrameLogReader::seek(int64_t stamp_ns) const noexcept {
+  // Records are in arrival order, the stamps of different streams may interleave slightly
+  auto it = std::find_if(index_.begin(), index_.end(), [stamp_ns](const IndexEntry &entry) {
+    return entry.stamp_ns >= stamp_ns;
+  });
+  return it - index_.begin();
+}
+}  // namespace fyt::camera_driver
@@ -0,0 +1,184 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+// ros2
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp/serialization.hpp>
+#include <sensor_msgs/msg/camera_info.hpp>
+#include <sensor_msgs/msg/image.hpp>
+// project
+#include "rm_camera_driver/frame_log.hpp"
+#include "rm_interfaces/msg/serial_receive_data.hpp"
+#include "rm_utils/heartbeat.hpp"
+#include "rm_utils/logger/log.hpp"
+#include "rm_utils/thread_config.hpp"
+
+namespace fyt::camera_driver {
+// Replays a frame log of DahengCameraNode: the raw frames, the camera info and the attitude
+// stream in their original order, either at the original timing or as fast as possible
+class FrameLogPlayerNode : public rclcpp::Node {
+public:
+  explicit FrameLogPlayerNode(const rclcpp::NodeOptions &options) : Node("camera_driver", options) {
+    FYT_REGISTER_LOGGER("camera_driver", "~/fyt2024-log", INFO);
+    FYT_INFO("camera_driver", "Starting FrameLogPlayerNode!");
+    log_path_ = this->declare_parameter("path", "");
+    rate_ = this->declare_parameter("rate", 1.0);
+    start_time_ = this->declare_parameter("start_time", 0.0);
+    is_loop_ = this->declare_parameter("keep_looping", false);
+    use_original_stamps_ = this->declare_parameter("use_original_stamps", false);
+
+    if (!reader_.open(log_path_)) {
+      FYT_ERROR("camera_driver", "Failed to open the frame log {}", log_path_);
+      rclcpp::shutdown();
+      return;
+    }
+    FYT_INFO("camera_driver", "Frame log {} has {} records", log_path_, reader_.size());
+
+    // Heartbeat
+    heartbeat_ = HeartBeatPublisher::create(this);
+
+    // unique_ptr is published to avoid copies in intra-process comms
+    image_pub_ = this->create_publisher<sensor_msgs::msg::Image>("image_raw", 10);
+    camera_info_pub_ = this->create_publisher<sensor_msgs::msg::CameraInfo>("camera_info", 10);
+    receive_data_pub_ =
+      this->create_publisher<rm_interfaces::msg::SerialReceiveData>("serial/receive", 10);
+
+    play_thread_ = std::thread(&FrameLogPlayerNode::playLoop, this);
+  }
+
+  ~FrameLogPlayerNode() override {
+    running_ = false;
+    if (play_thread_.joinable()) {
+      play_thread_.join();
+    }
+  }
+
+private:
+  void playLoop() {
+    utils::configureThread("frame_log_play");
+    if (reader_.size() == 0) {
+      return;
+    }
+    rclcpp::Serialization<sensor_msgs::msg::CameraInfo> camera_info_serialization;
+    rclcpp::Serialization<rm_interfaces::msg::SerialReceiveData> receive_data_serialization;
+    sensor_msgs::msg::CameraInfo camera_info;
+    rm_interfaces::msg::SerialReceiveData receive_data;
+
+    const int64_t first_stamp = reader_.record(0).stamp_ns;
+    const size_t start = reader_.seek(first_stamp + static_cast<int64_t>(start_time_ * 1e9));
+    do {
+      // Timing is relative to the first record played, stamps are moved to now unless the
+      // original ones are used
+      const int64_t begin_stamp = reader_.record(std::min(start, reader_.size() - 1)).stamp_ns;
+      const auto begin_wall = std::chrono::steady_clock::now();
+      const int64_t stamp_offset =
+        use_original_stamps_ ? 0 : this->now().nanoseconds() - begin_stamp;
+
+      for (size_t i = start; i < reader_.size() && running_ && rclcpp::ok(); i++) {
+        const auto record = reader_.record(i);
+        if (rate_ > 0) {
+          std::this_thread::sleep_until(
+            begin_wall + std::chrono::nanoseconds(
+                           static_cast<int64_t>((record.stamp_ns - begin_stamp) / rate_)));
+        }
+        const rclcpp::Time stamp(record.stamp_ns + stamp_offset,
+                                 this->get_clock()->get_clock_type());
+
+        switch (record.type) {
+          case frame_log::RecordType::CAMERA_INFO: {
+            deserialize(camera_info_serialization, record, camera_info);
+            break;
+          }
+          case frame_log::RecordType::RECEIVE_DATA: {
+            deserialize(receive_data_serialization, record, receive_data);
+            receive_data.header.stamp = stamp;
+            receive_data_pub_->publish(receive_data);
+            break;
+          }
+          case frame_log::RecordType::FRAME: {
+            if (record.size < sizeof(frame_log::FrameHeader)) {
+              break;
+            }
+            frame_log::FrameHeader header;
+            std::memcpy(&header, record.payload, sizeof(header));
+            const size_t data_size = std::min<size_t>(record.size - sizeof(header),
+                                                      size_t{header.step} * header.height);
+            auto image_msg = std::make_unique<sensor_msgs::msg::Image>();
+            image_msg->header.frame_id = camera_info.header.frame_id;
+            image_msg->header.stamp = stamp;
+            image_msg->encoding = header.encoding;
+            image_msg->width = header.width;
+            image_msg->height = header.height;
+            image_msg->step = header.step;
+            image_msg->data.resize(size_t{header.step} * header.height);
+            std::memcpy(image_msg->data.data(), record.payload + sizeof(header), data_size);
+
+            const bool full_frame =
+              header.width == camera_info.width && header.height == camera_info.height;
+            camera_info.header.stamp = stamp;
+            camera_info.roi.x_offset = full_frame ? 0 : header.x_offset;
+            camera_info.roi.y_offset = full_frame ? 0 : header.y_offset;
+            camera_info.roi.width = full_frame ? 0 : header.width;
+            camera_info.roi.height = full_frame ? 0 : header.height;
+            camera_info_pub_->publish(camera_info);
+            image_pub_->publish(std::move(image_msg));
+            break;
+          }
+        }
+      }
+      FYT_INFO("camera_driver", "Frame log ends!");
+    } while (is_loop_ && running_ && rclcpp::ok());
+  }
+
+  template <typename MessageT>
+  static void deserialize(rclcpp::Serialization<MessageT> &serialization,
+                          const FrameLogReader::Record &record,
+                          MessageT &msg) {
+    rclcpp::SerializedMessage serialized(record.size);
+    auto &buffer = serialized.get_rcl_serialized_message();
+    std::memcpy(buffer.buffer, record.payload, record.size);
+    buffer.buffer_length = record.size;
+    serialization.deserialize_message(&serialized, &msg);
+  }
+
+  HeartBeatPublisher::SharedPtr heartbeat_;
+  std::string log_path_;
+  // Playback speed over the original timing, 0 for as fast as possible
+  double rate_;
+  // Start of the playback from the first record, Unit: s
+  double start_time_;
+  bool is_loop_;
+  bool use_original_stamps_;
+
+  FrameLogReader reader_;
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_pub_;
+  rclcpp::Publisher<sensor_msgs::msg::CameraInfo>::SharedPtr camera_info_pub_;
+  rclcpp::Publisher<rm_interfaces::msg::SerialReceiveData>::SharedPtr receive_data_pub_;
+
+  std::atomic<bool> running_{true};
+  std::thread play_thread_;
+};
+}  // namespace fyt::camera_driver
+
+#include "rclcpp_components/register_node_macro.hpp"
+RCLCPP_COMPONENTS_REGISTER_NODE(fyt::camera_driver::FrameLogPlayerNode)
@@ -15,45 +15,121 @@
 
 #include "rm_camera_driver/recorder.hpp"
 // std
+#include <pthread.h>
+#include <sched.h>
+
 #include <filesystem>
 // OpenCV
 #include <opencv2/opencv.hpp>
 // project
 #include "rm_utils/logger/log.hpp"
+#include "rm_utils/thread_config.hpp"
 
 namespace fyt::camera_driver {
-Recorder::Recorder(const std::filesystem::path &file, int fps, cv::Size size)
-: path(file), size_(size), fps_(fps) {}
+Recorder::Encoder Recorder::encoderFromString(const std::string &name) noexcept {
+  if (name == "x264") {
+    return Encoder::X264;
+  } else if (name == "vaapi") {
+    return Encoder::VAAPI;
+  } else if (name == "qsv") {
+    return Encoder::QSV;
+  } else if (name == "nvenc") {
+    return Encoder::NVENC;
+  }
+  return Encoder::MJPG;
+}
+
+Recorder::Recorder(const std::filesystem::path &file,
+                   int fps,
+                   cv::Size size,
+                   utils::BayerPattern pattern,
+                   Encoder encoder)
+: path(file), size_(size), fps_(fps), pattern_(pattern), encoder_(encoder) {
+  if (encoder_ != Encoder::MJPG) {
+    path.replace_extension(".mkv");
+  }
+}
 
-void Recorder::start() {
+std::string Recorder::pipeline() const {
+  std::string encode;
+  switch (encoder_) {
+    case Encoder::X264:
+      encode = "x264enc speed-preset=ultrafast tune=zerolatency";
+      break;
+    case Encoder::VAAPI:
+      encode = "vaapih264enc";
+      break;
+    case Encoder::QSV:
+      encode = "msdkh264enc";
+      break;
+    case Encoder::NVENC:
+      encode = "nvh264enc";
+      break;
+    default:
+      return "";
+  }
+  return "appsrc ! videoconvert ! " + encode + " ! h264parse ! matroskamux ! filesink location=" +
+         path.string();
+}
+
+void Recorder::start(int cpu) {
   if (!std::filesystem::exists(path)) {
     std::filesystem::create_directories(path.parent_path());
   }
 
-  writer_.open(path.string(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps_, size_, true);
+  if (encoder_ != Encoder::MJPG) {
+    writer_.open(pipeline(), cv::CAP_GSTREAMER, 0, fps_, size_, true);
+    if (!writer_.isOpened()) {
+      FYT_WARN("camera_driver", "Failed to open the pipeline: {}, fall back to MJPG", pipeline());
+      encoder_ = Encoder::MJPG;
+      path.replace_extension(".avi");
+    }
+  }
+  if (encoder_ == Encoder::MJPG) {
+    writer_.open(path.string(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps_, size_, true);
+  }
   recoring_ = true;
   recorder_thread_ = std::thread(&Recorder::recorderThread, this);
+  if (cpu >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    if (pthread_setaffinity_np(recorder_thread_.native_handle(), sizeof(cpu_set), &cpu_set) != 0) {
+      FYT_WARN("camera_driver", "Failed to pin the recorder thread to CPU {}", cpu);
+    }
+  }
 }
 
 Recorder::~Recorder() { stop(); }
 
-void Recorder::addFrame(const Frame &frame) {
-  mutex_.lock();
-  // Keep the queue size
-  if (frame_queue_.size() < 5) {
-    frame_queue_.push_back(frame);
+void Recorder::addFrame(FramePtr frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Keep the queue size, the camera gets its buffer back at once
+    if (frame_queue_.size() >= QUEUE_SIZE) {
+      dropped_frames_++;
+      return;
+    }
+    frame_queue_.push_back(std::move(frame));
   }
-  mutex_.unlock();
   cv_.notify_one();
 }
 
 void Recorder::stop() {
   recoring_ = false;
   cv_.notify_all();
-  recorder_thread_.join();
+  if (recorder_thread_.joinable()) {
+    recorder_thread_.join();
+  }
+  // Give the buffers back to the camera
+  std::lock_guard<std::mutex> lock(mutex_);
+  frame_queue_.clear();
 }
 
 void Recorder::recorderThread() {
+  utils::configureThread("recorder");
+  const bool raw = pattern_ != utils::BayerPattern::NONE;
+  const size_t frame_size = size_.area() * (raw ? 1 : 3);
   while (recoring_) {
     std::unique_lock<std::mutex> lock(mutex_);
     // !recoring_ is used to break the loop when stop() is called
@@ -64,11 +140,21 @@ void Recorder::recorderThread() {
     auto buffer = std::move(frame_queue_.front());
     frame_queue_.pop_front();
     lock.unlock();
-    if (!buffer.empty()) {
-      cv::Mat frame(size_, CV_8UC3, buffer.data());
-      cv::cvtColor(frame, frame, cv::COLOR_RGB2BGR);
-      writer_.write(frame);
+    if (buffer == nullptr || buffer->size() < frame_size) {
+      dropped_frames_++;
+      continue;
+    }
+    // The frame is read only, convert it out of place and release it before encoding
+    const cv::Mat frame(
+      size_, raw ? CV_8UC1 : CV_8UC3, const_cast<unsigned char *>(buffer->data()));
+    if (raw) {
+      utils::bayerToBgr(frame, pattern_.load(), bgr_);
+    } else {
+      cv::cvtColor(frame, bgr_, cv::COLOR_RGB2BGR);
     }
+    buffer.reset();
+    writer_.write(bgr_);
+    written_frames_++;
   }
 }
 
@@ -0,0 +1,204 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_camera_driver/shared_frames.hpp"
+// std
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace fyt::camera_driver {
+using namespace shared_frames;
+
+namespace {
+// shm_open takes "/name"
+std::string objectName(const std::string &name) {
+  return name.empty() || name.front() != '/' ? "/" + name : name;
+}
+}  // namespace
+
+SharedFrameWriter::SharedFrameWriter(std::string name, size_t slot_count, size_t slot_capacity)
+: name_(std::move(name)), slot_count_(std::max<size_t>(slot_count, 2)),
+  slot_capacity_(slot_capacity) {}
+
+SharedFrameWriter::~SharedFrameWriter() { close(); }
+
+bool SharedFrameWriter::open() {
+  close();
+  const std::string object = objectName(name_);
+  // A killed driver leaves its object behind, readers of it see it never advance again
+  ::shm_unlink(object.c_str());
+  // Read-only to the other users
+  int fd = ::shm_open(object.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  const size_t slot_stride = align64(sizeof(SlotHeader) + slot_capacity_);
+  size_ = align64(sizeof(StoreHeader)) + slot_count_ * slot_stride;
+  if (::ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+    ::close(fd);
+    ::shm_unlink(object.c_str());
+    size_ = 0;
+    return false;
+  }
+  void *data = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    ::shm_unlink(object.c_str());
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<unsigned char *>(data);
+
+  // The object is zero filled, the atomics start at 0
+  auto *header = new (data_) StoreHeader{};
+  header->version = VERSION;
+  header->slot_count = static_cast<uint32_t>(slot_count_);
+  header->slot_stride = slot_stride;
+  header->slot_capacity = slot_capacity_;
+  for (size_t i = 0; i < slot_count_; i++) {
+    new (data_ + align64(sizeof(StoreHeader)) + i * slot_stride) SlotHeader{};
+  }
+  frame_number_ = 0;
+  // The magic last, a reader never sees a half initialized header
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic, MAGIC, sizeof(header->magic));
+  return true;
+}
+
+void SharedFrameWriter::close() {
+  if (data_ == nullptr) {
+    return;
+  }
+  reinterpret_cast<StoreHeader *>(data_)->closed.store(1, std::memory_order_release);
+  ::munmap(data_, size_);
+  ::shm_unlink(objectName(name_).c_str());
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool SharedFrameWriter::write(int64_t stamp_ns,
+                              const frame_log::FrameHeader &header,
+                              const void *data,
+                              size_t size) noexcept {
+  if (data_ == nullptr || size > slot_capacity_) {
+    return false;
+  }
+  auto *store = reinterpret_cast<StoreHeader *>(data_);
+  const uint64_t number = ++frame_number_;
+  unsigned char *base =
+    data_ + align64(sizeof(StoreHeader)) + (number % slot_count_) * store->slot_stride;
+  auto *slot = reinterpret_cast<SlotHeader *>(base);
+
+  slot->seq.store(2 * number - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->stamp_ns = stamp_ns;
+  slot->size = size;
+  slot->frame = header;
+  std::memcpy(base + sizeof(SlotHeader), data, size);
+  slot->seq.store(2 * number, std::memory_order_release);
+  store->latest.store(number, std::memory_order_release);
+  return true;
+}
+
+SharedFrameReader::~SharedFrameReader() { close(); }
+
+bool SharedFrameReader::open(const std::string &name) {
+  close();
+  int fd = ::shm_open(objectName(name).c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(StoreHeader)) {
+    ::close(fd);
+    return false;
+  }
+  size_ = st.st_size;
+  void *data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const unsigned char *>(data);
+
+  const auto *header = reinterpret_cast<const StoreHeader *>(data_);
+  char magic[sizeof(MAGIC)];
+  std::memcpy(magic, header->magic, sizeof(magic));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (std::memcmp(magic, MAGIC, sizeof(magic)) != 0 || header->version != VERSION ||
+      header->slot_count < 2 ||
+      align64(sizeof(StoreHeader)) + header->slot_count * header->slot_stride > size_) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void SharedFrameReader::close() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<unsigned char *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool SharedFrameReader::closed() const noexcept {
+  return data_ == nullptr ||
+         reinterpret_cast<const StoreHeader *>(data_)->closed.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t SharedFrameReader::latest() const noexcept {
+  return data_ != nullptr
+           ? reinterpret_cast<const StoreHeader *>(data_)->latest.load(std::memory_order_acquire)
+           : 0;
+}
+
+const SlotHeader *SharedFrameReader::slot(uint64_t number) const noexcept {
+  const auto *header = reinterpret_cast<const StoreHeader *>(data_);
+  return reinterpret_cast<const SlotHeader *>(data_ + align64(sizeof(StoreHeader)) +
+                                              (number % header->slot_count) * header->slot_stride);
+}
+
+bool SharedFrameReader::acquire(Frame &frame, uint64_t after) const noexcept {
+  const uint64_t number = latest();
+  if (number == 0 || number <= after) {
+    return false;
+  }
+  const SlotHeader *header = slot(number);
+  if (header->seq.load(std::memory_order_acquire) != 2 * number) {
+    return false;
+  }
+  frame.number = number;
+  frame.stamp_ns = header->stamp_ns;
+  frame.size = header->size;
+  frame.header = header->frame;
+  frame.data = reinterpret_cast<const unsigned char *>(header) + sizeof(SlotHeader);
+  // The fields above are of the frame only if the slot wasn't taken meanwhile
+  return frame.size <= reinterpret_cast<const StoreHeader *>(data_)->slot_capacity &&
+         valid(frame);
+}
+
+bool SharedFrameReader::valid(const Frame &frame) const noexcept {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot(frame.number)->seq.load(std::memory_order_relaxed) == 2 * frame.number;
+}
+}  // namespace fyt::camera_driver
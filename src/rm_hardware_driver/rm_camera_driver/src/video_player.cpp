@@ -14,8 +14,15 @@
 // limitations under the License.
 
 // std
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 // ros2
 #include <camera_info_manager/camera_info_manager.hpp>
 #include <image_transport/camera_publisher.hpp>
@@ -31,6 +38,7 @@
 // project
 #include "rm_utils/heartbeat.hpp"
 #include "rm_utils/logger/log.hpp"
+#include "rm_utils/thread_config.hpp"
 
 namespace fyt::camera_driver {
 class VideoPlayerNode : public rclcpp::Node {
@@ -47,9 +55,23 @@ public:
     int frame_rate = this->declare_parameter("frame_rate", 30);
     start_frame_ = this->declare_parameter("start_frame", 0);
     is_loop_ = this->declare_parameter("keep_looping", true);
+    // realtime: at frame_rate, fast: as fast as the decoding, lockstep: the next frame after the
+    // detector has answered the last one
+    std::string mode = this->declare_parameter("mode", "realtime");
+    mode_ = mode == "fast" ? Mode::FAST : mode == "lockstep" ? Mode::LOCKSTEP : Mode::REALTIME;
+    prefetch_ = std::max<int64_t>(this->declare_parameter("prefetch", 8), 1);
+    // any: the first backend of OpenCV that opens the file, ffmpeg, gstreamer
+    decoder_backend_ = this->declare_parameter("decoder.backend", "any");
+    // none, any, vaapi, d3d11 or mfx, the decoded frames are downloaded as BGR
+    decoder_hw_ = this->declare_parameter("decoder.hw_acceleration", "any");
+    // GStreamer pipeline ending in an appsink of BGR, {path} is replaced by the path. Empty
+    // opens the file with decoder.backend
+    decoder_pipeline_ = this->declare_parameter("decoder.pipeline", "");
+    decoder_threads_ = this->declare_parameter("decoder.threads", 0);
 
     // Heartbeat
     heartbeat_ = HeartBeatPublisher::create(this);
+    decode_latency_ = &heartbeat_->metrics().latency("decode");
 
     // Open video file
     std::filesystem::path video_file(video_path);
@@ -59,12 +81,15 @@ public:
       rclcpp::shutdown();
       return;
     }
-    cap_.open(video_path);
-    if (!cap_.isOpened()) {
+    if (!openVideo()) {
       FYT_ERROR("camera_driver", "Video file open failed!");
       rclcpp::shutdown();
       return;
     }
+    FYT_INFO("camera_driver",
+             "Decoding with {}, hardware acceleration {}",
+             cap_.getBackendName(),
+             hwAccelerationName(static_cast<int>(cap_.get(cv::CAP_PROP_HW_ACCELERATION))));
 
     // Set image msg
     image_msg_ = std::make_shared<sensor_msgs::msg::Image>();
@@ -73,7 +98,6 @@ public:
     image_msg_->width = cap_.get(cv::CAP_PROP_FRAME_WIDTH);
     image_msg_->height = cap_.get(cv::CAP_PROP_FRAME_HEIGHT);
     image_msg_->step = image_msg_->width * 3;
-    image_msg_->data.resize(image_msg_->step * image_msg_->height);
 
     // Set camera info
     camera_info_manager_ = std::make_shared<camera_info_manager::CameraInfoManager>(
@@ -94,52 +118,251 @@ public:
     camera_info_.header.frame_id = frame_id;
     camera_info_.header.stamp = this->now();
 
-    // pub
-    camera_pub_ = image_transport::create_camera_publisher(this, "image_raw");
+    // pub, unique_ptr is published to avoid copies in intra-process comms
+    image_pub_ = this->create_publisher<sensor_msgs::msg::Image>("image_raw", 10);
+    camera_info_pub_ = this->create_publisher<sensor_msgs::msg::CameraInfo>("camera_info", 10);
 
-    // Loop
+    // Any message on the output topic of the detector acknowledges the last frame. A frame that
+    // gets no answer (e.g. no transform yet) is given up after lockstep_timeout
+    if (mode_ == Mode::LOCKSTEP) {
+      std::string ack_topic = this->declare_parameter("lockstep_topic", "armor_detector/armors");
+      std::string ack_type = this->declare_parameter("lockstep_type", "rm_interfaces/msg/Armors");
+      ack_timeout_ = std::chrono::duration<double>(
+        this->declare_parameter("lockstep_timeout", 1.0));
+      ack_sub_ = this->create_generic_subscription(
+        ack_topic, ack_type, rclcpp::QoS(10), [this](std::shared_ptr<rclcpp::SerializedMessage>) {
+          {
+            std::lock_guard<std::mutex> lock(ack_mutex_);
+            acked_ = true;
+          }
+          ack_cv_.notify_one();
+        });
+    }
+
+    // Decode on a background thread, the frames are published by the play thread
     loop_rate_ = std::make_shared<rclcpp::WallRate>(frame_rate);
-    timer_ = this->create_wall_timer(std::chrono::milliseconds(1), [this]() {
-      cap_ >> frame_;
-      if (frame_.empty()) {
+    decode_thread_ = std::thread(&VideoPlayerNode::decodeLoop, this);
+    play_thread_ = std::thread(&VideoPlayerNode::playLoop, this);
+  }
+
+  ~VideoPlayerNode() override {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      running_ = false;
+    }
+    queue_cv_.notify_all();
+    ack_cv_.notify_all();
+    if (decode_thread_.joinable()) {
+      decode_thread_.join();
+    }
+    if (play_thread_.joinable()) {
+      play_thread_.join();
+    }
+  }
+
+private:
+  enum class Mode { REALTIME, FAST, LOCKSTEP };
+
+  static const char *hwAccelerationName(int type) {
+    switch (type) {
+      case cv::VIDEO_ACCELERATION_NONE:
+        return "none";
+      case cv::VIDEO_ACCELERATION_ANY:
+        return "any";
+      case cv::VIDEO_ACCELERATION_D3D11:
+        return "d3d11";
+      case cv::VIDEO_ACCELERATION_VAAPI:
+        return "vaapi";
+      case cv::VIDEO_ACCELERATION_MFX:
+        return "mfx";
+      default:
+        return "unknown";
+    }
+  }
+
+  // Open the video with the configured decoder. A hardware decoder that fails to open falls
+  // back to software decoding
+  bool openVideo() {
+    if (!decoder_pipeline_.empty()) {
+      std::string pipeline = decoder_pipeline_;
+      const std::string key = "{path}";
+      if (auto pos = pipeline.find(key); pos != std::string::npos) {
+        pipeline.replace(pos, key.size(), video_path);
+      }
+      return cap_.open(pipeline, cv::CAP_GSTREAMER);
+    }
+
+    int api = cv::CAP_ANY;
+    if (decoder_backend_ == "ffmpeg") {
+      api = cv::CAP_FFMPEG;
+    } else if (decoder_backend_ == "gstreamer") {
+      api = cv::CAP_GSTREAMER;
+    } else if (decoder_backend_ != "any") {
+      FYT_WARN("camera_driver", "Unknown decoder.backend {}, any is used", decoder_backend_);
+    }
+    int hw = cv::VIDEO_ACCELERATION_ANY;
+    if (decoder_hw_ == "none") {
+      hw = cv::VIDEO_ACCELERATION_NONE;
+    } else if (decoder_hw_ == "vaapi") {
+      hw = cv::VIDEO_ACCELERATION_VAAPI;
+    } else if (decoder_hw_ == "d3d11") {
+      hw = cv::VIDEO_ACCELERATION_D3D11;
+    } else if (decoder_hw_ == "mfx") {
+      hw = cv::VIDEO_ACCELERATION_MFX;
+    }
+    std::vector<int> props = {cv::CAP_PROP_HW_ACCELERATION, hw};
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+    if (decoder_threads_ > 0) {
+      props.insert(props.end(), {cv::CAP_PROP_N_THREADS, decoder_threads_});
+    }
+#endif
+    if (cap_.open(video_path, api, props)) {
+      return true;
+    }
+    if (hw != cv::VIDEO_ACCELERATION_NONE) {
+      FYT_WARN("camera_driver", "Hardware decoding failed, fall back to software decoding");
+      return cap_.open(
+        video_path, api, {cv::CAP_PROP_HW_ACCELERATION, cv::VIDEO_ACCELERATION_NONE});
+    }
+    return false;
+  }
+
+  // Decode into the image msgs directly, at most prefetch_ frames ahead of the play thread
+  void decodeLoop() {
+    utils::configureThread("video_decode");
+    while (rclcpp::ok()) {
+      auto image_msg = std::make_unique<sensor_msgs::msg::Image>(*image_msg_);
+      image_msg->data.resize(image_msg->step * image_msg->height);
+      // The decoder writes into the preallocated buffer of the msg
+      frame_ = cv::Mat(image_msg->height, image_msg->width, CV_8UC3, image_msg->data.data());
+      const uchar *buffer = frame_.data;
+      const auto decode_start = std::chrono::steady_clock::now();
+      bool ok = frame_cnt_ < start_frame_ ? cap_.grab() : cap_.read(frame_);
+      decode_latency_->record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - decode_start)
+                                .count());
+      if (!ok || frame_.empty()) {
         FYT_INFO("camera_driver", "Video file ends!");
         if (!is_loop_) {
-          rclcpp::shutdown();
-          return;
-        } else {
-          cap_.open(video_path);
-          frame_cnt_ = 0;
+          pushFrame(nullptr);
           return;
         }
+        openVideo();
+        frame_cnt_ = 0;
+        continue;
       }
-      memcpy(image_msg_->data.data(), frame_.data, image_msg_->step * image_msg_->height);
       frame_cnt_++;
-      if (frame_cnt_ < start_frame_) {
-        FYT_INFO("camera_driver", "Skipping frame {}", frame_cnt_);
+      if (frame_cnt_ <= start_frame_) {
+        continue;
+      }
+      if (frame_.data != buffer) {
+        // The size of the video changed, fall back to a copy
+        image_msg->data.assign(frame_.data, frame_.data + image_msg->step * image_msg->height);
+      }
+      if (!pushFrame(std::move(image_msg))) {
         return;
       }
-      image_msg_->header.stamp = camera_info_.header.stamp = this->now();
-      camera_pub_.publish(*image_msg_, camera_info_);
-      loop_rate_->sleep();
-    });
+    }
+  }
 
-    rclcpp::spin(this->get_node_base_interface());
+  // Return: false if the player is stopped
+  bool pushFrame(std::unique_ptr<sensor_msgs::msg::Image> image_msg) {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    queue_cv_.wait(lock, [this] { return !running_ || frame_queue_.size() < prefetch_; });
+    if (!running_) {
+      return false;
+    }
+    frame_queue_.push_back(std::move(image_msg));
+    queue_cv_.notify_all();
+    return true;
+  }
+
+  void playLoop() {
+    utils::configureThread("video_play");
+    const auto start = std::chrono::steady_clock::now();
+    size_t published = 0, timeouts = 0;
+    while (rclcpp::ok()) {
+      std::unique_ptr<sensor_msgs::msg::Image> image_msg;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        queue_cv_.wait(lock, [this] { return !running_ || !frame_queue_.empty(); });
+        if (!running_) {
+          return;
+        }
+        image_msg = std::move(frame_queue_.front());
+        frame_queue_.pop_front();
+        queue_cv_.notify_all();
+      }
+      // End of the video without looping
+      if (image_msg == nullptr) {
+        break;
+      }
+
+      if (mode_ == Mode::LOCKSTEP) {
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        acked_ = false;
+      }
+      image_msg->header.stamp = camera_info_.header.stamp = this->now();
+      camera_info_pub_->publish(camera_info_);
+      image_pub_->publish(std::move(image_msg));
+      published++;
+
+      if (mode_ == Mode::REALTIME) {
+        loop_rate_->sleep();
+      } else if (mode_ == Mode::LOCKSTEP) {
+        std::unique_lock<std::mutex> lock(ack_mutex_);
+        if (!ack_cv_.wait_for(lock, ack_timeout_, [this] { return acked_ || !running_; })) {
+          timeouts++;
+        }
+      }
+    }
+    const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    FYT_INFO("camera_driver",
+             "Published {} frames in {:.2f} s ({:.1f} fps), {} lockstep timeouts",
+             published,
+             seconds,
+             published / std::max(seconds, 1e-9),
+             timeouts);
+    rclcpp::shutdown();
   }
 
-private:
   HeartBeatPublisher::SharedPtr heartbeat_;
   std::string video_path;
-  image_transport::CameraPublisher camera_pub_;
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_pub_;
+  rclcpp::Publisher<sensor_msgs::msg::CameraInfo>::SharedPtr camera_info_pub_;
   bool is_loop_;
+  Mode mode_;
   cv::VideoCapture cap_;
+  std::string decoder_backend_;
+  std::string decoder_hw_;
+  std::string decoder_pipeline_;
+  int decoder_threads_;
+  // Time of grab/read of each frame, a hardware decoder included its download
+  utils::LatencyHistogram *decode_latency_ = nullptr;
   cv::Mat frame_;
   sensor_msgs::msg::Image::SharedPtr image_msg_;
   sensor_msgs::msg::CameraInfo camera_info_;
   std::shared_ptr<camera_info_manager::CameraInfoManager> camera_info_manager_;
-  rclcpp::TimerBase::SharedPtr timer_;
   rclcpp::WallRate::SharedPtr loop_rate_;
   int start_frame_;
   int frame_cnt_;
+
+  // Decoded frames waiting to be published, nullptr marks the end of the video
+  size_t prefetch_;
+  std::deque<std::unique_ptr<sensor_msgs::msg::Image>> frame_queue_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  bool running_ = true;
+  std::thread decode_thread_;
+  std::thread play_thread_;
+
+  // Lockstep
+  rclcpp::GenericSubscription::SharedPtr ack_sub_;
+  std::chrono::duration<double> ack_timeout_{1.0};
+  std::mutex ack_mutex_;
+  std::condition_variable ack_cv_;
+  bool acked_ = false;
 };
 }  // namespace fyt::camera_driver
 
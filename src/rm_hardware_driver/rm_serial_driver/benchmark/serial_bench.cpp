@@ -0,0 +1,418 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput and latency of the serial stack over a pseudo terminal, the baseline of the
+// changes to the send queue and the receive loop.
+//
+// Usage:
+//   ros2 run rm_serial_driver serial_bench [--packets=20000] [--rate=0] [--rx_rate=1000]
+//     [--corrupt_every=100]
+//
+// The host side is the real UartTransporter on the slave of a pty, the MCU side reads and
+// writes the master. Every packet carries its sequence number as the yaw, so the MCU side
+// can timestamp it:
+//   - send: FixedPacketTool with realtime send off and on, then the infantry, default and
+//     sentry protocols. Packets/s and the latency from sendPacket() to the bytes read by the
+//     MCU, at --rate packets/s (0: as fast as possible)
+//   - receive: the MCU writes --rx_rate packets/s and a truncated frame with garbage before
+//     every --corrupt_every packets. FixedPacketTool::recvPacket() and Protocol::receive()
+//     latency, the packets lost or wrongly parsed after a corruption and the resync time,
+//     from the corruption to the next packet parsed right
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+// system
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+// project
+#include "rm_serial_driver/fixed_packet.hpp"
+#include "rm_serial_driver/fixed_packet_tool.hpp"
+#include "rm_serial_driver/protocol/default_protocol.hpp"
+#include "rm_serial_driver/protocol/infantry_protocol.hpp"
+#include "rm_serial_driver/protocol/sentry_protocol.hpp"
+#include "rm_serial_driver/uart_transporter.hpp"
+
+using namespace fyt::serial_driver;
+
+namespace {
+int g_packets = 20000;
+double g_rate = 0;
+double g_rx_rate = 1000;
+int g_corrupt_every = 100;
+
+using Clock = std::chrono::steady_clock;
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch())
+    .count();
+}
+
+// Master of a pseudo terminal, the slave is opened by the transporter under test
+class PtyMaster {
+public:
+  PtyMaster() {
+    fd_ = ::posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd_ < 0 || ::grantpt(fd_) != 0 || ::unlockpt(fd_) != 0) {
+      throw std::runtime_error("Failed to open a pty");
+    }
+    slave_path_ = ::ptsname(fd_);
+    // Raw bytes both ways, the transporter sets the same on its side
+    termios options;
+    ::tcgetattr(fd_, &options);
+    ::cfmakeraw(&options);
+    ::tcsetattr(fd_, TCSANOW, &options);
+  }
+  ~PtyMaster() { ::close(fd_); }
+
+  int fd() const noexcept { return fd_; }
+  const std::string &slavePath() const noexcept { return slave_path_; }
+
+  // Drop whatever is left from the previous case
+  void drain() {
+    uint8_t buffer[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    while (::poll(&pfd, 1, 50) > 0 && ::read(fd_, buffer, sizeof(buffer)) > 0) {
+    }
+  }
+
+private:
+  int fd_;
+  std::string slave_path_;
+};
+
+// Packet layout of a case, the sequence number is a float at seq_index
+struct Layout {
+  int size;
+  int seq_index;
+};
+
+void makeFrame(const Layout &layout, uint32_t seq, std::vector<uint8_t> &frame) {
+  frame.assign(layout.size, 0);
+  frame.front() = 0xFF;
+  frame.back() = 0xFE;
+  const float value = static_cast<float>(seq);
+  std::memcpy(frame.data() + layout.seq_index, &value, sizeof(value));
+}
+
+// Sequence number of a parsed value, false if it is not one the MCU sent
+bool toSeq(float value, uint32_t &seq) {
+  if (!(value >= 0) || value >= g_packets || value != static_cast<float>(static_cast<int>(value))) {
+    return false;
+  }
+  seq = static_cast<uint32_t>(value);
+  return true;
+}
+
+void pace(Clock::time_point start, int i, double rate) {
+  if (rate > 0) {
+    std::this_thread::sleep_until(
+      start + std::chrono::nanoseconds(static_cast<int64_t>(i * 1e9 / rate)));
+  }
+}
+
+double percentile(std::vector<double> samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[static_cast<size_t>(p * (samples.size() - 1) + 0.5)];
+}
+
+double maxOf(const std::vector<double> &samples) {
+  return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+}
+
+// Send g_packets through send, the MCU side timestamps them off the master
+void runSend(const char *name,
+             PtyMaster &pty,
+             const Layout &layout,
+             const std::function<bool(uint32_t)> &send,
+             const std::function<uint64_t()> &dropped) {
+  pty.drain();
+  std::vector<int64_t> send_ns(g_packets, 0), recv_ns(g_packets, 0);
+  std::atomic<bool> sending{true};
+  size_t received = 0;
+
+  std::thread mcu([&]() {
+    std::vector<uint8_t> buffer(layout.size * 256);
+    size_t len = 0;
+    while (true) {
+      struct pollfd pfd = {pty.fd(), POLLIN, 0};
+      if (::poll(&pfd, 1, 200) <= 0) {
+        if (!sending) {
+          // Nothing more in flight
+          return;
+        }
+        continue;
+      }
+      const int n = ::read(pty.fd(), buffer.data() + len, buffer.size() - len);
+      if (n <= 0) {
+        continue;
+      }
+      const int64_t t = nowNs();
+      len += n;
+      size_t i = 0;
+      for (; i + layout.size <= len; i++) {
+        if (buffer[i] != 0xFF || buffer[i + layout.size - 1] != 0xFE) {
+          continue;
+        }
+        float value;
+        std::memcpy(&value, buffer.data() + i + layout.seq_index, sizeof(value));
+        uint32_t seq;
+        if (toSeq(value, seq) && recv_ns[seq] == 0) {
+          recv_ns[seq] = t;
+          received++;
+        }
+        i += layout.size - 1;
+      }
+      std::memmove(buffer.data(), buffer.data() + i, len - i);
+      len -= i;
+    }
+  });
+
+  const auto start = Clock::now();
+  for (int i = 0; i < g_packets; i++) {
+    pace(start, i, g_rate);
+    send_ns[i] = nowNs();
+    send(i);
+  }
+  sending = false;
+  mcu.join();
+
+  std::vector<double> latency_us;
+  int64_t last_ns = send_ns.front();
+  for (int i = 0; i < g_packets; i++) {
+    if (recv_ns[i] != 0) {
+      latency_us.push_back((recv_ns[i] - send_ns[i]) / 1e3);
+      last_ns = std::max(last_ns, recv_ns[i]);
+    }
+  }
+  const double seconds = (last_ns - send_ns.front()) / 1e9;
+  std::printf("send     %-16s %9.0f packets/s  latency p50 %8.1f us  p99 %8.1f us  "
+              "max %8.1f us  lost %zu  dropped %lu\n",
+              name,
+              seconds > 0 ? received / seconds : 0.0,
+              percentile(latency_us, 0.50),
+              percentile(latency_us, 0.99),
+              maxOf(latency_us),
+              g_packets - received,
+              static_cast<unsigned long>(dropped ? dropped() : 0));
+}
+
+// The MCU writes g_packets with corruptions, receive parses them on the host
+void runReceive(const char *name,
+                PtyMaster &pty,
+                const Layout &layout,
+                const std::function<bool(float &)> &receive) {
+  pty.drain();
+  std::vector<int64_t> write_ns(g_packets, 0), recv_ns(g_packets, 0);
+  // Time of the corruption written before a packet, 0 if none
+  std::vector<int64_t> corrupt_ns(g_packets, 0);
+  std::atomic<bool> writing{true};
+  size_t received = 0, wrong = 0;
+
+  std::thread host([&]() {
+    uint32_t last_seq = 0;
+    bool has_last = false;
+    while (writing || received + wrong < static_cast<size_t>(g_packets)) {
+      float value;
+      if (!receive(value)) {
+        if (!writing) {
+          // The transporter timed out, nothing more in flight
+          return;
+        }
+        continue;
+      }
+      const int64_t t = nowNs();
+      uint32_t seq;
+      if (!toSeq(value, seq) || (has_last && seq <= last_seq)) {
+        wrong++;
+        continue;
+      }
+      recv_ns[seq] = t;
+      last_seq = seq;
+      has_last = true;
+      received++;
+    }
+  });
+
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> garbage(0, 0xFD);
+  std::vector<uint8_t> frame, junk;
+  const auto start = Clock::now();
+  for (int i = 0; i < g_packets; i++) {
+    pace(start, i, g_rx_rate);
+    if (g_corrupt_every > 0 && i > 0 && i % g_corrupt_every == 0) {
+      // The head of a frame cut by a glitch, then line noise
+      makeFrame(layout, g_packets, junk);
+      junk.resize(layout.size / 2);
+      for (int k = 0; k < layout.size / 4; k++) {
+        junk.push_back(static_cast<uint8_t>(garbage(rng)));
+      }
+      corrupt_ns[i] = nowNs();
+      [[maybe_unused]] auto ret = ::write(pty.fd(), junk.data(), junk.size());
+    }
+    makeFrame(layout, i, frame);
+    write_ns[i] = nowNs();
+    [[maybe_unused]] auto ret = ::write(pty.fd(), frame.data(), frame.size());
+  }
+  writing = false;
+  host.join();
+
+  std::vector<double> latency_us, resync_us;
+  size_t lost_after_corruption = 0;
+  for (int i = 0; i < g_packets; i++) {
+    if (recv_ns[i] != 0) {
+      latency_us.push_back((recv_ns[i] - write_ns[i]) / 1e3);
+    }
+    if (corrupt_ns[i] == 0) {
+      continue;
+    }
+    int j = i;
+    while (j < g_packets && recv_ns[j] == 0) {
+      j++;
+    }
+    if (j < g_packets) {
+      resync_us.push_back((recv_ns[j] - corrupt_ns[i]) / 1e3);
+      lost_after_corruption += j - i;
+    }
+  }
+  std::printf("receive  %-16s latency p50 %8.1f us  p99 %8.1f us  lost %zu (%zu after %zu "
+              "corruptions)  wrong %zu  resync p50 %8.1f us  max %8.1f us\n",
+              name,
+              percentile(latency_us, 0.50),
+              percentile(latency_us, 0.99),
+              g_packets - received,
+              lost_after_corruption,
+              resync_us.size(),
+              wrong,
+              percentile(resync_us, 0.50),
+              maxOf(resync_us));
+}
+
+TransporterInterface::SharedPtr openTransporter(const PtyMaster &pty) {
+  auto transporter = std::make_shared<UartTransporter>(pty.slavePath(), 921600);
+  if (!transporter->open()) {
+    throw std::runtime_error(transporter->errorMessage());
+  }
+  return transporter;
+}
+
+rm_interfaces::msg::GimbalCmd makeCmd(uint32_t seq) {
+  rm_interfaces::msg::GimbalCmd cmd;
+  cmd.yaw = static_cast<float>(seq);
+  cmd.pitch = 0.1;
+  cmd.distance = 5.0;
+  return cmd;
+}
+
+template <typename ProtocolT>
+void runProtocol(const char *name, PtyMaster &pty, const Layout &send, const Layout &receive) {
+  auto transporter = openTransporter(pty);
+  ProtocolT protocol(transporter, false);
+  // No cap on the frame rate of the protocols merging their commands, a command sent while
+  // the previous frame is written still shares the next frame and counts as lost
+  protocol.setTransmitRate(0);
+  runSend(
+    name,
+    pty,
+    send,
+    [&protocol](uint32_t seq) {
+      protocol.send(makeCmd(seq));
+      return true;
+    },
+    nullptr);
+  runReceive(name, pty, receive, [&protocol](float &value) {
+    rm_interfaces::msg::SerialReceiveData data;
+    if (protocol.receive(data) != ReceiveStatus::OK) {
+      return false;
+    }
+    value = data.yaw;
+    return true;
+  });
+  transporter->close();
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--packets=", 10) == 0) {
+      g_packets = std::max(1, std::atoi(argv[i] + 10));
+    } else if (std::strncmp(argv[i], "--rate=", 7) == 0) {
+      g_rate = std::max(0.0, std::atof(argv[i] + 7));
+    } else if (std::strncmp(argv[i], "--rx_rate=", 10) == 0) {
+      g_rx_rate = std::max(0.0, std::atof(argv[i] + 10));
+    } else if (std::strncmp(argv[i], "--corrupt_every=", 16) == 0) {
+      g_corrupt_every = std::max(0, std::atoi(argv[i] + 16));
+    } else {
+      std::cerr << "Unknown argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  PtyMaster pty;
+  std::cerr << "pty " << pty.slavePath() << ", " << g_packets << " packets per case"
+            << std::endl;
+
+  // The packet tool alone, the layout of the infantry command
+  const Layout tool_layout{16, 6};
+  for (bool realtime : {false, true}) {
+    auto transporter = openTransporter(pty);
+    FixedPacketTool<16> tool(transporter);
+    tool.enbaleRealtimeSend(realtime);
+    runSend(
+      realtime ? "tool realtime" : "tool",
+      pty,
+      tool_layout,
+      [&tool, &tool_layout](uint32_t seq) {
+        FixedPacket<16> packet;
+        packet.loadData<float>(static_cast<float>(seq), tool_layout.seq_index);
+        return tool.sendPacket(packet);
+      },
+      [&tool]() { return tool.droppedPackets(); });
+    // Join the send thread before closing
+    tool.enbaleRealtimeSend(false);
+    transporter->close();
+  }
+  {
+    auto transporter = openTransporter(pty);
+    FixedPacketTool<16> tool(transporter);
+    runReceive("tool", pty, tool_layout, [&tool, &tool_layout](float &value) {
+      FixedPacket<16> packet;
+      return tool.recvPacket(packet) == ReceiveStatus::OK &&
+             packet.unloadData(value, tool_layout.seq_index);
+    });
+    transporter->close();
+  }
+
+  runProtocol<protocol::ProtocolInfantry>("infantry", pty, {16, 6}, {16, 10});
+  runProtocol<protocol::DefaultProtocol>("default", pty, {16, 6}, {16, 10});
+  runProtocol<protocol::ProtocolSentry>("sentry", pty, {32, 8}, {32, 6});
+  return 0;
+}
@@ -0,0 +1,78 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SERIAL_DRIVER_CRC_HPP_
+#define SERIAL_DRIVER_CRC_HPP_
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace fyt::serial_driver::crc {
+// The CRCs of the RoboMaster referee system, so the firmware can reuse its implementation:
+// CRC8 with the reflected polynomial 0x31 and CRC16 with the reflected polynomial 0x1021
+// (CRC-16/MCRF4XX), both computed with 256-entry tables built at compile time
+namespace detail {
+constexpr std::array<uint8_t, 256> makeCrc8Table() {
+  std::array<uint8_t, 256> table{};
+  for (int i = 0; i < 256; i++) {
+    uint8_t crc = static_cast<uint8_t>(i);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? static_cast<uint8_t>((crc >> 1) ^ 0x8C) : static_cast<uint8_t>(crc >> 1);
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr std::array<uint16_t, 256> makeCrc16Table() {
+  std::array<uint16_t, 256> table{};
+  for (int i = 0; i < 256; i++) {
+    uint16_t crc = static_cast<uint16_t>(i);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0x8408)
+                      : static_cast<uint16_t>(crc >> 1);
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+inline constexpr std::array<uint8_t, 256> CRC8_TABLE = makeCrc8Table();
+inline constexpr std::array<uint16_t, 256> CRC16_TABLE = makeCrc16Table();
+}  // namespace detail
+
+inline constexpr uint8_t CRC8_INIT = 0xFF;
+inline constexpr uint16_t CRC16_INIT = 0xFFFF;
+
+inline uint8_t crc8(const void *data, std::size_t len, uint8_t crc = CRC8_INIT) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (std::size_t i = 0; i < len; i++) {
+    crc = detail::CRC8_TABLE[crc ^ bytes[i]];
+  }
+  return crc;
+}
+
+inline uint16_t crc16(const void *data, std::size_t len, uint16_t crc = CRC16_INIT) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (std::size_t i = 0; i < len; i++) {
+    crc = static_cast<uint16_t>((crc >> 8) ^ detail::CRC16_TABLE[(crc ^ bytes[i]) & 0xFF]);
+  }
+  return crc;
+}
+
+}  // namespace fyt::serial_driver::crc
+
+#endif  // SERIAL_DRIVER_CRC_HPP_
@@ -0,0 +1,131 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SERIAL_DRIVER_CRC_PACKET_HPP_
+#define SERIAL_DRIVER_CRC_PACKET_HPP_
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+// project
+#include "rm_serial_driver/crc.hpp"
+
+namespace fyt::serial_driver::crc {
+
+// Schema of the CRC protocol, the only place the payloads are defined. Every field is a
+// FIELD(type, name) whose name is the one of the ROS message it is converted from/to, the
+// payload structs and the conversions are generated from the lists. Changing a list changes the
+// wire format, so PROTOCOL_VERSION must be increased with it
+inline constexpr uint8_t PROTOCOL_VERSION = 2;
+
+// 下位机 -> 上位机, rm_interfaces/msg/SerialReceiveData
+#define FYT_CRC_RECEIVE_FIELDS(FIELD) \
+  FIELD(uint8_t, mode)                \
+  FIELD(float, bullet_speed)          \
+  FIELD(float, roll)                  \
+  FIELD(float, pitch)                 \
+  FIELD(float, yaw)
+// Clock sync, not converted to the message. All times are the low 32 bits of microseconds:
+//   timestamp_us     MCU time at which the attitude was sampled
+//   echo_host_us     host_time_us of the last frame the MCU received, 0 if none
+//   echo_receive_us  MCU time at which that frame was received
+#define FYT_CRC_RECEIVE_SYNC_FIELDS(FIELD) \
+  FIELD(uint32_t, timestamp_us)            \
+  FIELD(uint32_t, echo_host_us)            \
+  FIELD(uint32_t, echo_receive_us)
+
+// 上位机 -> 下位机, rm_interfaces/msg/GimbalCmd
+#define FYT_CRC_SEND_FIELDS(FIELD) \
+  FIELD(uint8_t, fire_advice)      \
+  FIELD(float, pitch)              \
+  FIELD(float, yaw)                \
+  FIELD(float, distance)
+// Clock sync: host time at which the frame is sent
+#define FYT_CRC_SEND_SYNC_FIELDS(FIELD) FIELD(uint32_t, host_time_us)
+
+#define FYT_CRC_DECLARE_FIELD(type, name) type name;
+#define FYT_CRC_FROM_MSG(type, name) payload.name = static_cast<type>(msg.name);
+#define FYT_CRC_TO_MSG(type, name) msg.name = payload.name;
+
+#pragma pack(push, 1)
+struct ReceivePayload {
+  FYT_CRC_RECEIVE_FIELDS(FYT_CRC_DECLARE_FIELD)
+  FYT_CRC_RECEIVE_SYNC_FIELDS(FYT_CRC_DECLARE_FIELD)
+};
+
+struct SendPayload {
+  FYT_CRC_SEND_FIELDS(FYT_CRC_DECLARE_FIELD)
+  FYT_CRC_SEND_SYNC_FIELDS(FYT_CRC_DECLARE_FIELD)
+};
+
+// Start of frame, version and sequence number, checked by crc8 before the rest is read
+struct FrameHeader {
+  uint8_t sof;
+  uint8_t version;
+  uint8_t sequence;
+  uint8_t crc8;
+};
+
+// A frame is its header, the payload and the crc16 of both, in the byte order of the host
+// (little endian on both sides)
+template <typename Payload>
+struct Frame {
+  FrameHeader header;
+  Payload payload;
+  uint16_t crc16;
+};
+#pragma pack(pop)
+
+inline constexpr uint8_t SOF = 0xA5;
+
+static_assert(sizeof(FrameHeader) == 4, "FrameHeader must be packed");
+static_assert(sizeof(Frame<ReceivePayload>) == 4 + 29 + 2, "Frame must be packed");
+
+// Fill the header and the checksums
+template <typename Payload>
+void sealFrame(Frame<Payload> &frame, uint8_t sequence) {
+  frame.header.sof = SOF;
+  frame.header.version = PROTOCOL_VERSION;
+  frame.header.sequence = sequence;
+  frame.header.crc8 = crc8(&frame.header, offsetof(FrameHeader, crc8));
+  frame.crc16 = crc16(&frame, offsetof(Frame<Payload>, crc16));
+}
+
+enum class FrameStatus { OK, BAD_HEADER, BAD_VERSION, BAD_CRC };
+
+// Check the header of the bytes at buffer, at least sizeof(FrameHeader) of them
+inline FrameStatus checkHeader(const uint8_t *buffer) {
+  FrameHeader header;
+  std::memcpy(&header, buffer, sizeof(header));
+  if (header.sof != SOF || header.crc8 != crc8(&header, offsetof(FrameHeader, crc8))) {
+    return FrameStatus::BAD_HEADER;
+  }
+  return header.version == PROTOCOL_VERSION ? FrameStatus::OK : FrameStatus::BAD_VERSION;
+}
+
+// Check and copy a whole frame at buffer, one bounded memcpy and the checksums
+template <typename Payload>
+FrameStatus parseFrame(const uint8_t *buffer, Frame<Payload> &frame) {
+  if (FrameStatus status = checkHeader(buffer); status != FrameStatus::OK) {
+    return status;
+  }
+  std::memcpy(&frame, buffer, sizeof(frame));
+  return frame.crc16 == crc16(&frame, offsetof(Frame<Payload>, crc16)) ? FrameStatus::OK
+                                                                        : FrameStatus::BAD_CRC;
+}
+
+}  // namespace fyt::serial_driver::crc
+
+#endif  // SERIAL_DRIVER_CRC_PACKET_HPP_
@@ -20,17 +20,25 @@
 #define SERIAL_DRIVER_FIXED_PACKET_TOOL_HPP_
 
 // std
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <stdexcept>
 #include <string>
 #include <thread>
+// system
+#include <sys/eventfd.h>
+#include <unistd.h>
 // project
 #include "rm_serial_driver/fixed_packet.hpp"
 #include "rm_serial_driver/transporter_interface.hpp"
 #include "rm_utils/logger/log.hpp"
+#include "rm_utils/spsc_queue.hpp"
+#include "rm_utils/thread_config.hpp"
 
 namespace fyt::serial_driver {
 
@@ -50,45 +58,83 @@ public:
   ~FixedPacketTool() { enbaleRealtimeSend(false); }
 
   bool isOpen() { return transporter_->isOpen(); }
+  // Send on a thread woken by an eventfd, sendPacket only queues the packet
   void enbaleRealtimeSend(bool enable);
+  // With realtime send, only the latest queued packet is sent, a stale command is worse than a
+  // dropped one. Only for protocols whose every packet carries the whole state
+  void enableLatestOnly(bool enable) { use_latest_only_ = enable; }
+  // Packets dropped because the send queue was full
+  uint64_t droppedPackets() const { return dropped_packets_.load(); }
   void enbaleDataPrint(bool enable) { use_data_print_ = enable; }
   bool sendPacket(const FixedPacket<capacity> &packet);
-  bool recvPacket(FixedPacket<capacity> &packet);
+  ReceiveStatus recvPacket(FixedPacket<capacity> &packet);
 
   std::string getErrorMessage() { return transporter_->errorMessage(); }
 
 private:
-  bool checkPacket(uint8_t *tmp_buffer, int recv_len);
+  bool checkPacket(const uint8_t *buffer);
+  // Take the first complete frame in recv_buffer_, skipping the bytes before it
+  bool parsePacket(FixedPacket<capacity> &packet);
+  void consume(int len);
   bool simpleSendPacket(const FixedPacket<capacity> &packet);
 
 private:
   std::shared_ptr<TransporterInterface> transporter_;
-  // data
-  uint8_t tmp_buffer_[capacity];       // NOLINT
-  uint8_t recv_buffer_[capacity * 2];  // NOLINT
-  int recv_buf_len_;
+  // Bytes read but not parsed yet, filled and parsed by the receiving thread only. Every read
+  // takes all the bytes available, the frames left are parsed by the next calls without waiting
+  uint8_t recv_buffer_[capacity * 8];  // NOLINT
+  int recv_buf_len_{0};
   // for realtime sending
-  bool use_realtime_send_{false};
+  std::atomic<bool> use_realtime_send_{false};
+  std::atomic<bool> use_latest_only_{false};
   bool use_data_print_{false};
+  // Several callbacks may send, so the producer side is serialized by realtime_send_mut_. The
+  // send thread pops without locking
   std::mutex realtime_send_mut_;
   std::unique_ptr<std::thread> realtime_send_thread_;
-  std::queue<FixedPacket<capacity>> realtime_packets_;
+  utils::SpscQueue<FixedPacket<capacity>, 16> realtime_packets_;
+  // Counts the queued packets, the send thread blocks on reading it
+  int wakeup_fd_{-1};
+  std::atomic<uint64_t> dropped_packets_{0};
 };
 
 template <int capacity>
-bool FixedPacketTool<capacity>::checkPacket(uint8_t *buffer, int recv_len) {
-  // 检查长度
-  if (recv_len != capacity) {
-    return false;
-  }
-  // 检查帧头，帧尾,
-  // if ((buffer[0] != 0xff) || (buffer[capacity - 1] != 0x0d)) {
-  //修改为spr的通信协议
-  if ((buffer[0] != 0xFF) || (buffer[capacity - 1] != 0xFE)) {
+bool FixedPacketTool<capacity>::checkPacket(const uint8_t *buffer) {
+  // 检查帧头，帧尾. FixedPacket的帧尾在最后一字节, 当前下位机的帧尾在capacity - 4
+  if (buffer[0] != 0xFF) {
     return false;
   }
   // TODO(gezp): 检查check_byte(buffer[capacity-2]),可采用异或校验(BCC)
-  return true;
+  return buffer[capacity - 1] == 0xFE || buffer[capacity - 4] == 0xFE;
+}
+
+template <int capacity>
+void FixedPacketTool<capacity>::consume(int len) {
+  recv_buf_len_ -= len;
+  std::memmove(recv_buffer_, recv_buffer_ + len, recv_buf_len_);
+}
+
+template <int capacity>
+bool FixedPacketTool<capacity>::parsePacket(FixedPacket<capacity> &packet) {
+  int i = 0;
+  for (; i + capacity <= recv_buf_len_; i++) {
+    if (checkPacket(recv_buffer_ + i)) {
+      if (i > 0) {
+        FYT_WARN("serial_driver", "checkPacket() failed, skipped {} bytes", i);
+      }
+      packet.copyFrom(recv_buffer_ + i);
+      consume(i + capacity);
+      return true;
+    }
+  }
+  // The rest may be the beginning of a frame, keep it from the first frame head
+  while (i < recv_buf_len_ && recv_buffer_[i] != 0xFF) {
+    i++;
+  }
+  if (i > 0) {
+    consume(i);
+  }
+  return false;
 }
 
 template <int capacity>
@@ -110,105 +156,95 @@ void FixedPacketTool<capacity>::enbaleRealtimeSend(bool enable) {
     return;
   }
   if (enable) {
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+      FYT_ERROR("serial_driver", "eventfd() failed, realtime send is disabled");
+      return;
+    }
     use_realtime_send_ = true;
-    realtime_send_thread_ = std::make_unique<std::thread>([&]() {
+    realtime_send_thread_ = std::make_unique<std::thread>([this]() {
+      utils::configureThread("serial_send");
       FixedPacket<capacity> packet;
       while (use_realtime_send_) {
-        bool empty = true;
-        {
-          std::lock_guard<std::mutex> lock(realtime_send_mut_);
-          empty = realtime_packets_.empty();
-          if (!empty) {
-            packet = realtime_packets_.front();
-            realtime_packets_.pop();
-          }
+        // Woken by every push, the counter is reset by the read so no push is missed
+        uint64_t count;
+        if (::read(wakeup_fd_, &count, sizeof(count)) < 0 && errno != EINTR) {
+          FYT_ERROR("serial_driver", "Failed to wait for the packets to send");
+          break;
         }
-        if (!empty) {
-          simpleSendPacket(packet);
+        if (use_latest_only_) {
+          bool has_packet = false;
+          while (realtime_packets_.pop(packet)) {
+            has_packet = true;
+          }
+          if (has_packet) {
+            simpleSendPacket(packet);
+          }
         } else {
-          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          while (realtime_packets_.pop(packet)) {
+            simpleSendPacket(packet);
+          }
         }
       }
     });
   } else {
     use_realtime_send_ = false;
+    const uint64_t one = 1;
+    [[maybe_unused]] auto ret = ::write(wakeup_fd_, &one, sizeof(one));
     realtime_send_thread_->join();
     realtime_send_thread_.reset();
+    ::close(wakeup_fd_);
+    wakeup_fd_ = -1;
   }
 }
 
 template <int capacity>
 bool FixedPacketTool<capacity>::sendPacket(const FixedPacket<capacity> &packet) {
   if (use_realtime_send_) {
-    std::lock_guard<std::mutex> lock(realtime_send_mut_);
-    realtime_packets_.push(packet);
-    return true;
+    {
+      std::lock_guard<std::mutex> lock(realtime_send_mut_);
+      if (!realtime_packets_.push(packet)) {
+        // The newest packet is dropped, with latest only the queue is drained on every wakeup
+        dropped_packets_++;
+        return false;
+      }
+    }
+    const uint64_t one = 1;
+    return ::write(wakeup_fd_, &one, sizeof(one)) == sizeof(one);
   } else {
     return simpleSendPacket(packet);
   }
 }
 
 template <int capacity>
-bool FixedPacketTool<capacity>::recvPacket(FixedPacket<capacity> &packet) {
-  int recv_len = transporter_->read(tmp_buffer_, capacity);
-  if (recv_len > 0) {
+ReceiveStatus FixedPacketTool<capacity>::recvPacket(FixedPacket<capacity> &packet) {
+  while (!parsePacket(packet)) {
+    // At most capacity - 1 bytes are left after parsing, so there is always room
+    int recv_len = transporter_->read(recv_buffer_ + recv_buf_len_,
+                                      sizeof(recv_buffer_) - recv_buf_len_);
+    if (recv_len == 0) {
+      // No data within the timeout of the transporter
+      return ReceiveStatus::TIMEOUT;
+    }
+    if (recv_len < 0) {
+      FYT_ERROR("serial_driver", "transporter_->read() failed");
+      // reconnect
+      recv_buf_len_ = 0;
+      transporter_->close();
+      transporter_->open();
+      // 串口错误
+      return ReceiveStatus::FAILURE;
+    }
     // print data
     if (use_data_print_) {
       for (int i = 0; i < recv_len; i++) {
-        std::cout << std::hex << static_cast<int>(tmp_buffer_[i]) << " ";
-        //位操作变成浮点数打印显示
-        
+        std::cout << std::hex << static_cast<int>(recv_buffer_[recv_buf_len_ + i]) << " ";
       }
       std::cout << "\n";
     }
-    // if(tmp_buffer_[0] == 0xFF){
-    // check packet
-    // if (checkPacket(tmp_buffer_, recv_len)) {
-    if (tmp_buffer_[0] == 0xFF && tmp_buffer_[capacity - 4] == 0xFE) {
-      packet.copyFrom(tmp_buffer_);
-      return true;
-    } else {
-      FYT_INFO("serial_driver", "checkPacket() failed");
-      // // 如果是断帧，拼接缓存，并遍历校验，获得合法数据
-      // FYT_INFO("serial_driver", "checkPacket() failed, check if it is a broken frame");
-      // if (recv_buf_len_ + recv_len > capacity * 2) {
-      //   recv_buf_len_ = 0;
-      // }
-      // // 拼接缓存
-      // memcpy(recv_buffer_ + recv_buf_len_, tmp_buffer_, recv_len);
-      // recv_buf_len_ = recv_buf_len_ + recv_len;
-      // // 遍历校验
-      // for (int i = 0; (i + capacity) <= recv_buf_len_; i++) {
-      //   if (checkPacket(recv_buffer_ + i, capacity)) {
-      //     packet.copyFrom(recv_buffer_ + i);
-      //     // 读取一帧后，更新接收缓存
-      //     int k = 0;
-      //     for (int j = i + capacity; j < recv_buf_len_; j++, k++) {
-      //       recv_buffer_[k] = recv_buffer_[j];
-      //     }
-      //     recv_buf_len_ = k;
-      //     return true;
-      //   }
-      // }
-      // // 表明断帧，或错误帧。
-      // FYT_WARN("serial_driver",
-      //          "checkPacket() failed with recv_len:{}, frame head:{}, frame end:{}",
-      //          recv_len,
-      //          tmp_buffer_[0],
-      //          tmp_buffer_[recv_len - 1]);
-      return false;
-    }
-    // else{
-    //   return false;
-    // }
-  } else {
-    FYT_ERROR("serial_driver", "transporter_->read() failed");
-    // reconnect
-    transporter_->close();
-    transporter_->open();
-    // 串口错误
-    return false;
+    recv_buf_len_ += recv_len;
   }
+  return ReceiveStatus::OK;
 }
 
 using FixedPacketTool16 = FixedPacketTool<16>;
@@ -0,0 +1,91 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SERIAL_DRIVER_GIMBAL_CMD_ARBITER_HPP_
+#define SERIAL_DRIVER_GIMBAL_CMD_ARBITER_HPP_
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+// project
+#include "rm_interfaces/msg/gimbal_cmd.hpp"
+#include "rm_utils/metrics.hpp"
+
+namespace fyt::serial_driver {
+
+// Chooses the gimbal commands worth the link. The armor and the rune solvers both publish
+// at their own rate whatever the mode, only the commands of the solver of the vision mode
+// requested by the MCU are forwarded. A command computed from a frame older than max_age, or
+// older than the last forwarded one of its solver, is dropped. With a rate, the commands are
+// coalesced: only the newest of each transmit slot is sent, at the end of the slot.
+// Commands of no frame (zero stamp) are never stale. Times in ns
+class GimbalCmdArbiter {
+public:
+  enum Source { ARMOR = 0, RUNE = 1, SOURCE_NUM };
+
+  struct Params {
+    bool enable = true;
+    // Transmit slots per second, 0: every command is sent as it comes
+    double rate = 0;
+    // Age of the frame of a command beyond which it is dropped, s. 0: no limit
+    double max_age = 0.1;
+  };
+
+  GimbalCmdArbiter() = default;
+  explicit GimbalCmdArbiter(const Params &params) : params_(params) {}
+
+  const Params &params() const noexcept { return params_; }
+
+  // Vision mode of SetMode, the rune modes select the rune solver
+  void setMode(int mode) noexcept;
+  Source activeSource() const noexcept { return active_.load(std::memory_order_relaxed); }
+
+  // True if the command is to be sent now. With a rate, a command of the active source is
+  // kept for the end of the slot instead and false returned
+  bool offer(Source source, const rm_interfaces::msg::GimbalCmd &cmd, int64_t now_ns);
+
+  // End of a transmit slot: the newest command kept in it, false if there is none or it
+  // went stale while waiting
+  bool take(rm_interfaces::msg::GimbalCmd &cmd, int64_t now_ns);
+
+  // Commands dropped for their source, their age, or replaced by a newer one of the slot
+  int64_t inactiveDrops() const noexcept { return inactive_drops_->load(); }
+  int64_t staleDrops() const noexcept { return stale_drops_->load(); }
+  int64_t coalesced() const noexcept { return coalesced_->load(); }
+  // Count into the metrics of the node instead, before the first command
+  void attachMetrics(utils::Metrics &metrics);
+
+private:
+  bool stale(const rm_interfaces::msg::GimbalCmd &cmd, int64_t now_ns) const noexcept;
+
+  Params params_{};
+  std::atomic<Source> active_{ARMOR};
+
+  // The subscriptions and the slot timer may run on several threads of the executor
+  std::mutex mutex_;
+  int64_t last_stamp_ns_[SOURCE_NUM] = {0, 0};
+  bool has_pending_ = false;
+  Source pending_source_ = ARMOR;
+  rm_interfaces::msg::GimbalCmd pending_;
+
+  std::atomic<int64_t> counts_[3] = {};
+  std::atomic<int64_t> *inactive_drops_ = &counts_[0];
+  std::atomic<int64_t> *stale_drops_ = &counts_[1];
+  std::atomic<int64_t> *coalesced_ = &counts_[2];
+};
+
+}  // namespace fyt::serial_driver
+
+#endif  // SERIAL_DRIVER_GIMBAL_CMD_ARBITER_HPP_
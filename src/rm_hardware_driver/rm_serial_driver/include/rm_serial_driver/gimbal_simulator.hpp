@@ -0,0 +1,97 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SERIAL_DRIVER_GIMBAL_SIMULATOR_HPP_
+#define SERIAL_DRIVER_GIMBAL_SIMULATOR_HPP_
+
+// std
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace fyt::serial_driver {
+
+// Gimbal dynamics for the closed loop without the robot. A command reaches the MCU after the
+// transport delay, then each axis follows it as a second-order servo (natural frequency and
+// damping) with the feed-forward yaw velocity of the setpoints. The measured attitude carries
+// gaussian IMU noise. Angles in rad, times in s
+class GimbalSimulator {
+public:
+  struct Params {
+    double delay = 0.005;
+    double natural_frequency = 40.0;
+    double damping = 0.7;
+    // Standard deviation of the measured angles
+    double imu_noise = 0.0;
+    uint32_t seed = 0;
+  };
+
+  struct Setpoint {
+    // Time at which the MCU aims at it, before the transport delay
+    double time;
+    double yaw;
+    double pitch;
+    double yaw_velocity;
+  };
+
+  GimbalSimulator(const Params &params, double yaw, double pitch);
+
+  // A command received at now, interpolated between its setpoints in time once it arrives.
+  // A single setpoint is held
+  void command(double now, std::vector<Setpoint> setpoints);
+
+  // Integrate the dynamics up to now, in steps of at most 1 ms
+  void step(double now);
+
+  double yaw() const noexcept { return yaw_; }
+  double pitch() const noexcept { return pitch_; }
+  // Attitude as measured by the IMU
+  void measure(double &yaw, double &pitch);
+  // Aim of the command being followed minus the attitude, 0 before the first command
+  double yawError() const noexcept;
+  double pitchError() const noexcept { return has_reference_ ? ref_pitch_ - pitch_ : 0; }
+
+private:
+  struct Command {
+    double arrival;
+    std::vector<Setpoint> setpoints;
+  };
+
+  // Aim and feed-forward yaw velocity of the active command at t
+  void reference(double t);
+
+  Params params_;
+  std::deque<Command> pending_;
+  std::vector<Setpoint> active_;
+
+  double time_ = -1;
+  double yaw_;
+  double pitch_;
+  double yaw_velocity_ = 0;
+  double pitch_velocity_ = 0;
+
+  bool has_reference_ = false;
+  double ref_yaw_ = 0;
+  double ref_pitch_ = 0;
+  double ref_yaw_velocity_ = 0;
+
+  std::mt19937 rng_;
+  std::normal_distribution<double> noise_;
+};
+
+}  // namespace fyt::serial_driver
+
+#endif  // SERIAL_DRIVER_GIMBAL_SIMULATOR_HPP_
@@ -0,0 +1,70 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SERIAL_DRIVER_LATEST_SLOT_HPP_
+#define SERIAL_DRIVER_LATEST_SLOT_HPP_
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace fyt::serial_driver {
+
+// Latest value of a command, written by one thread at a time and read by another without
+// locks. The value is kept in relaxed atomic words guarded by a sequence counter, the writer
+// never waits and the reader retries while the value is being written
+template <typename T>
+class LatestSlot {
+  static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+  static constexpr std::size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+  void store(const T &value) noexcept {
+    uint64_t words[WORDS] = {};
+    std::memcpy(words, &value, sizeof(T));
+    const uint64_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < WORDS; i++) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  // Version of the value read, 0 if none has been stored yet. It changes with every store
+  uint64_t load(T &value) const noexcept {
+    uint64_t words[WORDS];
+    uint64_t before, after;
+    do {
+      before = seq_.load(std::memory_order_acquire);
+      for (std::size_t i = 0; i < WORDS; i++) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = seq_.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1) != 0);
+    std::memcpy(&value, words, sizeof(T));
+    return before;
+  }
+
+private:
+  std::atomic<uint64_t> seq_{0};
+  std::atomic<uint64_t> words_[WORDS] = {};
+};
+
+}  // namespace fyt::serial_driver
+
+#endif  // SERIAL_DRIVER_LATEST_SLOT_HPP_
@@ -17,12 +17,15 @@
 #define SERIAL_DRIVER_PROTOCOL_HPP_
 
 // std
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
 // ros2
 #include <geometry_msgs/msg/twist.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <std_msgs/msg/header.hpp>
 // project
 #include "rm_interfaces/msg/chassis_cmd.hpp"
 #include "rm_interfaces/msg/gimbal_cmd.hpp"
@@ -30,6 +33,7 @@
 #include "rm_interfaces/srv/set_mode.hpp"
 #include "rm_serial_driver/fixed_packet.hpp"
 #include "rm_serial_driver/fixed_packet_tool.hpp"
+#include "rm_serial_driver/gimbal_cmd_arbiter.hpp"
 #include "rm_serial_driver/uart_transporter.hpp"
 
 namespace fyt::serial_driver {
@@ -44,8 +48,8 @@ public:
   // Send gimbal command
   virtual void send(const rm_interfaces::msg::GimbalCmd &data) = 0;
 
-  // Receive data from serial port
-  virtual bool receive(rm_interfaces::msg::SerialReceiveData &data) = 0;
+  // Receive data from serial port, TIMEOUT if the line was idle
+  virtual ReceiveStatus receive(rm_interfaces::msg::SerialReceiveData &data) = 0;
 
   // Create subscriptions for SerialDriverNode
   virtual std::vector<rclcpp::SubscriptionBase::SharedPtr> getSubscriptions(
@@ -57,7 +61,58 @@ public:
 
   virtual std::string getErrorMessage() = 0;
 
+  // Host time (ns, system clock) at which the MCU sampled the last received data, false if the
+  // protocol carries no MCU timestamp or the clocks are not synchronized yet
+  virtual bool getSampleTime(int64_t &host_ns) {
+    (void)host_ns;
+    return false;
+  }
+
+  // Called by send() once the command is handed to the transporter, with the header of the
+  // command, i.e. the stamp of the camera frame it is computed from. Set before the
+  // subscriptions are created
+  using SentCallback = std::function<void(const std_msgs::msg::Header &)>;
+  void setSentCallback(SentCallback callback) { sent_callback_ = std::move(callback); }
+
+  // The transporter of the protocol, set by the ProtocolFactory
+  void attachTransporter(TransporterInterface::SharedPtr transporter) {
+    transporter_ = std::move(transporter);
+  }
+  // Reopen the device from the receiving thread, see TransporterInterface::requestReopen
+  void requestReconnect() {
+    if (transporter_ != nullptr) {
+      transporter_->requestReopen();
+    }
+  }
+
+  // Frames per second of the protocols sending all their commands in one scheduled frame
+  virtual void setTransmitRate(double rate) { (void)rate; }
+
+  // Arbiter of the gimbal commands of the solvers, replaced before the subscriptions are
+  // created. The node passes it the vision modes received
+  void setArbiterParams(const GimbalCmdArbiter::Params &params) {
+    arbiter_ = std::make_unique<GimbalCmdArbiter>(params);
+  }
+  GimbalCmdArbiter &arbiter() { return *arbiter_; }
+
+protected:
+  void notifySent(const std_msgs::msg::Header &header) {
+    if (sent_callback_) {
+      sent_callback_(header);
+    }
+  }
+
+  // Subscriptions to armor_solver/cmd_gimbal and rune_solver/cmd_gimbal, their commands go
+  // through the arbiter to send(). With an arbiter rate, a timer of the node sends the newest
+  // command of each slot
+  std::vector<rclcpp::SubscriptionBase::SharedPtr> createGimbalSubscriptions(
+    rclcpp::Node::SharedPtr node);
+
 private:
+  SentCallback sent_callback_;
+  TransporterInterface::SharedPtr transporter_;
+  std::unique_ptr<GimbalCmdArbiter> arbiter_ = std::make_unique<GimbalCmdArbiter>();
+  rclcpp::TimerBase::SharedPtr arbiter_timer_;
 };
 
 }  // namespace protocol
@@ -0,0 +1,96 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SERIAL_DRIVER_CRC_PROTOCOL_HPP_
+#define SERIAL_DRIVER_CRC_PROTOCOL_HPP_
+
+// std
+#include <array>
+#include <mutex>
+// project
+#include "rm_serial_driver/crc_packet.hpp"
+#include "rm_serial_driver/protocol.hpp"
+#include "rm_utils/device_clock.hpp"
+
+namespace fyt::serial_driver::protocol {
+// Infantry protocol on CRC checked, versioned frames with sequence numbers, see crc_packet.hpp
+class ProtocolCrc : public Protocol {
+public:
+  explicit ProtocolCrc(TransporterInterface::SharedPtr transporter, bool enable_data_print);
+
+  ~ProtocolCrc() = default;
+
+  void send(const rm_interfaces::msg::GimbalCmd &data) override;
+
+  ReceiveStatus receive(rm_interfaces::msg::SerialReceiveData &data) override;
+
+  std::vector<rclcpp::SubscriptionBase::SharedPtr> getSubscriptions(
+    rclcpp::Node::SharedPtr node) override;
+
+  std::vector<rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr> getClients(
+    rclcpp::Node::SharedPtr node) const override;
+
+  std::string getErrorMessage() override { return error_message_; }
+
+  bool getSampleTime(int64_t &host_ns) override;
+
+private:
+  using ReceiveFrame = crc::Frame<crc::ReceivePayload>;
+  using SendFrame = crc::Frame<crc::SendPayload>;
+
+  // Take the first valid frame in recv_buffer_, skipping the bytes before it
+  bool parseFrame(ReceiveFrame &frame);
+  void consume(int len);
+  // Update the clock model with the MCU timestamps of a received frame
+  void syncClock(const crc::ReceivePayload &payload);
+  void resetClock();
+  // System clock in ns, the ROS clock of the nodes without simulated time
+  static int64_t hostNow();
+
+  TransporterInterface::SharedPtr transporter_;
+  bool enable_data_print_;
+
+  std::mutex send_mutex_;
+  uint8_t send_sequence_ = 0;
+
+  // Only used by the receiving thread
+  uint8_t recv_buffer_[sizeof(ReceiveFrame) * 8];  // NOLINT
+  int recv_buf_len_ = 0;
+  bool has_sequence_ = false;
+  uint8_t last_sequence_ = 0;
+  uint64_t lost_frames_ = 0;
+  uint64_t bad_frames_ = 0;
+  std::string error_message_;
+
+  // Clock sync, only used by the receiving thread. The MCU time of every frame is mapped onto
+  // the host by the lower envelope of the receive times (DeviceClock, offset and drift), which
+  // is late by the smallest one-way delay. That delay is taken as half of the smallest round
+  // trip of the echoed send times among the last RTT_NUM
+  static constexpr size_t RTT_NUM = 32;
+  static constexpr int64_t MAX_ROUND_TRIP_US = 100000;
+  int64_t read_host_ns_ = 0;
+  utils::DeviceClock device_clock_{1000.0};
+  bool has_device_time_ = false;
+  uint32_t last_device_us_ = 0;
+  uint64_t device_ticks_ = 0;
+  uint32_t last_echo_us_ = 0;
+  std::array<int64_t, RTT_NUM> round_trips_us_;
+  size_t round_trip_head_ = 0;
+  size_t round_trip_size_ = 0;
+  bool has_sample_time_ = false;
+  int64_t sample_host_ns_ = 0;
+};
+}  // namespace fyt::serial_driver::protocol
+
+#endif  // SERIAL_DRIVER_CRC_PROTOCOL_HPP_
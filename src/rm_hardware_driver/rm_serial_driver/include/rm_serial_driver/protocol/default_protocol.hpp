@@ -22,13 +22,13 @@ namespace fyt::serial_driver::protocol {
 // 默认
 class DefaultProtocol : public Protocol {
 public:
-  explicit DefaultProtocol(std::string_view port_name, bool enable_data_print);
+  explicit DefaultProtocol(TransporterInterface::SharedPtr transporter, bool enable_data_print);
 
   ~DefaultProtocol() = default;
 
   void send(const rm_interfaces::msg::GimbalCmd &data) override;
 
-  bool receive(rm_interfaces::msg::SerialReceiveData &data) override;
+  ReceiveStatus receive(rm_interfaces::msg::SerialReceiveData &data) override;
 
   std::vector<rclcpp::SubscriptionBase::SharedPtr> getSubscriptions(rclcpp::Node::SharedPtr node) override;
 
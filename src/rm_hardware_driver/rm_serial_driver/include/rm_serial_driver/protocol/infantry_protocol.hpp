@@ -22,13 +22,13 @@ namespace fyt::serial_driver::protocol {
 // 步兵通信协议
 class ProtocolInfantry : public Protocol {
 public:
-  explicit ProtocolInfantry(std::string_view port_name, bool enable_data_print);
+  explicit ProtocolInfantry(TransporterInterface::SharedPtr transporter, bool enable_data_print);
 
   ~ProtocolInfantry() = default;
 
   void send(const rm_interfaces::msg::GimbalCmd &data) override;
 
-  bool receive(rm_interfaces::msg::SerialReceiveData &data) override;
+  ReceiveStatus receive(rm_interfaces::msg::SerialReceiveData &data) override;
 
   std::vector<rclcpp::SubscriptionBase::SharedPtr> getSubscriptions(
     rclcpp::Node::SharedPtr node) override;
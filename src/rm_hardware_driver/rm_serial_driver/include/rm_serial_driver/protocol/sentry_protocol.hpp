@@ -16,23 +16,35 @@
 #ifndef SERIAL_DRIVER__SENTRY_PROTOCOL_HPP_
 #define SERIAL_DRIVER__SENTRY_PROTOCOL_HPP_
 
+// std
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
 // project
 #include "rm_interfaces/msg/chassis_cmd.hpp"
+#include "rm_serial_driver/latest_slot.hpp"
 #include "rm_serial_driver/protocol.hpp"
 
 namespace fyt::serial_driver::protocol {
 // 哨兵通信协议
+// The gimbal and the chassis commands share one frame. The callbacks only store the latest
+// command of each, a transmit thread woken by them sends one frame with both, at most
+// transmit_rate frames per second
 class ProtocolSentry : public Protocol {
 public:
-  explicit ProtocolSentry(std::string_view port_name, bool enable_data_print);
+  explicit ProtocolSentry(TransporterInterface::SharedPtr transporter, bool enable_data_print);
 
-  ~ProtocolSentry() = default;
+  ~ProtocolSentry();
 
   void send(const rm_interfaces::msg::GimbalCmd &data) override;
 
   void send(const rm_interfaces::msg::ChassisCmd &data);
 
-  bool receive(rm_interfaces::msg::SerialReceiveData &data) override;
+  // 0: a frame for every wakeup
+  void setTransmitRate(double rate) override;
+
+  ReceiveStatus receive(rm_interfaces::msg::SerialReceiveData &data) override;
 
   std::vector<rclcpp::SubscriptionBase::SharedPtr> getSubscriptions(rclcpp::Node::SharedPtr node) override;
 
@@ -43,9 +55,35 @@ public:
 
 private:
   enum GameStatus { NOT_START = 0x00, ENEMY_RED = 0x01, ENEMY_BLUE = 0x02 };
+  static constexpr double DEFAULT_TRANSMIT_RATE = 250.0;
+
+  struct GimbalFields {
+    // Stamp of the frame the command is computed from, for notifySent
+    int64_t stamp_ns;
+    float pitch;
+    float yaw;
+    float distance;
+    uint8_t fire;
+  };
+  struct ChassisFields {
+    float linear_x;
+    float linear_y;
+    float angular_z;
+    uint8_t spinning;
+    uint8_t navigating;
+  };
+
+  void transmitLoop();
+  void wakeTransmitter();
+
   FixedPacketTool<32>::SharedPtr packet_tool_;
-  FixedPacket<32> packet_;
-  rm_interfaces::msg::ChassisCmd chassis_cmd_;
+  LatestSlot<GimbalFields> gimbal_slot_;
+  LatestSlot<ChassisFields> chassis_slot_;
+
+  std::atomic<int64_t> transmit_period_ns_{0};
+  std::atomic<bool> running_{true};
+  int wakeup_fd_ = -1;
+  std::unique_ptr<std::thread> transmit_thread_;
 };
 }  // namespace fyt::serial_driver::protocol
 
@@ -23,13 +23,13 @@ namespace fyt::serial_driver::protocol {
 // 默认
 class TestProtocol : public Protocol {
 public:
-  explicit TestProtocol(std::string_view port_name, bool enable_data_print);
+  explicit TestProtocol(TransporterInterface::SharedPtr transporter, bool enable_data_print);
 
   ~TestProtocol() = default;
 
   void send(const rm_interfaces::msg::GimbalCmd &data) override;
 
-  bool receive(rm_interfaces::msg::SerialReceiveData &data) override;
+  ReceiveStatus receive(rm_interfaces::msg::SerialReceiveData &data) override;
 
   std::vector<rclcpp::SubscriptionBase::SharedPtr> getSubscriptions(rclcpp::Node::SharedPtr node) override;
 
@@ -0,0 +1,68 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SERIAL_DRIVER_TRAJECTORY_PROTOCOL_HPP_
+#define SERIAL_DRIVER_TRAJECTORY_PROTOCOL_HPP_
+
+#include <cstdint>
+#include "rm_serial_driver/protocol.hpp"
+
+namespace fyt::serial_driver::protocol {
+// Streams the setpoint horizon of the solver (GimbalCmd.setpoints), so that the MCU interpolates
+// between the host updates: the commands may be sent at a lower rate and a late one is covered
+// by the setpoints of the previous one.
+//
+// Sent in a FixedPacket64:
+//   [1] fire state, [2] number of setpoints n (1 ~ MAX_SETPOINTS), [3] float distance,
+//   then from SETPOINTS_INDEX every SETPOINT_SIZE bytes:
+//     uint8 time (ms after the packet is sent), float yaw, float pitch (rad),
+//     int16 feed-forward yaw velocity (mrad/s)
+// A command without setpoints is sent as a single one at its yaw and pitch. The setpoints
+// already past are dropped but for the last of them, sent at time 0.
+// Received: the 16-byte packet of the infantry protocol
+class ProtocolTrajectory : public Protocol {
+public:
+  static constexpr int MAX_SETPOINTS = 5;
+  static constexpr int SETPOINTS_INDEX = 7;
+  static constexpr int SETPOINT_SIZE = 1 + 4 + 4 + 2;
+
+  explicit ProtocolTrajectory(TransporterInterface::SharedPtr transporter, bool enable_data_print);
+
+  ~ProtocolTrajectory() = default;
+
+  void send(const rm_interfaces::msg::GimbalCmd &data) override;
+
+  ReceiveStatus receive(rm_interfaces::msg::SerialReceiveData &data) override;
+
+  std::vector<rclcpp::SubscriptionBase::SharedPtr> getSubscriptions(
+    rclcpp::Node::SharedPtr node) override;
+
+  std::vector<rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr> getClients(
+    rclcpp::Node::SharedPtr node) const override;
+
+  std::string getErrorMessage() override { return recv_tool_->getErrorMessage(); }
+
+  // Pack the command, the setpoint times are made relative to now_ns (ns, clock of the stamps)
+  static void pack(const rm_interfaces::msg::GimbalCmd &data,
+                   int64_t now_ns,
+                   FixedPacket<64> &packet);
+
+private:
+  FixedPacketTool<64>::SharedPtr send_tool_;
+  FixedPacketTool<16>::SharedPtr recv_tool_;
+};
+}  // namespace fyt::serial_driver::protocol
+
+#endif  // SERIAL_DRIVER_TRAJECTORY_PROTOCOL_HPP_
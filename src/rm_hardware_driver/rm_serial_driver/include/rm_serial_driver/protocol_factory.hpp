@@ -20,41 +20,65 @@
 #include <string_view>
 
 #include "rm_serial_driver/protocol.hpp"
+#include "rm_serial_driver/protocol/crc_protocol.hpp"
 #include "rm_serial_driver/protocol/default_protocol.hpp"
 #include "rm_serial_driver/protocol/infantry_protocol.hpp"
 #include "rm_serial_driver/protocol/sentry_protocol.hpp"
 #include "rm_serial_driver/protocol/test_protocol.hpp"
+#include "rm_serial_driver/protocol/trajectory_protocol.hpp"
+#include "rm_serial_driver/uart_transporter.hpp"
+#include "rm_serial_driver/usb_cdc_transporter.hpp"
 
 namespace fyt::serial_driver {
 
 class ProtocolFactory {
 public:
   ProtocolFactory() = delete;
-  // Factory method to create a protocol
-  static std::unique_ptr<protocol::Protocol> createProtocol(std::string_view protocol_type,
-                                                            std::string_view port_name,
-                                                            bool enable_data_print) {
-    if (protocol_type == "infantry") {
-      return std::make_unique<protocol::ProtocolInfantry>(port_name, enable_data_print);
-    }
-    if (protocol_type == "hero") {
-      return std::make_unique<protocol::DefaultProtocol>(port_name, enable_data_print);
+  // Factory method to create a transporter, "uart" or "usb_cdc"
+  static TransporterInterface::SharedPtr createTransporter(std::string_view transporter_type,
+                                                           std::string_view port_name,
+                                                           int baud_rate) {
+    if (transporter_type == "uart") {
+      return std::make_shared<UartTransporter>(std::string(port_name), baud_rate);
     }
-    if (protocol_type == "air") {
-      return std::make_unique<protocol::DefaultProtocol>(port_name, enable_data_print);
+    if (transporter_type == "usb_cdc") {
+      return std::make_shared<UsbCdcTransporter>(std::string(port_name), baud_rate);
     }
-    if (protocol_type == "sentry") {
-      return std::make_unique<protocol::ProtocolSentry>(port_name, enable_data_print);
+    return nullptr;
+  }
+
+  // Factory method to create a protocol
+  static std::unique_ptr<protocol::Protocol> createProtocol(
+    std::string_view protocol_type,
+    std::string_view port_name,
+    bool enable_data_print,
+    std::string_view transporter_type = "uart",
+    int baud_rate = 115200) {
+    auto transporter = createTransporter(transporter_type, port_name, baud_rate);
+    if (transporter == nullptr) {
+      return nullptr;
     }
-    if (protocol_type == "test") {
-      return std::make_unique<protocol::TestProtocol>(port_name, enable_data_print);
+    std::unique_ptr<protocol::Protocol> result;
+    if (protocol_type == "infantry") {
+      result = std::make_unique<protocol::ProtocolInfantry>(transporter, enable_data_print);
+    } else if (protocol_type == "hero") {
+      result = std::make_unique<protocol::DefaultProtocol>(transporter, enable_data_print);
+    } else if (protocol_type == "air") {
+      result = std::make_unique<protocol::DefaultProtocol>(transporter, enable_data_print);
+    } else if (protocol_type == "sentry") {
+      result = std::make_unique<protocol::ProtocolSentry>(transporter, enable_data_print);
+    } else if (protocol_type == "crc") {
+      result = std::make_unique<protocol::ProtocolCrc>(transporter, enable_data_print);
+    } else if (protocol_type == "trajectory") {
+      result = std::make_unique<protocol::ProtocolTrajectory>(transporter, enable_data_print);
+    } else if (protocol_type == "test") {
+      result = std::make_unique<protocol::TestProtocol>(transporter, enable_data_print);
     }
-    {
-      /* code */
+    // The watchdog of the node reopens the transporter through the protocol
+    if (result != nullptr) {
+      result->attachTransporter(transporter);
     }
-    
-
-    return nullptr;
+    return result;
   }
 };
 
@@ -0,0 +1,93 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SERIAL_DRIVER_RUNE_LOADER_HPP_
+#define SERIAL_DRIVER_RUNE_LOADER_HPP_
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+// ros2
+#include <composition_interfaces/srv/load_node.hpp>
+#include <composition_interfaces/srv/unload_node.hpp>
+#include <rcl_interfaces/msg/parameter.hpp>
+#include <rclcpp/rclcpp.hpp>
+
+namespace fyt::serial_driver {
+
+// Loads the rune detector and the rune solver into the detector container, through the
+// composition services, while a rune mode is requested, and unloads them once the armor modes
+// have been requested for unload_delay. The model and the threads of the rune pipeline are then
+// only resident while they are used, a short switch to the armor mode keeps them loaded
+class RuneLoader {
+public:
+  struct Params {
+    // Name of the container, relative to the namespace of the node
+    std::string container = "camera_detector_container";
+    // In seconds
+    double unload_delay = 10.0;
+    // Parameter files of the components, as given to the launch file
+    std::string detector_params;
+    std::string solver_params;
+  };
+
+  // on_loaded is called by the executor when a component is loaded, so that its mode is sent
+  RuneLoader(rclcpp::Node *node, const Params &params, std::function<void()> on_loaded);
+
+  // Load or unload the components for the latest requested mode. Called by the mode thread,
+  // never waits for the container
+  void update(int mode, std::chrono::steady_clock::time_point now);
+
+  // Whether a set_mode service may be called, false for the service of a component not loaded.
+  // The mode of a component is sent again after it is loaded
+  bool available(const std::string &service_name) const;
+
+private:
+  struct Component {
+    std::string package;
+    std::string plugin;
+    std::string name;
+    std::vector<rcl_interfaces::msg::Parameter> parameters;
+    // Id given by the container, 0 if not loaded
+    std::atomic<uint64_t> unique_id{0};
+    std::atomic<bool> pending{false};
+  };
+
+  void load(Component &component);
+  void unload(Component &component);
+
+  // Parameters of the node in the file, those of "/**" first
+  static std::vector<rcl_interfaces::msg::Parameter> readParameters(const std::string &file,
+                                                                    const std::string &node_name);
+
+  Params params_;
+  std::function<void()> on_loaded_;
+  std::vector<std::unique_ptr<Component>> components_;
+  rclcpp::Client<composition_interfaces::srv::LoadNode>::SharedPtr load_client_;
+  rclcpp::Client<composition_interfaces::srv::UnloadNode>::SharedPtr unload_client_;
+  std::string node_namespace_;
+  // Only used by the mode thread
+  bool rune_requested_ = false;
+  std::chrono::steady_clock::time_point last_rune_request_;
+};
+
+}  // namespace fyt::serial_driver
+
+#endif  // SERIAL_DRIVER_RUNE_LOADER_HPP_
@@ -17,23 +17,35 @@
 #define SERIAL_DRIVER_SERIAL_DRIVER_NODE_HPP_
 
 // std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 // ros2
 #include <tf2_ros/transform_broadcaster.h>
 
 #include <geometry_msgs/msg/transform_stamped.hpp>
 #include <geometry_msgs/msg/twist.hpp>
+#include <rcl_interfaces/msg/set_parameters_result.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <std_msgs/msg/header.hpp>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
 // project
+#include "rm_utils/attitude_cache.hpp"
 #include "rm_utils/heartbeat.hpp"
+#include "rm_utils/spsc_queue.hpp"
+#include "rm_utils/stall_watchdog.hpp"
 #include "rm_interfaces/msg/gimbal_cmd.hpp"
 #include "rm_interfaces/msg/serial_receive_data.hpp"
 #include "rm_interfaces/srv/set_mode.hpp"
 #include "rm_serial_driver/fixed_packet_tool.hpp"
 #include "rm_serial_driver/protocol.hpp"
 #include "rm_serial_driver/protocol_factory.hpp"
+#include "rm_serial_driver/rune_loader.hpp"
 #include "rm_serial_driver/transporter_interface.hpp"
 
 namespace fyt::serial_driver {
@@ -54,15 +66,37 @@ public:
   struct SetModeClient {
     SetModeClient(rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr p) : ptr(p) {}
     std::atomic<bool> on_waiting = false;
+    // Mode acknowledged by the service
     std::atomic<int> mode = 0;
+    // Latest mode received from the serial port, older requests are dropped
+    std::atomic<int> requested_mode = 0;
+    // Time of the pending request, only used by the mode thread
+    std::chrono::steady_clock::time_point request_time;
     rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr ptr;
   };
   std::unordered_map<std::string, SetModeClient> set_mode_clients_;
   void setMode(SetModeClient &client, const uint8_t mode);
 
 private:
+  // Sends the requested modes, so that the listen thread never waits for a service
+  void modeLoop();
+  std::unique_ptr<std::thread> mode_thread_;
+  std::mutex mode_mutex_;
+  std::condition_variable mode_cv_;
+  bool mode_requested_ = false;
+  // Rune components loaded on demand, only if rune_on_demand.enable
+  std::unique_ptr<RuneLoader> rune_loader_;
+  void requestModeUpdate();
+
   // Heartbeat
   HeartBeatPublisher::SharedPtr heartbeat_;
+  // Metrics reported with the heartbeat, registered by init() before the threads use them
+  utils::LatencyHistogram *packet_interval_ = nullptr;
+  utils::LatencyHistogram *glass_to_serial_ = nullptr;
+  std::atomic<int64_t> *dropped_packets_ = nullptr;
+  std::atomic<int64_t> *receive_errors_ = nullptr;
+  std::atomic<int64_t> *receive_queue_depth_ = nullptr;
+  std::atomic<int64_t> *received_packets_ = nullptr;
 
   std::unique_ptr<std::thread> listen_thread_;
   // Protocol
@@ -74,10 +108,30 @@ private:
   std::vector<rclcpp::SubscriptionBase::SharedPtr> subscriptions_;
   // Publisher
   rclcpp::Publisher<rm_interfaces::msg::SerialReceiveData>::SharedPtr serial_receive_data_pub_;
-
-  // Broadcast tf from odom to gimbal_link
-  double timestamp_offset_ = 0;
+  // Headers of the sent commands, only if publish_sent
+  rclcpp::Publisher<std_msgs::msg::Header>::SharedPtr sent_pub_;
+
+  // Param set callback, the listen thread reads timestamp_offset_ without querying the node
+  rcl_interfaces::msg::SetParametersResult onSetParameters(
+    std::vector<rclcpp::Parameter> parameters);
+  rclcpp::Node::OnSetParametersCallbackHandle::SharedPtr on_set_parameters_callback_handle_;
+
+  // The listen thread only parses the packets and hands them over, the publish thread publishes
+  // them and the tf so that the serial port is never held up by DDS
+  void publishLoop();
+  void publishTransforms(const utils::AttitudeCache<>::Sample &sample);
+  std::unique_ptr<std::thread> publish_thread_;
+  utils::SpscQueue<rm_interfaces::msg::SerialReceiveData, 64> receive_queue_;
+  int wakeup_fd_ = -1;
+
+  // Broadcast tf from odom to gimbal_link, at most tf_rate_ Hz (every sample if 0)
+  std::atomic<double> timestamp_offset_{0};
+  double tf_rate_ = 0;
   std::unique_ptr<tf2_ros::TransformBroadcaster> tf_broadcaster_;
+
+  // Reopens the device if no packet arrives for watchdog.timeout_ms, declared last so that it
+  // stops before the protocol is destroyed
+  std::unique_ptr<utils::StallWatchdog> watchdog_;
 };
 
 }  // namespace fyt::serial_driver
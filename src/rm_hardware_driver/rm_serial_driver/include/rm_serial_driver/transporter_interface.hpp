@@ -20,11 +20,16 @@
 #define SERIAL_DRIVER_TRANSPORTER_INTERFACE_HPP_
 
 // std
+#include <atomic>
 #include <memory>
 #include <string>
 
 namespace fyt::serial_driver {
 
+// Result of receiving a packet. An idle line is no error: TIMEOUT when nothing arrived within
+// the read timeout of the transporter, FAILURE when the device failed or the data was invalid
+enum class ReceiveStatus { OK, TIMEOUT, FAILURE };
+
 // Transporter device interface to transport data between embedded systems
 // (stm32,c51) and PC
 class TransporterInterface {
@@ -34,12 +39,23 @@ public:
   virtual bool open() = 0;
   virtual void close() = 0;
   virtual bool isOpen() = 0;
-  // return recv len>0, return <0 if error
+  // return recv len>0, 0 if nothing arrived within the timeout of the transporter, <0 if error
   virtual int read(void *buffer, size_t len) = 0;
   // return send len>0, return <0 if error
   virtual int write(const void *buffer, size_t len) = 0;
   // get error message when open() return false.
   virtual std::string errorMessage() = 0;
+
+  // Reopen the device at the next read, e.g. asked by a watchdog that sees no data coming while
+  // the device reports no error. Any thread may call, the reading thread reopens
+  void requestReopen() { reopen_requested_ = true; }
+
+protected:
+  // Return: true once for every request
+  bool takeReopenRequest() { return reopen_requested_.exchange(false); }
+
+private:
+  std::atomic<bool> reopen_requested_{false};
 };
 
 }  // namespace fyt::serial_driver
@@ -45,6 +45,7 @@ public:
   bool open() override;
   void close() override;
   bool isOpen() override;
+  // Wait for the data with poll and take all the bytes available
   int read(void *buffer, size_t len) override;
   int write(const void *buffer, size_t len) override;
   std::string errorMessage() override { return error_message_; }
@@ -54,6 +55,8 @@ private:
     int speed = 115200, int flow_ctrl = 0, int databits = 0, int stopbits = 1, int parity = 'N');
 
 private:
+  // 等待数据的超时, 超时后read返回0
+  static constexpr int READ_TIMEOUT_MS = 100;
   // 设备文件描述符
   int fd_{-1};
   // 设备状态
@@ -0,0 +1,61 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SERIAL_DRIVER_USB_CDC_TRANSPORTER_HPP_
+#define SERIAL_DRIVER_USB_CDC_TRANSPORTER_HPP_
+
+// std
+#include <string>
+// project
+#include "rm_serial_driver/transporter_interface.hpp"
+
+namespace fyt::serial_driver {
+
+// USB-CDC or high speed UART (8N1, no flow control). Any baud rate is set through termios2 and
+// BOTHER, e.g. 921600 to 4000000, and the low latency flag of the driver is set when supported.
+// USB-CDC devices ignore the baud rate and run at the USB speed
+class UsbCdcTransporter : public TransporterInterface {
+public:
+  explicit UsbCdcTransporter(const std::string &device_path = "/dev/ttyACM0",
+                             int speed = 921600)
+  : device_path_(device_path), speed_(speed) {}
+
+  ~UsbCdcTransporter() override { close(); }
+
+  bool open() override;
+  void close() override;
+  bool isOpen() override { return is_open_; }
+  // Wait for the data with poll and take all the bytes available
+  int read(void *buffer, size_t len) override;
+  // Write the whole buffer, waiting for the tty buffer if it is full
+  int write(const void *buffer, size_t len) override;
+  std::string errorMessage() override { return error_message_; }
+
+private:
+  bool setParam();
+
+  // 等待数据的超时, 超时后read返回0
+  static constexpr int READ_TIMEOUT_MS = 100;
+  // 发送缓存满时等待的超时
+  static constexpr int WRITE_TIMEOUT_MS = 10;
+  int fd_{-1};
+  bool is_open_{false};
+  std::string error_message_;
+  std::string device_path_;
+  int speed_;
+};
+
+}  // namespace fyt::serial_driver
+
+#endif  // SERIAL_DRIVER_USB_CDC_TRANSPORTER_HPP_
@@ -0,0 +1,95 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_serial_driver/gimbal_cmd_arbiter.hpp"
+
+// ros2
+#include <rclcpp/time.hpp>
+// project
+#include "rm_utils/common.hpp"
+
+namespace fyt::serial_driver {
+
+void GimbalCmdArbiter::setMode(int mode) noexcept {
+  const Source source = mode >= VisionMode::SMALL_RUNE_RED ? RUNE : ARMOR;
+  active_.store(source, std::memory_order_relaxed);
+}
+
+void GimbalCmdArbiter::attachMetrics(utils::Metrics &metrics) {
+  inactive_drops_ = &metrics.counter("cmd_inactive_drops");
+  stale_drops_ = &metrics.counter("cmd_stale_drops");
+  coalesced_ = &metrics.counter("cmd_coalesced");
+}
+
+bool GimbalCmdArbiter::stale(const rm_interfaces::msg::GimbalCmd &cmd,
+                             int64_t now_ns) const noexcept {
+  const int64_t stamp_ns = rclcpp::Time(cmd.header.stamp).nanoseconds();
+  if (stamp_ns == 0) {
+    return false;
+  }
+  return params_.max_age > 0 && now_ns - stamp_ns > static_cast<int64_t>(params_.max_age * 1e9);
+}
+
+bool GimbalCmdArbiter::offer(Source source,
+                             const rm_interfaces::msg::GimbalCmd &cmd,
+                             int64_t now_ns) {
+  if (!params_.enable) {
+    return true;
+  }
+  if (source != activeSource()) {
+    inactive_drops_->fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Out of order, or computed from a frame too old to be aimed at
+  const int64_t stamp_ns = rclcpp::Time(cmd.header.stamp).nanoseconds();
+  if ((stamp_ns != 0 && stamp_ns < last_stamp_ns_[source]) || stale(cmd, now_ns)) {
+    stale_drops_->fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (stamp_ns != 0) {
+    last_stamp_ns_[source] = stamp_ns;
+  }
+  if (params_.rate <= 0) {
+    return true;
+  }
+  if (has_pending_) {
+    coalesced_->fetch_add(1, std::memory_order_relaxed);
+  }
+  pending_ = cmd;
+  pending_source_ = source;
+  has_pending_ = true;
+  return false;
+}
+
+bool GimbalCmdArbiter::take(rm_interfaces::msg::GimbalCmd &cmd, int64_t now_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!has_pending_) {
+    return false;
+  }
+  has_pending_ = false;
+  // The mode may have changed while the command waited
+  if (pending_source_ != activeSource()) {
+    inactive_drops_->fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (stale(pending_, now_ns)) {
+    stale_drops_->fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  cmd = pending_;
+  return true;
+}
+
+}  // namespace fyt::serial_driver
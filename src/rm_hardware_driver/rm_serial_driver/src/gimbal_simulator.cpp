@@ -0,0 +1,114 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "rm_serial_driver/gimbal_simulator.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace fyt::serial_driver {
+namespace {
+constexpr double MAX_STEP = 0.001;
+
+double normalize(double angle) { return std::remainder(angle, 2 * M_PI); }
+}  // namespace
+
+GimbalSimulator::GimbalSimulator(const Params &params, double yaw, double pitch)
+: params_(params)
+, yaw_(yaw)
+, pitch_(pitch)
+, rng_(params.seed)
+, noise_(0.0, std::max(params.imu_noise, 0.0)) {}
+
+void GimbalSimulator::command(double now, std::vector<Setpoint> setpoints) {
+  if (setpoints.empty()) {
+    return;
+  }
+  // The MCU takes the setpoint times from the reception
+  for (auto &setpoint : setpoints) {
+    setpoint.time += params_.delay;
+  }
+  pending_.push_back(Command{now + params_.delay, std::move(setpoints)});
+}
+
+void GimbalSimulator::reference(double t) {
+  while (!pending_.empty() && pending_.front().arrival <= t) {
+    active_ = std::move(pending_.front().setpoints);
+    pending_.pop_front();
+  }
+  if (active_.empty()) {
+    return;
+  }
+  has_reference_ = true;
+  auto next = std::find_if(
+    active_.begin(), active_.end(), [t](const Setpoint &s) { return s.time > t; });
+  if (next == active_.begin() || next == active_.end()) {
+    // Before the horizon, or held at its end
+    const Setpoint &s = next == active_.end() ? active_.back() : active_.front();
+    ref_yaw_ = s.yaw;
+    ref_pitch_ = s.pitch;
+    ref_yaw_velocity_ = next == active_.end() && active_.size() > 1 ? 0 : s.yaw_velocity;
+    return;
+  }
+  const Setpoint &a = *(next - 1);
+  const Setpoint &b = *next;
+  const double r = (t - a.time) / (b.time - a.time);
+  ref_yaw_ = normalize(a.yaw + r * normalize(b.yaw - a.yaw));
+  ref_pitch_ = a.pitch + r * (b.pitch - a.pitch);
+  ref_yaw_velocity_ = a.yaw_velocity + r * (b.yaw_velocity - a.yaw_velocity);
+}
+
+void GimbalSimulator::step(double now) {
+  if (time_ < 0) {
+    time_ = now;
+    return;
+  }
+  const double wn2 = params_.natural_frequency * params_.natural_frequency;
+  const double c = 2 * params_.damping * params_.natural_frequency;
+  while (time_ < now) {
+    const double dt = std::min(MAX_STEP, now - time_);
+    time_ += dt;
+    reference(time_);
+    if (!has_reference_) {
+      continue;
+    }
+    // Semi-implicit Euler, stable for the servo bandwidths of a gimbal at 1 ms
+    const double yaw_acc =
+      wn2 * normalize(ref_yaw_ - yaw_) + c * (ref_yaw_velocity_ - yaw_velocity_);
+    const double pitch_acc = wn2 * (ref_pitch_ - pitch_) - c * pitch_velocity_;
+    yaw_velocity_ += yaw_acc * dt;
+    pitch_velocity_ += pitch_acc * dt;
+    yaw_ = normalize(yaw_ + yaw_velocity_ * dt);
+    pitch_ += pitch_velocity_ * dt;
+  }
+}
+
+void GimbalSimulator::measure(double &yaw, double &pitch) {
+  if (params_.imu_noise > 0) {
+    yaw = normalize(yaw_ + noise_(rng_));
+    pitch = pitch_ + noise_(rng_);
+  } else {
+    yaw = yaw_;
+    pitch = pitch_;
+  }
+}
+
+double GimbalSimulator::yawError() const noexcept {
+  return has_reference_ ? normalize(ref_yaw_ - yaw_) : 0;
+}
+
+}  // namespace fyt::serial_driver
@@ -0,0 +1,223 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_serial_driver/protocol/crc_protocol.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+// third party
+#include <fmt/format.h>
+// project
+#include "rm_utils/trace.hpp"
+
+namespace fyt::serial_driver::protocol {
+ProtocolCrc::ProtocolCrc(TransporterInterface::SharedPtr transporter, bool enable_data_print)
+: transporter_(std::move(transporter))
+, enable_data_print_(enable_data_print) {
+  FYT_REGISTER_LOGGER("serial_driver", "~/fyt2024-log", INFO);
+}
+
+void ProtocolCrc::send(const rm_interfaces::msg::GimbalCmd &data) {
+  // The command carries the header of the target, i.e. the stamp of its frame
+  utils::TraceScope trace(utils::TraceStage::SERIAL_SEND,
+                          rclcpp::Time(data.header.stamp).nanoseconds());
+  SendFrame frame;
+  auto &payload = frame.payload;
+  const auto &msg = data;
+  FYT_CRC_SEND_FIELDS(FYT_CRC_FROM_MSG)
+  payload.host_time_us = static_cast<uint32_t>(hostNow() / 1000);
+
+  {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    crc::sealFrame(frame, send_sequence_++);
+    if (transporter_->write(&frame, sizeof(frame)) != static_cast<int>(sizeof(frame))) {
+      FYT_ERROR("serial_driver", "transporter_->write() failed");
+      transporter_->close();
+      transporter_->open();
+      return;
+    }
+  }
+  notifySent(data.header);
+}
+
+void ProtocolCrc::consume(int len) {
+  recv_buf_len_ -= len;
+  std::memmove(recv_buffer_, recv_buffer_ + len, recv_buf_len_);
+}
+
+bool ProtocolCrc::parseFrame(ReceiveFrame &frame) {
+  constexpr int header_size = sizeof(crc::FrameHeader);
+  constexpr int frame_size = sizeof(ReceiveFrame);
+  int i = 0;
+  for (; i + header_size <= recv_buf_len_; i++) {
+    if (recv_buffer_[i] != crc::SOF) {
+      continue;
+    }
+    const crc::FrameStatus status = crc::checkHeader(recv_buffer_ + i);
+    if (status == crc::FrameStatus::BAD_VERSION) {
+      error_message_ = fmt::format("protocol version {} is expected, got {}",
+                                   crc::PROTOCOL_VERSION,
+                                   recv_buffer_[i + 1]);
+    }
+    if (status != crc::FrameStatus::OK) {
+      continue;
+    }
+    if (i + frame_size > recv_buf_len_) {
+      // Wait for the rest of the frame
+      break;
+    }
+    if (crc::parseFrame(recv_buffer_ + i, frame) != crc::FrameStatus::OK) {
+      bad_frames_++;
+      error_message_ = fmt::format("crc16 mismatched, {} bad frames", bad_frames_);
+      continue;
+    }
+    consume(i + frame_size);
+    return true;
+  }
+  // Keep what may be the beginning of a frame
+  while (i < recv_buf_len_ && recv_buffer_[i] != crc::SOF) {
+    i++;
+  }
+  if (i > 0) {
+    consume(i);
+  }
+  return false;
+}
+
+ReceiveStatus ProtocolCrc::receive(rm_interfaces::msg::SerialReceiveData &data) {
+  ReceiveFrame frame;
+  while (!parseFrame(frame)) {
+    // At most sizeof(ReceiveFrame) - 1 bytes are left after parsing
+    int recv_len =
+      transporter_->read(recv_buffer_ + recv_buf_len_, sizeof(recv_buffer_) - recv_buf_len_);
+    if (recv_len == 0) {
+      error_message_ = "no data";
+      return ReceiveStatus::TIMEOUT;
+    }
+    if (recv_len < 0) {
+      error_message_ = transporter_->errorMessage();
+      recv_buf_len_ = 0;
+      has_sequence_ = false;
+      resetClock();
+      transporter_->close();
+      transporter_->open();
+      return ReceiveStatus::FAILURE;
+    }
+    if (enable_data_print_) {
+      for (int i = 0; i < recv_len; i++) {
+        std::cout << std::hex << static_cast<int>(recv_buffer_[recv_buf_len_ + i]) << " ";
+      }
+      std::cout << "\n";
+    }
+    recv_buf_len_ += recv_len;
+    read_host_ns_ = hostNow();
+  }
+
+  // Loss detection by the 8-bit sequence number
+  const uint8_t sequence = frame.header.sequence;
+  if (has_sequence_ && sequence != static_cast<uint8_t>(last_sequence_ + 1)) {
+    lost_frames_ += static_cast<uint8_t>(sequence - last_sequence_ - 1);
+    FYT_WARN("serial_driver", "Lost {} frames in total", lost_frames_);
+  }
+  has_sequence_ = true;
+  last_sequence_ = sequence;
+  syncClock(frame.payload);
+
+  const auto &payload = frame.payload;
+  auto &msg = data;
+  FYT_CRC_RECEIVE_FIELDS(FYT_CRC_TO_MSG)
+  return ReceiveStatus::OK;
+}
+
+int64_t ProtocolCrc::hostNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::system_clock::now().time_since_epoch())
+    .count();
+}
+
+void ProtocolCrc::resetClock() {
+  device_clock_.reset();
+  has_device_time_ = false;
+  last_echo_us_ = 0;
+  round_trip_size_ = 0;
+  has_sample_time_ = false;
+}
+
+void ProtocolCrc::syncClock(const crc::ReceivePayload &payload) {
+  // Unwrap the 32-bit MCU time
+  const uint32_t device_us = payload.timestamp_us;
+  if (has_device_time_) {
+    device_ticks_ += static_cast<uint32_t>(device_us - last_device_us_);
+  } else {
+    device_ticks_ = device_us;
+    has_device_time_ = true;
+  }
+  last_device_us_ = device_us;
+  const int64_t envelope_ns = device_clock_.update(device_ticks_, read_host_ns_);
+
+  // Round trip of the echoed send time, without the time the MCU held it before sampling
+  if (payload.echo_host_us != 0 && payload.echo_host_us != last_echo_us_) {
+    last_echo_us_ = payload.echo_host_us;
+    const auto host_us = static_cast<uint32_t>(read_host_ns_ / 1000);
+    const int64_t round_trip_us =
+      static_cast<int32_t>(host_us - payload.echo_host_us) -
+      int64_t{static_cast<int32_t>(device_us - payload.echo_receive_us)};
+    if (round_trip_us >= 0 && round_trip_us < MAX_ROUND_TRIP_US) {
+      round_trips_us_[round_trip_head_] = round_trip_us;
+      round_trip_head_ = (round_trip_head_ + 1) % RTT_NUM;
+      round_trip_size_ = std::min(round_trip_size_ + 1, RTT_NUM);
+    }
+  }
+
+  int64_t one_way_ns = 0;
+  if (round_trip_size_ > 0) {
+    one_way_ns = *std::min_element(round_trips_us_.begin(),
+                                   round_trips_us_.begin() + round_trip_size_) *
+                 500;
+  }
+  sample_host_ns_ = envelope_ns - one_way_ns;
+  has_sample_time_ = true;
+}
+
+bool ProtocolCrc::getSampleTime(int64_t &host_ns) {
+  if (!has_sample_time_) {
+    return false;
+  }
+  host_ns = sample_host_ns_;
+  return true;
+}
+
+std::vector<rclcpp::SubscriptionBase::SharedPtr> ProtocolCrc::getSubscriptions(
+  rclcpp::Node::SharedPtr node) {
+  // Only the commands of the solver of the current mode
+  return createGimbalSubscriptions(node);
+}
+
+std::vector<rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr> ProtocolCrc::getClients(
+  rclcpp::Node::SharedPtr node) const {
+  auto client1 = node->create_client<rm_interfaces::srv::SetMode>("armor_detector/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  auto client2 = node->create_client<rm_interfaces::srv::SetMode>("armor_solver/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  auto client3 = node->create_client<rm_interfaces::srv::SetMode>("rune_detector/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  auto client4 = node->create_client<rm_interfaces::srv::SetMode>("rune_solver/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  return {client1, client2, client3, client4};
+}
+
+}  // namespace fyt::serial_driver::protocol
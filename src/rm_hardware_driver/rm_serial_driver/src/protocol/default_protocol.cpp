@@ -17,9 +17,9 @@
 
 namespace fyt::serial_driver::protocol {
 
-DefaultProtocol::DefaultProtocol(std::string_view port_name, bool enable_data_print) {
-  auto uart_transporter = std::make_shared<UartTransporter>(std::string(port_name));
-  packet_tool_ = std::make_shared<FixedPacketTool<16>>(uart_transporter);
+DefaultProtocol::DefaultProtocol(TransporterInterface::SharedPtr transporter,
+                                 bool enable_data_print) {
+  packet_tool_ = std::make_shared<FixedPacketTool<16>>(std::move(transporter));
   packet_tool_->enbaleDataPrint(enable_data_print);
 }
 
@@ -46,19 +46,19 @@ void DefaultProtocol::send(const rm_interfaces::msg::GimbalCmd &data) {
   packet.loadData<float>(static_cast<float>(data.yaw), 6);
   packet.loadData<float>(static_cast<float>(data.distance), 10);
   packet_tool_->sendPacket(packet);
+  notifySent(data.header);
 }
 
-bool DefaultProtocol::receive(rm_interfaces::msg::SerialReceiveData &data) {
+ReceiveStatus DefaultProtocol::receive(rm_interfaces::msg::SerialReceiveData &data) {
   FixedPacket<16> packet;
-  if (packet_tool_->recvPacket(packet)) {
+  const ReceiveStatus status = packet_tool_->recvPacket(packet);
+  if (status == ReceiveStatus::OK) {
     packet.unloadData(data.mode, 1);
     packet.unloadData(data.roll, 2);
     packet.unloadData(data.pitch, 6);
     packet.unloadData(data.yaw, 10);
-    return true;
-  } else {
-    return false;
   }
+  return status;
 }
 
 }  // namespace fyt::serial_driver::protocol
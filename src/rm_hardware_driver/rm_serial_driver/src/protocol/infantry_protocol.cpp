@@ -16,9 +16,9 @@
 #include "rm_serial_driver/protocol/infantry_protocol.hpp"
 
 namespace fyt::serial_driver::protocol {
-ProtocolInfantry::ProtocolInfantry(std::string_view port_name, bool enable_data_print) {
-  auto uart_transporter = std::make_shared<UartTransporter>(std::string(port_name));
-  packet_tool_ = std::make_shared<FixedPacketTool<16>>(uart_transporter);
+ProtocolInfantry::ProtocolInfantry(TransporterInterface::SharedPtr transporter,
+                                   bool enable_data_print) {
+  packet_tool_ = std::make_shared<FixedPacketTool<16>>(std::move(transporter));
   packet_tool_->enbaleDataPrint(enable_data_print);
 }
 
@@ -29,32 +29,25 @@ void ProtocolInfantry::send(const rm_interfaces::msg::GimbalCmd &data) {
   packet.loadData<float>(static_cast<float>(data.yaw), 6);
   packet.loadData<float>(static_cast<float>(data.distance), 10);
   packet_tool_->sendPacket(packet);
+  notifySent(data.header);
 }
 
-bool ProtocolInfantry::receive(rm_interfaces::msg::SerialReceiveData &data) {
+ReceiveStatus ProtocolInfantry::receive(rm_interfaces::msg::SerialReceiveData &data) {
   FixedPacket<16> packet;
-  if (packet_tool_->recvPacket(packet)) {
+  const ReceiveStatus status = packet_tool_->recvPacket(packet);
+  if (status == ReceiveStatus::OK) {
     packet.unloadData(data.mode, 1);
     packet.unloadData(data.roll, 2);
     packet.unloadData(data.pitch, 6);
     packet.unloadData(data.yaw, 10);
-    return true;
-  } else {
-    return false;
   }
+  return status;
 }
 
 std::vector<rclcpp::SubscriptionBase::SharedPtr> ProtocolInfantry::getSubscriptions(
   rclcpp::Node::SharedPtr node) {
-  auto sub1 = node->create_subscription<rm_interfaces::msg::GimbalCmd>(
-    "armor_solver/cmd_gimbal",
-    rclcpp::SensorDataQoS(),
-    [this](const rm_interfaces::msg::GimbalCmd::SharedPtr msg) { this->send(*msg); });
-  auto sub2 = node->create_subscription<rm_interfaces::msg::GimbalCmd>(
-    "rune_solver/cmd_gimbal",
-    rclcpp::SensorDataQoS(),
-    [this](const rm_interfaces::msg::GimbalCmd::SharedPtr msg) { this->send(*msg); });
-  return {sub1, sub2};
+  // Only the commands of the solver of the current mode
+  return createGimbalSubscriptions(node);
 }
 
 std::vector<rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr> ProtocolInfantry::getClients(
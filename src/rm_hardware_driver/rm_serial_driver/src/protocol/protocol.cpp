@@ -0,0 +1,51 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_serial_driver/protocol.hpp"
+
+// std
+#include <chrono>
+
+namespace fyt::serial_driver::protocol {
+
+std::vector<rclcpp::SubscriptionBase::SharedPtr> Protocol::createGimbalSubscriptions(
+  rclcpp::Node::SharedPtr node) {
+  auto clock = node->get_clock();
+  auto subscribe = [this, &node, clock](const char *topic, GimbalCmdArbiter::Source source) {
+    return node->create_subscription<rm_interfaces::msg::GimbalCmd>(
+      topic,
+      rclcpp::SensorDataQoS(),
+      [this, clock, source](const rm_interfaces::msg::GimbalCmd::SharedPtr msg) {
+        if (arbiter_->offer(source, *msg, clock->now().nanoseconds())) {
+          this->send(*msg);
+        }
+      });
+  };
+  auto sub1 = subscribe("armor_solver/cmd_gimbal", GimbalCmdArbiter::ARMOR);
+  auto sub2 = subscribe("rune_solver/cmd_gimbal", GimbalCmdArbiter::RUNE);
+
+  const auto &params = arbiter_->params();
+  if (params.enable && params.rate > 0) {
+    const auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / params.rate));
+    arbiter_timer_ = node->create_wall_timer(period, [this, clock]() {
+      rm_interfaces::msg::GimbalCmd cmd;
+      if (arbiter_->take(cmd, clock->now().nanoseconds())) {
+        this->send(cmd);
+      }
+    });
+  }
+  return {sub1, sub2};
+}
+
+}  // namespace fyt::serial_driver::protocol
@@ -14,60 +14,131 @@
 // limitations under the License.
 
 #include "rm_serial_driver/protocol/sentry_protocol.hpp"
+// std
+#include <cerrno>
+// system
+#include <sys/eventfd.h>
+#include <unistd.h>
 // ros2
 #include <geometry_msgs/msg/twist.hpp>
+// project
+#include "rm_utils/logger/log.hpp"
+#include "rm_utils/thread_config.hpp"
 
 namespace fyt::serial_driver::protocol {
-ProtocolSentry::ProtocolSentry(std::string_view port_name, bool enable_data_print) {
-  auto uart_transporter = std::make_shared<UartTransporter>(std::string(port_name));
-  packet_tool_ = std::make_shared<FixedPacketTool<32>>(uart_transporter);
+ProtocolSentry::ProtocolSentry(TransporterInterface::SharedPtr transporter,
+                               bool enable_data_print) {
+  FYT_REGISTER_LOGGER("serial_driver", "~/fyt2024-log", INFO);
+  packet_tool_ = std::make_shared<FixedPacketTool<32>>(std::move(transporter));
   packet_tool_->enbaleDataPrint(enable_data_print);
+  setTransmitRate(DEFAULT_TRANSMIT_RATE);
+  wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (wakeup_fd_ < 0) {
+    FYT_ERROR("serial_driver", "eventfd() failed, no command will be sent");
+    return;
+  }
+  transmit_thread_ = std::make_unique<std::thread>(&ProtocolSentry::transmitLoop, this);
+}
+
+ProtocolSentry::~ProtocolSentry() {
+  running_ = false;
+  if (transmit_thread_ != nullptr) {
+    wakeTransmitter();
+    transmit_thread_->join();
+  }
+  if (wakeup_fd_ >= 0) {
+    ::close(wakeup_fd_);
+  }
+}
+
+void ProtocolSentry::setTransmitRate(double rate) {
+  transmit_period_ns_ = rate > 0 ? static_cast<int64_t>(1e9 / rate) : 0;
 }
 
 void ProtocolSentry::send(const rm_interfaces::msg::GimbalCmd &data) {
-  packet_.loadData<unsigned char>(data.fire_advice ? FireState::Fire : FireState::NotFire, 1);
-  // is_spin
-  // packet_.loadData<unsigned char>(0x00, 2);
-  // gimbal control
-  packet_.loadData<float>(static_cast<float>(data.pitch), 4);
-  packet_.loadData<float>(static_cast<float>(data.yaw), 8);
-  packet_.loadData<float>(static_cast<float>(data.distance), 12);
-  // // chassis control
-  // // linear x
-  // packet_.loadData<float>(0, 16);
-  // // linear y
-  // packet_.loadData<float>(0, 20);
-  // // angular z
-  // packet_.loadData<float>(0, 24);
-  // // useless data
-  // packet_.loadData<float>(0, 28);
-  packet_tool_->sendPacket(packet_);
+  GimbalFields fields;
+  fields.stamp_ns = rclcpp::Time(data.header.stamp).nanoseconds();
+  fields.pitch = static_cast<float>(data.pitch);
+  fields.yaw = static_cast<float>(data.yaw);
+  fields.distance = static_cast<float>(data.distance);
+  fields.fire = data.fire_advice ? FireState::Fire : FireState::NotFire;
+  gimbal_slot_.store(fields);
+  wakeTransmitter();
 }
 
 void ProtocolSentry::send(const rm_interfaces::msg::ChassisCmd &data) {
-  // packet_.loadData<unsigned char>(0x00, 1);
-  // is_spin
-  packet_.loadData<unsigned char>(data.is_spining ? 0x01 : 0x00, 2);
-  packet_.loadData<unsigned char>(data.is_navigating ? 0x01 : 0x00, 3);
-  // gimbal control
-  // packet_.loadData<float>(0, 4);
-  // packet_.loadData<float>(0, 8);
-  // packet_.loadData<float>(0, 12);
-  // chassis control
-  // linear x
-  packet_.loadData<float>(data.twist.linear.x, 16);
-  // linear y
-  packet_.loadData<float>(data.twist.linear.y, 20);
-  // angular z
-  packet_.loadData<float>(data.twist.angular.z, 24);
-  // useless data
-  // packet_.loadData<float>(0, 28);
-  packet_tool_->sendPacket(packet_);
+  ChassisFields fields;
+  fields.linear_x = static_cast<float>(data.twist.linear.x);
+  fields.linear_y = static_cast<float>(data.twist.linear.y);
+  fields.angular_z = static_cast<float>(data.twist.angular.z);
+  fields.spinning = data.is_spining ? 0x01 : 0x00;
+  fields.navigating = data.is_navigating ? 0x01 : 0x00;
+  chassis_slot_.store(fields);
+  wakeTransmitter();
 }
 
-bool ProtocolSentry::receive(rm_interfaces::msg::SerialReceiveData &data) {
+void ProtocolSentry::wakeTransmitter() {
+  if (wakeup_fd_ >= 0) {
+    const uint64_t one = 1;
+    [[maybe_unused]] auto ret = ::write(wakeup_fd_, &one, sizeof(one));
+  }
+}
+
+void ProtocolSentry::transmitLoop() {
+  utils::configureThread("serial_send");
+  uint64_t gimbal_version = 0, chassis_version = 0;
+  std::chrono::steady_clock::time_point last_send;
+  while (running_) {
+    // Woken by every command, the counter is reset by the read so no command is missed
+    uint64_t count;
+    if (::read(wakeup_fd_, &count, sizeof(count)) < 0 && errno != EINTR) {
+      FYT_ERROR("serial_driver", "Failed to wait for the commands to send");
+      break;
+    }
+    // The commands coming until the next cycle go into the same frame
+    std::this_thread::sleep_until(last_send +
+                                  std::chrono::nanoseconds(transmit_period_ns_.load()));
+    if (!running_) {
+      break;
+    }
+    GimbalFields gimbal{};
+    ChassisFields chassis{};
+    const uint64_t new_gimbal_version = gimbal_slot_.load(gimbal);
+    const uint64_t new_chassis_version = chassis_slot_.load(chassis);
+    if (new_gimbal_version == gimbal_version && new_chassis_version == chassis_version) {
+      continue;
+    }
+
+    // A command never received is sent as zeros
+    FixedPacket<32> packet;
+    packet.loadData<unsigned char>(gimbal.fire, 1);
+    packet.loadData<unsigned char>(chassis.spinning, 2);
+    packet.loadData<unsigned char>(chassis.navigating, 3);
+    // gimbal control
+    packet.loadData<float>(gimbal.pitch, 4);
+    packet.loadData<float>(gimbal.yaw, 8);
+    packet.loadData<float>(gimbal.distance, 12);
+    // chassis control
+    packet.loadData<float>(chassis.linear_x, 16);
+    packet.loadData<float>(chassis.linear_y, 20);
+    packet.loadData<float>(chassis.angular_z, 24);
+    last_send = std::chrono::steady_clock::now();
+    packet_tool_->sendPacket(packet);
+
+    if (new_gimbal_version != gimbal_version) {
+      std_msgs::msg::Header header;
+      header.stamp = rclcpp::Time(gimbal.stamp_ns, RCL_ROS_TIME);
+      notifySent(header);
+    }
+    gimbal_version = new_gimbal_version;
+    chassis_version = new_chassis_version;
+  }
+}
+
+ReceiveStatus ProtocolSentry::receive(rm_interfaces::msg::SerialReceiveData &data) {
   FixedPacket<32> packet;
-  if (packet_tool_->recvPacket(packet)) {
+  const ReceiveStatus status = packet_tool_->recvPacket(packet);
+  if (status == ReceiveStatus::OK) {
      // game status
     uint8_t enemy_color;
     packet.unloadData(enemy_color, 1);
@@ -91,27 +162,19 @@ bool ProtocolSentry::receive(rm_interfaces::msg::SerialReceiveData &data) {
     packet.unloadData(data.judge_system_data.game_status, 25);
 
     data.bullet_speed = 25;
-    return true;
-  } else {
-    return false;
   }
+  return status;
 }
 
 std::vector<rclcpp::SubscriptionBase::SharedPtr> ProtocolSentry::getSubscriptions(
   rclcpp::Node::SharedPtr node) {
-  auto sub1 = node->create_subscription<rm_interfaces::msg::GimbalCmd>(
-    "armor_solver/cmd_gimbal",
-    rclcpp::SensorDataQoS(),
-    [this](const rm_interfaces::msg::GimbalCmd::SharedPtr msg) { this->send(*msg); });
-  auto sub2 = node->create_subscription<rm_interfaces::msg::GimbalCmd>(
-    "rune_solver/cmd_gimbal",
-    rclcpp::SensorDataQoS(),
-    [this](const rm_interfaces::msg::GimbalCmd::SharedPtr msg) { this->send(*msg); });
-  auto sub3 = node->create_subscription<rm_interfaces::msg::ChassisCmd>(
+  // Only the commands of the solver of the current mode
+  auto subscriptions = createGimbalSubscriptions(node);
+  subscriptions.push_back(node->create_subscription<rm_interfaces::msg::ChassisCmd>(
     "/cmd_chassis",
     rclcpp::SensorDataQoS(),
-    [this](const rm_interfaces::msg::ChassisCmd::SharedPtr msg) { this->send(*msg); });
-  return {sub1, sub2, sub3};
+    [this](const rm_interfaces::msg::ChassisCmd::SharedPtr msg) { this->send(*msg); }));
+  return subscriptions;
 }
 
 std::vector<rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr> ProtocolSentry::getClients(
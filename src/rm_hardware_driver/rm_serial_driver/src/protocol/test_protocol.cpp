@@ -19,11 +19,10 @@
 
 namespace fyt::serial_driver::protocol {
 
-TestProtocol::TestProtocol(std::string_view port_name, bool enable_data_print) {
-  auto uart_transporter = std::make_shared<UartTransporter>(std::string(port_name));
-  // packet_tool33 = std::make_shared<FixedPacketTool<33>>(uart_transporter);
+TestProtocol::TestProtocol(TransporterInterface::SharedPtr transporter, bool enable_data_print) {
+  // packet_tool33 = std::make_shared<FixedPacketTool<33>>(std::move(transporter));
   // packet_tool33->enbaleDataPrint(enable_data_print);
-  packet_tool16 = std::make_shared<FixedPacketTool<16>>(uart_transporter);
+  packet_tool16 = std::make_shared<FixedPacketTool<16>>(std::move(transporter));
   packet_tool16->enbaleDataPrint(enable_data_print);
 }
 
@@ -65,11 +64,13 @@ void TestProtocol::send(const rm_interfaces::msg::GimbalCmd &data) {
   //添加我们的enemy_id，暂时不做
   // packet.loadData<float>(static_cast<float>(data.enemyid), 14);
   packet_tool16->sendPacket(packet16);
+  notifySent(data.header);
 }
 
-bool TestProtocol::receive(rm_interfaces::msg::SerialReceiveData &data) {
+ReceiveStatus TestProtocol::receive(rm_interfaces::msg::SerialReceiveData &data) {
   FixedPacket<16> packet;
-  if (packet_tool16->recvPacket(packet)) {
+  const ReceiveStatus status = packet_tool16->recvPacket(packet);
+  if (status == ReceiveStatus::OK) {
      // game status
     uint8_t enemy_color;
     packet.unloadData(enemy_color, 1);
@@ -95,10 +96,8 @@ bool TestProtocol::receive(rm_interfaces::msg::SerialReceiveData &data) {
     // packet.unloadData(data.judge_system_data.game_status, 25);
 
     data.bullet_speed = 25;
-    return true;
-  } else {
-    return false;
   }
+  return status;
 }
 
 }  // namespace fyt::serial_driver::protocol
@@ -0,0 +1,117 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "rm_serial_driver/protocol/trajectory_protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace fyt::serial_driver::protocol {
+ProtocolTrajectory::ProtocolTrajectory(TransporterInterface::SharedPtr transporter,
+                                       bool enable_data_print) {
+  // Both directions share the transporter, only the packet sizes differ
+  send_tool_ = std::make_shared<FixedPacketTool<64>>(transporter);
+  send_tool_->enbaleDataPrint(enable_data_print);
+  recv_tool_ = std::make_shared<FixedPacketTool<16>>(std::move(transporter));
+  recv_tool_->enbaleDataPrint(enable_data_print);
+}
+
+void ProtocolTrajectory::pack(const rm_interfaces::msg::GimbalCmd &data,
+                              int64_t now_ns,
+                              FixedPacket<64> &packet) {
+  packet.loadData<unsigned char>(data.fire_advice ? FireState::Fire : FireState::NotFire, 1);
+  packet.loadData<float>(static_cast<float>(data.distance), 3);
+
+  auto load_setpoint = [&packet](int k, double time_ms, double yaw, double pitch, double v_yaw) {
+    const int index = SETPOINTS_INDEX + k * SETPOINT_SIZE;
+    packet.loadData<uint8_t>(static_cast<uint8_t>(std::clamp(std::round(time_ms), 0.0, 255.0)),
+                             index);
+    packet.loadData<float>(static_cast<float>(yaw), index + 1);
+    packet.loadData<float>(static_cast<float>(pitch), index + 5);
+    packet.loadData<int16_t>(
+      static_cast<int16_t>(std::clamp(std::round(v_yaw * 1000), -32768.0, 32767.0)), index + 9);
+  };
+
+  const auto &setpoints = data.setpoints;
+  if (setpoints.empty()) {
+    load_setpoint(0, 0, data.yaw, data.pitch, 0);
+    packet.loadData<uint8_t>(1, 2);
+    return;
+  }
+  const int64_t stamp_ns = rclcpp::Time(data.header.stamp).nanoseconds();
+  auto time_ms = [&](size_t k) {
+    return (stamp_ns + setpoints[k].time * 1e9 - now_ns) * 1e-6;
+  };
+  // From the last setpoint already past
+  size_t first = 0;
+  while (first + 1 < setpoints.size() && time_ms(first + 1) <= 0) {
+    first++;
+  }
+  const size_t n = std::min(setpoints.size() - first, static_cast<size_t>(MAX_SETPOINTS));
+  for (size_t k = 0; k < n; k++) {
+    const auto &setpoint = setpoints[first + k];
+    load_setpoint(static_cast<int>(k),
+                  time_ms(first + k),
+                  setpoint.yaw,
+                  setpoint.pitch,
+                  setpoint.yaw_velocity);
+  }
+  packet.loadData<uint8_t>(static_cast<uint8_t>(n), 2);
+}
+
+void ProtocolTrajectory::send(const rm_interfaces::msg::GimbalCmd &data) {
+  FixedPacket<64> packet;
+  // The system clock, the ROS clock of the nodes without simulated time
+  const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+  pack(data, now_ns, packet);
+  send_tool_->sendPacket(packet);
+  notifySent(data.header);
+}
+
+ReceiveStatus ProtocolTrajectory::receive(rm_interfaces::msg::SerialReceiveData &data) {
+  FixedPacket<16> packet;
+  const ReceiveStatus status = recv_tool_->recvPacket(packet);
+  if (status == ReceiveStatus::OK) {
+    packet.unloadData(data.mode, 1);
+    packet.unloadData(data.roll, 2);
+    packet.unloadData(data.pitch, 6);
+    packet.unloadData(data.yaw, 10);
+  }
+  return status;
+}
+
+std::vector<rclcpp::SubscriptionBase::SharedPtr> ProtocolTrajectory::getSubscriptions(
+  rclcpp::Node::SharedPtr node) {
+  // Only the commands of the solver of the current mode
+  return createGimbalSubscriptions(node);
+}
+
+std::vector<rclcpp::Client<rm_interfaces::srv::SetMode>::SharedPtr>
+ProtocolTrajectory::getClients(rclcpp::Node::SharedPtr node) const {
+  auto client1 = node->create_client<rm_interfaces::srv::SetMode>("armor_detector/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  auto client2 = node->create_client<rm_interfaces::srv::SetMode>("armor_solver/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  auto client3 = node->create_client<rm_interfaces::srv::SetMode>("rune_detector/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  auto client4 = node->create_client<rm_interfaces::srv::SetMode>("rune_solver/set_mode",
+                                                                  rmw_qos_profile_services_default);
+  return {client1, client2, client3, client4};
+}
+
+}  // namespace fyt::serial_driver::protocol
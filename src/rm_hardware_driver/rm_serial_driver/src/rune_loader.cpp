@@ -0,0 +1,170 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "rm_serial_driver/rune_loader.hpp"
+
+// std
+#include <utility>
+// ros2
+#include <rclcpp/parameter_map.hpp>
+// project
+#include "rm_utils/common.hpp"
+#include "rm_utils/logger/log.hpp"
+
+namespace fyt::serial_driver {
+namespace {
+bool isRuneMode(int mode) { return mode >= SMALL_RUNE_RED && mode <= BIG_RUNE_BLUE; }
+}  // namespace
+
+RuneLoader::RuneLoader(rclcpp::Node *node,
+                       const Params &params,
+                       std::function<void()> on_loaded)
+: params_(params), on_loaded_(std::move(on_loaded)), node_namespace_(node->get_namespace()) {
+  load_client_ = node->create_client<composition_interfaces::srv::LoadNode>(
+    params_.container + "/_container/load_node");
+  unload_client_ = node->create_client<composition_interfaces::srv::UnloadNode>(
+    params_.container + "/_container/unload_node");
+
+  auto add = [this](const std::string &package,
+                    const std::string &plugin,
+                    const std::string &name,
+                    const std::string &params_file) {
+    auto component = std::make_unique<Component>();
+    component->package = package;
+    component->plugin = plugin;
+    component->name = name;
+    component->parameters = readParameters(params_file, name);
+    components_.push_back(std::move(component));
+  };
+  add("rune_detector", "fyt::rune::RuneDetectorNode", "rune_detector", params_.detector_params);
+  add("rune_solver", "fyt::rune::RuneSolverNode", "rune_solver", params_.solver_params);
+}
+
+std::vector<rcl_interfaces::msg::Parameter> RuneLoader::readParameters(
+  const std::string &file, const std::string &node_name) {
+  std::vector<rcl_interfaces::msg::Parameter> res;
+  if (file.empty()) {
+    return res;
+  }
+  try {
+    const rclcpp::ParameterMap map = rclcpp::parameter_map_from_yaml_file(file);
+    // The parameters of the node override the wildcard ones, as with the launch file
+    for (const std::string &key : {std::string("/**"), "/" + node_name}) {
+      auto it = map.find(key);
+      if (it == map.end()) {
+        continue;
+      }
+      for (const rclcpp::Parameter &p : it->second) {
+        res.push_back(p.to_parameter_msg());
+      }
+    }
+  } catch (const std::exception &e) {
+    FYT_ERROR("serial_driver", "Failed to read parameters of {} from {}: {}", node_name, file,
+              e.what());
+  }
+  return res;
+}
+
+void RuneLoader::update(int mode, std::chrono::steady_clock::time_point now) {
+  if (isRuneMode(mode)) {
+    rune_requested_ = true;
+    last_rune_request_ = now;
+  }
+  const auto unload_delay = std::chrono::duration<double>(params_.unload_delay);
+  const bool wanted =
+    isRuneMode(mode) || (rune_requested_ && now - last_rune_request_ < unload_delay);
+  for (auto &component : components_) {
+    if (component->pending.load()) {
+      continue;
+    }
+    const bool loaded = component->unique_id.load() != 0;
+    if (wanted && !loaded) {
+      load(*component);
+    } else if (!wanted && loaded) {
+      unload(*component);
+    }
+  }
+}
+
+bool RuneLoader::available(const std::string &service_name) const {
+  for (const auto &component : components_) {
+    const std::string suffix = component->name + "/set_mode";
+    if (service_name.size() >= suffix.size() &&
+        service_name.compare(service_name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      return component->unique_id.load() != 0;
+    }
+  }
+  return true;
+}
+
+void RuneLoader::load(Component &component) {
+  // The mode thread tries again if the container is not up yet
+  if (!load_client_->service_is_ready()) {
+    return;
+  }
+  auto req = std::make_shared<composition_interfaces::srv::LoadNode::Request>();
+  req->package_name = component.package;
+  req->plugin_name = component.plugin;
+  req->node_name = component.name;
+  req->node_namespace = node_namespace_;
+  req->parameters = component.parameters;
+  rcl_interfaces::msg::Parameter intra_process;
+  intra_process.name = "use_intra_process_comms";
+  intra_process.value.type = rcl_interfaces::msg::ParameterType::PARAMETER_BOOL;
+  intra_process.value.bool_value = true;
+  req->extra_arguments.push_back(intra_process);
+
+  FYT_INFO("serial_driver", "Loading {}", component.name);
+  component.pending.store(true);
+  load_client_->async_send_request(
+    req,
+    [this, &component](rclcpp::Client<composition_interfaces::srv::LoadNode>::SharedFuture result) {
+      const auto &res = result.get();
+      if (res->success) {
+        component.unique_id.store(res->unique_id);
+        FYT_INFO("serial_driver", "Loaded {} as {}", component.name, res->full_node_name);
+      } else {
+        FYT_ERROR("serial_driver", "Failed to load {}: {}", component.name, res->error_message);
+      }
+      component.pending.store(false);
+      if (res->success && on_loaded_) {
+        on_loaded_();
+      }
+    });
+}
+
+void RuneLoader::unload(Component &component) {
+  if (!unload_client_->service_is_ready()) {
+    return;
+  }
+  auto req = std::make_shared<composition_interfaces::srv::UnloadNode::Request>();
+  req->unique_id = component.unique_id.load();
+
+  FYT_INFO("serial_driver", "Unloading {}", component.name);
+  component.pending.store(true);
+  unload_client_->async_send_request(
+    req,
+    [&component](rclcpp::Client<composition_interfaces::srv::UnloadNode>::SharedFuture result) {
+      const auto &res = result.get();
+      if (res->success) {
+        component.unique_id.store(0);
+      } else {
+        FYT_ERROR("serial_driver", "Failed to unload {}: {}", component.name, res->error_message);
+      }
+      component.pending.store(false);
+    });
+}
+
+}  // namespace fyt::serial_driver
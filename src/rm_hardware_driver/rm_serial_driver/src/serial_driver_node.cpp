@@ -15,19 +15,24 @@
 
 #include "rm_serial_driver/serial_driver_node.hpp"
 
-#include <tf2/LinearMath/Matrix3x3.h>
 // std
 #include <chrono>
 #include <cstdint>
 #include <memory>
 #include <thread>
+// system
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 // ros2
 #include <Eigen/Geometry>
 #include <rclcpp/rclcpp.hpp>
 // project
 #include "rm_serial_driver/uart_transporter.hpp"
+#include "rm_utils/flight_recorder.hpp"
 #include "rm_utils/logger/log.hpp"
 #include "rm_utils/math/utils.hpp"
+#include "rm_utils/thread_config.hpp"
 
 namespace fyt::serial_driver {
 SerialDriverNode::SerialDriverNode(const rclcpp::NodeOptions &options)
@@ -45,16 +50,60 @@ void SerialDriverNode::init() {
   std::string port_name = this->declare_parameter("port_name", "/dev/ttyUSB0");
   std::string protocol_type = this->declare_parameter("protocol", "infantry");
   bool enable_data_print = this->declare_parameter("enable_data_print", false);
+  std::string transporter_type = this->declare_parameter("transporter", "uart");
+  int baud_rate = this->declare_parameter("baud_rate", 115200);
   // Create Protocol
-  protocol_ = ProtocolFactory::createProtocol(protocol_type, port_name, enable_data_print);
+  protocol_ = ProtocolFactory::createProtocol(
+    protocol_type, port_name, enable_data_print, transporter_type, baud_rate);
   if (protocol_ == nullptr) {
-    FYT_FATAL("serial_driver", "Failed to create protocol with type: {}", protocol_type);
+    FYT_FATAL("serial_driver",
+              "Failed to create protocol with type: {}, transporter: {}",
+              protocol_type,
+              transporter_type);
     rclcpp::shutdown();
     return;
   }
   FYT_INFO(
     "serial_driver", "Protocol has been created with type: {}, port: {}", protocol_type, port_name);
 
+  // Heartbeat
+  heartbeat_ = HeartBeatPublisher::create(this);
+  auto &metrics = heartbeat_->metrics();
+  packet_interval_ = &metrics.latency("packet_interval");
+  glass_to_serial_ = &metrics.latency("glass_to_serial");
+  dropped_packets_ = &metrics.counter("dropped_packets");
+  receive_errors_ = &metrics.counter("receive_errors");
+  receive_queue_depth_ = &metrics.gauge("receive_queue");
+  received_packets_ = &metrics.counter("received_packets");
+
+  // From the capture of the frame to the command written to the MCU, the headers of the sent
+  // commands are also published for the latency benchmark
+  if (this->declare_parameter("publish_sent", false)) {
+    sent_pub_ = this->create_publisher<std_msgs::msg::Header>("serial/sent", 10);
+  }
+  protocol_->setSentCallback([this](const std_msgs::msg::Header &header) {
+    const rclcpp::Time stamp = header.stamp;
+    if (stamp.nanoseconds() == 0) {
+      // A command of no frame, e.g. the target is never detected
+      return;
+    }
+    glass_to_serial_->record((this->now() - stamp).nanoseconds());
+    if (sent_pub_ != nullptr) {
+      sent_pub_->publish(header);
+    }
+  });
+
+  // Only the gimbal commands of the solver of the requested mode are sent
+  GimbalCmdArbiter::Params arbiter_params;
+  arbiter_params.enable = this->declare_parameter("cmd_arbiter.enable", true);
+  arbiter_params.rate = this->declare_parameter("cmd_arbiter.rate", arbiter_params.rate);
+  arbiter_params.max_age = this->declare_parameter("cmd_arbiter.max_age", arbiter_params.max_age);
+  protocol_->setArbiterParams(arbiter_params);
+  // Only used by the protocols sending the gimbal and chassis commands in one frame
+  const double transmit_rate = this->declare_parameter("transmit_rate", 250.0);
+  protocol_->setTransmitRate(transmit_rate);
+  protocol_->arbiter().attachMetrics(metrics);
+
   // Subscriptions
   subscriptions_ = protocol_->getSubscriptions(this->shared_from_this());
   for (auto sub : subscriptions_) {
@@ -66,7 +115,34 @@ void SerialDriverNode::init() {
 
   // TF broadcaster
   timestamp_offset_ = this->declare_parameter("timestamp_offset", 0.0);
+  on_set_parameters_callback_handle_ = this->add_on_set_parameters_callback(
+    std::bind(&SerialDriverNode::onSetParameters, this, std::placeholders::_1));
   tf_broadcaster_ = std::make_unique<tf2_ros::TransformBroadcaster>(*this);
+  tf_rate_ = this->declare_parameter("tf_rate", 0.0);
+
+  // Publish thread, woken by the listen thread for every packet
+  wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (wakeup_fd_ < 0) {
+    FYT_FATAL("serial_driver", "eventfd() failed");
+    rclcpp::shutdown();
+    return;
+  }
+  publish_thread_ = std::make_unique<std::thread>(&SerialDriverNode::publishLoop, this);
+
+  // Rune pipeline loaded into the container only while a rune mode is requested
+  if (this->declare_parameter("rune_on_demand.enable", false)) {
+    RuneLoader::Params loader_params;
+    loader_params.container =
+      this->declare_parameter("rune_on_demand.container", loader_params.container);
+    loader_params.unload_delay =
+      this->declare_parameter("rune_on_demand.unload_delay", loader_params.unload_delay);
+    loader_params.detector_params =
+      this->declare_parameter("rune_on_demand.detector_params", std::string());
+    loader_params.solver_params =
+      this->declare_parameter("rune_on_demand.solver_params", std::string());
+    rune_loader_ =
+      std::make_unique<RuneLoader>(this, loader_params, [this]() { requestModeUpdate(); });
+  }
 
   // Param client
   for (auto client : protocol_->getClients(this->shared_from_this())) {
@@ -75,8 +151,18 @@ void SerialDriverNode::init() {
     FYT_INFO("serial_driver", "Create client for service: {}", name);
   }
 
-  // Heartbeat
-  heartbeat_ = HeartBeatPublisher::create(this);
+  mode_thread_ = std::make_unique<std::thread>(&SerialDriverNode::modeLoop, this);
+
+  // A device that is open but silent, e.g. a stuck USB-serial adapter, gives no read error
+  watchdog_ = utils::declareStallWatchdog(*this, metrics);
+  if (watchdog_ != nullptr) {
+    utils::StallWatchdog::Stage stage;
+    stage.name = "serial";
+    stage.progress = received_packets_;
+    stage.timeout = std::chrono::milliseconds(this->declare_parameter("watchdog.timeout_ms", 500));
+    stage.recover = [this]() { protocol_->requestReconnect(); };
+    watchdog_->watch(std::move(stage));
+  }
 
   FYT_INFO("serial_driver", "SerialDriverNode has been initialized!");
 }
@@ -87,75 +173,195 @@ SerialDriverNode::~SerialDriverNode() {
   if (listen_thread_ != nullptr) {
     listen_thread_->join();
   }
+  if (publish_thread_ != nullptr) {
+    publish_thread_->join();
+  }
+  if (mode_thread_ != nullptr) {
+    mode_cv_.notify_one();
+    mode_thread_->join();
+  }
+  if (wakeup_fd_ >= 0) {
+    ::close(wakeup_fd_);
+  }
+}
+
+rcl_interfaces::msg::SetParametersResult SerialDriverNode::onSetParameters(
+  std::vector<rclcpp::Parameter> parameters) {
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+  for (const auto &param : parameters) {
+    if (param.get_name() == "timestamp_offset") {
+      timestamp_offset_ = param.as_double();
+    }
+  }
+  return result;
 }
 
 void SerialDriverNode::listenLoop() {
+  utils::configureThread("serial_listen");
   if (protocol_ == nullptr) {
     // Lazy init because shared_from_this() is not available in constructor
     init();
   }
 
   rm_interfaces::msg::SerialReceiveData receive_data;
+  auto last_packet = std::chrono::steady_clock::now();
   while (rclcpp::ok()) {
-    if (protocol_->receive(receive_data)) {
-      receive_data.header.stamp = this->now() + rclcpp::Duration::from_seconds(timestamp_offset_);
+    const ReceiveStatus status = protocol_->receive(receive_data);
+    if (status == ReceiveStatus::OK) {
+      // Its rate is the packet rate, and its tail the stalls of the link
+      const auto now = std::chrono::steady_clock::now();
+      packet_interval_->record(now - last_packet);
+      last_packet = now;
+      received_packets_->fetch_add(1, std::memory_order_relaxed);
+      // The sample time given by the MCU clock if the protocol supports it, else the time the
+      // packet is parsed
+      int64_t sample_ns = 0;
+      const rclcpp::Time sample_time =
+        protocol_->getSampleTime(sample_ns) ? rclcpp::Time(sample_ns, RCL_ROS_TIME) : this->now();
+      const rclcpp::Time stamp =
+        sample_time + rclcpp::Duration::from_seconds(timestamp_offset_.load());
+      receive_data.header.stamp = stamp;
       receive_data.header.frame_id = target_frame_;
-      serial_receive_data_pub_->publish(receive_data);
 
+      // Only hand the sample over, the publish thread talks to DDS
+      const Eigen::Quaterniond q(Eigen::AngleAxisd(receive_data.yaw, Eigen::Vector3d::UnitZ()) *
+                                 Eigen::AngleAxisd(receive_data.pitch, Eigen::Vector3d::UnitY()) *
+                                 Eigen::AngleAxisd(receive_data.roll, Eigen::Vector3d::UnitX()));
+      utils::processAttitudeCache().push(stamp.nanoseconds(), q);
+      if (!receive_queue_.push(receive_data)) {
+        FYT_WARN("serial_driver",
+                 "Receive queue is full, {} packets dropped",
+                 dropped_packets_->fetch_add(1, std::memory_order_relaxed) + 1);
+      }
+      uint64_t one = 1;
+      [[maybe_unused]] auto ret = ::write(wakeup_fd_, &one, sizeof(one));
+
+      // The arbiter follows the mode at once, the services may take a while
+      protocol_->arbiter().setMode(receive_data.mode);
+      // Only record the mode, the mode thread calls the services
+      bool mode_changed = false;
       for (auto &[service_name, client] : set_mode_clients_) {
-        if (client.mode.load() != receive_data.mode && !client.on_waiting.load()) {
-          setMode(client, receive_data.mode);
+        if (client.requested_mode.exchange(receive_data.mode) != receive_data.mode) {
+          mode_changed = true;
         }
       }
-
-      geometry_msgs::msg::TransformStamped t;
-      timestamp_offset_ = this->get_parameter("timestamp_offset").as_double();
-      t.header.stamp = this->now() + rclcpp::Duration::from_seconds(timestamp_offset_);
-      t.header.frame_id = target_frame_;
-      t.child_frame_id = "gimbal_link";
-      // auto roll = receive_data.roll * M_PI / 180.0;
-      // auto pitch = -receive_data.pitch * M_PI / 180.0;
-      // auto yaw = receive_data.yaw * M_PI / 180.0;
-      auto roll = receive_data.roll;
-      auto pitch = receive_data.pitch;
-      auto yaw = receive_data.yaw;
-      tf2::Quaternion q;
-      // std::cout<<"r: "<<roll<<"p: "<<pitch<<"y: "<<yaw<<std::endl;
-      q.setRPY(roll, pitch, yaw);
-      t.transform.rotation = tf2::toMsg(q);
-      tf_broadcaster_->sendTransform(t);
-
-      // odom_rectify: 转了roll角后的坐标系
-      Eigen::Quaterniond q_eigen(q.w(), q.x(), q.y(), q.z());
-      Eigen::Vector3d rpy = utils::getRPY(q_eigen.toRotationMatrix());
-      q.setRPY(rpy[0], 0, 0);
-      t.header.frame_id = target_frame_;
-      t.child_frame_id = target_frame_ + "_rectify";
-      tf_broadcaster_->sendTransform(t);
-    } else {
+      if (mode_changed) {
+        utils::FlightRecorder::record(
+          utils::FlightEvent::MODE, static_cast<int16_t>(receive_data.mode), 0, {});
+        requestModeUpdate();
+      }
+    } else if (status == ReceiveStatus::FAILURE) {
+      // An idle line only times out, the watchdog sees a silent MCU
       auto error_message = protocol_->getErrorMessage();
       error_message = error_message.empty() ? "unknown" : error_message;
+      receive_errors_->fetch_add(1, std::memory_order_relaxed);
+      // No fixed sleep, the transporter waits for the data or for reconnecting
       FYT_WARN("serial_driver","Packet unstable, error message :{}", error_message);
-      std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
   }
 }
 
-void SerialDriverNode::setMode(SetModeClient &client, const uint8_t mode) {
+void SerialDriverNode::publishLoop() {
+  utils::configureThread("serial_publish");
+  const int64_t tf_period_ns = tf_rate_ > 0 ? static_cast<int64_t>(1e9 / tf_rate_) : 0;
+  int64_t last_tf_ns = 0;
+  rm_interfaces::msg::SerialReceiveData receive_data;
+  while (rclcpp::ok()) {
+    // Woken by every packet, the timeout only checks for shutdown
+    pollfd pfd{wakeup_fd_, POLLIN, 0};
+    if (::poll(&pfd, 1, 100) > 0) {
+      uint64_t count;
+      [[maybe_unused]] auto ret = ::read(wakeup_fd_, &count, sizeof(count));
+    }
+    receive_queue_depth_->store(receive_queue_.size(), std::memory_order_relaxed);
+    while (receive_queue_.pop(receive_data)) {
+      serial_receive_data_pub_->publish(receive_data);
+    }
+
+    // tf of the newest sample, at most tf_rate_ by the sample stamps
+    utils::AttitudeCache<>::Sample sample;
+    if (utils::processAttitudeCache().latest(sample) && sample.stamp_ns != last_tf_ns &&
+        sample.stamp_ns - last_tf_ns >= tf_period_ns) {
+      last_tf_ns = sample.stamp_ns;
+      publishTransforms(sample);
+    }
+  }
+}
+
+void SerialDriverNode::publishTransforms(const utils::AttitudeCache<>::Sample &sample) {
+  geometry_msgs::msg::TransformStamped t;
+  t.header.stamp = rclcpp::Time(sample.stamp_ns, RCL_ROS_TIME);
+  t.header.frame_id = target_frame_;
+  t.child_frame_id = "gimbal_link";
+  t.transform.rotation.w = sample.q.w();
+  t.transform.rotation.x = sample.q.x();
+  t.transform.rotation.y = sample.q.y();
+  t.transform.rotation.z = sample.q.z();
+  tf_broadcaster_->sendTransform(t);
+
+  // odom_rectify: 转了roll角后的坐标系
+  const double roll = utils::getRPY(sample.q.toRotationMatrix())[0];
+  const Eigen::Quaterniond q_rectify(Eigen::AngleAxisd(roll, Eigen::Vector3d::UnitX()));
+  t.child_frame_id = target_frame_ + "_rectify";
+  t.transform.rotation.w = q_rectify.w();
+  t.transform.rotation.x = q_rectify.x();
+  t.transform.rotation.y = q_rectify.y();
+  t.transform.rotation.z = q_rectify.z();
+  tf_broadcaster_->sendTransform(t);
+}
+
+void SerialDriverNode::requestModeUpdate() {
+  {
+    std::lock_guard<std::mutex> lock(mode_mutex_);
+    mode_requested_ = true;
+  }
+  mode_cv_.notify_one();
+}
+
+void SerialDriverNode::modeLoop() {
+  utils::configureThread("serial_mode");
   using namespace std::chrono_literals;
+  // A request without response is sent again after this
+  constexpr auto request_timeout = 1s;
+  while (rclcpp::ok()) {
+    {
+      std::unique_lock<std::mutex> lock(mode_mutex_);
+      // Unavailable services are retried on the timeout
+      mode_cv_.wait_for(lock, 1s, [this] { return mode_requested_ || !rclcpp::ok(); });
+      mode_requested_ = false;
+    }
 
-  std::string service_name = client.ptr->get_service_name();
-  // Wait for service
-  while (!client.ptr->wait_for_service(1s)) {
-    if (!rclcpp::ok()) {
-      FYT_ERROR(
-        "serial_driver", "Interrupted while waiting for the service {}. Exiting.", service_name);
-      return;
+    const auto now = std::chrono::steady_clock::now();
+    if (rune_loader_ != nullptr && !set_mode_clients_.empty()) {
+      rune_loader_->update(set_mode_clients_.begin()->second.requested_mode.load(), now);
+    }
+    for (auto &[service_name, client] : set_mode_clients_) {
+      if (rune_loader_ != nullptr && !rune_loader_->available(service_name)) {
+        // Sent again once the component is loaded
+        client.mode.store(-1);
+        continue;
+      }
+      const int mode = client.requested_mode.load();
+      if (client.on_waiting.load()) {
+        if (now - client.request_time < request_timeout) {
+          continue;
+        }
+        FYT_WARN("serial_driver", "No response from {}, sending again", service_name);
+        client.on_waiting.store(false);
+      }
+      if (client.mode.load() != mode) {
+        client.request_time = now;
+        setMode(client, static_cast<uint8_t>(mode));
+      }
     }
-    FYT_INFO("serial_driver", "Service {} not available, waiting again...", service_name);
   }
+}
+
+void SerialDriverNode::setMode(SetModeClient &client, const uint8_t mode) {
+  // Never waits, the mode thread tries again if the service is not ready
   if (!client.ptr->service_is_ready()) {
-    FYT_WARN("serial_driver", "Service: {} is not available!", service_name);
+    FYT_WARN("serial_driver", "Service: {} is not available!", client.ptr->get_service_name());
     return;
   }
   // Send request
@@ -164,11 +370,18 @@ void SerialDriverNode::setMode(SetModeClient &client, const uint8_t mode) {
 
   client.on_waiting.store(true);
   auto result = client.ptr->async_send_request(
-    req, [mode, &client](rclcpp::Client<rm_interfaces::srv::SetMode>::SharedFuture result) {
+    req,
+    [this, mode, &client](rclcpp::Client<rm_interfaces::srv::SetMode>::SharedFuture result) {
       client.on_waiting.store(false);
-      if (result.get()->success) {
+      const bool success = result.get()->success;
+      if (success) {
         client.mode.store(mode);
       }
+      // The MCU changed the mode meanwhile, or the request failed: the mode thread sends the
+      // current one now instead of on its next unrelated wakeup
+      if (!success || client.requested_mode.load() != mode) {
+        requestModeUpdate();
+      }
     });
 }
 
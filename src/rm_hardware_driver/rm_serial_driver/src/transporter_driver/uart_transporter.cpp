@@ -20,6 +20,7 @@
 // System
 #include <errno.h>  /*错误号定义*/
 #include <fcntl.h>  /*文件控制定义*/
+#include <poll.h>
 #include <stdio.h>  /*标准输入输出定义*/
 #include <stdlib.h> /*标准函数库定义*/
 #include <string.h>
@@ -32,8 +33,9 @@ namespace fyt::serial_driver {
 
 bool UartTransporter::setParam(int speed, int flow_ctrl, int databits, int stopbits, int parity) {
   // 设置串口数据帧格式
-  int speed_arr[] = {B115200, B19200, B9600, B4800, B2400, B1200, B300};
-  int name_arr[] = {115200, 19200, 9600, 4800, 2400, 1200, 300};
+  int speed_arr[] = {
+    B921600, B460800, B230400, B115200, B19200, B9600, B4800, B2400, B1200, B300};
+  int name_arr[] = {921600, 460800, 230400, 115200, 19200, 9600, 4800, 2400, 1200, 300};
   struct termios options;
   // tcgetattr(fd,&options)得到与fd指向对象的相关参数，并将它们保存于options,该函数还可以测试配置是否正确，
   // 该串口是否可用等。若调用成功，函数返回值为0，若调用失败，函数返回值为1.
@@ -41,13 +43,19 @@ bool UartTransporter::setParam(int speed, int flow_ctrl, int databits, int stopb
     error_message_ = "Setup Serial err";
     return false;
   }
-  // 设置串口输入波特率和输出波特率
+  // 设置串口输入波特率和输出波特率, 其他波特率使用 UsbCdcTransporter
+  bool speed_supported = false;
   for (size_t i = 0; i < sizeof(speed_arr) / sizeof(int); i++) {
     if (speed == name_arr[i]) {
       cfsetispeed(&options, speed_arr[i]);
       cfsetospeed(&options, speed_arr[i]);
+      speed_supported = true;
     }
   }
+  if (!speed_supported) {
+    error_message_ = "Unsupported baud rate";
+    return false;
+  }
   // 修改控制模式，保证程序不会占用串口
   options.c_cflag |= CLOCAL;
   // 修改控制模式，使得能够从串口中读取输入数据
@@ -130,9 +138,9 @@ bool UartTransporter::setParam(int speed, int flow_ctrl, int databits, int stopb
   // 传输特殊字符，否则特殊字符0x0d,0x11,0x13会被屏蔽或映射。
   options.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
 
-  // 设置等待时间和最小接收字符
-  options.c_cc[VTIME] = 1;  // 读取一个字符等待1*(1/10)s
-  options.c_cc[VMIN] = 1;   // 读取字符的最少个数为1
+  // 设置等待时间和最小接收字符. 由poll等待数据到达, read只取走已到达的全部数据, 不阻塞
+  options.c_cc[VTIME] = 0;
+  options.c_cc[VMIN] = 0;
   tcflush(fd_, TCIFLUSH);
 
   // 激活配置 (将修改后的termios数据设置到串口中）
@@ -155,6 +163,8 @@ bool UartTransporter::open() {
   // 恢复串口为阻塞状态
   if (fcntl(fd_, F_SETFL, 0) < 0) {
     error_message_ = "fcntl failed";
+    ::close(fd_);
+    fd_ = -1;
     return false;
   }
   // 测试是否为终端设备
@@ -164,7 +174,10 @@ bool UartTransporter::open() {
   //   return false;
   // }
   // 设置串口数据帧格式
+  // 失败时关闭, 否则每次重连都泄漏一个fd, 且read()会读未配置的串口
   if (!setParam(speed_, flow_ctrl_, databits_, stopbits_, parity_)) {
+    ::close(fd_);
+    fd_ = -1;
     return false;
   }
   is_open_ = true;
@@ -183,9 +196,29 @@ void UartTransporter::close() {
 bool UartTransporter::isOpen() { return is_open_; }
 
 int UartTransporter::read(void *buffer, size_t len) {
-  int ret = ::read(fd_, buffer, len);
-  // tcflush(fd_, TCIFLUSH);
-  return ret;
+  if (takeReopenRequest()) {
+    close();
+    open();
+  }
+  if (fd_ < 0) {
+    // Wait as long as a timeout, so that reconnecting doesn't spin
+    ::poll(nullptr, 0, READ_TIMEOUT_MS);
+    return -1;
+  }
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  int ret = ::poll(&pfd, 1, READ_TIMEOUT_MS);
+  if (ret == 0 || (ret < 0 && errno == EINTR)) {
+    return 0;
+  }
+  if (ret < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
+    return -1;
+  }
+  ret = ::read(fd_, buffer, len);
+  if (ret < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return 0;
+  }
+  // Readable without data, the device is gone
+  return ret == 0 ? -1 : ret;
 }
 
 int UartTransporter::write(const void *buffer, size_t len) {
@@ -0,0 +1,149 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_serial_driver/usb_cdc_transporter.hpp"
+// System, termios2 comes from the kernel headers and must not be mixed with <termios.h>
+#include <asm/termbits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace fyt::serial_driver {
+
+bool UsbCdcTransporter::setParam() {
+  struct termios2 options;
+  if (ioctl(fd_, TCGETS2, &options) != 0) {
+    error_message_ = std::string("TCGETS2 failed: ") + strerror(errno);
+    return false;
+  }
+  // Raw 8N1 without flow control
+  options.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF |
+                       IXANY | INPCK);
+  options.c_oflag &= ~OPOST;
+  options.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  options.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS);
+  options.c_cflag |= CS8 | CLOCAL | CREAD;
+  // Any baud rate
+  options.c_cflag &= ~CBAUD;
+  options.c_cflag |= BOTHER;
+  options.c_ispeed = speed_;
+  options.c_ospeed = speed_;
+  // 由poll等待数据到达, read只取走已到达的全部数据, 不阻塞
+  options.c_cc[VTIME] = 0;
+  options.c_cc[VMIN] = 0;
+  if (ioctl(fd_, TCSETS2, &options) != 0) {
+    error_message_ = std::string("TCSETS2 failed: ") + strerror(errno);
+    return false;
+  }
+
+  // Deliver every byte right away instead of after the latency timer of the driver, not
+  // supported by every driver (e.g. cdc_acm has no timer)
+  struct serial_struct serial;
+  if (ioctl(fd_, TIOCGSERIAL, &serial) == 0) {
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd_, TIOCSSERIAL, &serial);
+  }
+  ioctl(fd_, TCFLSH, TCIOFLUSH);
+  return true;
+}
+
+bool UsbCdcTransporter::open() {
+  if (is_open_) {
+    return true;
+  }
+  fd_ = ::open(device_path_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd_ < 0) {
+    error_message_ = "can't open usb cdc device: " + device_path_;
+    return false;
+  }
+  if (!setParam()) {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  is_open_ = true;
+  return true;
+}
+
+void UsbCdcTransporter::close() {
+  if (!is_open_) {
+    return;
+  }
+  ::close(fd_);
+  fd_ = -1;
+  is_open_ = false;
+}
+
+int UsbCdcTransporter::read(void *buffer, size_t len) {
+  if (takeReopenRequest()) {
+    close();
+    open();
+  }
+  if (fd_ < 0) {
+    // Wait as long as a timeout, so that reconnecting doesn't spin
+    ::poll(nullptr, 0, READ_TIMEOUT_MS);
+    return -1;
+  }
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  int ret = ::poll(&pfd, 1, READ_TIMEOUT_MS);
+  if (ret == 0 || (ret < 0 && errno == EINTR)) {
+    return 0;
+  }
+  if (ret < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
+    error_message_ = "usb cdc device is disconnected: " + device_path_;
+    return -1;
+  }
+  ret = ::read(fd_, buffer, len);
+  if (ret < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return 0;
+  }
+  // Readable without data, the device is gone
+  return ret == 0 ? -1 : ret;
+}
+
+int UsbCdcTransporter::write(const void *buffer, size_t len) {
+  if (fd_ < 0) {
+    return -1;
+  }
+  // One write for the whole buffer in general, the rest is written once the tty buffer drains
+  const auto *data = static_cast<const uint8_t *>(buffer);
+  size_t written = 0;
+  while (written < len) {
+    const ssize_t ret = ::write(fd_, data + written, len - written);
+    if (ret > 0) {
+      written += ret;
+      continue;
+    }
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0 && errno != EAGAIN) {
+      error_message_ = std::string("write failed: ") + strerror(errno);
+      return -1;
+    }
+    struct pollfd pfd = {fd_, POLLOUT, 0};
+    if (::poll(&pfd, 1, WRITE_TIMEOUT_MS) <= 0) {
+      error_message_ = "write timeout";
+      return -1;
+    }
+  }
+  return static_cast<int>(written);
+}
+
+}  // namespace fyt::serial_driver
@@ -3,12 +3,15 @@
 
 // std
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <opencv2/calib3d.hpp>
 #include <rclcpp/executors.hpp>
 #include <thread>
+#include <vector>
 // ros2
 #include <tf2_ros/transform_broadcaster.h>
 
@@ -16,10 +19,13 @@
 #include <rclcpp/logging.hpp>
 #include <rclcpp/node_options.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <std_msgs/msg/header.hpp>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
 // project
+#include "rm_interfaces/msg/gimbal_cmd.hpp"
 #include "rm_interfaces/msg/serial_receive_data.hpp"
 #include "rm_interfaces/srv/set_mode.hpp"
+#include "rm_serial_driver/gimbal_simulator.hpp"
 #include "rm_utils/logger/log.hpp"
 #include "rm_utils/math/utils.hpp"
 #include "rm_utils/heartbeat.hpp"
@@ -59,6 +65,41 @@ public:
     // Heartbeat
     heartbeat_ = HeartBeatPublisher::create(this);
 
+    // Closed loop: the gimbal follows the received commands instead of the fixed attitude
+    if (this->declare_parameter("sim.enable", false)) {
+      GimbalSimulator::Params sim_params;
+      sim_params.delay = this->declare_parameter("sim.delay", 0.005);
+      sim_params.natural_frequency = this->declare_parameter("sim.natural_frequency", 40.0);
+      sim_params.damping = this->declare_parameter("sim.damping", 0.7);
+      sim_params.imu_noise = this->declare_parameter("sim.imu_noise", 0.0) * M_PI / 180.0;
+      sim_params.seed = static_cast<uint32_t>(this->declare_parameter("sim.seed", 0));
+      simulator_ = std::make_unique<GimbalSimulator>(sim_params,
+                                                     serial_receive_data_msg_.yaw * M_PI / 180.0,
+                                                     serial_receive_data_msg_.pitch * M_PI / 180.0);
+      FYT_INFO("serial_driver",
+               "Gimbal simulator enabled, delay: {} s, natural frequency: {} rad/s",
+               sim_params.delay,
+               sim_params.natural_frequency);
+    }
+    auto &metrics = heartbeat_->metrics();
+    glass_to_serial_ = &metrics.latency("glass_to_serial");
+    tracking_error_ = &metrics.gauge("tracking_error_urad");
+
+    // Stands in for the serial port in the latency benchmark: every command is "sent" on
+    // arrival, and its header is published as the real driver does
+    if (this->declare_parameter("publish_sent", false)) {
+      sent_pub_ = this->create_publisher<std_msgs::msg::Header>("serial/sent", 10);
+    }
+    if (sent_pub_ != nullptr || simulator_ != nullptr) {
+      auto on_cmd = [this](const rm_interfaces::msg::GimbalCmd::SharedPtr msg) {
+        onCommand(*msg);
+      };
+      for (const char *topic : {"armor_solver/cmd_gimbal", "rune_solver/cmd_gimbal"}) {
+        cmd_subs_.push_back(this->create_subscription<rm_interfaces::msg::GimbalCmd>(
+          topic, rclcpp::SensorDataQoS(), on_cmd));
+      }
+    }
+
     // Param client
     auto autoaim_set_mode_client_1 =
       this->create_client<rm_interfaces::srv::SetMode>("armor_detector/set_mode");
@@ -81,6 +122,9 @@ public:
       double roll = this->get_parameter("roll").as_double();
       double pitch = this->get_parameter("pitch").as_double();
       double yaw = this->get_parameter("yaw").as_double();
+      if (simulator_ != nullptr) {
+        stepSimulator(yaw, pitch);
+      }
       serial_receive_data_msg_.mode = mode;
       serial_receive_data_msg_.pitch = pitch;
       serial_receive_data_msg_.yaw = yaw;
@@ -110,6 +154,48 @@ public:
     });
   }
 
+  void onCommand(const rm_interfaces::msg::GimbalCmd &msg) {
+    const rclcpp::Time stamp = msg.header.stamp;
+    if (stamp.nanoseconds() == 0) {
+      return;
+    }
+    const rclcpp::Time now = this->now();
+    glass_to_serial_->record((now - stamp).nanoseconds());
+    if (sent_pub_ != nullptr) {
+      sent_pub_->publish(msg.header);
+    }
+    if (simulator_ == nullptr) {
+      return;
+    }
+
+    std::vector<GimbalSimulator::Setpoint> setpoints;
+    if (msg.setpoints.empty()) {
+      setpoints.push_back(GimbalSimulator::Setpoint{now.seconds(), msg.yaw, msg.pitch, 0});
+    } else {
+      setpoints.reserve(msg.setpoints.size());
+      for (const auto &s : msg.setpoints) {
+        setpoints.push_back(
+          GimbalSimulator::Setpoint{stamp.seconds() + s.time, s.yaw, s.pitch, s.yaw_velocity});
+      }
+    }
+    std::lock_guard<std::mutex> lock(simulator_mutex_);
+    simulator_->command(now.seconds(), std::move(setpoints));
+  }
+
+  // Advance the simulated gimbal to now and measure its attitude, in degrees
+  void stepSimulator(double &yaw, double &pitch) {
+    std::lock_guard<std::mutex> lock(simulator_mutex_);
+    simulator_->step(this->now().seconds());
+    simulator_->measure(yaw, pitch);
+    yaw *= 180.0 / M_PI;
+    pitch *= 180.0 / M_PI;
+
+    const double error = std::hypot(simulator_->yawError(), simulator_->pitchError());
+    mean_tracking_error_ += 0.01 * (error - mean_tracking_error_);
+    tracking_error_->store(static_cast<int64_t>(mean_tracking_error_ * 1e6),
+                           std::memory_order_relaxed);
+  }
+
   void setMode(SetModeClient &client, const uint8_t mode) {
     using namespace std::chrono_literals;
 
@@ -145,7 +231,15 @@ private:
   std::unique_ptr<tf2_ros::TransformBroadcaster> tf_broadcaster_;
   rclcpp::Publisher<rm_interfaces::msg::SerialReceiveData>::SharedPtr serial_receive_data_pub_;
   rclcpp::TimerBase::SharedPtr timer_;
+  rclcpp::Publisher<std_msgs::msg::Header>::SharedPtr sent_pub_;
+  std::vector<rclcpp::Subscription<rm_interfaces::msg::GimbalCmd>::SharedPtr> cmd_subs_;
   rm_interfaces::msg::SerialReceiveData serial_receive_data_msg_;
+  std::unique_ptr<GimbalSimulator> simulator_;
+  // The commands and the timer may run on different threads of the executor
+  std::mutex simulator_mutex_;
+  double mean_tracking_error_ = 0;
+  utils::LatencyHistogram *glass_to_serial_ = nullptr;
+  std::atomic<int64_t> *tracking_error_ = nullptr;
   geometry_msgs::msg::TransformStamped transform_stamped_;
 
   bool has_rune_;
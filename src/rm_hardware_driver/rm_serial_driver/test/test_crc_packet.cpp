@@ -0,0 +1,67 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "rm_serial_driver/crc_packet.hpp"
+
+using namespace fyt::serial_driver;
+
+TEST(CrcPacket, crc16_check_value) {
+  // CRC-16/MCRF4XX of "123456789"
+  const char data[] = "123456789";
+  EXPECT_EQ(crc::crc16(data, 9), 0x6F91);
+}
+
+TEST(CrcPacket, seal_and_parse) {
+  crc::Frame<crc::ReceivePayload> frame;
+  frame.payload.mode = 1;
+  frame.payload.bullet_speed = 25.0f;
+  frame.payload.roll = 0.1f;
+  frame.payload.pitch = -0.2f;
+  frame.payload.yaw = 3.0f;
+  frame.payload.timestamp_us = 123456;
+  frame.payload.echo_host_us = 0;
+  frame.payload.echo_receive_us = 0;
+  crc::sealFrame(frame, 42);
+
+  std::vector<uint8_t> bytes(sizeof(frame));
+  std::memcpy(bytes.data(), &frame, sizeof(frame));
+  crc::Frame<crc::ReceivePayload> parsed;
+  ASSERT_EQ(crc::parseFrame(bytes.data(), parsed), crc::FrameStatus::OK);
+  EXPECT_EQ(parsed.header.sequence, 42);
+  EXPECT_EQ(parsed.payload.mode, 1);
+  EXPECT_FLOAT_EQ(parsed.payload.yaw, 3.0f);
+  EXPECT_EQ(parsed.payload.timestamp_us, 123456u);
+
+  // A flipped bit in the payload
+  bytes[sizeof(crc::FrameHeader) + 3] ^= 0x10;
+  EXPECT_EQ(crc::parseFrame(bytes.data(), parsed), crc::FrameStatus::BAD_CRC);
+  // A flipped bit in the header
+  bytes[2] ^= 0x01;
+  EXPECT_EQ(crc::parseFrame(bytes.data(), parsed), crc::FrameStatus::BAD_HEADER);
+}
+
+TEST(CrcPacket, version_mismatch) {
+  crc::Frame<crc::SendPayload> frame;
+  std::memset(&frame, 0, sizeof(frame));
+  crc::sealFrame(frame, 0);
+  frame.header.version = crc::PROTOCOL_VERSION + 1;
+  frame.header.crc8 = crc::crc8(&frame.header, 3);
+  EXPECT_EQ(crc::checkHeader(reinterpret_cast<const uint8_t *>(&frame)),
+            crc::FrameStatus::BAD_VERSION);
+}
@@ -40,7 +40,7 @@ TEST(FixedPacketTool, send_and_recv) {
   ASSERT_TRUE(send_ret);
   // recv
   int b;
-  bool recv_ret = packet_tool2->recvPacket(packet2);
+  bool recv_ret = packet_tool2->recvPacket(packet2) == serial_driver::ReceiveStatus::OK;
   ASSERT_TRUE(recv_ret);
   packet2.unloadData<int>(b, 10);
   EXPECT_EQ(a, b);
@@ -58,7 +58,7 @@ TEST(FixedPacketTool, realtime_send) {
   auto t = std::thread([&]() {
     int b;
     for (int i = 0; i < 10; i++) {
-      bool recv_ret = packet_tool2->recvPacket(packet2);
+      bool recv_ret = packet_tool2->recvPacket(packet2) == serial_driver::ReceiveStatus::OK;
       ASSERT_TRUE(recv_ret);
       packet2.unloadData<int>(b, 10);
       EXPECT_EQ(i, b);
@@ -71,4 +71,56 @@ TEST(FixedPacketTool, realtime_send) {
     ASSERT_TRUE(send_ret);
   }
   t.join();
-}
\ No newline at end of file
+}
+
+TEST(FixedPacketTool, recv_batch_and_resync) {
+  auto factory = std::make_shared<TransporterFactory>();
+  auto transporter1 = factory->get_transporter1();
+  auto transporter2 = factory->get_transporter2();
+  auto packet_tool2 = std::make_shared<serial_driver::FixedPacketTool<32>>(transporter2);
+  // Garbage, three frames in one write and half of a fourth one
+  std::vector<uint8_t> bytes = {0x01, 0xFE, 0x02};
+  for (int i = 0; i < 4; i++) {
+    serial_driver::FixedPacket<32> packet;
+    packet.loadData(i, 10);
+    bytes.insert(bytes.end(), packet.buffer(), packet.buffer() + 32);
+  }
+  ASSERT_EQ(transporter1->write(bytes.data(), bytes.size() - 16),
+            static_cast<int>(bytes.size() - 16));
+
+  serial_driver::FixedPacket<32> packet;
+  int b;
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(packet_tool2->recvPacket(packet), serial_driver::ReceiveStatus::OK);
+    packet.unloadData<int>(b, 10);
+    EXPECT_EQ(i, b);
+  }
+  // The rest of the last frame
+  ASSERT_EQ(transporter1->write(bytes.data() + bytes.size() - 16, 16), 16);
+  ASSERT_EQ(packet_tool2->recvPacket(packet), serial_driver::ReceiveStatus::OK);
+  packet.unloadData<int>(b, 10);
+  EXPECT_EQ(3, b);
+}
+
+// Every read returns the same result, 0 for an idle line
+class ConstantTransporter : public serial_driver::TransporterInterface {
+public:
+  explicit ConstantTransporter(int read_result) : read_result_(read_result) {}
+  bool open() override { return true; }
+  void close() override {}
+  bool isOpen() override { return true; }
+  int read(void *, size_t) override { return read_result_; }
+  int write(const void *, size_t len) override { return static_cast<int>(len); }
+  std::string errorMessage() override { return ""; }
+
+private:
+  int read_result_;
+};
+
+TEST(FixedPacketTool, recv_timeout_and_failure) {
+  serial_driver::FixedPacket<32> packet;
+  serial_driver::FixedPacketTool<32> idle(std::make_shared<ConstantTransporter>(0));
+  EXPECT_EQ(idle.recvPacket(packet), serial_driver::ReceiveStatus::TIMEOUT);
+  serial_driver::FixedPacketTool<32> failed(std::make_shared<ConstantTransporter>(-1));
+  EXPECT_EQ(failed.recvPacket(packet), serial_driver::ReceiveStatus::FAILURE);
+}
@@ -0,0 +1,85 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gtest/gtest.h"
+#include "rm_serial_driver/gimbal_cmd_arbiter.hpp"
+
+using fyt::serial_driver::GimbalCmdArbiter;
+
+namespace {
+constexpr int64_t MS = 1000000;
+
+rm_interfaces::msg::GimbalCmd command(int64_t stamp_ns, double yaw) {
+  rm_interfaces::msg::GimbalCmd cmd;
+  cmd.header.stamp.sec = static_cast<int32_t>(stamp_ns / 1000000000);
+  cmd.header.stamp.nanosec = static_cast<uint32_t>(stamp_ns % 1000000000);
+  cmd.yaw = yaw;
+  return cmd;
+}
+}  // namespace
+
+TEST(GimbalCmdArbiterTest, ForwardsTheActiveSource) {
+  GimbalCmdArbiter arbiter;
+  const int64_t now = 1000 * MS;
+  EXPECT_TRUE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now, 0), now));
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::RUNE, command(now, 0), now));
+
+  // Big rune of the blue side
+  arbiter.setMode(5);
+  EXPECT_EQ(arbiter.activeSource(), GimbalCmdArbiter::RUNE);
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now, 0), now));
+  EXPECT_TRUE(arbiter.offer(GimbalCmdArbiter::RUNE, command(now, 0), now));
+  EXPECT_EQ(arbiter.inactiveDrops(), 2);
+
+  GimbalCmdArbiter::Params params;
+  params.enable = false;
+  GimbalCmdArbiter disabled(params);
+  disabled.setMode(5);
+  EXPECT_TRUE(disabled.offer(GimbalCmdArbiter::ARMOR, command(now, 0), now));
+}
+
+TEST(GimbalCmdArbiterTest, DropsStaleCommands) {
+  GimbalCmdArbiter arbiter;
+  const int64_t now = 1000 * MS;
+  // Older than max_age
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now - 200 * MS, 0), now));
+  EXPECT_TRUE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now - 10 * MS, 0), now));
+  // Older than the last one forwarded
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now - 20 * MS, 0), now));
+  // A command of no frame
+  EXPECT_TRUE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(0, 0), now));
+  EXPECT_EQ(arbiter.staleDrops(), 2);
+}
+
+TEST(GimbalCmdArbiterTest, CoalescesToTheNewestOfASlot) {
+  GimbalCmdArbiter::Params params;
+  params.rate = 250;
+  GimbalCmdArbiter arbiter(params);
+  const int64_t now = 1000 * MS;
+  rm_interfaces::msg::GimbalCmd cmd;
+  EXPECT_FALSE(arbiter.take(cmd, now));
+
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now, 1), now));
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now + 1 * MS, 2), now + 1 * MS));
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::RUNE, command(now + 2 * MS, 3), now + 2 * MS));
+  ASSERT_TRUE(arbiter.take(cmd, now + 4 * MS));
+  EXPECT_DOUBLE_EQ(cmd.yaw, 2);
+  EXPECT_EQ(arbiter.coalesced(), 1);
+  EXPECT_FALSE(arbiter.take(cmd, now + 8 * MS));
+
+  // The mode changes while the command waits for its slot
+  EXPECT_FALSE(arbiter.offer(GimbalCmdArbiter::ARMOR, command(now + 9 * MS, 4), now + 9 * MS));
+  arbiter.setMode(2);
+  EXPECT_FALSE(arbiter.take(cmd, now + 12 * MS));
+}
@@ -0,0 +1,72 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+#include "rm_serial_driver/gimbal_simulator.hpp"
+
+using fyt::serial_driver::GimbalSimulator;
+
+TEST(GimbalSimulatorTest, StepResponseSettles) {
+  GimbalSimulator::Params params;
+  params.delay = 0;
+  GimbalSimulator sim(params, 0, 0);
+  sim.step(0);
+  sim.command(0, {{0, 0.2, 0.1, 0}});
+  sim.step(0.5);
+  EXPECT_NEAR(sim.yaw(), 0.2, 1e-4);
+  EXPECT_NEAR(sim.pitch(), 0.1, 1e-4);
+  EXPECT_NEAR(sim.yawError(), 0, 1e-4);
+}
+
+TEST(GimbalSimulatorTest, HonorsDelay) {
+  GimbalSimulator::Params params;
+  params.delay = 0.01;
+  GimbalSimulator sim(params, 0, 0);
+  sim.step(0);
+  sim.command(0, {{0, 0.2, 0, 0}});
+  sim.step(0.0095);
+  EXPECT_DOUBLE_EQ(sim.yaw(), 0);
+  sim.step(0.02);
+  EXPECT_GT(sim.yaw(), 0);
+}
+
+TEST(GimbalSimulatorTest, YawTakesShortestPath) {
+  GimbalSimulator::Params params;
+  params.delay = 0;
+  GimbalSimulator sim(params, 3.1, 0);
+  sim.step(0);
+  sim.command(0, {{0, -3.1, 0, 0}});
+  sim.step(0.5);
+  EXPECT_NEAR(std::abs(sim.yaw()), 3.1, 1e-3);
+  EXPECT_NEAR(sim.yawError(), 0, 1e-3);
+}
+
+TEST(GimbalSimulatorTest, FollowsSetpoints) {
+  GimbalSimulator::Params params;
+  params.delay = 0;
+  GimbalSimulator sim(params, 0, 0);
+  sim.step(0);
+  // A ramp of 1 rad/s with its feed-forward velocity
+  std::vector<GimbalSimulator::Setpoint> setpoints;
+  for (int k = 0; k <= 50; k++) {
+    setpoints.push_back({0.02 * k, 0.02 * k, 0, 1.0});
+  }
+  sim.command(0, setpoints);
+  sim.step(0.8);
+  // No lag but the 1 ms integration step
+  EXPECT_NEAR(sim.yawError(), 0, 2e-3);
+}
@@ -0,0 +1,113 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "rm_serial_driver/latest_slot.hpp"
+
+using fyt::serial_driver::LatestSlot;
+
+namespace {
+// Not a multiple of the word size
+struct Command {
+  float yaw;
+  float pitch;
+  uint8_t fire;
+};
+
+// Every field follows from the counter, so a torn read shows up as a mismatch
+struct Wide {
+  uint64_t counter;
+  double yaw;
+  double pitch;
+  uint64_t check;
+  uint32_t tail;
+
+  static Wide of(uint64_t n) {
+    return {n, n * 0.5, -static_cast<double>(n), ~n, static_cast<uint32_t>(n * 7)};
+  }
+  bool consistent() const {
+    const Wide expected = of(counter);
+    return yaw == expected.yaw && pitch == expected.pitch && check == expected.check &&
+           tail == expected.tail;
+  }
+};
+}  // namespace
+
+TEST(LatestSlotTest, VersionChangesWithEveryStore) {
+  LatestSlot<Command> slot;
+  Command value{1.0f, 2.0f, 1};
+  EXPECT_EQ(slot.load(value), 0u);
+  // Nothing stored yet, the value is zero
+  EXPECT_EQ(value.yaw, 0.0f);
+  EXPECT_EQ(value.fire, 0);
+
+  slot.store({0.25f, -0.5f, 1});
+  const uint64_t first = slot.load(value);
+  EXPECT_NE(first, 0u);
+  EXPECT_EQ(value.yaw, 0.25f);
+  EXPECT_EQ(value.pitch, -0.5f);
+  EXPECT_EQ(value.fire, 1);
+  // Reading does not change the version
+  EXPECT_EQ(slot.load(value), first);
+
+  slot.store({0.75f, 0.0f, 0});
+  const uint64_t second = slot.load(value);
+  EXPECT_GT(second, first);
+  EXPECT_EQ(value.yaw, 0.75f);
+  EXPECT_EQ(value.fire, 0);
+}
+
+TEST(LatestSlotTest, ReaderNeverSeesATornValue) {
+  constexpr uint64_t STORES = 2000000;
+  LatestSlot<Wide> slot;
+  std::atomic<bool> done{false};
+
+  std::thread writer([&]() {
+    for (uint64_t n = 1; n <= STORES; n++) {
+      slot.store(Wide::of(n));
+    }
+    done = true;
+  });
+
+  uint64_t reads = 0, torn = 0, last_counter = 0, last_version = 0;
+  bool ordered = true;
+  while (!done.load() || reads == 0) {
+    Wide value{};
+    const uint64_t version = slot.load(value);
+    reads++;
+    if (version == 0) {
+      continue;
+    }
+    if (!value.consistent()) {
+      torn++;
+    }
+    // One writer, so the values come in order and the version follows the value
+    ordered = ordered && value.counter >= last_counter && version >= last_version &&
+              (value.counter == last_counter) == (version == last_version);
+    last_counter = value.counter;
+    last_version = version;
+  }
+  writer.join();
+
+  EXPECT_EQ(torn, 0u) << "of " << reads << " reads";
+  EXPECT_TRUE(ordered);
+  Wide value{};
+  slot.load(value);
+  EXPECT_EQ(value.counter, STORES);
+  EXPECT_TRUE(value.consistent());
+}
@@ -0,0 +1,109 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+#include "rm_serial_driver/protocol/trajectory_protocol.hpp"
+
+using namespace fyt::serial_driver;
+using protocol::ProtocolTrajectory;
+
+namespace {
+rm_interfaces::msg::GimbalCmd makeCmd(int64_t stamp_ns, int setpoints_num) {
+  rm_interfaces::msg::GimbalCmd cmd;
+  cmd.header.stamp = rclcpp::Time(stamp_ns);
+  cmd.yaw = 0.5;
+  cmd.pitch = -0.1;
+  cmd.distance = 4.0;
+  cmd.fire_advice = true;
+  for (int k = 0; k < setpoints_num; k++) {
+    rm_interfaces::msg::GimbalSetpoint setpoint;
+    setpoint.time = 0.01 + 0.02 * k;
+    setpoint.yaw = 0.5 + 0.01 * k;
+    setpoint.pitch = -0.1;
+    setpoint.yaw_velocity = 0.5;
+    cmd.setpoints.push_back(setpoint);
+  }
+  return cmd;
+}
+
+struct Setpoint {
+  uint8_t time_ms;
+  float yaw;
+  float pitch;
+  int16_t yaw_velocity;
+};
+
+Setpoint unloadSetpoint(FixedPacket<64> &packet, int k) {
+  const int index = ProtocolTrajectory::SETPOINTS_INDEX + k * ProtocolTrajectory::SETPOINT_SIZE;
+  Setpoint s;
+  packet.unloadData(s.time_ms, index);
+  packet.unloadData(s.yaw, index + 1);
+  packet.unloadData(s.pitch, index + 5);
+  packet.unloadData(s.yaw_velocity, index + 9);
+  return s;
+}
+}  // namespace
+
+TEST(TrajectoryProtocol, pack_setpoints) {
+  const int64_t stamp_ns = 1'000'000'000;
+  FixedPacket<64> packet;
+  // Sent 5 ms after the stamp
+  ProtocolTrajectory::pack(makeCmd(stamp_ns, 4), stamp_ns + 5'000'000, packet);
+  uint8_t fire, n;
+  float distance;
+  packet.unloadData(fire, 1);
+  packet.unloadData(n, 2);
+  packet.unloadData(distance, 3);
+  EXPECT_EQ(fire, protocol::FireState::Fire);
+  EXPECT_EQ(n, 4);
+  EXPECT_FLOAT_EQ(distance, 4.0f);
+  for (int k = 0; k < 4; k++) {
+    const Setpoint s = unloadSetpoint(packet, k);
+    EXPECT_EQ(s.time_ms, 5 + 20 * k);
+    EXPECT_FLOAT_EQ(s.yaw, 0.5f + 0.01f * k);
+    EXPECT_FLOAT_EQ(s.pitch, -0.1f);
+    EXPECT_EQ(s.yaw_velocity, 500);
+  }
+  EXPECT_EQ(packet.buffer()[63], 0xFE);
+}
+
+TEST(TrajectoryProtocol, drop_past_setpoints) {
+  const int64_t stamp_ns = 1'000'000'000;
+  FixedPacket<64> packet;
+  // The first two are past, the second of them is kept at time 0
+  ProtocolTrajectory::pack(makeCmd(stamp_ns, 7), stamp_ns + 40'000'000, packet);
+  uint8_t n;
+  packet.unloadData(n, 2);
+  EXPECT_EQ(n, ProtocolTrajectory::MAX_SETPOINTS);
+  const Setpoint first = unloadSetpoint(packet, 0);
+  EXPECT_EQ(first.time_ms, 0);
+  EXPECT_FLOAT_EQ(first.yaw, 0.51f);
+  EXPECT_EQ(unloadSetpoint(packet, 1).time_ms, 10);
+}
+
+TEST(TrajectoryProtocol, command_without_setpoints) {
+  FixedPacket<64> packet;
+  ProtocolTrajectory::pack(makeCmd(0, 0), 0, packet);
+  uint8_t n;
+  packet.unloadData(n, 2);
+  EXPECT_EQ(n, 1);
+  const Setpoint s = unloadSetpoint(packet, 0);
+  EXPECT_EQ(s.time_ms, 0);
+  EXPECT_FLOAT_EQ(s.yaw, 0.5f);
+  EXPECT_FLOAT_EQ(s.pitch, -0.1f);
+  EXPECT_EQ(s.yaw_velocity, 0);
+}
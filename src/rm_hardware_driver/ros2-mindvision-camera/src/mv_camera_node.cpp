@@ -6,14 +6,26 @@
 
 // ROS
 #include <camera_info_manager/camera_info_manager.hpp>
-#include <image_transport/image_transport.hpp>
 #include <rclcpp/logging.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <sensor_msgs/msg/camera_info.hpp>
 #include <sensor_msgs/msg/image.hpp>
 
+// project
+#include "rm_interfaces/msg/camera_control.hpp"
+#include "rm_utils/device_clock.hpp"
+#include "rm_utils/thread_config.hpp"
+
 // C++ system
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -56,10 +68,6 @@ public:
     // 获得相机的特性描述结构体。该结构体中包含了相机可设置的各种参数的范围信息。决定了相关函数的参数
     CameraGetCapability(h_camera_, &t_capability_);
 
-    // 直接使用vector的内存作为相机输出buffer
-    image_msg_.data.reserve(
-      t_capability_.sResolutionRange.iHeightMax * t_capability_.sResolutionRange.iWidthMax * 3);
-
     // 设置手动曝光
     CameraSetAeState(h_camera_, false);
 
@@ -77,8 +85,9 @@ public:
     // rqt_image_view can't subscribe image msg with sensor_data QoS
     // https://github.com/ros-visualization/rqt/issues/187
     bool use_sensor_data_qos = this->declare_parameter("use_sensor_data_qos", false);
-    auto qos = use_sensor_data_qos ? rmw_qos_profile_sensor_data : rmw_qos_profile_default;
-    camera_pub_ = image_transport::create_camera_publisher(this, "image_raw", qos);
+    auto qos = use_sensor_data_qos ? rclcpp::SensorDataQoS() : rclcpp::QoS(10);
+    image_pub_ = this->create_publisher<sensor_msgs::msg::Image>("image_raw", qos);
+    camera_info_pub_ = this->create_publisher<sensor_msgs::msg::CameraInfo>("camera_info", qos);
 
     // Load camera info
     camera_name_ = this->declare_parameter("camera_name", "mv_camera");
@@ -97,50 +106,50 @@ public:
     params_callback_handle_ = this->add_on_set_parameters_callback(
       std::bind(&MVCameraNode::parametersCallback, this, std::placeholders::_1));
 
-    capture_thread_ = std::thread{[this]() -> void {
-      RCLCPP_INFO(this->get_logger(), "Publishing image!");
-
-      image_msg_.header.frame_id = "camera_optical_frame";
-      image_msg_.encoding = "rgb8";
-
-      while (rclcpp::ok()) {
-        int status = CameraGetImageBuffer(h_camera_, &s_frame_info_, &pby_buffer_, 1000);
-        if (status == CAMERA_STATUS_SUCCESS) {
-          CameraImageProcess(h_camera_, pby_buffer_, image_msg_.data.data(), &s_frame_info_);
-          if (flip_image_) {
-            CameraFlipFrameBuffer(image_msg_.data.data(), &s_frame_info_, 3);
-          }
-          camera_info_msg_.header.stamp = image_msg_.header.stamp = this->now();
-          image_msg_.height = s_frame_info_.iHeight;
-          image_msg_.width = s_frame_info_.iWidth;
-          image_msg_.step = s_frame_info_.iWidth * 3;
-          image_msg_.data.resize(s_frame_info_.iWidth * s_frame_info_.iHeight * 3);
-
-          camera_pub_.publish(image_msg_, camera_info_msg_);
-
-          // 在成功调用CameraGetImageBuffer后，必须调用CameraReleaseImageBuffer来释放获得的buffer。
-          // 否则再次调用CameraGetImageBuffer时，程序将被挂起一直阻塞，
-          // 直到其他线程中调用CameraReleaseImageBuffer来释放了buffer
-          CameraReleaseImageBuffer(h_camera_, pby_buffer_);
-          fail_conut_ = 0;
-        } else {
-          RCLCPP_WARN(this->get_logger(), "Failed to get image buffer, status = %d", status);
-          fail_conut_++;
-        }
+    // Exposure and AOI requested by the detectors, applied by the capture thread between frames.
+    // The AOI is given in the coordinate of the resolution at startup
+    CameraGetImageResolution(h_camera_, &full_resolution_);
+    if (this->declare_parameter("camera_control", false)) {
+      control_sub_ = this->create_subscription<rm_interfaces::msg::CameraControl>(
+        "camera_control", rclcpp::QoS(1),
+        [this](const rm_interfaces::msg::CameraControl::SharedPtr msg) {
+          std::lock_guard<std::mutex> lock(control_mutex_);
+          pending_control_ = *msg;
+          has_pending_control_ = true;
+        });
+    }
 
-        if (fail_conut_ > 5) {
-          RCLCPP_FATAL(this->get_logger(), "Failed to get image buffer, exit!");
-          rclcpp::shutdown();
-        }
-      }
-    }};
+    // The grab thread only copies the raw frame and gives the SDK buffer back at once, the ISP
+    // runs on the process threads
+    const size_t raw_size =
+      t_capability_.sResolutionRange.iHeightMax * t_capability_.sResolutionRange.iWidthMax * 2;
+    for (size_t i = 0; i < RAW_POOL_SIZE; i++) {
+      raw_pool_[i].data.reserve(raw_size);
+      free_raw_.push_back(i);
+    }
+    const int process_threads = std::max<int64_t>(this->declare_parameter("process_threads", 1), 1);
+    for (int i = 0; i < process_threads; i++) {
+      process_threads_.emplace_back(&MVCameraNode::processLoop, this);
+    }
+    capture_thread_ = std::thread(&MVCameraNode::captureLoop, this);
   }
 
   ~MVCameraNode() override
   {
+    {
+      // Under both locks, a process thread between its check and its wait would miss the wakeup
+      std::lock_guard<std::mutex> raw_lock(raw_mutex_);
+      std::lock_guard<std::mutex> publish_lock(publish_mutex_);
+      running_ = false;
+    }
+    raw_cv_.notify_all();
+    publish_cv_.notify_all();
     if (capture_thread_.joinable()) {
       capture_thread_.join();
     }
+    for (auto & thread : process_threads_) {
+      thread.join();
+    }
 
     CameraUnInit(h_camera_);
 
@@ -148,6 +157,131 @@ public:
   }
 
 private:
+  // Grab the frames, stamp them and copy them into the raw pool
+  void captureLoop()
+  {
+    fyt::utils::configureThread("camera_capture");
+    RCLCPP_INFO(this->get_logger(), "Publishing image!");
+
+    while (rclcpp::ok() && running_) {
+      applyControl();
+      uint8_t * pby_buffer;
+      int status = CameraGetImageBuffer(h_camera_, &s_frame_info_, &pby_buffer, 1000);
+      if (status != CAMERA_STATUS_SUCCESS) {
+        RCLCPP_WARN(this->get_logger(), "Failed to get image buffer, status = %d", status);
+        if (++fail_conut_ > 5) {
+          RCLCPP_FATAL(this->get_logger(), "Failed to get image buffer, exit!");
+          rclcpp::shutdown();
+        }
+        continue;
+      }
+      fail_conut_ = 0;
+      const rclcpp::Time stamp = frameStamp();
+
+      size_t index = RAW_POOL_SIZE;
+      {
+        std::lock_guard<std::mutex> lock(raw_mutex_);
+        if (!free_raw_.empty()) {
+          index = free_raw_.back();
+          free_raw_.pop_back();
+        } else if (!ready_raw_.empty()) {
+          // The process threads fall behind, drop the oldest frame
+          index = ready_raw_.front();
+          ready_raw_.pop_front();
+        }
+      }
+      if (index != RAW_POOL_SIZE) {
+        // Nobody else touches the frame until it is ready
+        RawFrame & frame = raw_pool_[index];
+        frame.data.resize(s_frame_info_.uiBytes);
+        std::memcpy(frame.data.data(), pby_buffer, s_frame_info_.uiBytes);
+        frame.head = s_frame_info_;
+        frame.stamp = stamp;
+        setFrameRoi(frame.roi);
+      }
+
+      // 在成功调用CameraGetImageBuffer后，必须调用CameraReleaseImageBuffer来释放获得的buffer。
+      // 否则再次调用CameraGetImageBuffer时，程序将被挂起一直阻塞，
+      // 直到其他线程中调用CameraReleaseImageBuffer来释放了buffer
+      CameraReleaseImageBuffer(h_camera_, pby_buffer);
+
+      if (index != RAW_POOL_SIZE) {
+        {
+          std::lock_guard<std::mutex> lock(raw_mutex_);
+          ready_raw_.push_back(index);
+        }
+        raw_cv_.notify_one();
+      }
+    }
+  }
+
+  // Run the ISP on the raw frames and publish them in the order they were taken
+  void processLoop()
+  {
+    fyt::utils::configureThread("camera_process");
+    while (true) {
+      size_t index;
+      uint64_t sequence;
+      {
+        std::unique_lock<std::mutex> lock(raw_mutex_);
+        raw_cv_.wait(lock, [this] { return !running_ || !ready_raw_.empty(); });
+        if (!running_) {
+          return;
+        }
+        index = ready_raw_.front();
+        ready_raw_.pop_front();
+        sequence = next_sequence_++;
+      }
+
+      RawFrame & frame = raw_pool_[index];
+      // The ownership is moved to the subscribers, the message is never reused while in flight
+      auto image_msg = std::make_unique<sensor_msgs::msg::Image>();
+      image_msg->header.frame_id = "camera_optical_frame";
+      image_msg->header.stamp = frame.stamp;
+      image_msg->height = frame.head.iHeight;
+      image_msg->width = frame.head.iWidth;
+      const char * raw_encoding = publish_raw_ ? rawEncoding(frame.head.uiMediaType) : nullptr;
+      if (raw_encoding != nullptr) {
+        // Skip the ISP, the subscribers demosaic the raw frame on demand
+        image_msg->encoding = raw_encoding;
+        image_msg->step = frame.head.iWidth;
+        const size_t size = std::min<size_t>(frame.data.size(), image_msg->height * image_msg->step);
+        image_msg->data.assign(frame.data.begin(), frame.data.begin() + size);
+      } else {
+        image_msg->encoding = "rgb8";
+        image_msg->step = frame.head.iWidth * 3;
+        image_msg->data.resize(image_msg->height * image_msg->step);
+        {
+          // The ISP keeps its working buffers in the camera handle
+          std::lock_guard<std::mutex> lock(isp_mutex_);
+          CameraImageProcess(h_camera_, frame.data.data(), image_msg->data.data(), &frame.head);
+        }
+        if (flip_image_) {
+          CameraFlipFrameBuffer(image_msg->data.data(), &frame.head, 3);
+        }
+      }
+      auto camera_info_msg = std::make_unique<sensor_msgs::msg::CameraInfo>(camera_info_msg_);
+      camera_info_msg->header = image_msg->header;
+      camera_info_msg->roi = frame.roi;
+      {
+        std::lock_guard<std::mutex> lock(raw_mutex_);
+        free_raw_.push_back(index);
+      }
+
+      // Keep the order of the frames with several process threads
+      std::unique_lock<std::mutex> lock(publish_mutex_);
+      publish_cv_.wait(lock, [this, sequence] { return !running_ || published_ == sequence; });
+      if (!running_) {
+        return;
+      }
+      camera_info_pub_->publish(std::move(camera_info_msg));
+      image_pub_->publish(std::move(image_msg));
+      published_++;
+      lock.unlock();
+      publish_cv_.notify_all();
+    }
+  }
+
   void declareParameters()
   {
     rcl_interfaces::msg::ParameterDescriptor param_desc;
@@ -219,6 +353,134 @@ private:
 
     // Flip
     flip_image_ = this->declare_parameter("flip_image", false);
+
+    // Device timestamp, mapped onto the ROS clock at the middle of the exposure
+    hardware_timestamp_ = this->declare_parameter("hardware_timestamp", true);
+    transfer_delay_ns_ = this->declare_parameter("transfer_delay", 0) * int64_t{1000};
+
+    // Raw Bayer output, flipping is not applied to it
+    publish_raw_ = this->declare_parameter("publish_raw", false);
+    if (publish_raw_ && flip_image_) {
+      RCLCPP_WARN(this->get_logger(), "flip_image is ignored for raw frames");
+    }
+  }
+
+  // Stamp of the frame in s_frame_info_, called right after it is grabbed
+  rclcpp::Time frameStamp()
+  {
+    const rclcpp::Time now = this->now();
+    if (!hardware_timestamp_) {
+      return now;
+    }
+    if (device_clock_reset_.exchange(false)) {
+      device_clock_.reset();
+      has_device_stamp_ = false;
+    }
+    // uiTimeStamp is 32 bits of 0.1 ms, unwrap it
+    const uint32_t device_stamp = s_frame_info_.uiTimeStamp;
+    if (has_device_stamp_) {
+      device_ticks_ += static_cast<uint32_t>(device_stamp - last_device_stamp_);
+    } else {
+      device_ticks_ = device_stamp;
+      has_device_stamp_ = true;
+    }
+    last_device_stamp_ = device_stamp;
+    // The fastest frame arrives at the end of the exposure plus the transfer delay
+    const int64_t arrival_ns = device_clock_.update(device_ticks_, now.nanoseconds());
+    return rclcpp::Time(
+      arrival_ns - int64_t{s_frame_info_.uiExpTime} * 500 - transfer_delay_ns_,
+      now.get_clock_type());
+  }
+
+  // Apply the latest request of camera_control, called by the capture thread
+  void applyControl()
+  {
+    rm_interfaces::msg::CameraControl control;
+    {
+      std::lock_guard<std::mutex> lock(control_mutex_);
+      if (!has_pending_control_) {
+        return;
+      }
+      has_pending_control_ = false;
+      control = pending_control_;
+    }
+
+    if (control.exposure_time > 0 && control.exposure_time != control_exposure_) {
+      control_exposure_ = control.exposure_time;
+      CameraSetExposureTime(h_camera_, control_exposure_);
+      device_clock_reset_ = true;
+    }
+
+    // Round the requested area outwards to AOI_STEP, zero width or height for the full frame
+    Aoi aoi;
+    if (control.width > 0 && control.height > 0) {
+      auto fit = [](int64_t begin, int64_t end, int full, int & offset, int & size) {
+        int64_t s = std::max<int64_t>(end - begin, AOI_STEP);
+        s = std::min<int64_t>((s + AOI_STEP - 1) / AOI_STEP * AOI_STEP, full);
+        offset = std::clamp<int64_t>(begin, 0, full - s) / AOI_STEP * AOI_STEP;
+        size = s;
+      };
+      fit(control.x_offset, int64_t{control.x_offset} + control.width, full_resolution_.iWidth,
+        aoi.x, aoi.width);
+      fit(control.y_offset, int64_t{control.y_offset} + control.height, full_resolution_.iHeight,
+        aoi.y, aoi.height);
+      if (aoi.width == full_resolution_.iWidth && aoi.height == full_resolution_.iHeight) {
+        aoi = Aoi();
+      }
+    }
+    if (aoi == aoi_) {
+      return;
+    }
+
+    tSdkImageResolution resolution = full_resolution_;
+    if (aoi.width > 0) {
+      resolution.iIndex = 0xff;
+      resolution.iHOffsetFOV = full_resolution_.iHOffsetFOV + aoi.x;
+      resolution.iVOffsetFOV = full_resolution_.iVOffsetFOV + aoi.y;
+      resolution.iWidthFOV = resolution.iWidth = aoi.width;
+      resolution.iHeightFOV = resolution.iHeight = aoi.height;
+    }
+    int status = CameraSetImageResolution(h_camera_, &resolution);
+    if (status != CAMERA_STATUS_SUCCESS) {
+      RCLCPP_WARN(this->get_logger(), "Failed to set the AOI, status = %d", status);
+      return;
+    }
+    previous_aoi_ = aoi_;
+    aoi_ = aoi;
+  }
+
+  // The AOI of the frame in s_frame_info_. Frames grabbed before a change still have the size of
+  // the previous AOI
+  void setFrameRoi(sensor_msgs::msg::RegionOfInterest & roi)
+  {
+    auto matches = [this](const Aoi & aoi) {
+      return aoi.width > 0 ? aoi.width == s_frame_info_.iWidth &&
+                               aoi.height == s_frame_info_.iHeight
+                           : full_resolution_.iWidth == s_frame_info_.iWidth &&
+                               full_resolution_.iHeight == s_frame_info_.iHeight;
+    };
+    const Aoi & aoi = !matches(aoi_) && matches(previous_aoi_) ? previous_aoi_ : aoi_;
+    roi.x_offset = aoi.x;
+    roi.y_offset = aoi.y;
+    roi.width = aoi.width;
+    roi.height = aoi.height;
+  }
+
+  // sensor_msgs encoding of an 8-bit raw frame, nullptr if the media type is not Bayer
+  static const char * rawEncoding(UINT media_type)
+  {
+    switch (media_type) {
+      case CAMERA_MEDIA_TYPE_BAYGR8:
+        return "bayer_grbg8";
+      case CAMERA_MEDIA_TYPE_BAYRG8:
+        return "bayer_rggb8";
+      case CAMERA_MEDIA_TYPE_BAYGB8:
+        return "bayer_gbrg8";
+      case CAMERA_MEDIA_TYPE_BAYBG8:
+        return "bayer_bggr8";
+      default:
+        return nullptr;
+    }
   }
 
   rcl_interfaces::msg::SetParametersResult parametersCallback(
@@ -228,6 +490,8 @@ private:
     result.successful = true;
     for (const auto & param : parameters) {
       if (param.get_name() == "exposure_time") {
+        // The delay of the frames changes with the exposure
+        device_clock_reset_ = true;
         int status = CameraSetExposureTime(h_camera_, param.as_int());
         if (status != CAMERA_STATUS_SUCCESS) {
           result.successful = false;
@@ -284,18 +548,73 @@ private:
   }
 
   int h_camera_;
-  uint8_t * pby_buffer_;
   tSdkCameraCapbility t_capability_;  // 设备描述信息
-  tSdkFrameHead s_frame_info_;        // 图像帧头信息
+  tSdkFrameHead s_frame_info_;        // 图像帧头信息, 只在采集线程中使用
 
-  sensor_msgs::msg::Image image_msg_;
-
-  image_transport::CameraPublisher camera_pub_;
+  // A raw frame copied from the SDK buffer
+  struct RawFrame
+  {
+    std::vector<uint8_t> data;
+    tSdkFrameHead head;
+    rclcpp::Time stamp;
+    sensor_msgs::msg::RegionOfInterest roi;
+  };
+  // Preallocated raw frames, each one is either free, ready or owned by a process thread. If none
+  // is free the oldest ready one is dropped
+  static constexpr size_t RAW_POOL_SIZE = 4;
+  std::array<RawFrame, RAW_POOL_SIZE> raw_pool_;
+  std::vector<size_t> free_raw_;
+  std::deque<size_t> ready_raw_;
+  std::mutex raw_mutex_;
+  std::condition_variable raw_cv_;
+  // Sequence of the frames taken by the process threads, guarded by raw_mutex_
+  uint64_t next_sequence_ = 0;
+  // Count of the published frames, guarded by publish_mutex_
+  uint64_t published_ = 0;
+  std::mutex publish_mutex_;
+  std::condition_variable publish_cv_;
+  // Serializes CameraImageProcess between the process threads
+  std::mutex isp_mutex_;
+  std::atomic<bool> running_{true};
+  std::vector<std::thread> process_threads_;
+
+  // Plain rclcpp publishers, image_transport can't publish unique_ptr for intra-process
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_pub_;
+  rclcpp::Publisher<sensor_msgs::msg::CameraInfo>::SharedPtr camera_info_pub_;
 
   // RGB Gain
   int r_gain_, g_gain_, b_gain_;
 
   bool flip_image_;
+  bool publish_raw_;
+
+  // Hardware timestamp, only used by the capture thread
+  bool hardware_timestamp_;
+  int64_t transfer_delay_ns_;
+  fyt::utils::DeviceClock device_clock_{1e5};
+  std::atomic<bool> device_clock_reset_{false};
+  bool has_device_stamp_ = false;
+  uint32_t last_device_stamp_ = 0;
+  uint64_t device_ticks_ = 0;
+
+  // Detector-driven exposure and AOI, only used by the capture thread except the pending request
+  struct Aoi
+  {
+    int x = 0, y = 0, width = 0, height = 0;
+    bool operator==(const Aoi & other) const
+    {
+      return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+  };
+  static constexpr int AOI_STEP = 16;
+  rclcpp::Subscription<rm_interfaces::msg::CameraControl>::SharedPtr control_sub_;
+  std::mutex control_mutex_;
+  rm_interfaces::msg::CameraControl pending_control_;
+  bool has_pending_control_ = false;
+  int control_exposure_ = 0;
+  tSdkImageResolution full_resolution_;
+  // Zero width for the full frame
+  Aoi aoi_, previous_aoi_;
 
   std::string camera_name_;
   std::unique_ptr<camera_info_manager::CameraInfoManager> camera_info_manager_;
@@ -0,0 +1,234 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Latency and keypoint error of a rune model (e.g. INT8 quantized) against a reference model.
+//
+// Usage:
+//   ros2 run rune_detector rune_model_bench --frames=<dir> [--reference=<model>]
+//     [--candidate=<model>] [--device=CPU] [--rounds=3]
+//
+// Every image in <dir> is one frame, docs/test.png is used if no directory is given.
+// The detections of the reference model are taken as the ground truth: each candidate fan is
+// matched to the reference fan of the same type with the nearest box center, and the error is
+// the mean distance of its five keypoints in pixels.
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+// 3rd party
+#include <opencv2/opencv.hpp>
+// project
+#include "rm_utils/url_resolver.hpp"
+#include "rune_detector/rune_detector.hpp"
+#include "rune_detector/types.hpp"
+
+using namespace fyt;
+using namespace fyt::rune;
+namespace fs = std::filesystem;
+
+namespace {
+std::string g_frames_dir;
+std::string g_reference = "package://rune_detector/model/yolox_rune_3.6m.onnx";
+std::string g_candidate = "package://rune_detector/model/yolox_rune_3.6m_int8.xml";
+std::string g_device = "CPU";
+int g_rounds = 3;
+
+std::vector<fs::path> listFrames() {
+  std::vector<fs::path> paths;
+  if (g_frames_dir.empty()) {
+    paths.emplace_back(
+      utils::URLResolver::getResolvedPath("package://rune_detector/docs/test.png"));
+    return paths;
+  }
+  for (const auto &entry : fs::directory_iterator(g_frames_dir)) {
+    std::string ext = entry.path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (entry.is_regular_file() && (ext == ".png" || ext == ".jpg" || ext == ".bmp")) {
+      paths.emplace_back(entry.path());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+struct ModelResult {
+  RuneDetector::InitProfile profile;
+  // Per-frame detections, in the order of the frames
+  std::vector<std::vector<RuneObject>> detections;
+  // Latency of every inference in milliseconds
+  std::vector<double> latencies;
+};
+
+ModelResult runModel(const std::string &model, const std::vector<cv::Mat> &frames) {
+  ModelResult result;
+  auto detector = std::make_unique<RuneDetector>(utils::URLResolver::getResolvedPath(model),
+                                                 g_device);
+  std::vector<RuneObject> objs;
+  detector->setCallback(
+    [&objs](std::vector<RuneObject> &res, int64_t, const cv::Mat &) { objs = res; });
+  // One request, so that the latency is the one of a single frame
+  result.profile = detector->init(1);
+
+  result.detections.resize(frames.size());
+  for (int round = 0; round < g_rounds; round++) {
+    for (size_t i = 0; i < frames.size(); i++) {
+      objs.clear();
+      auto start = std::chrono::steady_clock::now();
+      detector->pushInput(frames[i], 0).get();
+      result.latencies.push_back(
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+          .count());
+      if (round == 0) {
+        result.detections[i] = objs;
+      }
+    }
+  }
+  return result;
+}
+
+double percentile(std::vector<double> samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[static_cast<size_t>(p * (samples.size() - 1) + 0.5)];
+}
+
+double keypointError(const RuneObject &a, const RuneObject &b) {
+  auto pa = a.pts.toVector2f();
+  auto pb = b.pts.toVector2f();
+  double sum = 0;
+  for (size_t i = 0; i < pa.size(); i++) {
+    sum += cv::norm(pa[i] - pb[i]);
+  }
+  return sum / pa.size();
+}
+
+void printLatency(const char *name, const ModelResult &result) {
+  double mean = 0;
+  for (double l : result.latencies) {
+    mean += l;
+  }
+  mean /= std::max<size_t>(result.latencies.size(), 1);
+  std::printf("%-10s quantized %-3s  read %8.1f ms  compile %8.1f ms  first %7.2f ms  "
+              "p50 %7.2f ms  p99 %7.2f ms  mean %7.2f ms  %7.1f fps\n",
+              name,
+              result.profile.quantized ? "yes" : "no",
+              result.profile.read_ms,
+              result.profile.compile_ms,
+              result.profile.first_infer_ms,
+              percentile(result.latencies, 0.50),
+              percentile(result.latencies, 0.99),
+              mean,
+              mean > 0 ? 1000.0 / mean : 0.0);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--frames=", 9) == 0) {
+      g_frames_dir = argv[i] + 9;
+    } else if (std::strncmp(argv[i], "--reference=", 12) == 0) {
+      g_reference = argv[i] + 12;
+    } else if (std::strncmp(argv[i], "--candidate=", 12) == 0) {
+      g_candidate = argv[i] + 12;
+    } else if (std::strncmp(argv[i], "--device=", 9) == 0) {
+      g_device = argv[i] + 9;
+    } else if (std::strncmp(argv[i], "--rounds=", 9) == 0) {
+      g_rounds = std::max(1, std::atoi(argv[i] + 9));
+    } else {
+      std::cerr << "Unknown argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<cv::Mat> frames;
+  for (const auto &path : listFrames()) {
+    cv::Mat img = cv::imread(path.string(), cv::IMREAD_COLOR);
+    if (img.empty()) {
+      std::cerr << "Failed to read " << path << std::endl;
+      continue;
+    }
+    cv::cvtColor(img, img, cv::COLOR_BGR2RGB);
+    frames.emplace_back(std::move(img));
+  }
+  if (frames.empty()) {
+    std::cerr << "No frames loaded" << std::endl;
+    return 1;
+  }
+  std::cerr << "Loaded " << frames.size() << " frames" << std::endl;
+
+  ModelResult reference = runModel(g_reference, frames);
+  ModelResult candidate = runModel(g_candidate, frames);
+  printLatency("reference", reference);
+  printLatency("candidate", candidate);
+
+  // Keypoint error of the candidate against the reference
+  size_t reference_num = 0, matched_num = 0, extra_num = 0;
+  std::vector<double> errors;
+  for (size_t i = 0; i < frames.size(); i++) {
+    const auto &ref_objs = reference.detections[i];
+    std::vector<bool> used(ref_objs.size(), false);
+    reference_num += ref_objs.size();
+    for (const auto &obj : candidate.detections[i]) {
+      const cv::Point2f center = (obj.box.tl() + obj.box.br()) / 2;
+      size_t best = ref_objs.size();
+      double best_distance = std::numeric_limits<double>::max();
+      for (size_t j = 0; j < ref_objs.size(); j++) {
+        if (used[j] || ref_objs[j].type != obj.type) {
+          continue;
+        }
+        const cv::Point2f ref_center = (ref_objs[j].box.tl() + ref_objs[j].box.br()) / 2;
+        const double distance = cv::norm(center - ref_center);
+        // The boxes must overlap
+        if (distance < std::max(ref_objs[j].box.width, ref_objs[j].box.height) / 2.0 &&
+            distance < best_distance) {
+          best = j;
+          best_distance = distance;
+        }
+      }
+      if (best == ref_objs.size()) {
+        extra_num++;
+        continue;
+      }
+      used[best] = true;
+      matched_num++;
+      errors.push_back(keypointError(obj, ref_objs[best]));
+    }
+  }
+  double mean_error = 0;
+  for (double e : errors) {
+    mean_error += e;
+  }
+  mean_error /= std::max<size_t>(errors.size(), 1);
+  std::printf("keypoints  matched %zu/%zu  extra %zu  error mean %.2f px  p50 %.2f px  "
+              "p99 %.2f px  max %.2f px\n",
+              matched_num,
+              reference_num,
+              extra_num,
+              mean_error,
+              percentile(errors, 0.50),
+              percentile(errors, 0.99),
+              errors.empty() ? 0.0 : *std::max_element(errors.begin(), errors.end()));
+  return 0;
+}
@@ -0,0 +1,81 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef RUNE_DETECTOR_KEYPOINT_FLOW_HPP_
+#define RUNE_DETECTOR_KEYPOINT_FLOW_HPP_
+
+// std
+#include <cstdint>
+#include <mutex>
+#include <vector>
+// third party
+#include <opencv2/core.hpp>
+
+namespace fyt::rune {
+
+// Sparse optical flow (pyramidal KLT) of the five keypoints of the target fan, so that the
+// frames between two inferences still get a target. The keypoints are anchored by every
+// inference result and carried from frame to frame until the flow of one of them is lost.
+// Thread-safe, the inference results arrive on the threads of OpenVINO
+class KeypointFlow {
+public:
+  struct Params {
+    bool enable = false;
+    // A frame is sent to the inference at least every this many frames, and on every frame
+    // while the flow is lost
+    int reanchor_interval = 3;
+    // Maximum mean KLT error of the keypoints
+    double max_error = 20.0;
+    // Side of the KLT window in pixels, and the number of pyramid levels above the image
+    int window_size = 21;
+    int max_level = 3;
+  };
+
+  KeypointFlow() = default;
+  explicit KeypointFlow(const Params &params) : params_(params) {}
+
+  // Anchor the keypoints detected in rgb_img, empty if the target is lost. A result older
+  // than the last anchor is ignored
+  void anchor(const cv::Mat &rgb_img,
+              int64_t timestamp_nanosec,
+              const std::vector<cv::Point2f> &pts);
+
+  // Propagate the keypoints into rgb_img, which must be newer than the last frame.
+  // Return: false if there is no anchor or the flow is lost, the anchor is cleared then
+  bool propagate(const cv::Mat &rgb_img, int64_t timestamp_nanosec, std::vector<cv::Point2f> &pts);
+
+  bool tracking() const;
+  void reset();
+
+  const Params &params() const noexcept { return params_; }
+
+private:
+  Params params_;
+
+  mutable std::mutex mtx_;
+  bool tracking_ = false;
+  int64_t anchor_stamp_ = 0;
+  int64_t last_stamp_ = 0;
+  // Frame the keypoints are in, swapped with the new frame after each propagation
+  cv::Mat prev_gray_;
+  cv::Mat gray_;
+  std::vector<cv::Point2f> prev_pts_;
+  std::vector<cv::Point2f> next_pts_;
+  std::vector<uchar> status_;
+  std::vector<float> err_;
+};
+
+}  // namespace fyt::rune
+#endif  // RUNE_DETECTOR_KEYPOINT_FLOW_HPP_
@@ -20,11 +20,17 @@
 #define RUNE_DETECTOR_RUNE_DETECTOR_HPP_
 
 // std
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
 #include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <tuple>
 // third party
@@ -54,25 +60,150 @@ public:
                         float nms_threshold = 0.3,
                         bool auto_init = false);
 
-  void init();
+  // Wait for the running requests
+  ~RuneDetector();
 
-  // Push an inference request to the detector
+  // Time spent in each step of init, in milliseconds
+  struct InitProfile {
+    double read_ms = 0;
+    double compile_ms = 0;
+    // The warm-up inference of the first request
+    double first_infer_ms = 0;
+    uint32_t requests = 0;
+    // Frames of one inference at most
+    int batch_size = 1;
+    // The model has FakeQuantize layers, e.g. quantized to INT8 by NNCF/POT
+    bool quantized = false;
+  };
+
+  // max_requests: upper bound of the requests created, 0 for the optimal number of the device
+  // cache_dir: the compiled model is cached there and loaded on the next startup, empty for no
+  // cache. Every request runs one inference before init returns.
+  // batch_size: above 1 the model is compiled with a dynamic batch up to batch_size, and
+  // submitInput() groups consecutive frames into one inference, a batch that is not full is
+  // started batch_timeout_ms after its first frame
+  InitProfile init(int max_requests = 0,
+                   const std::string &cache_dir = "",
+                   int batch_size = 1,
+                   double batch_timeout_ms = 5.0);
+
+  // Push an inference request to the detector, it runs on one of the pre-created requests and
+  // blocks if all of them are busy. The future is ready after the callback is called
   std::future<bool> pushInput(const cv::Mat &rgb_img, int64_t timestamp_nanosec);
 
+  // Never blocks: start the frame on a free request, or if all of them are busy keep it as the
+  // next frame to run, replacing the frame kept before (drop oldest). In the batch mode the
+  // frame is added to the batch being filled instead, the results of a batch are reported in
+  // the order of its frames. The result is only reported by the callback. owner is held until
+  // the frame is processed, e.g. the message that rgb_img shares its data with
+  void submitInput(const cv::Mat &rgb_img,
+                   int64_t timestamp_nanosec,
+                   std::shared_ptr<const void> owner = nullptr);
+
   void setCallback(CallbackType callback);
 
+  // Replace the busy requests by new ones of the compiled model, e.g. when they hang on the
+  // device. The frames they run on are dropped, the model is not compiled again.
+  // Return: the number of requests replaced
+  size_t resetRequests();
+
   // Detect R tag using traditional method
   // Return the center of the R tag and binary roi image (for debug)
   std::tuple<cv::Point2f, cv::Mat> detectRTag(const cv::Mat &img,
                                               int binary_thresh,
                                               const cv::Point2f &prior);
 
+  // Track the R tag over frames, objs are the fans of this frame (not empty).
+  // The image is skipped when the R centers of the fans agree with each other and
+  // with the last R tag, otherwise the R tag is searched in a ROI sized by the
+  // rune radius around the last position. The binary roi image is only made if
+  // draw_debug, empty otherwise
+  std::tuple<cv::Point2f, cv::Mat> trackRTag(const cv::Mat &img,
+                                             int binary_thresh,
+                                             const std::vector<RuneObject> &objs,
+                                             bool draw_debug);
+
 private:
-  // Do inference and call the infer_callback_ after inference
-  bool processCallback(const cv::Mat resized_img,
-                       Eigen::Matrix3f transform_matrix,
-                       int64_t timestamp_nanosec,
-                       const cv::Mat &src_img);
+  // A frame of an inference request
+  struct SlotFrame {
+    Eigen::Matrix3f transform_matrix;
+    int64_t timestamp_nanosec;
+    cv::Mat src_img;
+    std::shared_ptr<const void> owner;
+  };
+
+  // A pre-created inference request and the frames it runs on
+  struct InferSlot {
+    ov::InferRequest request;
+    // Letterboxed u8 RGB images stacked by rows, batch_size_ of them, the input tensor of
+    // request takes the first frames.size()
+    cv::Mat input_img;
+    std::vector<SlotFrame> frames;
+    std::promise<bool> promise;
+  };
+
+  // A frame waiting for a free request
+  struct PendingFrame {
+    cv::Mat img;
+    int64_t timestamp_nanosec;
+    std::shared_ptr<const void> owner;
+  };
+
+  // A request of the compiled model with the input of a full batch, without callback
+  std::unique_ptr<InferSlot> createSlot();
+  void setSlotCallback(size_t index, InferSlot &slot);
+
+  // Letterbox the frame into the slot and start its request. The promise of the slot must be
+  // set up before. The slot is taken from slots_ under mtx_, it stays alive even if
+  // resetRequests() replaces it meanwhile
+  void startRequest(InferSlot &slot,
+                    const cv::Mat &rgb_img,
+                    int64_t timestamp_nanosec,
+                    std::shared_ptr<const void> owner);
+
+  // Letterbox the frame as the next one of the slot
+  void addFrame(InferSlot &slot,
+                const cv::Mat &rgb_img,
+                int64_t timestamp_nanosec,
+                std::shared_ptr<const void> owner);
+
+  // Start the request of the slot on its frames
+  void runSlot(InferSlot &slot);
+
+  // Batch mode of submitInput(), the frame is added to the open batch
+  void addToBatch(const cv::Mat &rgb_img,
+                  int64_t timestamp_nanosec,
+                  std::shared_ptr<const void> owner);
+
+  // Start the open batch, batch_mtx_ must be held
+  void flushBatch();
+
+  // Give the slot of the open batch back without running it, batch_mtx_ must be held
+  void closeBatch();
+
+  // Start the open batch once it is batch_timeout_ old
+  void batchTimerLoop();
+
+  // Completion callback of the request of slot, called by OpenVINO. Ignored if the slot is no
+  // longer slots_[index], which is checked again whenever the index would be given back
+  void onInferComplete(size_t index, InferSlot *slot, std::exception_ptr ex);
+  // Whether slot is still slots_[index], mtx_ must be held
+  bool isCurrentSlot(size_t index, const InferSlot *slot) const noexcept {
+    return index < slots_.size() && slots_[index].get() == slot;
+  }
+
+  // Search the contour of the R tag containing prior in a roi_size x roi_size
+  // ROI, binary_img is drawn if not null
+  // Return: false if not found
+  bool findRTag(const cv::Mat &img, const cv::Point2f &prior, int roi_size,
+                cv::Point2f &center, cv::Mat *binary_img);
+
+  // Decode the output of the batch_index-th frame and call the infer_callback_
+  bool processOutput(const ov::Tensor &output,
+                     size_t batch_index,
+                     const Eigen::Matrix3f &transform_matrix,
+                     int64_t timestamp_nanosec,
+                     const cv::Mat &src_img);
 
 private:
   std::string model_path_;
@@ -88,6 +219,37 @@ private:
 
   std::unique_ptr<ov::Core> ov_core_;
   std::unique_ptr<ov::CompiledModel> compiled_model_;
+
+  // Request pool, sized by ov::optimal_number_of_infer_requests. Read and replaced under mtx_
+  // only, a slot is used through its pointer once taken
+  std::vector<std::unique_ptr<InferSlot>> slots_;
+  std::vector<size_t> free_slots_;
+  std::condition_variable slot_cv_;
+  // Slots replaced by resetRequests(), their requests may still be running
+  std::vector<std::unique_ptr<InferSlot>> retired_slots_;
+  bool has_pending_ = false;
+  PendingFrame pending_;
+
+  // Batch mode, the batch being filled takes a slot of its own. Locked before mtx_
+  int batch_size_ = 1;
+  std::chrono::steady_clock::duration batch_timeout_{};
+  std::mutex batch_mtx_;
+  std::condition_variable batch_cv_;
+  int open_slot_ = -1;
+  InferSlot *open_batch_ = nullptr;
+  // Changes with every batch opened, so that the timer never starts a batch early
+  uint64_t batch_id_ = 0;
+  std::chrono::steady_clock::time_point open_since_;
+  bool stop_batch_timer_ = false;
+  std::thread batch_timer_;
+
+  // R tag tracking, results may come from more than one request at a time
+  std::mutex r_tag_mtx_;
+  bool has_r_tag_ = false;
+  // Last R tag found in the image, and its offset from the prior of the fans
+  cv::Point2f last_r_tag_;
+  cv::Point2f r_tag_offset_;
+  int r_tag_skipped_ = 0;
 };
 }  // namespace fyt::rune
 #endif  // RUNE_DETECTOR_RUNE_DETECTOR_HPP_
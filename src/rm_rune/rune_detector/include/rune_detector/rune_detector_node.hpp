@@ -18,7 +18,9 @@
 // std
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 // ros2
 #include <image_transport/image_transport.hpp>
@@ -36,21 +38,35 @@
 #include "rm_interfaces/msg/serial_receive_data.hpp"
 #include "rm_interfaces/srv/set_mode.hpp"
 #include "rm_utils/common.hpp"
+#include "rm_utils/debug_image.hpp"
 #include "rm_utils/heartbeat.hpp"
+#include "rm_utils/perception_scheduler.hpp"
+#include "rm_utils/sample_dumper.hpp"
+#include "rm_utils/stall_watchdog.hpp"
+#include "rm_utils/startup_report.hpp"
+#include "rune_detector/keypoint_flow.hpp"
 #include "rune_detector/rune_detector.hpp"
 
 namespace fyt::rune {
 class RuneDetectorNode : public rclcpp::Node {
 public:
   RuneDetectorNode(const rclcpp::NodeOptions &options);
+  ~RuneDetectorNode() override;
 
 private:
   std::unique_ptr<RuneDetector> initDetector();
 
   void imageCallback(const sensor_msgs::msg::Image::ConstSharedPtr img_msg);
+  void processImage(const sensor_msgs::msg::Image::ConstSharedPtr &img_msg);
   void inferResultCallback(std::vector<RuneObject> &rune_objects,
                            int64_t timestamp_nanosec,
                            const cv::Mat &img);
+  // Publish the keypoints propagated into the frame by the optical flow
+  void publishPropagated(const std::vector<cv::Point2f> &pts, int64_t timestamp_nanosec);
+  // With the optical flow the targets are published in the order of their frames, a result
+  // older than the last published one only anchors the flow.
+  // Return: true if a target of the frame may be published
+  bool claimStamp(int64_t timestamp_nanosec);
 
   void createDebugPublishers();
   void destroyDebugPublishers();
@@ -64,9 +80,15 @@ private:
 
   // Heartbeat
   HeartBeatPublisher::SharedPtr heartbeat_;
+  // Metrics reported with the heartbeat, registered at the end of the constructor
+  utils::LatencyHistogram *end_to_end_latency_ = nullptr;
+  std::atomic<int64_t> *dropped_frames_ = nullptr;
+  std::atomic<int64_t> *propagated_frames_ = nullptr;
 
   // Image subscription
   rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr img_sub_;
+  rclcpp::CallbackGroup::SharedPtr image_group_;
+  rclcpp::SubscriptionOptions image_sub_options_;
 
   //Target publisher
   std::string frame_id_;
@@ -77,21 +99,47 @@ private:
 
   // Rune detector
   int requests_limit_;
-  std::queue<std::future<bool>> detect_requests_;
   std::unique_ptr<RuneDetector> rune_detector_;
+  // The model is compiled in background, frames are dropped until it is ready
+  std::thread detector_init_thread_;
+  std::atomic<bool> detector_ready_{false};
+  // Frames submitted to the detector and the results of the inference, watched by watchdog_
+  std::atomic<int64_t> submitted_frames_{0};
+  std::atomic<int64_t> inferred_frames_{0};
+  // Construction and the detector compiled in the background, reported by the heartbeat
+  utils::StartupReport startup_;
+  void finishStartupStep(const std::string &step);
+  // Queue in the shared perception scheduler, -1 if frames are handled in the callback
+  int scheduler_queue_ = -1;
 
-  // Rune params
-  EnemyColor detect_color_;
-  bool is_rune_;
-  bool is_big_rune_;
+  // Optical flow of the keypoints between inferences, null if disabled
+  std::unique_ptr<KeypointFlow> keypoint_flow_;
+
+  // Crops of the detected runes, saved for retraining
+  std::unique_ptr<utils::SampleDumper> sample_dumper_;
+  // Frames since the last one sent to the inference, only used by the image thread
+  int frames_since_inference_ = 0;
+  std::atomic<int64_t> last_published_stamp_{0};
+
+  // Rune params, set by set_mode and read by the image and inference callbacks, which run in
+  // other threads
+  std::atomic<EnemyColor> detect_color_{EnemyColor::RED};
+  std::atomic<bool> is_rune_;
+  std::atomic<bool> is_big_rune_{false};
 
   // For R tag detection
   bool detect_r_tag_;
-  int binary_thresh_;
+  std::atomic<int> binary_thresh_;
 
   // Debug infomation
   bool debug_;
+  utils::DebugImageParams debug_image_params_;
   image_transport::Publisher result_img_pub_;
+  // Draws and publishes the result image, declared after the publisher it uses
+  std::unique_ptr<utils::DebugImageWorker> debug_worker_;
+
+  // Replaces the requests of the detector when the inference stalls, null if disabled
+  std::unique_ptr<utils::StallWatchdog> watchdog_;
 };
 }  // namespace fyt::rune
 #endif  // RUNE_DETECTOR_RUNE_DETECTOR_NODE_HPP_
@@ -0,0 +1,91 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "rune_detector/keypoint_flow.hpp"
+
+// std
+#include <algorithm>
+#include <numeric>
+// third party
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+namespace fyt::rune {
+
+void KeypointFlow::anchor(const cv::Mat &rgb_img,
+                          int64_t timestamp_nanosec,
+                          const std::vector<cv::Point2f> &pts) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  // Results of the requests may complete out of order
+  if (timestamp_nanosec <= anchor_stamp_) {
+    return;
+  }
+  anchor_stamp_ = timestamp_nanosec;
+  if (pts.empty()) {
+    tracking_ = false;
+    return;
+  }
+  // The next frame flows from this one, even if newer frames have been propagated meanwhile
+  cv::cvtColor(rgb_img, prev_gray_, cv::COLOR_RGB2GRAY);
+  prev_pts_ = pts;
+  last_stamp_ = timestamp_nanosec;
+  tracking_ = true;
+}
+
+bool KeypointFlow::propagate(const cv::Mat &rgb_img,
+                             int64_t timestamp_nanosec,
+                             std::vector<cv::Point2f> &pts) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!tracking_ || timestamp_nanosec <= last_stamp_ || rgb_img.size() != prev_gray_.size()) {
+    return false;
+  }
+
+  cv::cvtColor(rgb_img, gray_, cv::COLOR_RGB2GRAY);
+  cv::calcOpticalFlowPyrLK(prev_gray_,
+                           gray_,
+                           prev_pts_,
+                           next_pts_,
+                           status_,
+                           err_,
+                           cv::Size(params_.window_size, params_.window_size),
+                           params_.max_level);
+
+  const bool found =
+    std::all_of(status_.begin(), status_.end(), [](uchar s) { return s != 0; });
+  const double mean_error =
+    std::accumulate(err_.begin(), err_.end(), 0.0) / std::max<size_t>(err_.size(), 1);
+  if (!found || mean_error > params_.max_error) {
+    tracking_ = false;
+    return false;
+  }
+
+  std::swap(prev_gray_, gray_);
+  std::swap(prev_pts_, next_pts_);
+  last_stamp_ = timestamp_nanosec;
+  pts = prev_pts_;
+  return true;
+}
+
+bool KeypointFlow::tracking() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return tracking_;
+}
+
+void KeypointFlow::reset() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  tracking_ = false;
+}
+
+}  // namespace fyt::rune
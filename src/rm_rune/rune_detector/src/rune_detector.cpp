@@ -19,6 +19,7 @@
 #include "rune_detector/rune_detector.hpp"
 // std
 #include <algorithm>
+#include <chrono>
 #include <numeric>
 #include <unordered_map>
 // third party
@@ -37,30 +38,35 @@ static constexpr int NUM_POINTS = 5;
 static constexpr int NUM_POINTS_2 = 2 * NUM_POINTS;
 static constexpr float MERGE_CONF_ERROR = 0.15;
 static constexpr float MERGE_MIN_IOU = 0.9;
+// R tag tracking: tolerance on the R centers of the fans, in pixel and as a
+// ratio of the rune radius, the ROI size as a ratio of the rune radius, and the
+// frames to trust the fans before detecting again
+static constexpr float R_TAG_MIN_TOLERANCE = 3.0;
+static constexpr float R_TAG_TOLERANCE_RATIO = 0.05;
+static constexpr float R_TAG_ROI_RATIO = 0.8;
+static constexpr int R_TAG_MIN_ROI = 40;
+static constexpr int R_TAG_MAX_SKIP = 5;
 // 由于训练失误，网络的颜色是反的
 static std::unordered_map<int, EnemyColor> DNN_COLOR_TO_ENEMY_COLOR = {
     {0, EnemyColor::BLUE}, {1, EnemyColor::RED}};
 
-static cv::Mat letterbox(const cv::Mat &img, Eigen::Matrix3f &transform_matrix,
-                         std::vector<int> new_shape = {INPUT_W, INPUT_H}) {
+// Letterbox img into dst, an INPUT_W x INPUT_H u8 image that is reused between
+// frames. Only the padding is filled, the image is resized straight into dst
+static void letterbox(const cv::Mat &img, Eigen::Matrix3f &transform_matrix,
+                      cv::Mat &dst) {
   // Get current image shape [height, width]
 
   int img_h = img.rows;
   int img_w = img.cols;
 
   // Compute scale ratio(new / old) and target resized shape
-  float scale =
-      std::min(new_shape[1] * 1.0 / img_h, new_shape[0] * 1.0 / img_w);
+  float scale = std::min(INPUT_H * 1.0 / img_h, INPUT_W * 1.0 / img_w);
   int resize_h = static_cast<int>(round(img_h * scale));
   int resize_w = static_cast<int>(round(img_w * scale));
 
   // Compute padding
-  int pad_h = new_shape[1] - resize_h;
-  int pad_w = new_shape[0] - resize_w;
-
-  // Resize and pad image while meeting stride-multiple constraints
-  cv::Mat resized_img;
-  cv::resize(img, resized_img, cv::Size(resize_w, resize_h));
+  int pad_h = INPUT_H - resize_h;
+  int pad_w = INPUT_W - resize_w;
 
   // divide padding into 2 sides
   float half_h = pad_h * 1.0 / 2;
@@ -68,9 +74,7 @@ static cv::Mat letterbox(const cv::Mat &img, Eigen::Matrix3f &transform_matrix,
 
   // Compute padding boarder
   int top = static_cast<int>(round(half_h - 0.1));
-  int bottom = static_cast<int>(round(half_h + 0.1));
   int left = static_cast<int>(round(half_w - 0.1));
-  int right = static_cast<int>(round(half_w + 0.1));
 
   /* clang-format off */
   /* *INDENT-OFF* */
@@ -84,10 +88,18 @@ static cv::Mat letterbox(const cv::Mat &img, Eigen::Matrix3f &transform_matrix,
   /* clang-format on */
 
   // Add border
-  cv::copyMakeBorder(resized_img, resized_img, top, bottom, left, right,
-                     cv::BORDER_CONSTANT, cv::Scalar(114, 114, 114));
+  dst.create(INPUT_H, INPUT_W, CV_8UC3);
+  const cv::Scalar border(114, 114, 114);
+  const cv::Rect image_rect(left, top, resize_w, resize_h);
+  dst.rowRange(0, top).setTo(border);
+  dst.rowRange(top + resize_h, INPUT_H).setTo(border);
+  dst(cv::Rect(0, top, left, resize_h)).setTo(border);
+  dst(cv::Rect(left + resize_w, top, INPUT_W - left - resize_w, resize_h))
+      .setTo(border);
 
-  return resized_img;
+  // Resize and pad image while meeting stride-multiple constraints
+  cv::Mat resized_img = dst(image_rect);
+  cv::resize(img, resized_img, image_rect.size());
 }
 
 // Generate grids and stride for post processing
@@ -111,15 +123,20 @@ static void generateGridsAndStride(const int target_w, const int target_h,
 }
 
 // Decode output tensor
+// The objectness of every anchor is checked first on the raw rows, only the few
+// anchors above conf_threshold are decoded
 static void generateProposals(
-    std::vector<RuneObject> &output_objs, std::vector<float> &scores,
-    std::vector<cv::Rect> &rects, const cv::Mat &output_buffer,
+    std::vector<RuneObject> &output_objs, const cv::Mat &output_buffer,
     const Eigen::Matrix<float, 3, 3> &transform_matrix, float conf_threshold,
-    std::vector<GridAndStride> grid_strides) {
-  const int num_anchors = grid_strides.size();
+    const std::vector<GridAndStride> &grid_strides) {
+  const int num_anchors =
+      std::min(static_cast<int>(grid_strides.size()), output_buffer.rows);
+  const int row_step = output_buffer.step1();
+  const float *data = output_buffer.ptr<float>(0);
 
   for (int anchor_idx = 0; anchor_idx < num_anchors; anchor_idx++) {
-    float confidence = output_buffer.at<float>(anchor_idx, NUM_POINTS_2);
+    const float *row = data + anchor_idx * row_step;
+    const float confidence = row[NUM_POINTS_2];
     if (confidence < conf_threshold) {
       continue;
     }
@@ -128,68 +145,48 @@ static void generateProposals(
     const int grid1 = grid_strides[anchor_idx].grid1;
     const int stride = grid_strides[anchor_idx].stride;
 
-    double color_score, class_score;
-    cv::Point color_id, class_id;
-    cv::Mat color_scores =
-        output_buffer.row(anchor_idx)
-            .colRange(NUM_POINTS_2 + 1, NUM_POINTS_2 + 1 + NUM_COLORS);
-    cv::Mat num_scores =
-        output_buffer.row(anchor_idx)
-            .colRange(NUM_POINTS_2 + 1 + NUM_COLORS,
-                      NUM_POINTS_2 + 1 + NUM_COLORS + NUM_CLASSES);
     // Argmax
-    cv::minMaxLoc(color_scores, NULL, &color_score, NULL, &color_id);
-    cv::minMaxLoc(num_scores, NULL, &class_score, NULL, &class_id);
-
-    float x_1 = (output_buffer.at<float>(anchor_idx, 0) + grid0) * stride;
-    float y_1 = (output_buffer.at<float>(anchor_idx, 1) + grid1) * stride;
-    float x_2 = (output_buffer.at<float>(anchor_idx, 2) + grid0) * stride;
-    float y_2 = (output_buffer.at<float>(anchor_idx, 3) + grid1) * stride;
-    float x_3 = (output_buffer.at<float>(anchor_idx, 4) + grid0) * stride;
-    float y_3 = (output_buffer.at<float>(anchor_idx, 5) + grid1) * stride;
-    float x_4 = (output_buffer.at<float>(anchor_idx, 6) + grid0) * stride;
-    float y_4 = (output_buffer.at<float>(anchor_idx, 7) + grid1) * stride;
-    float x_5 = (output_buffer.at<float>(anchor_idx, 8) + grid0) * stride;
-    float y_5 = (output_buffer.at<float>(anchor_idx, 9) + grid1) * stride;
-
-    Eigen::Matrix<float, 3, 5> apex_norm;
-    Eigen::Matrix<float, 3, 5> apex_dst;
-
-    /* clang-format off */
-    /* *INDENT-OFF* */
-    apex_norm << x_1, x_2, x_3, x_4, x_5,
-                y_1, y_2, y_3, y_4, y_5,
-                1,   1,   1,   1,   1;
-    /* *INDENT-ON* */
-    /* clang-format on */
-
-    apex_dst = transform_matrix * apex_norm;
+    const float *color_scores = row + NUM_POINTS_2 + 1;
+    const float *num_scores = color_scores + NUM_COLORS;
+    const int color_id =
+        std::max_element(color_scores, color_scores + NUM_COLORS) -
+        color_scores;
+    const int class_id =
+        std::max_element(num_scores, num_scores + NUM_CLASSES) - num_scores;
+
+    // Grid to input image, then input image to source image
+    cv::Point2f apex[NUM_POINTS];
+    for (int i = 0; i < NUM_POINTS; i++) {
+      const float x = (row[2 * i] + grid0) * stride;
+      const float y = (row[2 * i + 1] + grid1) * stride;
+      apex[i].x = transform_matrix(0, 0) * x + transform_matrix(0, 1) * y +
+                  transform_matrix(0, 2);
+      apex[i].y = transform_matrix(1, 0) * x + transform_matrix(1, 1) * y +
+                  transform_matrix(1, 2);
+    }
 
     RuneObject obj;
 
-    obj.pts.r_center = cv::Point2f(apex_dst(0, 0), apex_dst(1, 0));
-    obj.pts.bottom_left = cv::Point2f(apex_dst(0, 1), apex_dst(1, 1));
-    obj.pts.top_left = cv::Point2f(apex_dst(0, 2), apex_dst(1, 2));
-    obj.pts.top_right = cv::Point2f(apex_dst(0, 3), apex_dst(1, 3));
-    obj.pts.bottom_right = cv::Point2f(apex_dst(0, 4), apex_dst(1, 4));
+    obj.pts.r_center = apex[0];
+    obj.pts.bottom_left = apex[1];
+    obj.pts.top_left = apex[2];
+    obj.pts.top_right = apex[3];
+    obj.pts.bottom_right = apex[4];
 
-    auto rect = cv::boundingRect(obj.pts.toVector2f());
-
-    obj.box = rect;
-    obj.color = DNN_COLOR_TO_ENEMY_COLOR[color_id.x];
-    obj.type = static_cast<RuneType>(class_id.x);
+    obj.box = cv::boundingRect(obj.pts.toVector2f());
+    obj.color = DNN_COLOR_TO_ENEMY_COLOR[color_id];
+    obj.type = static_cast<RuneType>(class_id);
     obj.prob = confidence;
 
-    rects.push_back(rect);
-    scores.push_back(confidence);
     output_objs.push_back(std::move(obj));
   }
 }
 
-// Calculate intersection area between Object a and Object b.
-static inline float intersectionArea(const RuneObject &a, const RuneObject &b) {
-  cv::Rect_<float> inter = a.box & b.box;
-  return inter.area();
+// Calculate intersection area between box a and box b.
+static inline float intersectionArea(const cv::Rect &a, const cv::Rect &b) {
+  const int w = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+  const int h = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+  return w > 0 && h > 0 ? static_cast<float>(w) * h : 0.f;
 }
 
 static void nmsMergeSortedBboxes(std::vector<RuneObject> &faceobjects,
@@ -208,12 +205,17 @@ static void nmsMergeSortedBboxes(std::vector<RuneObject> &faceobjects,
     RuneObject &a = faceobjects[i];
 
     int keep = 1;
-    for (size_t j = 0; j < indices.size(); j++) {
-      RuneObject &b = faceobjects[indices[j]];
+    // Every kept box is visited, a suppressed box may still be merged into it
+    for (int j : indices) {
+      RuneObject &b = faceobjects[j];
 
       // intersection over union
-      float inter_area = intersectionArea(a, b);
-      float union_area = areas[i] + areas[indices[j]] - inter_area;
+      float inter_area = intersectionArea(a.box, b.box);
+      float union_area = areas[i] + areas[j] - inter_area;
+      // Disjoint boxes, only an empty union (nan iou) suppresses
+      if (inter_area == 0 && union_area > 0) {
+        continue;
+      }
       float iou = inter_area / union_area;
       if (iou > nms_threshold || isnan(iou)) {
         keep = 0;
@@ -222,7 +224,6 @@ static void nmsMergeSortedBboxes(std::vector<RuneObject> &faceobjects,
             abs(a.prob - b.prob) < MERGE_CONF_ERROR) {
           a.pts.children.push_back(b.pts);
         }
-        // cout<<b.pts_x.size()<<endl;
       }
     }
 
@@ -243,92 +244,459 @@ RuneDetector::RuneDetector(const std::filesystem::path &model_path,
   }
 }
 
-void RuneDetector::init() {
+RuneDetector::InitProfile RuneDetector::init(int max_requests,
+                                             const std::string &cache_dir,
+                                             int batch_size,
+                                             double batch_timeout_ms) {
+  using Clock = std::chrono::steady_clock;
+  auto elapsed_ms = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  InitProfile profile;
+
   if (ov_core_ == nullptr) {
     ov_core_ = std::make_unique<ov::Core>();
   }
+  if (!cache_dir.empty()) {
+    ov_core_->set_property(ov::cache_dir(cache_dir));
+  }
 
+  auto start = Clock::now();
   auto model = ov_core_->read_model(model_path_);
+  // A quantized model runs in INT8 as it is, only tell it apart
+  for (const auto &op : model->get_ops()) {
+    if (std::string(op->get_type_name()) == "FakeQuantize") {
+      profile.quantized = true;
+      break;
+    }
+  }
 
-  // Set infer type
+  // Let the model take the letterboxed u8 RGB image as it is: RGB->BGR,
+  // u8(0-255)->f32(0.0-1.0), NHWC->NCHW run inside the compiled model
+  // note: TUP's model no need to normalize
   ov::preprocess::PrePostProcessor ppp(model);
-  // Set input output precision
-  auto elem_type = device_name_ == "GPU" ? ov::element::f16 : ov::element::f32;
+  ppp.input()
+      .tensor()
+      .set_element_type(ov::element::u8)
+      .set_layout("NHWC")
+      .set_color_format(ov::preprocess::ColorFormat::RGB);
+  ppp.input()
+      .preprocess()
+      .convert_color(ov::preprocess::ColorFormat::BGR)
+      .convert_element_type(ov::element::f32);
+  ppp.input().model().set_layout("NCHW");
+  // The output is parsed as f32
+  ppp.output().tensor().set_element_type(ov::element::f32);
+  model = ppp.build();
+  // Up to batch_size frames in one inference, the request takes as many as it has
+  batch_size = std::max(batch_size, 1);
+  if (batch_size > 1) {
+    model->reshape(
+        ov::PartialShape{ov::Dimension(1, batch_size), INPUT_H, INPUT_W, 3});
+  }
+  profile.read_ms = elapsed_ms(start);
+
+  // Set infer type
   auto perf_mode =
       device_name_ == "GPU"
           ? ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT)
           : ov::hint::performance_mode(ov::hint::PerformanceMode::LATENCY);
-  ppp.input().tensor().set_element_type(elem_type);
-  ppp.output().tensor().set_element_type(elem_type);
 
-  // Compile model
+  // Wait for the requests of the last model
+  std::unique_lock<std::mutex> batch_lock(batch_mtx_);
+  closeBatch();
+  std::unique_lock<std::mutex> lock(mtx_);
+  slot_cv_.wait(lock, [this] { return free_slots_.size() == slots_.size(); });
+  slots_.clear();
+  free_slots_.clear();
+  batch_size_ = batch_size;
+  batch_timeout_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::milli>(batch_timeout_ms));
+
+  // Compile model, loaded from cache_dir if it was compiled before
+  start = Clock::now();
   compiled_model_ = std::make_unique<ov::CompiledModel>(
       ov_core_->compile_model(model, device_name_, perf_mode));
+  profile.compile_ms = elapsed_ms(start);
+
+  // Create the requests once, as many as the device can run in parallel
+  uint32_t requests_num = std::max<uint32_t>(
+      1, compiled_model_->get_property(ov::optimal_number_of_infer_requests));
+  if (max_requests > 0) {
+    requests_num = std::min<uint32_t>(requests_num, max_requests);
+  }
+  for (uint32_t i = 0; i < requests_num; i++) {
+    auto slot = createSlot();
+    // Run once before the callback is set, the first inference of a request
+    // pays for the lazy allocations, do it here instead of on the first frame
+    // after switching to the rune mode. A full batch, the largest shape
+    start = Clock::now();
+    slot->request.infer();
+    if (i == 0) {
+      profile.first_infer_ms = elapsed_ms(start);
+    }
+    setSlotCallback(i, *slot);
+    slots_.emplace_back(std::move(slot));
+    free_slots_.push_back(i);
+  }
 
   strides_ = {8, 16, 32};
+  grid_strides_.clear();
   generateGridsAndStride(INPUT_W, INPUT_H, strides_, grid_strides_);
+  profile.requests = requests_num;
+  profile.batch_size = batch_size_;
+  lock.unlock();
+
+  if (batch_size_ > 1 && !batch_timer_.joinable()) {
+    batch_timer_ = std::thread(&RuneDetector::batchTimerLoop, this);
+  }
+  return profile;
+}
+
+std::unique_ptr<RuneDetector::InferSlot> RuneDetector::createSlot() {
+  auto slot = std::make_unique<InferSlot>();
+  slot->request = compiled_model_->create_infer_request();
+  slot->input_img = cv::Mat(batch_size_ * INPUT_H, INPUT_W, CV_8UC3,
+                            cv::Scalar(114, 114, 114));
+  slot->frames.reserve(batch_size_);
+  slot->request.set_input_tensor(ov::Tensor(
+      ov::element::u8,
+      ov::Shape(std::vector<size_t>{static_cast<size_t>(batch_size_), INPUT_H,
+                                    INPUT_W, 3}),
+      slot->input_img.data));
+  return slot;
+}
+
+void RuneDetector::setSlotCallback(size_t index, InferSlot &slot) {
+  slot.request.set_callback([this, index, slot = &slot](std::exception_ptr ex) {
+    onInferComplete(index, slot, ex);
+  });
+}
+
+size_t RuneDetector::resetRequests() {
+  std::lock_guard<std::mutex> batch_lock(batch_mtx_);
+  closeBatch();
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (compiled_model_ == nullptr) {
+    return 0;
+  }
+  std::vector<bool> is_free(slots_.size(), false);
+  for (size_t index : free_slots_) {
+    is_free[index] = true;
+  }
+  size_t replaced = 0;
+  for (size_t i = 0; i < slots_.size(); i++) {
+    if (is_free[i]) {
+      continue;
+    }
+    try {
+      slots_[i]->request.cancel();
+    } catch (const std::exception &) {
+      // A request of a lost device may not even be cancelled, it is replaced all the same
+    }
+    // Kept alive, the request may still complete into its old slot
+    retired_slots_.emplace_back(std::move(slots_[i]));
+    slots_[i] = createSlot();
+    setSlotCallback(i, *slots_[i]);
+    free_slots_.push_back(i);
+    replaced++;
+  }
+  // The waiting frame is stale by now
+  has_pending_ = false;
+  pending_ = PendingFrame{};
+  slot_cv_.notify_all();
+  return replaced;
+}
+
+RuneDetector::~RuneDetector() {
+  {
+    std::lock_guard<std::mutex> batch_lock(batch_mtx_);
+    stop_batch_timer_ = true;
+    closeBatch();
+  }
+  batch_cv_.notify_all();
+  if (batch_timer_.joinable()) {
+    batch_timer_.join();
+  }
+  std::unique_lock<std::mutex> lock(mtx_);
+  has_pending_ = false;
+  slot_cv_.wait(lock, [this] { return free_slots_.size() == slots_.size(); });
 }
 
 std::future<bool> RuneDetector::pushInput(const cv::Mat &rgb_img,
                                           int64_t timestamp_nanosec) {
+  // return false when img is empty or the detector is not initialized
+  auto failed = [] {
+    std::promise<bool> empty;
+    empty.set_value(false);
+    return empty.get_future();
+  };
+  if (rgb_img.empty()) {
+    return failed();
+  }
+
+  // Take a free request
+  InferSlot *slot;
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (slots_.empty()) {
+      return failed();
+    }
+    slot_cv_.wait(lock, [this] { return !free_slots_.empty(); });
+    slot = slots_[free_slots_.back()].get();
+    free_slots_.pop_back();
+  }
+  slot->promise = std::promise<bool>();
+  std::future<bool> result = slot->promise.get_future();
+  startRequest(*slot, rgb_img, timestamp_nanosec, nullptr);
+  return result;
+}
+
+void RuneDetector::submitInput(const cv::Mat &rgb_img,
+                               int64_t timestamp_nanosec,
+                               std::shared_ptr<const void> owner) {
   if (rgb_img.empty()) {
-    // return false when img is empty
-    return std::async([]() { return false; });
+    return;
+  }
+  if (batch_size_ > 1) {
+    addToBatch(rgb_img, timestamp_nanosec, std::move(owner));
+    return;
   }
 
+  InferSlot *slot;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (slots_.empty()) {
+      return;
+    }
+    if (free_slots_.empty()) {
+      // Started by the next finished request
+      pending_ = PendingFrame{rgb_img, timestamp_nanosec, std::move(owner)};
+      has_pending_ = true;
+      return;
+    }
+    slot = slots_[free_slots_.back()].get();
+    free_slots_.pop_back();
+  }
+  // Nobody waits for the future
+  slot->promise = std::promise<bool>();
+  startRequest(*slot, rgb_img, timestamp_nanosec, std::move(owner));
+}
+
+void RuneDetector::startRequest(InferSlot &slot,
+                                const cv::Mat &rgb_img,
+                                int64_t timestamp_nanosec,
+                                std::shared_ptr<const void> owner) {
+  slot.frames.clear();
+  addFrame(slot, rgb_img, timestamp_nanosec, std::move(owner));
+  runSlot(slot);
+}
+
+void RuneDetector::addFrame(InferSlot &slot, const cv::Mat &rgb_img,
+                            int64_t timestamp_nanosec,
+                            std::shared_ptr<const void> owner) {
   // Reprocess
-  Eigen::Matrix3f
-      transform_matrix; // transform matrix from resized image to source image.
-  cv::Mat resized_img = letterbox(rgb_img, transform_matrix);
+  // transform matrix from resized image to source image.
+  SlotFrame &frame = slot.frames.emplace_back();
+  const int row = static_cast<int>(slot.frames.size() - 1) * INPUT_H;
+  cv::Mat input_img = slot.input_img.rowRange(row, row + INPUT_H);
+  letterbox(rgb_img, frame.transform_matrix, input_img);
+  frame.timestamp_nanosec = timestamp_nanosec;
+  frame.src_img = rgb_img;
+  frame.owner = std::move(owner);
+}
+
+void RuneDetector::runSlot(InferSlot &slot) {
+  // Feed the u8 images into input, the tensor shares the buffer of the images
+  slot.request.set_input_tensor(ov::Tensor(
+      ov::element::u8,
+      ov::Shape(std::vector<size_t>{slot.frames.size(), INPUT_H, INPUT_W, 3}),
+      slot.input_img.data));
 
   // Start async detect
-  return std::async(std::launch::async, &RuneDetector::processCallback, this,
-                    resized_img, transform_matrix, timestamp_nanosec, rgb_img);
+  slot.request.start_async();
+}
+
+void RuneDetector::addToBatch(const cv::Mat &rgb_img,
+                              int64_t timestamp_nanosec,
+                              std::shared_ptr<const void> owner) {
+  std::lock_guard<std::mutex> batch_lock(batch_mtx_);
+  if (stop_batch_timer_) {
+    return;
+  }
+  if (open_slot_ < 0) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (free_slots_.empty()) {
+        // Opens the next batch once a request finishes
+        pending_ = PendingFrame{rgb_img, timestamp_nanosec, std::move(owner)};
+        has_pending_ = true;
+        return;
+      }
+      open_slot_ = static_cast<int>(free_slots_.back());
+      open_batch_ = slots_[open_slot_].get();
+      free_slots_.pop_back();
+    }
+    // Nobody waits for the future
+    open_batch_->promise = std::promise<bool>();
+    open_batch_->frames.clear();
+    open_since_ = std::chrono::steady_clock::now();
+    batch_id_++;
+    batch_cv_.notify_all();
+  }
+
+  InferSlot &slot = *open_batch_;
+  addFrame(slot, rgb_img, timestamp_nanosec, std::move(owner));
+  if (slot.frames.size() >= static_cast<size_t>(batch_size_)) {
+    flushBatch();
+  }
+}
+
+void RuneDetector::flushBatch() {
+  if (open_slot_ < 0) {
+    return;
+  }
+  InferSlot &slot = *open_batch_;
+  open_slot_ = -1;
+  open_batch_ = nullptr;
+  runSlot(slot);
+}
+
+void RuneDetector::closeBatch() {
+  if (open_slot_ < 0) {
+    return;
+  }
+  open_batch_->frames.clear();
+  std::lock_guard<std::mutex> lock(mtx_);
+  free_slots_.push_back(static_cast<size_t>(open_slot_));
+  open_slot_ = -1;
+  open_batch_ = nullptr;
+  slot_cv_.notify_all();
+}
+
+void RuneDetector::batchTimerLoop() {
+  std::unique_lock<std::mutex> batch_lock(batch_mtx_);
+  while (!stop_batch_timer_) {
+    batch_cv_.wait(batch_lock,
+                   [this] { return stop_batch_timer_ || open_slot_ >= 0; });
+    if (stop_batch_timer_) {
+      break;
+    }
+    // Until the batch is started full, or it is old enough
+    const uint64_t id = batch_id_;
+    if (!batch_cv_.wait_until(
+            batch_lock, open_since_ + batch_timeout_, [this, id] {
+              return stop_batch_timer_ || open_slot_ < 0 || batch_id_ != id;
+            })) {
+      flushBatch();
+    }
+  }
 }
 
 void RuneDetector::setCallback(CallbackType callback) {
   infer_callback_ = callback;
 }
 
-bool RuneDetector::processCallback(const cv::Mat resized_img,
-                                   Eigen::Matrix3f transform_matrix,
-                                   int64_t timestamp_nanosec,
-                                   const cv::Mat &src_img) {
-  // BGR->RGB, u8(0-255)->f32(0.0-1.0), HWC->NCHW
-  // note: TUP's model no need to normalize
-  cv::Mat blob = cv::dnn::blobFromImage(
-      resized_img, 1., cv::Size(INPUT_W, INPUT_H), cv::Scalar(0, 0, 0), true);
-
-  // Feed blob into input
-  auto input_port = compiled_model_->input();
-  ov::Tensor input_tensor(
-      input_port.get_element_type(),
-      ov::Shape(std::vector<size_t>{1, 3, INPUT_W, INPUT_H}), blob.ptr(0));
+void RuneDetector::onInferComplete(size_t index, InferSlot *slot_ptr,
+                                   std::exception_ptr ex) {
+  {
+    // The late completion of a request replaced by resetRequests()
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!isCurrentSlot(index, slot_ptr)) {
+      return;
+    }
+  }
+  InferSlot &slot = *slot_ptr;
+  bool success = false;
+  if (ex == nullptr) {
+    // The frames of a batch in order
+    const ov::Tensor output = slot.request.get_output_tensor();
+    success = true;
+    for (size_t i = 0; i < slot.frames.size(); i++) {
+      const SlotFrame &frame = slot.frames[i];
+      success &= processOutput(output, i, frame.transform_matrix,
+                               frame.timestamp_nanosec, frame.src_img);
+    }
+  }
+  slot.frames.clear();
+  std::promise<bool> promise = std::move(slot.promise);
+
+  // In the batch mode the request is given back, the waiting frame opens a new
+  // batch
+  if (batch_size_ > 1) {
+    bool has_next = false;
+    PendingFrame next;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      // A reset meanwhile gave the index back with a new slot already
+      if (isCurrentSlot(index, slot_ptr)) {
+        free_slots_.push_back(index);
+      }
+      slot_cv_.notify_all();
+      if (has_pending_) {
+        next = std::move(pending_);
+        pending_ = PendingFrame{};
+        has_pending_ = false;
+        has_next = true;
+      }
+    }
+    promise.set_value(success);
+    if (has_next) {
+      addToBatch(next.img, next.timestamp_nanosec, std::move(next.owner));
+    }
+    return;
+  }
 
-  // Start inference
-  // Lock because of the thread race condition within the openvino library
-  mtx_.lock();
-  auto infer_request = compiled_model_->create_infer_request();
-  infer_request.set_input_tensor(input_tensor);
-  infer_request.infer();
-  mtx_.unlock();
+  // Run the waiting frame on this request, or give the request back. Notify
+  // under the lock so that the destructor can not return before this
+  bool has_next = false;
+  PendingFrame next;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!isCurrentSlot(index, slot_ptr)) {
+      // Replaced by a reset meanwhile, the index is free with a new slot
+      slot_cv_.notify_all();
+    } else if (has_pending_) {
+      next = std::move(pending_);
+      pending_ = PendingFrame{};
+      has_pending_ = false;
+      has_next = true;
+    } else {
+      free_slots_.push_back(index);
+      slot_cv_.notify_all();
+    }
+  }
+  promise.set_value(success);
 
-  auto output = infer_request.get_output_tensor();
+  if (has_next) {
+    // On the slot of this completion, which is not free. Replaced by a reset before it starts,
+    // its completion is ignored like any late one
+    slot.promise = std::promise<bool>();
+    startRequest(slot, next.img, next.timestamp_nanosec, std::move(next.owner));
+  }
+}
 
+bool RuneDetector::processOutput(const ov::Tensor &output,
+                                 size_t batch_index,
+                                 const Eigen::Matrix3f &transform_matrix,
+                                 int64_t timestamp_nanosec,
+                                 const cv::Mat &src_img) {
   // Process output data
   auto output_shape = output.get_shape();
-  // 3549 x 21 Matrix
-  cv::Mat output_buffer(output_shape[1], output_shape[2], CV_32F,
-                        output.data());
+  // 3549 x 21 Matrix of each frame
+  const size_t frame_size = output_shape[1] * output_shape[2];
+  cv::Mat output_buffer(
+      output_shape[1], output_shape[2], CV_32F,
+      static_cast<float *>(const_cast<void *>(output.data())) +
+          batch_index * frame_size);
 
   // Parsed variable
   std::vector<RuneObject> objs_tmp, objs_result;
-  std::vector<cv::Rect> rects;
-  std::vector<float> scores;
   std::vector<int> indices;
 
   // Parse YOLO output
-  generateProposals(objs_tmp, scores, rects, output_buffer, transform_matrix,
+  generateProposals(objs_tmp, output_buffer, transform_matrix,
                     this->conf_threshold_, this->grid_strides_);
 
   // TopK
@@ -354,14 +722,6 @@ bool RuneDetector::processCallback(const cv::Mat resized_img,
     }
   }
 
-  // NMS & TopK
-  // cv::dnn::NMSBoxes(
-  //   rects, scores, this->conf_threshold_, this->nms_threshold_, indices, 1.0,
-  //   this->top_k_);
-  // for (size_t i = 0; i < indices.size(); ++i) {
-  //   objs_result.push_back(std::move(objs_tmp[i]));
-  // }
-
   // Call callback function
   if (this->infer_callback_) {
     this->infer_callback_(objs_result, timestamp_nanosec, src_img);
@@ -378,8 +738,81 @@ RuneDetector::detectRTag(const cv::Mat &img, int binary_thresh,
     return {prior, cv::Mat::zeros(cv::Size(200, 200), CV_8UC3)};
   }
 
+  cv::Point2f center;
+  cv::Mat binary_img;
+  if (!findRTag(img, prior, 200, center, &binary_img)) {
+    return {prior, binary_img};
+  }
+  return {center, binary_img};
+}
+
+std::tuple<cv::Point2f, cv::Mat>
+RuneDetector::trackRTag(const cv::Mat &img, int binary_thresh,
+                        const std::vector<RuneObject> &objs, bool draw_debug) {
+  // Prior: the average R center of the fans, and how far the fans spread
+  cv::Point2f prior(0, 0);
+  for (const auto &obj : objs) {
+    prior += obj.pts.r_center / static_cast<float>(objs.size());
+  }
+  float spread = 0;
+  for (const auto &obj : objs) {
+    spread = std::max(spread,
+                      static_cast<float>(cv::norm(obj.pts.r_center - prior)));
+  }
+  // Rune radius in pixel, from the R center to the armor center of a fan
+  const auto &pts = objs.front().pts;
+  const cv::Point2f armor_center =
+      (pts.bottom_left + pts.top_left + pts.top_right + pts.bottom_right) / 4;
+  const float radius = static_cast<float>(cv::norm(armor_center - prior));
+  const float tolerance =
+      std::max(R_TAG_TOLERANCE_RATIO * radius, R_TAG_MIN_TOLERANCE);
+
+  std::lock_guard<std::mutex> lock(r_tag_mtx_);
+  const cv::Point2f predicted =
+      has_r_tag_ ? prior + r_tag_offset_ : prior;
+
+  // The fans agree with each other and with the last R tag, keep its offset
+  // from the prior without looking at the image, detect again every few frames
+  // to refresh the offset
+  if (has_r_tag_ && objs.size() > 1 && spread < tolerance &&
+      cv::norm(predicted - last_r_tag_) < tolerance &&
+      r_tag_skipped_ < R_TAG_MAX_SKIP) {
+    r_tag_skipped_++;
+    return {predicted, cv::Mat()};
+  }
+
+  if (predicted.x < 0 || predicted.x > img.cols || predicted.y < 0 ||
+      predicted.y > img.rows) {
+    has_r_tag_ = false;
+    return {prior, cv::Mat()};
+  }
+
+  // The R tag is small compared with the radius, the ROI shrinks while it is
+  // tracked
+  const int roi_size =
+      has_r_tag_ ? std::clamp(static_cast<int>(R_TAG_ROI_RATIO * radius),
+                              R_TAG_MIN_ROI, 200)
+                 : 200;
+  cv::Point2f center;
+  cv::Mat binary_img;
+  if (!findRTag(img, predicted, roi_size, center,
+                draw_debug ? &binary_img : nullptr)) {
+    has_r_tag_ = false;
+    return {prior, binary_img};
+  }
+  has_r_tag_ = true;
+  last_r_tag_ = center;
+  r_tag_offset_ = center - prior;
+  r_tag_skipped_ = 0;
+  return {center, binary_img};
+}
+
+bool RuneDetector::findRTag(const cv::Mat &img, const cv::Point2f &prior,
+                            int roi_size, cv::Point2f &center,
+                            cv::Mat *binary_img) {
   // Create ROI
-  cv::Rect roi = cv::Rect(prior.x - 100, prior.y - 100, 200, 200) &
+  cv::Rect roi = cv::Rect(prior.x - roi_size / 2, prior.y - roi_size / 2,
+                          roi_size, roi_size) &
                  cv::Rect(0, 0, img.cols, img.rows);
   const cv::Point2f prior_in_roi = prior - cv::Point2f(roi.tl());
 
@@ -388,16 +821,15 @@ RuneDetector::detectRTag(const cv::Mat &img, int binary_thresh,
   // Gray -> Binary -> Dilate
   cv::Mat gray_img;
   cv::cvtColor(img_roi, gray_img, cv::COLOR_BGR2GRAY);
-  cv::Mat binary_img;
-  cv::threshold(gray_img, binary_img, 0, 255,
-                cv::THRESH_BINARY | cv::THRESH_OTSU);
-  cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-  cv::dilate(binary_img, binary_img, kernel);
+  cv::Mat binary;
+  cv::threshold(gray_img, binary, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+  static const cv::Mat kernel =
+      cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+  cv::dilate(binary, binary, kernel);
 
   // Find contours
   std::vector<std::vector<cv::Point>> contours;
-  cv::findContours(binary_img, contours, cv::RETR_EXTERNAL,
-                   cv::CHAIN_APPROX_NONE);
+  cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
 
   auto it = std::find_if(
       contours.begin(), contours.end(),
@@ -406,21 +838,23 @@ RuneDetector::detectRTag(const cv::Mat &img, int binary_thresh,
       });
 
   // For visualization
-  cv::cvtColor(binary_img, binary_img, cv::COLOR_GRAY2BGR);
+  if (binary_img) {
+    cv::cvtColor(binary, *binary_img, cv::COLOR_GRAY2BGR);
+  }
 
   if (it == contours.end()) {
-    return {prior, binary_img};
+    return false;
   }
 
-  cv::drawContours(binary_img, contours, it - contours.begin(),
-                   cv::Scalar(0, 255, 0), 2);
+  if (binary_img) {
+    cv::drawContours(*binary_img, contours, it - contours.begin(),
+                     cv::Scalar(0, 255, 0), 2);
+  }
 
-  cv::Point2f center =
-      std::accumulate(it->begin(), it->end(), cv::Point(0, 0));
+  center = std::accumulate(it->begin(), it->end(), cv::Point(0, 0));
   center /= static_cast<float>(it->size());
   center += cv::Point2f(roi.tl());
-
-  return {center, binary_img};
+  return true;
 }
 
 } // namespace fyt::rune
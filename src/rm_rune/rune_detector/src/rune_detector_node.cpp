@@ -23,13 +23,19 @@
 #include <array>
 #include <filesystem>
 #include <numeric>
+#include <thread>
 #include <vector>
 // third party
 #include <opencv2/imgproc.hpp>
 // project
 #include "rm_utils/assert.hpp"
+#include "rm_utils/bayer.hpp"
 #include "rm_utils/common.hpp"
+#include "rm_utils/debug_image.hpp"
 #include "rm_utils/logger/log.hpp"
+#include "rm_utils/opencv_config.hpp"
+#include "rm_utils/stall_watchdog.hpp"
+#include "rm_utils/trace.hpp"
 #include "rm_utils/url_resolver.hpp"
 #include "rune_detector/types.hpp"
 
@@ -38,27 +44,59 @@ RuneDetectorNode::RuneDetectorNode(const rclcpp::NodeOptions &options)
 : Node("rune_detector", options), is_rune_(false) {
   FYT_REGISTER_LOGGER("rune_detector", "~/fyt2024-log", INFO);
   FYT_INFO("rune_detector", "Starting RuneDetectorNode!");
+  startup_.begin("constructor");
+  FYT_INFO("rune_detector",
+           "OpenCV: {}",
+           utils::applyOpenCVConfig(utils::declareOpenCVConfig(*this)));
 
   frame_id_ = declare_parameter("frame_id", "camera_optical_frame");
   detect_r_tag_ = declare_parameter("detect_r_tag", true);
   binary_thresh_ = declare_parameter("min_lightness", 100);
   requests_limit_ = declare_parameter("requests_limit", 5);
 
+  // Optical flow of the keypoints between inferences
+  KeypointFlow::Params flow_params;
+  flow_params.enable = declare_parameter("flow.enable", false);
+  flow_params.reanchor_interval = declare_parameter("flow.reanchor_interval", 3);
+  flow_params.max_error = declare_parameter("flow.max_error", flow_params.max_error);
+  flow_params.window_size = declare_parameter("flow.window_size", flow_params.window_size);
+  flow_params.max_level = declare_parameter("flow.max_level", flow_params.max_level);
+  if (flow_params.enable) {
+    keypoint_flow_ = std::make_unique<KeypointFlow>(flow_params);
+  }
+
   // Detector
   rune_detector_ = initDetector();
+  // Shared perception scheduler, the rune mode is inactive at startup
+  if (declare_parameter("scheduler.enable", false)) {
+    const int64_t threads = declare_parameter("scheduler.threads", 0);
+    auto &scheduler =
+      utils::PerceptionScheduler::instance(static_cast<size_t>(std::max<int64_t>(threads, 0)));
+    scheduler_queue_ = scheduler.addQueue("rune_detector", 1, 0);
+  }
   // Rune Publisher
   rune_pub_ = this->create_publisher<rm_interfaces::msg::RuneTarget>("rune_detector/rune_target",
                                                                      rclcpp::SensorDataQoS());
 
   // Debug Publishers
   this->debug_ = declare_parameter("debug", true);
+  debug_image_params_ = utils::declareDebugImageParams(*this, "debug_image");
   if (this->debug_) {
     createDebugPublishers();
   }
+  // Training samples, written by a background thread
+  sample_dumper_ = utils::declareSampleDumper(*this);
+  // Frames get a callback group of their own, so that set_mode never delays them with a
+  // multi-threaded executor
+  image_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  image_sub_options_.callback_group = image_group_;
   auto qos = rclcpp::SensorDataQoS();
   qos.keep_last(1);
   img_sub_ = this->create_subscription<sensor_msgs::msg::Image>(
-    "image_raw", qos, std::bind(&RuneDetectorNode::imageCallback, this, std::placeholders::_1));
+    "image_raw",
+    qos,
+    std::bind(&RuneDetectorNode::imageCallback, this, std::placeholders::_1),
+    image_sub_options_);
   set_rune_mode_srv_ = this->create_service<rm_interfaces::srv::SetMode>(
     "rune_detector/set_mode",
     std::bind(
@@ -66,18 +104,75 @@ RuneDetectorNode::RuneDetectorNode(const rclcpp::NodeOptions &options)
 
   // Heartbeat
   heartbeat_ = HeartBeatPublisher::create(this);
+  auto &metrics = heartbeat_->metrics();
+  end_to_end_latency_ = &metrics.latency("end_to_end");
+  dropped_frames_ = &metrics.counter("dropped_frames");
+  propagated_frames_ = &metrics.counter("propagated_frames");
+  startup_.attach(metrics);
+
+  // Watchdog, hung requests (e.g. a GPU that stopped answering) are replaced by new ones of the
+  // compiled model
+  const int64_t watchdog_timeout_ms = declare_parameter("watchdog.timeout_ms", 500);
+  watchdog_ = utils::declareStallWatchdog(*this, metrics);
+  if (watchdog_ != nullptr) {
+    utils::StallWatchdog::Stage stage;
+    stage.name = "rune_infer";
+    stage.progress = &inferred_frames_;
+    stage.demand = &submitted_frames_;
+    stage.timeout = std::chrono::milliseconds(std::max<int64_t>(watchdog_timeout_ms, 50));
+    stage.recover = [this]() {
+      const size_t replaced = rune_detector_->resetRequests();
+      FYT_WARN("rune_detector", "Inference stalled, {} requests replaced", replaced);
+    };
+    watchdog_->watch(std::move(stage));
+  }
+  finishStartupStep("constructor");
+}
+
+void RuneDetectorNode::finishStartupStep(const std::string &step) {
+  if (startup_.finish(step)) {
+    FYT_INFO("rune_detector", "Startup {}", startup_.summary());
+  }
+}
+
+RuneDetectorNode::~RuneDetectorNode() {
+  // Its recovery uses the detector
+  watchdog_.reset();
+  // No frame may reach the detector once it is being destroyed
+  if (scheduler_queue_ >= 0) {
+    utils::PerceptionScheduler::instance().removeQueue(scheduler_queue_);
+  }
+  if (detector_init_thread_.joinable()) {
+    detector_init_thread_.join();
+  }
 }
 
 std::unique_ptr<RuneDetector> RuneDetectorNode::initDetector() {
   std::string model_path =
     this->declare_parameter("detector.model", "package://rune_detector/model/yolox_rune_3.6m.onnx");
+  // The INT8 model replaces detector.model if selected
+  std::string precision = this->declare_parameter("detector.precision", std::string("fp32"));
+  std::string int8_model_path = this->declare_parameter(
+    "detector.int8_model", std::string("package://rune_detector/model/yolox_rune_3.6m_int8.xml"));
+  if (precision == "int8") {
+    model_path = int8_model_path;
+  } else if (precision != "fp32") {
+    FYT_WARN("rune_detector", "Unknown precision {}, use fp32", precision);
+    precision = "fp32";
+  }
   std::string device_type = this->declare_parameter("detector.device_type", "AUTO");
+  std::string cache_dir =
+    this->declare_parameter("detector.cache_dir", std::string("/tmp/fyt_model_cache"));
   FYT_ASSERT(!model_path.empty());
-  FYT_INFO("rune_detector", "model : {}, device : {}", model_path, device_type);
+  FYT_INFO(
+    "rune_detector", "model : {}, device : {}, precision : {}", model_path, device_type, precision);
 
   float conf_threshold = this->declare_parameter("detector.confidence_threshold", 0.50);
   int top_k = this->declare_parameter("detector.top_k", 128);
   float nms_threshold = this->declare_parameter("detector.nms_threshold", 0.3);
+  // Frames grouped into one inference, for the THROUGHPUT mode of the GPU
+  const int batch_size = this->declare_parameter("detector.batch_size", 1);
+  const double batch_timeout_ms = this->declare_parameter("detector.batch_timeout_ms", 5.0);
 
   namespace fs = std::filesystem;
   fs::path resolved_path = utils::URLResolver::getResolvedPath(model_path);
@@ -98,30 +193,128 @@ std::unique_ptr<RuneDetector> RuneDetectorNode::initDetector() {
                                        std::placeholders::_1,
                                        std::placeholders::_2,
                                        std::placeholders::_3));
-  // init detector
-  rune_detector->init();
+  // init detector in background, requests_limit bounds the requests in flight. Compiling for GPU
+  // takes seconds without the cache, the node is up meanwhile
+  const int max_requests = std::max(requests_limit_, 1);
+  startup_.begin("detector");
+  detector_init_thread_ =
+    std::thread([this,
+                 detector = rune_detector.get(),
+                 cache_dir,
+                 max_requests,
+                 precision,
+                 batch_size,
+                 batch_timeout_ms]() {
+      try {
+        auto profile = detector->init(max_requests, cache_dir, batch_size, batch_timeout_ms);
+        if (precision == "int8" && !profile.quantized) {
+          FYT_WARN("rune_detector", "INT8 selected but the model is not quantized");
+        }
+        FYT_INFO("rune_detector",
+                 "Detector ready: read {:.1f} ms, compile {:.1f} ms, first infer {:.1f} ms, "
+                 "{} requests, batch {}",
+                 profile.read_ms,
+                 profile.compile_ms,
+                 profile.first_infer_ms,
+                 profile.requests,
+                 profile.batch_size);
+        detector_ready_.store(true, std::memory_order_release);
+        finishStartupStep("detector");
+      } catch (const std::exception &e) {
+        FYT_ERROR("rune_detector", "Failed to init detector: {}", e.what());
+      }
+    });
   return rune_detector;
 }
 
 void RuneDetectorNode::imageCallback(const sensor_msgs::msg::Image::ConstSharedPtr msg) {
-  if (is_rune_ == false) {
+  if (is_rune_ == false || !detector_ready_.load(std::memory_order_acquire)) {
     return;
   }
 
-  // Limits request size
-  while (detect_requests_.size() > static_cast<size_t>(requests_limit_)) {
-    detect_requests_.front().get();
-    detect_requests_.pop();
+  if (scheduler_queue_ >= 0) {
+    if (!utils::PerceptionScheduler::instance().submit(scheduler_queue_,
+                                                       [this, msg]() { processImage(msg); })) {
+      dropped_frames_->fetch_add(1, std::memory_order_relaxed);
+    }
+    return;
   }
+  processImage(msg);
+}
 
+void RuneDetectorNode::processImage(const sensor_msgs::msg::Image::ConstSharedPtr &msg) {
   auto timestamp = rclcpp::Time(msg->header.stamp);
   frame_id_ = msg->header.frame_id;
-  auto img = cv_bridge::toCvCopy(msg, "rgb8")->image;
+  // A raw frame is demosaiced here, the detector only takes rgb
+  const auto bayer_pattern = utils::bayerPattern(msg->encoding);
+  cv::Mat rgb_img;
+  cv_bridge::CvImageConstPtr cv_img;
+  if (bayer_pattern != utils::BayerPattern::NONE) {
+    utils::bayerToRgb(cv_bridge::toCvShare(msg)->image, bayer_pattern, rgb_img);
+  } else {
+    // Shares the data of the message if it is rgb8 already
+    cv_img = cv_bridge::toCvShare(msg, "rgb8");
+    rgb_img = cv_img->image;
+  }
+
+  // While the flow follows the target, only every reanchor_interval-th frame is inferred
+  if (keypoint_flow_ != nullptr) {
+    std::vector<cv::Point2f> pts;
+    bool propagated = false;
+    {
+      utils::TraceScope trace(utils::TraceStage::RUNE_FLOW, timestamp.nanoseconds());
+      propagated = keypoint_flow_->propagate(rgb_img, timestamp.nanoseconds(), pts);
+    }
+    if (propagated) {
+      publishPropagated(pts, timestamp.nanoseconds());
+    }
+    if (propagated && ++frames_since_inference_ < keypoint_flow_->params().reanchor_interval) {
+      return;
+    }
+    frames_since_inference_ = 0;
+  }
 
-  // Push image to detector
-  detect_requests_.push(rune_detector_->pushInput(img, timestamp.nanoseconds()));
+  // Push image to detector, never waits for the inference: if all requests are busy the frame
+  // replaces the one waiting before it
+  submitted_frames_.fetch_add(1, std::memory_order_relaxed);
+  rune_detector_->submitInput(rgb_img, timestamp.nanoseconds(), cv_img);
 };
 
+void RuneDetectorNode::publishPropagated(const std::vector<cv::Point2f> &pts,
+                                         int64_t timestamp_nanosec) {
+  if (!claimStamp(timestamp_nanosec)) {
+    return;
+  }
+  auto timestamp = rclcpp::Time(timestamp_nanosec);
+  rm_interfaces::msg::RuneTarget rune_msg;
+  rune_msg.header.frame_id = frame_id_;
+  rune_msg.header.stamp = timestamp;
+  rune_msg.is_big_rune = is_big_rune_;
+  rune_msg.is_lost = false;
+  rune_msg.propagated = true;
+  // Same order as FeaturePoints::toVector2f()
+  for (size_t i = 0; i < rune_msg.pts.size(); i++) {
+    rune_msg.pts[i].x = pts[i].x;
+    rune_msg.pts[i].y = pts[i].y;
+  }
+  rune_pub_->publish(std::move(rune_msg));
+  propagated_frames_->fetch_add(1, std::memory_order_relaxed);
+  end_to_end_latency_->record((this->now() - timestamp).nanoseconds());
+}
+
+bool RuneDetectorNode::claimStamp(int64_t timestamp_nanosec) {
+  if (keypoint_flow_ == nullptr) {
+    return true;
+  }
+  int64_t last = last_published_stamp_.load(std::memory_order_relaxed);
+  while (timestamp_nanosec > last) {
+    if (last_published_stamp_.compare_exchange_weak(last, timestamp_nanosec)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 rcl_interfaces::msg::SetParametersResult RuneDetectorNode::onSetParameters(
   std::vector<rclcpp::Parameter> parameters) {
   rcl_interfaces::msg::SetParametersResult result;
@@ -137,10 +330,13 @@ rcl_interfaces::msg::SetParametersResult RuneDetectorNode::onSetParameters(
 void RuneDetectorNode::inferResultCallback(std::vector<RuneObject> &objs,
                                            int64_t timestamp_nanosec,
                                            const cv::Mat &src_img) {
+  // The post-processing of the inference result
+  utils::TraceScope trace(utils::TraceStage::RUNE_DETECT, timestamp_nanosec);
+  inferred_frames_.fetch_add(1, std::memory_order_relaxed);
   auto timestamp = rclcpp::Time(timestamp_nanosec);
-  // Used to draw debug info
+  // Used to draw debug info, the frame is only copied if someone watches
   cv::Mat debug_img;
-  if (debug_) {
+  if (debug_ && result_img_pub_.getNumSubscribers() > 0) {
     debug_img = src_img.clone();
   }
 
@@ -153,9 +349,24 @@ void RuneDetectorNode::inferResultCallback(std::vector<RuneObject> &objs,
   objs.erase(
     std::remove_if(objs.begin(),
                    objs.end(),
-                   [c = detect_color_](const auto &obj) -> bool { return obj.color != c; }),
+                   [c = detect_color_.load()](const auto &obj) -> bool { return obj.color != c; }),
     objs.end());
 
+  if (sample_dumper_ != nullptr) {
+    const cv::Rect image_rect(0, 0, src_img.cols, src_img.rows);
+    for (const auto &obj : objs) {
+      const cv::Rect box = obj.box & image_rect;
+      if (!box.empty()) {
+        sample_dumper_->submit(src_img(box),
+                               fmt::format("{}_{}",
+                                           enemyColorToString(obj.color),
+                                           obj.type == RuneType::INACTIVATED ? "HIT" : "OK"),
+                               timestamp_nanosec,
+                               obj.prob);
+      }
+    }
+  }
+
   if (!objs.empty()) {
     // Sort by probability
     std::sort(objs.begin(), objs.end(), [](const RuneObject &a, const RuneObject &b) {
@@ -163,11 +374,13 @@ void RuneDetectorNode::inferResultCallback(std::vector<RuneObject> &objs,
     });
 
     cv::Point2f r_tag;
-    cv::Mat binary_roi = cv::Mat::zeros(1, 1, CV_8UC3);
+    cv::Mat binary_roi;
     if (detect_r_tag_) {
-      // Detect R tag using traditional method
+      // Detect R tag using traditional method, tracked over frames. The binary roi is only
+      // drawn if someone watches the result image
+      const bool draw_roi = !debug_img.empty();
       std::tie(r_tag, binary_roi) =
-        rune_detector_->detectRTag(src_img, binary_thresh_, objs.at(0).pts.r_center);
+        rune_detector_->trackRTag(src_img, binary_thresh_, objs, draw_roi);
     } else {
       // Use the average center of all objects as the center of the R tag
       r_tag = std::accumulate(objs.begin(),
@@ -180,8 +393,8 @@ void RuneDetectorNode::inferResultCallback(std::vector<RuneObject> &objs,
     // Assign the center of the R tag to all objects
     std::for_each(objs.begin(), objs.end(), [r = r_tag](RuneObject &obj) { obj.pts.r_center = r; });
 
-    // Draw binary roi
-    if (debug_ && !debug_img.empty()) {
+    // Draw binary roi, it is not in the crop of debug_image.roi_only
+    if (!debug_img.empty() && !binary_roi.empty() && !debug_image_params_.roi_only) {
       cv::Rect roi =
         cv::Rect(debug_img.cols - binary_roi.cols, 0, binary_roi.cols, binary_roi.rows);
       binary_roi.copyTo(debug_img(roi));
@@ -190,7 +403,7 @@ void RuneDetectorNode::inferResultCallback(std::vector<RuneObject> &objs,
 
     // The final target is the inactivated rune with the highest probability
     auto result_it =
-      std::find_if(objs.begin(), objs.end(), [c = detect_color_](const auto &obj) -> bool {
+      std::find_if(objs.begin(), objs.end(), [c = detect_color_.load()](const auto &obj) -> bool {
         return obj.type == RuneType::INACTIVATED && obj.color == c;
       });
 
@@ -216,14 +429,37 @@ void RuneDetectorNode::inferResultCallback(std::vector<RuneObject> &objs,
     rune_msg.is_lost = true;
   }
 
-  rune_pub_->publish(std::move(rune_msg));
-
-  if (debug_) {
-    if (debug_img.empty()) {
-      // Avoid debug_mode change in processing
-      return;
+  // Every result anchors the flow, even if a newer propagated target is out already
+  if (keypoint_flow_ != nullptr) {
+    std::vector<cv::Point2f> pts;
+    if (!rune_msg.is_lost) {
+      for (const auto &p : rune_msg.pts) {
+        pts.emplace_back(p.x, p.y);
+      }
     }
+    keypoint_flow_->anchor(src_img, timestamp_nanosec, pts);
+  }
 
+  if (claimStamp(timestamp_nanosec)) {
+    rune_pub_->publish(std::move(rune_msg));
+    // From the capture of the frame to the result, the inference included
+    end_to_end_latency_->record((this->now() - timestamp).nanoseconds());
+  }
+
+  if (debug_img.empty()) {
+    return;
+  }
+  // Drawing, downscaling and encoding run in the debug worker, only the newest frame is kept
+  const double latency_ms = (this->get_clock()->now() - timestamp).seconds() * 1000;
+  std_msgs::msg::Header header;
+  header.frame_id = frame_id_;
+  header.stamp = timestamp;
+  debug_worker_->post([this,
+                       header = std::move(header),
+                       img = std::move(debug_img),
+                       objs = std::move(objs),
+                       latency_ms]() mutable {
+    cv::Rect targets;
     // Draw detection result
     for (auto &obj : objs) {
       auto pts = obj.pts.toVector2f();
@@ -231,39 +467,41 @@ void RuneDetectorNode::inferResultCallback(std::vector<RuneObject> &objs,
 
       cv::Scalar line_color =
         obj.type == RuneType::INACTIVATED ? cv::Scalar(50, 255, 50) : cv::Scalar(255, 50, 255);
-      cv::putText(debug_img,
+      cv::putText(img,
                   fmt::format("{:.2f}", obj.prob),
                   cv::Point2i(pts[1]),
                   cv::FONT_HERSHEY_SIMPLEX,
                   0.8,
                   line_color,
                   2);
-      cv::polylines(debug_img, obj.pts.toVector2i(), true, line_color, 2);
-      cv::circle(debug_img, aim_point, 5, line_color, -1);
+      cv::polylines(img, obj.pts.toVector2i(), true, line_color, 2);
+      cv::circle(img, aim_point, 5, line_color, -1);
 
       std::string rune_type = obj.type == RuneType::INACTIVATED ? "_HIT" : "_OK";
       std::string rune_color = enemyColorToString(obj.color);
-      cv::putText(debug_img,
+      cv::putText(img,
                   rune_color + rune_type,
                   cv::Point2i(pts[2]),
                   cv::FONT_HERSHEY_SIMPLEX,
                   0.8,
                   line_color,
                   2);
+      // The R tag is shared by all blades, the region holds the whole rune
+      const cv::Rect box = cv::boundingRect(pts);
+      targets = targets.empty() ? box : (targets | box);
     }
 
-    auto end = this->get_clock()->now();
-    auto duration = end.seconds() - timestamp.seconds();
-    std::string letency = fmt::format("Latency: {:.3f}ms", duration * 1000);
-    cv::putText(debug_img,
-                letency,
+    cv::Mat out = utils::shrinkDebugImage(img, debug_image_params_, targets);
+    // The text is drawn after the shrinking, so that it stays readable
+    cv::putText(out,
+                fmt::format("Latency: {:.3f}ms", latency_ms),
                 cv::Point2i(10, 30),
                 cv::FONT_HERSHEY_SIMPLEX,
                 0.8,
                 cv::Scalar(0, 255, 255),
                 2);
-    result_img_pub_.publish(cv_bridge::CvImage(rune_msg.header, "rgb8", debug_img).toImageMsg());
-  }
+    result_img_pub_.publish(cv_bridge::CvImage(header, "rgb8", out).toImageMsg());
+  });
 }
 
 void RuneDetectorNode::setModeCallback(
@@ -283,7 +521,8 @@ void RuneDetectorNode::setModeCallback(
       img_sub_ = this->create_subscription<sensor_msgs::msg::Image>(
         "image_raw",
         rclcpp::SensorDataQoS(),
-        std::bind(&RuneDetectorNode::imageCallback, this, std::placeholders::_1));
+        std::bind(&RuneDetectorNode::imageCallback, this, std::placeholders::_1),
+        image_sub_options_);
     }
   };
 
@@ -324,14 +563,28 @@ void RuneDetectorNode::setModeCallback(
     }
   }
 
+  // The target of the last mode is not followed
+  if (keypoint_flow_ != nullptr) {
+    keypoint_flow_->reset();
+  }
+
+  // The frames of the active mode get the workers first
+  if (scheduler_queue_ >= 0) {
+    utils::PerceptionScheduler::instance().setPriority(scheduler_queue_, is_rune_ ? 1 : 0);
+  }
+
   FYT_WARN("rune_detector", "Set Rune Mode: {}", visionModeToString(mode));
 }
 
 void RuneDetectorNode::createDebugPublishers() {
   result_img_pub_ = image_transport::create_publisher(this, "rune_detector/result_img");
+  debug_worker_ = std::make_unique<utils::DebugImageWorker>("rune_debug");
 }
 
-void RuneDetectorNode::destroyDebugPublishers() { result_img_pub_.shutdown(); }
+void RuneDetectorNode::destroyDebugPublishers() {
+  debug_worker_.reset();
+  result_img_pub_.shutdown();
+}
 
 }  // namespace fyt::rune
 #include "rclcpp_components/register_node_macro.hpp"
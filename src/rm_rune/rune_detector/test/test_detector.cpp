@@ -21,11 +21,13 @@
 #include <rclcpp/utilities.hpp>
 // std
 #include <memory>
+#include <vector>
 // opencv
 #include <opencv2/opencv.hpp>
 // project
 #include "rm_utils/common.hpp"
 #include "rm_utils/url_resolver.hpp"
+#include "rune_detector/keypoint_flow.hpp"
 #include "rune_detector/rune_detector.hpp"
 #include "rune_detector/types.hpp"
 
@@ -73,3 +75,40 @@ TEST(RuneDetectorNodeTest, NodeStartupTest) {
   EXPECT_EQ(runes[1].type, RuneType::ACTIVATED);
   EXPECT_EQ(runes[2].type, RuneType::ACTIVATED);
 }
+
+TEST(RuneDetectorNodeTest, KeypointFlowFollowsShiftedFrames) {
+  namespace fs = std::filesystem;
+  fs::path test_image_path =
+    utils::URLResolver::getResolvedPath("package://rune_detector/docs/test.png");
+  cv::Mat test_image = cv::imread(test_image_path.string(), cv::IMREAD_COLOR);
+  cv::cvtColor(test_image, test_image, cv::COLOR_BGR2RGB);
+
+  // Corners of strong gradients, as the fan corners are
+  std::vector<cv::Point2f> pts;
+  cv::Mat gray;
+  cv::cvtColor(test_image, gray, cv::COLOR_RGB2GRAY);
+  cv::goodFeaturesToTrack(gray, pts, 5, 0.1, 20);
+  ASSERT_EQ(pts.size(), static_cast<size_t>(5));
+
+  KeypointFlow flow(KeypointFlow::Params{.enable = true});
+  std::vector<cv::Point2f> propagated;
+  EXPECT_FALSE(flow.propagate(test_image, 1, propagated));
+  flow.anchor(test_image, 1, pts);
+
+  for (int i = 1; i <= 3; i++) {
+    cv::Mat shift = (cv::Mat_<double>(2, 3) << 1, 0, 2 * i, 0, 1, i);
+    cv::Mat frame;
+    cv::warpAffine(test_image, frame, shift, test_image.size());
+    ASSERT_TRUE(flow.propagate(frame, 1 + i, propagated));
+    for (size_t k = 0; k < pts.size(); k++) {
+      EXPECT_NEAR(propagated[k].x, pts[k].x + 2 * i, 0.5);
+      EXPECT_NEAR(propagated[k].y, pts[k].y + i, 0.5);
+    }
+  }
+
+  // An older result does not anchor, a lost one stops the flow
+  flow.anchor(test_image, 1, {});
+  EXPECT_TRUE(flow.tracking());
+  flow.anchor(test_image, 5, {});
+  EXPECT_FALSE(flow.tracking());
+}
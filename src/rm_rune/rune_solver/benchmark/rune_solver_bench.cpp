@@ -0,0 +1,357 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Fitting latency and prediction error of the rune curve fitter over a corpus of (time, angle)
+// sequences, so that changes of the fitting can be judged on the same data.
+//
+// Usage:
+//   ros2 run rune_solver rune_solver_bench [--data=<dir or file>] [--predict_time=0.1]
+//     [--auto_type=1] [--sequences=5] [--noise=0.01] [--seed=0]
+//
+// A sequence is a csv file of "time,angle" lines (s, rad, the observed angle fed to the
+// fitter) or the output of `ros2 topic echo --csv rune_solver/observed_angle`. Its type is big
+// if the file name contains "big", small otherwise. Without --data, --sequences synthetic
+// sequences of each type are made at 100 Hz over 10 s with gaussian noise, with the speed
+// parameters of the big rune drawn from the rules.
+//
+// Each sample goes through CurveFitter::update() as RuneSolver::update() feeds it, and the
+// bench waits for the fitting started by the sample, so the fit latency is the time of one
+// fitting on the worker. The prediction is made as RuneSolver::predictTarget() makes it, from
+// the observed angle and the fitted curve, and compared with the angle predict_time later.
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+// project
+#include "rune_solver/curve_fitter.hpp"
+#include "rune_solver/types.hpp"
+
+using namespace fyt::rune;
+namespace fs = std::filesystem;
+
+namespace {
+std::string g_data;
+double g_predict_time = 0.1;
+bool g_auto_type = true;
+int g_sequences = 5;
+double g_noise = 0.01;
+unsigned g_seed = 0;
+
+// Samples of the fitter input, same size as the fitter queue before the type is locked
+constexpr size_t MIN_FIT_SAMPLES = 50;
+constexpr auto FIT_TIMEOUT = std::chrono::milliseconds(100);
+
+struct Sequence {
+  std::string name;
+  MotionType type;
+  std::vector<double> time;
+  std::vector<double> angle;
+  // Noise free angle at a time, empty for a recorded sequence
+  std::function<double(double)> truth;
+};
+
+bool parseLine(const std::string &line, double &time, double &angle) {
+  std::vector<std::string> fields;
+  std::stringstream ss(line);
+  for (std::string field; std::getline(ss, field, ',');) {
+    fields.push_back(field);
+  }
+  char *end = nullptr;
+  if (fields.size() == 2) {
+    time = std::strtod(fields[0].c_str(), &end);
+    if (end == fields[0].c_str()) {
+      return false;
+    }
+    angle = std::strtod(fields[1].c_str(), &end);
+    return end != fields[1].c_str();
+  }
+  // sec, nanosec, frame_id, data of the DebugRuneAngle header
+  if (fields.size() == 4) {
+    const double sec = std::strtod(fields[0].c_str(), &end);
+    if (end == fields[0].c_str()) {
+      return false;
+    }
+    time = sec + std::strtod(fields[1].c_str(), nullptr) * 1e-9;
+    angle = std::strtod(fields[3].c_str(), &end);
+    return end != fields[3].c_str();
+  }
+  return false;
+}
+
+bool loadSequence(const fs::path &path, Sequence &seq) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  seq.name = path.filename().string();
+  seq.type = seq.name.find("big") != std::string::npos ? MotionType::BIG : MotionType::SMALL;
+  double t0 = 0;
+  for (std::string line; std::getline(file, line);) {
+    double time, angle;
+    if (!parseLine(line, time, angle)) {
+      continue;
+    }
+    if (seq.time.empty()) {
+      t0 = time;
+    }
+    // Relative to the first sample, as RuneSolver makes it
+    seq.time.push_back(time - t0);
+    seq.angle.push_back(angle);
+  }
+  return seq.time.size() >= MIN_FIT_SAMPLES;
+}
+
+std::vector<Sequence> loadCorpus() {
+  std::vector<fs::path> paths;
+  if (fs::is_directory(g_data)) {
+    for (const auto &entry : fs::directory_iterator(g_data)) {
+      if (entry.is_regular_file()) {
+        paths.push_back(entry.path());
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+  } else {
+    paths.emplace_back(g_data);
+  }
+  std::vector<Sequence> corpus;
+  for (const auto &path : paths) {
+    Sequence seq;
+    if (loadSequence(path, seq)) {
+      corpus.push_back(std::move(seq));
+    } else {
+      std::cerr << "Skip " << path << ", less than " << MIN_FIT_SAMPLES << " samples" << std::endl;
+    }
+  }
+  return corpus;
+}
+
+std::vector<Sequence> makeCorpus() {
+  std::mt19937 rng(g_seed);
+  std::normal_distribution<double> noise(0, g_noise);
+  std::vector<Sequence> corpus;
+  for (int i = 0; i < 2 * g_sequences; i++) {
+    Sequence seq;
+    const bool big = i >= g_sequences;
+    const double direction = std::uniform_int_distribution<int>(0, 1)(rng) ? 1 : -1;
+    const double phase = std::uniform_real_distribution<double>(0, 2 * M_PI)(rng);
+    if (big) {
+      // spd = a * sin(omega * t) + b, b = 2.090 - a
+      const double a = std::uniform_real_distribution<double>(0.780, 1.045)(rng);
+      const double omega = std::uniform_real_distribution<double>(1.884, 2.000)(rng);
+      const double b = 2.090 - a;
+      seq.truth = [=](double t) {
+        return direction * (-a / omega * std::cos(omega * t + phase) + b * t);
+      };
+      seq.type = MotionType::BIG;
+      seq.name = "synthetic_big_" + std::to_string(i - g_sequences);
+    } else {
+      seq.truth = [=](double t) { return direction * (M_PI / 3 * t + phase); };
+      seq.type = MotionType::SMALL;
+      seq.name = "synthetic_small_" + std::to_string(i);
+    }
+    for (int k = 0; k < 1000; k++) {
+      const double t = 0.01 * k;
+      seq.time.push_back(t);
+      seq.angle.push_back(seq.truth(t) + noise(rng));
+    }
+    corpus.push_back(std::move(seq));
+  }
+  return corpus;
+}
+
+// Angle of the sequence at time, interpolated between the samples
+bool angleAt(const Sequence &seq, double time, double &angle) {
+  if (seq.truth) {
+    angle = seq.truth(time);
+    return true;
+  }
+  auto it = std::lower_bound(seq.time.begin(), seq.time.end(), time);
+  if (it == seq.time.end() || it == seq.time.begin()) {
+    return false;
+  }
+  const size_t i = it - seq.time.begin();
+  const double r = (time - seq.time[i - 1]) / (seq.time[i] - seq.time[i - 1]);
+  angle = seq.angle[i - 1] + r * (seq.angle[i] - seq.angle[i - 1]);
+  return true;
+}
+
+struct Stats {
+  std::vector<double> update_us;
+  std::vector<double> fit_us;
+  // Time of the data until statusVerified(), s
+  std::vector<double> verify_s;
+  size_t unverified = 0;
+  // Prediction errors once verified, rad
+  std::vector<double> errors;
+};
+
+double elapsedUs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+    .count();
+}
+
+void runSequence(const Sequence &seq, Stats &stats) {
+  CurveFitter fitter(MotionType::UNKNOWN);
+  fitter.setAutoTypeDetermined(g_auto_type);
+  bool verified = false;
+  for (size_t i = 0; i < seq.time.size(); i++) {
+    const bool was_verified = fitter.statusVerified();
+    // From the first fitting on, all but the small rune closed form run on the worker
+    const bool closed_form = fitter.getType() == MotionType::SMALL &&
+                             (!g_auto_type || fitter.isTypeLocked());
+    const bool async = was_verified && i + 1 >= MIN_FIT_SAMPLES && !closed_form;
+
+    const uint64_t version = fitter.getVersion();
+    auto start = std::chrono::steady_clock::now();
+    fitter.setType(seq.type);
+    fitter.update(seq.time[i], seq.angle[i]);
+    stats.update_us.push_back(elapsedUs(start));
+
+    if (async) {
+      // The version is bumped by update() and again once the worker takes the result
+      while (fitter.getVersion() < version + 2 &&
+             std::chrono::steady_clock::now() - start < FIT_TIMEOUT) {
+        std::this_thread::yield();
+      }
+      if (fitter.getVersion() >= version + 2) {
+        stats.fit_us.push_back(elapsedUs(start));
+      }
+    }
+
+    if (!fitter.statusVerified()) {
+      continue;
+    }
+    if (!verified) {
+      verified = true;
+      stats.verify_s.push_back(seq.time[i]);
+    }
+
+    // As RuneSolver::predictTarget(), the fitted increment on the observed angle
+    const CurveFitter::Curve curve = fitter.getCurve();
+    const double predicted =
+      seq.angle[i] + curve.predict(seq.time[i] + g_predict_time) - curve.predict(seq.time[i]);
+    double truth;
+    if (angleAt(seq, seq.time[i] + g_predict_time, truth)) {
+      stats.errors.push_back(std::abs(predicted - truth));
+    }
+  }
+  if (!verified) {
+    stats.unverified++;
+  }
+}
+
+double percentile(std::vector<double> samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[static_cast<size_t>(p * (samples.size() - 1) + 0.5)];
+}
+
+double mean(const std::vector<double> &samples) {
+  double sum = 0;
+  for (double s : samples) {
+    sum += s;
+  }
+  return sum / std::max<size_t>(samples.size(), 1);
+}
+
+void printStats(const char *name, size_t sequences, const Stats &stats) {
+  if (sequences == 0) {
+    return;
+  }
+  std::printf("%-6s sequences %zu  unverified %zu\n", name, sequences, stats.unverified);
+  std::printf("       update  p50 %9.2f us  p99 %9.2f us  max %9.2f us\n",
+              percentile(stats.update_us, 0.50),
+              percentile(stats.update_us, 0.99),
+              stats.update_us.empty()
+                ? 0.0
+                : *std::max_element(stats.update_us.begin(), stats.update_us.end()));
+  std::printf("       fit     p50 %9.2f us  p99 %9.2f us  max %9.2f us  fits %zu\n",
+              percentile(stats.fit_us, 0.50),
+              percentile(stats.fit_us, 0.99),
+              stats.fit_us.empty() ? 0.0
+                                   : *std::max_element(stats.fit_us.begin(), stats.fit_us.end()),
+              stats.fit_us.size());
+  std::printf("       verify  mean %7.3f s  max %7.3f s\n",
+              mean(stats.verify_s),
+              stats.verify_s.empty()
+                ? 0.0
+                : *std::max_element(stats.verify_s.begin(), stats.verify_s.end()));
+  std::printf("       error   predict_time %.3f s  mean %.4f rad  p50 %.4f rad  p90 %.4f rad  "
+              "p99 %.4f rad\n",
+              g_predict_time,
+              mean(stats.errors),
+              percentile(stats.errors, 0.50),
+              percentile(stats.errors, 0.90),
+              percentile(stats.errors, 0.99));
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--data=", 7) == 0) {
+      g_data = argv[i] + 7;
+    } else if (std::strncmp(argv[i], "--predict_time=", 15) == 0) {
+      g_predict_time = std::atof(argv[i] + 15);
+    } else if (std::strncmp(argv[i], "--auto_type=", 12) == 0) {
+      g_auto_type = std::atoi(argv[i] + 12) != 0;
+    } else if (std::strncmp(argv[i], "--sequences=", 12) == 0) {
+      g_sequences = std::max(1, std::atoi(argv[i] + 12));
+    } else if (std::strncmp(argv[i], "--noise=", 8) == 0) {
+      g_noise = std::max(0.0, std::atof(argv[i] + 8));
+    } else if (std::strncmp(argv[i], "--seed=", 7) == 0) {
+      g_seed = static_cast<unsigned>(std::atoi(argv[i] + 7));
+    } else {
+      std::cerr << "Unknown argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  const std::vector<Sequence> corpus = g_data.empty() ? makeCorpus() : loadCorpus();
+  if (corpus.empty()) {
+    std::cerr << "No sequences loaded" << std::endl;
+    return 1;
+  }
+  std::cerr << "Loaded " << corpus.size() << " sequences" << std::endl;
+
+  Stats small, big;
+  size_t small_num = 0, big_num = 0;
+  for (const auto &seq : corpus) {
+    if (seq.type == MotionType::BIG) {
+      runSequence(seq, big);
+      big_num++;
+    } else {
+      runSequence(seq, small);
+      small_num++;
+    }
+  }
+  printStats("small", small_num, small);
+  printStats("big", big_num, big);
+  return 0;
+}
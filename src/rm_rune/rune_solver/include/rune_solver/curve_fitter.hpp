@@ -18,7 +18,15 @@
 #define RUNE_SOLVER_CURVE_FITTER_HPP_
 
 // std
-#include <future>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 // third party
 #include <ceres/ceres.h>
 // project
@@ -26,14 +34,30 @@
 
 namespace fyt::rune {
 
+// The small rune curve is linear in time and is solved in closed form from running sums on every
+// update. The big rune fitting runs on a worker thread started with the fitter, on a snapshot of
+// the data, seeded by a linear solve over a grid of omega or the last result. predict() always
+// uses the latest finished fitting. With the automatic type both curves are fitted until one
+// of them wins the BIC by a clear margin over several fittings in a row, then only that one is
+// fitted until reset
 class CurveFitter {
 public:
-  explicit CurveFitter(const MotionType &t) : type_(t), fitting_future_(nullptr) {
-    // Init parameters to be fitted
-    fitting_param_ = {1.045, 0, 0, 0, 0};
-    direction_ = Direction::UNKNOWN;
+  // Result of the fitting, evaluated without the fitter
+  struct Curve {
+    MotionType type = MotionType::UNKNOWN;
+    std::array<double, 5> param = {};
+    int direction = 0;
+    bool is_static = false;
+    // Angle of the latest data, returned for a static target
+    double last_angle = 0;
+
+    double predict(double time) const noexcept;
   };
 
+  explicit CurveFitter(const MotionType &t);
+
+  ~CurveFitter();
+
   // Perform angle predict
   double predict(double time);
 
@@ -53,35 +77,153 @@ public:
 
   MotionType getType() const;
 
+  // The automatic type is decided, only its curve is fitted
+  bool isTypeLocked() const;
+
+  // Snapshot of the latest fitting result
+  Curve getCurve() const;
+
+  // Changes whenever the result of getCurve() may have changed, lock free
+  uint64_t getVersion() const noexcept { return version_.load(std::memory_order_acquire); }
+
   // Get the string of the fitting result
   std::string getDebugText();
 
 private:
+  // Data in time order, structure of arrays
+  struct Samples {
+    std::vector<double> time;
+    std::vector<double> angle;
+    size_t size() const noexcept { return time.size(); }
+  };
+
+  // Running sums of the data for the least squares line angle = k * time + q,
+  // time is taken relative to t0 to keep the precision
+  struct LineSums {
+    double t0 = 0;
+    double n = 0, t = 0, y = 0, tt = 0, ty = 0;
+    void add(double time, double angle) noexcept {
+      const double dt = time - t0;
+      n += 1;
+      t += dt;
+      y += angle;
+      tt += dt * dt;
+      ty += dt * angle;
+    }
+    void remove(double time, double angle) noexcept {
+      const double dt = time - t0;
+      n -= 1;
+      t -= dt;
+      y -= angle;
+      tt -= dt * dt;
+      ty -= dt * angle;
+    }
+  };
+
+  // Everything a fitting reads, copied from the fitter so that the worker never touches
+  // the live data. type and param are the results
+  struct FitTask {
+    Samples data;
+    LineSums line;
+    MotionType type = MotionType::UNKNOWN;
+    std::array<double, 5> param = {};
+    int direction = 0;
+    bool is_static = false;
+    bool auto_type_determined = false;
+    // BIC of the small rune curve minus that of the big rune curve, positive if the big one
+    // is better. Only set by fitDoubleCurve()
+    double evidence = 0;
+    // Fitted curves of both types, the type locked in by the evidence takes its own even if the
+    // cost picked the other one. Only set by fitDoubleCurve()
+    std::array<double, 5> small_param = {};
+    std::array<double, 5> big_param = {};
+    // Results of an older generation (before reset or setType) are dropped
+    uint64_t generation = 0;
+  };
+
   // Perform double curve fitting
   // automated determination of the type of curve
-  void fitDoubleCurve();
+  static void fitDoubleCurve(FitTask &task);
 
   // Perform curve fitting
-  void fitCurve();
+  static void fitCurve(FitTask &task);
+
+  // Closed-form small rune fitting, O(1), the speed is clamped to its bounds
+  // Return: false if the time span of the data is degenerated
+  static bool fitSmallCurve(const LineSums &line, int direction, std::array<double, 5> &param);
+
+  // For a fixed omega the big rune curve is linear in a*cos(omega*(x+d)), a*sin(...), b and c.
+  // Search omega on a grid, solve the rest by linear least squares
+  // Return: the sum of squared residuals, infinity if no solution
+  static double fitBigCurveLinear(const Samples &data,
+                                  int direction,
+                                  std::array<double, 5> &param);
+
+  // Sum of squared residuals of the big rune curve
+  static double bigCurveError(const Samples &data,
+                              int direction,
+                              const std::array<double, 5> &param);
+
+  // Cost of the small rune curve under the same robust loss as the Ceres problems
+  static double smallCurveCost(const Samples &data,
+                               int direction,
+                               const std::array<double, 5> &param);
+
+  // Sum of squared residuals of the small rune curve
+  static double smallCurveError(const Samples &data,
+                                int direction,
+                                const std::array<double, 5> &param);
 
-  // Status value
+  // Take the result of a finished task, mtx_ must be held
+  void acceptTask(const FitTask &task);
+
+  static void runTask(FitTask &task);
+
+  void workerLoop();
+
+  // Ring buffer of the data, the oldest is dropped when full
+  void pushData(double time, double angle) noexcept;
+  void popData() noexcept;
+  size_t dataIndex(size_t i) const noexcept { return (data_head_ + i) % QUEUE_UPPER_LIMIT; }
+  // Copy the data in time order, at most two spans per array
+  void copyData(Samples &samples) const;
+
+  // Status value, guarded by mtx_
   MotionType type_;
   bool is_static_ = false;
   bool auto_type_determined_ = false;
   int direction_;
+  // Sequential test of the automatic type: signed count of the fittings in a row whose
+  // evidence passed TYPE_LOCK_EVIDENCE, positive for the big rune
+  static constexpr double TYPE_LOCK_EVIDENCE = 10.0;
+  static constexpr int TYPE_LOCK_FITS = 5;
+  int type_streak_ = 0;
+  bool type_locked_ = false;
 
   // Data to be fitted
-  static constexpr int QUEUE_UPPER_LIMIT = 500;
-  static constexpr int QUEUE_LOWER_LIMIT = 50;
-  struct Data {
-    double time;
-    double angle;
-  };
-  std::deque<Data> data_history_queue_;
+  static constexpr size_t QUEUE_UPPER_LIMIT = 500;
+  static constexpr size_t QUEUE_LOWER_LIMIT = 50;
+  std::array<double, QUEUE_UPPER_LIMIT> data_time_;
+  std::array<double, QUEUE_UPPER_LIMIT> data_angle_;
+  size_t data_head_ = 0;
+  size_t data_size_ = 0;
+  LineSums line_sums_;
+  // Updates since the sums were last rebuilt from the queue
+  size_t line_updates_ = 0;
 
-  // Parameters to be fitted
+  // Parameters to be fitted, guarded by mtx_
   std::array<double, 5> fitting_param_;
-  std::unique_ptr<std::future<void>> fitting_future_;
+  bool has_fitted_ = false;
+  uint64_t generation_ = 0;
+  std::atomic<uint64_t> version_{0};
+
+  // Fitting worker, the latest task replaces a task not started yet
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  FitTask task_;
+  bool has_task_ = false;
+  bool stop_ = false;
+  std::thread worker_;
 
 private:
   // Fitting Curve
@@ -23,22 +23,38 @@ namespace fyt::rune {
 
 constexpr int X_N = 4, Z_N = 4;
 
+// The rune center is static, x1 = x0
 struct Predict {
+  static constexpr bool is_linear = true;
+
   template <typename T>
   void operator()(const T x0[X_N], T x1[X_N]) {
     for (int i = 0; i < X_N; ++i) {
       x1[i] = x0[i];
     }
   }
+
+  void jacobian(const Eigen::Matrix<double, X_N, 1> &,
+                Eigen::Matrix<double, X_N, X_N> &F) const noexcept {
+    F.setIdentity();
+  }
 };
 
+// The pose is measured directly, z = x
 struct Measure {
+  static constexpr bool is_linear = true;
+
   template <typename T>
   void operator()(const T x[Z_N], T z[Z_N]) {
     for (int i = 0; i < Z_N; ++i) {
       z[i] = x[i];
     }
   }
+
+  void jacobian(const Eigen::Matrix<double, X_N, 1> &,
+                Eigen::Matrix<double, Z_N, X_N> &H) const noexcept {
+    H.setIdentity();
+  }
 };
 
 using RuneCenterEKF = ExtendedKalmanFilter<X_N, Z_N, Predict, Measure>;
@@ -19,6 +19,7 @@
 // std
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <deque>
 #include <iostream>
 #include <memory>
@@ -64,6 +65,11 @@ public:
     double angle_offset_thres;
     double lost_time_thres;
     bool auto_type_determined;
+    // Refine the PnP of the last target instead of solving from scratch, a full solve is
+    // kept for a new target and a refined pose whose mean reprojection error (in pixels)
+    // is above pnp_max_refine_error
+    bool pnp_warm_start = false;
+    double pnp_max_refine_error = 2.0;
   };
 
   enum State {
@@ -118,6 +124,9 @@ private:
   // Return ekf state
   Eigen::Vector4d getStateFromTransform(const Eigen::Matrix4d &transform) const;
 
+  // Rebuild R_odom_2_rune_, call whenever ekf_state_ or last_angle_ changes
+  void updateRuneRotation();
+
   // Observation data
 
   // last_observed_angle_ is continuously increasing (or decreasing)
@@ -131,6 +140,21 @@ private:
   double last_time_;
 
   Eigen::Vector4d ekf_state_;
+  // Rotation from rune to odom, reconstructed from the yaw of ekf_state_ and last_angle_
+  Eigen::Matrix3d R_odom_2_rune_;
+
+  // predictTarget() runs far more often than the fitting changes, keep the fitted curve
+  // and its angle at last_time_ until either changes
+  uint64_t curve_version_;
+  CurveFitter::Curve curve_;
+  double last_predicted_angle_;
+  bool prediction_valid_;
+
+  // Pose of the rune in the camera frame from the last PnP, the guess of the next one
+  bool has_pnp_guess_ = false;
+  double pnp_guess_time_ = 0;
+  cv::Mat pnp_rvec_;
+  cv::Mat pnp_tvec_;
 
   std::shared_ptr<tf2_ros::Buffer> tf2_buffer_;
 };
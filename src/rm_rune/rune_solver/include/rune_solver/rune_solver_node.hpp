@@ -18,6 +18,7 @@
 
 // std
 #include <algorithm>
+#include <atomic>
 #include <deque>
 #include <iostream>
 #include <rm_interfaces/msg/detail/debug_rune_angle__struct.hpp>
@@ -59,6 +60,10 @@ private:
 
   // Heartbeat
   HeartBeatPublisher::SharedPtr heartbeat_;
+  // Metrics reported with the heartbeat, registered at the end of the constructor
+  utils::LatencyHistogram *update_latency_ = nullptr;
+  utils::LatencyHistogram *end_to_end_latency_ = nullptr;
+  std::atomic<int64_t> *solver_errors_ = nullptr;
 
   // Rune solver
   std::unique_ptr<RuneSolver> rune_solver_;
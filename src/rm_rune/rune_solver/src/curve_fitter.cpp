@@ -16,72 +16,141 @@
 
 #include "rune_solver/curve_fitter.hpp"
 // std
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <limits>
 #include <string>
-#include <thread>
+#include <utility>
 // third party
+#include <Eigen/Dense>
 #include <fmt/format.h>
 // project
 #include "rm_utils/logger/log.hpp"
+#include "rm_utils/thread_config.hpp"
+#include "rm_utils/worker_pool.hpp"
 #include "rune_solver/types.hpp"
 
 namespace fyt::rune {
 
-// Fit two curves simultaneously and choose the one with lower cost
-// This function will change the type_ automatically
-void CurveFitter::fitDoubleCurve() {
-  if (is_static_) {
-    // Treat the static target as a small rune
-    type_ = MotionType::SMALL;
+CurveFitter::CurveFitter(const MotionType &t) : type_(t) {
+  // Init parameters to be fitted
+  fitting_param_ = {1.045, 0, 0, 0, 0};
+  direction_ = Direction::UNKNOWN;
+  worker_ = std::thread(&CurveFitter::workerLoop, this);
+}
+
+CurveFitter::~CurveFitter() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  worker_.join();
+}
+
+void CurveFitter::workerLoop() {
+  utils::configureThread("rune_fitter");
+  FitTask task;
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (true) {
+    cv_.wait(lock, [this]() { return stop_ || has_task_; });
+    if (stop_) {
+      return;
+    }
+    // Swap to keep the buffers of both tasks
+    std::swap(task, task_);
+    has_task_ = false;
+
+    lock.unlock();
+    runTask(task);
+    lock.lock();
+
+    if (task.generation == generation_) {
+      acceptTask(task);
+    }
+  }
+}
+
+void CurveFitter::acceptTask(const FitTask &task) {
+  type_ = task.type;
+  fitting_param_ = task.param;
+  version_++;
+  if (!task.auto_type_determined || type_locked_) {
     return;
   }
 
-  constexpr int PARALLEL_THRESHOLD = 300;
-  bool is_parallel = data_history_queue_.size() > PARALLEL_THRESHOLD;
+  // Both curves were fitted, count the fittings in a row that favour one of them clearly
+  const int vote = task.evidence > TYPE_LOCK_EVIDENCE    ? 1
+                   : task.evidence < -TYPE_LOCK_EVIDENCE ? -1
+                                                         : 0;
+  type_streak_ = vote != 0 && (type_streak_ > 0) == (vote > 0) ? type_streak_ + vote : vote;
+  if (std::abs(type_streak_) < TYPE_LOCK_FITS) {
+    return;
+  }
+  type_locked_ = true;
+  const MotionType locked = type_streak_ > 0 ? MotionType::BIG : MotionType::SMALL;
+  if (type_ != locked) {
+    type_ = locked;
+    fitting_param_ = locked == MotionType::BIG ? task.big_param : task.small_param;
+  }
+  FYT_INFO("rune_solver",
+           "Rune type locked to {}, evidence {:.1f}",
+           locked == MotionType::BIG ? "big" : "small",
+           task.evidence);
+}
 
+void CurveFitter::runTask(FitTask &task) {
   auto t1 = std::chrono::high_resolution_clock::now();
+  if (task.auto_type_determined) {
+    fitDoubleCurve(task);
+  } else {
+    fitCurve(task);
+  }
+  auto t2 = std::chrono::high_resolution_clock::now();
+  FYT_DEBUG("rune_solver",
+            "Fitting time: {} ms",
+            std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count());
+}
+
+// Fit two curves and choose the one with lower cost
+// This function will change the type automatically
+void CurveFitter::fitDoubleCurve(FitTask &task) {
+  if (task.is_static) {
+    // Treat the static target as a small rune, no evidence for either curve
+    task.type = MotionType::SMALL;
+    task.evidence = 0;
+    return;
+  }
 
-  ceres::Problem small_fitting_problem;
   ceres::Problem big_fitting_problem;
 
-  std::array<double, 5> small_param;
-  std::array<double, 5> big_param;
+  std::array<double, 5> small_param = {1.045, 0, 0, 0, 0};
+  std::array<double, 5> big_param = {0.9125, 1.942, 2.090 - 0.9125, 0, 0};
+  if (task.type == MotionType::BIG) {
+    big_param = task.param;
+  }
+
+  // The small rune curve is linear, solve it in closed form
+  fitSmallCurve(task.line, task.direction, small_param);
+  const double small_cost = smallCurveCost(task.data, task.direction, small_param);
 
-  // Set the initial parameters in different cases
-  switch (type_) {
-    case MotionType::UNKNOWN: {
-      small_param = {1.045, 0, 0, 0, 0};
-      big_param = {0.9125, 1.942, 2.090 - 0.9125, 0, 0};
-      break;
-    }
-    case MotionType::BIG: {
-      small_param = {1.045, 0, 0, 0, 0};
-      big_param = fitting_param_;
-      break;
-    }
-    case MotionType::SMALL: {
-      small_param = fitting_param_;
-      big_param = {0.9125, 1.942, 2.090 - 0.9125, 0, 0};
-      break;
-    }
+  // Seed the big rune fitting with the better of the linear solve and the last result
+  std::array<double, 5> linear_param;
+  if (fitBigCurveLinear(task.data, task.direction, linear_param) <
+      bigCurveError(task.data, task.direction, big_param)) {
+    big_param = linear_param;
   }
 
-  // Add residuals to the problems
+  // Add residuals to the problem
   double *big_param_ptr = big_param.data();
-  double *small_param_ptr = small_param.data();
-  std::for_each(data_history_queue_.begin(), data_history_queue_.end(), [&](const auto &data) {
-    small_fitting_problem.AddResidualBlock(
-      new ceres::AutoDiffCostFunction<CurveFitter::SmallRuneFittingCost, 1, 3>(
-        new SmallRuneFittingCost(data.time, data.angle, direction_)),
-      new ceres::CauchyLoss(0.5),
-      small_param_ptr);
-
+  for (size_t i = 0; i < task.data.size(); i++) {
     big_fitting_problem.AddResidualBlock(
       new ceres::AutoDiffCostFunction<CurveFitter::BigRuneFittingCost, 1, 5>(
-        new BigRuneFittingCost(data.time, data.angle, direction_)),
+        new BigRuneFittingCost(task.data.time[i], task.data.angle[i], task.direction)),
       new ceres::CauchyLoss(0.5),
       big_param_ptr);
-  });
+  }
 
   // Set the bounds of the parameters
   big_fitting_problem.SetParameterLowerBound(big_param_ptr, 0, 0.780 * 0.5);
@@ -90,152 +159,282 @@ void CurveFitter::fitDoubleCurve() {
   big_fitting_problem.SetParameterUpperBound(big_param_ptr, 1, 2.000 * 1.5);
   big_fitting_problem.SetParameterLowerBound(big_param_ptr, 2, (2.090 - 1.045) * 0.5);
   big_fitting_problem.SetParameterUpperBound(big_param_ptr, 2, (2.090 - 0.780) * 1.5);
-  small_fitting_problem.SetParameterLowerBound(small_param_ptr, 0, 1.045 * 0.5);
-  small_fitting_problem.SetParameterUpperBound(small_param_ptr, 0, 1.045 * 1.5);
 
   ceres::Solver::Options options;
   options.linear_solver_type = ceres::DENSE_QR;
-  ceres::Solver::Summary small_summary;
   ceres::Solver::Summary big_summary;
 
-  // Start the optimization
-  if (is_parallel) {
-    auto f1 = std::async(std::launch::async,
-                         [&]() { ceres::Solve(options, &small_fitting_problem, &small_summary); });
-    auto f2 = std::async(std::launch::async,
-                         [&]() { ceres::Solve(options, &big_fitting_problem, &big_summary); });
-    f1.get();
-    f2.get();
-  } else {
-    ceres::Solve(options, &small_fitting_problem, &small_summary);
-    ceres::Solve(options, &big_fitting_problem, &big_summary);
-  }
+  // Start the optimization, the fitting is already off the caller thread
+  ceres::Solve(options, &big_fitting_problem, &big_summary);
+
+  // Bayesian information criterion n * log(SSE / n) + k * log(n) of both curves, the big one
+  // has to pay for its three more parameters
+  const double n = static_cast<double>(task.data.size());
+  auto bic = [n](double sse, int k) {
+    return n * std::log(std::max(sse, 1e-12) / n) + k * std::log(n);
+  };
+  task.evidence = bic(smallCurveError(task.data, task.direction, small_param), 2) -
+                  bic(bigCurveError(task.data, task.direction, big_param), 5);
 
-  double small_cost = small_summary.final_cost;
+  task.small_param = small_param;
+  task.big_param = big_param;
   double big_cost = big_summary.final_cost;
   // Choose the curve with lower cost
   if (small_cost < big_cost) {
-    fitting_param_ = small_param;
-    type_ = MotionType::SMALL;
+    task.param = small_param;
+    task.type = MotionType::SMALL;
   } else {
-    fitting_param_ = big_param;
-    type_ = MotionType::BIG;
+    task.param = big_param;
+    task.type = MotionType::BIG;
   }
-  auto t2 = std::chrono::high_resolution_clock::now();
-  FYT_DEBUG("rune_solver",
-            "Fitting time: {} ms",
-            std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count());
 }
 
 // Fit the curve with the determined type
-void CurveFitter::fitCurve() {
-  if (is_static_) {
+void CurveFitter::fitCurve(FitTask &task) {
+  if (task.is_static) {
     return;
   }
 
-  auto t1 = std::chrono::high_resolution_clock::now();
-  ceres::Problem problem;
-
-  // Copy the fitting parameters to a temporary array
-  // to avoid using the variables that are being optimized
-  std::array<double, 5> temp_param = fitting_param_;
+  if (task.type == MotionType::SMALL) {
+    fitSmallCurve(task.line, task.direction, task.param);
+    return;
+  } else if (task.type != MotionType::BIG) {
+    return;
+  }
 
-  // If the target is static, set the initial parameters, optimize the curve from scratch
-  if (type_ == MotionType::BIG) {
-    temp_param = {0.9125, 1.942, 2.090 - 0.9125, 0, 0};
-  } else if (type_ == MotionType::SMALL) {
-    temp_param = {1.045, 0, 0, 0, 0};
+  // Warm start from the last result of this type, setType() puts the initial parameters
+  // here when the type changes. The linear solve takes over when it fits better, e.g.
+  // the last result sits in a local minimum of omega
+  std::array<double, 5> linear_param;
+  if (fitBigCurveLinear(task.data, task.direction, linear_param) <
+      bigCurveError(task.data, task.direction, task.param)) {
+    task.param = linear_param;
   }
 
-  double *param_ptr = temp_param.data();
+  ceres::Problem problem;
+  double *param_ptr = task.param.data();
 
   // Add residuals to the problem
-  std::for_each(data_history_queue_.begin(), data_history_queue_.end(), [&](const auto &data) {
-    if (type_ == MotionType::BIG) {
-      problem.AddResidualBlock(
-        new ceres::AutoDiffCostFunction<CurveFitter::BigRuneFittingCost, 1, 5>(
-          new BigRuneFittingCost(data.time, data.angle, direction_)),
-        new ceres::CauchyLoss(0.5),
-        param_ptr);
-    } else if (type_ == MotionType::SMALL) {
-      problem.AddResidualBlock(
-        new ceres::AutoDiffCostFunction<CurveFitter::SmallRuneFittingCost, 1, 3>(
-          new SmallRuneFittingCost(data.time, data.angle, direction_)),
-        new ceres::CauchyLoss(0.5),
-        param_ptr);
-    }
-  });
+  for (size_t i = 0; i < task.data.size(); i++) {
+    problem.AddResidualBlock(
+      new ceres::AutoDiffCostFunction<CurveFitter::BigRuneFittingCost, 1, 5>(
+        new BigRuneFittingCost(task.data.time[i], task.data.angle[i], task.direction)),
+      new ceres::CauchyLoss(0.5),
+      param_ptr);
+  }
 
   // Set the bounds of the parameters
-  if (type_ == MotionType::BIG) {
-    problem.SetParameterLowerBound(param_ptr, 0, 0.780 * 0.5);
-    problem.SetParameterUpperBound(param_ptr, 0, 1.045 * 1.5);
-    problem.SetParameterLowerBound(param_ptr, 1, 1.884 * 0.5);
-    problem.SetParameterUpperBound(param_ptr, 1, 2.000 * 1.5);
-    problem.SetParameterLowerBound(param_ptr, 2, (2.090 - 1.045) * 0.5);
-    problem.SetParameterUpperBound(param_ptr, 2, (2.090 - 0.780) * 1.5);
-  } else if (type_ == MotionType::SMALL) {
-    problem.SetParameterLowerBound(param_ptr, 0, 1.045 * 0.5);
-    problem.SetParameterUpperBound(param_ptr, 0, 1.045 * 1.5);
-  }
+  problem.SetParameterLowerBound(param_ptr, 0, 0.780 * 0.5);
+  problem.SetParameterUpperBound(param_ptr, 0, 1.045 * 1.5);
+  problem.SetParameterLowerBound(param_ptr, 1, 1.884 * 0.5);
+  problem.SetParameterUpperBound(param_ptr, 1, 2.000 * 1.5);
+  problem.SetParameterLowerBound(param_ptr, 2, (2.090 - 1.045) * 0.5);
+  problem.SetParameterUpperBound(param_ptr, 2, (2.090 - 0.780) * 1.5);
 
   // Start the optimization
   ceres::Solver::Options options;
   options.linear_solver_type = ceres::DENSE_QR;
   ceres::Solver::Summary summary;
   ceres::Solve(options, &problem, &summary);
-  auto t2 = std::chrono::high_resolution_clock::now();
-  FYT_DEBUG("rune_solver",
-            "Fitting time: {} ms",
-            std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count());
+}
+
+bool CurveFitter::fitSmallCurve(const LineSums &line,
+                                int direction,
+                                std::array<double, 5> &param) {
+  if (line.n < 2) {
+    return false;
+  }
+  const double mean_t = line.t / line.n;
+  const double mean_y = line.y / line.n;
+  // n * var(t) and n * cov(t, y)
+  const double var_t = line.tt - line.t * mean_t;
+  const double cov_ty = line.ty - line.t * mean_y;
+  if (var_t < 1e-9 * line.n) {
+    return false;
+  }
 
-  // Save the optimized parameters
-  fitting_param_ = temp_param;
+  // angle * direction = a * time + c, the same bounds as the nonlinear fitting
+  const double a = std::clamp(direction * cov_ty / var_t, 1.045 * 0.5, 1.045 * 1.5);
+  const double c = direction * mean_y - a * (mean_t + line.t0);
+  param = {a, 0, c, 0, 0};
+  return true;
 }
 
-double CurveFitter::predict(double current_time) {
+double CurveFitter::fitBigCurveLinear(const Samples &data,
+                                      int direction,
+                                      std::array<double, 5> &param) {
+  constexpr double INF = std::numeric_limits<double>::infinity();
+  if (data.size() < 4) {
+    return INF;
+  }
+  // Centered time keeps the normal equations well conditioned
+  const double tm = 0.5 * (data.time.front() + data.time.back());
+
+  // angle * direction = p * cos(omega * t) + q * sin(omega * t) + b * t + k,  t = time - tm
+  auto solve = [&](double omega, Eigen::Vector4d &theta) {
+    Eigen::Matrix4d ata = Eigen::Matrix4d::Zero();
+    Eigen::Vector4d aty = Eigen::Vector4d::Zero();
+    double yy = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+      const double t = data.time[i] - tm;
+      const double y = data.angle[i] * direction;
+      const Eigen::Vector4d row(std::cos(omega * t), std::sin(omega * t), t, 1.0);
+      ata.noalias() += row * row.transpose();
+      aty.noalias() += row * y;
+      yy += y * y;
+    }
+    const Eigen::LDLT<Eigen::Matrix4d> ldlt(ata);
+    if (ldlt.info() != Eigen::Success || !ldlt.isPositive()) {
+      return INF;
+    }
+    theta = ldlt.solve(aty);
+    return yy - theta.dot(aty);
+  };
+
+  // Grid over the bounds of omega, then a parabola through the best point and its neighbours
+  constexpr double OMEGA_MIN = 1.884 * 0.5;
+  constexpr double OMEGA_MAX = 2.000 * 1.5;
+  constexpr double OMEGA_STEP = 0.05;
+  constexpr int GRID_N = static_cast<int>((OMEGA_MAX - OMEGA_MIN) / OMEGA_STEP) + 1;
+  // Each grid point is a pass over the samples, the workers only pay off for a long window
+  constexpr size_t PARALLEL_MIN_SAMPLES = 256;
+  std::array<double, GRID_N> errors;
+  utils::WorkerPool::instance().parallelFor(
+    GRID_N,
+    [&](size_t i) {
+      Eigen::Vector4d grid_theta;
+      errors[i] = solve(OMEGA_MIN + i * OMEGA_STEP, grid_theta);
+    },
+    data.size() >= PARALLEL_MIN_SAMPLES ? 2 : GRID_N + 1);
+  const int best =
+    static_cast<int>(std::min_element(errors.begin(), errors.end()) - errors.begin());
+  Eigen::Vector4d theta;
+  if (errors[best] == INF) {
+    return INF;
+  }
+  double omega = OMEGA_MIN + best * OMEGA_STEP;
+  if (best > 0 && best < GRID_N - 1) {
+    const double curvature = errors[best - 1] - 2 * errors[best] + errors[best + 1];
+    if (curvature > 0) {
+      omega -= 0.5 * OMEGA_STEP * (errors[best + 1] - errors[best - 1]) / curvature;
+    }
+  }
+  if (solve(omega, theta) == INF) {
+    return INF;
+  }
+
+  // p * cos(omega * t) + q * sin(omega * t) = -(a / omega) * cos(omega * (t + d'))
+  const double amplitude = std::hypot(theta[0], theta[1]);
+  const double phase = std::atan2(theta[1], -theta[0]);
+  // Back to the absolute time, d is kept within one period
+  const double period = 2 * CV_PI / omega;
+  double d = phase / omega - tm;
+  d -= period * std::round(d / period);
+  const double b = theta[2];
+  const double c = theta[3] - b * tm - b * d;
+  param = {std::clamp(omega * amplitude, 0.780 * 0.5, 1.045 * 1.5),
+           omega,
+           std::clamp(b, (2.090 - 1.045) * 0.5, (2.090 - 0.780) * 1.5),
+           c,
+           d};
+  return bigCurveError(data, direction, param);
+}
+
+double CurveFitter::bigCurveError(const Samples &data,
+                                  int direction,
+                                  const std::array<double, 5> &param) {
+  double error = 0;
+  for (size_t i = 0; i < data.size(); i++) {
+    const double r =
+      data.angle[i] -
+      BIG_RUNE_CURVE(data.time[i], param[0], param[1], param[2], param[3], param[4], direction);
+    error += r * r;
+  }
+  return error;
+}
+
+double CurveFitter::smallCurveCost(const Samples &data,
+                                   int direction,
+                                   const std::array<double, 5> &param) {
+  // Cost of ceres::CauchyLoss(0.5): 0.5 * sum(b * log(1 + r^2 / b)), b = 0.5^2
+  constexpr double B = 0.25;
+  double cost = 0;
+  for (size_t i = 0; i < data.size(); i++) {
+    const double r =
+      data.angle[i] - SMALL_RUNE_CURVE(data.time[i], param[0], param[1], param[2], direction);
+    cost += B * std::log1p(r * r / B);
+  }
+  return 0.5 * cost;
+}
+
+double CurveFitter::smallCurveError(const Samples &data,
+                                    int direction,
+                                    const std::array<double, 5> &param) {
+  double error = 0;
+  for (size_t i = 0; i < data.size(); i++) {
+    const double r =
+      data.angle[i] - SMALL_RUNE_CURVE(data.time[i], param[0], param[1], param[2], direction);
+    error += r * r;
+  }
+  return error;
+}
+
+double CurveFitter::Curve::predict(double time) const noexcept {
   // If the target is static, return the last angle
-  if (is_static_) {
-    return data_history_queue_.back().angle;
+  if (is_static) {
+    return last_angle;
   }
 
   double pred_angle = 0;
-  if (type_ == MotionType::BIG) {
-    pred_angle = BIG_RUNE_CURVE(current_time,
-                                fitting_param_[0],
-                                fitting_param_[1],
-                                fitting_param_[2],
-                                fitting_param_[3],
-                                fitting_param_[4],
-                                direction_);
-  } else if (type_ == MotionType::SMALL) {
-    pred_angle = SMALL_RUNE_CURVE(
-      current_time, fitting_param_[0], fitting_param_[1], fitting_param_[2], direction_);
+  if (type == MotionType::BIG) {
+    pred_angle = BIG_RUNE_CURVE(time, param[0], param[1], param[2], param[3], param[4], direction);
+  } else if (type == MotionType::SMALL) {
+    pred_angle = SMALL_RUNE_CURVE(time, param[0], param[1], param[2], direction);
   }
 
   return pred_angle;
 }
 
+double CurveFitter::predict(double current_time) { return getCurve().predict(current_time); }
+
+CurveFitter::Curve CurveFitter::getCurve() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  Curve curve;
+  curve.type = type_;
+  curve.param = fitting_param_;
+  curve.direction = direction_;
+  curve.is_static = is_static_;
+  curve.last_angle = data_size_ > 0 ? data_angle_[dataIndex(data_size_ - 1)] : 0;
+  return curve;
+}
+
 void CurveFitter::reset() {
-  if (fitting_future_ != nullptr && fitting_future_->valid()) {
-    fitting_future_->wait();
-    fitting_future_.reset();
-  }
+  std::lock_guard<std::mutex> lock(mtx_);
+  // Drop the fitting in progress
+  generation_++;
+  has_task_ = false;
+  has_fitted_ = false;
+  version_++;
   type_ = MotionType::UNKNOWN;
   direction_ = Direction::UNKNOWN;
-  data_history_queue_.clear();
+  type_streak_ = 0;
+  type_locked_ = false;
+  data_head_ = 0;
+  data_size_ = 0;
+  line_updates_ = 0;
 }
 
 void CurveFitter::setType(const MotionType &t) {
+  std::lock_guard<std::mutex> lock(mtx_);
   // Only available when the auto_type_determined_ is false
   if (type_ == t || auto_type_determined_) {
     return;
   }
 
-  if (fitting_future_ != nullptr && fitting_future_->valid()) {
-    fitting_future_->wait();
-  }
-
+  // The fitting in progress is for the last type
+  generation_++;
+  has_task_ = false;
+  version_++;
   type_ = t;
   if (t == MotionType::BIG) {
     fitting_param_ = {0.9125, 1.942, 2.090 - 0.9125, 0, 0};
@@ -244,13 +443,25 @@ void CurveFitter::setType(const MotionType &t) {
   }
 }
 
-MotionType CurveFitter::getType() const { return type_; }
+MotionType CurveFitter::getType() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return type_;
+}
+
+bool CurveFitter::isTypeLocked() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return type_locked_;
+}
 
 void CurveFitter::setAutoTypeDetermined(bool auto_type_determined) {
+  std::lock_guard<std::mutex> lock(mtx_);
   auto_type_determined_ = auto_type_determined;
+  type_streak_ = 0;
+  type_locked_ = false;
 }
 
 std::string CurveFitter::getDebugText() {
+  std::lock_guard<std::mutex> lock(mtx_);
   std::string t = "Unknown";
 
   if (type_ == MotionType::BIG) {
@@ -276,57 +487,115 @@ std::string CurveFitter::getDebugText() {
 }
 
 void CurveFitter::update(double time, double angle) {
-  data_history_queue_.emplace_back(Data{.time = time, .angle = angle});
+  std::unique_lock<std::mutex> lock(mtx_);
+  if (data_size_ == 0) {
+    line_sums_ = LineSums();
+    line_sums_.t0 = time;
+  }
+  // Limit the size of the queue
+  pushData(time, angle);
+  version_++;
 
   // Start fitting when the queue size reaches the lower limit
-  if (data_history_queue_.size() < QUEUE_LOWER_LIMIT) {
+  if (data_size_ < QUEUE_LOWER_LIMIT) {
     return;
   }
 
-  // Limit the size of the queue
-  if (data_history_queue_.size() > QUEUE_UPPER_LIMIT) {
-    data_history_queue_.pop_front();
-  }
-
   // Check if the target is moving or static
-  double angle_diff = data_history_queue_.back().angle - data_history_queue_.front().angle;
+  double angle_diff = data_angle_[dataIndex(data_size_ - 1)] - data_angle_[data_head_];
   if (std::abs(angle_diff) < 2 * CV_PI / 180) {
     is_static_ = true;
-    data_history_queue_.pop_front();
+    popData();
   } else {
     is_static_ = false;
   }
 
+  // Rebuild the sums once per window so that the rounding of add and remove does not pile up
+  if (++line_updates_ >= QUEUE_UPPER_LIMIT) {
+    line_updates_ = 0;
+    line_sums_ = LineSums();
+    line_sums_.t0 = data_time_[data_head_];
+    for (size_t i = 0; i < data_size_; i++) {
+      line_sums_.add(data_time_[dataIndex(i)], data_angle_[dataIndex(i)]);
+    }
+  }
+
   // Determine the direction of rotation
   direction_ = static_cast<int>(angle_diff < 0 ? Direction::CLOCKWISE : Direction::ANTI_CLOCKWISE);
 
-  auto startFitting = [this]() {
-    if (auto_type_determined_) {
-      fitting_future_ = std::make_unique<std::future<void>>(
-        std::async(std::launch::async, &CurveFitter::fitDoubleCurve, this));
-    } else {
-      fitting_future_ = std::make_unique<std::future<void>>(
-        std::async(std::launch::async, &CurveFitter::fitCurve, this));
+  // A locked automatic type is fitted as if it was set
+  const bool auto_type = auto_type_determined_ && !type_locked_;
+  if (type_ == MotionType::SMALL && !auto_type) {
+    // Closed form in O(1), no need for the worker
+    has_task_ = false;
+    if (!is_static_) {
+      fitSmallCurve(line_sums_, direction_, fitting_param_);
     }
-  };
+    has_fitted_ = true;
+    return;
+  }
 
-  if (fitting_future_ == nullptr) {
-    // First fitting
-    startFitting();
-    // Wait for the first fitting to finish in case the fitting is not finished when the first prediction is needed
-    fitting_future_->wait();
-  } else if (fitting_future_->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-    // Start a new fitting asynchronously
-    startFitting();
-  } else {
-    // If fitting is in progess or has been completed, do not start a new fitting
-    FYT_WARN("rune_solver", "Fitting is in progress, do not start a new fitting");
+  // Snapshot for the worker, a task not started yet is replaced by this newer one
+  copyData(task_.data);
+  task_.line = line_sums_;
+  task_.type = type_;
+  task_.param = fitting_param_;
+  task_.direction = direction_;
+  task_.is_static = is_static_;
+  task_.auto_type_determined = auto_type;
+  task_.generation = generation_;
+
+  if (!has_fitted_) {
+    // First fitting, run it here in case the fitting is not finished when the first prediction
+    // is needed
+    FitTask first = std::move(task_);
+    lock.unlock();
+    runTask(first);
+    lock.lock();
+    if (first.generation == generation_) {
+      acceptTask(first);
+      has_fitted_ = true;
+    }
+    task_ = std::move(first);
+    return;
   }
+
+  has_task_ = true;
+  lock.unlock();
+  cv_.notify_one();
+}
+
+void CurveFitter::pushData(double time, double angle) noexcept {
+  if (data_size_ == QUEUE_UPPER_LIMIT) {
+    popData();
+  }
+  const size_t i = dataIndex(data_size_);
+  data_time_[i] = time;
+  data_angle_[i] = angle;
+  data_size_++;
+  line_sums_.add(time, angle);
+}
+
+void CurveFitter::popData() noexcept {
+  line_sums_.remove(data_time_[data_head_], data_angle_[data_head_]);
+  data_head_ = dataIndex(1);
+  data_size_--;
+}
+
+void CurveFitter::copyData(Samples &samples) const {
+  // The buffers of the task are reused, no allocation once they reach the capacity
+  samples.time.resize(data_size_);
+  samples.angle.resize(data_size_);
+  const size_t first = std::min(data_size_, QUEUE_UPPER_LIMIT - data_head_);
+  std::copy_n(data_time_.begin() + data_head_, first, samples.time.begin());
+  std::copy_n(data_angle_.begin() + data_head_, first, samples.angle.begin());
+  std::copy_n(data_time_.begin(), data_size_ - first, samples.time.begin() + first);
+  std::copy_n(data_angle_.begin(), data_size_ - first, samples.angle.begin() + first);
 }
 
 bool CurveFitter::statusVerified() {
-  if (type_ == MotionType::UNKNOWN || direction_ == Direction::UNKNOWN ||
-      fitting_future_ == nullptr) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (type_ == MotionType::UNKNOWN || direction_ == Direction::UNKNOWN || !has_fitted_) {
     return false;
   }
   return true;
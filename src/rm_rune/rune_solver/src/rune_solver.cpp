@@ -23,6 +23,7 @@
 #include <geometry_msgs/msg/point_stamped.hpp>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
 // std
+#include <cmath>
 #include <memory>
 // third party
 #include <angles/angles.h>
@@ -44,7 +45,12 @@ RuneSolver::RuneSolver(const RuneSolverParams &rsp, std::shared_ptr<tf2_ros::Buf
   trajectory_compensator->gravity = rsp.gravity;
   trajectory_compensator->velocity = rsp.bullet_speed;
   trajectory_compensator->resistance = 0.01;
+  trajectory_compensator->buildTable();
   ekf_state_ = Eigen::Vector4d::Zero();
+  R_odom_2_rune_ = Eigen::Matrix3d::Identity();
+  curve_version_ = 0;
+  last_predicted_angle_ = 0;
+  prediction_valid_ = false;
   manual_compensator = std::make_unique<ManualCompensator>();
 }
 
@@ -55,7 +61,8 @@ double RuneSolver::init(const rm_interfaces::msg::RuneTarget::SharedPtr received
 
   FYT_INFO("rune_solver", "Init!");
 
-  // Init EKF
+  // Init EKF, a new target is solved from scratch
+  has_pnp_guess_ = false;
   try {
     Eigen::Matrix4d T_odom_2_rune = solvePose(*received_target);
 
@@ -83,6 +90,8 @@ double RuneSolver::init(const rm_interfaces::msg::RuneTarget::SharedPtr received
   last_angle_ = last_observed_angle_;
   start_time_ = rclcpp::Time(received_target->header.stamp).seconds();
   last_time_ = start_time_;
+  updateRuneRotation();
+  prediction_valid_ = false;
 
   return observed_angle;
 }
@@ -128,6 +137,8 @@ double RuneSolver::update(const rm_interfaces::msg::RuneTarget::SharedPtr receiv
     last_time_ = now_time;
     last_angle_ = normal_angle;
     last_observed_angle_ = observed_angle;
+    updateRuneRotation();
+    prediction_valid_ = false;
   }
 
   // Update tracker state
@@ -159,9 +170,15 @@ double RuneSolver::update(const rm_interfaces::msg::RuneTarget::SharedPtr receiv
 }
 
 double RuneSolver::predictTarget(Eigen::Vector3d &predicted_position, double timestamp) {
-  double t1 = timestamp - start_time_;
-  double t0 = last_time_ - start_time_;
-  double predict_angle_diff = curve_fitter->predict(t1) - curve_fitter->predict(t0);
+  // Read the version first, a fitting finished in between only makes the next call reload
+  const uint64_t version = curve_fitter->getVersion();
+  if (!prediction_valid_ || version != curve_version_) {
+    curve_version_ = version;
+    curve_ = curve_fitter->getCurve();
+    last_predicted_angle_ = curve_.predict(last_time_ - start_time_);
+    prediction_valid_ = true;
+  }
+  double predict_angle_diff = curve_.predict(timestamp - start_time_) - last_predicted_angle_;
 
   // Get the predicted position
   predicted_position = getTargetPosition(predict_angle_diff);
@@ -178,7 +195,26 @@ Eigen::Matrix4d RuneSolver::solvePose(const rm_interfaces::msg::RuneTarget &pred
                  [](const auto &pt) { return cv::Point2f(pt.x, pt.y); });
 
   cv::Mat rvec(3, 1, CV_64F), tvec(3, 1, CV_64F);
-  if (pnp_solver && pnp_solver->solvePnP(image_points, rvec, tvec, "rune")) {
+  // The rune barely moves in the camera frame between two targets, refine the last pose
+  const double stamp = rclcpp::Time(predicted_target.header.stamp).seconds();
+  bool solved = false;
+  if (pnp_solver && rune_solver_params.pnp_warm_start && has_pnp_guess_ &&
+      std::abs(stamp - pnp_guess_time_) < rune_solver_params.lost_time_thres) {
+    pnp_rvec_.copyTo(rvec);
+    pnp_tvec_.copyTo(tvec);
+    solved = pnp_solver->refinePnP(image_points, rvec, tvec, "rune") &&
+             pnp_solver->calculateReprojectionError(image_points, rvec, tvec, "rune") <
+               rune_solver_params.pnp_max_refine_error * image_points.size();
+  }
+  if (!solved && pnp_solver) {
+    solved = pnp_solver->solvePnP(image_points, rvec, tvec, "rune");
+  }
+  if (solved) {
+    rvec.copyTo(pnp_rvec_);
+    tvec.copyTo(pnp_tvec_);
+    pnp_guess_time_ = stamp;
+    has_pnp_guess_ = true;
+
     // Get the transformation matrix from rune to odom
     try {
       // Get rotation matrix from rvec
@@ -259,6 +295,9 @@ rm_interfaces::msg::GimbalCmd RuneSolver::solveGimbalCmd(const Eigen::Vector3d &
   trajectory_compensator->velocity = rune_solver_params.bullet_speed;
   trajectory_compensator->gravity = rune_solver_params.gravity;
   trajectory_compensator->iteration_times = 30;
+  if (!trajectory_compensator->tableValid()) {
+    trajectory_compensator->buildTable();
+  }
 
   if (double temp_pitch = pitch; trajectory_compensator->compensate(target, temp_pitch)) {
     pitch = temp_pitch;
@@ -335,23 +374,24 @@ Eigen::Vector3d RuneSolver::getCenterPosition() const { return ekf_state_.head(3
 Eigen::Vector3d RuneSolver::getTargetPosition(double angle_diff) const {
   Eigen::Vector3d t_odom_2_rune = ekf_state_.head(3);
 
+  // Calculate the position of the armor in rune frame, (0, -ARM_LENGTH, 0) rotated by
+  // -angle_diff about the x axis
+  Eigen::Vector3d p_rune(0, -ARM_LENGTH * std::cos(angle_diff), ARM_LENGTH * std::sin(angle_diff));
+
+  // Transform to odom frame
+  Eigen::Vector3d p_odom = R_odom_2_rune_ * p_rune + t_odom_2_rune;
+
+  return p_odom;
+}
+
+void RuneSolver::updateRuneRotation() {
   // Considering the large error and jitter(抖动) in the orientation obtained from PnP,
   // and the fact that the position of the Rune are static in the odom frame,
   // it is advisable to reconstruct the rotation matrix using geometric information
   double yaw = ekf_state_(3);
   double pitch = 0;
   double roll = -last_angle_;
-  Eigen::Matrix3d R_odom_2_rune =
-    utils::eulerToMatrix(Eigen::Vector3d{roll, pitch, yaw}, utils::EulerOrder::XYZ);
-
-  // Calculate the position of the armor in rune frame
-  Eigen::Vector3d p_rune = Eigen::AngleAxisd(-angle_diff, Eigen::Vector3d::UnitX()).matrix() *
-                           Eigen::Vector3d(0, -ARM_LENGTH, 0);
-
-  // Transform to odom frame
-  Eigen::Vector3d p_odom = R_odom_2_rune * p_rune + t_odom_2_rune;
-
-  return p_odom;
+  R_odom_2_rune_ = utils::eulerToMatrix(Eigen::Vector3d{roll, pitch, yaw}, utils::EulerOrder::XYZ);
 }
 
 Eigen::Vector4d RuneSolver::getStateFromTransform(const Eigen::Matrix4d &transform) const {
@@ -27,6 +27,7 @@
 #include "rm_utils/common.hpp"
 #include "rm_utils/logger/log.hpp"
 #include "rm_utils/math/pnp_solver.hpp"
+#include "rm_utils/trace.hpp"
 #include "rune_solver/motion_model.hpp"
 
 namespace fyt::rune {
@@ -48,6 +49,8 @@ RuneSolverNode::RuneSolverNode(const rclcpp::NodeOptions &options) : Node("rune_
     .angle_offset_thres = declare_parameter("angle_offset_thres", 0.78),
     .lost_time_thres = declare_parameter("lost_time_thres", 0.5),
     .auto_type_determined = declare_parameter("auto_type_determined", true),
+    .pnp_warm_start = declare_parameter("pnp_warm_start", false),
+    .pnp_max_refine_error = declare_parameter("pnp_max_refine_error", 2.0),
   };
   rune_solver_ = std::make_unique<RuneSolver>(rune_solver_params, tf2_buffer_);
   
@@ -153,12 +156,18 @@ RuneSolverNode::RuneSolverNode(const rclcpp::NodeOptions &options) : Node("rune_
       "rune_solver/marker", rclcpp::SensorDataQoS());
   }
   last_rune_target_.header.frame_id = "";
-  // Timer 250 Hz
-  pub_timer_ = this->create_wall_timer(std::chrono::milliseconds(4),
-                                       std::bind(&RuneSolverNode::timerCallback, this));
+  // Timer, 250 Hz by default
+  double publish_rate = declare_parameter("publish_rate", 250.0);
+  pub_timer_ = this->create_wall_timer(
+    std::chrono::microseconds(static_cast<int64_t>(1e6 / std::max(publish_rate, 1.0))),
+    std::bind(&RuneSolverNode::timerCallback, this));
 
   // Heartbeat
   heartbeat_ = HeartBeatPublisher::create(this);
+  auto &metrics = heartbeat_->metrics();
+  update_latency_ = &metrics.latency("update");
+  end_to_end_latency_ = &metrics.latency("end_to_end");
+  solver_errors_ = &metrics.counter("solver_errors");
 }
 
 void RuneSolverNode::timerCallback() {
@@ -212,6 +221,7 @@ void RuneSolverNode::timerCallback() {
       control_msg = rune_solver_->solveGimbalCmd(pred_pos);
     } catch (...) {
       FYT_ERROR("rune_solver", "solveGimbalCmd error");
+      solver_errors_->fetch_add(1, std::memory_order_relaxed);
       control_msg.yaw_diff = 0;
       control_msg.pitch_diff = 0;
       control_msg.distance = -1;
@@ -228,6 +238,10 @@ void RuneSolverNode::timerCallback() {
     control_msg.fire_advice = false;
   }
   gimbal_pub_->publish(control_msg);
+  if (rune_solver_->tracker_state == RuneSolver::TRACKING) {
+    // From the capture of the frame to the command
+    end_to_end_latency_->record((this->now() - last_rune_target_.header.stamp).nanoseconds());
+  }
 
   if (debug_) {
     // Publish fitting info
@@ -315,6 +329,9 @@ void RuneSolverNode::runeTargetCallback(
     last_rune_target_ = *rune_target_msg;
   }
   double observed_angle = 0;
+  utils::TraceScope trace(utils::TraceStage::RUNE_SOLVE,
+                          rclcpp::Time(rune_target_msg->header.stamp).nanoseconds());
+  utils::LatencyScope latency(update_latency_);
   if (rune_solver_->tracker_state == RuneSolver::LOST) {
     observed_angle = rune_solver_->init(rune_target_msg);
   } else {
@@ -346,6 +363,10 @@ rcl_interfaces::msg::SetParametersResult RuneSolverNode::onSetParameters(
       rune_solver_->rune_solver_params.angle_offset_thres = param.as_double();
     } else if (param.get_name() == "lost_time_thres") {
       rune_solver_->rune_solver_params.lost_time_thres = param.as_double();
+    } else if (param.get_name() == "pnp_warm_start") {
+      rune_solver_->rune_solver_params.pnp_warm_start = param.as_bool();
+    } else if (param.get_name() == "pnp_max_refine_error") {
+      rune_solver_->rune_solver_params.pnp_max_refine_error = param.as_double();
     }
   }
   return result;
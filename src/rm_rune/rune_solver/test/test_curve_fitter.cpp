@@ -0,0 +1,75 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// std
+#include <chrono>
+#include <cmath>
+#include <thread>
+// gtest
+#include <gtest/gtest.h>
+// project
+#include "rm_utils/logger/log.hpp"
+#include "rune_solver/curve_fitter.hpp"
+
+using namespace fyt::rune;
+
+namespace {
+// Big rune seen with spikes of +-8 rad, e.g. blades mistaken for the target. The robust cost
+// prefers the big curve, which ignores the spikes, while the spikes dominate both sums of
+// squares and the BIC settles for the small curve
+constexpr double T0 = 1000.0;
+constexpr double DT = 0.01;
+constexpr double A = 0.9125, OMEGA = 1.942, B = 2.090 - 0.9125;
+
+double inlierAngle(double time) {
+  // The speed crosses B in the first half second, a line follows the curve closely there
+  const double d = CV_PI * std::ceil(OMEGA * (T0 + 0.25) / CV_PI) / OMEGA - (T0 + 0.25);
+  // Zero at T0, the absolute time puts the offset far from zero
+  const double c = -BIG_RUNE_CURVE(T0, A, OMEGA, B, 0.0, d, 1);
+  return BIG_RUNE_CURVE(time, A, OMEGA, B, c, d, 1);
+}
+
+double sampleAngle(int i) {
+  // Pairs of opposite spikes mirrored within two blocks of 20 samples, they do not tilt the line
+  // fitted to a window holding both blocks, i.e. any window the fitter sees
+  const int k = (i - 10) % 20;
+  double spike = 0;
+  if (i >= 10 && i < 50) {
+    spike = k == 3 || k == 14 ? 8.0 : k == 4 || k == 13 ? -8.0 : 0.0;
+  }
+  return inlierAngle(T0 + i * DT) + spike;
+}
+}  // namespace
+
+TEST(CurveFitter, LockedTypeKeepsItsFittedCurve) {
+  // The lock is logged
+  FYT_REGISTER_LOGGER("rune_solver", ::testing::TempDir(), ERROR);
+  CurveFitter fitter(MotionType::UNKNOWN);
+  fitter.setAutoTypeDetermined(true);
+
+  int last = 0;
+  for (int i = 0; i < 500 && !fitter.isTypeLocked(); i++) {
+    fitter.update(T0 + i * DT, sampleAngle(i));
+    last = i;
+    // Let the worker finish, each fitting is a vote on the type
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  ASSERT_TRUE(fitter.isTypeLocked());
+
+  // The curve of the locked type fitted to the data, not its initial parameters
+  const CurveFitter::Curve curve = fitter.getCurve();
+  EXPECT_EQ(curve.type, fitter.getType());
+  const double time = T0 + last * DT;
+  EXPECT_NEAR(curve.predict(time), inlierAngle(time), 0.5);
+}
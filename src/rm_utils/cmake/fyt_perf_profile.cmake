@@ -0,0 +1,67 @@
+# Release build profile of the vision stack, off by default:
+#   colcon build --cmake-args -DFYT_PERF_PROFILE=ON [-DFYT_PERF_MARCH=<cpu>]
+#     [-DFYT_PGO=GENERATE|USE] [-DFYT_PGO_DIR=<dir>]
+#
+# fyt_perf_profile() applies it to the targets created after the call in the calling
+# directory, so it is called right after the dependencies are found:
+#   - LTO (INTERPROCEDURAL_OPTIMIZATION) if the toolchain supports it
+#   - -march=${FYT_PERF_MARCH}, none by default. The packages share Eigen types with the
+#     prebuilt g2o, Ceres and Sophus, which are built for the baseline CPU; Eigen aligns to 32
+#     or 64 bytes under AVX, so a -march is built with the alignment of the baseline
+#     (EIGEN_MAX_ALIGN_BYTES=16) to keep the layouts and the operator new of both sides equal
+#   - PGO: GENERATE instruments the build, running it writes the profiles of each package to
+#     ${FYT_PGO_DIR}/<package>; USE optimizes with them. GENERATE and USE must build in the same
+#     build directory, GCC finds the profiles by the paths of the objects. Clang writes .profraw
+#     files, which are merged to ${FYT_PGO_DIR}/<package>/default.profdata by llvm-profdata
+# This file is included by rm_utils and exported to the packages that depend on it.
+
+option(FYT_PERF_PROFILE "LTO, -march tuning and PGO for the hot packages" OFF)
+set(FYT_PERF_MARCH "" CACHE STRING "-march of the perf profile, e.g. native, empty for none")
+set(FYT_PGO "OFF" CACHE STRING "PGO stage of the perf profile: OFF, GENERATE or USE")
+set_property(CACHE FYT_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(FYT_PGO_DIR "$ENV{HOME}/.cache/fyt_pgo" CACHE PATH "Profiles of the PGO stages")
+
+macro(fyt_perf_profile)
+  if(FYT_PERF_PROFILE)
+    include(CheckIPOSupported)
+    check_ipo_supported(RESULT _fyt_ipo_supported OUTPUT _fyt_ipo_output LANGUAGES CXX)
+    if(_fyt_ipo_supported)
+      set(CMAKE_INTERPROCEDURAL_OPTIMIZATION ON)
+    else()
+      message(WARNING "${PROJECT_NAME}: LTO is not supported: ${_fyt_ipo_output}")
+    endif()
+
+    if(FYT_PERF_MARCH)
+      add_compile_options(-march=${FYT_PERF_MARCH})
+      add_compile_definitions(EIGEN_MAX_ALIGN_BYTES=16 EIGEN_MAX_STATIC_ALIGN_BYTES=16)
+    endif()
+
+    set(_fyt_pgo_dir "${FYT_PGO_DIR}/${PROJECT_NAME}")
+    if(FYT_PGO STREQUAL "GENERATE")
+      file(MAKE_DIRECTORY "${_fyt_pgo_dir}")
+      if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        # The pipeline is multi-threaded, racy counters would be wrong
+        add_compile_options(-fprofile-generate=${_fyt_pgo_dir} -fprofile-update=atomic)
+      else()
+        add_compile_options(-fprofile-generate=${_fyt_pgo_dir})
+      endif()
+      add_link_options(-fprofile-generate=${_fyt_pgo_dir})
+    elseif(FYT_PGO STREQUAL "USE")
+      if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        # Code the training did not run keeps the normal optimization instead of being
+        # optimized for size, a profile that does not match the source is only a warning
+        add_compile_options(-fprofile-use=${_fyt_pgo_dir} -fprofile-partial-training
+                            -fprofile-correction -Wno-missing-profile
+                            -Wno-error=coverage-mismatch)
+      else()
+        add_compile_options(-fprofile-use=${_fyt_pgo_dir}/default.profdata
+                            -Wno-profile-instr-out-of-date -Wno-profile-instr-unprofiled)
+      endif()
+    elseif(NOT FYT_PGO STREQUAL "OFF")
+      message(FATAL_ERROR "FYT_PGO must be OFF, GENERATE or USE, not ${FYT_PGO}")
+    endif()
+
+    message(STATUS "${PROJECT_NAME}: perf profile, LTO ${_fyt_ipo_supported}, "
+                   "march '${FYT_PERF_MARCH}', PGO ${FYT_PGO}")
+  endif()
+endmacro()
@@ -0,0 +1,78 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_ARMOR_NUMBER_HPP_
+#define RM_UTILS_ARMOR_NUMBER_HPP_
+
+// std
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace fyt {
+
+// X(enumerator, display name), the display names are the labels of the number classifier.
+// The values are the NUMBER_* constants of rm_interfaces/msg/Armor.msg, keep them in sync
+#define FYT_ARMOR_NUMBERS(X) \
+  X(UNKNOWN, "")             \
+  X(HERO, "1")               \
+  X(ENGINEER, "2")           \
+  X(INFANTRY_3, "3")         \
+  X(INFANTRY_4, "4")         \
+  X(INFANTRY_5, "5")         \
+  X(OUTPOST, "outpost")      \
+  X(SENTRY, "sentry")        \
+  X(BASE, "base")            \
+  X(NEGATIVE, "negative")
+
+// Robot id carried by the armor messages
+enum class ArmorNumber : uint8_t {
+#define FYT_ARMOR_NUMBER_ENUM(name, str) name,
+  FYT_ARMOR_NUMBERS(FYT_ARMOR_NUMBER_ENUM)
+#undef FYT_ARMOR_NUMBER_ENUM
+    COUNT
+};
+
+namespace detail {
+inline constexpr std::array<std::string_view, static_cast<size_t>(ArmorNumber::COUNT)>
+  ARMOR_NUMBER_NAMES = {
+#define FYT_ARMOR_NUMBER_NAME(name, str) str,
+    FYT_ARMOR_NUMBERS(FYT_ARMOR_NUMBER_NAME)
+#undef FYT_ARMOR_NUMBER_NAME
+};
+}  // namespace detail
+
+// Display name, for logs and markers
+constexpr std::string_view armorNumberToString(ArmorNumber number) noexcept {
+  const auto index = static_cast<size_t>(number);
+  return index < detail::ARMOR_NUMBER_NAMES.size() ? detail::ARMOR_NUMBER_NAMES[index] : "";
+}
+constexpr std::string_view armorNumberToString(uint8_t number) noexcept {
+  return armorNumberToString(static_cast<ArmorNumber>(number));
+}
+
+// Inverse of armorNumberToString(), UNKNOWN if the name is not known
+constexpr ArmorNumber armorNumberFromString(std::string_view name) noexcept {
+  for (size_t i = 1; i < detail::ARMOR_NUMBER_NAMES.size(); i++) {
+    if (detail::ARMOR_NUMBER_NAMES[i] == name) {
+      return static_cast<ArmorNumber>(i);
+    }
+  }
+  return ArmorNumber::UNKNOWN;
+}
+
+}  // namespace fyt
+
+#endif  // RM_UTILS_ARMOR_NUMBER_HPP_
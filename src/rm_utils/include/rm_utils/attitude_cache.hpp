@@ -0,0 +1,146 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef RM_UTILS_ATTITUDE_CACHE_HPP_
+#define RM_UTILS_ATTITUDE_CACHE_HPP_
+
+// std
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+// 3rd party
+#include <Eigen/Geometry>
+
+namespace fyt::utils {
+// Ring buffer of timestamped gimbal attitudes. One writer (e.g. the serial/receive callback)
+// pushes the samples, any number of readers query them without locks: every slot is guarded
+// by a sequence counter and readers retry if the slot is being written.
+template <std::size_t Capacity = 256>
+class AttitudeCache {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+public:
+  struct Sample {
+    int64_t stamp_ns;
+    Eigen::Quaterniond q;
+  };
+
+  // Writer side, stamps must be increasing
+  void push(int64_t stamp_ns, const Eigen::Quaterniond &q) noexcept {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[head & kMask];
+    const uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.stamp_ns.store(stamp_ns, std::memory_order_relaxed);
+    slot.q[0].store(q.w(), std::memory_order_relaxed);
+    slot.q[1].store(q.x(), std::memory_order_relaxed);
+    slot.q[2].store(q.y(), std::memory_order_relaxed);
+    slot.q[3].store(q.z(), std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  bool empty() const noexcept { return head_.load(std::memory_order_acquire) == 0; }
+
+  // Newest sample, return false if the cache is empty
+  bool latest(Sample &sample) const noexcept {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    return head > 0 && read(head - 1, sample);
+  }
+
+  // Attitude at stamp_ns, spherically interpolated between the two nearest samples. A stamp at
+  // most max_extrapolation_ns newer than the newest sample gets the newest attitude.
+  // Return false if stamp_ns is out of the buffered range
+  bool lookup(int64_t stamp_ns,
+              Eigen::Quaterniond &q,
+              int64_t max_extrapolation_ns = 2'000'000) const noexcept {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const uint64_t count = head < Capacity ? head : Capacity - 1;
+
+    Sample newer, older;
+    if (count == 0 || !read(head - 1, newer)) {
+      return false;
+    }
+    if (stamp_ns >= newer.stamp_ns) {
+      if (stamp_ns - newer.stamp_ns > max_extrapolation_ns) {
+        return false;
+      }
+      q = newer.q;
+      return true;
+    }
+
+    // Walk back from the newest sample
+    for (uint64_t i = 2; i <= count; i++) {
+      // Samples must be older and older, otherwise the writer has wrapped around
+      if (!read(head - i, older) || older.stamp_ns > newer.stamp_ns) {
+        return false;
+      }
+      if (older.stamp_ns <= stamp_ns) {
+        const int64_t span = newer.stamp_ns - older.stamp_ns;
+        const double ratio =
+          span > 0 ? static_cast<double>(stamp_ns - older.stamp_ns) / span : 0.0;
+        q = older.q.slerp(ratio, newer.q);
+        return true;
+      }
+      newer = older;
+    }
+    return false;
+  }
+
+private:
+  static constexpr uint64_t kMask = Capacity - 1;
+
+  struct Slot {
+    std::atomic<uint64_t> seq{0};
+    std::atomic<int64_t> stamp_ns{0};
+    // w, x, y, z
+    std::array<std::atomic<double>, 4> q;
+  };
+
+  bool read(uint64_t index, Sample &sample) const noexcept {
+    const Slot &slot = slots_[index & kMask];
+    // Retry a few times if the writer is on this slot
+    for (int retry = 0; retry < 8; retry++) {
+      const uint64_t seq1 = slot.seq.load(std::memory_order_acquire);
+      if (seq1 & 1) {
+        continue;
+      }
+      sample.stamp_ns = slot.stamp_ns.load(std::memory_order_relaxed);
+      sample.q = Eigen::Quaterniond(slot.q[0].load(std::memory_order_relaxed),
+                                    slot.q[1].load(std::memory_order_relaxed),
+                                    slot.q[2].load(std::memory_order_relaxed),
+                                    slot.q[3].load(std::memory_order_relaxed));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == seq1) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::atomic<uint64_t> head_{0};
+  std::array<Slot, Capacity> slots_;
+};
+
+// Cache shared by the nodes of one process. The serial driver composed into the process is its
+// only writer, so the other nodes get the attitude without going through DDS
+AttitudeCache<> &processAttitudeCache();
+// processAttitudeCache() once a serial driver in this process writes it, otherwise fallback,
+// e.g. a cache filled from the serial/receive topic when the driver runs in another process
+const AttitudeCache<> &processAttitudeCacheOr(const AttitudeCache<> &fallback) noexcept;
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_ATTITUDE_CACHE_HPP_
@@ -0,0 +1,44 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_BAYER_HPP_
+#define RM_UTILS_BAYER_HPP_
+
+// std
+#include <string>
+// third party
+#include <opencv2/core.hpp>
+
+namespace fyt::utils {
+// Color filter layout of the top-left 2x2 cell of a raw frame
+enum class BayerPattern { NONE = 0, RGGB, BGGR, GBRG, GRBG };
+
+// Pattern of a sensor_msgs image encoding, e.g. "bayer_rggb8"
+// Return: NONE if the encoding is not 8-bit bayer
+BayerPattern bayerPattern(const std::string &encoding) noexcept;
+
+// sensor_msgs image encoding of an 8-bit pattern, empty for NONE
+std::string bayerEncoding(BayerPattern pattern) noexcept;
+
+// Position of the red pixel in the 2x2 cell, blue is at (1 - x, 1 - y)
+cv::Point bayerRedOffset(BayerPattern pattern) noexcept;
+
+// Demosaic a CV_8UC1 raw frame by the vectorized bilinear demosaic of OpenCV, a cv::UMat
+// runs on OpenCL if available. The frame must start at an even row and column of the sensor
+void bayerToRgb(cv::InputArray bayer, BayerPattern pattern, cv::OutputArray rgb);
+void bayerToBgr(cv::InputArray bayer, BayerPattern pattern, cv::OutputArray bgr);
+void bayerToGray(cv::InputArray bayer, BayerPattern pattern, cv::OutputArray gray);
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_BAYER_HPP_
@@ -0,0 +1,80 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_DEBUG_IMAGE_HPP_
+#define RM_UTILS_DEBUG_IMAGE_HPP_
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+// ros2
+#include <rclcpp/rclcpp.hpp>
+// 3rd party
+#include <opencv2/core.hpp>
+
+namespace fyt::utils {
+
+// How the debug images are shrunk before they are encoded, so that they fit the field Wi-Fi
+struct DebugImageParams {
+  // Factor of the size of the published image, (0, 1]
+  double scale = 1.0;
+  // Publish only the region of the targets, the full image if there is none
+  bool roi_only = false;
+  // Pixels kept around the region, in the original image
+  int roi_margin = 64;
+};
+
+// Declare the parameters <prefix>.scale, <prefix>.roi_only and <prefix>.roi_margin of the node
+DebugImageParams declareDebugImageParams(rclcpp::Node &node, const std::string &prefix);
+
+// Crop the image to the roi (if roi_only and the roi is not empty) and downscale it.
+// Return: the image itself if there is nothing to do, a new image otherwise
+cv::Mat shrinkDebugImage(const cv::Mat &image,
+                         const DebugImageParams &params,
+                         const cv::Rect &roi = cv::Rect());
+
+// Runs the rendering and encoding of the debug images off the detection thread. Only the
+// newest job is kept: a job posted before the worker took the previous one replaces it
+class DebugImageWorker {
+public:
+  explicit DebugImageWorker(const std::string &thread_name);
+  ~DebugImageWorker();
+
+  DebugImageWorker(const DebugImageWorker &) = delete;
+  DebugImageWorker &operator=(const DebugImageWorker &) = delete;
+
+  void post(std::function<void()> job);
+
+  // Jobs replaced before they ran
+  int64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  void run(const std::string &thread_name);
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::function<void()> job_;
+  bool stop_ = false;
+  std::atomic<int64_t> dropped_{0};
+  std::thread thread_;
+};
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_DEBUG_IMAGE_HPP_
@@ -0,0 +1,82 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_DEVICE_CLOCK_HPP_
+#define RM_UTILS_DEVICE_CLOCK_HPP_
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace fyt::utils {
+// Maps the timestamps of a device (e.g. the camera) onto the host clock. A sample is received
+// at device time + offset + transport delay, the delay is positive and varies, so:
+//   - per 0.5 s of device time only the sample of the smallest delay is kept
+//   - the drift of the device oscillator is the least squares slope of these minima
+//   - the offset is the lower envelope of all samples under that slope
+// The mapped time is never later than the receive time. Not thread safe
+class DeviceClock {
+public:
+  explicit DeviceClock(double tick_period_ns = 1.0) noexcept;
+
+  void setTickPeriod(double tick_period_ns) noexcept;
+
+  // Forget all samples, e.g. after the device was reopened
+  void reset() noexcept;
+
+  // Add a sample, the model restarts if the device clock goes backwards
+  // Return: host time of device_ticks in nanoseconds
+  int64_t update(uint64_t device_ticks, int64_t host_ns) noexcept;
+
+  // Host time of device_ticks in nanoseconds, valid after the first update()
+  int64_t toHost(uint64_t device_ticks) const noexcept;
+
+  // Drift of the device clock against the host clock in ppm, positive if the device is slow
+  double driftPpm() const noexcept { return slope_ * 1e6; }
+
+private:
+  // The minimum of offset = host - device among the samples, device time is relative to origin
+  struct Bucket {
+    double device_ns;
+    double offset_ns;
+  };
+
+  void fit() noexcept;
+
+  static constexpr double BUCKET_NS = 5e8;
+  static constexpr size_t BUCKET_NUM = 64;
+  // Drift larger than this is taken as noise
+  static constexpr double MAX_SLOPE = 1e-3;
+
+  double tick_period_ns_;
+  bool has_origin_ = false;
+  uint64_t origin_ticks_ = 0;
+  int64_t origin_host_ns_ = 0;
+  uint64_t last_ticks_ = 0;
+
+  // Ring of the finished buckets and the one being filled
+  std::array<Bucket, BUCKET_NUM> buckets_;
+  size_t bucket_head_ = 0;
+  size_t bucket_size_ = 0;
+  Bucket current_ = {0, 0};
+  int64_t current_index_ = 0;
+
+  // offset = slope_ * device + intercept_
+  double slope_ = 0;
+  double intercept_ = 0;
+};
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_DEVICE_CLOCK_HPP_
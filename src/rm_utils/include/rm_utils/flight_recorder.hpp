@@ -0,0 +1,100 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_FLIGHT_RECORDER_HPP_
+#define RM_UTILS_FLIGHT_RECORDER_HPP_
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+namespace fyt::utils {
+
+// Events of the flight records
+enum class FlightEvent : uint16_t {
+  // id: armor number, values: x, y, z, qx, qy, qz, qw, distance to the image center
+  DETECTION,
+  // id: tracker state (-1 without target), values: xc, yc, zc, yaw, vx, vy, vz, v_yaw, r
+  TRACKER,
+  // id: fire advice, values: pitch, yaw, distance, pitch_diff, yaw_diff
+  COMMAND,
+  // id: mode requested by the MCU, values: none
+  MODE,
+  // id: index of the stage in the watchdog, values: time of the stall in ms
+  STALL,
+  COUNT
+};
+
+constexpr const char *FlightEventNames[static_cast<size_t>(FlightEvent::COUNT)] = {
+  "detection", "tracker", "command", "mode", "stall"};
+
+// Fixed-size record of the flight recorder. frame_id is the stamp of the camera frame in ns
+// (0 if the event belongs to no frame), the values depend on the event
+struct FlightRecord {
+  // System clock in ns
+  int64_t stamp_ns;
+  uint64_t frame_id;
+  uint32_t thread_id;
+  uint16_t event;
+  int16_t id;
+  float values[10];
+};
+static_assert(sizeof(FlightRecord) == 64, "FlightRecord must be 64 bytes");
+
+// Header of a dump, followed by `count` records, in the order of the threads
+struct FlightFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count;
+  int64_t dump_ns;
+};
+
+inline constexpr char FLIGHT_MAGIC[8] = {'F', 'Y', 'T', 'F', 'L', 'I', 'T', 'E'};
+inline constexpr uint32_t FLIGHT_VERSION = 1;
+
+// Always-on in-memory recorder of the last seconds of the pipeline, for the post-mortem of a
+// match without verbose logging. Every thread writes into its own fixed-size ring, a record is
+// a plain store and an atomic increment, nothing is written to disk until a dump:
+//   - a crash signal (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT), once install() was called
+//   - SIGUSR1 (`kill -USR1 <pid>`), once install() was called
+//   - dump(), e.g. by the stall watchdog
+// The dumps are written to <dir>/flight_<pid>_<n>_<reason>.bin, flight_export prints them
+class FlightRecorder {
+public:
+  // Records kept by every thread
+  static constexpr size_t RING_SIZE = 4096;
+  // Threads with a ring, the records of later threads are dropped
+  static constexpr size_t MAX_THREADS = 64;
+
+  // Set the directory of the dumps and install the signal handlers, only the first call of the
+  // process counts. dir: FYT_FLIGHT_DIR if empty, /tmp if both are empty
+  static void install(const std::string &dir = std::string());
+
+  static void record(FlightEvent event,
+                     int16_t id,
+                     uint64_t frame_id,
+                     std::initializer_list<float> values) noexcept;
+
+  // Write the rings of all threads. Async-signal-safe, a dump while another one is running
+  // is skipped. reason: a short name, part of the file name
+  // Return: true if the dump was written
+  static bool dump(const char *reason) noexcept;
+};
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_FLIGHT_RECORDER_HPP_
@@ -16,13 +16,17 @@
 #define RM_UTILS_HEARTBEAT_HPP_
 
 // std
+#include <chrono>
 #include <memory>
 #include <thread>
 // ros2
 #include <rclcpp/rclcpp.hpp>
 #include <std_msgs/msg/int64.hpp>
+// project
+#include "rm_utils/metrics.hpp"
 
 namespace fyt {
+// Publishes <node>/heartbeat and <node>/metrics once a second
 class HeartBeatPublisher {
 public:
   using SharedPtr = std::shared_ptr<HeartBeatPublisher>;
@@ -30,11 +34,22 @@ public:
   static SharedPtr create(rclcpp::Node *node);
 
   ~HeartBeatPublisher();
+
+  // Metrics of the node, registered by the node and reported by the heartbeat thread
+  utils::Metrics &metrics() noexcept { return metrics_; }
+
 private:
   explicit HeartBeatPublisher(rclcpp::Node *node);
 
+  void publishMetrics();
+
   std_msgs::msg::Int64 message_;
   rclcpp::Publisher<std_msgs::msg::Int64>::SharedPtr publisher_;
+  utils::Metrics metrics_;
+  rm_interfaces::msg::NodeMetrics metrics_msg_;
+  rclcpp::Publisher<rm_interfaces::msg::NodeMetrics>::SharedPtr metrics_publisher_;
+  rclcpp::Clock::SharedPtr clock_;
+  std::chrono::steady_clock::time_point last_report_;
   std::thread pub_thread_;
 };
 }  // namespace fyt
@@ -0,0 +1,99 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_LOGGER_ASYNC_BACKEND_HPP_
+#define RM_UTILS_LOGGER_ASYNC_BACKEND_HPP_
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <unordered_set>
+
+// project
+#include "rm_utils/logger/types.hpp"
+#include "rm_utils/mpsc_queue.hpp"
+
+namespace fyt::logger::internal {
+class Logger;
+
+// A formatted message waiting for the backend, longer messages are truncated
+struct Record {
+  static constexpr std::size_t MAX_SIZE = 480;
+  Logger *logger;
+  int64_t stamp_ns;
+  LogLevel level;
+  uint16_t size;
+  char text[MAX_SIZE];
+};
+
+// Process-wide writer thread of all the loggers. Logger::log only formats the message into a
+// record of a lock-free ring, the thread adds the prefixes, prints to the console and writes
+// the files in batches, flushing them every FLUSH_PERIOD_MS or right after an ERROR / FATAL
+class AsyncBackend {
+public:
+  // Never destroyed, the thread is stopped at exit after writing all the records
+  static AsyncBackend &instance();
+
+  // Return false if the ring is full (the record is dropped and counted) or the backend is
+  // stopped, then the caller writes the record itself
+  template <typename F>
+  bool push(F &&fill) {
+    if (stopped_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (!queue_.emplace(std::forward<F>(fill))) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    pushed_.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  // Wait until every record pushed before is written and flushed
+  void flush();
+
+  // Write the rest of the records and stop the thread, records are written by their callers
+  // afterwards
+  void stop();
+
+private:
+  AsyncBackend();
+
+  void run();
+  // Drain the ring, return the number of records written
+  size_t writeBatch();
+  void flushFiles();
+
+  static constexpr size_t QUEUE_SIZE = 1024;
+  static constexpr int FLUSH_PERIOD_MS = 100;
+  static constexpr int IDLE_SLEEP_MS = 2;
+
+  utils::MpscQueue<Record, QUEUE_SIZE> queue_;
+  std::atomic<bool> stopped_{false};
+  std::atomic<bool> running_{true};
+  std::atomic<uint64_t> pushed_{0};
+  std::atomic<uint64_t> written_{0};
+  std::atomic<uint64_t> flushed_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<bool> flush_requested_{false};
+  // Only used by the writer thread
+  std::unordered_set<Logger *> dirty_loggers_;
+  uint64_t reported_dropped_ = 0;
+  std::thread thread_;
+};
+}  // namespace fyt::logger::internal
+
+#endif  // RM_UTILS_LOGGER_ASYNC_BACKEND_HPP_
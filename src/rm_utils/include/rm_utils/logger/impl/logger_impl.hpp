@@ -17,8 +17,13 @@
 #define RM_UTILS_LOGGER_LOGGER_IMPL_HPP_
 
 // std
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -26,8 +31,10 @@
 // fmt
 #include <fmt/color.h>
 #include <fmt/core.h>
+#include <fmt/format.h>
 
 // project
+#include "rm_utils/logger/impl/async_backend.hpp"
 #include "rm_utils/logger/impl/writer.hpp"
 #include "rm_utils/logger/types.hpp"
 
@@ -38,22 +45,38 @@ class Logger {
 public:
   Logger(std::string name, std::string path, LogLevel level, LogOptions ops);
 
+  // Only formats the message into a record, the prefixes are added and the record is written
+  // by the backend thread. Messages below the level of the logger are dropped
   template <typename... Args>
   void log(LogLevel level, const std::string &format, Args... args) {
-    std::string log_info = fmt::format(format, args...);
-    std::string level_prefix = fmt::format("[{}] ", LogNameTable[static_cast<std::uint8_t>(level)]);
-    std::string name_prefix = fmt::format("[{}] ", name_);
-    std::string log_time = fmt::format("[{}] ", getLocalTime());
-    std::string message =
-      fmt::format("{} {} {}: {}", level_prefix, name_prefix, log_time, log_info);
-
-    if (level >= this->level_) {
-      std::string colored_message =
-        fmt::format(LogColorTable[static_cast<std::uint8_t>(level)], message);
-      writer_->write(colored_message);
+    if (!enabled(level)) {
+      return;
+    }
+    const int64_t stamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::system_clock::now().time_since_epoch())
+                               .count();
+    auto fill = [&](Record &record) {
+      record.logger = this;
+      record.stamp_ns = stamp_ns;
+      record.level = level;
+      const auto result = fmt::format_to_n(record.text, Record::MAX_SIZE, format, args...);
+      record.size = static_cast<uint16_t>(std::min(result.size, Record::MAX_SIZE));
+    };
+    if (!AsyncBackend::instance().push(fill)) {
+      // The backend is stopped at exit
+      Record record;
+      fill(record);
+      fmt::memory_buffer console;
+      write(record, console);
+      std::lock_guard<std::mutex> lock(consle_mutex_);
+      std::fwrite(console.data(), 1, console.size(), stdout);
+      writer_->flush();
+      return;
+    }
+    if (level == LogLevel::FATAL) {
+      // Usually followed by a shutdown
+      AsyncBackend::instance().flush();
     }
-    std::lock_guard<std::mutex> lock(consle_mutex_);
-    fmt::print(fg(LogFmtColorTable[static_cast<std::uint8_t>(level)]), "{}\n", message);
   }
 
   template <typename... Args>
@@ -89,14 +112,25 @@ public:
 
   void setLevel(LogLevel level);
 
+  bool enabled(LogLevel level) const {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+
+  // Wait for the backend to write the records logged before and flush the file
   void flush();
 
+  // Add the prefixes to a record, write it to the file (without flushing) and append the colored
+  // message to the console buffer. Called by the backend thread
+  void write(const Record &record, fmt::memory_buffer &console);
+
+  void flushFile();
+
 private:
   std::string getLocalTime();
 
   std::mutex &consle_mutex_;
   std::string name_;
-  LogLevel level_;
+  std::atomic<LogLevel> level_;
   std::unique_ptr<Writer> writer_;
 };
 }  // namespace internal
@@ -25,9 +25,17 @@
       name, path, fyt::logger::LogLevel::level, DATE_DIR | DATE_SUFFIX); \
   } while (0)
 
-#define FYT_LOG(name, level, ...)                                     \
-  do {                                                                \
-    fyt::logger::LoggerPool::getLogger(name).log(level, __VA_ARGS__); \
+// The logger of a call site is looked up once, the message is only formatted if its level is
+// enabled. name must be a string literal
+#define FYT_LOG(name, level, ...)                                               \
+  do {                                                                          \
+    if constexpr (level >= fyt::logger::LOG_MIN_LEVEL) {                        \
+      static fyt::logger::internal::Logger &fyt_logger_ =                       \
+        fyt::logger::LoggerPool::getLogger(name);                               \
+      if (fyt_logger_.enabled(level)) {                                         \
+        fyt_logger_.log(level, __VA_ARGS__);                                    \
+      }                                                                         \
+    }                                                                           \
   } while (0)
 
 #define FYT_DEBUG(name, ...) FYT_LOG(name, fyt::logger::LogLevel::DEBUG, __VA_ARGS__)
@@ -31,6 +31,13 @@ namespace fyt::logger {
 
 enum class LogLevel : std::uint8_t { DEBUG, INFO, WARN, ERROR, FATAL };
 
+// Messages below FYT_LOG_MIN_LEVEL (0 = DEBUG ... 4 = FATAL) are compiled out and their arguments
+// are never evaluated, e.g. add_compile_definitions(FYT_LOG_MIN_LEVEL=1) drops FYT_DEBUG
+#ifndef FYT_LOG_MIN_LEVEL
+#define FYT_LOG_MIN_LEVEL 0
+#endif
+inline constexpr LogLevel LOG_MIN_LEVEL = static_cast<LogLevel>(FYT_LOG_MIN_LEVEL);
+
 constexpr const char *LogNameTable[5] = {"DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
 
 // DEBUG = gray, INFO = white, WARN = yellow, ERROR = red, FATAL = blue
@@ -0,0 +1,405 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_BATCHED_KALMAN_FILTER_HPP_
+#define RM_UTILS_BATCHED_KALMAN_FILTER_HPP_
+
+// std
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+// Eigen
+#include <Eigen/Dense>
+
+namespace fyt {
+
+// K Kalman filters of the same dimensions run side by side, e.g. the tracks of a tracker bank.
+// The storage is a structure of arrays: element i of a vector (i, j of a matrix) of all the
+// filters is one array of K lanes, so every step is a loop over the lanes that the compiler
+// vectorizes, instead of K small matrix products.
+//   - predict() is linear, F and Q are shared by the batch (one dt per frame). Zeros of F are
+//     skipped, a constant velocity F costs about one multiply-add per element of P
+//   - update() linearizes the measurement of every lane by a functor working on the lanes, and
+//     only changes the lanes of the mask: the others keep their prediction
+// The update is the one of ExtendedKalmanFilter up to the rounding: P = P - K S K^T, which is
+// the Joseph form for the optimal gain, kept exactly symmetric.
+// Scalar is the type of the lanes. With float a vector register holds twice the lanes and the
+// batch takes half the cache, the states and covariances are still exchanged in double
+template <int N_X, int N_Z, int K, typename Scalar = double>
+class BatchedKalmanFilter {
+public:
+  static_assert(K > 0 && K <= 64, "the lanes of a mask are the bits of a uint64_t");
+
+  static constexpr int LANES = K;
+  using ScalarType = Scalar;
+  static_assert(std::is_floating_point_v<Scalar>);
+
+  using MatrixXX = Eigen::Matrix<double, N_X, N_X>;
+  using MatrixX1 = Eigen::Matrix<double, N_X, 1>;
+  using MatrixZZ = Eigen::Matrix<double, N_Z, N_Z>;
+  using MatrixZ1 = Eigen::Matrix<double, N_Z, 1>;
+
+  // Lanes of the vectors and matrices, [i][k] / [i][j][k] is element i / (i, j) of lane k
+  using StateLanes = Scalar[N_X][K];
+  using MeasurementLanes = Scalar[N_Z][K];
+  using NoiseLanes = Scalar[N_Z][N_Z][K];
+  using JacobianLanes = Scalar[N_Z][N_X][K];
+
+  BatchedKalmanFilter() noexcept {
+    for (int k = 0; k < K; k++) {
+      setState(k, MatrixX1::Zero());
+      setCovariance(k, MatrixXX::Identity());
+      log_likelihood_[k] = 0;
+    }
+  }
+
+  void setState(int k, const MatrixX1 &x) noexcept {
+    for (int i = 0; i < N_X; i++) {
+      x_[i][k] = toLane(x(i));
+    }
+  }
+
+  MatrixX1 getState(int k) const noexcept {
+    MatrixX1 x;
+    for (int i = 0; i < N_X; i++) {
+      x(i) = x_[i][k];
+    }
+    return x;
+  }
+
+  void setCovariance(int k, const MatrixXX &P) noexcept {
+    for (int i = 0; i < N_X; i++) {
+      for (int j = 0; j < N_X; j++) {
+        P_[i][j][k] = toLane(P(i, j));
+      }
+    }
+  }
+
+  MatrixXX getCovariance(int k) const noexcept {
+    MatrixXX P;
+    for (int i = 0; i < N_X; i++) {
+      for (int j = 0; j < N_X; j++) {
+        P(i, j) = P_[i][j][k];
+      }
+    }
+    return P;
+  }
+
+  // Log likelihood of the measurement of lane k in the last update(), log N(z; z_pri, S),
+  // -inf if the lane was not updated
+  double getLogLikelihood(int k) const noexcept { return log_likelihood_[k]; }
+
+  // x = F x and P = F P F^T + Q in every lane
+  void predict(const MatrixXX &F, const MatrixXX &Q) noexcept {
+    // Nonzero elements of F by row
+    int nonzero_n[N_X];
+    int nonzero_col[N_X][N_X];
+    for (int i = 0; i < N_X; i++) {
+      nonzero_n[i] = 0;
+      for (int a = 0; a < N_X; a++) {
+        if (F(i, a) != 0) {
+          nonzero_col[i][nonzero_n[i]++] = a;
+        }
+      }
+    }
+
+    // T = F P, then P = T F^T + Q
+    for (int i = 0; i < N_X; i++) {
+      for (int b = 0; b < N_X; b++) {
+        Scalar *t = tmp_[i][b];
+        for (int k = 0; k < K; k++) {
+          t[k] = 0;
+        }
+        for (int n = 0; n < nonzero_n[i]; n++) {
+          const int a = nonzero_col[i][n];
+          const Scalar f = static_cast<Scalar>(F(i, a));
+          const Scalar *p = P_[a][b];
+          for (int k = 0; k < K; k++) {
+            t[k] += f * p[k];
+          }
+        }
+      }
+    }
+    for (int i = 0; i < N_X; i++) {
+      for (int j = i; j < N_X; j++) {
+        Scalar *p = P_[i][j];
+        const Scalar q = static_cast<Scalar>(Q(i, j));
+        for (int k = 0; k < K; k++) {
+          p[k] = q;
+        }
+        for (int n = 0; n < nonzero_n[j]; n++) {
+          const int b = nonzero_col[j][n];
+          const Scalar f = static_cast<Scalar>(F(j, b));
+          const Scalar *t = tmp_[i][b];
+          for (int k = 0; k < K; k++) {
+            p[k] += t[k] * f;
+          }
+        }
+      }
+      mirrorRow(i);
+    }
+
+    for (int i = 0; i < N_X; i++) {
+      Scalar *x = xp_[i];
+      for (int k = 0; k < K; k++) {
+        x[k] = 0;
+      }
+      for (int n = 0; n < nonzero_n[i]; n++) {
+        const int a = nonzero_col[i][n];
+        const Scalar f = static_cast<Scalar>(F(i, a));
+        for (int k = 0; k < K; k++) {
+          x[k] += f * x_[a][k];
+        }
+      }
+    }
+    for (int i = 0; i < N_X; i++) {
+      for (int k = 0; k < K; k++) {
+        x_[i][k] = xp_[i][k];
+      }
+    }
+  }
+
+  // Update the lanes of mask (bit k for lane k) with the measurements z and their noises R.
+  // measure(x, z_pri, H) writes the predicted measurements and the jacobians of all lanes from
+  // the states, H is zeroed before. The lanes out of mask, and the lanes whose innovation
+  // covariance is not positive definite, keep their prediction
+  // Return: the mask of the updated lanes
+  template <class MeasureLanes>
+  uint64_t update(const MeasurementLanes &z,
+                  const NoiseLanes &R,
+                  uint64_t mask,
+                  MeasureLanes &&measure) noexcept {
+    for (int m = 0; m < N_Z; m++) {
+      for (int i = 0; i < N_X; i++) {
+        for (int k = 0; k < K; k++) {
+          H_[m][i][k] = 0;
+        }
+      }
+    }
+    measure(x_, z_pri_, H_);
+    // Elements of H that are zero in every lane are skipped, a measurement jacobian is sparse
+    int nonzero_n[N_Z];
+    int nonzero_col[N_Z][N_X];
+    for (int m = 0; m < N_Z; m++) {
+      nonzero_n[m] = 0;
+      for (int j = 0; j < N_X; j++) {
+        bool zero = true;
+        for (int k = 0; k < K; k++) {
+          zero = zero && H_[m][j][k] == 0;
+        }
+        if (!zero) {
+          nonzero_col[m][nonzero_n[m]++] = j;
+        }
+      }
+    }
+
+    // PH^T, then S = H PH^T + R
+    for (int i = 0; i < N_X; i++) {
+      for (int m = 0; m < N_Z; m++) {
+        Scalar *pht = PHt_[i][m];
+        for (int k = 0; k < K; k++) {
+          pht[k] = 0;
+        }
+        for (int n = 0; n < nonzero_n[m]; n++) {
+          const int j = nonzero_col[m][n];
+          const Scalar *p = P_[i][j];
+          const Scalar *h = H_[m][j];
+          for (int k = 0; k < K; k++) {
+            pht[k] += p[k] * h[k];
+          }
+        }
+      }
+    }
+    for (int m = 0; m < N_Z; m++) {
+      for (int n = 0; n <= m; n++) {
+        Scalar *s = L_[m][n];
+        for (int k = 0; k < K; k++) {
+          s[k] = R[m][n][k];
+        }
+        for (int c = 0; c < nonzero_n[m]; c++) {
+          const int i = nonzero_col[m][c];
+          const Scalar *h = H_[m][i];
+          const Scalar *pht = PHt_[i][n];
+          for (int k = 0; k < K; k++) {
+            s[k] += h[k] * pht[k];
+          }
+        }
+      }
+    }
+
+    // Cholesky factor of S in place, S = L L^T. A lane that is not positive definite gets the
+    // identity and drops out of the mask
+    for (int k = 0; k < K; k++) {
+      active_[k] = (mask >> k) & 1 ? Scalar(1) : Scalar(0);
+    }
+    for (int j = 0; j < N_Z; j++) {
+      Scalar *d = L_[j][j];
+      for (int p = 0; p < j; p++) {
+        for (int k = 0; k < K; k++) {
+          d[k] -= L_[j][p][k] * L_[j][p][k];
+        }
+      }
+      for (int k = 0; k < K; k++) {
+        const bool ok = d[k] > 0;
+        active_[k] = ok ? active_[k] : Scalar(0);
+        d[k] = std::sqrt(ok ? d[k] : Scalar(1));
+        inv_diag_[j][k] = Scalar(1) / d[k];
+      }
+      for (int i = j + 1; i < N_Z; i++) {
+        Scalar *l = L_[i][j];
+        for (int p = 0; p < j; p++) {
+          for (int k = 0; k < K; k++) {
+            l[k] -= L_[i][p][k] * L_[j][p][k];
+          }
+        }
+        for (int k = 0; k < K; k++) {
+          l[k] *= inv_diag_[j][k];
+        }
+      }
+    }
+    // A degenerated lane must not spread NaN through the masked updates
+    for (int j = 0; j < N_Z; j++) {
+      for (int k = 0; k < K; k++) {
+        inv_diag_[j][k] = active_[k] != 0 ? inv_diag_[j][k] : Scalar(1);
+      }
+      for (int i = j; i < N_Z; i++) {
+        for (int k = 0; k < K; k++) {
+          L_[i][j][k] = active_[k] != 0 ? L_[i][j][k] : (i == j ? Scalar(1) : Scalar(0));
+        }
+      }
+    }
+
+    // Gain K = PH^T S^-1, row by row: solve L w = (PH^T)_i, then L^T k_i = w
+    for (int i = 0; i < N_X; i++) {
+      solve(PHt_[i], gain_[i]);
+    }
+
+    // Innovation of the active lanes, whitened for the likelihood
+    for (int m = 0; m < N_Z; m++) {
+      for (int k = 0; k < K; k++) {
+        innovation_[m][k] = active_[k] != 0 ? z[m][k] - z_pri_[m][k] : Scalar(0);
+      }
+    }
+    for (int m = 0; m < N_Z; m++) {
+      for (int k = 0; k < K; k++) {
+        Scalar w = innovation_[m][k];
+        for (int p = 0; p < m; p++) {
+          w -= L_[m][p][k] * whitened_[p][k];
+        }
+        whitened_[m][k] = w * inv_diag_[m][k];
+      }
+    }
+    const double log_norm = 0.5 * N_Z * std::log(2 * M_PI);
+    for (int k = 0; k < K; k++) {
+      double squared_norm = 0, log_det = 0;
+      for (int m = 0; m < N_Z; m++) {
+        squared_norm += whitened_[m][k] * whitened_[m][k];
+        log_det += std::log(L_[m][m][k]);
+      }
+      log_likelihood_[k] = active_[k] != 0 ? -0.5 * squared_norm - log_det - log_norm
+                                           : -std::numeric_limits<double>::infinity();
+    }
+
+    // x += K y, the innovation of the other lanes is 0
+    for (int i = 0; i < N_X; i++) {
+      for (int m = 0; m < N_Z; m++) {
+        const Scalar *g = gain_[i][m];
+        for (int k = 0; k < K; k++) {
+          x_[i][k] += g[k] * innovation_[m][k];
+        }
+      }
+    }
+    // P -= K (PH^T)^T = K S K^T on the active lanes
+    for (int i = 0; i < N_X; i++) {
+      for (int j = i; j < N_X; j++) {
+        Scalar *p = P_[i][j];
+        for (int m = 0; m < N_Z; m++) {
+          const Scalar *g = gain_[i][m];
+          const Scalar *pht = PHt_[j][m];
+          for (int k = 0; k < K; k++) {
+            p[k] -= active_[k] * g[k] * pht[k];
+          }
+        }
+      }
+      mirrorRow(i);
+    }
+
+    uint64_t updated = 0;
+    for (int k = 0; k < K; k++) {
+      updated |= active_[k] != 0 ? uint64_t{1} << k : 0;
+    }
+    return updated;
+  }
+
+private:
+  // A value below the smallest normal Scalar would be a denormal, slow in every operation after.
+  // A vanishing element of P reaches it within a few frames in float
+  static Scalar toLane(double v) noexcept {
+    return std::abs(v) < std::numeric_limits<Scalar>::min() ? Scalar(0) : static_cast<Scalar>(v);
+  }
+
+  // Copy the upper part of row i to column i
+  void mirrorRow(int i) noexcept {
+    for (int j = i + 1; j < N_X; j++) {
+      for (int k = 0; k < K; k++) {
+        P_[j][i][k] = P_[i][j][k];
+      }
+    }
+  }
+
+  // out = S^-1 b in every lane, by the Cholesky factor in L_
+  void solve(const Scalar (&b)[N_Z][K], Scalar (&out)[N_Z][K]) const noexcept {
+    for (int m = 0; m < N_Z; m++) {
+      for (int k = 0; k < K; k++) {
+        Scalar w = b[m][k];
+        for (int p = 0; p < m; p++) {
+          w -= L_[m][p][k] * out[p][k];
+        }
+        out[m][k] = w * inv_diag_[m][k];
+      }
+    }
+    for (int m = N_Z - 1; m >= 0; m--) {
+      for (int k = 0; k < K; k++) {
+        Scalar w = out[m][k];
+        for (int p = m + 1; p < N_Z; p++) {
+          w -= L_[p][m][k] * out[p][k];
+        }
+        out[m][k] = w * inv_diag_[m][k];
+      }
+    }
+  }
+
+  alignas(64) Scalar x_[N_X][K];
+  alignas(64) Scalar P_[N_X][N_X][K];
+  double log_likelihood_[K];
+
+  // Buffers of predict() and update()
+  alignas(64) Scalar xp_[N_X][K];
+  alignas(64) Scalar tmp_[N_X][N_X][K];
+  alignas(64) Scalar z_pri_[N_Z][K];
+  alignas(64) Scalar H_[N_Z][N_X][K];
+  alignas(64) Scalar PHt_[N_X][N_Z][K];
+  // S and its Cholesky factor, lower part
+  alignas(64) Scalar L_[N_Z][N_Z][K];
+  alignas(64) Scalar inv_diag_[N_Z][K];
+  alignas(64) Scalar gain_[N_X][N_Z][K];
+  alignas(64) Scalar innovation_[N_Z][K];
+  alignas(64) Scalar whitened_[N_Z][K];
+  alignas(64) Scalar active_[K];
+};
+
+}  // namespace fyt
+
+#endif  // RM_UTILS_BATCHED_KALMAN_FILTER_HPP_
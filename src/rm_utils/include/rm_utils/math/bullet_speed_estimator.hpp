@@ -0,0 +1,90 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_BULLET_SPEED_ESTIMATOR_HPP_
+#define RM_UTILS_BULLET_SPEED_ESTIMATOR_HPP_
+
+// std
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace fyt {
+// Median of the muzzle speeds of the last shots. The referee system reports the speed of the
+// last shot again and again, so a sample equal to the previous one is not counted as a new shot
+class BulletSpeedEstimator {
+public:
+  // window_size is at least 1, it is signed so that a negative parameter is not a huge window
+  BulletSpeedEstimator(double initial_speed,
+                       int window_size = 10,
+                       double min_speed = 10.0,
+                       double max_speed = 35.0)
+  : window_size_(static_cast<std::size_t>(std::max(window_size, 1)))
+  , estimate_(initial_speed)
+  , min_speed_(min_speed)
+  , max_speed_(max_speed) {
+    window_.reserve(window_size_);
+    sorted_.reserve(window_size_);
+  }
+
+  // Return true if the estimate changes
+  bool update(double measured_speed) noexcept {
+    // Not a new shot, or an implausible reading
+    if (measured_speed == last_measured_ || measured_speed < min_speed_ ||
+        measured_speed > max_speed_) {
+      return false;
+    }
+    last_measured_ = measured_speed;
+
+    if (window_.size() < window_size_) {
+      window_.push_back(measured_speed);
+    } else {
+      window_[next_] = measured_speed;
+      next_ = (next_ + 1) % window_.size();
+    }
+
+    sorted_.assign(window_.begin(), window_.end());
+    auto mid = sorted_.begin() + sorted_.size() / 2;
+    std::nth_element(sorted_.begin(), mid, sorted_.end());
+    double median = *mid;
+    if (sorted_.size() % 2 == 0) {
+      median = 0.5 * (median + *std::max_element(sorted_.begin(), mid));
+    }
+
+    if (median == estimate_) {
+      return false;
+    }
+    estimate_ = median;
+    return true;
+  }
+
+  double estimate() const noexcept { return estimate_; }
+
+  // Number of shots in the window
+  std::size_t size() const noexcept { return window_.size(); }
+
+private:
+  std::size_t window_size_;
+  std::vector<double> window_;
+  std::vector<double> sorted_;
+  std::size_t next_ = 0;
+  double last_measured_ = 0;
+  double estimate_;
+  double min_speed_;
+  double max_speed_;
+};
+}  // namespace fyt
+
+#endif  // RM_UTILS_BULLET_SPEED_ESTIMATOR_HPP_
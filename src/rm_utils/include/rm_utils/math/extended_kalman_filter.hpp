@@ -21,7 +21,11 @@
 #define RM_UTILS_KALMAN_FILTER_HPP_
 
 // std
+#include <cmath>
 #include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
 // Eigen
 #include <Eigen/Dense>
 // ceres
@@ -29,12 +33,41 @@
 
 namespace fyt {
 
-// Extended Kalman Filter with auto differentiation
+namespace detail {
+// True if Func provides an analytic jacobian: void jacobian(const X &x, J &jacobian)
+template <class Func, class X, class J, class = void>
+struct HasJacobian : std::false_type {};
+template <class Func, class X, class J>
+struct HasJacobian<
+  Func, X, J,
+  std::void_t<decltype(std::declval<const Func &>().jacobian(std::declval<const X &>(),
+                                                             std::declval<J &>()))>>
+  : std::true_type {};
+
+// True if Func declares static constexpr bool is_linear = true, its jacobian is then constant
+template <class Func, class = void>
+struct IsLinear : std::false_type {};
+template <class Func>
+struct IsLinear<Func, std::enable_if_t<Func::is_linear>> : std::true_type {};
+}  // namespace detail
+
+// Extended Kalman Filter
 // N_X: state vector dimension
 // N_Z: measurement vector dimension
 // PredicFunc: process nonlinear vector function
 // MeasureFunc: observation nonlinear vector function
-template <int N_X, int N_Z, class PredicFunc, class MeasureFunc>
+// UpdateQFunc: process noise, MatrixXX()
+// UpdateRFunc: measurement noise, MatrixZZ(const MatrixZ1 &z)
+// If PredicFunc / MeasureFunc have a member jacobian(x, J), it is used instead of
+// auto differentiation. If they are also linear (detail::IsLinear), the jacobian is evaluated
+// once when the function is set and the filter runs as a linear Kalman filter
+template <int N_X,
+          int N_Z,
+          class PredicFunc,
+          class MeasureFunc,
+          class UpdateQFunc = std::function<Eigen::Matrix<double, N_X, N_X>()>,
+          class UpdateRFunc =
+            std::function<Eigen::Matrix<double, N_Z, N_Z>(const Eigen::Matrix<double, N_Z, 1> &)>>
 class ExtendedKalmanFilter {
 public:
   ExtendedKalmanFilter() = default;
@@ -46,9 +79,6 @@ public:
   using MatrixX1 = Eigen::Matrix<double, N_X, 1>;
   using MatrixZ1 = Eigen::Matrix<double, N_Z, 1>;
 
-  using UpdateQFunc = std::function<MatrixXX()>;
-  using UpdateRFunc = std::function<MatrixZZ(const MatrixZ1 &z)>;
-
   explicit ExtendedKalmanFilter(const PredicFunc &f,
                                 const MeasureFunc &h,
                                 const UpdateQFunc &u_q,
@@ -57,29 +87,75 @@ public:
   : f(f), h(h), update_Q(u_q), update_R(u_r), P_post(P0) {
     F = MatrixXX::Zero();
     H = MatrixZX::Zero();
+    x_post = MatrixX1::Zero();
+    x_pri = MatrixX1::Zero();
+    linearizeConstant();
   }
 
   // Set the initial state
   void setState(const MatrixX1 &x0) noexcept { x_post = x0; }
 
-  void setPredictFunc(const PredicFunc &f) noexcept { this->f = f; }
+  const MatrixX1 &getState() const noexcept { return x_post; }
+
+  void setCovariance(const MatrixXX &P) noexcept { P_post = P; }
+
+  const MatrixXX &getCovariance() const noexcept { return P_post; }
+
+  // Covariance of the last predict()
+  const MatrixXX &getPredictedCovariance() const noexcept { return P_pri; }
+
+  // Replace the result of the last predict(), e.g. by a discrete change of the state between
+  // predict() and update()
+  void setPrediction(const MatrixX1 &x, const MatrixXX &P) noexcept {
+    x_pri = x;
+    x_post = x;
+    P_pri = P;
+  }
+
+  // Log likelihood of the last measurement given the prediction, log N(z; z_pri, S)
+  double getLogLikelihood() const noexcept { return log_likelihood; }
+
+  void setPredictFunc(const PredicFunc &f) noexcept {
+    this->f = f;
+    if constexpr (LINEAR_PREDICT) {
+      this->f.jacobian(x_post, F);
+    }
+  }
+
+  void setMeasureFunc(const MeasureFunc &h) noexcept {
+    this->h = h;
+    if constexpr (LINEAR_MEASURE) {
+      this->h.jacobian(x_post, H);
+    }
+  }
+
+  void setUpdateQFunc(const UpdateQFunc &u_q) noexcept { update_Q = u_q; }
+
+  void setUpdateRFunc(const UpdateRFunc &u_r) noexcept { update_R = u_r; }
 
-  void setMeasureFunc(const MeasureFunc &h) noexcept { this->h = h; }
+  const UpdateRFunc &getUpdateRFunc() const noexcept { return update_R; }
 
   // Compute a predicted state
   MatrixX1 predict() noexcept {
-    ceres::Jet<double, N_X> x_e_jet[N_X];
-    for (int i = 0; i < N_X; ++i) {
-      x_e_jet[i].a = x_post[i];
-      x_e_jet[i].v[i] = 1.;
-      // a 对自己的偏导数为 1.
-    }
-    ceres::Jet<double, N_X> x_p_jet[N_X];
-    f(x_e_jet, x_p_jet);
+    if constexpr (LINEAR_PREDICT) {
+      x_pri.noalias() = F * x_post;
+    } else if constexpr (detail::HasJacobian<PredicFunc, MatrixX1, MatrixXX>::value) {
+      f(x_post.data(), x_pri.data());
+      f.jacobian(x_post, F);
+    } else {
+      ceres::Jet<double, N_X> x_e_jet[N_X];
+      for (int i = 0; i < N_X; ++i) {
+        x_e_jet[i].a = x_post[i];
+        x_e_jet[i].v[i] = 1.;
+        // a 对自己的偏导数为 1.
+      }
+      ceres::Jet<double, N_X> x_p_jet[N_X];
+      f(x_e_jet, x_p_jet);
 
-    for (int i = 0; i < N_X; ++i) {
-      x_pri[i] = x_p_jet[i].a;
-      F.block(i, 0, 1, N_X) = x_p_jet[i].v.transpose();
+      for (int i = 0; i < N_X; ++i) {
+        x_pri[i] = x_p_jet[i].a;
+        F.block(i, 0, 1, N_X) = x_p_jet[i].v.transpose();
+      }
     }
 
     Q = update_Q();
@@ -89,30 +165,83 @@ public:
     return x_pri;
   }
 
+  // Predicted measurement and innovation covariance S = H * P_pri * H^T + R of the last
+  // prediction, R is evaluated at the predicted measurement. For gating, call after predict()
+  void predictMeasurement(MatrixZ1 &z_pri, MatrixZZ &S) noexcept {
+    linearizeMeasurement(z_pri);
+    S = H * P_pri * H.transpose() + update_R(z_pri);
+  }
+
   // Update the estimated state based on measurement
   MatrixX1 update(const MatrixZ1 &z) noexcept {
-    ceres::Jet<double, N_X> x_p_jet[N_X];
-    for (int i = 0; i < N_X; i++) {
-      x_p_jet[i].a = x_pri[i];
-      x_p_jet[i].v[i] = 1;
-    }
-    ceres::Jet<double, N_X> z_p_jet[N_Z];
-    h(x_p_jet, z_p_jet);
-
     MatrixZ1 z_pri;
-    for (int i = 0; i < N_Z; i++) {
-      z_pri[i] = z_p_jet[i].a;
-      H.block(i, 0, 1, N_X) = z_p_jet[i].v.transpose();
-    }
+    linearizeMeasurement(z_pri);
 
     R = update_R(z);
-    K = P_pri * H.transpose() * (H * P_pri * H.transpose() + R).inverse();
-    x_post = x_post + K * (z - z_pri);
-    P_post = (MatrixXX::Identity() - K * H) * P_pri;
+    // The innovation covariance is symmetric positive definite, K = P * H^T * S^-1
+    const Eigen::Matrix<double, N_Z, N_X> HP = H * P_pri;
+    const MatrixZZ S = HP * H.transpose() + R;
+    const Eigen::LLT<MatrixZZ> llt(S);
+    if (llt.info() != Eigen::Success) {
+      // Degenerated covariance, keep the prediction
+      P_post = P_pri;
+      log_likelihood = -std::numeric_limits<double>::infinity();
+      return x_post;
+    }
+    K = llt.solve(HP).transpose();
+    const MatrixZ1 innovation = z - z_pri;
+    const MatrixZ1 whitened = llt.matrixL().solve(innovation);
+    log_likelihood = -0.5 * whitened.squaredNorm() -
+                     llt.matrixLLT().diagonal().array().log().sum() -
+                     0.5 * N_Z * std::log(2 * M_PI);
+    x_post = x_post + K * innovation;
+    // Joseph form keeps P_post symmetric positive semi-definite
+    const MatrixXX I_KH = MatrixXX::Identity() - K * H;
+    P_post = I_KH * P_pri * I_KH.transpose() + K * R * K.transpose();
     return x_post;
   }
 
 private:
+  static constexpr bool LINEAR_PREDICT =
+    detail::IsLinear<PredicFunc>::value &&
+    detail::HasJacobian<PredicFunc, MatrixX1, MatrixXX>::value;
+  static constexpr bool LINEAR_MEASURE =
+    detail::IsLinear<MeasureFunc>::value &&
+    detail::HasJacobian<MeasureFunc, MatrixX1, MatrixZX>::value;
+
+  // The constant jacobians of the linear functions
+  void linearizeConstant() noexcept {
+    if constexpr (LINEAR_PREDICT) {
+      f.jacobian(x_post, F);
+    }
+    if constexpr (LINEAR_MEASURE) {
+      h.jacobian(x_post, H);
+    }
+  }
+
+  // z_pri = h(x_pri), H = dh/dx at x_pri
+  void linearizeMeasurement(MatrixZ1 &z_pri) noexcept {
+    if constexpr (LINEAR_MEASURE) {
+      z_pri.noalias() = H * x_pri;
+    } else if constexpr (detail::HasJacobian<MeasureFunc, MatrixX1, MatrixZX>::value) {
+      h(x_pri.data(), z_pri.data());
+      h.jacobian(x_pri, H);
+    } else {
+      ceres::Jet<double, N_X> x_p_jet[N_X];
+      for (int i = 0; i < N_X; i++) {
+        x_p_jet[i].a = x_pri[i];
+        x_p_jet[i].v[i] = 1;
+      }
+      ceres::Jet<double, N_X> z_p_jet[N_Z];
+      h(x_p_jet, z_p_jet);
+
+      for (int i = 0; i < N_Z; i++) {
+        z_pri[i] = z_p_jet[i].a;
+        H.block(i, 0, 1, N_X) = z_p_jet[i].v.transpose();
+      }
+    }
+  }
+
   // Process nonlinear vector function
   PredicFunc f;
   MatrixXX F;
@@ -138,6 +267,8 @@ private:
   MatrixX1 x_pri;
   // Posteriori state
   MatrixX1 x_post;
+
+  double log_likelihood = 0;
 };
 
 }  // namespace fyt
@@ -0,0 +1,203 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_INTERACTING_MULTIPLE_MODEL_HPP_
+#define RM_UTILS_INTERACTING_MULTIPLE_MODEL_HPP_
+
+// std
+#include <cmath>
+#include <utility>
+#include <vector>
+// Eigen
+#include <Eigen/Dense>
+
+namespace fyt {
+
+// Interacting Multiple Model estimator over a set of Kalman filters sharing the state space.
+// Filter must provide predict(), update(z), setState(x), getState(), getCovariance(),
+// setCovariance(P), getLogLikelihood(), predictMeasurement(z, S), getPredictedCovariance() and
+// setPrediction(x, P), like ExtendedKalmanFilter.
+// With a single filter it is exactly that filter
+template <class Filter>
+class InteractingMultipleModel {
+public:
+  using MatrixX1 = typename Filter::MatrixX1;
+  using MatrixXX = typename Filter::MatrixXX;
+  using MatrixZ1 = typename Filter::MatrixZ1;
+  using MatrixZZ = typename Filter::MatrixZZ;
+
+  // transition(i, j): probability of switching from model i to model j, rows sum to 1
+  InteractingMultipleModel(std::vector<Filter> filters,
+                           const Eigen::MatrixXd &transition,
+                           const Eigen::VectorXd &initial_probabilities)
+  : filters_(std::move(filters))
+  , transition_(transition)
+  , initial_mu_(initial_probabilities)
+  , mu_(initial_probabilities)
+  , c_(initial_probabilities) {
+    log_likelihood_.resize(filters_.size());
+    mixed_x_.resize(filters_.size());
+    mixed_p_.resize(filters_.size());
+    model_z_.resize(filters_.size());
+    model_s_.resize(filters_.size());
+  }
+
+  size_t size() const noexcept { return filters_.size(); }
+
+  Filter &filter(size_t i) noexcept { return filters_[i]; }
+
+  // Model probabilities after the last update
+  const Eigen::VectorXd &getProbabilities() const noexcept { return mu_; }
+
+  void resetProbabilities() noexcept { mu_ = c_ = initial_mu_; }
+
+  // Restore the probabilities and the combined state, e.g. from a stored snapshot
+  void restore(const Eigen::VectorXd &probabilities, const MatrixX1 &x) noexcept {
+    mu_ = c_ = probabilities;
+    x_ = x;
+  }
+
+  // Set the state of all models, the covariances are kept
+  void setState(const MatrixX1 &x) noexcept {
+    for (auto &filter : filters_) {
+      filter.setState(x);
+    }
+    x_ = x;
+  }
+
+  const MatrixX1 &getState() const noexcept { return x_; }
+
+  MatrixX1 predict() noexcept {
+    if (filters_.size() == 1) {
+      return x_ = filters_.front().predict();
+    }
+    const int n = static_cast<int>(filters_.size());
+
+    // Mixing, c_j = sum_i p_ij mu_i and mu_ij = p_ij mu_i / c_j
+    c_.noalias() = transition_.transpose() * mu_;
+    for (int j = 0; j < n; j++) {
+      mixed_x_[j].setZero();
+      for (int i = 0; i < n; i++) {
+        mixed_x_[j] += mixingWeight(i, j) * filters_[i].getState();
+      }
+      mixed_p_[j].setZero();
+      for (int i = 0; i < n; i++) {
+        const MatrixX1 d = filters_[i].getState() - mixed_x_[j];
+        mixed_p_[j] += mixingWeight(i, j) * (filters_[i].getCovariance() + d * d.transpose());
+      }
+    }
+
+    x_.setZero();
+    for (int j = 0; j < n; j++) {
+      filters_[j].setState(mixed_x_[j]);
+      filters_[j].setCovariance(mixed_p_[j]);
+      x_ += c_(j) * filters_[j].predict();
+    }
+    // Without a measurement the predicted model probabilities are the best guess
+    mu_ = c_;
+    return x_;
+  }
+
+  // Apply f(j, x, P) to the prediction of every model j, between predict() and update(), e.g. a
+  // discrete change of the state. Return the combined prediction
+  template <class F>
+  MatrixX1 transformPrediction(F &&f) {
+    x_.setZero();
+    for (size_t j = 0; j < filters_.size(); j++) {
+      MatrixX1 x = filters_[j].getState();
+      MatrixXX P = filters_[j].getPredictedCovariance();
+      f(j, x, P);
+      filters_[j].setPrediction(x, P);
+      x_ += (filters_.size() == 1 ? 1.0 : c_(j)) * x;
+    }
+    return x_;
+  }
+
+  // Predicted measurement and innovation covariance of the mixture, the spread of the model
+  // predictions is added to S. For gating, call after predict()
+  void predictMeasurement(MatrixZ1 &z_pri, MatrixZZ &S) noexcept {
+    if (filters_.size() == 1) {
+      filters_.front().predictMeasurement(z_pri, S);
+      return;
+    }
+    const int n = static_cast<int>(filters_.size());
+    z_pri.setZero();
+    for (int j = 0; j < n; j++) {
+      filters_[j].predictMeasurement(model_z_[j], model_s_[j]);
+      z_pri += c_(j) * model_z_[j];
+    }
+    S.setZero();
+    for (int j = 0; j < n; j++) {
+      const MatrixZ1 d = model_z_[j] - z_pri;
+      S += c_(j) * (model_s_[j] + d * d.transpose());
+    }
+  }
+
+  MatrixX1 update(const MatrixZ1 &z) noexcept {
+    if (filters_.size() == 1) {
+      return x_ = filters_.front().update(z);
+    }
+    const int n = static_cast<int>(filters_.size());
+
+    for (int j = 0; j < n; j++) {
+      filters_[j].update(z);
+      log_likelihood_(j) = filters_[j].getLogLikelihood();
+    }
+    // mu_j is proportional to c_j * L_j, normalized in the log domain
+    const double max_log_likelihood = log_likelihood_.maxCoeff();
+    if (std::isfinite(max_log_likelihood)) {
+      mu_ = c_.cwiseProduct((log_likelihood_.array() - max_log_likelihood).exp().matrix());
+      const double sum = mu_.sum();
+      if (sum > 0) {
+        mu_ /= sum;
+      } else {
+        mu_ = c_;
+      }
+    }
+
+    x_.setZero();
+    for (int j = 0; j < n; j++) {
+      x_ += mu_(j) * filters_[j].getState();
+    }
+    return x_;
+  }
+
+private:
+  double mixingWeight(int i, int j) const noexcept {
+    return c_(j) > 0 ? transition_(i, j) * mu_(i) / c_(j) : 0;
+  }
+
+  std::vector<Filter> filters_;
+  Eigen::MatrixXd transition_;
+  Eigen::VectorXd initial_mu_;
+  // Model probabilities
+  Eigen::VectorXd mu_;
+  // Predicted model probabilities
+  Eigen::VectorXd c_;
+
+  MatrixX1 x_ = MatrixX1::Zero();
+  // Buffer of update()
+  Eigen::VectorXd log_likelihood_;
+  // Buffers of the mixing step
+  std::vector<MatrixX1> mixed_x_;
+  std::vector<MatrixXX> mixed_p_;
+  // Buffers of predictMeasurement()
+  std::vector<MatrixZ1> model_z_;
+  std::vector<MatrixZZ> model_s_;
+};
+
+}  // namespace fyt
+
+#endif  // RM_UTILS_INTERACTING_MULTIPLE_MODEL_HPP_
@@ -15,6 +15,7 @@
 #ifndef RM_UTILS_MANUAL_COMPENSATOR_HPP_
 #define RM_UTILS_MANUAL_COMPENSATOR_HPP_
 
+#include <array>
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -43,6 +44,9 @@ namespace fyt {
         return false;
       }
 
+      double lowwer() const { return lowwer_; }
+      double upper() const { return upper_; }
+
     private:
       double lowwer_;
       double upper_;
@@ -67,7 +71,9 @@ namespace fyt {
 
       ManualCompensator() = default;
 
-      std::vector<double> angleHardCorrect(const double dist, const double height);
+      // Return {pitch_offset, yaw_offset} of the region containing (dist, height),
+      // two binary searches in the compiled index
+      std::array<double, 2> angleHardCorrect(const double dist, const double height) const;
 
       bool updateMap(const LineRegion& d_region,
                      const LineRegion& h_region,
@@ -88,7 +94,16 @@ namespace fyt {
     private:
       bool parseStr(const std::string& str, std::vector<double>& nums); 
 
+      // Split the plane by all region bounds into a grid of cells, each cell holds the
+      // offsets of the first region covering it
+      void compileIndex();
+
       std::vector<DistMapNode> angle_offset_map_;
+
+      // Sorted bounds of all regions, and the (dist cell, height cell) row-major grid
+      std::vector<double> dist_bounds_;
+      std::vector<double> height_bounds_;
+      std::vector<std::array<double, 2>> cells_;
   };
 }  // namespace fyt
 #endif
\ No newline at end of file
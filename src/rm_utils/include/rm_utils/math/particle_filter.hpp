@@ -16,81 +16,126 @@
 #define RM_UTILS_MATH_PARTICLE_FILTER_HPP_
 
 #include <Eigen/Dense>
+#include <cmath>
+#include <functional>
 #include <random>
-#include <set>
+#include <type_traits>
+#include <utility>
 
 namespace fyt {
 
-template <int N_X, int N_Z, int P_NUM>
-// 粒子滤波器，目前实现的版本效率不高，可以考虑使用OpenMP等并行计算库进行优化
+namespace detail {
+// True if Func evaluates all particles at once: void operator()(const In &in, Out &out)
+template <class Func, class In, class Out, class = void>
+struct IsBatchFunc : std::false_type {};
+template <class Func, class In, class Out>
+struct IsBatchFunc<
+  Func, In, Out,
+  std::void_t<decltype(std::declval<const Func &>()(std::declval<const In &>(),
+                                                    std::declval<Out &>()))>>
+  : std::true_type {};
+}  // namespace detail
+
+// 粒子滤波器
+// PredictFunc / MeasureFunc 可以逐个粒子计算 (VectorX f(const VectorX &))，
+// 也可以一次计算全部粒子 (void f(const Particles &in, Particles &out))，后者便于向量化。
+// 逐个粒子计算时，若以 -fopenmp 编译则并行计算，此时函数需要线程安全
+template <int N_X,
+          int N_Z,
+          int P_NUM,
+          class PredictFunc = std::function<Eigen::Matrix<double, N_X, 1>(
+            const Eigen::Matrix<double, N_X, 1> &)>,
+          class MeasureFunc = std::function<Eigen::Matrix<double, N_Z, 1>(
+            const Eigen::Matrix<double, N_X, 1> &)>,
+          class UpdateQFunc = std::function<Eigen::Matrix<double, N_X, N_X>()>,
+          class UpdateRFunc =
+            std::function<Eigen::Matrix<double, N_Z, N_Z>(const Eigen::Matrix<double, N_Z, 1> &)>>
 class ParticleFilter {
+public:
   using Particles = Eigen::Matrix<double, N_X, P_NUM>;
+  using Measurements = Eigen::Matrix<double, N_Z, P_NUM>;
   using Weights = Eigen::Matrix<double, P_NUM, 1>;
   using VectorX = Eigen::Matrix<double, N_X, 1>;
   using VectorZ = Eigen::Matrix<double, N_Z, 1>;
   using MatrixXX = Eigen::Matrix<double, N_X, N_X>;
   using MatrixZZ = Eigen::Matrix<double, N_Z, N_Z>;
 
-  using PredictFunc = std::function<VectorX(const VectorX &)>;
-  using MeasureFunc = std::function<VectorZ(const VectorX &)>;
-  using UpdateQFunc = std::function<MatrixXX()>;
-  using UpdateRFunc = std::function<MatrixZZ(const VectorZ &z)>;
-
-public:
   explicit ParticleFilter(const PredictFunc &f,
                           const MeasureFunc &h,
                           const UpdateQFunc &u_q,
-                          const UpdateRFunc &u_r) noexcept
-  : f(f), h(h), update_q(u_q), update_r(u_r) {
+                          const UpdateRFunc &u_r,
+                          unsigned int seed = std::random_device{}()) noexcept
+  : f(f), h(h), update_q(u_q), update_r(u_r), gen_(seed) {
     particles_ = Particles::Zero();
     weights_ = Weights::Zero();
   }
 
   void initState(const VectorX &x0) noexcept {
-    auto noise = generateRandomNoise(update_q());
+    Particles noise;
+    generateRandomNoise(update_q(), noise);
 
     particles_ = x0.replicate(1, P_NUM) + noise;
-    weights_ = Weights::Ones() / P_NUM;
+    weights_ = Weights::Constant(1.0 / P_NUM);
   }
 
   void setDim(size_t dim, double val) {
-    std::random_device rd;
-    auto gen = std::default_random_engine(rd());
     auto process_cov = update_q();
-    auto normal_distribution = std::normal_distribution<double>(val, process_cov(dim, dim));
+    auto normal_distribution =
+      std::normal_distribution<double>(val, std::sqrt(process_cov(dim, dim)));
 
     for (int i = 0; i < P_NUM; ++i) {
-      particles_(dim, i) = normal_distribution(gen);
+      particles_(dim, i) = normal_distribution(gen_);
     }
   }
 
   VectorX predict() {
-    Particles pred_particles = Particles::Zero();
     // 根据状态转移方程进行预测
-    for (int i = 0; i < P_NUM; i++) {
-      pred_particles.col(i) = f(particles_.col(i));
+    if constexpr (detail::IsBatchFunc<PredictFunc, Particles, Particles>::value) {
+      f(particles_, pred_particles_);
+    } else {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (int i = 0; i < P_NUM; i++) {
+        pred_particles_.col(i) = f(particles_.col(i));
+      }
     }
-    particles_ = pred_particles;
+    particles_.swap(pred_particles_);
     return particles_ * weights_;
   }
 
   VectorX update(const VectorZ &z) {
-    Weights w = Weights::Zero();
-    MatrixZZ measurement_cov = update_r(z);
-
-    // 基于高斯分布计算权重
-    for (int i = 0; i < P_NUM; i++) {
-      VectorZ z_hat = h(particles_.col(i));
-      double prob = gaussainLikelyhood(z, z_hat, measurement_cov);
-
-      w(i) = prob * weights_(i);
+    if constexpr (detail::IsBatchFunc<MeasureFunc, Particles, Measurements>::value) {
+      h(particles_, z_hat_);
+    } else {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (int i = 0; i < P_NUM; i++) {
+        z_hat_.col(i) = h(particles_.col(i));
+      }
     }
 
-    weights_ = w / w.sum();
+    // 基于高斯分布计算权重，协方差只分解一次
+    // 归一化常数对所有粒子相同，在对数域计算以免下溢
+    const Eigen::LLT<MatrixZZ> llt(update_r(z));
+    if (llt.info() != Eigen::Success) {
+      return particles_ * weights_;
+    }
+    Measurements diff = z.replicate(1, P_NUM) - z_hat_;
+    llt.matrixL().solveInPlace(diff);
+    log_weights_ = -0.5 * diff.colwise().squaredNorm().transpose() +
+                   weights_.array().log().matrix();
+    const double max_log_weight = log_weights_.maxCoeff();
+    if (!std::isfinite(max_log_weight)) {
+      return particles_ * weights_;
+    }
+    weights_ = (log_weights_.array() - max_log_weight).exp().matrix();
+    weights_ /= weights_.sum();
     VectorX pred = particles_ * weights_;
 
     // n_eff: 有效粒子数
-    double n_eff = 1.0 / (weights_.transpose() * weights_).value();
+    double n_eff = 1.0 / weights_.squaredNorm();
     // 有效粒子数小于一半时重采样
     if (n_eff < P_NUM * 0.5) {
       resample();
@@ -100,60 +145,50 @@ public:
   }
 
 private:
+  // 系统重采样，O(N)
   void resample() {
-    Particles new_particles = Particles::Zero();
-    Weights new_weights = Weights::Zero();
-    Particles noise = generateRandomNoise(update_q());
-
-    std::random_device rd;
-    auto gen = std::default_random_engine(rd());
-    // 根据权重进行重采样，每个粒子出现概率等于其权重
-    auto discrete_distribution =
-      std::discrete_distribution<int>(weights_.data(), weights_.data() + P_NUM);
-
-    std::set<int> idx_set;
+    Particles noise;
+    generateRandomNoise(update_q(), noise);
+
+    // 每个粒子被采样的次数正比于其权重
+    const double step = 1.0 / P_NUM;
+    double u = std::uniform_real_distribution<double>(0, step)(gen_);
+    double cumulative = weights_(0);
+    int idx = 0;
+    int last_idx = -1;
     for (int i = 0; i < P_NUM; i++) {
-      int idx = discrete_distribution(gen);
-      new_particles.col(i) = particles_.col(idx);
+      while (u > cumulative && idx < P_NUM - 1) {
+        cumulative += weights_(++idx);
+      }
+      pred_particles_.col(i) = particles_.col(idx);
 
       // 只对已经采样过的粒子添加噪声
       // 保证原来的优秀粒子能存活下来，不被噪声覆盖
-      if (idx_set.find(idx) != idx_set.end()) {
-        new_particles.col(i) += noise.col(i);
+      if (idx == last_idx) {
+        pred_particles_.col(i) += noise.col(i);
       }
-
-      new_weights(i) = 1.0 / P_NUM;
-      idx_set.insert(idx);
+      last_idx = idx;
+      u += step;
     }
-    particles_ = new_particles;
-    weights_ = new_weights;
-  }
-
-  template <int dim>
-  double gaussainLikelyhood(const Eigen::Matrix<double, dim, 1> &x,
-                            const Eigen::Matrix<double, dim, 1> &mean,
-                            const Eigen::Matrix<double, dim, dim> &cov) {
-    // 在服从均值为mean，协方差为cov的高斯分布下，x出现的概率
-    auto diff = x - mean;
-    auto exponent = -0.5 * diff.transpose() * cov.inverse() * diff;
-    return std::exp(exponent) / std::sqrt(std::pow(2 * M_PI, dim) * cov.determinant());
+    particles_.swap(pred_particles_);
+    weights_.setConstant(step);
   }
 
-  // 生成服从高斯分布的随机噪声，假设各个维度之间相互独立
-  Particles generateRandomNoise(const MatrixXX &cov) {
-    std::random_device rd;
-    auto gen = std::default_random_engine(rd());
-    auto distributions = std::vector<std::normal_distribution<double>>(N_X);
-    for (int i = 0; i < N_X; ++i) {
-      distributions[i] = std::normal_distribution<double>(0, cov(i, i));
-    }
-    Particles noise = Particles::Zero();
-    for (int i = 0; i < N_X; ++i) {
-      for (int j = 0; j < P_NUM; ++j) {
-        noise(i, j) = distributions[i](gen);
+  // 生成服从高斯分布的随机噪声
+  void generateRandomNoise(const MatrixXX &cov, Particles &noise) {
+    std::normal_distribution<double> distribution(0, 1);
+    for (int j = 0; j < P_NUM; ++j) {
+      for (int i = 0; i < N_X; ++i) {
+        noise(i, j) = distribution(gen_);
       }
     }
-    return noise;
+    const Eigen::LLT<MatrixXX> llt(cov);
+    if (llt.info() == Eigen::Success) {
+      noise = llt.matrixL() * noise;
+    } else {
+      // 非正定时退化为对角协方差
+      noise = cov.diagonal().cwiseMax(0).cwiseSqrt().asDiagonal() * noise;
+    }
   }
 
 private:
@@ -163,6 +198,13 @@ private:
   UpdateRFunc update_r;
   Particles particles_;
   Weights weights_;
+
+  // Buffers reused by every call
+  Particles pred_particles_;
+  Measurements z_hat_;
+  Weights log_weights_;
+
+  std::mt19937 gen_;
 };
 }  // namespace fyt
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,271 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_PLANAR_PNP_SOLVER_HPP_
+#define RM_UTILS_PLANAR_PNP_SOLVER_HPP_
+
+// std
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+#include <vector>
+// 3rd party
+#include <Eigen/Dense>
+#include <opencv2/core.hpp>
+
+namespace fyt {
+// PnP solver for N coplanar object points (IPPE, Collins & Bartoli 2014).
+// Everything that only depends on the object points is computed once in addObjectPoints(),
+// so solve() only runs a fixed-size homography fit and the closed-form IPPE decomposition.
+// Object models are referred to by the integer handle returned by addObjectPoints().
+template <int N>
+class PlanarPnPSolver {
+  static_assert(N >= 4, "A homography needs at least 4 points");
+
+public:
+  struct Solution {
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    // Sum of the reprojection distances, same as PnPSolver::calculateReprojectionError
+    double reprojection_error;
+  };
+
+  // distortion_coefficients: plumb bob model (k1, k2, p1, p2, k3), missing ones are zero
+  PlanarPnPSolver(const std::array<double, 9> &camera_matrix,
+                  const std::vector<double> &distortion_coefficients) {
+    fx_ = camera_matrix[0];
+    fy_ = camera_matrix[4];
+    cx_ = camera_matrix[2];
+    cy_ = camera_matrix[5];
+    dist_.fill(0);
+    std::copy_n(distortion_coefficients.begin(),
+                std::min<std::size_t>(distortion_coefficients.size(), dist_.size()),
+                dist_.begin());
+  }
+
+  // Add a planar object model, return its handle
+  template <class PointContainer>
+  int addObjectPoints(const PointContainer &object_points) {
+    Model model;
+    for (int i = 0; i < N; i++) {
+      model.points[i] = Eigen::Vector3d(object_points[i].x, object_points[i].y, object_points[i].z);
+    }
+
+    // Plane basis from the scatter matrix, the normal has the smallest eigenvalue
+    model.centroid.setZero();
+    for (const auto &p : model.points) {
+      model.centroid += p;
+    }
+    model.centroid /= N;
+    Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+    for (const auto &p : model.points) {
+      scatter += (p - model.centroid) * (p - model.centroid).transpose();
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(scatter);
+    Eigen::Matrix3d basis = eigen_solver.eigenvectors();
+    // Columns: in-plane axes (largest eigenvalues first) and the normal, right-handed
+    model.R_plane_object.row(0) = basis.col(2).transpose();
+    model.R_plane_object.row(1) = basis.col(1).transpose();
+    model.R_plane_object.row(2) = basis.col(2).cross(basis.col(1)).transpose();
+
+    // Plane coordinates, scaled to unit RMS for a well conditioned homography fit
+    double sum_sq = 0;
+    for (int i = 0; i < N; i++) {
+      Eigen::Vector3d p = model.R_plane_object * (model.points[i] - model.centroid);
+      model.plane_points[i] = p.head<2>();
+      sum_sq += model.plane_points[i].squaredNorm();
+    }
+    model.scale = std::sqrt(N / std::max(sum_sq, 1e-12));
+    for (auto &p : model.plane_points) {
+      p *= model.scale;
+    }
+
+    models_.emplace_back(std::move(model));
+    return static_cast<int>(models_.size()) - 1;
+  }
+
+  // Solve both IPPE solutions, sorted by reprojection error. Return the number of solutions
+  template <class PointContainer>
+  int solve(const PointContainer &image_points, int model_id,
+            std::array<Solution, 2> &solutions) const noexcept {
+    if (model_id < 0 || model_id >= static_cast<int>(models_.size())) {
+      return 0;
+    }
+    const Model &model = models_[model_id];
+
+    std::array<Eigen::Vector2d, N> normalized;
+    for (int i = 0; i < N; i++) {
+      normalized[i] = undistort(image_points[i].x, image_points[i].y);
+    }
+
+    // Homography from the scaled plane coordinates to the normalized image, H(2, 2) = 1
+    Eigen::Matrix<double, 2 * N, 8> A;
+    Eigen::Matrix<double, 2 * N, 1> b;
+    for (int i = 0; i < N; i++) {
+      const double x = model.plane_points[i].x(), y = model.plane_points[i].y();
+      const double u = normalized[i].x(), v = normalized[i].y();
+      A.row(2 * i) << x, y, 1, 0, 0, 0, -u * x, -u * y;
+      A.row(2 * i + 1) << 0, 0, 0, x, y, 1, -v * x, -v * y;
+      b(2 * i) = u;
+      b(2 * i + 1) = v;
+    }
+    const Eigen::Matrix<double, 8, 1> h = A.householderQr().solve(b);
+    if (!h.allFinite()) {
+      return 0;
+    }
+
+    // Jacobian of the homography at the plane origin, undo the scaling of the plane
+    const double p = h(2), q = h(5);
+    Eigen::Matrix2d J;
+    J << h(0) - h(6) * p, h(1) - h(7) * p, h(3) - h(6) * q, h(4) - h(7) * q;
+    J *= model.scale;
+
+    std::array<Eigen::Matrix3d, 2> R_camera_plane;
+    if (!computeRotations(J, p, q, R_camera_plane)) {
+      return 0;
+    }
+
+    for (int k = 0; k < 2; k++) {
+      Solution &solution = solutions[k];
+      solution.R = R_camera_plane[k] * model.R_plane_object;
+      solution.t = computeTranslation(model, normalized, solution.R);
+      solution.reprojection_error = reprojectionError(model, image_points, solution);
+    }
+    if (solutions[1].reprojection_error < solutions[0].reprojection_error) {
+      std::swap(solutions[0], solutions[1]);
+    }
+    return 2;
+  }
+
+  // Project a point in camera coordinate to the image, with distortion
+  cv::Point2d project(const Eigen::Vector3d &p) const noexcept {
+    const double x = p.x() / p.z(), y = p.y() / p.z();
+    const double k1 = dist_[0], k2 = dist_[1], p1 = dist_[2], p2 = dist_[3], k3 = dist_[4];
+    const double r2 = x * x + y * y;
+    const double radial = 1 + ((k3 * r2 + k2) * r2 + k1) * r2;
+    const double xd = x * radial + 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+    const double yd = y * radial + p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+    return cv::Point2d(fx_ * xd + cx_, fy_ * yd + cy_);
+  }
+
+private:
+  struct Model {
+    std::array<Eigen::Vector3d, N> points;
+    Eigen::Vector3d centroid;
+    // Rotation from the object frame to the plane frame (plane is z = 0)
+    Eigen::Matrix3d R_plane_object;
+    std::array<Eigen::Vector2d, N> plane_points;
+    double scale;
+  };
+
+  // Same iterations as cv::undistortPoints with the default criteria
+  Eigen::Vector2d undistort(double u, double v) const noexcept {
+    const double x0 = (u - cx_) / fx_, y0 = (v - cy_) / fy_;
+    const double k1 = dist_[0], k2 = dist_[1], p1 = dist_[2], p2 = dist_[3], k3 = dist_[4];
+    double x = x0, y = y0;
+    for (int i = 0; i < 5; i++) {
+      const double r2 = x * x + y * y;
+      const double icdist = 1 / (1 + ((k3 * r2 + k2) * r2 + k1) * r2);
+      const double delta_x = 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+      const double delta_y = p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+      x = (x0 - delta_x) * icdist;
+      y = (y0 - delta_y) * icdist;
+    }
+    return Eigen::Vector2d(x, y);
+  }
+
+  // IPPE: the two rotations of the plane from the jacobian J of the homography at the plane
+  // origin and (p, q), the normalized image of the origin
+  static bool computeRotations(const Eigen::Matrix2d &J, double p, double q,
+                               std::array<Eigen::Matrix3d, 2> &rotations) noexcept {
+    // Rotation taking the z axis to the ray through the origin's image
+    const Eigen::Matrix3d Rv =
+      Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitZ(), Eigen::Vector3d(p, q, 1))
+        .toRotationMatrix();
+
+    Eigen::Matrix2d B;
+    B << Rv(0, 0) - p * Rv(2, 0), Rv(0, 1) - p * Rv(2, 1), Rv(1, 0) - q * Rv(2, 0),
+      Rv(1, 1) - q * Rv(2, 1);
+    const double det = B.determinant();
+    if (std::abs(det) < 1e-12) {
+      return false;
+    }
+    const Eigen::Matrix2d A = B.inverse() * J;
+
+    // Largest singular value of A
+    const Eigen::Matrix2d AAt = A * A.transpose();
+    const double gamma2 = 0.5 * (AAt(0, 0) + AAt(1, 1) +
+                                 std::sqrt((AAt(0, 0) - AAt(1, 1)) * (AAt(0, 0) - AAt(1, 1)) +
+                                           4 * AAt(0, 1) * AAt(0, 1)));
+    if (!(gamma2 > 1e-24)) {
+      return false;
+    }
+    const Eigen::Matrix2d R22 = A / std::sqrt(gamma2);
+
+    // Complete the first two columns to unit length, the sign of b gives the two solutions
+    const double b0 = std::sqrt(std::max(0.0, 1 - R22.col(0).squaredNorm()));
+    double b1 = std::sqrt(std::max(0.0, 1 - R22.col(1).squaredNorm()));
+    if (-R22.col(0).dot(R22.col(1)) < 0) {
+      b1 = -b1;
+    }
+
+    for (int k = 0; k < 2; k++) {
+      const double sign = k == 0 ? 1 : -1;
+      const Eigen::Vector3d c0(R22(0, 0), R22(1, 0), sign * b0);
+      const Eigen::Vector3d c1(R22(0, 1), R22(1, 1), sign * b1);
+      Eigen::Matrix3d R;
+      R << c0, c1, c0.cross(c1);
+      rotations[k] = Rv * R;
+    }
+    return true;
+  }
+
+  // Linear least squares of the translation given the rotation
+  static Eigen::Vector3d computeTranslation(const Model &model,
+                                            const std::array<Eigen::Vector2d, N> &normalized,
+                                            const Eigen::Matrix3d &R) noexcept {
+    Eigen::Matrix3d AtA = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d Atb = Eigen::Vector3d::Zero();
+    for (int i = 0; i < N; i++) {
+      const Eigen::Vector3d rp = R * model.points[i];
+      const double u = normalized[i].x(), v = normalized[i].y();
+      // (R * P + t).xy - (u, v) * (R * P + t).z = 0
+      const Eigen::Vector3d a0(1, 0, -u), a1(0, 1, -v);
+      const double b0 = u * rp.z() - rp.x(), b1 = v * rp.z() - rp.y();
+      AtA += a0 * a0.transpose() + a1 * a1.transpose();
+      Atb += a0 * b0 + a1 * b1;
+    }
+    return AtA.ldlt().solve(Atb);
+  }
+
+  template <class PointContainer>
+  double reprojectionError(const Model &model, const PointContainer &image_points,
+                           const Solution &solution) const noexcept {
+    double error = 0;
+    for (int i = 0; i < N; i++) {
+      const cv::Point2d reprojected = project(solution.R * model.points[i] + solution.t);
+      error += std::hypot(image_points[i].x - reprojected.x, image_points[i].y - reprojected.y);
+    }
+    return error;
+  }
+
+  double fx_, fy_, cx_, cy_;
+  std::array<double, 5> dist_;
+  std::vector<Model> models_;
+};
+}  // namespace fyt
+
+#endif  // RM_UTILS_PLANAR_PNP_SOLVER_HPP_
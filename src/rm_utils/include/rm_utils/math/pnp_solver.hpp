@@ -78,6 +78,29 @@ public:
     }
   }
 
+  // Refine rvec and tvec in place by a few Levenberg-Marquardt steps, e.g. from the pose of the
+  // last frame, instead of a solve from scratch
+  template <class InputArray>
+  bool refinePnP(const InputArray &image_points,
+                 cv::Mat &rvec,
+                 cv::Mat &tvec,
+                 const std::string &coord_frame_name,
+                 int max_iterations = 5) {
+    auto it = object_points_map_.find(coord_frame_name);
+    if (it == object_points_map_.end()) {
+      return false;
+    }
+    cv::solvePnPRefineLM(
+      it->second,
+      image_points,
+      camera_matrix_,
+      distortion_coefficients_,
+      rvec,
+      tvec,
+      cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, max_iterations, 1e-6));
+    return true;
+  }
+
   // Calculate the distance between armor center and image center
   float calculateDistanceToCenter(const cv::Point2f &image_point) const noexcept;
 
@@ -19,6 +19,7 @@
 #include <Eigen/Dense>
 #include <memory>
 #include <tuple>
+#include <vector>
 
 namespace fyt {
 
@@ -30,7 +31,22 @@ public:
   // Compensate the trajectory of the bullet, return the pitch increment
   bool compensate(const Eigen::Vector3d &target_position, double &pitch) const noexcept;
 
-  virtual double getFlyingTime(const Eigen::Vector3d &target_position) const noexcept = 0;
+  double getFlyingTime(const Eigen::Vector3d &target_position) const noexcept;
+
+  // Tabulate the pitch and the flying time over a (distance, height) grid, so that
+  // compensate() and getFlyingTime() become a bilinear lookup plus at most a couple of Newton
+  // steps. The table is only used while velocity, gravity and resistance are the ones it was
+  // built with, call it again after changing them
+  void buildTable(double max_distance = 15.0,
+                  double min_height = -2.0,
+                  double max_height = 3.0,
+                  double step = 0.1);
+
+  // Whether the table is built for the current velocity, gravity and resistance
+  bool tableValid() const noexcept {
+    return !pitch_table_.empty() && table_velocity_ == velocity && table_gravity_ == gravity &&
+           table_resistance_ == resistance;
+  }
 
   std::vector<std::pair<double, double>> getTrajectory(double distance,
                                                        double angle) const noexcept;
@@ -43,24 +59,51 @@ public:
 protected:
   // Calculate the trajectory of the bullet, return the vertical impact point
   virtual double calculateTrajectory(const double x, const double angle) const noexcept = 0;
+
+  virtual double calculateFlyingTime(const Eigen::Vector3d &target_position) const noexcept = 0;
+
+private:
+  // The fixed-point iterations, used to build the table and outside of it
+  bool compensateIteratively(double distance, double height, double &pitch) const noexcept;
+
+  // Newton iterations on the impact height, starting from pitch
+  bool refine(double distance, double height, double &pitch) const noexcept;
+
+  // Bilinear interpolation of the table, return false if the cell is outside the table or
+  // any of its corners is unreachable
+  bool lookupTable(const std::vector<float> &table,
+                   double distance,
+                   double height,
+                   double &value) const noexcept;
+
+  // Row-major, rows are heights and columns are distances. NaN marks an unreachable point.
+  // float halves the cache footprint, its rounding is far below the interpolation error of
+  // the grid, and the pitch is refined by Newton in double after the lookup
+  std::vector<float> pitch_table_;
+  std::vector<float> flying_time_table_;
+  int table_cols_ = 0;
+  int table_rows_ = 0;
+  double table_min_height_ = 0;
+  double table_step_ = 0;
+  double table_velocity_ = 0;
+  double table_gravity_ = 0;
+  double table_resistance_ = 0;
 };
 
 // IdealCompensator does not consider the air resistance
 class IdealCompensator : public TrajectoryCompensator {
-public:
-  double getFlyingTime(const Eigen::Vector3d &target_position) const noexcept override;
-
 protected:
   double calculateTrajectory(const double x, const double angle) const noexcept override;
+
+  double calculateFlyingTime(const Eigen::Vector3d &target_position) const noexcept override;
 };
 
 // ResistanceCompensator considers the air resistance
 class ResistanceCompensator : public TrajectoryCompensator {
-public:
-  double getFlyingTime(const Eigen::Vector3d &target_position) const noexcept override;
-
 protected:
   double calculateTrajectory(const double x, const double angle) const noexcept override;
+
+  double calculateFlyingTime(const Eigen::Vector3d &target_position) const noexcept override;
 };
 
 // Factory class for trajectory compensator
@@ -0,0 +1,69 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_UNDISTORTER_HPP_
+#define RM_UTILS_UNDISTORTER_HPP_
+
+// std
+#include <array>
+#include <cstddef>
+#include <vector>
+// 3rd party
+#include <opencv2/core.hpp>
+
+namespace fyt {
+// Maps the pixels of a distorted image (plumb bob model) to an ideal pinhole camera with the
+// same camera matrix, so that PnP, reprojection and BA downstream need no distortion model.
+// The inverse distortion is sampled once per camera on a coarse grid and interpolated
+// bilinearly, the distortion is smooth enough for the error to stay far below a pixel.
+// Thread-safe after construction
+class Undistorter {
+public:
+  // Spacing of the grid, in pixels
+  static constexpr int GRID_STEP = 8;
+
+  // distortion_coefficients: (k1, k2, p1, p2, k3), missing ones are zero. Without the image
+  // size every point is undistorted iteratively
+  Undistorter(const std::array<double, 9> &camera_matrix,
+              const std::vector<double> &distortion_coefficients,
+              int width,
+              int height);
+
+  // True if there is no distortion, the points are then returned as they are
+  bool isPinhole() const noexcept { return pinhole_; }
+
+  cv::Point2f undistort(const cv::Point2f &p) const noexcept;
+
+  // Undistort N points, e.g. the landmarks of an armor
+  template <class InputContainer, class OutputContainer>
+  void undistort(const InputContainer &points, OutputContainer &undistorted) const noexcept {
+    for (std::size_t i = 0; i < points.size(); i++) {
+      undistorted[i] = undistort(points[i]);
+    }
+  }
+
+  // Without the table, the same iterations as cv::undistortPoints until convergence
+  cv::Point2f undistortExact(double u, double v) const noexcept;
+
+private:
+  double fx_, fy_, cx_, cy_;
+  std::array<double, 5> dist_;
+  bool pinhole_;
+  // Undistorted pixel of every grid node, row-major
+  int grid_cols_ = 0, grid_rows_ = 0;
+  std::vector<cv::Point2f> table_;
+};
+}  // namespace fyt
+
+#endif  // RM_UTILS_UNDISTORTER_HPP_
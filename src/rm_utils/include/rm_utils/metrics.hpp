@@ -0,0 +1,129 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_METRICS_HPP_
+#define RM_UTILS_METRICS_HPP_
+
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+// project
+#include "rm_interfaces/msg/node_metrics.hpp"
+
+namespace fyt::utils {
+// Lock-free latency histogram with log-linear buckets (HDR style): below SUB_BUCKETS us the
+// buckets are 1 us wide, above that every power of two is split into SUB_BUCKETS / 2 linear
+// buckets, so a percentile is within ~3% of the true value up to ~67 s. Any thread may record,
+// the reporter takes the samples of the last period while they are being recorded
+class LatencyHistogram {
+public:
+  static constexpr int SUB_BITS = 6;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+  static constexpr int HALF_BUCKETS = SUB_BUCKETS / 2;
+  static constexpr int MAX_SHIFT = 20;
+  static constexpr uint64_t MAX_US = (uint64_t(1) << (MAX_SHIFT + SUB_BITS)) - 1;
+  static constexpr int BUCKET_NUM = (MAX_SHIFT + 2) * HALF_BUCKETS;
+
+  struct Summary {
+    uint64_t count = 0;
+    // In ms
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    double max = 0;
+  };
+
+  void record(int64_t ns) noexcept {
+    const uint64_t us = ns > 0 ? static_cast<uint64_t>(ns) / 1000 : 0;
+    buckets_[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_us_.load(std::memory_order_relaxed);
+    while (us > max && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  void record(std::chrono::nanoseconds duration) noexcept { record(duration.count()); }
+
+  // Summarize the samples recorded since the last call and start a new period
+  Summary takeSummary() noexcept;
+
+  static size_t bucketOf(uint64_t us) noexcept;
+  // Upper bound of the bucket in us
+  static uint64_t bucketLimit(size_t bucket) noexcept;
+
+private:
+  std::array<std::atomic<uint64_t>, BUCKET_NUM> buckets_{};
+  std::atomic<uint64_t> max_us_{0};
+};
+
+// Records the lifetime of the scope into a histogram
+class LatencyScope {
+public:
+  explicit LatencyScope(LatencyHistogram *histogram) noexcept
+  : histogram_(histogram), begin_(std::chrono::steady_clock::now()) {}
+
+  ~LatencyScope() {
+    if (histogram_ != nullptr) {
+      histogram_->record(std::chrono::steady_clock::now() - begin_);
+    }
+  }
+
+  LatencyScope(const LatencyScope &) = delete;
+  LatencyScope &operator=(const LatencyScope &) = delete;
+
+private:
+  LatencyHistogram *histogram_;
+  std::chrono::steady_clock::time_point begin_;
+};
+
+// Metrics of a node, published with the heartbeat. The returned references stay valid as long
+// as the Metrics, so they are looked up once and kept by the caller:
+//   - latency: per-stage histogram, its sample rate is the frame rate of the stage
+//   - counter: monotonic count, e.g. dropped frames
+//   - gauge: last value, e.g. a queue depth
+class Metrics {
+public:
+  LatencyHistogram &latency(const std::string &name);
+  std::atomic<int64_t> &counter(const std::string &name);
+  std::atomic<int64_t> &gauge(const std::string &name);
+
+  // Fill the stages, counters and gauges, period in seconds since the last call
+  void fill(rm_interfaces::msg::NodeMetrics &msg, double period);
+
+  struct LatencyEntry {
+    std::string name;
+    std::unique_ptr<LatencyHistogram> value;
+  };
+  struct ValueEntry {
+    std::string name;
+    std::unique_ptr<std::atomic<int64_t>> value;
+  };
+
+private:
+  // Only guards the registration and the report, never the recording
+  std::mutex mutex_;
+  std::vector<LatencyEntry> latencies_;
+  std::vector<ValueEntry> counters_;
+  std::vector<ValueEntry> gauges_;
+};
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_METRICS_HPP_
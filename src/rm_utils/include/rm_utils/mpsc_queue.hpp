@@ -0,0 +1,103 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_MPSC_QUEUE_HPP_
+#define RM_UTILS_MPSC_QUEUE_HPP_
+
+// std
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace fyt::utils {
+// Lock-free bounded queue for any number of producer threads and exactly one consumer thread.
+// Every slot carries a sequence number telling whether it is free or holds an item, producers
+// claim the slots by a CAS on the head and write the items in place.
+template <typename T, std::size_t Capacity>
+class MpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of 2");
+
+public:
+  MpscQueue() {
+    for (std::size_t i = 0; i < Capacity; i++) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Producer side, fill(T &) writes the item into its slot. Return false if the queue is full
+  template <typename F>
+  bool emplace(F &&fill) {
+    std::size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots_[pos & kMask];
+      const std::size_t seq = slot.seq.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          fill(slot.item);
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  template <typename U>
+  bool push(U &&item) {
+    return emplace([&item](T &slot) { slot = std::forward<U>(item); });
+  }
+
+  // Consumer side, read(T &) reads the oldest item in place. Return false if the queue is
+  // empty or the oldest item is still being written
+  template <typename F>
+  bool consume(F &&read) {
+    Slot &slot = slots_[tail_ & kMask];
+    if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) {
+      return false;
+    }
+    read(slot.item);
+    slot.seq.store(tail_ + Capacity, std::memory_order_release);
+    tail_++;
+    return true;
+  }
+
+  bool pop(T &item) {
+    return consume([&item](T &slot) { item = std::move(slot); });
+  }
+
+  static constexpr std::size_t capacity() { return Capacity; }
+
+private:
+  static constexpr std::size_t kMask = Capacity - 1;
+
+  struct Slot {
+    std::atomic<std::size_t> seq;
+    T item;
+  };
+
+  // Producers and the consumer live in different cache lines
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::size_t tail_{0};
+  std::array<Slot, Capacity> slots_;
+};
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_MPSC_QUEUE_HPP_
@@ -0,0 +1,50 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_OPENCV_CONFIG_HPP_
+#define RM_UTILS_OPENCV_CONFIG_HPP_
+
+// std
+#include <string>
+// ros2
+#include <rclcpp/rclcpp.hpp>
+
+namespace fyt::utils {
+// Runtime settings of OpenCV. They are global to the process, so in a container the node
+// started last wins
+struct OpenCVConfig {
+  // Threads of the OpenCV pool (cv::setNumThreads), -1 for the cores not used by the
+  // WorkerPool, 0 to keep the default of OpenCV
+  int threads = -1;
+  // SIMD dispatch of the optimized code paths (cv::setUseOptimized)
+  bool use_optimized = true;
+  bool use_ipp = true;
+  // There is no UMat in the pipeline, so OpenCL only costs its initialization
+  bool use_opencl = false;
+  // Reference for comparisons: one thread, no SIMD dispatch, no IPP and no OpenCL
+  bool baseline = false;
+};
+
+// Declare the parameters opencv.threads, opencv.use_optimized, opencv.use_ipp,
+// opencv.use_opencl and opencv.baseline of the node
+OpenCVConfig declareOpenCVConfig(rclcpp::Node &node);
+
+// Apply the config to the process. The pool of -1 threads is sized by the WorkerPool, which is
+// created by this call if it is not yet.
+// Return: a line of the applied settings and of the CPU features that OpenCV dispatches to
+std::string applyOpenCVConfig(const OpenCVConfig &config);
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_OPENCV_CONFIG_HPP_
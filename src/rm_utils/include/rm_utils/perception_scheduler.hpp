@@ -0,0 +1,100 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_PERCEPTION_SCHEDULER_HPP_
+#define RM_UTILS_PERCEPTION_SCHEDULER_HPP_
+
+// std
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fyt::utils {
+// Fixed thread pool shared by the detectors of one process, e.g. the detectors composed into
+// the camera container. Each detector owns a queue of frame tasks:
+//   - the tasks of a queue run one at a time in order, so the detector needs no extra locking
+//   - a queue keeps the newest `capacity` tasks, the oldest one is dropped when it is full
+//   - free workers serve the queue with the highest priority first (the active mode),
+//     queues of the same priority in turn
+class PerceptionScheduler {
+public:
+  using Task = std::function<void()>;
+
+  // The scheduler of this process, its workers are started by the first call.
+  // thread_num: number of workers, 0 for half of the cores, ignored after the first call
+  static PerceptionScheduler &instance(size_t thread_num = 0);
+
+  ~PerceptionScheduler();
+
+  PerceptionScheduler(const PerceptionScheduler &) = delete;
+  PerceptionScheduler &operator=(const PerceptionScheduler &) = delete;
+
+  // Return: id of the new queue
+  int addQueue(const std::string &name, size_t capacity = 1, int priority = 0);
+
+  // Drop the waiting tasks and wait for the running one, call before the objects used by the
+  // tasks are destroyed
+  void removeQueue(int id);
+
+  // Tasks must not throw, an exception is swallowed to keep the worker alive
+  // Return: false if a waiting task was dropped to make room
+  bool submit(int id, Task task);
+
+  void setPriority(int id, int priority);
+
+  // Tasks dropped from the queue so far
+  uint64_t droppedCount(int id);
+
+  size_t threadNum() const noexcept { return workers_.size(); }
+
+private:
+  explicit PerceptionScheduler(size_t thread_num);
+
+  struct Queue {
+    std::string name;
+    size_t capacity;
+    int priority;
+    std::deque<Task> tasks;
+    bool running = false;
+    // Order of the last service, the least recently served goes first among equals
+    uint64_t last_served = 0;
+    uint64_t dropped = 0;
+  };
+
+  // Must be called with mtx_ held, nullptr if no queue has a runnable task
+  Queue *pickQueue() noexcept;
+
+  Queue *findQueue(int id) noexcept;
+
+  void workerLoop();
+
+  std::mutex mtx_;
+  std::condition_variable task_cv_;
+  std::condition_variable idle_cv_;
+  std::vector<std::pair<int, std::unique_ptr<Queue>>> queues_;
+  int next_id_ = 0;
+  uint64_t serve_count_ = 0;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_PERCEPTION_SCHEDULER_HPP_
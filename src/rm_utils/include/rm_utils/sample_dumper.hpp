@@ -0,0 +1,153 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_SAMPLE_DUMPER_HPP_
+#define RM_UTILS_SAMPLE_DUMPER_HPP_
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+// ros2
+#include <rclcpp/rclcpp.hpp>
+// 3rd party
+#include <opencv2/core.hpp>
+// project
+#include "rm_utils/mpsc_queue.hpp"
+
+namespace fyt::utils {
+
+// Header of a shard file, followed by the records. Each record is a SampleRecordHeader, the
+// label (label_size bytes) and the pixels (rows * cols * elemSize of type, row-major)
+struct SampleShardHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct SampleRecordHeader {
+  // Stamp of the camera frame in ns
+  int64_t stamp_ns;
+  float confidence;
+  uint16_t rows;
+  uint16_t cols;
+  // cv::Mat type, e.g. CV_8UC1
+  int32_t type;
+  uint32_t label_size;
+};
+static_assert(sizeof(SampleRecordHeader) == 24, "SampleRecordHeader must be 24 bytes");
+
+inline constexpr char SAMPLE_SHARD_MAGIC[8] = {'F', 'Y', 'T', 'S', 'M', 'P', 'L', 'E'};
+inline constexpr uint32_t SAMPLE_SHARD_VERSION = 1;
+
+// Saves labelled crops (number ROIs, rune crops) for retraining without stalling detection.
+// submit() copies the crop into a slot of a lock-free queue, a writer thread at the lowest
+// priority (SCHED_IDLE) encodes them in batches:
+//   - png: <directory>/<label>/<stamp>_<confidence>.png
+//   - shard: appended to <directory>/shard_<time>_<n>.bin, a new shard every shard_mb MB
+// Samples are dropped, never waited for, if they come faster than max_rate, the queue is full
+// or the files in the directory reach quota_mb
+class SampleDumper {
+public:
+  enum class Format { PNG, SHARD };
+
+  struct Params {
+    std::string directory = "/tmp/fyt_samples";
+    Format format = Format::PNG;
+    // Samples per second, 0 for no limit
+    double max_rate = 20;
+    // Size of the directory in MB, the existing files included
+    double quota_mb = 1024;
+    double shard_mb = 64;
+  };
+
+  static bool parseFormat(const std::string &text, Format &format);
+
+  // Start the writer thread. The samples are dropped if the directory can not be created
+  explicit SampleDumper(const Params &params);
+  // Write the queued samples and stop the writer thread
+  ~SampleDumper();
+
+  SampleDumper(const SampleDumper &) = delete;
+  SampleDumper &operator=(const SampleDumper &) = delete;
+
+  // Copy the crop and queue it, any thread may call. Return false if it is dropped
+  bool submit(const cv::Mat &image, std::string_view label, int64_t stamp_ns,
+              float confidence = 1.0f);
+
+  uint64_t dumped() const noexcept { return dumped_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+  bool quotaReached() const noexcept { return quota_reached_.load(std::memory_order_relaxed); }
+
+private:
+  struct Sample {
+    cv::Mat image;
+    std::string label;
+    int64_t stamp_ns = 0;
+    float confidence = 0;
+  };
+
+  static constexpr size_t QUEUE_SIZE = 256;
+  static constexpr size_t BATCH_SIZE = 32;
+
+  void run();
+  // Encode the batch, called by the writer thread
+  void writeBatch(size_t n);
+  bool writePng(const Sample &sample);
+  bool writeShard(const Sample &sample);
+
+  Params params_;
+  int64_t interval_ns_ = 0;
+  uint64_t quota_bytes_ = 0;
+  uint64_t shard_bytes_ = 0;
+
+  MpscQueue<Sample, QUEUE_SIZE> queue_;
+  // Earliest stamp of the next accepted sample, steady clock in ns
+  std::atomic<int64_t> next_ns_{0};
+  std::atomic<uint64_t> dumped_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<bool> quota_reached_{false};
+  std::atomic<bool> ready_{false};
+
+  // Writer thread only
+  Sample batch_[BATCH_SIZE];
+  std::vector<uchar> png_buffer_;
+  uint64_t used_bytes_ = 0;
+  std::FILE *shard_ = nullptr;
+  uint64_t shard_size_ = 0;
+  int shard_index_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+// Declare the parameters sample_dump.enable, sample_dump.directory (default
+// /tmp/fyt_samples/<node name>), sample_dump.format ("png" or "shard"), sample_dump.max_rate,
+// sample_dump.quota_mb and sample_dump.shard_mb of the node.
+// Return: nullptr if it is not enabled
+std::unique_ptr<SampleDumper> declareSampleDumper(rclcpp::Node &node);
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_SAMPLE_DUMPER_HPP_
@@ -0,0 +1,78 @@
+// Created by Chengfu Zou
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef RM_UTILS_SPSC_QUEUE_HPP_
+#define RM_UTILS_SPSC_QUEUE_HPP_
+
+// std
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace fyt::utils {
+// Lock-free bounded queue for exactly one producer thread and one consumer thread.
+// One slot is kept empty to tell full from empty, so it holds at most Capacity - 1 items.
+template <typename T, std::size_t Capacity>
+class SpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of 2");
+
+public:
+  // Producer side, return false if the queue is full
+  template <typename U>
+  bool push(U &&item) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    const std::size_t next = (head + 1) & kMask;
+    if (next == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    buffer_[head] = std::forward<U>(item);
+    head_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, return false if the queue is empty
+  bool pop(T &item) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = std::move(buffer_[tail]);
+    tail_.store((tail + 1) & kMask, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+  std::size_t size() const {
+    return (head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)) &
+           kMask;
+  }
+
+  static constexpr std::size_t capacity() { return Capacity - 1; }
+
+private:
+  static constexpr std::size_t kMask = Capacity - 1;
+
+  // Producer and consumer indices live in different cache lines
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  std::array<T, Capacity> buffer_;
+};
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_SPSC_QUEUE_HPP_
@@ -0,0 +1,106 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_STALL_WATCHDOG_HPP_
+#define RM_UTILS_STALL_WATCHDOG_HPP_
+
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// ros2
+#include <rclcpp/rclcpp.hpp>
+// project
+#include "rm_utils/metrics.hpp"
+
+namespace fyt::utils {
+// Polls the progress counters of the stages of a node and recovers a stalled stage alone, e.g.
+// reopens the camera, instead of relaunching the whole container. A stage is stalled if its
+// progress has not moved for its timeout while it had work: its demand counter moved since the
+// last progress, or always if it has no demand counter. The recovery runs on the watchdog
+// thread, the other stages are not checked meanwhile. Every recovery is counted in the counter
+// "<stage>_recoveries" of the metrics
+class StallWatchdog {
+public:
+  struct Stage {
+    std::string name;
+    // Work done by the stage, e.g. the frames published
+    const std::atomic<int64_t> *progress = nullptr;
+    // Work handed to the stage, e.g. the frames submitted. Null if it must always progress
+    const std::atomic<int64_t> *demand = nullptr;
+    std::chrono::milliseconds timeout{200};
+    // Time given to the recovered component to come back before it may be recovered again
+    std::chrono::milliseconds cooldown{1000};
+    std::function<void()> recover;
+  };
+
+  // rate: polls per second
+  StallWatchdog(Metrics &metrics, double rate);
+  ~StallWatchdog();
+
+  StallWatchdog(const StallWatchdog &) = delete;
+  StallWatchdog &operator=(const StallWatchdog &) = delete;
+
+  // Start watching the stage, its counters must outlive the watchdog
+  void watch(Stage stage);
+
+  // A stall that outlasts its recoveries (an unplugged camera) trips again after every cooldown,
+  // and a flight dump holds the rings of all threads. One dump per stall of a stage, until it
+  // progresses again, at most one per DUMP_INTERVAL and MAX_DUMPS in all
+  static constexpr std::chrono::seconds DUMP_INTERVAL{30};
+  static constexpr int MAX_DUMPS = 8;
+
+private:
+  struct Watched {
+    Stage stage;
+    std::atomic<int64_t> *recoveries;
+    int64_t last_progress;
+    int64_t demand_at_progress;
+    std::chrono::steady_clock::time_point since;
+    // The current stall was dumped
+    bool dumped = false;
+  };
+
+  // Whether a stall of the stage is dumped, counts the dump
+  bool takeDump(Watched &watched, std::chrono::steady_clock::time_point now);
+
+  void run();
+  // Return: true if the stage is stalled
+  bool check(Watched &watched, std::chrono::steady_clock::time_point now);
+
+  Metrics &metrics_;
+  std::chrono::steady_clock::duration period_;
+  std::vector<Watched> stages_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread thread_;
+  int dumps_ = 0;
+  std::chrono::steady_clock::time_point last_dump_{};
+};
+
+// Declare the parameters watchdog.enable and watchdog.rate of the node.
+// Return: nullptr if it is not enabled
+std::unique_ptr<StallWatchdog> declareStallWatchdog(rclcpp::Node &node, Metrics &metrics);
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_STALL_WATCHDOG_HPP_
@@ -0,0 +1,70 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef RM_UTILS_STARTUP_REPORT_HPP_
+#define RM_UTILS_STARTUP_REPORT_HPP_
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+// project
+#include "rm_utils/metrics.hpp"
+
+namespace fyt::utils {
+// Startup of a node, whose initialization steps (model loading, compilation, solver
+// construction) may run in the background while the node sets up its subscriptions. Every step
+// is timed from its begin and the node is ready once all of them are finished. The readiness and
+// the time from the construction to it are reported as the gauges "ready" and "startup_ms".
+// Thread-safe
+class StartupReport {
+public:
+  StartupReport() noexcept : created_(std::chrono::steady_clock::now()) {}
+
+  void begin(const std::string &step);
+  // Return: true if this was the last step, the node is ready from now on
+  bool finish(const std::string &step);
+
+  bool ready() const noexcept { return ready_.load(std::memory_order_acquire); }
+
+  // Register the gauges, before or after the node is ready
+  void attach(Metrics &metrics);
+
+  // "ready in 1234.5 ms: model 1100.2 ms, solver 12.3 ms", the pending steps are marked as such
+  std::string summary() const;
+
+private:
+  struct Step {
+    std::string name;
+    std::chrono::steady_clock::time_point begin;
+    double ms = -1;
+  };
+
+  void publishGauges();
+
+  std::chrono::steady_clock::time_point created_;
+  mutable std::mutex mutex_;
+  std::vector<Step> steps_;
+  double startup_ms_ = -1;
+  std::atomic<bool> ready_{false};
+  std::atomic<int64_t> *ready_gauge_ = nullptr;
+  std::atomic<int64_t> *startup_gauge_ = nullptr;
+};
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_STARTUP_REPORT_HPP_
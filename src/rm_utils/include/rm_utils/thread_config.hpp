@@ -0,0 +1,58 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_THREAD_CONFIG_HPP_
+#define RM_UTILS_THREAD_CONFIG_HPP_
+
+// std
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fyt::utils {
+// Cores and priority of a thread
+struct ThreadSchedule {
+  // Empty if not pinned
+  std::vector<int> cpus;
+  // SCHED_FIFO priority (1 ~ 99), 0 for the default policy
+  int priority = 0;
+};
+
+struct ThreadConfig {
+  std::map<std::string, ThreadSchedule> schedules;
+  // Lock the memory of the process (mlockall), so that no page fault stalls a thread
+  bool lock_memory = false;
+};
+
+// Parse "name=cpus[:priority];...;mlockall", cpus like "2", "2,3" or "2-5".
+// The schedule named "default" is applied to every thread of the process that is not named by
+// configureThread(), e.g. the executor and DDS threads.
+// Return: false if the text is malformed, nothing is parsed then
+bool parseThreadConfig(const std::string &text, ThreadConfig &config);
+
+// The schedule of a thread named name. Trailing digits are ignored by the lookup, e.g.
+// "perception0" uses "perception". A name without an entry gets "default", or the default
+// policy on all cores (an empty schedule) if there is none.
+ThreadSchedule findThreadSchedule(const ThreadConfig &config, const std::string &name);
+
+// Name the calling thread (shown by top -H, at most 15 characters) and apply its schedule
+// from the environment variable FYT_THREAD_CONFIG (see findThreadSchedule), which is set by the
+// launch file from launch_params.yaml. The first call of the process also applies "default"
+// and mlockall. The cores and priority inherited from the creating thread are replaced, an
+// empty schedule resets them to all cores and the default policy.
+void configureThread(const std::string &name);
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_THREAD_CONFIG_HPP_
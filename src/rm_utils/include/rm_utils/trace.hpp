@@ -0,0 +1,150 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_TRACE_HPP_
+#define RM_UTILS_TRACE_HPP_
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fyt::utils {
+
+// Pipeline stages of the trace records
+enum class TraceStage : uint16_t {
+  CAMERA_GRAB,
+  PREPROCESS,
+  FIND_LIGHTS,
+  MATCH_LIGHTS,
+  CLASSIFY,
+  PNP,
+  BA,
+  TRACK,
+  SOLVE,
+  SERIAL_SEND,
+  RUNE_DETECT,
+  RUNE_SOLVE,
+  ARMOR_KEYPOINTS,
+  RUNE_FLOW,
+  COUNT
+};
+
+constexpr const char *TraceStageNames[static_cast<size_t>(TraceStage::COUNT)] = {"camera_grab",
+                                                                                "preprocess",
+                                                                                "find_lights",
+                                                                                "match_lights",
+                                                                                "classify",
+                                                                                "pnp",
+                                                                                "ba",
+                                                                                "track",
+                                                                                "solve",
+                                                                                "serial_send",
+                                                                                "rune_detect",
+                                                                                "rune_solve",
+                                                                                "armor_keypoints",
+                                                                                "rune_flow"};
+
+// Fixed-size record of the trace file. frame_id is the stamp of the camera frame in ns, so the
+// records of one frame are matched across the nodes and processes
+struct TraceRecord {
+  uint64_t frame_id;
+  // System clock in ns
+  int64_t begin_ns;
+  int64_t end_ns;
+  uint32_t thread_id;
+  uint16_t stage;
+  uint16_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 32, "TraceRecord must be 32 bytes");
+
+// Header of the trace file, followed by `count` records
+struct TraceFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  // Updated by the writer after every batch, so a file left by a crash is still readable
+  uint64_t count;
+  uint64_t dropped;
+};
+
+inline constexpr char TRACE_MAGIC[8] = {'F', 'Y', 'T', 'T', 'R', 'A', 'C', 'E'};
+inline constexpr uint32_t TRACE_VERSION = 1;
+
+// Binary trace of the pipeline stages. Every thread writes its records into its own lock-free
+// buffer, a writer thread copies them into a memory-mapped file. Tracing is off unless it is
+// started, or the environment variable FYT_TRACE_FILE is set (the pid is appended to the path),
+// and then costs one atomic load per scope. trace_export converts the file to the Chrome trace
+// format, which is opened by chrome://tracing or https://ui.perfetto.dev
+class Trace {
+public:
+  // Start writing to path, at most max_mb MB of records
+  static bool start(const std::string &path, size_t max_mb = 64);
+  // Write the buffered records and close the file
+  static void stop();
+
+  static bool enabled() noexcept {
+    // The environment variable is checked once
+    static const bool env_checked = startFromEnv();
+    (void)env_checked;
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  static void record(TraceStage stage, uint64_t frame_id, int64_t begin_ns, int64_t end_ns);
+
+  // Frame of the records of the calling thread, set when the thread starts working on a frame
+  static void setFrame(uint64_t frame_id) noexcept { current_frame_ = frame_id; }
+  static uint64_t frame() noexcept { return current_frame_; }
+
+  static int64_t now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+  }
+
+private:
+  static bool startFromEnv();
+
+  static std::atomic<bool> enabled_;
+  static thread_local uint64_t current_frame_;
+};
+
+// Records the lifetime of the scope as a stage of the current frame of the thread
+class TraceScope {
+public:
+  explicit TraceScope(TraceStage stage) noexcept : TraceScope(stage, Trace::frame()) {}
+
+  TraceScope(TraceStage stage, uint64_t frame_id) noexcept
+  : stage_(stage), frame_id_(frame_id), begin_ns_(Trace::enabled() ? Trace::now() : 0) {}
+
+  ~TraceScope() {
+    if (begin_ns_ != 0) {
+      Trace::record(stage_, frame_id_, begin_ns_, Trace::now());
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  TraceStage stage_;
+  uint64_t frame_id_;
+  int64_t begin_ns_;
+};
+
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_TRACE_HPP_
@@ -0,0 +1,97 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RM_UTILS_WORKER_POOL_HPP_
+#define RM_UTILS_WORKER_POOL_HPP_
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace fyt::utils {
+// Fixed pool of workers for the short fork-join loops of a frame, e.g. the armors of a frame or
+// the grid search of the curve fitter. The caller takes part in the loop and nothing is spawned
+// or allocated per call, so a loop of a few items costs a wake-up instead of a task graph:
+//   - fewer than min_parallel items run inline on the caller
+//   - a call from a worker, or while another caller has the pool, also runs inline, so the
+//     cores are never oversubscribed and callers never wait for each other
+// The items of a loop are handed out in order, each one runs exactly once
+class WorkerPool {
+public:
+  // The pool of this process, its workers are started by the first call.
+  // thread_num: number of workers besides the caller, 0 for min(cores - 1, 3), ignored after
+  // the first call
+  static WorkerPool &instance(size_t thread_num = 0);
+
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Run f(i) for i in [0, n) and wait for all of them. f must not throw
+  template <typename F>
+  void parallelFor(size_t n, F &&f, size_t min_parallel = 2) {
+    if (n == 0) {
+      return;
+    }
+    using Func = std::remove_reference_t<F>;
+    if (n < min_parallel || workers_.empty() ||
+        !tryRun(n, [](void *context, size_t i) { (*static_cast<Func *>(context))(i); }, &f)) {
+      for (size_t i = 0; i < n; i++) {
+        f(i);
+      }
+    }
+  }
+
+  size_t threadNum() const noexcept { return workers_.size(); }
+
+private:
+  using Invoke = void (*)(void *, size_t);
+
+  explicit WorkerPool(size_t thread_num);
+
+  // Return: false if the pool is in use or called from a worker, nothing is run then
+  bool tryRun(size_t n, Invoke invoke, void *context);
+
+  void runItems(size_t n, Invoke invoke, void *context) noexcept;
+
+  void workerLoop();
+
+  // Held by the caller that has the pool
+  std::mutex call_mtx_;
+
+  // The current loop, guarded by mtx_
+  std::mutex mtx_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  uint64_t generation_ = 0;
+  bool open_ = false;
+  bool stop_ = false;
+  size_t active_ = 0;
+  size_t n_ = 0;
+  Invoke invoke_ = nullptr;
+  void *context_ = nullptr;
+  std::atomic<size_t> next_{0};
+
+  std::vector<std::thread> workers_;
+};
+}  // namespace fyt::utils
+
+#endif  // RM_UTILS_WORKER_POOL_HPP_
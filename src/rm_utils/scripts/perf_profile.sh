@@ -0,0 +1,125 @@
+#!/bin/bash
+# Build the hot packages with the perf profile (LTO, -march, PGO) and measure the speedup
+# over the default build on the benchmarks, see the perf profile section of rm_utils/README.md.
+#
+# Usage (from the workspace, after sourcing ROS):
+#   src/rm_utils/scripts/perf_profile.sh --bag=<rosbag2 uri> [--frames=<image dir>]
+#     [--march=<cpu>] [--pgo_dir=$HOME/.cache/fyt_pgo] [--skip_base]
+#
+# The bag is replayed by armor_tracker_bench, the frames by armor_detector_bench (docs/test.png
+# if not given), rune_solver_bench uses its synthetic corpus. The instrumented build is
+# trained on the same benchmarks, train it on a full replay instead by running the bringup
+# from install_pgo before the USE step (see the README).
+
+set -e
+
+BAG=""
+FRAMES=""
+MARCH=""
+PGO_DIR="$HOME/.cache/fyt_pgo"
+SKIP_BASE=0
+for arg in "$@"; do
+  case $arg in
+    --bag=*) BAG="${arg#*=}" ;;
+    --frames=*) FRAMES="${arg#*=}" ;;
+    --march=*) MARCH="${arg#*=}" ;;
+    --pgo_dir=*) PGO_DIR="${arg#*=}" ;;
+    --skip_base) SKIP_BASE=1 ;;
+    *) echo "Unknown argument $arg"; exit 1 ;;
+  esac
+done
+if [ -z "$BAG" ]; then
+  echo "--bag is required"
+  exit 1
+fi
+
+PACKAGES="rm_utils armor_detector armor_solver rune_solver"
+OUT=perf_profile
+mkdir -p $OUT
+
+build() {
+  # build_base install_base / build_pgo install_pgo, GENERATE and USE share the build directory
+  local name=$1
+  shift
+  colcon build --build-base build_$name --install-base install_$name \
+    --packages-up-to $PACKAGES --cmake-args -DCMAKE_BUILD_TYPE=Release "$@"
+}
+
+# Wall time of a command in s
+run_timed() {
+  local log=$1
+  shift
+  local begin=$(date +%s.%N)
+  "$@" > $log 2>&1
+  local end=$(date +%s.%N)
+  echo "$end - $begin" | bc
+}
+
+# Run the benchmarks of an install, the results go to $OUT/<name>
+run_benches() {
+  local name=$1
+  mkdir -p $OUT/$name
+  (
+    source install_$name/setup.bash
+    local frames_arg=""
+    [ -n "$FRAMES" ] && frames_arg="--frames=$FRAMES"
+    ros2 run armor_detector armor_detector_bench $frames_arg --benchmark_format=json \
+      --benchmark_out=$OUT/$name/armor_detector.json > $OUT/$name/armor_detector.txt 2>&1 || \
+      echo "armor_detector_bench is not built (Google Benchmark missing)"
+    run_timed $OUT/$name/armor_solver.txt \
+      ros2 run armor_solver armor_tracker_bench --bag=$BAG > $OUT/$name/armor_solver.time
+    run_timed $OUT/$name/rune_solver.txt \
+      ros2 run rune_solver rune_solver_bench --sequences=20 > $OUT/$name/rune_solver.time
+  )
+}
+
+if [ $SKIP_BASE -eq 0 ]; then
+  build base
+  run_benches base
+fi
+
+# Instrumented build, trained by the benchmarks
+rm -rf $PGO_DIR
+build pgo -DFYT_PERF_PROFILE=ON "-DFYT_PERF_MARCH=$MARCH" -DFYT_PGO=GENERATE -DFYT_PGO_DIR=$PGO_DIR
+run_benches pgo
+if command -v llvm-profdata > /dev/null && ls $PGO_DIR/*/*.profraw > /dev/null 2>&1; then
+  for dir in $PGO_DIR/*/; do
+    llvm-profdata merge -o $dir/default.profdata $dir/*.profraw
+  done
+fi
+
+# Optimized with the profiles
+build pgo -DFYT_PERF_PROFILE=ON "-DFYT_PERF_MARCH=$MARCH" -DFYT_PGO=USE -DFYT_PGO_DIR=$PGO_DIR
+run_benches pgo
+
+python3 - $OUT <<'EOF'
+import json, math, os, sys
+
+out = sys.argv[1]
+
+def detector(name):
+    path = os.path.join(out, name, "armor_detector.json")
+    if not os.path.exists(path):
+        return None
+    with open(path) as f:
+        return {b["name"]: b["real_time"] for b in json.load(f)["benchmarks"]}
+
+base, pgo = detector("base"), detector("pgo")
+if base and pgo:
+    ratios = [base[k] / pgo[k] for k in base if k in pgo and pgo[k] > 0]
+    for k in sorted(base):
+        if k in pgo and pgo[k] > 0:
+            print(f"armor_detector  {k:40s} {base[k] / pgo[k]:.2f}x")
+    print(f"armor_detector  speedup {math.exp(sum(map(math.log, ratios)) / len(ratios)):.2f}x "
+          "(geometric mean of the stages)")
+for package in ("armor_solver", "rune_solver"):
+    try:
+        with open(os.path.join(out, "base", package + ".time")) as f:
+            base_s = float(f.read())
+        with open(os.path.join(out, "pgo", package + ".time")) as f:
+            pgo_s = float(f.read())
+    except (OSError, ValueError):
+        continue
+    print(f"{package:15s} speedup {base_s / pgo_s:.2f}x ({base_s:.2f} s -> {pgo_s:.2f} s)")
+print(f"Latency percentiles of each benchmark are in {out}/base and {out}/pgo")
+EOF
@@ -0,0 +1,27 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/attitude_cache.hpp"
+
+namespace fyt::utils {
+AttitudeCache<> &processAttitudeCache() {
+  static AttitudeCache<> cache;
+  return cache;
+}
+
+const AttitudeCache<> &processAttitudeCacheOr(const AttitudeCache<> &fallback) noexcept {
+  const AttitudeCache<> &cache = processAttitudeCache();
+  return cache.empty() ? fallback : cache;
+}
+}  // namespace fyt::utils
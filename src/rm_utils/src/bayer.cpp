@@ -0,0 +1,123 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/bayer.hpp"
+// third party
+#include <opencv2/imgproc.hpp>
+
+namespace fyt::utils {
+namespace {
+// OpenCV names a pattern after the second row, e.g. RGGB is cv::COLOR_BayerBG2RGB
+int rgbConversionCode(BayerPattern pattern) noexcept {
+  switch (pattern) {
+    case BayerPattern::RGGB:
+      return cv::COLOR_BayerBG2RGB;
+    case BayerPattern::BGGR:
+      return cv::COLOR_BayerRG2RGB;
+    case BayerPattern::GBRG:
+      return cv::COLOR_BayerGR2RGB;
+    case BayerPattern::GRBG:
+      return cv::COLOR_BayerGB2RGB;
+    default:
+      return -1;
+  }
+}
+
+int bgrConversionCode(BayerPattern pattern) noexcept {
+  switch (pattern) {
+    case BayerPattern::RGGB:
+      return cv::COLOR_BayerBG2BGR;
+    case BayerPattern::BGGR:
+      return cv::COLOR_BayerRG2BGR;
+    case BayerPattern::GBRG:
+      return cv::COLOR_BayerGR2BGR;
+    case BayerPattern::GRBG:
+      return cv::COLOR_BayerGB2BGR;
+    default:
+      return -1;
+  }
+}
+
+int grayConversionCode(BayerPattern pattern) noexcept {
+  switch (pattern) {
+    case BayerPattern::RGGB:
+      return cv::COLOR_BayerBG2GRAY;
+    case BayerPattern::BGGR:
+      return cv::COLOR_BayerRG2GRAY;
+    case BayerPattern::GBRG:
+      return cv::COLOR_BayerGR2GRAY;
+    case BayerPattern::GRBG:
+      return cv::COLOR_BayerGB2GRAY;
+    default:
+      return -1;
+  }
+}
+}  // namespace
+
+BayerPattern bayerPattern(const std::string &encoding) noexcept {
+  if (encoding == "bayer_rggb8") {
+    return BayerPattern::RGGB;
+  } else if (encoding == "bayer_bggr8") {
+    return BayerPattern::BGGR;
+  } else if (encoding == "bayer_gbrg8") {
+    return BayerPattern::GBRG;
+  } else if (encoding == "bayer_grbg8") {
+    return BayerPattern::GRBG;
+  }
+  return BayerPattern::NONE;
+}
+
+std::string bayerEncoding(BayerPattern pattern) noexcept {
+  switch (pattern) {
+    case BayerPattern::RGGB:
+      return "bayer_rggb8";
+    case BayerPattern::BGGR:
+      return "bayer_bggr8";
+    case BayerPattern::GBRG:
+      return "bayer_gbrg8";
+    case BayerPattern::GRBG:
+      return "bayer_grbg8";
+    default:
+      return "";
+  }
+}
+
+cv::Point bayerRedOffset(BayerPattern pattern) noexcept {
+  switch (pattern) {
+    case BayerPattern::BGGR:
+      return {1, 1};
+    case BayerPattern::GBRG:
+      return {0, 1};
+    case BayerPattern::GRBG:
+      return {1, 0};
+    default:
+      return {0, 0};
+  }
+}
+
+void bayerToRgb(cv::InputArray bayer, BayerPattern pattern, cv::OutputArray rgb) {
+  CV_Assert(pattern != BayerPattern::NONE);
+  cv::cvtColor(bayer, rgb, rgbConversionCode(pattern));
+}
+
+void bayerToBgr(cv::InputArray bayer, BayerPattern pattern, cv::OutputArray bgr) {
+  CV_Assert(pattern != BayerPattern::NONE);
+  cv::cvtColor(bayer, bgr, bgrConversionCode(pattern));
+}
+
+void bayerToGray(cv::InputArray bayer, BayerPattern pattern, cv::OutputArray gray) {
+  CV_Assert(pattern != BayerPattern::NONE);
+  cv::cvtColor(bayer, gray, grayConversionCode(pattern));
+}
+}  // namespace fyt::utils
@@ -0,0 +1,99 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/debug_image.hpp"
+
+// std
+#include <algorithm>
+#include <utility>
+// 3rd party
+#include <opencv2/imgproc.hpp>
+// project
+#include "rm_utils/thread_config.hpp"
+
+namespace fyt::utils {
+
+DebugImageParams declareDebugImageParams(rclcpp::Node &node, const std::string &prefix) {
+  DebugImageParams params;
+  params.scale = std::clamp(node.declare_parameter(prefix + ".scale", params.scale), 0.05, 1.0);
+  params.roi_only = node.declare_parameter(prefix + ".roi_only", params.roi_only);
+  params.roi_margin =
+    std::max<int>(node.declare_parameter(prefix + ".roi_margin", params.roi_margin), 0);
+  return params;
+}
+
+cv::Mat shrinkDebugImage(const cv::Mat &image,
+                         const DebugImageParams &params,
+                         const cv::Rect &roi) {
+  cv::Mat result = image;
+  if (params.roi_only && !roi.empty()) {
+    const int m = params.roi_margin;
+    const cv::Rect crop =
+      cv::Rect(roi.x - m, roi.y - m, roi.width + 2 * m, roi.height + 2 * m) &
+      cv::Rect(0, 0, image.cols, image.rows);
+    if (!crop.empty()) {
+      result = image(crop);
+    }
+  }
+  if (params.scale < 1.0) {
+    cv::Mat scaled;
+    // INTER_AREA averages the pixels, thin lines of the drawings do not vanish
+    cv::resize(result, scaled, cv::Size(), params.scale, params.scale, cv::INTER_AREA);
+    return scaled;
+  }
+  return result;
+}
+
+DebugImageWorker::DebugImageWorker(const std::string &thread_name) {
+  thread_ = std::thread(&DebugImageWorker::run, this, thread_name);
+}
+
+DebugImageWorker::~DebugImageWorker() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void DebugImageWorker::post(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    job_ = std::move(job);
+  }
+  cv_.notify_one();
+}
+
+void DebugImageWorker::run(const std::string &thread_name) {
+  configureThread(thread_name);
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stop_ || job_; });
+      if (stop_) {
+        return;
+      }
+      job = std::move(job_);
+      job_ = nullptr;
+    }
+    job();
+  }
+}
+
+}  // namespace fyt::utils
@@ -0,0 +1,101 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/device_clock.hpp"
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace fyt::utils {
+DeviceClock::DeviceClock(double tick_period_ns) noexcept : tick_period_ns_(tick_period_ns) {}
+
+void DeviceClock::setTickPeriod(double tick_period_ns) noexcept {
+  tick_period_ns_ = tick_period_ns;
+  reset();
+}
+
+void DeviceClock::reset() noexcept {
+  has_origin_ = false;
+  bucket_head_ = bucket_size_ = 0;
+  slope_ = intercept_ = 0;
+}
+
+int64_t DeviceClock::update(uint64_t device_ticks, int64_t host_ns) noexcept {
+  if (!has_origin_ || device_ticks < last_ticks_) {
+    reset();
+    has_origin_ = true;
+    origin_ticks_ = last_ticks_ = device_ticks;
+    origin_host_ns_ = host_ns;
+    current_ = {0, 0};
+    current_index_ = 0;
+    return host_ns;
+  }
+  last_ticks_ = device_ticks;
+
+  const double device = static_cast<double>(device_ticks - origin_ticks_) * tick_period_ns_;
+  const double offset = static_cast<double>(host_ns - origin_host_ns_) - device;
+  const auto index = static_cast<int64_t>(device / BUCKET_NS);
+  if (index != current_index_) {
+    buckets_[(bucket_head_ + bucket_size_) % BUCKET_NUM] = current_;
+    if (bucket_size_ < BUCKET_NUM) {
+      bucket_size_++;
+    } else {
+      bucket_head_ = (bucket_head_ + 1) % BUCKET_NUM;
+    }
+    current_ = {device, offset};
+    current_index_ = index;
+    fit();
+  } else if (offset < current_.offset_ns) {
+    current_ = {device, offset};
+  }
+  // Keep the line under the newest minimum
+  intercept_ = std::min(intercept_, offset - slope_ * device);
+  return toHost(device_ticks);
+}
+
+int64_t DeviceClock::toHost(uint64_t device_ticks) const noexcept {
+  const double device =
+    static_cast<double>(static_cast<int64_t>(device_ticks - origin_ticks_)) * tick_period_ns_;
+  return origin_host_ns_ + std::llround(device + slope_ * device + intercept_);
+}
+
+void DeviceClock::fit() noexcept {
+  const size_t n = bucket_size_ + 1;
+  auto bucket = [this](size_t i) -> const Bucket & {
+    return i < bucket_size_ ? buckets_[(bucket_head_ + i) % BUCKET_NUM] : current_;
+  };
+
+  // Centered least squares, the device time grows large
+  double mean_d = 0, mean_o = 0;
+  for (size_t i = 0; i < n; i++) {
+    mean_d += bucket(i).device_ns;
+    mean_o += bucket(i).offset_ns;
+  }
+  mean_d /= n;
+  mean_o /= n;
+  double sdd = 0, sdo = 0;
+  for (size_t i = 0; i < n; i++) {
+    const double dd = bucket(i).device_ns - mean_d;
+    sdd += dd * dd;
+    sdo += dd * (bucket(i).offset_ns - mean_o);
+  }
+  // The slope needs a few buckets of span to be better than no drift at all
+  slope_ = n >= 3 && sdd > 0 ? std::clamp(sdo / sdd, -MAX_SLOPE, MAX_SLOPE) : 0.0;
+
+  intercept_ = bucket(0).offset_ns - slope_ * bucket(0).device_ns;
+  for (size_t i = 1; i < n; i++) {
+    intercept_ = std::min(intercept_, bucket(i).offset_ns - slope_ * bucket(i).device_ns);
+  }
+}
+}  // namespace fyt::utils
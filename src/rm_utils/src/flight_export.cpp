@@ -0,0 +1,87 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Print the dumps of the flight recorder as CSV, the records of all threads in time order
+//
+// Usage:
+//   ros2 run rm_utils flight_export <dump>... > flight.csv
+//
+// Columns: time before the dump in ms, thread, event, id, frame id, values. The values of
+// each event are listed in rm_utils/flight_recorder.hpp
+
+// std
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+// project
+#include "rm_utils/flight_recorder.hpp"
+
+using namespace fyt::utils;
+
+namespace {
+bool readDump(const char *path, std::vector<FlightRecord> &records, FlightFileHeader &header) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, FLIGHT_MAGIC, sizeof(FLIGHT_MAGIC)) != 0 ||
+      header.version != FLIGHT_VERSION || header.record_size != sizeof(FlightRecord)) {
+    std::cerr << path << " is not a flight dump of version " << FLIGHT_VERSION << std::endl;
+    return false;
+  }
+  // The count is 0 if the dump was cut short, the records written are read anyway
+  records.resize(header.count > 0 ? header.count : (1 << 20));
+  file.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(FlightRecord));
+  records.resize(file.gcount() / sizeof(FlightRecord));
+  return true;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: flight_export <dump>... > flight.csv" << std::endl;
+    return 1;
+  }
+
+  std::printf("file,t_ms,thread,event,id,frame_id,v0,v1,v2,v3,v4,v5,v6,v7,v8,v9\n");
+  for (int i = 1; i < argc; i++) {
+    FlightFileHeader header;
+    std::vector<FlightRecord> records;
+    if (!readDump(argv[i], records, header)) {
+      return 1;
+    }
+    std::cerr << argv[i] << ": " << records.size() << " records" << std::endl;
+    std::stable_sort(records.begin(), records.end(), [](const auto &a, const auto &b) {
+      return a.stamp_ns < b.stamp_ns;
+    });
+    for (const auto &record : records) {
+      const char *event = record.event < static_cast<uint16_t>(FlightEvent::COUNT)
+                            ? FlightEventNames[record.event]
+                            : "unknown";
+      std::printf("%d,%.3f,%u,%s,%d,%llu",
+                  i,
+                  (record.stamp_ns - header.dump_ns) / 1e6,
+                  record.thread_id,
+                  event,
+                  record.id,
+                  static_cast<unsigned long long>(record.frame_id));
+      for (float value : record.values) {
+        std::printf(",%g", value);
+      }
+      std::printf("\n");
+    }
+  }
+  return 0;
+}
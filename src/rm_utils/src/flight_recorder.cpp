@@ -0,0 +1,240 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/flight_recorder.hpp"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+// system
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fyt::utils {
+
+namespace {
+constexpr size_t RING_SIZE = FlightRecorder::RING_SIZE;
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of two");
+
+// Written by its thread only. The dump copies the ring and keeps the records that were not
+// overwritten meanwhile
+struct FlightRing {
+  uint32_t thread_id = 0;
+  std::atomic<uint64_t> head{0};
+  FlightRecord records[RING_SIZE];
+};
+
+// Never destroyed, the rings of the threads that have exited are kept for the dump
+std::atomic<FlightRing *> g_rings[FlightRecorder::MAX_THREADS];
+std::atomic<size_t> g_ring_count{0};
+thread_local FlightRing *t_ring = nullptr;
+thread_local bool t_no_ring = false;
+
+// The dump runs in signal handlers: no allocation, no lock, no stdio
+char g_dir[256] = "/tmp";
+std::atomic_flag g_dumping = ATOMIC_FLAG_INIT;
+std::atomic<uint32_t> g_dump_count{0};
+FlightRecord g_copy[RING_SIZE];
+
+void append(char *buf, size_t &len, size_t cap, const char *str) {
+  while (*str != '\0' && len + 1 < cap) {
+    buf[len++] = *str++;
+  }
+  buf[len] = '\0';
+}
+
+void append(char *buf, size_t &len, size_t cap, uint64_t value) {
+  char digits[24];
+  size_t n = 0;
+  do {
+    digits[n++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (n > 0 && len + 1 < cap) {
+    buf[len++] = digits[--n];
+  }
+  buf[len] = '\0';
+}
+
+bool writeAll(int fd, const void *data, size_t size) {
+  const char *p = static_cast<const char *>(data);
+  while (size > 0) {
+    const ssize_t n = ::write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+int64_t nowNs() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::system_clock::now().time_since_epoch())
+    .count();
+}
+
+// Copy the ring into g_copy, return the number of records copied, oldest first
+size_t copyRing(const FlightRing &ring) {
+  const uint64_t head = ring.head.load(std::memory_order_acquire);
+  const uint64_t begin = head > RING_SIZE ? head - RING_SIZE : 0;
+  for (uint64_t i = begin; i < head; i++) {
+    std::memcpy(&g_copy[i - begin], &ring.records[i & (RING_SIZE - 1)], sizeof(FlightRecord));
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // Records overwritten during the copy are dropped, one more for the record being written
+  const uint64_t head_after = ring.head.load(std::memory_order_relaxed);
+  const uint64_t valid = head_after + 1 > RING_SIZE ? head_after + 1 - RING_SIZE : 0;
+  if (valid >= head) {
+    return 0;
+  }
+  const uint64_t skip = valid > begin ? valid - begin : 0;
+  if (skip > 0) {
+    std::memmove(&g_copy[0], &g_copy[skip], (head - begin - skip) * sizeof(FlightRecord));
+  }
+  return head - begin - skip;
+}
+
+void onSignal(int sig) {
+  if (sig == SIGUSR1) {
+    // The interrupted thread may check errno right after the handler returns
+    const int saved_errno = errno;
+    FlightRecorder::dump("request");
+    errno = saved_errno;
+    return;
+  }
+  char reason[24] = "crash_";
+  size_t len = std::strlen(reason);
+  append(reason, len, sizeof(reason), static_cast<uint64_t>(sig));
+  FlightRecorder::dump(reason);
+  // SA_RESETHAND restored the default action, the process dies as it would have
+  ::raise(sig);
+}
+}  // namespace
+
+void FlightRecorder::install(const std::string &dir) {
+  static std::once_flag once;
+  std::call_once(once, [&dir]() {
+    std::string path = dir;
+    if (path.empty()) {
+      const char *env = std::getenv("FYT_FLIGHT_DIR");
+      path = env != nullptr ? env : "";
+    }
+    if (!path.empty()) {
+      size_t len = 0;
+      g_dir[0] = '\0';
+      append(g_dir, len, sizeof(g_dir), path.c_str());
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND;
+    for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+      ::sigaction(sig, &action, nullptr);
+    }
+    action.sa_flags = SA_RESTART;
+    ::sigaction(SIGUSR1, &action, nullptr);
+  });
+}
+
+void FlightRecorder::record(FlightEvent event,
+                            int16_t id,
+                            uint64_t frame_id,
+                            std::initializer_list<float> values) noexcept {
+  if (t_ring == nullptr) {
+    if (t_no_ring) {
+      return;
+    }
+    const size_t index = g_ring_count.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MAX_THREADS) {
+      t_no_ring = true;
+      return;
+    }
+    t_ring = new FlightRing();
+    t_ring->thread_id = static_cast<uint32_t>(::syscall(SYS_gettid));
+    g_rings[index].store(t_ring, std::memory_order_release);
+  }
+  const uint64_t head = t_ring->head.load(std::memory_order_relaxed);
+  FlightRecord &record = t_ring->records[head & (RING_SIZE - 1)];
+  record.stamp_ns = nowNs();
+  record.frame_id = frame_id;
+  record.thread_id = t_ring->thread_id;
+  record.event = static_cast<uint16_t>(event);
+  record.id = id;
+  const size_t n = std::min(values.size(), std::size(record.values));
+  std::copy_n(values.begin(), n, record.values);
+  std::fill(record.values + n, std::end(record.values), 0.0f);
+  t_ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool FlightRecorder::dump(const char *reason) noexcept {
+  if (g_dumping.test_and_set(std::memory_order_acquire)) {
+    return false;
+  }
+  char path[384];
+  size_t len = 0;
+  append(path, len, sizeof(path), g_dir);
+  append(path, len, sizeof(path), "/flight_");
+  append(path, len, sizeof(path), static_cast<uint64_t>(::getpid()));
+  append(path, len, sizeof(path), "_");
+  append(path, len, sizeof(path), g_dump_count.fetch_add(1, std::memory_order_relaxed));
+  append(path, len, sizeof(path), "_");
+  append(path, len, sizeof(path), reason);
+  append(path, len, sizeof(path), ".bin");
+
+  const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    g_dumping.clear(std::memory_order_release);
+    return false;
+  }
+  FlightFileHeader header;
+  std::memcpy(header.magic, FLIGHT_MAGIC, sizeof(FLIGHT_MAGIC));
+  header.version = FLIGHT_VERSION;
+  header.record_size = sizeof(FlightRecord);
+  header.count = 0;
+  header.dump_ns = nowNs();
+  bool ok = writeAll(fd, &header, sizeof(header));
+  const size_t rings = std::min(g_ring_count.load(std::memory_order_acquire), MAX_THREADS);
+  for (size_t i = 0; i < rings && ok; i++) {
+    // Null while its thread is still registering
+    const FlightRing *ring = g_rings[i].load(std::memory_order_acquire);
+    if (ring == nullptr) {
+      continue;
+    }
+    const size_t count = copyRing(*ring);
+    ok = writeAll(fd, g_copy, count * sizeof(FlightRecord));
+    header.count += count;
+  }
+  // The count is written last, a dump cut short by a second crash is still readable
+  ok = ok && ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+  ::close(fd);
+  g_dumping.clear(std::memory_order_release);
+  return ok;
+}
+
+}  // namespace fyt::utils
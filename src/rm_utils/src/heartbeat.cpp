@@ -14,28 +14,50 @@
 
 #include "rm_utils/heartbeat.hpp"
 
+#include "rm_utils/flight_recorder.hpp"
+#include "rm_utils/thread_config.hpp"
+
 namespace fyt {
 HeartBeatPublisher::SharedPtr HeartBeatPublisher::create(rclcpp::Node *node) {
   return std::shared_ptr<HeartBeatPublisher>(new HeartBeatPublisher(node));
 }
 
 HeartBeatPublisher::HeartBeatPublisher(rclcpp::Node *node) {
+  // Every node has a heartbeat, the first one of the process installs the dump handlers
+  utils::FlightRecorder::install();
   // Initialize message
   message_.data = 0;
   // Create publisher
   std::string node_name = node->get_name();
   std::string topic_name = node_name + "/heartbeat";
   publisher_ = node->create_publisher<std_msgs::msg::Int64>(topic_name, 1);
+  metrics_publisher_ =
+    node->create_publisher<rm_interfaces::msg::NodeMetrics>(node_name + "/metrics", 1);
+  metrics_msg_.header.frame_id = node_name;
+  clock_ = node->get_clock();
+  last_report_ = std::chrono::steady_clock::now();
   // Start publishing thread
   pub_thread_ = std::thread([this]() {
+    utils::configureThread("heartbeat");
     while (rclcpp::ok()) {
       message_.data++;
       publisher_->publish(message_);
+      publishMetrics();
       std::this_thread::sleep_for(std::chrono::seconds(1));
     }
   });
 }
 
+void HeartBeatPublisher::publishMetrics() {
+  const auto now = std::chrono::steady_clock::now();
+  const double period = std::chrono::duration<double>(now - last_report_).count();
+  last_report_ = now;
+  metrics_msg_.header.stamp = clock_->now();
+  metrics_msg_.heartbeat = message_.data;
+  metrics_.fill(metrics_msg_, period);
+  metrics_publisher_->publish(metrics_msg_);
+}
+
 HeartBeatPublisher::~HeartBeatPublisher() {
   if (pub_thread_.joinable()) {
     pub_thread_.join();
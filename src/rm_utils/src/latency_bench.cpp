@@ -0,0 +1,252 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Glass-to-servo latency benchmark. The stamp of a camera frame is its tag: it is carried by
+// the header of Armors, Target and GimbalCmd, and the serial driver publishes the headers of
+// the commands it has written on serial/sent (parameter publish_sent). The benchmark records
+// the arrival of every tag at every hop, then reports the latency from the capture of the
+// frame (total) and between the hops.
+//
+// Usage (the pipeline is already running, e.g. video_player + virtual_serial offline):
+//   ros2 run rm_utils latency_bench --ros-args -p duration:=30.0 -p max_p99_ms:=20.0
+//
+// The exit code is not zero if no frame reached the last hop or the p99 of the total latency
+// is over max_p99_ms, so that it can be used as an acceptance test.
+
+// std
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+// ros2
+#include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/msg/camera_info.hpp>
+#include <std_msgs/msg/header.hpp>
+// third party
+#include <fmt/format.h>
+// project
+#include "rm_interfaces/msg/armors.hpp"
+#include "rm_interfaces/msg/gimbal_cmd.hpp"
+#include "rm_interfaces/msg/target.hpp"
+#include "rm_utils/metrics.hpp"
+
+namespace fyt::utils {
+
+class LatencyBenchNode : public rclcpp::Node {
+  static constexpr size_t HOP_NUM = 5;
+
+public:
+  explicit LatencyBenchNode(const rclcpp::NodeOptions &options)
+  : Node("latency_bench", options) {
+    duration_ = this->declare_parameter("duration", 0.0);
+    max_p99_ms_ = this->declare_parameter("max_p99_ms", 0.0);
+    const double report_period = this->declare_parameter("report_period", 1.0);
+    const std::string csv_file = this->declare_parameter("csv_file", "");
+    // The hops, in the order of the pipeline
+    const std::array<std::array<const char *, 3>, HOP_NUM> hops = {{
+      {"camera", "camera_topic", "camera_info"},
+      {"detector", "armors_topic", "armor_detector/armors"},
+      {"tracker", "target_topic", "armor_solver/target"},
+      {"solver", "cmd_topic", "armor_solver/cmd_gimbal"},
+      {"serial", "sent_topic", "serial/sent"},
+    }};
+    for (size_t i = 0; i < HOP_NUM; i++) {
+      hops_[i].name = hops[i][0];
+      hops_[i].topic = this->declare_parameter(hops[i][1], std::string(hops[i][2]));
+    }
+
+    if (!csv_file.empty()) {
+      csv_ = std::make_unique<std::ofstream>(csv_file);
+      *csv_ << "stamp_ns";
+      for (const auto &hop : hops_) {
+        *csv_ << "," << hop.name << "_ms";
+      }
+      *csv_ << "\n";
+    }
+
+    subscribe<sensor_msgs::msg::CameraInfo>(0);
+    subscribe<rm_interfaces::msg::Armors>(1);
+    subscribe<rm_interfaces::msg::Target>(2);
+    subscribe<rm_interfaces::msg::GimbalCmd>(3);
+    subscribe<std_msgs::msg::Header>(4);
+
+    report_timer_ = this->create_wall_timer(
+      std::chrono::nanoseconds(static_cast<int64_t>(report_period * 1e9)), [this]() {
+        report();
+      });
+    if (duration_ > 0) {
+      stop_timer_ = this->create_wall_timer(
+        std::chrono::nanoseconds(static_cast<int64_t>(duration_ * 1e9)), []() {
+          rclcpp::shutdown();
+        });
+    }
+  }
+
+  // Print the latency of the whole run, return the exit code
+  int finish() {
+    for (auto &[stamp, arrivals] : frames_) {
+      writeCsv(stamp, arrivals);
+    }
+    frames_.clear();
+
+    fmt::print("==== latency_bench: the whole run ====\n");
+    LatencyHistogram::Summary last;
+    for (auto &hop : hops_) {
+      const auto total = hop.run_total.takeSummary();
+      const auto step = hop.run_step.takeSummary();
+      printRow(hop.name, total, step);
+      if (total.count > 0) {
+        last = total;
+      }
+    }
+    if (hops_.back().frames == 0) {
+      fmt::print("FAILED: no frame reached {}\n", hops_.back().topic);
+      return 1;
+    }
+    if (max_p99_ms_ > 0 && last.p99 > max_p99_ms_) {
+      fmt::print("FAILED: p99 {:.2f} ms > {:.2f} ms\n", last.p99, max_p99_ms_);
+      return 1;
+    }
+    return 0;
+  }
+
+private:
+  // Frames kept for the hops that have not arrived yet
+  static constexpr size_t MAX_FRAMES = 512;
+
+  struct Hop {
+    std::string name;
+    std::string topic;
+    uint64_t frames = 0;
+    // From the capture of the frame, and from the previous hop
+    LatencyHistogram period_total;
+    LatencyHistogram period_step;
+    LatencyHistogram run_total;
+    LatencyHistogram run_step;
+  };
+  using Arrivals = std::array<int64_t, HOP_NUM>;
+
+  template <typename MessageT>
+  void subscribe(size_t hop) {
+    subscriptions_.push_back(this->create_subscription<MessageT>(
+      hops_[hop].topic,
+      rclcpp::SensorDataQoS(),
+      [this, hop](const typename MessageT::SharedPtr msg) {
+        onArrival(hop, rclcpp::Time(headerOf(*msg).stamp).nanoseconds());
+      }));
+  }
+
+  static const std_msgs::msg::Header &headerOf(const std_msgs::msg::Header &msg) { return msg; }
+  template <typename MessageT>
+  static const std_msgs::msg::Header &headerOf(const MessageT &msg) {
+    return msg.header;
+  }
+
+  void onArrival(size_t hop, int64_t stamp) {
+    // A command of no frame, e.g. the target is never detected
+    if (stamp == 0) {
+      return;
+    }
+    const int64_t now = this->now().nanoseconds();
+    auto it = frames_.find(stamp);
+    if (it == frames_.end()) {
+      it = frames_.emplace(stamp, Arrivals{}).first;
+      while (frames_.size() > MAX_FRAMES) {
+        writeCsv(frames_.begin()->first, frames_.begin()->second);
+        frames_.erase(frames_.begin());
+      }
+    }
+    Arrivals &arrivals = it->second;
+    // Only the first arrival, e.g. the target is republished for a late frame
+    if (arrivals[hop] != 0) {
+      return;
+    }
+    arrivals[hop] = now;
+
+    auto &h = hops_[hop];
+    h.frames++;
+    h.period_total.record(now - stamp);
+    h.run_total.record(now - stamp);
+    // From the nearest hop before that the frame has reached
+    for (size_t prev = hop; prev-- > 0;) {
+      if (arrivals[prev] != 0) {
+        h.period_step.record(now - arrivals[prev]);
+        h.run_step.record(now - arrivals[prev]);
+        break;
+      }
+    }
+  }
+
+  void writeCsv(int64_t stamp, const Arrivals &arrivals) {
+    if (csv_ == nullptr) {
+      return;
+    }
+    *csv_ << stamp;
+    for (int64_t arrival : arrivals) {
+      if (arrival != 0) {
+        *csv_ << fmt::format(",{:.3f}", (arrival - stamp) / 1e6);
+      } else {
+        *csv_ << ",";
+      }
+    }
+    *csv_ << "\n";
+  }
+
+  static void printRow(const std::string &name,
+                       const LatencyHistogram::Summary &total,
+                       const LatencyHistogram::Summary &step) {
+    fmt::print("{:<9} n={:<6} total p50 {:7.2f} p99 {:7.2f} p999 {:7.2f} max {:7.2f} | "
+               "hop p50 {:7.2f} p99 {:7.2f} max {:7.2f} (ms)\n",
+               name,
+               total.count,
+               total.p50,
+               total.p99,
+               total.p999,
+               total.max,
+               step.p50,
+               step.p99,
+               step.max);
+  }
+
+  void report() {
+    fmt::print("---- latency_bench ----\n");
+    for (auto &hop : hops_) {
+      printRow(hop.name, hop.period_total.takeSummary(), hop.period_step.takeSummary());
+    }
+    std::fflush(stdout);
+  }
+
+  double duration_;
+  double max_p99_ms_;
+  std::array<Hop, HOP_NUM> hops_;
+  std::map<int64_t, Arrivals> frames_;
+  std::unique_ptr<std::ofstream> csv_;
+  std::vector<rclcpp::SubscriptionBase::SharedPtr> subscriptions_;
+  rclcpp::TimerBase::SharedPtr report_timer_;
+  rclcpp::TimerBase::SharedPtr stop_timer_;
+};
+
+}  // namespace fyt::utils
+
+int main(int argc, char **argv) {
+  rclcpp::init(argc, argv);
+  auto node = std::make_shared<fyt::utils::LatencyBenchNode>(rclcpp::NodeOptions());
+  rclcpp::spin(node);
+  const int ret = node->finish();
+  rclcpp::shutdown();
+  return ret;
+}
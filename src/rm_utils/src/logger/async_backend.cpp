@@ -0,0 +1,125 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/logger/impl/async_backend.hpp"
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <mutex>
+
+#include "rm_utils/logger/impl/global_mutex.hpp"
+#include "rm_utils/logger/impl/logger_impl.hpp"
+
+namespace fyt::logger::internal {
+
+AsyncBackend &AsyncBackend::instance() {
+  // Leaked on purpose, so that it outlives every logger and static object that logs at exit
+  static AsyncBackend *backend = [] {
+    auto *b = new AsyncBackend();
+    std::atexit([] { instance().stop(); });
+    return b;
+  }();
+  return *backend;
+}
+
+AsyncBackend::AsyncBackend() : thread_(&AsyncBackend::run, this) {}
+
+void AsyncBackend::flush() {
+  if (stopped_.load(std::memory_order_acquire)) {
+    return;
+  }
+  const uint64_t target = pushed_.load(std::memory_order_acquire);
+  while (flushed_.load(std::memory_order_acquire) < target &&
+         !stopped_.load(std::memory_order_acquire)) {
+    flush_requested_.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void AsyncBackend::stop() {
+  if (stopped_.exchange(true)) {
+    return;
+  }
+  running_.store(false, std::memory_order_release);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+size_t AsyncBackend::writeBatch() {
+  fmt::memory_buffer console;
+  size_t count = 0;
+  bool urgent = false;
+  while (queue_.consume([&](const Record &record) {
+    record.logger->write(record, console);
+    dirty_loggers_.insert(record.logger);
+    urgent = urgent || record.level >= LogLevel::ERROR;
+  })) {
+    count++;
+  }
+
+  const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != reported_dropped_) {
+    fmt::format_to(std::back_inserter(console),
+                   fg(fmt::color::yellow),
+                   "[WARN]  [logger] : {} records dropped, the log ring is full\n",
+                   dropped - reported_dropped_);
+    reported_dropped_ = dropped;
+  }
+
+  if (console.size() > 0) {
+    std::lock_guard<std::mutex> lock(GlobalMutex::getConsoleMutex());
+    std::fwrite(console.data(), 1, console.size(), stdout);
+    std::fflush(stdout);
+  }
+  written_.fetch_add(count, std::memory_order_release);
+  if (urgent) {
+    flushFiles();
+  }
+  return count;
+}
+
+void AsyncBackend::flushFiles() {
+  for (Logger *logger : dirty_loggers_) {
+    logger->flushFile();
+  }
+  dirty_loggers_.clear();
+  flushed_.store(written_.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+void AsyncBackend::run() {
+  auto last_flush = std::chrono::steady_clock::now();
+  while (running_.load(std::memory_order_acquire)) {
+    const size_t count = writeBatch();
+    const auto now = std::chrono::steady_clock::now();
+    if (flush_requested_.exchange(false, std::memory_order_acq_rel) ||
+        now - last_flush > std::chrono::milliseconds(FLUSH_PERIOD_MS)) {
+      flushFiles();
+      last_flush = now;
+    }
+    if (count == 0) {
+      // Nothing to write, the producers never wake the thread
+      std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_SLEEP_MS));
+    }
+  }
+  // Producers that passed the check before the stop finish their records in a moment
+  std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_SLEEP_MS));
+  writeBatch();
+  flushFiles();
+}
+
+}  // namespace fyt::logger::internal
@@ -16,7 +16,9 @@
 #include "rm_utils/logger/impl/logger_impl.hpp"
 
 #include <chrono>
+#include <ctime>
 #include <iomanip>
+#include <iterator>
 #include <string>
 #include <utility>
 
@@ -56,9 +58,38 @@ Logger::Logger(std::string name, std::string filename, LogLevel level, LogOption
   writer_ = std::make_unique<Writer>(filename);
 }
 
-void Logger::setLevel(LogLevel level) { level_ = level; }
+void Logger::setLevel(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
 
-void Logger::flush() { writer_->flush(); }
+void Logger::flush() {
+  AsyncBackend::instance().flush();
+  writer_->flush();
+}
+
+void Logger::flushFile() { writer_->flush(); }
+
+void Logger::write(const Record &record, fmt::memory_buffer &console) {
+  // The time is formatted once per second
+  thread_local int64_t cached_second = -1;
+  thread_local char cached_time[32];
+  const int64_t second = record.stamp_ns / 1'000'000'000;
+  if (second != cached_second) {
+    std::time_t tt = static_cast<std::time_t>(second);
+    std::tm tm;
+    localtime_r(&tt, &tm);
+    std::strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S", &tm);
+    cached_second = second;
+  }
+
+  const auto level = static_cast<std::uint8_t>(record.level);
+  const std::string message = fmt::format("[{}]  [{}]  [{}] : {}",
+                                          LogNameTable[level],
+                                          name_,
+                                          cached_time,
+                                          std::string_view(record.text, record.size));
+  writer_->write(fmt::format(LogColorTable[level], message));
+  fmt::format_to(std::back_inserter(console), fg(LogFmtColorTable[level]), "{}", message);
+  console.push_back('\n');
+}
 
 std::string Logger::getLocalTime() {
   std::time_t tt = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
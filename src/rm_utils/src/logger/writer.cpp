@@ -32,9 +32,9 @@ Writer::Writer(const std::string &filename) : r_mutex_(GlobalMutex::getFileMutex
 }
 
 void Writer::write(const std::string &message) {
+  // Flushed by the backend in batches
   std::lock_guard<std::mutex> lock(r_mutex_);
   file_ << message << "\n\n";
-  file_.flush();
 }
 
 void Writer::flush() {
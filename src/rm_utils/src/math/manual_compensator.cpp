@@ -46,33 +46,70 @@ bool ManualCompensator::updateMap(const LineRegion& d_region,
         return false;
       }
     }
+    compileIndex();
     return true;
   }
 
-std::vector<double> ManualCompensator::angleHardCorrect(const double dist, 
-                                           const double height) {
-  auto target_dist_node = 
-    std::find_if(angle_offset_map_.begin(), 
-                  angle_offset_map_.end(),
-                  [&](const DistMapNode& dist_node) {
-    return dist_node.dist_region.checkPoint(dist); 
-  });
+std::array<double, 2> ManualCompensator::angleHardCorrect(const double dist,
+                                                          const double height) const {
+  // Index of the cell whose lower bound is the largest one not above the value
+  auto findCell = [](const std::vector<double>& bounds, const double value) {
+    return static_cast<int>(std::upper_bound(bounds.begin(), bounds.end(), value) -
+                            bounds.begin()) - 1;
+  };
 
-  if (target_dist_node != angle_offset_map_.end()) {
-    auto target_height_node = 
-      std::find_if(target_dist_node->height_map.begin(),
-                    target_dist_node->height_map.end(),
-                    [&](const HeightMapNode& height_node) {
-      return height_node.height_region.checkPoint(height);
-    });
+  const int dist_cell = findCell(dist_bounds_, dist);
+  const int height_cell = findCell(height_bounds_, height);
+  const int dist_cells = static_cast<int>(dist_bounds_.size()) - 1;
+  const int height_cells = static_cast<int>(height_bounds_.size()) - 1;
+  if (dist_cell < 0 || dist_cell >= dist_cells || height_cell < 0 || height_cell >= height_cells) {
+    return {0.0, 0.0};
+  }
+  return cells_[dist_cell * height_cells + height_cell];
+}
 
-    if (target_height_node != target_dist_node->height_map.end()) {
-      return {target_height_node->pitch_offset, target_height_node->yaw_offset};    
+void ManualCompensator::compileIndex() {
+  dist_bounds_.clear();
+  height_bounds_.clear();
+  for (const auto& dist_node : angle_offset_map_) {
+    for (const auto& height_node : dist_node.height_map) {
+      dist_bounds_.push_back(dist_node.dist_region.lowwer());
+      dist_bounds_.push_back(dist_node.dist_region.upper());
+      height_bounds_.push_back(height_node.height_region.lowwer());
+      height_bounds_.push_back(height_node.height_region.upper());
     }
   }
-  return {0.0, 0.0};
-} 
-  
+  for (auto* bounds : {&dist_bounds_, &height_bounds_}) {
+    std::sort(bounds->begin(), bounds->end());
+    bounds->erase(std::unique(bounds->begin(), bounds->end()), bounds->end());
+  }
+
+  const size_t height_cells = height_bounds_.empty() ? 0 : height_bounds_.size() - 1;
+  const size_t dist_cells = dist_bounds_.empty() ? 0 : dist_bounds_.size() - 1;
+  cells_.assign(dist_cells * height_cells, {0.0, 0.0});
+
+  auto cellRange = [](const std::vector<double>& bounds, const LineRegion& region) {
+    auto first = std::lower_bound(bounds.begin(), bounds.end(), region.lowwer());
+    auto last = std::lower_bound(bounds.begin(), bounds.end(), region.upper());
+    return std::make_pair(first - bounds.begin(), last - bounds.begin());
+  };
+
+  // Paint the regions backwards, so the first region covering a cell wins
+  for (auto dist_node = angle_offset_map_.rbegin(); dist_node != angle_offset_map_.rend();
+       ++dist_node) {
+    const auto [d_first, d_last] = cellRange(dist_bounds_, dist_node->dist_region);
+    for (auto height_node = dist_node->height_map.rbegin();
+         height_node != dist_node->height_map.rend(); ++height_node) {
+      const auto [h_first, h_last] = cellRange(height_bounds_, height_node->height_region);
+      for (auto i = d_first; i < d_last; ++i) {
+        for (auto j = h_first; j < h_last; ++j) {
+          cells_[i * height_cells + j] = {height_node->pitch_offset, height_node->yaw_offset};
+        }
+      }
+    }
+  }
+}
+
 bool ManualCompensator::parseStr(const std::string& str, 
                                  std::vector<double>& nums) {
   std::stringstream ss(str);
@@ -15,15 +15,81 @@
 
 #include "rm_utils/math/trajectory_compensator.hpp"
 
+#include <cmath>
+#include <limits>
+
 namespace fyt {
 bool TrajectoryCompensator::compensate(const Eigen::Vector3d &target_position,
                                        double &pitch) const noexcept {
   double target_height = target_position(2);
+  double distance =
+    std::sqrt(target_position(0) * target_position(0) + target_position(1) * target_position(1));
+
+  // The interpolated pitch is a warm start for Newton, the iterations are the fallback
+  double table_pitch = 0;
+  if (tableValid() && lookupTable(pitch_table_, distance, target_height, table_pitch) &&
+      refine(distance, target_height, table_pitch)) {
+    pitch = table_pitch;
+    return true;
+  }
+  return compensateIteratively(distance, target_height, pitch);
+}
+
+double TrajectoryCompensator::getFlyingTime(const Eigen::Vector3d &target_position) const noexcept {
+  double distance =
+    std::sqrt(target_position(0) * target_position(0) + target_position(1) * target_position(1));
+  double t = 0;
+  if (tableValid() && lookupTable(flying_time_table_, distance, target_position(2), t)) {
+    return t;
+  }
+  return calculateFlyingTime(target_position);
+}
+
+void TrajectoryCompensator::buildTable(double max_distance,
+                                       double min_height,
+                                       double max_height,
+                                       double step) {
+  pitch_table_.clear();
+  flying_time_table_.clear();
+  if (step <= 0 || max_distance <= 0 || max_height <= min_height) {
+    return;
+  }
+
+  table_cols_ = static_cast<int>(std::ceil(max_distance / step)) + 1;
+  table_rows_ = static_cast<int>(std::ceil((max_height - min_height) / step)) + 1;
+  table_min_height_ = min_height;
+  table_step_ = step;
+  pitch_table_.resize(table_rows_ * table_cols_);
+  flying_time_table_.resize(table_rows_ * table_cols_);
+
+  for (int row = 0; row < table_rows_; ++row) {
+    double height = min_height + row * step;
+    for (int col = 0; col < table_cols_; ++col) {
+      double distance = col * step;
+      double pitch = 0;
+      int index = row * table_cols_ + col;
+      if (distance > 0 && compensateIteratively(distance, height, pitch)) {
+        pitch_table_[index] = static_cast<float>(pitch);
+        flying_time_table_[index] =
+          static_cast<float>(calculateFlyingTime(Eigen::Vector3d(distance, 0, height)));
+      } else {
+        pitch_table_[index] = std::numeric_limits<float>::quiet_NaN();
+        flying_time_table_[index] = std::numeric_limits<float>::quiet_NaN();
+      }
+    }
+  }
+
+  table_velocity_ = velocity;
+  table_gravity_ = gravity;
+  table_resistance_ = resistance;
+}
+
+bool TrajectoryCompensator::compensateIteratively(double distance,
+                                                  double target_height,
+                                                  double &pitch) const noexcept {
   // The iterative_height is used to calculate angle in each iteration
   double iterative_height = target_height;
   double impact_height = 0;
-  double distance =
-    std::sqrt(target_position(0) * target_position(0) + target_position(1) * target_position(1));
   double angle = std::atan2(target_height, distance);
   double dh = 0;
   // Iterate to find the right angle, which makes the impact height equal to the
@@ -47,6 +113,51 @@ bool TrajectoryCompensator::compensate(const Eigen::Vector3d &target_position,
   return true;
 }
 
+bool TrajectoryCompensator::refine(double distance,
+                                   double target_height,
+                                   double &pitch) const noexcept {
+  constexpr double kDelta = 1e-4;
+  constexpr int kMaxSteps = 2;
+  for (int i = 0;; ++i) {
+    double dh = target_height - calculateTrajectory(distance, pitch);
+    if (std::abs(dh) < 0.01) {
+      return std::abs(pitch) <= M_PI / 2.5;
+    }
+    if (i == kMaxSteps) {
+      return false;
+    }
+    // Numerical derivative of the impact height with respect to the pitch
+    double slope = (calculateTrajectory(distance, pitch + kDelta) -
+                    calculateTrajectory(distance, pitch)) /
+                   kDelta;
+    if (!(std::abs(slope) > 1e-9)) {
+      return false;
+    }
+    pitch += dh / slope;
+  }
+}
+
+bool TrajectoryCompensator::lookupTable(const std::vector<float> &table,
+                                        double distance,
+                                        double height,
+                                        double &value) const noexcept {
+  double x = distance / table_step_;
+  double y = (height - table_min_height_) / table_step_;
+  if (!(x >= 0 && y >= 0 && x < table_cols_ - 1 && y < table_rows_ - 1)) {
+    return false;
+  }
+  int col = static_cast<int>(x);
+  int row = static_cast<int>(y);
+  double fx = x - col, fy = y - row;
+
+  const float *cell = table.data() + row * table_cols_ + col;
+  double v00 = cell[0], v01 = cell[1];
+  double v10 = cell[table_cols_], v11 = cell[table_cols_ + 1];
+  value = (v00 * (1 - fx) + v01 * fx) * (1 - fy) + (v10 * (1 - fx) + v11 * fx) * fy;
+  // Any unreachable corner makes the result NaN
+  return !std::isnan(value);
+}
+
 std::vector<std::pair<double, double>> TrajectoryCompensator::getTrajectory(
   double distance, double angle) const noexcept {
   std::vector<std::pair<double, double>> trajectory;
@@ -67,7 +178,7 @@ double IdealCompensator::calculateTrajectory(const double x, const double angle)
   return y;
 }
 
-double IdealCompensator::getFlyingTime(const Eigen::Vector3d &target_position) const noexcept {
+double IdealCompensator::calculateFlyingTime(const Eigen::Vector3d &target_position) const noexcept {
   double distance =
     sqrt(target_position(0) * target_position(0) + target_position(1) * target_position(1));
   double angle = atan2(target_position(2), distance);
@@ -83,7 +194,8 @@ double ResistanceCompensator::calculateTrajectory(const double x,
   return y;
 }
 
-double ResistanceCompensator::getFlyingTime(const Eigen::Vector3d &target_position) const noexcept {
+double ResistanceCompensator::calculateFlyingTime(
+  const Eigen::Vector3d &target_position) const noexcept {
   double r = resistance < 1e-4 ? 1e-4 : resistance;
   double distance =
     sqrt(target_position(0) * target_position(0) + target_position(1) * target_position(1));
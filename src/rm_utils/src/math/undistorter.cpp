@@ -0,0 +1,80 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/math/undistorter.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace fyt {
+Undistorter::Undistorter(const std::array<double, 9> &camera_matrix,
+                         const std::vector<double> &distortion_coefficients,
+                         int width,
+                         int height)
+: fx_(camera_matrix[0]), fy_(camera_matrix[4]), cx_(camera_matrix[2]), cy_(camera_matrix[5]) {
+  dist_.fill(0);
+  std::copy_n(distortion_coefficients.begin(),
+              std::min<std::size_t>(distortion_coefficients.size(), dist_.size()),
+              dist_.begin());
+  pinhole_ = std::all_of(dist_.begin(), dist_.end(), [](double d) { return d == 0; });
+  if (pinhole_ || width <= 0 || height <= 0) {
+    return;
+  }
+
+  // One node beyond the last pixel on each side, so that every pixel lies inside a cell
+  grid_cols_ = width / GRID_STEP + 2;
+  grid_rows_ = height / GRID_STEP + 2;
+  table_.resize(static_cast<std::size_t>(grid_cols_) * grid_rows_);
+  for (int r = 0; r < grid_rows_; r++) {
+    for (int c = 0; c < grid_cols_; c++) {
+      table_[r * grid_cols_ + c] = undistortExact(c * GRID_STEP, r * GRID_STEP);
+    }
+  }
+}
+
+cv::Point2f Undistorter::undistort(const cv::Point2f &p) const noexcept {
+  if (pinhole_) {
+    return p;
+  }
+  const float gx = p.x / GRID_STEP, gy = p.y / GRID_STEP;
+  const int c = static_cast<int>(std::floor(gx)), r = static_cast<int>(std::floor(gy));
+  if (c < 0 || r < 0 || c + 1 >= grid_cols_ || r + 1 >= grid_rows_) {
+    return undistortExact(p.x, p.y);
+  }
+  const float ax = gx - c, ay = gy - r;
+  const cv::Point2f *row0 = &table_[r * grid_cols_ + c];
+  const cv::Point2f *row1 = row0 + grid_cols_;
+  return (row0[0] * (1 - ax) + row0[1] * ax) * (1 - ay) + (row1[0] * (1 - ax) + row1[1] * ax) * ay;
+}
+
+cv::Point2f Undistorter::undistortExact(double u, double v) const noexcept {
+  const double x0 = (u - cx_) / fx_, y0 = (v - cy_) / fy_;
+  const double k1 = dist_[0], k2 = dist_[1], p1 = dist_[2], p2 = dist_[3], k3 = dist_[4];
+  double x = x0, y = y0;
+  for (int i = 0; i < 20; i++) {
+    const double r2 = x * x + y * y;
+    const double icdist = 1 / (1 + ((k3 * r2 + k2) * r2 + k1) * r2);
+    const double delta_x = 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+    const double delta_y = p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+    const double next_x = (x0 - delta_x) * icdist, next_y = (y0 - delta_y) * icdist;
+    const bool converged = std::abs(next_x - x) + std::abs(next_y - y) < 1e-10;
+    x = next_x, y = next_y;
+    if (converged) {
+      break;
+    }
+  }
+  return cv::Point2f(static_cast<float>(fx_ * x + cx_), static_cast<float>(fy_ * y + cy_));
+}
+}  // namespace fyt
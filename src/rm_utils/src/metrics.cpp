@@ -0,0 +1,131 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/metrics.hpp"
+
+// std
+#include <algorithm>
+
+namespace fyt::utils {
+
+size_t LatencyHistogram::bucketOf(uint64_t us) noexcept {
+  us = std::min(us, MAX_US);
+  if (us < SUB_BUCKETS) {
+    return us;
+  }
+  const int msb = 63 - __builtin_clzll(us);
+  const int shift = msb - SUB_BITS + 1;
+  return shift * HALF_BUCKETS + (us >> shift);
+}
+
+uint64_t LatencyHistogram::bucketLimit(size_t bucket) noexcept {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  const int shift = static_cast<int>(bucket / HALF_BUCKETS) - 1;
+  const uint64_t sub = bucket - shift * HALF_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+LatencyHistogram::Summary LatencyHistogram::takeSummary() noexcept {
+  std::array<uint64_t, BUCKET_NUM> counts;
+  Summary summary;
+  for (size_t i = 0; i < counts.size(); i++) {
+    counts[i] = buckets_[i].exchange(0, std::memory_order_relaxed);
+    summary.count += counts[i];
+  }
+  const uint64_t max_us = max_us_.exchange(0, std::memory_order_relaxed);
+  if (summary.count == 0) {
+    return summary;
+  }
+
+  // Rank of the sample of each percentile, 1-based
+  const double quantiles[] = {0.5, 0.99, 0.999};
+  double *values[] = {&summary.p50, &summary.p99, &summary.p999};
+  size_t q = 0;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts.size() && q < std::size(quantiles); i++) {
+    seen += counts[i];
+    while (q < std::size(quantiles) &&
+           seen >= std::max<uint64_t>(1, quantiles[q] * summary.count + 0.5)) {
+      // A bucket never reports more than the largest sample
+      *values[q] = std::min(bucketLimit(i), max_us) / 1e3;
+      q++;
+    }
+  }
+  summary.max = max_us / 1e3;
+  return summary;
+}
+
+LatencyHistogram &Metrics::latency(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : latencies_) {
+    if (entry.name == name) {
+      return *entry.value;
+    }
+  }
+  latencies_.push_back({name, std::make_unique<LatencyHistogram>()});
+  return *latencies_.back().value;
+}
+
+namespace {
+std::atomic<int64_t> &findOrAdd(std::vector<Metrics::ValueEntry> &entries,
+                                const std::string &name) {
+  for (auto &entry : entries) {
+    if (entry.name == name) {
+      return *entry.value;
+    }
+  }
+  entries.push_back({name, std::make_unique<std::atomic<int64_t>>(0)});
+  return *entries.back().value;
+}
+}  // namespace
+
+std::atomic<int64_t> &Metrics::counter(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return findOrAdd(counters_, name);
+}
+
+std::atomic<int64_t> &Metrics::gauge(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return findOrAdd(gauges_, name);
+}
+
+void Metrics::fill(rm_interfaces::msg::NodeMetrics &msg, double period) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  msg.stages.resize(latencies_.size());
+  for (size_t i = 0; i < latencies_.size(); i++) {
+    const auto summary = latencies_[i].value->takeSummary();
+    auto &stage = msg.stages[i];
+    stage.name = latencies_[i].name;
+    stage.count = static_cast<uint32_t>(summary.count);
+    stage.rate = period > 0 ? static_cast<float>(summary.count / period) : 0.f;
+    stage.p50 = static_cast<float>(summary.p50);
+    stage.p99 = static_cast<float>(summary.p99);
+    stage.p999 = static_cast<float>(summary.p999);
+    stage.max = static_cast<float>(summary.max);
+  }
+  auto fill_values = [](const std::vector<ValueEntry> &entries,
+                        std::vector<rm_interfaces::msg::MetricValue> &values) {
+    values.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      values[i].name = entries[i].name;
+      values[i].value = entries[i].value->load(std::memory_order_relaxed);
+    }
+  };
+  fill_values(counters_, msg.counters);
+  fill_values(gauges_, msg.gauges);
+}
+
+}  // namespace fyt::utils
@@ -0,0 +1,77 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/opencv_config.hpp"
+
+// std
+#include <algorithm>
+#include <thread>
+// third party
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/core/utility.hpp>
+// project
+#include "rm_utils/worker_pool.hpp"
+
+namespace fyt::utils {
+
+OpenCVConfig declareOpenCVConfig(rclcpp::Node &node) {
+  OpenCVConfig config;
+  config.threads = node.declare_parameter("opencv.threads", config.threads);
+  config.use_optimized = node.declare_parameter("opencv.use_optimized", config.use_optimized);
+  config.use_ipp = node.declare_parameter("opencv.use_ipp", config.use_ipp);
+  config.use_opencl = node.declare_parameter("opencv.use_opencl", config.use_opencl);
+  config.baseline = node.declare_parameter("opencv.baseline", config.baseline);
+  return config;
+}
+
+std::string applyOpenCVConfig(const OpenCVConfig &config) {
+  int threads = config.threads;
+  if (config.baseline) {
+    threads = 1;
+  } else if (threads < 0) {
+    const int cores = std::max<int>(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    threads = std::max(cores - static_cast<int>(WorkerPool::instance().threadNum()), 1);
+  }
+  if (threads > 0) {
+    cv::setNumThreads(threads);
+  }
+  cv::setUseOptimized(config.use_optimized && !config.baseline);
+  cv::ipp::setUseIPP(config.use_ipp && !config.baseline);
+  cv::ocl::setUseOpenCL(config.use_opencl && !config.baseline);
+
+  std::string text = config.baseline ? "baseline, " : "";
+  text += "threads " + std::to_string(cv::getNumThreads());
+  text += std::string(", optimized ") + (cv::useOptimized() ? "on" : "off");
+  text += std::string(", ipp ") + (cv::ipp::useIPP() ? "on" : "off");
+  text += std::string(", opencl ") + (cv::ocl::useOpenCL() ? "on" : "off");
+  // Nothing is dispatched to while the optimizations are off
+  text += ", dispatch:";
+  bool any = false;
+  for (int feature = 1; feature < CV_HARDWARE_MAX_FEATURE; feature++) {
+    const std::string name = cv::getHardwareFeatureName(feature);
+    if (!name.empty() && cv::checkHardwareSupport(feature)) {
+      text += " " + name;
+      any = true;
+    }
+  }
+  if (!any) {
+    text += " none";
+  }
+  // Built for, * marks the baseline of the build and ? a feature missing on this CPU
+  text += " (build: " + cv::getCPUFeaturesLine() + ")";
+  return text;
+}
+
+}  // namespace fyt::utils
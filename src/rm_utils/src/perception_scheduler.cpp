@@ -0,0 +1,163 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/perception_scheduler.hpp"
+
+#include "rm_utils/thread_config.hpp"
+// std
+#include <algorithm>
+#include <utility>
+
+namespace fyt::utils {
+PerceptionScheduler &PerceptionScheduler::instance(size_t thread_num) {
+  // Lives in rm_utils so that every detector library of the process gets the same one
+  static PerceptionScheduler scheduler(thread_num);
+  return scheduler;
+}
+
+PerceptionScheduler::PerceptionScheduler(size_t thread_num) {
+  if (thread_num == 0) {
+    thread_num = std::max<size_t>(std::thread::hardware_concurrency() / 2, 1);
+  }
+  workers_.reserve(thread_num);
+  for (size_t i = 0; i < thread_num; i++) {
+    workers_.emplace_back(&PerceptionScheduler::workerLoop, this);
+  }
+}
+
+PerceptionScheduler::~PerceptionScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+  }
+  task_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+int PerceptionScheduler::addQueue(const std::string &name, size_t capacity, int priority) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto queue = std::make_unique<Queue>();
+  queue->name = name;
+  queue->capacity = std::max<size_t>(capacity, 1);
+  queue->priority = priority;
+  const int id = next_id_++;
+  queues_.emplace_back(id, std::move(queue));
+  return id;
+}
+
+void PerceptionScheduler::removeQueue(int id) {
+  std::unique_lock<std::mutex> lock(mtx_);
+  Queue *queue = findQueue(id);
+  if (queue == nullptr) {
+    return;
+  }
+  queue->tasks.clear();
+  idle_cv_.wait(lock, [queue] { return !queue->running; });
+  queues_.erase(std::find_if(
+    queues_.begin(), queues_.end(), [id](const auto &entry) { return entry.first == id; }));
+}
+
+bool PerceptionScheduler::submit(int id, Task task) {
+  bool dropped = false;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Queue *queue = findQueue(id);
+    if (queue == nullptr) {
+      return false;
+    }
+    if (queue->tasks.size() >= queue->capacity) {
+      queue->tasks.pop_front();
+      queue->dropped++;
+      dropped = true;
+    }
+    queue->tasks.emplace_back(std::move(task));
+  }
+  task_cv_.notify_one();
+  return !dropped;
+}
+
+void PerceptionScheduler::setPriority(int id, int priority) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (Queue *queue = findQueue(id)) {
+    queue->priority = priority;
+  }
+}
+
+uint64_t PerceptionScheduler::droppedCount(int id) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  Queue *queue = findQueue(id);
+  return queue == nullptr ? 0 : queue->dropped;
+}
+
+PerceptionScheduler::Queue *PerceptionScheduler::pickQueue() noexcept {
+  Queue *best = nullptr;
+  for (auto &entry : queues_) {
+    Queue *queue = entry.second.get();
+    if (queue->running || queue->tasks.empty()) {
+      continue;
+    }
+    if (best == nullptr || queue->priority > best->priority ||
+        (queue->priority == best->priority && queue->last_served < best->last_served)) {
+      best = queue;
+    }
+  }
+  return best;
+}
+
+PerceptionScheduler::Queue *PerceptionScheduler::findQueue(int id) noexcept {
+  for (auto &entry : queues_) {
+    if (entry.first == id) {
+      return entry.second.get();
+    }
+  }
+  return nullptr;
+}
+
+void PerceptionScheduler::workerLoop() {
+  configureThread("perception");
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (true) {
+    Queue *queue = nullptr;
+    task_cv_.wait(lock, [this, &queue] {
+      queue = stop_ ? nullptr : pickQueue();
+      return stop_ || queue != nullptr;
+    });
+    if (stop_) {
+      return;
+    }
+
+    Task task = std::move(queue->tasks.front());
+    queue->tasks.pop_front();
+    queue->running = true;
+    queue->last_served = ++serve_count_;
+
+    lock.unlock();
+    try {
+      task();
+    } catch (...) {
+    }
+    lock.lock();
+
+    // The queue can not be removed while running
+    queue->running = false;
+    idle_cv_.notify_all();
+    if (!queue->tasks.empty()) {
+      // Its next task was skipped by the other workers while this one was running
+      task_cv_.notify_one();
+    }
+  }
+}
+}  // namespace fyt::utils
@@ -0,0 +1,286 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/sample_dumper.hpp"
+
+// std
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <utility>
+// system
+#include <pthread.h>
+#include <sched.h>
+// 3rd party
+#include <fmt/format.h>
+#include <opencv2/imgcodecs.hpp>
+// project
+#include "rm_utils/thread_config.hpp"
+
+namespace fyt::utils {
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr auto WRITE_PERIOD = std::chrono::milliseconds(100);
+
+int64_t steadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// Size of the regular files under the directory
+uint64_t directorySize(const fs::path &directory) {
+  uint64_t size = 0;
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(directory, ec);
+       !ec && it != fs::recursive_directory_iterator();
+       it.increment(ec)) {
+    if (it->is_regular_file(ec)) {
+      size += it->file_size(ec);
+    }
+  }
+  return size;
+}
+}  // namespace
+
+bool SampleDumper::parseFormat(const std::string &text, Format &format) {
+  if (text == "png") {
+    format = Format::PNG;
+  } else if (text == "shard") {
+    format = Format::SHARD;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+SampleDumper::SampleDumper(const Params &params) : params_(params) {
+  interval_ns_ = params_.max_rate > 0 ? static_cast<int64_t>(1e9 / params_.max_rate) : 0;
+  quota_bytes_ = static_cast<uint64_t>(std::max(params_.quota_mb, 0.0) * 1024 * 1024);
+  shard_bytes_ = static_cast<uint64_t>(std::max(params_.shard_mb, 1.0) * 1024 * 1024);
+  thread_ = std::thread(&SampleDumper::run, this);
+}
+
+SampleDumper::~SampleDumper() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+  if (shard_ != nullptr) {
+    std::fclose(shard_);
+  }
+}
+
+bool SampleDumper::submit(const cv::Mat &image,
+                          std::string_view label,
+                          int64_t stamp_ns,
+                          float confidence) {
+  if (image.empty() || !ready_.load(std::memory_order_relaxed) ||
+      quota_reached_.load(std::memory_order_relaxed)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (interval_ns_ > 0) {
+    // Only one of the callers racing for a slot of the rate wins it
+    const int64_t now = steadyNs();
+    int64_t next = next_ns_.load(std::memory_order_relaxed);
+    if (now < next ||
+        !next_ns_.compare_exchange_strong(next, now + interval_ns_, std::memory_order_relaxed)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  // The slot keeps the buffer of the sample it held, so a crop of the same size is not allocated
+  const bool queued = queue_.emplace([&](Sample &sample) {
+    image.copyTo(sample.image);
+    sample.label.assign(label.data(), label.size());
+    sample.stamp_ns = stamp_ns;
+    sample.confidence = confidence;
+  });
+  if (!queued) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return queued;
+}
+
+void SampleDumper::run() {
+  configureThread("sample_dump");
+  // Below every other thread, the samples are written only when a core is idle
+  sched_param param{};
+  if (::pthread_setschedparam(::pthread_self(), SCHED_IDLE, &param) != 0) {
+    std::fprintf(stderr, "[sample_dumper] Failed to set SCHED_IDLE for the writer thread\n");
+  }
+
+  std::error_code ec;
+  fs::create_directories(params_.directory, ec);
+  if (ec) {
+    fmt::print(
+      stderr, "[sample_dumper] Failed to create {}: {}\n", params_.directory, ec.message());
+    return;
+  }
+  used_bytes_ = directorySize(params_.directory);
+  if (used_bytes_ >= quota_bytes_) {
+    fmt::print(
+      stderr, "[sample_dumper] {} is over the quota, no sample is saved\n", params_.directory);
+    quota_reached_ = true;
+  }
+  ready_ = true;
+
+  bool stop = false;
+  while (!stop) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, WRITE_PERIOD, [this]() { return stop_; });
+      stop = stop_;
+    }
+    // Whatever is queued at the stop is written too
+    for (;;) {
+      size_t n = 0;
+      while (n < BATCH_SIZE &&
+             queue_.consume([this, n](Sample &sample) { std::swap(batch_[n], sample); })) {
+        n++;
+      }
+      if (n == 0) {
+        break;
+      }
+      writeBatch(n);
+    }
+    if (shard_ != nullptr) {
+      std::fflush(shard_);
+    }
+  }
+}
+
+void SampleDumper::writeBatch(size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (quota_reached_) {
+      dropped_.fetch_add(n - i, std::memory_order_relaxed);
+      return;
+    }
+    const bool ok =
+      params_.format == Format::PNG ? writePng(batch_[i]) : writeShard(batch_[i]);
+    if (ok) {
+      dumped_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (used_bytes_ >= quota_bytes_ && !quota_reached_) {
+      fmt::print(stderr,
+                 "[sample_dumper] {} reached the quota of {} MB\n",
+                 params_.directory,
+                 params_.quota_mb);
+      quota_reached_ = true;
+    }
+  }
+}
+
+bool SampleDumper::writePng(const Sample &sample) {
+  if (!cv::imencode(".png", sample.image, png_buffer_)) {
+    return false;
+  }
+  const fs::path directory = fs::path(params_.directory) / sample.label;
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+  const fs::path path =
+    directory / fmt::format("{}_{:03d}.png",
+                            sample.stamp_ns,
+                            static_cast<int>(std::clamp(sample.confidence, 0.0f, 1.0f) * 100));
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    fmt::print(
+      stderr, "[sample_dumper] Failed to open {}: {}\n", path.string(), std::strerror(errno));
+    return false;
+  }
+  const bool ok =
+    std::fwrite(png_buffer_.data(), 1, png_buffer_.size(), file) == png_buffer_.size();
+  std::fclose(file);
+  used_bytes_ += png_buffer_.size();
+  return ok;
+}
+
+bool SampleDumper::writeShard(const Sample &sample) {
+  const cv::Mat &image = sample.image;
+  if (image.rows > std::numeric_limits<uint16_t>::max() ||
+      image.cols > std::numeric_limits<uint16_t>::max()) {
+    return false;
+  }
+  if (shard_ != nullptr && shard_size_ >= shard_bytes_) {
+    std::fclose(shard_);
+    shard_ = nullptr;
+  }
+  if (shard_ == nullptr) {
+    const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+    const fs::path path =
+      fs::path(params_.directory) / fmt::format("shard_{}_{}.bin", now, shard_index_++);
+    shard_ = std::fopen(path.c_str(), "wb");
+    if (shard_ == nullptr) {
+      fmt::print(
+        stderr, "[sample_dumper] Failed to open {}: {}\n", path.string(), std::strerror(errno));
+      return false;
+    }
+    SampleShardHeader header{};
+    std::copy(std::begin(SAMPLE_SHARD_MAGIC), std::end(SAMPLE_SHARD_MAGIC), header.magic);
+    header.version = SAMPLE_SHARD_VERSION;
+    std::fwrite(&header, sizeof(header), 1, shard_);
+    shard_size_ = sizeof(header);
+    used_bytes_ += sizeof(header);
+  }
+
+  SampleRecordHeader record{};
+  record.stamp_ns = sample.stamp_ns;
+  record.confidence = sample.confidence;
+  record.rows = static_cast<uint16_t>(image.rows);
+  record.cols = static_cast<uint16_t>(image.cols);
+  record.type = image.type();
+  record.label_size = static_cast<uint32_t>(sample.label.size());
+  // The copy made by submit() is continuous
+  const size_t image_bytes = image.total() * image.elemSize();
+  const bool ok =
+    std::fwrite(&record, sizeof(record), 1, shard_) == 1 &&
+    std::fwrite(sample.label.data(), 1, sample.label.size(), shard_) == sample.label.size() &&
+    std::fwrite(image.data, 1, image_bytes, shard_) == image_bytes;
+  const uint64_t size = sizeof(record) + sample.label.size() + image_bytes;
+  shard_size_ += size;
+  used_bytes_ += size;
+  return ok;
+}
+
+std::unique_ptr<SampleDumper> declareSampleDumper(rclcpp::Node &node) {
+  SampleDumper::Params params;
+  const bool enable = node.declare_parameter("sample_dump.enable", false);
+  params.directory = node.declare_parameter(
+    "sample_dump.directory", (fs::path("/tmp/fyt_samples") / node.get_name()).string());
+  const std::string format = node.declare_parameter("sample_dump.format", std::string("png"));
+  params.max_rate = node.declare_parameter("sample_dump.max_rate", params.max_rate);
+  params.quota_mb = node.declare_parameter("sample_dump.quota_mb", params.quota_mb);
+  params.shard_mb = node.declare_parameter("sample_dump.shard_mb", params.shard_mb);
+  if (!enable) {
+    return nullptr;
+  }
+  if (!SampleDumper::parseFormat(format, params.format)) {
+    RCLCPP_WARN(node.get_logger(), "Unknown sample_dump.format %s, png is used", format.c_str());
+  }
+  return std::make_unique<SampleDumper>(params);
+}
+
+}  // namespace fyt::utils
@@ -0,0 +1,144 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/stall_watchdog.hpp"
+
+// std
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+// 3rd party
+#include <fmt/format.h>
+// project
+#include "rm_utils/flight_recorder.hpp"
+#include "rm_utils/thread_config.hpp"
+
+namespace fyt::utils {
+
+StallWatchdog::StallWatchdog(Metrics &metrics, double rate) : metrics_(metrics) {
+  period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(1.0 / std::clamp(rate, 1.0, 1000.0)));
+  thread_ = std::thread(&StallWatchdog::run, this);
+}
+
+StallWatchdog::~StallWatchdog() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void StallWatchdog::watch(Stage stage) {
+  auto &recoveries = metrics_.counter(stage.name + "_recoveries");
+  std::lock_guard<std::mutex> lock(mutex_);
+  Watched watched{std::move(stage), &recoveries, 0, 0, std::chrono::steady_clock::now(), false};
+  watched.last_progress = watched.stage.progress->load(std::memory_order_relaxed);
+  if (watched.stage.demand != nullptr) {
+    watched.demand_at_progress = watched.stage.demand->load(std::memory_order_relaxed);
+  }
+  stages_.emplace_back(std::move(watched));
+}
+
+bool StallWatchdog::check(Watched &watched, std::chrono::steady_clock::time_point now) {
+  const Stage &stage = watched.stage;
+  const int64_t progress = stage.progress->load(std::memory_order_relaxed);
+  const int64_t demand =
+    stage.demand != nullptr ? stage.demand->load(std::memory_order_relaxed) : 0;
+  if (progress != watched.last_progress) {
+    watched.last_progress = progress;
+    watched.demand_at_progress = demand;
+    watched.since = now;
+    watched.dumped = false;
+    return false;
+  }
+  if (stage.demand != nullptr && demand == watched.demand_at_progress) {
+    // Idle, nothing to do is no stall
+    watched.since = now;
+    return false;
+  }
+  return now - watched.since > stage.timeout;
+}
+
+bool StallWatchdog::takeDump(Watched &watched, std::chrono::steady_clock::time_point now) {
+  if (watched.dumped || dumps_ >= MAX_DUMPS ||
+      (dumps_ > 0 && now - last_dump_ < DUMP_INTERVAL)) {
+    return false;
+  }
+  watched.dumped = true;
+  dumps_++;
+  last_dump_ = now;
+  return true;
+}
+
+void StallWatchdog::run() {
+  configureThread("watchdog");
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto next = std::chrono::steady_clock::now();
+  while (true) {
+    next += period_;
+    if (cv_.wait_until(lock, next, [this]() { return stop_; })) {
+      return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    // A late wakeup does not make a burst of checks
+    next = std::max(next, now - period_);
+    // By index, a recovery may watch new stages while the lock is released
+    for (size_t i = 0; i < stages_.size(); i++) {
+      if (!check(stages_[i], now)) {
+        continue;
+      }
+      const auto stalled_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - stages_[i].since).count();
+      fmt::print(stderr,
+                 "[watchdog] {} stalled for {} ms, recovering\n",
+                 stages_[i].stage.name,
+                 stalled_ms);
+      stages_[i].recoveries->fetch_add(1, std::memory_order_relaxed);
+      FlightRecorder::record(
+        FlightEvent::STALL, static_cast<int16_t>(i), 0, {static_cast<float>(stalled_ms)});
+      const bool dump = takeDump(stages_[i], now);
+      const std::string reason = "watchdog_" + stages_[i].stage.name;
+      const auto recover = stages_[i].stage.recover;
+      lock.unlock();
+      recover();
+      // The last seconds before the stall, for the post-mortem. After the recovery, which the
+      // write to disk would delay
+      if (dump) {
+        FlightRecorder::dump(reason.c_str());
+      }
+      lock.lock();
+      // Progress made during the recovery counts from its end, and the component is given the
+      // cooldown to come back
+      Watched &watched = stages_[i];
+      watched.last_progress = watched.stage.progress->load(std::memory_order_relaxed);
+      if (watched.stage.demand != nullptr) {
+        watched.demand_at_progress = watched.stage.demand->load(std::memory_order_relaxed);
+      }
+      watched.since = std::chrono::steady_clock::now() + watched.stage.cooldown;
+    }
+  }
+}
+
+std::unique_ptr<StallWatchdog> declareStallWatchdog(rclcpp::Node &node, Metrics &metrics) {
+  const bool enable = node.declare_parameter("watchdog.enable", true);
+  const double rate = node.declare_parameter("watchdog.rate", 20.0);
+  if (!enable) {
+    return nullptr;
+  }
+  return std::make_unique<StallWatchdog>(metrics, rate);
+}
+
+}  // namespace fyt::utils
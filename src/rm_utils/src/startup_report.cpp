@@ -0,0 +1,81 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "rm_utils/startup_report.hpp"
+
+// std
+#include <algorithm>
+// third party
+#include <fmt/format.h>
+
+namespace fyt::utils {
+namespace {
+double msSince(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin)
+    .count();
+}
+}  // namespace
+
+void StartupReport::begin(const std::string &step) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  steps_.push_back(Step{step, std::chrono::steady_clock::now()});
+}
+
+bool StartupReport::finish(const std::string &step) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find_if(
+    steps_.begin(), steps_.end(), [&step](const Step &s) { return s.name == step && s.ms < 0; });
+  if (it == steps_.end()) {
+    return false;
+  }
+  it->ms = msSince(it->begin);
+  if (std::any_of(steps_.begin(), steps_.end(), [](const Step &s) { return s.ms < 0; })) {
+    return false;
+  }
+  startup_ms_ = msSince(created_);
+  ready_.store(true, std::memory_order_release);
+  publishGauges();
+  return true;
+}
+
+void StartupReport::attach(Metrics &metrics) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ready_gauge_ = &metrics.gauge("ready");
+  startup_gauge_ = &metrics.gauge("startup_ms");
+  publishGauges();
+}
+
+void StartupReport::publishGauges() {
+  if (ready_gauge_ == nullptr) {
+    return;
+  }
+  const bool ready = ready_.load(std::memory_order_relaxed);
+  ready_gauge_->store(ready ? 1 : 0, std::memory_order_relaxed);
+  startup_gauge_->store(ready ? static_cast<int64_t>(startup_ms_) : 0, std::memory_order_relaxed);
+}
+
+std::string StartupReport::summary() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string res = ready_.load(std::memory_order_relaxed)
+                      ? fmt::format("ready in {:.1f} ms", startup_ms_)
+                      : fmt::format("not ready after {:.1f} ms", msSince(created_));
+  for (size_t i = 0; i < steps_.size(); i++) {
+    const Step &s = steps_[i];
+    res += i == 0 ? ": " : ", ";
+    res += s.ms < 0 ? fmt::format("{} pending", s.name) : fmt::format("{} {:.1f} ms", s.name, s.ms);
+  }
+  return res;
+}
+}  // namespace fyt::utils
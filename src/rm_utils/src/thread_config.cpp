@@ -0,0 +1,214 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/thread_config.hpp"
+
+// std
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <sstream>
+// system
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fyt::utils {
+
+namespace {
+bool parseInt(const std::string &text, int &value) {
+  if (text.empty() || text.size() > 4) {
+    return false;
+  }
+  for (char c : text) {
+    if (!std::isdigit(static_cast<unsigned char>(c))) {
+      return false;
+    }
+  }
+  value = std::stoi(text);
+  return true;
+}
+
+bool parseCpus(const std::string &text, std::vector<int> &cpus) {
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    const auto dash = item.find('-');
+    int first = 0;
+    int last = 0;
+    if (dash == std::string::npos) {
+      if (!parseInt(item, first)) {
+        return false;
+      }
+      last = first;
+    } else if (!parseInt(item.substr(0, dash), first) ||
+               !parseInt(item.substr(dash + 1), last) || last < first) {
+      return false;
+    }
+    if (last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return !cpus.empty();
+}
+
+std::string trim(const std::string &text) {
+  const auto begin = text.find_first_not_of(" \t");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  const auto end = text.find_last_not_of(" \t");
+  return text.substr(begin, end - begin + 1);
+}
+
+// Apply to the thread tid, 0 for the calling thread. No cores or priority resets what the
+// thread inherited from its creator
+bool applySchedule(pid_t tid, const ThreadSchedule &schedule) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (schedule.cpus.empty()) {
+    // The kernel drops the cores outside of the cpuset of the process
+    const long cores = ::sysconf(_SC_NPROCESSORS_CONF);
+    for (int cpu = 0; cpu < cores && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &set);
+    }
+  } else {
+    for (int cpu : schedule.cpus) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  bool ok = ::sched_setaffinity(tid, sizeof(set), &set) == 0;
+  sched_param param{};
+  param.sched_priority = schedule.priority;
+  // SCHED_FIFO needs CAP_SYS_NICE or a rtprio limit, going back to SCHED_OTHER does not
+  ok = ::sched_setscheduler(tid, schedule.priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param) == 0 &&
+       ok;
+  return ok;
+}
+
+const ThreadSchedule *findSchedule(const ThreadConfig &config, const std::string &name) {
+  auto it = config.schedules.find(name);
+  if (it == config.schedules.end()) {
+    const auto end = name.find_last_not_of("0123456789");
+    if (end != std::string::npos && end + 1 < name.size()) {
+      it = config.schedules.find(name.substr(0, end + 1));
+    }
+  }
+  return it == config.schedules.end() ? nullptr : &it->second;
+}
+
+// Parsed once, the first call also configures the process
+const ThreadConfig &processConfig() {
+  static ThreadConfig config;
+  static std::once_flag once;
+  std::call_once(once, [] {
+    const char *text = std::getenv("FYT_THREAD_CONFIG");
+    if (text == nullptr || text[0] == '\0') {
+      return;
+    }
+    if (!parseThreadConfig(text, config)) {
+      std::fprintf(stderr, "[thread_config] Malformed FYT_THREAD_CONFIG: %s\n", text);
+      config = ThreadConfig();
+      return;
+    }
+    if (config.lock_memory && ::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      std::fprintf(stderr, "[thread_config] mlockall() failed: %s\n", std::strerror(errno));
+    }
+    // The threads that exist so far, i.e. the executor, DDS and the thread calling us. Newer
+    // threads inherit the cores of their creator
+    if (const ThreadSchedule *schedule = findSchedule(config, "default")) {
+      std::error_code ec;
+      for (const auto &task : std::filesystem::directory_iterator("/proc/self/task", ec)) {
+        const pid_t tid = static_cast<pid_t>(std::atoi(task.path().filename().c_str()));
+        if (tid > 0 && !applySchedule(tid, *schedule)) {
+          std::fprintf(stderr, "[thread_config] Failed to apply the default to thread %d\n", tid);
+        }
+      }
+    }
+  });
+  return config;
+}
+}  // namespace
+
+bool parseThreadConfig(const std::string &text, ThreadConfig &config) {
+  ThreadConfig parsed;
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ';')) {
+    item = trim(item);
+    if (item.empty()) {
+      continue;
+    }
+    if (item == "mlockall") {
+      parsed.lock_memory = true;
+      continue;
+    }
+    const auto eq = item.find('=');
+    if (eq == std::string::npos || eq == 0) {
+      return false;
+    }
+    ThreadSchedule schedule;
+    std::string value = trim(item.substr(eq + 1));
+    const auto colon = value.find(':');
+    if (colon != std::string::npos) {
+      if (!parseInt(trim(value.substr(colon + 1)), schedule.priority) ||
+          schedule.priority < 1 || schedule.priority > 99) {
+        return false;
+      }
+      value = trim(value.substr(0, colon));
+    }
+    if (!value.empty() && !parseCpus(value, schedule.cpus)) {
+      return false;
+    }
+    parsed.schedules[trim(item.substr(0, eq))] = schedule;
+  }
+  config = std::move(parsed);
+  return true;
+}
+
+ThreadSchedule findThreadSchedule(const ThreadConfig &config, const std::string &name) {
+  if (const ThreadSchedule *schedule = findSchedule(config, name)) {
+    return *schedule;
+  }
+  if (const ThreadSchedule *schedule = findSchedule(config, "default")) {
+    return *schedule;
+  }
+  return ThreadSchedule();
+}
+
+void configureThread(const std::string &name) {
+  // The kernel keeps 15 characters
+  ::pthread_setname_np(::pthread_self(), name.substr(0, 15).c_str());
+  const ThreadConfig &config = processConfig();
+  // Without a config the launch file (e.g. taskset) decides
+  if (config.schedules.empty()) {
+    return;
+  }
+  if (!applySchedule(0, findThreadSchedule(config, name))) {
+    std::fprintf(stderr,
+                 "[thread_config] Failed to apply the schedule of %s: %s\n",
+                 name.c_str(),
+                 std::strerror(errno));
+  }
+}
+
+}  // namespace fyt::utils
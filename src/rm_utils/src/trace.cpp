@@ -0,0 +1,192 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/trace.hpp"
+
+// std
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+// system
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// project
+#include "rm_utils/spsc_queue.hpp"
+#include "rm_utils/thread_config.hpp"
+
+namespace fyt::utils {
+
+namespace {
+constexpr size_t THREAD_BUFFER_SIZE = 4096;
+constexpr auto WRITE_PERIOD = std::chrono::milliseconds(10);
+
+struct ThreadBuffer {
+  SpscQueue<TraceRecord, THREAD_BUFFER_SIZE> queue;
+  uint32_t thread_id = 0;
+  std::atomic<uint64_t> dropped{0};
+};
+
+// Never destroyed, the buffers of the threads that have exited are kept
+struct TraceWriter {
+  // Guards the buffer list and the file
+  std::mutex mutex;
+  std::vector<ThreadBuffer *> buffers;
+  int fd = -1;
+  void *map = nullptr;
+  size_t map_size = 0;
+  size_t capacity = 0;
+  TraceFileHeader *header = nullptr;
+  TraceRecord *records = nullptr;
+  std::thread thread;
+  std::atomic<bool> running{false};
+  bool atexit_registered = false;
+
+  // Copy the buffered records into the file, called with the mutex held
+  void drain() {
+    if (header == nullptr) {
+      return;
+    }
+    uint64_t dropped = 0;
+    for (ThreadBuffer *buffer : buffers) {
+      TraceRecord record;
+      while (buffer->queue.pop(record)) {
+        if (header->count < capacity) {
+          records[header->count++] = record;
+        } else {
+          dropped++;
+        }
+      }
+      dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    header->dropped += dropped;
+  }
+
+  void run() {
+    configureThread("trace_writer");
+    while (running.load(std::memory_order_acquire)) {
+      std::this_thread::sleep_for(WRITE_PERIOD);
+      std::lock_guard<std::mutex> lock(mutex);
+      drain();
+    }
+  }
+};
+
+TraceWriter &writer() {
+  static auto *trace_writer = new TraceWriter();
+  return *trace_writer;
+}
+
+thread_local ThreadBuffer *t_buffer = nullptr;
+}  // namespace
+
+std::atomic<bool> Trace::enabled_{false};
+thread_local uint64_t Trace::current_frame_ = 0;
+
+bool Trace::start(const std::string &path, size_t max_mb) {
+  auto &w = writer();
+  std::lock_guard<std::mutex> lock(w.mutex);
+  if (w.header != nullptr) {
+    return false;
+  }
+  w.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (w.fd < 0) {
+    return false;
+  }
+  w.capacity = (max_mb << 20) / sizeof(TraceRecord);
+  w.map_size = sizeof(TraceFileHeader) + w.capacity * sizeof(TraceRecord);
+  if (::ftruncate(w.fd, static_cast<off_t>(w.map_size)) != 0) {
+    ::close(w.fd);
+    w.fd = -1;
+    return false;
+  }
+  w.map = ::mmap(nullptr, w.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, w.fd, 0);
+  if (w.map == MAP_FAILED) {
+    ::close(w.fd);
+    w.fd = -1;
+    w.map = nullptr;
+    return false;
+  }
+  w.header = static_cast<TraceFileHeader *>(w.map);
+  std::memcpy(w.header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  w.header->version = TRACE_VERSION;
+  w.header->record_size = sizeof(TraceRecord);
+  w.header->count = 0;
+  w.header->dropped = 0;
+  w.records = reinterpret_cast<TraceRecord *>(static_cast<char *>(w.map) +
+                                              sizeof(TraceFileHeader));
+
+  w.running.store(true, std::memory_order_release);
+  w.thread = std::thread(&TraceWriter::run, &w);
+  if (!w.atexit_registered) {
+    std::atexit([] { Trace::stop(); });
+    w.atexit_registered = true;
+  }
+  enabled_.store(true, std::memory_order_release);
+  return true;
+}
+
+void Trace::stop() {
+  auto &w = writer();
+  enabled_.store(false, std::memory_order_release);
+  w.running.store(false, std::memory_order_release);
+  if (w.thread.joinable()) {
+    w.thread.join();
+  }
+  std::lock_guard<std::mutex> lock(w.mutex);
+  if (w.header == nullptr) {
+    return;
+  }
+  w.drain();
+  const size_t used = sizeof(TraceFileHeader) + w.header->count * sizeof(TraceRecord);
+  ::msync(w.map, used, MS_SYNC);
+  ::munmap(w.map, w.map_size);
+  [[maybe_unused]] int ret = ::ftruncate(w.fd, static_cast<off_t>(used));
+  ::close(w.fd);
+  w.fd = -1;
+  w.map = nullptr;
+  w.header = nullptr;
+  w.records = nullptr;
+}
+
+bool Trace::startFromEnv() {
+  const char *path = std::getenv("FYT_TRACE_FILE");
+  if (path == nullptr || path[0] == '\0') {
+    return false;
+  }
+  return start(std::string(path) + "." + std::to_string(::getpid()));
+}
+
+void Trace::record(TraceStage stage, uint64_t frame_id, int64_t begin_ns, int64_t end_ns) {
+  if (!enabled()) {
+    return;
+  }
+  if (t_buffer == nullptr) {
+    t_buffer = new ThreadBuffer();
+    t_buffer->thread_id = static_cast<uint32_t>(::syscall(SYS_gettid));
+    auto &w = writer();
+    std::lock_guard<std::mutex> lock(w.mutex);
+    w.buffers.push_back(t_buffer);
+  }
+  TraceRecord record{
+    frame_id, begin_ns, end_ns, t_buffer->thread_id, static_cast<uint16_t>(stage), 0};
+  if (!t_buffer->queue.push(record)) {
+    t_buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace fyt::utils
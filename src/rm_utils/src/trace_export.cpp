@@ -0,0 +1,103 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Convert binary trace files to the Chrome trace format (JSON), for chrome://tracing or
+// https://ui.perfetto.dev
+//
+// Usage:
+//   ros2 run rm_utils trace_export <trace file>... > trace.json
+//
+// Every file (one per process) is shown as a process, every thread as a track, and every
+// record as a slice named by its stage with the frame id as an argument.
+
+// std
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+// project
+#include "rm_utils/trace.hpp"
+
+using namespace fyt::utils;
+
+namespace {
+bool readTrace(const char *path, std::vector<TraceRecord> &records, TraceFileHeader &header) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+      header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+    std::cerr << path << " is not a trace file of version " << TRACE_VERSION << std::endl;
+    return false;
+  }
+  records.resize(header.count);
+  file.read(reinterpret_cast<char *>(records.data()), header.count * sizeof(TraceRecord));
+  // A file left by a crash may be shorter than the count
+  records.resize(file.gcount() / sizeof(TraceRecord));
+  return true;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: trace_export <trace file>... > trace.json" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::vector<TraceRecord>> files;
+  int64_t first_ns = std::numeric_limits<int64_t>::max();
+  for (int i = 1; i < argc; i++) {
+    TraceFileHeader header;
+    std::vector<TraceRecord> records;
+    if (!readTrace(argv[i], records, header)) {
+      return 1;
+    }
+    std::cerr << argv[i] << ": " << records.size() << " records, " << header.dropped
+              << " dropped" << std::endl;
+    for (const auto &record : records) {
+      first_ns = std::min(first_ns, record.begin_ns);
+    }
+    files.emplace_back(std::move(records));
+  }
+
+  // Timestamps in us relative to the first record
+  std::printf("{\"displayTimeUnit\":\"us\",\"traceEvents\":[\n");
+  bool first = true;
+  for (size_t pid = 0; pid < files.size(); pid++) {
+    std::printf("%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%zu,\"tid\":0,"
+                "\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n",
+                pid + 1,
+                argv[pid + 1]);
+    first = false;
+    for (const auto &record : files[pid]) {
+      const char *name = record.stage < static_cast<uint16_t>(TraceStage::COUNT)
+                           ? TraceStageNames[record.stage]
+                           : "unknown";
+      std::printf(",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%zu,\"tid\":%u,\"ts\":%.3f,"
+                  "\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                  name,
+                  pid + 1,
+                  record.thread_id,
+                  (record.begin_ns - first_ns) / 1e3,
+                  (record.end_ns - record.begin_ns) / 1e3,
+                  static_cast<unsigned long long>(record.frame_id));
+    }
+  }
+  std::printf("\n]}\n");
+  return 0;
+}
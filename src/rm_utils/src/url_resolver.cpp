@@ -19,6 +19,8 @@
 #include "rm_utils/url_resolver.hpp"
 
 #include <filesystem>
+#include <mutex>
+#include <unordered_map>
 
 #include "ament_index_cpp/get_package_share_directory.hpp"
 #include "rcpputils/env.hpp"
@@ -131,8 +133,21 @@ std::string URLResolver::getPackageFileName(const std::string &url) {
   size_t rest = url.find('/', prefix_len);
   std::string package(url.substr(prefix_len, rest - prefix_len));
 
-  // Look up the ROS package path name.
-  std::string pkg_path = ament_index_cpp::get_package_share_directory(package);
+  // Look up the ROS package path name, once per package since every lookup goes through the
+  // ament index on disk
+  static std::mutex cache_mutex;
+  static std::unordered_map<std::string, std::string> share_directories;
+  std::string pkg_path;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = share_directories.find(package);
+    if (it == share_directories.end()) {
+      it = share_directories
+             .emplace(package, ament_index_cpp::get_package_share_directory(package))
+             .first;
+    }
+    pkg_path = it->second;
+  }
   if (pkg_path.empty()) {  // package not found?
     return pkg_path;
   } else {
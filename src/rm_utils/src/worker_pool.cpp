@@ -0,0 +1,128 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rm_utils/worker_pool.hpp"
+
+// std
+#include <algorithm>
+#include <string>
+// project
+#include "rm_utils/thread_config.hpp"
+
+namespace fyt::utils {
+
+namespace {
+thread_local bool in_worker = false;
+}  // namespace
+
+WorkerPool &WorkerPool::instance(size_t thread_num) {
+  static WorkerPool pool(thread_num);
+  return pool;
+}
+
+WorkerPool::WorkerPool(size_t thread_num) {
+  if (thread_num == 0) {
+    const size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    thread_num = std::min<size_t>(cores - 1, 3);
+  }
+  workers_.reserve(thread_num);
+  for (size_t i = 0; i < thread_num; i++) {
+    workers_.emplace_back([this, i]() {
+      configureThread("worker" + std::to_string(i));
+      workerLoop();
+    });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+bool WorkerPool::tryRun(size_t n, Invoke invoke, void *context) {
+  if (in_worker) {
+    return false;
+  }
+  std::unique_lock<std::mutex> call(call_mtx_, std::try_to_lock);
+  if (!call.owns_lock()) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    n_ = n;
+    invoke_ = invoke;
+    context_ = context;
+    next_.store(0, std::memory_order_relaxed);
+    open_ = true;
+    generation_++;
+  }
+  start_cv_.notify_all();
+
+  runItems(n, invoke, context);
+
+  // All items are taken, wait for the workers still running one. Workers that wake up later
+  // find the loop closed
+  std::unique_lock<std::mutex> lock(mtx_);
+  done_cv_.wait(lock, [this] { return active_ == 0; });
+  open_ = false;
+  return true;
+}
+
+void WorkerPool::runItems(size_t n, Invoke invoke, void *context) noexcept {
+  for (size_t i = next_.fetch_add(1, std::memory_order_relaxed); i < n;
+       i = next_.fetch_add(1, std::memory_order_relaxed)) {
+    invoke(context, i);
+  }
+}
+
+void WorkerPool::workerLoop() {
+  in_worker = true;
+  uint64_t seen = 0;
+  while (true) {
+    size_t n;
+    Invoke invoke;
+    void *context;
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      start_cv_.wait(lock, [&] { return stop_ || (open_ && generation_ != seen); });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      n = n_;
+      invoke = invoke_;
+      context = context_;
+      active_++;
+    }
+
+    runItems(n, invoke, context);
+
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      active_--;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+}  // namespace fyt::utils
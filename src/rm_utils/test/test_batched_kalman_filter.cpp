@@ -0,0 +1,186 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// std
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+// gtest
+#include <gtest/gtest.h>
+// project
+#include "rm_utils/math/batched_kalman_filter.hpp"
+#include "rm_utils/math/extended_kalman_filter.hpp"
+
+using namespace fyt;
+
+namespace {
+constexpr int N_X = 4, N_Z = 2, K = 8;
+constexpr double DT = 0.01;
+using MatrixXX = Eigen::Matrix<double, N_X, N_X>;
+using MatrixZX = Eigen::Matrix<double, N_Z, N_X>;
+using MatrixZZ = Eigen::Matrix<double, N_Z, N_Z>;
+using MatrixX1 = Eigen::Matrix<double, N_X, 1>;
+using MatrixZ1 = Eigen::Matrix<double, N_Z, 1>;
+
+// Constant velocity in the plane, x = (x, vx, y, vy)
+struct Predict {
+  static constexpr bool is_linear = true;
+  template <typename T>
+  void operator()(const T x0[N_X], T x1[N_X]) const {
+    x1[0] = x0[0] + DT * x0[1];
+    x1[1] = x0[1];
+    x1[2] = x0[2] + DT * x0[3];
+    x1[3] = x0[3];
+  }
+  void jacobian(const MatrixX1 &, MatrixXX &F) const {
+    F << 1, DT, 0, 0, 0, 1, 0, 0, 0, 0, 1, DT, 0, 0, 0, 1;
+  }
+};
+
+// Bearing and range from the origin
+struct Measure {
+  template <typename T>
+  void operator()(const T x[N_X], T z[N_Z]) const {
+    z[0] = std::atan2(x[2], x[0]);
+    z[1] = std::hypot(x[0], x[2]);
+  }
+  void jacobian(const MatrixX1 &x, MatrixZX &H) const {
+    const double r2 = x(0) * x(0) + x(2) * x(2);
+    const double r = std::sqrt(r2);
+    H << -x(2) / r2, 0, x(0) / r2, 0, x(0) / r, 0, x(2) / r, 0;
+  }
+};
+
+using Ekf = ExtendedKalmanFilter<N_X, N_Z, Predict, Measure>;
+
+MatrixXX randomCovariance(std::mt19937 &rng) {
+  std::uniform_real_distribution<double> u(-0.5, 0.5);
+  MatrixXX A;
+  for (int i = 0; i < N_X * N_X; i++) {
+    A(i) = u(rng);
+  }
+  return A * A.transpose() + 0.1 * MatrixXX::Identity();
+}
+
+// K tracks run through the batch and through one ExtendedKalmanFilter each, with random masks.
+// Lane 5 gets a negative noise every few frames, its innovation covariance is then not positive
+// definite and both filters keep the prediction
+template <typename Scalar>
+void compareWithScalarFilters(double tolerance) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> u(-1.0, 1.0);
+  std::normal_distribution<double> noise(0.0, 1.0);
+
+  Predict predict;
+  MatrixXX F;
+  predict.jacobian(MatrixX1::Zero(), F);
+  const MatrixXX Q = 0.01 * MatrixXX::Identity();
+
+  BatchedKalmanFilter<N_X, N_Z, K, Scalar> batch;
+  std::array<Ekf, K> ekfs;
+  std::array<MatrixZZ, K> R;
+  for (int k = 0; k < K; k++) {
+    MatrixX1 x0;
+    x0 << 6 + 2 * u(rng), u(rng), 3 * u(rng), u(rng);
+    const MatrixXX P0 = randomCovariance(rng);
+    R[k] << 1e-3 * (1 + k), 1e-4, 1e-4, 1e-2;
+    ekfs[k] = Ekf(
+      predict, Measure(), [Q]() { return Q; }, [&R, k](const MatrixZ1 &) { return R[k]; }, P0);
+    ekfs[k].setState(x0);
+    batch.setState(k, x0);
+    batch.setCovariance(k, P0);
+  }
+
+  typename BatchedKalmanFilter<N_X, N_Z, K, Scalar>::MeasurementLanes z;
+  typename BatchedKalmanFilter<N_X, N_Z, K, Scalar>::NoiseLanes noise_lanes;
+  for (int frame = 0; frame < 50; frame++) {
+    batch.predict(F, Q);
+    const uint64_t mask = std::uniform_int_distribution<uint64_t>(0, (1u << K) - 1)(rng);
+    const bool degenerate = frame % 5 == 0;
+    uint64_t expected = 0;
+    for (int k = 0; k < K; k++) {
+      ekfs[k].predict();
+      MatrixZZ r = R[k];
+      if (k == 5 && degenerate) {
+        r = -100 * MatrixZZ::Identity();
+        ekfs[k].setUpdateRFunc([r](const MatrixZ1 &) { return r; });
+      }
+      MatrixZ1 zk;
+      Measure()(ekfs[k].getState().data(), zk.data());
+      zk += 0.05 * MatrixZ1(noise(rng), noise(rng));
+      for (int m = 0; m < N_Z; m++) {
+        z[m][k] = static_cast<Scalar>(zk(m));
+        for (int n = 0; n < N_Z; n++) {
+          noise_lanes[m][n][k] = static_cast<Scalar>(r(m, n));
+        }
+      }
+      if ((mask >> k) & 1) {
+        ekfs[k].update(zk);
+        if (std::isfinite(ekfs[k].getLogLikelihood())) {
+          expected |= uint64_t{1} << k;
+        }
+      } else {
+        // Not measured, the prediction stands
+        ekfs[k].setCovariance(ekfs[k].getPredictedCovariance());
+      }
+      if (k == 5 && degenerate) {
+        ekfs[k].setUpdateRFunc([&R](const MatrixZ1 &) { return R[5]; });
+      }
+    }
+
+    auto measure_lanes = [](const auto &x, auto &z_pri, auto &H) {
+      for (int k = 0; k < K; k++) {
+        MatrixX1 xk;
+        for (int i = 0; i < N_X; i++) {
+          xk(i) = x[i][k];
+        }
+        MatrixZ1 zk;
+        MatrixZX Hk;
+        Measure()(xk.data(), zk.data());
+        Measure().jacobian(xk, Hk);
+        for (int m = 0; m < N_Z; m++) {
+          z_pri[m][k] = static_cast<Scalar>(zk(m));
+          for (int i = 0; i < N_X; i++) {
+            H[m][i][k] = static_cast<Scalar>(Hk(m, i));
+          }
+        }
+      }
+    };
+    const uint64_t updated = batch.update(z, noise_lanes, mask, measure_lanes);
+    ASSERT_EQ(updated, expected) << "frame " << frame;
+
+    for (int k = 0; k < K; k++) {
+      const MatrixX1 dx = batch.getState(k) - ekfs[k].getState();
+      const MatrixXX dP = batch.getCovariance(k) - ekfs[k].getCovariance();
+      EXPECT_LT(dx.norm(), tolerance * (1 + ekfs[k].getState().norm()))
+        << "frame " << frame << ", lane " << k;
+      EXPECT_LT(dP.norm(), tolerance * ekfs[k].getCovariance().norm())
+        << "frame " << frame << ", lane " << k;
+      if ((updated >> k) & 1) {
+        EXPECT_NEAR(batch.getLogLikelihood(k), ekfs[k].getLogLikelihood(), 100 * tolerance);
+      } else {
+        EXPECT_EQ(batch.getLogLikelihood(k), -std::numeric_limits<double>::infinity());
+      }
+    }
+  }
+}
+}  // namespace
+
+TEST(BatchedKalmanFilter, MatchesExtendedKalmanFilter) { compareWithScalarFilters<double>(1e-12); }
+
+TEST(BatchedKalmanFilter, FloatLanesMatchExtendedKalmanFilter) {
+  compareWithScalarFilters<float>(1e-5);
+}
@@ -0,0 +1,101 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// std
+#include <cmath>
+#include <cstdint>
+#include <random>
+// gtest
+#include <gtest/gtest.h>
+// project
+#include "rm_utils/device_clock.hpp"
+
+using namespace fyt::utils;
+
+namespace {
+// 1 MHz device ticks, frames at 200 Hz
+constexpr double TICK_NS = 1000.0;
+constexpr int64_t FRAME_NS = 5'000'000;
+constexpr int64_t HOST_START_NS = 1'700'000'000'000'000'000;
+constexpr uint64_t DEVICE_START_TICKS = 123'456'789;
+// The fastest transfer
+constexpr int64_t MIN_DELAY_NS = 100'000;
+
+// A frame exposed at device time t is received at the host time of t plus a delay of at least
+// MIN_DELAY_NS, mostly a few hundred us more. The device runs drift_ppm slow
+struct Camera {
+  double drift_ppm;
+  std::mt19937 rng{7};
+  std::exponential_distribution<double> jitter{1.0 / 300'000};
+
+  uint64_t ticks(int frame) const {
+    return DEVICE_START_TICKS + static_cast<uint64_t>(frame * FRAME_NS / TICK_NS);
+  }
+  // Host time of the exposure
+  int64_t exposure(int frame) const {
+    return HOST_START_NS + std::llround(frame * FRAME_NS * (1 + drift_ppm * 1e-6));
+  }
+  int64_t receive(int frame) { return exposure(frame) + MIN_DELAY_NS + std::llround(jitter(rng)); }
+};
+}  // namespace
+
+TEST(DeviceClock, FitsTheDriftUnderTheDelays) {
+  DeviceClock clock(TICK_NS);
+  Camera camera{50.0};
+  // 30 s
+  for (int frame = 0; frame < 6000; frame++) {
+    const int64_t receive = camera.receive(frame);
+    const int64_t mapped = clock.update(camera.ticks(frame), receive);
+    ASSERT_LE(mapped, receive) << "frame " << frame;
+    if (frame >= 1000) {
+      // The mapping follows the fastest transfer, the jitter is not in it
+      EXPECT_NEAR(mapped - camera.exposure(frame), MIN_DELAY_NS, 40'000) << "frame " << frame;
+    }
+  }
+  EXPECT_NEAR(clock.driftPpm(), 50.0, 2.0);
+  // A second later, without samples
+  EXPECT_NEAR(
+    clock.toHost(camera.ticks(6200)) - camera.exposure(6200), MIN_DELAY_NS, 40'000);
+}
+
+TEST(DeviceClock, LowerEnvelopeIgnoresLateSamples) {
+  DeviceClock clock(TICK_NS);
+  Camera camera{0.0};
+  // Stop in the middle of a bucket
+  for (int frame = 0; frame < 1050; frame++) {
+    clock.update(camera.ticks(frame), camera.exposure(frame) + MIN_DELAY_NS);
+  }
+  const int64_t before = clock.toHost(camera.ticks(1050));
+  EXPECT_EQ(before, camera.exposure(1050) + MIN_DELAY_NS);
+  // A stall of 20 ms does not move the mapping
+  EXPECT_EQ(clock.update(camera.ticks(1050), camera.exposure(1050) + 20'000'000), before);
+  // A faster sample pulls it down at once
+  const int64_t mapped = clock.update(camera.ticks(1051), camera.exposure(1051) + 50'000);
+  EXPECT_EQ(mapped, camera.exposure(1051) + 50'000);
+}
+
+TEST(DeviceClock, RestartsWhenTheDeviceGoesBack) {
+  DeviceClock clock(TICK_NS);
+  Camera camera{80.0};
+  for (int frame = 0; frame < 2000; frame++) {
+    clock.update(camera.ticks(frame), camera.receive(frame));
+  }
+  EXPECT_GT(clock.driftPpm(), 0.0);
+
+  // Reopened, the device counts from zero again
+  const int64_t host = camera.receive(2000);
+  EXPECT_EQ(clock.update(0, host), host);
+  EXPECT_EQ(clock.driftPpm(), 0.0);
+  EXPECT_EQ(clock.toHost(1000), host + 1'000'000);
+}
@@ -0,0 +1,183 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+// gtest
+#include <gtest/gtest.h>
+// 3rd party
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+// project
+#include "rm_utils/sample_dumper.hpp"
+
+using namespace fyt::utils;
+namespace fs = std::filesystem;
+
+namespace {
+SampleDumper::Params makeParams(const std::string &name, SampleDumper::Format format) {
+  SampleDumper::Params params;
+  params.directory = (fs::path(::testing::TempDir()) / "sample_dumper" / name).string();
+  fs::remove_all(params.directory);
+  params.format = format;
+  params.max_rate = 0;
+  return params;
+}
+
+cv::Mat makeCrop(int value) {
+  cv::Mat crop(20, 28, CV_8UC1);
+  for (int r = 0; r < crop.rows; r++) {
+    for (int c = 0; c < crop.cols; c++) {
+      crop.at<uchar>(r, c) = static_cast<uchar>(value + r * crop.cols + c);
+    }
+  }
+  return crop;
+}
+
+// The samples are dropped until the writer thread has set up the directory
+bool submitWhenReady(SampleDumper &dumper, const cv::Mat &image, const std::string &label,
+                     int64_t stamp_ns) {
+  for (int i = 0; i < 2000; i++) {
+    if (dumper.submit(image, label, stamp_ns)) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+std::vector<fs::path> listFiles(const fs::path &directory, const std::string &extension) {
+  std::vector<fs::path> files;
+  for (const auto &entry : fs::recursive_directory_iterator(directory)) {
+    if (entry.is_regular_file() && entry.path().extension() == extension) {
+      files.push_back(entry.path());
+    }
+  }
+  return files;
+}
+}  // namespace
+
+TEST(SampleDumper, ParseFormat) {
+  SampleDumper::Format format = SampleDumper::Format::PNG;
+  EXPECT_TRUE(SampleDumper::parseFormat("shard", format));
+  EXPECT_EQ(format, SampleDumper::Format::SHARD);
+  EXPECT_TRUE(SampleDumper::parseFormat("png", format));
+  EXPECT_EQ(format, SampleDumper::Format::PNG);
+  EXPECT_FALSE(SampleDumper::parseFormat("jpg", format));
+  EXPECT_EQ(format, SampleDumper::Format::PNG);
+}
+
+TEST(SampleDumper, ShardRoundTrip) {
+  const auto params = makeParams("shard", SampleDumper::Format::SHARD);
+  {
+    SampleDumper dumper(params);
+    ASSERT_TRUE(submitWhenReady(dumper, makeCrop(0), "num_0", 0));
+    for (int i = 1; i < 10; i++) {
+      ASSERT_TRUE(dumper.submit(makeCrop(i), "num_" + std::to_string(i % 3), i, 0.5f));
+    }
+    // The destructor writes what is still queued
+  }
+
+  const auto shards = listFiles(params.directory, ".bin");
+  ASSERT_EQ(shards.size(), 1u);
+  std::FILE *file = std::fopen(shards[0].c_str(), "rb");
+  ASSERT_NE(file, nullptr);
+  SampleShardHeader header{};
+  ASSERT_EQ(std::fread(&header, sizeof(header), 1, file), 1u);
+  EXPECT_EQ(std::memcmp(header.magic, SAMPLE_SHARD_MAGIC, sizeof(header.magic)), 0);
+  EXPECT_EQ(header.version, SAMPLE_SHARD_VERSION);
+
+  // In the order of submission
+  for (int i = 0; i < 10; i++) {
+    SampleRecordHeader record{};
+    ASSERT_EQ(std::fread(&record, sizeof(record), 1, file), 1u) << "record " << i;
+    EXPECT_EQ(record.stamp_ns, i);
+    EXPECT_FLOAT_EQ(record.confidence, i == 0 ? 1.0f : 0.5f);
+    ASSERT_EQ(record.rows, 20);
+    ASSERT_EQ(record.cols, 28);
+    ASSERT_EQ(record.type, CV_8UC1);
+    std::string label(record.label_size, '\0');
+    ASSERT_EQ(std::fread(label.data(), 1, label.size(), file), label.size());
+    EXPECT_EQ(label, i == 0 ? "num_0" : "num_" + std::to_string(i % 3));
+    cv::Mat image(record.rows, record.cols, record.type);
+    ASSERT_EQ(std::fread(image.data, 1, image.total(), file), image.total());
+    EXPECT_EQ(cv::norm(image, makeCrop(i), cv::NORM_INF), 0) << "record " << i;
+  }
+  char tail;
+  EXPECT_EQ(std::fread(&tail, 1, 1, file), 0u);
+  std::fclose(file);
+}
+
+TEST(SampleDumper, PngPerLabel) {
+  const auto params = makeParams("png", SampleDumper::Format::PNG);
+  {
+    SampleDumper dumper(params);
+    ASSERT_TRUE(submitWhenReady(dumper, makeCrop(1), "3", 1000));
+    ASSERT_TRUE(dumper.submit(makeCrop(2), "outpost", 2000, 0.75f));
+  }
+
+  const cv::Mat first = cv::imread(
+    (fs::path(params.directory) / "3" / "1000_100.png").string(), cv::IMREAD_UNCHANGED);
+  ASSERT_FALSE(first.empty());
+  EXPECT_EQ(cv::norm(first, makeCrop(1), cv::NORM_INF), 0);
+  const cv::Mat second = cv::imread(
+    (fs::path(params.directory) / "outpost" / "2000_075.png").string(), cv::IMREAD_UNCHANGED);
+  ASSERT_FALSE(second.empty());
+  EXPECT_EQ(cv::norm(second, makeCrop(2), cv::NORM_INF), 0);
+}
+
+TEST(SampleDumper, DropsAboveTheRate) {
+  auto params = makeParams("rate", SampleDumper::Format::SHARD);
+  params.max_rate = 1;
+  SampleDumper dumper(params);
+  ASSERT_TRUE(submitWhenReady(dumper, makeCrop(0), "num", 0));
+  const uint64_t dropped = dumper.dropped();
+  EXPECT_FALSE(dumper.submit(makeCrop(1), "num", 1));
+  EXPECT_FALSE(dumper.submit(makeCrop(2), "num", 2));
+  EXPECT_EQ(dumper.dropped(), dropped + 2);
+}
+
+TEST(SampleDumper, StopsAtTheQuota) {
+  auto params = makeParams("quota", SampleDumper::Format::SHARD);
+  // Less than the shard header, a record and a 20x28 crop
+  params.quota_mb = 512.0 / (1024 * 1024);
+  {
+    SampleDumper dumper(params);
+    ASSERT_TRUE(submitWhenReady(dumper, makeCrop(0), "num", 0));
+    for (int i = 1; i < 5; i++) {
+      dumper.submit(makeCrop(i), "num", i);
+    }
+    // Wait for the writer thread to reach the quota
+    for (int i = 0; i < 2000 && !dumper.quotaReached(); i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_TRUE(dumper.quotaReached());
+    EXPECT_EQ(dumper.dumped(), 1u);
+    EXPECT_FALSE(dumper.submit(makeCrop(5), "num", 5));
+  }
+
+  // A new dumper on the full directory saves nothing
+  SampleDumper dumper(params);
+  for (int i = 0; i < 2000 && !dumper.quotaReached(); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_TRUE(dumper.quotaReached());
+  EXPECT_FALSE(dumper.submit(makeCrop(0), "num", 0));
+}
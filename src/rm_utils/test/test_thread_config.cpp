@@ -0,0 +1,95 @@
+// Copyright (C) FYT Vision Group. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// std
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+// system
+#include <sched.h>
+// gtest
+#include <gtest/gtest.h>
+// project
+#include "rm_utils/thread_config.hpp"
+
+using namespace fyt::utils;
+
+TEST(ThreadConfig, Parse) {
+  ThreadConfig config;
+  ASSERT_TRUE(parseThreadConfig("default=0-1; serial_listen=6:90;perception=2,4;mlockall", config));
+  EXPECT_TRUE(config.lock_memory);
+  ASSERT_EQ(config.schedules.size(), 3u);
+  EXPECT_EQ(config.schedules["default"].cpus, (std::vector<int>{0, 1}));
+  EXPECT_EQ(config.schedules["default"].priority, 0);
+  EXPECT_EQ(config.schedules["serial_listen"].cpus, std::vector<int>{6});
+  EXPECT_EQ(config.schedules["serial_listen"].priority, 90);
+  EXPECT_EQ(config.schedules["perception"].cpus, (std::vector<int>{2, 4}));
+
+  // A malformed text leaves the config as it was
+  EXPECT_FALSE(parseThreadConfig("serial_listen=6:100", config));
+  EXPECT_FALSE(parseThreadConfig("serial_listen=3-1", config));
+  EXPECT_FALSE(parseThreadConfig("=1", config));
+  EXPECT_EQ(config.schedules.size(), 3u);
+}
+
+TEST(ThreadConfig, UnlistedNamesGetTheDefault) {
+  ThreadConfig config;
+  ASSERT_TRUE(parseThreadConfig("default=0-3;serial_listen=6:90;perception=4-5:70", config));
+  EXPECT_EQ(findThreadSchedule(config, "serial_listen").priority, 90);
+  EXPECT_EQ(findThreadSchedule(config, "perception1").cpus, (std::vector<int>{4, 5}));
+
+  const ThreadSchedule schedule = findThreadSchedule(config, "recorder");
+  EXPECT_EQ(schedule.cpus, (std::vector<int>{0, 1, 2, 3}));
+  EXPECT_EQ(schedule.priority, 0);
+
+  // Without a default: all cores and the default policy
+  ASSERT_TRUE(parseThreadConfig("serial_listen=6:90", config));
+  EXPECT_TRUE(findThreadSchedule(config, "recorder").cpus.empty());
+  EXPECT_EQ(findThreadSchedule(config, "recorder").priority, 0);
+}
+
+TEST(ThreadConfig, UnlistedThreadDropsTheCoresOfItsCreator) {
+  cpu_set_t all;
+  ASSERT_EQ(::sched_getaffinity(0, sizeof(all), &all), 0);
+  if (CPU_COUNT(&all) < 2) {
+    GTEST_SKIP() << "Needs two cores";
+  }
+  int core = 0;
+  while (!CPU_ISSET(core, &all)) {
+    core++;
+  }
+  // Read by the first configureThread() of the process
+  ::setenv("FYT_THREAD_CONFIG", ("listed=" + std::to_string(core)).c_str(), 1);
+
+  cpu_set_t listed;
+  cpu_set_t unlisted;
+  int policy = -1;
+  std::thread creator([&] {
+    configureThread("listed");
+    ::sched_getaffinity(0, sizeof(listed), &listed);
+    std::thread child([&] {
+      configureThread("unlisted");
+      ::sched_getaffinity(0, sizeof(unlisted), &unlisted);
+      policy = ::sched_getscheduler(0);
+    });
+    child.join();
+  });
+  creator.join();
+
+  EXPECT_EQ(CPU_COUNT(&listed), 1);
+  EXPECT_TRUE(CPU_ISSET(core, &listed));
+  EXPECT_TRUE(CPU_EQUAL(&unlisted, &all));
+  EXPECT_EQ(policy, SCHED_OTHER);
+}